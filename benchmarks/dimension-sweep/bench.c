@@ -0,0 +1,86 @@
+// Times every distance kernel at every SIMD level the CPU supports, across a
+// sweep of dimension counts. Prints CSV: dimensions,level,kernel,ns_per_call
+//
+//   ./bench [max_dimensions] [step]
+#include "../../sqlite-vec.h"
+#include "../../tests/sqlite-vec-internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *level_names[] = {"scalar", "sse4", "avx2", "avx512"};
+
+// keeps the compiler from dropping the kernel calls
+static volatile double sink;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Enough iterations for about 4M elements per measurement.
+static size_t iterations(size_t dimensions) {
+  size_t n = (4u << 20) / dimensions;
+  return n < 1000 ? 1000 : n;
+}
+
+#define BENCH(kernel_name, call)                                               \
+  do {                                                                         \
+    size_t n = iterations(d);                                                  \
+    double acc = 0;                                                            \
+    double start = now_ns();                                                   \
+    for (size_t i = 0; i < n; i++) {                                           \
+      acc += (call);                                                           \
+    }                                                                          \
+    double elapsed = now_ns() - start;                                         \
+    sink = acc;                                                                \
+    printf("%zu,%s,%s,%.2f\n", d, level_names[level], kernel_name,             \
+           elapsed / (double)n);                                               \
+  } while (0)
+
+int main(int argc, char **argv) {
+  size_t max_dimensions = argc > 1 ? (size_t)atol(argv[1]) : 1040;
+  size_t step = argc > 2 ? (size_t)atol(argv[2]) : 1;
+  if (max_dimensions == 0 || step == 0) {
+    fprintf(stderr, "usage: %s [max_dimensions] [step]\n", argv[0]);
+    return 1;
+  }
+
+  float *fa = malloc(max_dimensions * sizeof(float));
+  float *fb = malloc(max_dimensions * sizeof(float));
+  int8_t *ia = malloc(max_dimensions);
+  int8_t *ib = malloc(max_dimensions);
+  unsigned char *ba = malloc(max_dimensions);
+  unsigned char *bb = malloc(max_dimensions);
+  if (!fa || !fb || !ia || !ib || !ba || !bb) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  srand(42);
+  for (size_t i = 0; i < max_dimensions; i++) {
+    fa[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+    fb[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+    ia[i] = (int8_t)(rand() & 0xFF);
+    ib[i] = (int8_t)(rand() & 0xFF);
+    ba[i] = (unsigned char)(rand() & 0xFF);
+    bb[i] = (unsigned char)(rand() & 0xFF);
+  }
+
+  int max_level = _test_distance_kernels_init(3);
+  printf("dimensions,level,kernel,ns_per_call\n");
+  for (int level = 0; level <= max_level; level++) {
+    _test_distance_kernels_init(level);
+    for (size_t d = 1; d <= max_dimensions; d += step) {
+      BENCH("l2_f32", _test_distance_l2_sqr_float(fa, fb, d));
+      BENCH("cosine_f32", _test_distance_cosine_float(fa, fb, d));
+      BENCH("l1_f32", _test_distance_l1_f32(fa, fb, d));
+      BENCH("l2_i8", _test_distance_l2_sqr_int8(ia, ib, d));
+      BENCH("cosine_i8", _test_distance_cosine_int8(ia, ib, d));
+      BENCH("l1_i8", _test_distance_l1_int8(ia, ib, d));
+      // d bytes of bitvector = d * 8 bit dimensions
+      BENCH("hamming", _test_distance_hamming(ba, bb, d * 8));
+    }
+  }
+  return 0;
+}
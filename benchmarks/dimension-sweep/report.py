@@ -0,0 +1,27 @@
+"""
+Summarizes results.csv from ./bench: for each kernel and SIMD level, the
+ns/call at dimensions that are and aren't multiples of 16, so a cliff at
+"awkward" dimension counts shows up as a large ratio.
+"""
+import csv
+import sys
+from collections import defaultdict
+
+path = sys.argv[1] if len(sys.argv) > 1 else "results.csv"
+rows = defaultdict(dict)
+with open(path) as f:
+    for row in csv.DictReader(f):
+        rows[(row["kernel"], row["level"])][int(row["dimensions"])] = float(
+            row["ns_per_call"]
+        )
+
+print(f"{'kernel':<12}{'level':<8}{'d%16==0':>10}{'d%16!=0':>10}{'ratio':>8}")
+for (kernel, level), by_dim in rows.items():
+    # ns per dimension, so larger vectors don't dominate the average
+    aligned = [ns / d for d, ns in by_dim.items() if d >= 64 and d % 16 == 0]
+    unaligned = [ns / d for d, ns in by_dim.items() if d >= 64 and d % 16 != 0]
+    if not aligned or not unaligned:
+        continue
+    a = sum(aligned) / len(aligned)
+    u = sum(unaligned) / len(unaligned)
+    print(f"{kernel:<12}{level:<8}{a:>10.3f}{u:>10.3f}{u / a:>8.2f}")
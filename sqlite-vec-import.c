@@ -0,0 +1,479 @@
+/**
+ * sqlite-vec-import.c — Bulk loading vectors from files.
+ *
+ * This file is #included into sqlite-vec.c before vec0Update(). It implements
+ * the 'import=PATH' command:
+ *
+ *   INSERT INTO t(t) VALUES ('import=/data/embeddings.npy');
+ *
+ * Every vector in the file becomes a new row, with the next rowid. The table
+ * must have a single vector column and no partition key or metadata columns,
+ * which a file of vectors has no values for. Auxiliary columns are NULL.
+ *
+ * Supported files, picked by extension:
+ *   .npy   — a 2D NumPy array (rows, dimensions) in C order. float32,
+ *            float64, int8 and uint8 arrays load into float columns, int8
+ *            into int8 columns, and uint8 into bit columns, as np.packbits()
+ *            bytes.
+ *   .fvecs — the ANN benchmark format, each vector an int32 dimension count
+ *            then that many float32 values. Loads into float columns.
+ *   .bvecs — same with uint8 values, converted to float32.
+ *
+ * The file is read one vector at a time. Rows go through the write-behind
+ * buffer (see vec0_write_behind_flush()) a chunk at a time, so every chunk is
+ * written once per shadow table, rescore chunks included. IVF cells and the
+ * DiskANN graph are fed row by row, as they are on inserts.
+ *
+ * Compiled out with SQLITE_VEC_OMIT_FS, which also makes the command fail.
+ */
+
+#ifndef SQLITE_VEC_IMPORT_C
+#define SQLITE_VEC_IMPORT_C
+
+// When opened standalone in an editor, pull in types so the LSP is happy.
+// When #include'd from sqlite-vec.c, SQLITE_VEC_H is already defined.
+#ifndef SQLITE_VEC_H
+#include "sqlite-vec.c" // IWYU pragma: keep
+#endif
+
+#ifndef SQLITE_VEC_OMIT_FS
+
+// stdio buffer for import files
+#define VEC0_IMPORT_BUFFER_SIZE (1024 * 1024)
+
+enum Vec0ImportFormat {
+  VEC0_IMPORT_FORMAT_NPY,
+  VEC0_IMPORT_FORMAT_FVECS,
+  VEC0_IMPORT_FORMAT_BVECS,
+};
+
+// Element types of import files, named after their NumPy type codes.
+enum Vec0ImportElement {
+  VEC0_IMPORT_ELEMENT_F4,
+  VEC0_IMPORT_ELEMENT_F8,
+  VEC0_IMPORT_ELEMENT_I1,
+  VEC0_IMPORT_ELEMENT_U1,
+};
+
+struct Vec0ImportReader {
+  FILE *file;
+  enum Vec0ImportFormat format;
+  enum Vec0ImportElement element;
+  size_t elementSize;
+  // values per vector in the file
+  i64 dimensions;
+  // vectors left to read in .npy files, the others are read to the end
+  i64 remaining;
+  // one vector as stored in the file
+  void *record;
+};
+
+static int vec0_import_ends_with(const char *zPath, const char *zSuffix) {
+  size_t n = strlen(zPath);
+  size_t m = strlen(zSuffix);
+  return n >= m && sqlite3_stricmp(zPath + n - m, zSuffix) == 0;
+}
+
+/**
+ * @brief Find the value of key in the dict literal of a .npy header, ie the
+ * text right after "'key':".
+ */
+static const char *vec0_import_npy_field(const char *header, const char *key) {
+  char pattern[32];
+  sqlite3_snprintf(sizeof(pattern), pattern, "'%s':", key);
+  const char *s = strstr(header, pattern);
+  if (!s) {
+    return NULL;
+  }
+  s += strlen(pattern);
+  while (*s == ' ') {
+    s++;
+  }
+  return s;
+}
+
+/**
+ * @brief Read the header of a .npy file, leaving the file at the first value.
+ * https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+ */
+static int vec0_import_npy_header(vec0_vtab *p, struct Vec0ImportReader *r,
+                                  const char *zPath) {
+  unsigned char prefix[10];
+  u32 headerLength;
+  char *header = NULL;
+  const char *s;
+  int rc = SQLITE_ERROR;
+
+  if (fread(prefix, 1, 8, r->file) != 8 ||
+      memcmp(prefix, "\x93NUMPY", 6) != 0) {
+    vtab_set_error(&p->base, "import: %s is not a .npy file", zPath);
+    return SQLITE_ERROR;
+  }
+  if (prefix[6] == 1) {
+    if (fread(prefix + 8, 1, 2, r->file) != 2) {
+      goto truncated;
+    }
+    headerLength = prefix[8] | (prefix[9] << 8);
+  } else {
+    unsigned char length[4];
+    if (fread(length, 1, 4, r->file) != 4) {
+      goto truncated;
+    }
+    headerLength = length[0] | (length[1] << 8) | (length[2] << 16) |
+                   ((u32)length[3] << 24);
+  }
+  header = sqlite3_malloc64((i64)headerLength + 1);
+  if (!header) {
+    return SQLITE_NOMEM;
+  }
+  if (fread(header, 1, headerLength, r->file) != headerLength) {
+    goto truncated;
+  }
+  header[headerLength] = '\0';
+
+  s = vec0_import_npy_field(header, "descr");
+  if (s && (strncmp(s, "'<f4'", 5) == 0 || strncmp(s, "'=f4'", 5) == 0)) {
+    r->element = VEC0_IMPORT_ELEMENT_F4;
+  } else if (s &&
+             (strncmp(s, "'<f8'", 5) == 0 || strncmp(s, "'=f8'", 5) == 0)) {
+    r->element = VEC0_IMPORT_ELEMENT_F8;
+  } else if (s &&
+             (strncmp(s, "'|i1'", 5) == 0 || strncmp(s, "'<i1'", 5) == 0)) {
+    r->element = VEC0_IMPORT_ELEMENT_I1;
+  } else if (s &&
+             (strncmp(s, "'|u1'", 5) == 0 || strncmp(s, "'<u1'", 5) == 0)) {
+    r->element = VEC0_IMPORT_ELEMENT_U1;
+  } else {
+    vtab_set_error(&p->base,
+                   "import: %s must hold little-endian float32, float64, "
+                   "int8 or uint8 values",
+                   zPath);
+    goto done;
+  }
+
+  s = vec0_import_npy_field(header, "fortran_order");
+  if (!s || strncmp(s, "False", 5) != 0) {
+    vtab_set_error(&p->base, "import: %s must be in C order", zPath);
+    goto done;
+  }
+
+  s = vec0_import_npy_field(header, "shape");
+  i64 rows, dimensions;
+  int consumed = 0;
+  if (!s || sscanf(s, "(%lld, %lld)%n", &rows, &dimensions, &consumed) != 2 ||
+      consumed == 0 || rows < 0 || dimensions <= 0) {
+    vtab_set_error(&p->base,
+                   "import: %s must hold a 2-dimensional array of vectors",
+                   zPath);
+    goto done;
+  }
+  r->remaining = rows;
+  r->dimensions = dimensions;
+  rc = SQLITE_OK;
+  goto done;
+
+truncated:
+  vtab_set_error(&p->base, "import: %s is truncated", zPath);
+  rc = SQLITE_ERROR;
+done:
+  sqlite3_free(header);
+  return rc;
+}
+
+/**
+ * @brief Open an import file and read its header, checking its vectors fit
+ * the table's vector column.
+ */
+static int vec0_import_open(vec0_vtab *p, const char *zPath,
+                            struct Vec0ImportReader *r) {
+  int rc;
+  struct VectorColumnDefinition *column = &p->vector_columns[0];
+
+  if (vec0_import_ends_with(zPath, ".npy")) {
+    r->format = VEC0_IMPORT_FORMAT_NPY;
+  } else if (vec0_import_ends_with(zPath, ".fvecs")) {
+    r->format = VEC0_IMPORT_FORMAT_FVECS;
+    r->element = VEC0_IMPORT_ELEMENT_F4;
+  } else if (vec0_import_ends_with(zPath, ".bvecs")) {
+    r->format = VEC0_IMPORT_FORMAT_BVECS;
+    r->element = VEC0_IMPORT_ELEMENT_U1;
+  } else {
+    vtab_set_error(&p->base,
+                   "import: unknown file type %s, expected .npy, .fvecs or "
+                   ".bvecs",
+                   zPath);
+    return SQLITE_ERROR;
+  }
+
+  r->file = fopen(zPath, "rb");
+  if (!r->file) {
+    vtab_set_error(&p->base, "import: could not open %s", zPath);
+    return SQLITE_ERROR;
+  }
+  setvbuf(r->file, NULL, _IOFBF, VEC0_IMPORT_BUFFER_SIZE);
+
+  if (r->format == VEC0_IMPORT_FORMAT_NPY) {
+    rc = vec0_import_npy_header(p, r, zPath);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  } else {
+    // the dimensions of the first vector, each one repeats them
+    int32_t d;
+    size_t n = fread(&d, sizeof(d), 1, r->file);
+    if (n == 1 && d <= 0) {
+      vtab_set_error(&p->base, "import: %s has an invalid dimension count",
+                     zPath);
+      return SQLITE_ERROR;
+    }
+    r->dimensions = n == 1 ? (i64)d : (i64)column->dimensions;
+    r->remaining = -1;
+    rewind(r->file);
+  }
+
+  switch (r->element) {
+  case VEC0_IMPORT_ELEMENT_F4:
+    r->elementSize = sizeof(f32);
+    break;
+  case VEC0_IMPORT_ELEMENT_F8:
+    r->elementSize = sizeof(double);
+    break;
+  case VEC0_IMPORT_ELEMENT_I1:
+  case VEC0_IMPORT_ELEMENT_U1:
+    r->elementSize = 1;
+    break;
+  }
+
+  int fits = 0;
+  switch (column->element_type) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
+    fits = r->dimensions == (i64)column->dimensions;
+    break;
+  case SQLITE_VEC_ELEMENT_TYPE_INT8:
+    fits = r->element == VEC0_IMPORT_ELEMENT_I1 &&
+           r->dimensions == (i64)column->dimensions;
+    break;
+  case SQLITE_VEC_ELEMENT_TYPE_BIT:
+    fits = r->format == VEC0_IMPORT_FORMAT_NPY &&
+           r->element == VEC0_IMPORT_ELEMENT_U1 &&
+           r->dimensions * CHAR_BIT == (i64)column->dimensions;
+    break;
+  }
+  if (!fits) {
+    vtab_set_error(&p->base,
+                   "import: the vectors of %s don't fit the %s[%d] column "
+                   "\"%.*s\"",
+                   zPath, vector_subtype_name(column->element_type),
+                   (int)column->dimensions, column->name_length, column->name);
+    return SQLITE_ERROR;
+  }
+
+  r->record = sqlite3_malloc64(r->dimensions * r->elementSize);
+  if (!r->record) {
+    return SQLITE_NOMEM;
+  }
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Read the next vector of an import file into vector, converted to the
+ * element type of the table's vector column.
+ *
+ * @return SQLITE_ROW with a vector, SQLITE_DONE at the end of the file, error
+ * code otherwise
+ */
+static int vec0_import_next(vec0_vtab *p, struct Vec0ImportReader *r,
+                            const char *zPath, void *vector) {
+  if (r->format == VEC0_IMPORT_FORMAT_NPY) {
+    if (r->remaining == 0) {
+      return SQLITE_DONE;
+    }
+    r->remaining--;
+  } else {
+    int32_t d;
+    size_t n = fread(&d, 1, sizeof(d), r->file);
+    if (n == 0 && feof(r->file)) {
+      return SQLITE_DONE;
+    }
+    if (n == sizeof(d) && d != r->dimensions) {
+      vtab_set_error(&p->base,
+                     "import: vectors of %s have %d dimensions, expected "
+                     "%lld",
+                     zPath, d, r->dimensions);
+      return SQLITE_ERROR;
+    }
+    if (n != sizeof(d)) {
+      goto truncated;
+    }
+  }
+  if (fread(r->record, r->elementSize, r->dimensions, r->file) !=
+      (size_t)r->dimensions) {
+    goto truncated;
+  }
+
+  if (r->element == VEC0_IMPORT_ELEMENT_F4 ||
+      p->vector_columns[0].element_type != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+    // int8 and bit columns take the file's bytes as they are
+    memcpy(vector, r->record, r->dimensions * r->elementSize);
+    return SQLITE_ROW;
+  }
+  for (i64 i = 0; i < r->dimensions; i++) {
+    switch (r->element) {
+    case VEC0_IMPORT_ELEMENT_F8:
+      ((f32 *)vector)[i] = (f32)((const double *)r->record)[i];
+      break;
+    case VEC0_IMPORT_ELEMENT_I1:
+      ((f32 *)vector)[i] = ((const i8 *)r->record)[i];
+      break;
+    case VEC0_IMPORT_ELEMENT_U1:
+      ((f32 *)vector)[i] = ((const u8 *)r->record)[i];
+      break;
+    default:
+      break;
+    }
+  }
+  return SQLITE_ROW;
+
+truncated:
+  vtab_set_error(&p->base, "import: %s is truncated", zPath);
+  return SQLITE_ERROR;
+}
+
+/**
+ * @brief Add every vector of a file to the table as a new row.
+ */
+static int vec0_import(vec0_vtab *p, const char *zPath) {
+  int rc;
+  struct Vec0ImportReader reader;
+  struct VectorColumnDefinition *column = &p->vector_columns[0];
+  void *vector = NULL;
+  vector_cleanup cleanup = vector_cleanup_noop;
+  sqlite3_stmt *stmtAuxiliary = NULL;
+  int chunked = !vec0_all_columns_diskann(p);
+  memset(&reader, 0, sizeof(reader));
+
+  if (p->numVectorColumns != 1 || p->numPartitionColumns > 0 ||
+      p->numMetadataColumns > 0 || p->pkIsText) {
+    vtab_set_error(&p->base,
+                   "import requires a table with one vector column, an "
+                   "integer primary key, and no partition key or metadata "
+                   "columns");
+    return SQLITE_ERROR;
+  }
+
+  rc = vec0_import_open(p, zPath, &reader);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  if (p->numAuxiliaryColumns > 0) {
+    char *zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_AUXILIARY_NAME
+                                 "(rowid) VALUES (?)",
+                                 p->schemaName, p->tableName);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmtAuxiliary, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
+
+  while (1) {
+    i64 rowid;
+    cleanup(vector);
+    vector = sqlite3_malloc64(vector_column_byte_size(*column));
+    cleanup = sqlite3_free;
+    if (!vector) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = vec0_import_next(p, &reader, zPath, vector);
+    if (rc == SQLITE_DONE) {
+      break;
+    }
+    if (rc != SQLITE_ROW) {
+      goto cleanup;
+    }
+    if (column->normalize) {
+      rc = vector_normalize_f32(&vector, column->dimensions, &cleanup);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+
+    rc = vec0_rowids_insert_id(p, NULL, &rowid);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+    if (stmtAuxiliary) {
+      sqlite3_bind_int64(stmtAuxiliary, 1, rowid);
+      rc = sqlite3_step(stmtAuxiliary);
+      sqlite3_reset(stmtAuxiliary);
+      if (rc != SQLITE_DONE) {
+        rc = SQLITE_ERROR;
+        goto cleanup;
+      }
+    }
+#if SQLITE_VEC_ENABLE_DISKANN
+    if (column->index_type == VEC0_INDEX_TYPE_DISKANN) {
+      rc = diskann_insert(p, 0, rowid, vector);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+#endif
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+    if (column->index_type == VEC0_INDEX_TYPE_IVF) {
+      rc = ivf_insert(p, 0, rowid, vector,
+                      (int)vector_column_byte_size(*column));
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+#endif
+
+    if (chunked) {
+      // a chunk's worth at a time, whatever 'write_behind=N' is set to
+      rc = vec0_write_behind_stage(p, rowid, NULL, &vector, NULL);
+      if (rc == SQLITE_OK && p->numStagedRows >= p->chunk_size) {
+        rc = vec0_write_behind_flush(p);
+      }
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+  }
+  rc = vec0_write_behind_flush(p);
+
+cleanup:
+  if (rc != SQLITE_OK) {
+    vec0_write_behind_discard(p);
+  }
+  cleanup(vector);
+  sqlite3_finalize(stmtAuxiliary);
+  sqlite3_free(reader.record);
+  if (reader.file) {
+    fclose(reader.file);
+  }
+  return rc;
+}
+
+#endif /* SQLITE_VEC_OMIT_FS */
+
+static int vec0_import_handle_command(vec0_vtab *p, const char *command) {
+  if (strncmp(command, "import=", 7) != 0) {
+    return SQLITE_EMPTY;
+  }
+#ifdef SQLITE_VEC_OMIT_FS
+  vtab_set_error(&p->base, "import is not available in builds with "
+                           "SQLITE_VEC_OMIT_FS");
+  return SQLITE_ERROR;
+#else
+  return vec0_import(p, command + 7);
+#endif
+}
+
+#endif /* SQLITE_VEC_IMPORT_C */
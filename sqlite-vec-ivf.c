@@ -226,7 +226,8 @@ static int ivf_find_nearest_centroid(vec0_vtab *p, int col_idx,
 /**
  * Compute distance between two vectors using the column's distance_metric.
  * Dispatches to SIMD-optimized functions (NEON/AVX) via distance_*_float().
- * For float32 (non-quantized) vectors.
+ * For float32 (non-quantized) vectors. L2 distances are squared, which is
+ * all that ranking candidates or centroids needs.
  */
 static float ivf_distance_float(vec0_vtab *p, int col_idx,
                                  const float *a, const float *b) {
@@ -238,13 +239,13 @@ static float ivf_distance_float(vec0_vtab *p, int col_idx,
     return (float)distance_l1_f32(a, b, &dims);
   case VEC0_DISTANCE_METRIC_L2:
   default:
-    return distance_l2_sqr_float(a, b, &dims);
+    return distance_l2_squared_float(a, b, &dims);
   }
 }
 
 /**
  * Compute distance between two quantized vectors.
- * For int8: uses L2 or cosine on int8.
+ * For int8: uses squared L2 on int8.
  * For binary: uses hamming distance.
  * For none: delegates to ivf_distance_float.
  */
@@ -253,7 +254,7 @@ static float ivf_distance(vec0_vtab *p, int col_idx,
   size_t dims = p->vector_columns[col_idx].dimensions;
   switch (p->vector_columns[col_idx].ivf.quantizer) {
   case VEC0_IVF_QUANTIZER_INT8:
-    return distance_l2_sqr_int8(a, b, &dims);
+    return distance_l2_squared_int8(a, b, &dims);
   case VEC0_IVF_QUANTIZER_BINARY:
     return distance_hamming(a, b, &dims);
   default:
@@ -261,6 +262,21 @@ static float ivf_distance(vec0_vtab *p, int col_idx,
   }
 }
 
+/**
+ * The distance function ivf_distance() dispatches to for this column, for
+ * scanning many vectors at once with distances_for_chunk().
+ */
+static vec0_distance_f32_fn ivf_distance_fn(vec0_vtab *p, int col_idx) {
+  switch (p->vector_columns[col_idx].ivf.quantizer) {
+  case VEC0_IVF_QUANTIZER_INT8:
+    return distance_l2_squared_int8;
+  case VEC0_IVF_QUANTIZER_BINARY:
+    return distance_hamming;
+  default:
+    return p->vector_columns[col_idx].distance_fn;
+  }
+}
+
 static int ivf_ensure_stmt(vec0_vtab *p, sqlite3_stmt **pStmt, const char *fmt,
                             int col_idx) {
   if (*pStmt) return SQLITE_OK;
@@ -1189,6 +1205,12 @@ static int ivf_scan_cells_from_stmt(vec0_vtab *p, int col_idx,
                                      const void *queryVecQ, int qvecSize,
                                      struct IvfCandidate **candidates,
                                      int *nCandidates, int *cap) {
+  int rc = SQLITE_OK;
+  vec0_distance_f32_fn distance = ivf_distance_fn(p, col_idx);
+  size_t dims = p->vector_columns[col_idx].dimensions;
+  // distances for every slot of the current cell, grown to the largest cell
+  f32 *distances = NULL;
+  int distancesCap = 0;
   while (sqlite3_step(stmt) == SQLITE_ROW) {
     int n = sqlite3_column_int(stmt, 0);
     if (n == 0) continue;
@@ -1203,6 +1225,15 @@ static int ivf_scan_cells_from_stmt(vec0_vtab *p, int col_idx,
     if (ridsBytes / (int)sizeof(i64) < cell_cap) cell_cap = ridsBytes / (int)sizeof(i64);
     if (vecsBytes / qvecSize < cell_cap) cell_cap = vecsBytes / qvecSize;
 
+    if (cell_cap > distancesCap) {
+      f32 *tmp = sqlite3_realloc64(distances, (i64)cell_cap * sizeof(f32));
+      if (!tmp) { rc = SQLITE_NOMEM; break; }
+      distances = tmp;
+      distancesCap = cell_cap;
+    }
+    distances_for_chunk(distance, queryVecQ, vectors, qvecSize, &dims,
+                        cell_cap, validity, distances);
+
     int found = 0;
     for (int i = 0; i < cell_cap && found < n; i++) {
       if (!(validity[i / 8] & (1 << (i % 8)))) continue;
@@ -1210,16 +1241,17 @@ static int ivf_scan_cells_from_stmt(vec0_vtab *p, int col_idx,
       if (*nCandidates >= *cap) {
         *cap *= 2;
         struct IvfCandidate *tmp = sqlite3_realloc64(*candidates, (i64)*cap * sizeof(struct IvfCandidate));
-        if (!tmp) return SQLITE_NOMEM;
+        if (!tmp) { rc = SQLITE_NOMEM; break; }
         *candidates = tmp;
       }
       (*candidates)[*nCandidates].rowid = rowids[i];
-      (*candidates)[*nCandidates].distance = ivf_distance(p, col_idx,
-          queryVecQ, &vectors[i * qvecSize]);
+      (*candidates)[*nCandidates].distance = distances[i];
       (*nCandidates)++;
     }
+    if (rc != SQLITE_OK) break;
   }
-  return SQLITE_OK;
+  sqlite3_free(distances);
+  return rc;
 }
 
 static int ivf_query_knn(vec0_vtab *p, int col_idx,
@@ -1333,7 +1365,8 @@ static int ivf_query_knn(vec0_vtab *p, int col_idx,
   qsort(candidates, nCandidates, sizeof(struct IvfCandidate), ivf_candidate_cmp);
 
   // Oversample re-ranking: re-score top (oversample*k) with full-precision vectors
-  if (oversample > 1 && quantizer != VEC0_IVF_QUANTIZER_NONE && nCandidates > 0) {
+  int reranked = oversample > 1 && quantizer != VEC0_IVF_QUANTIZER_NONE && nCandidates > 0;
+  if (reranked) {
     i64 rescore_n = collect_k < nCandidates ? collect_k : nCandidates;
     sqlite3_stmt *stmtVec = NULL;
     char *zSql = sqlite3_mprintf(
@@ -1381,6 +1414,14 @@ static int ivf_query_knn(vec0_vtab *p, int col_idx,
     knn_data->rowids[i] = candidates[i].rowid;
     knn_data->distances[i] = candidates[i].distance;
   }
+  // Quantized int8 distances are always squared L2, binary ones are hamming.
+  // Re-ranked (or unquantized) distances follow the column's metric.
+  if (reranked || quantizer == VEC0_IVF_QUANTIZER_NONE) {
+    knn_data->distances_squared =
+        p->vector_columns[col_idx].distance_metric == VEC0_DISTANCE_METRIC_L2;
+  } else {
+    knn_data->distances_squared = quantizer == VEC0_IVF_QUANTIZER_INT8;
+  }
   knn_data->k = k; knn_data->k_used = nResults; knn_data->current_idx = 0;
   sqlite3_free(candidates);
   return SQLITE_OK;
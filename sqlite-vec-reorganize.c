@@ -0,0 +1,1178 @@
+/**
+ * sqlite-vec-reorganize.c — Similarity-clustered chunk reorganization.
+ *
+ * This file is #included into sqlite-vec.c after the vec0Update_Delete_*
+ * helpers. It implements the 'reorganize' command:
+ *
+ *   INSERT INTO t(t) VALUES ('reorganize');
+ *
+ * Rows are inserted into chunks in arrival order, so a chunk usually holds
+ * vectors from all over the space and its bounding box (_vector_boundsNN)
+ * rarely lets a KNN scan skip it. Reorganizing clusters every partition's
+ * rows with k-means on the first FLAT float32 vector column and moves them
+ * into fresh chunks cluster by cluster, so neighbouring vectors share chunks.
+ *
+ * The work runs in bounded steps, one per command, so it can proceed on a
+ * live database between ordinary reads and writes:
+ *
+ *   - The first step records the largest chunk rowid in _info as
+ *     'reorganize_chunk'. Chunks at or below it are "old", and are emptied
+ *     and reclaimed as their rows move out. New chunks always get larger
+ *     rowids (_chunks is AUTOINCREMENT).
+ *   - When the plan is empty, a step clusters the partition of the oldest
+ *     old chunk and writes its rows, in cluster order, to _reorganize.
+ *   - Otherwise a step moves the next VEC0_REORGANIZE_STEP_CHUNKS chunks
+ *     worth of planned rows into new, densely packed chunks.
+ *   - Once no old chunks remain, the _info key is deleted.
+ *
+ * Shadow table, created by the first 'reorganize' and empty between runs:
+ *   _reorganize — (seq INTEGER PRIMARY KEY, id INTEGER), rows to move in order
+ */
+
+#ifndef SQLITE_VEC_REORGANIZE_C
+#define SQLITE_VEC_REORGANIZE_C
+
+// When opened standalone in an editor, pull in types so the LSP is happy.
+// When #include'd from sqlite-vec.c, SQLITE_VEC_H is already defined.
+#ifndef SQLITE_VEC_H
+#include "sqlite-vec.c" // IWYU pragma: keep
+#endif
+
+#include <stdarg.h>
+
+// Chunks worth of rows moved by a single 'reorganize' step.
+#ifndef VEC0_REORGANIZE_STEP_CHUNKS
+#define VEC0_REORGANIZE_STEP_CHUNKS 16
+#endif
+
+// k-means trains on at most this many sampled rows per cluster.
+#define VEC0_REORGANIZE_SAMPLE_PER_CLUSTER 32
+
+#define VEC0_REORGANIZE_INFO_KEY "reorganize_chunk"
+
+/**
+ * @brief Run a single SQL statement that returns at most one integer.
+ * *out is left untouched when it returns no rows.
+ */
+static int vec0_reorganize_exec(vec0_vtab *p, i64 *out, const char *zFormat,
+                                ...) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  va_list ap;
+  va_start(ap, zFormat);
+  char *zSql = sqlite3_vmprintf(zFormat, ap);
+  va_end(ap);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_ROW && out && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+    *out = sqlite3_column_int64(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+  return (rc == SQLITE_ROW || rc == SQLITE_DONE) ? SQLITE_OK : rc;
+}
+
+// ============================================================================
+// Moving rows between chunk slots
+// ============================================================================
+
+/**
+ * @brief Move one slot of a chunk-layout blob column to another chunk slot,
+ * zeroing the source.
+ *
+ * @param size: bytes per slot, or 0 for a bitmap with one bit per slot.
+ * @param buf: scratch of at least `size` bytes. Holds the moved slot after.
+ */
+static int vec0_chunk_slot_move(vec0_vtab *p, const char *zTable,
+                                const char *zColumn, i64 src_chunk,
+                                i64 src_offset, i64 dst_chunk, i64 dst_offset,
+                                size_t size, void *buf) {
+  int rc, brc;
+  sqlite3_blob *blob = NULL;
+  u8 bit = 0;
+
+  rc = sqlite3_blob_open(p->db, p->schemaName, zTable, zColumn, src_chunk, 1,
+                         &blob);
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base, "could not open %s blob for %s.%s.%lld", zColumn,
+                   p->schemaName, zTable, src_chunk);
+    return rc;
+  }
+  if (size == 0) {
+    u8 block;
+    rc = sqlite3_blob_read(blob, &block, 1, src_offset / CHAR_BIT);
+    if (rc == SQLITE_OK) {
+      bit = (block >> (src_offset % CHAR_BIT)) & 1;
+      block &= ~(1 << (src_offset % CHAR_BIT));
+      rc = sqlite3_blob_write(blob, &block, 1, src_offset / CHAR_BIT);
+    }
+  } else {
+    rc = sqlite3_blob_read(blob, buf, size, src_offset * size);
+    if (rc == SQLITE_OK) {
+      void *zero = sqlite3_malloc64(size);
+      if (!zero) {
+        rc = SQLITE_NOMEM;
+      } else {
+        memset(zero, 0, size);
+        rc = sqlite3_blob_write(blob, zero, size, src_offset * size);
+        sqlite3_free(zero);
+      }
+    }
+  }
+  brc = sqlite3_blob_close(blob);
+  if (rc == SQLITE_OK) {
+    rc = brc;
+  }
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base, "could not move %s slot out of %s.%s.%lld",
+                   zColumn, p->schemaName, zTable, src_chunk);
+    return rc;
+  }
+
+  rc = sqlite3_blob_open(p->db, p->schemaName, zTable, zColumn, dst_chunk, 1,
+                         &blob);
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base, "could not open %s blob for %s.%s.%lld", zColumn,
+                   p->schemaName, zTable, dst_chunk);
+    return rc;
+  }
+  if (size == 0) {
+    u8 block;
+    rc = sqlite3_blob_read(blob, &block, 1, dst_offset / CHAR_BIT);
+    if (rc == SQLITE_OK) {
+      block = (block & ~(1 << (dst_offset % CHAR_BIT))) |
+              (bit << (dst_offset % CHAR_BIT));
+      rc = sqlite3_blob_write(blob, &block, 1, dst_offset / CHAR_BIT);
+    }
+  } else {
+    rc = sqlite3_blob_write(blob, buf, size, dst_offset * size);
+  }
+  brc = sqlite3_blob_close(blob);
+  if (rc == SQLITE_OK) {
+    rc = brc;
+  }
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base, "could not move %s slot into %s.%s.%lld",
+                   zColumn, p->schemaName, zTable, dst_chunk);
+  }
+  return rc;
+}
+
+/**
+ * @brief Move a row from one chunk slot to another, updating _rowids and
+ * the bounding boxes of both chunks.
+ *
+ * Every chunk-layout column moves with the row: the validity bit and rowid
+ * in _chunks, FLAT vectors, rescore's quantized vectors and metadata. Both
+ * chunks' free slot counts follow. Data
+ * keyed by rowid (auxiliary, long metadata text, rescore float vectors, IVF
+ * and DiskANN) stays where it is. The destination slot must be free. The
+ * source chunk is left in place even if it ends up empty.
+ */
+static int vec0_move_row(vec0_vtab *p, i64 rowid, i64 src_chunk,
+                         i64 src_offset, i64 dst_chunk, i64 dst_offset) {
+  int rc;
+  size_t bufSize = VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    size_t n = vector_column_byte_size(p->vector_columns[i]);
+    if (n > bufSize) {
+      bufSize = n;
+    }
+  }
+  void *buf = sqlite3_malloc64(bufSize);
+  if (!buf) {
+    return SQLITE_NOMEM;
+  }
+
+  rc = vec0_chunk_slot_move(p, p->shadowChunksName, "validity", src_chunk,
+                            src_offset, dst_chunk, dst_offset, 0, buf);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  rc = vec0_chunk_slot_move(p, p->shadowChunksName, "rowids", src_chunk,
+                            src_offset, dst_chunk, dst_offset, sizeof(i64),
+                            buf);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    struct VectorColumnDefinition *col = &p->vector_columns[i];
+#if SQLITE_VEC_ENABLE_RESCORE
+    if (col->index_type == VEC0_INDEX_TYPE_RESCORE) {
+      rc = vec0_chunk_slot_move(p, p->shadowRescoreChunksNames[i], "vectors",
+                                src_chunk, src_offset, dst_chunk, dst_offset,
+                                rescore_quantized_byte_size(col), buf);
+      if (rc != SQLITE_OK) {
+        goto done;
+      }
+      continue;
+    }
+#endif
+    // Non-FLAT columns (IVF, DiskANN) don't use _vector_chunks
+    if (col->index_type != VEC0_INDEX_TYPE_FLAT) {
+      continue;
+    }
+    rc = vec0_chunk_slot_move(p, p->shadowVectorChunksNames[i], "vectors",
+                              src_chunk, src_offset, dst_chunk, dst_offset,
+                              vector_column_byte_size(*col), buf);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+    if (p->shadowVectorBoundsNames[i]) {
+      rc = vec0_vector_bounds_add(p, i, dst_chunk, (const f32 *)buf, 1);
+      if (rc != SQLITE_OK) {
+        goto done;
+      }
+      rc = vec0_vector_bounds_remove(p, i, src_chunk);
+      if (rc != SQLITE_OK) {
+        goto done;
+      }
+    }
+  }
+
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    size_t size = 0;
+    switch (vec0_metadata_storage_kind(&p->metadata_columns[i])) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN:
+      size = 0;
+      break;
+    case VEC0_METADATA_COLUMN_KIND_INTEGER:
+      size = sizeof(i64);
+      break;
+    case VEC0_METADATA_COLUMN_KIND_FLOAT:
+      size = sizeof(double);
+      break;
+    case VEC0_METADATA_COLUMN_KIND_TEXT:
+      size = VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+      break;
+    }
+    rc = vec0_chunk_slot_move(p, p->shadowMetadataChunksNames[i], "data",
+                              src_chunk, src_offset, dst_chunk, dst_offset,
+                              size, buf);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+    if (p->shadowMetadataBoundsNames[i]) {
+      rc = vec0_metadata_bounds_add_slot(p, i, dst_chunk, dst_offset);
+      if (rc != SQLITE_OK) {
+        goto done;
+      }
+      rc = vec0_metadata_bounds_remove(p, i, src_chunk);
+      if (rc != SQLITE_OK) {
+        goto done;
+      }
+    }
+  }
+
+  rc = vec0_rowids_update_position(p, rowid, dst_chunk, dst_offset);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  rc = vec0_free_slots_update(p, src_chunk, 1);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  rc = vec0_free_slots_update(p, dst_chunk, -1);
+
+done:
+  sqlite3_free(buf);
+  return rc;
+}
+
+// ============================================================================
+// Planning
+// ============================================================================
+
+/**
+ * @brief Run k-means on an evenly strided sample of `n` vectors and assign
+ * every one of them to its nearest centroid.
+ *
+ * @param idx: the vectors to cluster, as indexes into `vectors`.
+ * @param assignments: output, the cluster of every idx entry.
+ * @param k: in/out, the wanted number of clusters, clamped to the sample.
+ */
+static int vec0_reorganize_cluster(const f32 *vectors, int dims,
+                                   const int *idx, int n, int *k,
+                                   int *assignments) {
+  int sampleSize = n;
+  if ((i64)*k * VEC0_REORGANIZE_SAMPLE_PER_CLUSTER < sampleSize) {
+    sampleSize = *k * VEC0_REORGANIZE_SAMPLE_PER_CLUSTER;
+  }
+  if (*k > sampleSize) {
+    *k = sampleSize;
+  }
+  if (*k <= 1) {
+    *k = 1;
+    memset(assignments, 0, n * sizeof(int));
+    return SQLITE_OK;
+  }
+
+  f32 *sample = sqlite3_malloc64((i64)sampleSize * dims * sizeof(f32));
+  f32 *centroids = sqlite3_malloc64((i64)*k * dims * sizeof(f32));
+  if (!sample || !centroids) {
+    sqlite3_free(sample);
+    sqlite3_free(centroids);
+    return SQLITE_NOMEM;
+  }
+  for (int i = 0; i < sampleSize; i++) {
+    i64 j = (i64)i * n / sampleSize;
+    memcpy(&sample[(i64)i * dims], &vectors[(i64)idx[j] * dims],
+           dims * sizeof(f32));
+  }
+  int failed = ivf_kmeans(sample, sampleSize, dims, *k,
+                          VEC0_IVF_KMEANS_MAX_ITER,
+                          VEC0_IVF_KMEANS_DEFAULT_SEED, centroids) != 0;
+  if (!failed) {
+    for (int i = 0; i < n; i++) {
+      assignments[i] = ivf_nearest_centroid(&vectors[(i64)idx[i] * dims],
+                                            centroids, dims, *k);
+    }
+  }
+  sqlite3_free(sample);
+  sqlite3_free(centroids);
+  return failed ? SQLITE_NOMEM : SQLITE_OK;
+}
+
+/**
+ * @brief Order rows so that similar vectors are adjacent, cluster by cluster.
+ *
+ * A partition of n rows is split into about n / chunk_size clusters, one per
+ * chunk. Clustering all rows against that many centroids at once would cost
+ * n * n / chunk_size distance computations, so it's done in two levels: the
+ * rows are first split into about sqrt(clusters) coarse clusters, and then
+ * each coarse cluster into clusters of about chunk_size rows.
+ *
+ * @param order: output, a permutation of 0..n-1.
+ */
+static int vec0_reorganize_order(const f32 *vectors, int dims, int n,
+                                 int chunk_size, int *order) {
+  int rc = SQLITE_OK;
+  int *all = sqlite3_malloc64((i64)n * sizeof(int));
+  int *coarse = sqlite3_malloc64((i64)n * sizeof(int));
+  int *members = sqlite3_malloc64((i64)n * sizeof(int));
+  int *fine = sqlite3_malloc64((i64)n * sizeof(int));
+  if (!all || !coarse || !members || !fine) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  for (int i = 0; i < n; i++) {
+    all[i] = i;
+  }
+
+  int clusters = (n + chunk_size - 1) / chunk_size;
+  int kCoarse = (int)ceil(sqrt((double)clusters));
+  rc = vec0_reorganize_cluster(vectors, dims, all, n, &kCoarse, coarse);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+
+  int written = 0;
+  for (int c = 0; c < kCoarse; c++) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+      if (coarse[i] == c) {
+        members[m++] = i;
+      }
+    }
+    int kFine = (m + chunk_size - 1) / chunk_size;
+    rc = vec0_reorganize_cluster(vectors, dims, members, m, &kFine, fine);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+    for (int f = 0; f < kFine; f++) {
+      for (int i = 0; i < m; i++) {
+        if (fine[i] == f) {
+          order[written++] = members[i];
+        }
+      }
+    }
+  }
+
+done:
+  sqlite3_free(all);
+  sqlite3_free(coarse);
+  sqlite3_free(members);
+  sqlite3_free(fine);
+  return rc;
+}
+
+/**
+ * @brief Plan the partition of the oldest chunk at or below `watermark`:
+ * cluster its rows in old chunks and write them to _reorganize in order.
+ *
+ * Old chunks of the partition without any rows are reclaimed right away.
+ * Sets *found to 0 when no old chunks are left.
+ */
+static int vec0_reorganize_plan(vec0_vtab *p, int col, i64 watermark,
+                                int *found) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  sqlite3_value *partitionValues[VEC0_MAX_PARTITION_COLUMNS] = {0};
+  size_t dims = p->vector_columns[col].dimensions;
+  size_t vectorSize = vector_column_byte_size(p->vector_columns[col]);
+  i64 *ids = NULL;
+  f32 *vectors = NULL;
+  int *order = NULL;
+  i64 *emptyChunks = NULL;
+  int n = 0, capacity = 0, numEmpty = 0, emptyCapacity = 0;
+  char *zSql;
+  *found = 0;
+
+  // 1. partition key values of the oldest old chunk
+  sqlite3_str *s = sqlite3_str_new(NULL);
+  sqlite3_str_appendall(s, "SELECT rowid");
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_str_appendf(s, ", partition%02d", i);
+  }
+  sqlite3_str_appendf(s,
+                      " FROM " VEC0_SHADOW_CHUNKS_NAME
+                      " WHERE rowid <= ? ORDER BY rowid LIMIT 1",
+                      p->schemaName, p->tableName);
+  zSql = sqlite3_str_finish(s);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  sqlite3_bind_int64(stmt, 1, watermark);
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_DONE) {
+    rc = SQLITE_OK;
+    goto done;
+  }
+  if (rc != SQLITE_ROW) {
+    goto done;
+  }
+  *found = 1;
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    partitionValues[i] = sqlite3_value_dup(sqlite3_column_value(stmt, 1 + i));
+    if (!partitionValues[i]) {
+      rc = SQLITE_NOMEM;
+      goto done;
+    }
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  // 2. every row of that partition in old chunks, with its vector
+  s = sqlite3_str_new(NULL);
+  sqlite3_str_appendf(s,
+                      "SELECT c.rowid, c.validity, c.rowids, v.vectors"
+                      " FROM " VEC0_SHADOW_CHUNKS_NAME " AS c"
+                      " JOIN " VEC0_SHADOW_VECTOR_N_NAME
+                      " AS v ON v.rowid = c.rowid"
+                      " WHERE c.rowid <= ?",
+                      p->schemaName, p->tableName, p->schemaName,
+                      p->tableName, col);
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_str_appendf(s, " AND c.partition%02d IS ?", i);
+  }
+  sqlite3_str_appendall(s, " ORDER BY c.rowid");
+  zSql = sqlite3_str_finish(s);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  sqlite3_bind_int64(stmt, 1, watermark);
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_bind_value(stmt, 2 + i, partitionValues[i]);
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    i64 chunk_id = sqlite3_column_int64(stmt, 0);
+    const u8 *validity = sqlite3_column_blob(stmt, 1);
+    const i64 *rowids = sqlite3_column_blob(stmt, 2);
+    const u8 *chunkVectors = sqlite3_column_blob(stmt, 3);
+    if (sqlite3_column_bytes(stmt, 1) != p->chunk_size / CHAR_BIT ||
+        sqlite3_column_bytes(stmt, 2) != (int)(p->chunk_size * sizeof(i64)) ||
+        sqlite3_column_bytes(stmt, 3) != (int)(p->chunk_size * vectorSize)) {
+      vtab_set_error(&p->base,
+                     VEC_INTERAL_ERROR "chunk %lld has an unexpected size",
+                     chunk_id);
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    int any = 0;
+    for (int j = 0; j < p->chunk_size; j++) {
+      if (!(validity[j / CHAR_BIT] & (1 << (j % CHAR_BIT)))) {
+        continue;
+      }
+      any = 1;
+      if (n == capacity) {
+        capacity = capacity ? capacity * 2 : p->chunk_size;
+        i64 *newIds = sqlite3_realloc64(ids, capacity * sizeof(i64));
+        if (!newIds) {
+          rc = SQLITE_NOMEM;
+          goto done;
+        }
+        ids = newIds;
+        f32 *newVectors =
+            sqlite3_realloc64(vectors, (i64)capacity * vectorSize);
+        if (!newVectors) {
+          rc = SQLITE_NOMEM;
+          goto done;
+        }
+        vectors = newVectors;
+      }
+      ids[n] = rowids[j];
+      memcpy(&vectors[(i64)n * dims], chunkVectors + j * vectorSize,
+             vectorSize);
+      n++;
+    }
+    if (!any) {
+      if (numEmpty == emptyCapacity) {
+        emptyCapacity = emptyCapacity ? emptyCapacity * 2 : 8;
+        i64 *newEmpty =
+            sqlite3_realloc64(emptyChunks, emptyCapacity * sizeof(i64));
+        if (!newEmpty) {
+          rc = SQLITE_NOMEM;
+          goto done;
+        }
+        emptyChunks = newEmpty;
+      }
+      emptyChunks[numEmpty++] = chunk_id;
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto done;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  for (int i = 0; i < numEmpty; i++) {
+    int deleted;
+    rc = vec0Update_Delete_DeleteChunkIfEmpty(p, emptyChunks[i], &deleted);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+  }
+  if (n == 0) {
+    rc = SQLITE_OK;
+    goto done;
+  }
+
+  // 3. cluster, then write the plan in cluster order
+  order = sqlite3_malloc64((i64)n * sizeof(int));
+  if (!order) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = vec0_reorganize_order(vectors, (int)dims, n, p->chunk_size, order);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+
+  zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_REORGANIZE_NAME
+                         "(id) VALUES (?)",
+                         p->schemaName, p->tableName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  for (int i = 0; i < n; i++) {
+    sqlite3_bind_int64(stmt, 1, ids[order[i]]);
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+      goto done;
+    }
+  }
+  rc = SQLITE_OK;
+
+done:
+  sqlite3_finalize(stmt);
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_value_free(partitionValues[i]);
+  }
+  sqlite3_free(ids);
+  sqlite3_free(vectors);
+  sqlite3_free(order);
+  sqlite3_free(emptyChunks);
+  return rc;
+}
+
+// ============================================================================
+// Moving planned rows
+// ============================================================================
+
+/**
+ * @brief Read the partition key values of a chunk, for new chunks created
+ * alongside it. Each value must be freed with sqlite3_value_free().
+ */
+static int vec0_reorganize_chunk_partition(vec0_vtab *p, i64 chunk_id,
+                                           sqlite3_value **values) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  sqlite3_str *s = sqlite3_str_new(NULL);
+  sqlite3_str_appendall(s, "SELECT rowid");
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_str_appendf(s, ", partition%02d", i);
+  }
+  sqlite3_str_appendf(s, " FROM " VEC0_SHADOW_CHUNKS_NAME " WHERE rowid = ?",
+                      p->schemaName, p->tableName);
+  char *zSql = sqlite3_str_finish(s);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  if (rc != SQLITE_ROW) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "could not find chunk %lld",
+                   chunk_id);
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  rc = SQLITE_OK;
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    values[i] = sqlite3_value_dup(sqlite3_column_value(stmt, 1 + i));
+    if (!values[i]) {
+      rc = SQLITE_NOMEM;
+    }
+  }
+
+done:
+  sqlite3_finalize(stmt);
+  return rc;
+}
+
+/**
+ * @brief Move the next planned rows into new chunks, packed densely in plan
+ * order. Rows deleted since planning, or already outside the old chunks, are
+ * dropped from the plan. Emptied old chunks are reclaimed.
+ */
+static int vec0_reorganize_move(vec0_vtab *p, i64 watermark) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  sqlite3_value *partitionValues[VEC0_MAX_PARTITION_COLUMNS] = {0};
+  i64 dst_chunk = 0;
+  i64 dst_offset = p->chunk_size;
+  i64 lastSeq = 0;
+
+  char *zSql = sqlite3_mprintf("SELECT seq, id FROM " VEC0_SHADOW_REORGANIZE_NAME
+                               " ORDER BY seq LIMIT ?",
+                               p->schemaName, p->tableName);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_bind_int64(stmt, 1, (i64)VEC0_REORGANIZE_STEP_CHUNKS * p->chunk_size);
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    i64 rowid = sqlite3_column_int64(stmt, 1);
+    i64 src_chunk, src_offset;
+    lastSeq = sqlite3_column_int64(stmt, 0);
+
+    rc = vec0_get_chunk_position(p, rowid, NULL, &src_chunk, &src_offset);
+    if (rc == SQLITE_EMPTY || (rc == SQLITE_OK && src_chunk > watermark)) {
+      continue;
+    }
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+
+    if (dst_offset == p->chunk_size) {
+      if (!dst_chunk) {
+        rc = vec0_reorganize_chunk_partition(p, src_chunk, partitionValues);
+        if (rc != SQLITE_OK) {
+          goto done;
+        }
+      }
+      rc = vec0_new_chunk(p, partitionValues, &dst_chunk);
+      if (rc != SQLITE_OK) {
+        goto done;
+      }
+      dst_offset = 0;
+    }
+
+    rc = vec0_move_row(p, rowid, src_chunk, src_offset, dst_chunk, dst_offset);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+    dst_offset++;
+    // old chunks are emptied, not refilled
+    rc = vec0_free_slots_clear(p, src_chunk);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+
+    int deleted;
+    rc = vec0Update_Delete_DeleteChunkIfEmpty(p, src_chunk, &deleted);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto done;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  zSql = sqlite3_mprintf("DELETE FROM " VEC0_SHADOW_REORGANIZE_NAME
+                         " WHERE seq <= ?",
+                         p->schemaName, p->tableName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  sqlite3_bind_int64(stmt, 1, lastSeq);
+  rc = sqlite3_step(stmt);
+  rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+
+done:
+  sqlite3_finalize(stmt);
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_value_free(partitionValues[i]);
+  }
+  return rc;
+}
+
+// ============================================================================
+// Compaction
+// ============================================================================
+
+struct Vec0OptimizeChunk {
+  i64 chunk_id;
+  // number of rows in the chunk
+  int count;
+  u8 *validity;
+  i64 *rowids;
+};
+
+// fullest chunks first, oldest first among equals
+static int vec0_optimize_chunk_cmp(const void *a, const void *b) {
+  const struct Vec0OptimizeChunk *x = a, *y = b;
+  if (x->count != y->count) {
+    return x->count > y->count ? -1 : 1;
+  }
+  return (x->chunk_id > y->chunk_id) - (x->chunk_id < y->chunk_id);
+}
+
+// first slot whose validity bit equals `set`, or -1
+static int vec0_optimize_find_slot(const u8 *validity, int chunk_size,
+                                   int set) {
+  for (int i = 0; i < chunk_size; i++) {
+    if (((validity[i / CHAR_BIT] >> (i % CHAR_BIT)) & 1) == set) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Repack the chunks of one partition: rows of the emptiest chunks fill
+ * the empty slots of the fullest ones, until at most one chunk is partially
+ * full. Emptied chunks are deleted, and the free slot counts of the rest are
+ * rewritten from their validity bitmaps.
+ *
+ * @param partitionValues: the partition's key values, NULL without partition
+ * key columns.
+ */
+static int vec0_optimize_partition(vec0_vtab *p,
+                                   sqlite3_value **partitionValues) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  struct Vec0OptimizeChunk *chunks = NULL;
+  int n = 0, capacity = 0;
+  int validitySize = p->chunk_size / CHAR_BIT;
+  int rowidsSize = p->chunk_size * sizeof(i64);
+
+  sqlite3_str *s = sqlite3_str_new(NULL);
+  sqlite3_str_appendf(s,
+                      "SELECT rowid, validity, rowids FROM "
+                      VEC0_SHADOW_CHUNKS_NAME,
+                      p->schemaName, p->tableName);
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_str_appendf(s, "%s partition%02d IS ?", i == 0 ? " WHERE" : " AND",
+                        i);
+  }
+  sqlite3_str_appendall(s, " ORDER BY rowid");
+  char *zSql = sqlite3_str_finish(s);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_bind_value(stmt, 1 + i, partitionValues[i]);
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (sqlite3_column_bytes(stmt, 1) != validitySize ||
+        sqlite3_column_bytes(stmt, 2) != rowidsSize) {
+      vtab_set_error(&p->base,
+                     VEC_INTERAL_ERROR "chunk %lld has an unexpected size",
+                     sqlite3_column_int64(stmt, 0));
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    if (n == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      struct Vec0OptimizeChunk *grown =
+          sqlite3_realloc64(chunks, capacity * sizeof(*chunks));
+      if (!grown) {
+        rc = SQLITE_NOMEM;
+        goto done;
+      }
+      chunks = grown;
+    }
+    struct Vec0OptimizeChunk *chunk = &chunks[n++];
+    chunk->chunk_id = sqlite3_column_int64(stmt, 0);
+    chunk->count = 0;
+    chunk->validity = sqlite3_malloc(validitySize);
+    chunk->rowids = sqlite3_malloc(rowidsSize);
+    if (!chunk->validity || !chunk->rowids) {
+      rc = SQLITE_NOMEM;
+      goto done;
+    }
+    memcpy(chunk->validity, sqlite3_column_blob(stmt, 1), validitySize);
+    memcpy(chunk->rowids, sqlite3_column_blob(stmt, 2), rowidsSize);
+    for (int i = 0; i < validitySize; i++) {
+      chunk->count += __builtin_popcountl(chunk->validity[i]);
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto done;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  // chunks is NULL for a partition without any
+  if (n > 1) {
+    qsort(chunks, n, sizeof(*chunks), vec0_optimize_chunk_cmp);
+  }
+  int dst = 0, src = n - 1;
+  while (dst < src) {
+    struct Vec0OptimizeChunk *to = &chunks[dst];
+    struct Vec0OptimizeChunk *from = &chunks[src];
+    if (to->count == p->chunk_size) {
+      dst++;
+      continue;
+    }
+    if (from->count == 0) {
+      src--;
+      continue;
+    }
+    int dst_offset = vec0_optimize_find_slot(to->validity, p->chunk_size, 0);
+    int src_offset = vec0_optimize_find_slot(from->validity, p->chunk_size, 1);
+    rc = vec0_move_row(p, from->rowids[src_offset], from->chunk_id, src_offset,
+                       to->chunk_id, dst_offset);
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+    from->validity[src_offset / CHAR_BIT] &= ~(1 << (src_offset % CHAR_BIT));
+    from->count--;
+    to->validity[dst_offset / CHAR_BIT] |= 1 << (dst_offset % CHAR_BIT);
+    to->rowids[dst_offset] = from->rowids[src_offset];
+    to->count++;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (chunks[i].count == 0) {
+      int deleted;
+      rc = vec0Update_Delete_DeleteChunkIfEmpty(p, chunks[i].chunk_id,
+                                                &deleted);
+    } else {
+      rc = vec0_free_slots_clear(p, chunks[i].chunk_id);
+      if (rc == SQLITE_OK) {
+        rc = vec0_free_slots_update(p, chunks[i].chunk_id,
+                                    p->chunk_size - chunks[i].count);
+      }
+    }
+    if (rc != SQLITE_OK) {
+      goto done;
+    }
+  }
+  rc = SQLITE_OK;
+
+done:
+  sqlite3_finalize(stmt);
+  for (int i = 0; i < n; i++) {
+    sqlite3_free(chunks[i].validity);
+    sqlite3_free(chunks[i].rowids);
+  }
+  sqlite3_free(chunks);
+  return rc;
+}
+
+/**
+ * @brief Handle the 'optimize' command: repack every partition's chunks.
+ *
+ * Tables created before _free_slots existed get it here, so later inserts
+ * reuse the slots of deleted rows.
+ */
+static int vec0_optimize(vec0_vtab *p) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  sqlite3_value **groups = NULL;
+  int numGroups = 0, capacity = 0;
+  i64 reorganizing = 0;
+
+  if (vec0_all_columns_diskann(p)) {
+    return SQLITE_OK;
+  }
+  rc = vec0_reorganize_exec(p, &reorganizing,
+                            "SELECT EXISTS (SELECT 1 FROM " VEC0_SHADOW_INFO_NAME
+                            " WHERE key = '" VEC0_REORGANIZE_INFO_KEY "')",
+                            p->schemaName, p->tableName);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  if (reorganizing) {
+    vtab_set_error(&p->base,
+                   "cannot optimize while a reorganize is under way");
+    return SQLITE_ERROR;
+  }
+
+  if (!p->shadowFreeSlotsName) {
+    rc = vec0_reorganize_exec(p, NULL, VEC0_SHADOW_FREE_SLOTS_CREATE,
+                              p->schemaName, p->tableName);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    rc = vec0_reorganize_exec(p, NULL,
+                              "INSERT INTO " VEC0_SHADOW_INFO_NAME
+                              "(key, value) VALUES ('free_slots', 1)",
+                              p->schemaName, p->tableName);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    p->shadowFreeSlotsName = sqlite3_mprintf("%s_free_slots", p->tableName);
+    if (!p->shadowFreeSlotsName) {
+      return SQLITE_NOMEM;
+    }
+  }
+
+  if (p->numPartitionColumns == 0) {
+    return vec0_optimize_partition(p, NULL);
+  }
+
+  sqlite3_str *s = sqlite3_str_new(NULL);
+  sqlite3_str_appendall(s, "SELECT DISTINCT ");
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_str_appendf(s, "%spartition%02d", i == 0 ? "" : ", ", i);
+  }
+  sqlite3_str_appendf(s, " FROM " VEC0_SHADOW_CHUNKS_NAME, p->schemaName,
+                      p->tableName);
+  char *zSql = sqlite3_str_finish(s);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto done;
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (numGroups == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      sqlite3_value **grown = sqlite3_realloc64(
+          groups, (i64)capacity * p->numPartitionColumns * sizeof(*groups));
+      if (!grown) {
+        rc = SQLITE_NOMEM;
+        goto done;
+      }
+      groups = grown;
+    }
+    sqlite3_value **group = &groups[numGroups++ * p->numPartitionColumns];
+    memset(group, 0, p->numPartitionColumns * sizeof(*group));
+    for (int i = 0; i < p->numPartitionColumns; i++) {
+      group[i] = sqlite3_value_dup(sqlite3_column_value(stmt, i));
+      if (!group[i]) {
+        rc = SQLITE_NOMEM;
+        goto done;
+      }
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto done;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  rc = SQLITE_OK;
+  for (int g = 0; g < numGroups && rc == SQLITE_OK; g++) {
+    rc = vec0_optimize_partition(p, &groups[g * p->numPartitionColumns]);
+  }
+
+done:
+  sqlite3_finalize(stmt);
+  for (int i = 0; i < numGroups * p->numPartitionColumns; i++) {
+    sqlite3_value_free(groups[i]);
+  }
+  sqlite3_free(groups);
+  return rc;
+}
+
+// ============================================================================
+// Command
+// ============================================================================
+
+/**
+ * @brief The vector column rows are clustered on: the first FLAT float32
+ * column, or -1.
+ */
+static int vec0_reorganize_column(vec0_vtab *p) {
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (p->vector_columns[i].index_type == VEC0_INDEX_TYPE_FLAT &&
+        p->vector_columns[i].element_type == SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int vec0_reorganize_step(vec0_vtab *p, int col) {
+  int rc;
+  i64 watermark = 0;
+
+  rc = vec0_reorganize_exec(p, &watermark,
+                            "SELECT value FROM " VEC0_SHADOW_INFO_NAME
+                            " WHERE key = '" VEC0_REORGANIZE_INFO_KEY "'",
+                            p->schemaName, p->tableName);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  if (!watermark) {
+    rc = vec0_reorganize_exec(p, &watermark,
+                              "SELECT max(rowid) FROM " VEC0_SHADOW_CHUNKS_NAME,
+                              p->schemaName, p->tableName);
+    if (rc != SQLITE_OK || !watermark) {
+      return rc;
+    }
+    rc = vec0_reorganize_exec(
+        p, NULL,
+        "INSERT OR REPLACE INTO " VEC0_SHADOW_INFO_NAME
+        "(key, value) VALUES ('" VEC0_REORGANIZE_INFO_KEY "', %lld)",
+        p->schemaName, p->tableName, watermark);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    rc = vec0_reorganize_exec(p, NULL,
+                              "CREATE TABLE IF NOT EXISTS "
+                              VEC0_SHADOW_REORGANIZE_NAME
+                              "(seq INTEGER PRIMARY KEY, id INTEGER NOT NULL)",
+                              p->schemaName, p->tableName);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+
+  // inserts must not refill old chunks that are being emptied
+  if (p->shadowFreeSlotsName) {
+    rc = vec0_reorganize_exec(p, NULL,
+                              "DELETE FROM " VEC0_SHADOW_FREE_SLOTS_NAME
+                              " WHERE rowid <= %lld",
+                              p->schemaName, p->tableName, watermark);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+
+  i64 planned = 0;
+  rc = vec0_reorganize_exec(p, &planned,
+                            "SELECT EXISTS (SELECT 1 FROM "
+                            VEC0_SHADOW_REORGANIZE_NAME ")",
+                            p->schemaName, p->tableName);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  if (planned) {
+    rc = vec0_reorganize_move(p, watermark);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    rc = vec0_reorganize_exec(p, &planned,
+                              "SELECT EXISTS (SELECT 1 FROM "
+                              VEC0_SHADOW_REORGANIZE_NAME ")",
+                              p->schemaName, p->tableName);
+    if (rc != SQLITE_OK || planned) {
+      return rc;
+    }
+    i64 remaining = 0;
+    rc = vec0_reorganize_exec(p, &remaining,
+                              "SELECT EXISTS (SELECT 1 FROM "
+                              VEC0_SHADOW_CHUNKS_NAME " WHERE rowid <= %lld)",
+                              p->schemaName, p->tableName, watermark);
+    if (rc != SQLITE_OK || remaining) {
+      return rc;
+    }
+  } else {
+    int found;
+    rc = vec0_reorganize_plan(p, col, watermark, &found);
+    if (rc != SQLITE_OK || found) {
+      return rc;
+    }
+  }
+
+  // nothing left at or below the watermark: done. The empty _reorganize
+  // table stays, tables can't be dropped while the INSERT runs.
+  return vec0_reorganize_exec(p, NULL,
+                              "DELETE FROM " VEC0_SHADOW_INFO_NAME
+                              " WHERE key = '" VEC0_REORGANIZE_INFO_KEY "'",
+                              p->schemaName, p->tableName);
+}
+
+/**
+ * @brief Handle the 'reorganize' and 'optimize' commands. Returns
+ * SQLITE_EMPTY for other commands.
+ */
+static int vec0_reorganize_handle_command(vec0_vtab *p, const char *command) {
+  if (strcmp(command, "optimize") == 0 || strcmp(command, "reorganize") == 0) {
+    // rows are about to move out from under the insert cursors
+    vec0_insert_cursors_clear(p);
+  }
+  if (strcmp(command, "optimize") == 0) {
+    return vec0_optimize(p);
+  }
+  if (strcmp(command, "reorganize") != 0) {
+    return SQLITE_EMPTY;
+  }
+  int col = vec0_reorganize_column(p);
+  if (col < 0) {
+    vtab_set_error(&p->base,
+                   "reorganize requires a float32 vector column without an "
+                   "index");
+    return SQLITE_ERROR;
+  }
+
+  // No SAVEPOINT here: SQLite won't open one while the INSERT runs. Writes
+  // made so far are undone with the rest of the failed statement.
+  return vec0_reorganize_step(p, col);
+}
+
+#endif /* SQLITE_VEC_REORGANIZE_C */
@@ -242,6 +242,92 @@ static int rescore_on_insert(vec0_vtab *p, i64 chunk_rowid, i64 chunk_offset,
   return SQLITE_OK;
 }
 
+/**
+ * rescore_on_insert() for n rows written to the same chunk at once, for
+ * rescore column i: the _rescore_chunks blob is read and written back once.
+ * vectors holds the n float vectors back to back.
+ */
+static int rescore_on_insert_rows(vec0_vtab *p, int i, i64 chunk_rowid,
+                                  const i64 *chunk_offsets, const i64 *rowids,
+                                  const f32 *vectors, int n) {
+  struct VectorColumnDefinition *col = &p->vector_columns[i];
+  size_t qsize = rescore_quantized_byte_size(col);
+  size_t fsize = vector_column_byte_size(*col);
+  i64 blob_size = (i64)p->chunk_size * (i64)qsize;
+  sqlite3_blob *blob = NULL;
+  sqlite3_stmt *stmt = NULL;
+  uint8_t *qbuf = NULL;
+  int rc, brc;
+
+  // 1. Quantize into the _rescore_chunks blob
+  rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowRescoreChunksNames[i],
+                         "vectors", chunk_rowid, 1, &blob);
+  if (rc != SQLITE_OK)
+    return rc;
+  if (sqlite3_blob_bytes(blob) != blob_size) {
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
+  qbuf = sqlite3_malloc64(blob_size);
+  if (!qbuf) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_blob_read(blob, qbuf, blob_size, 0);
+  if (rc != SQLITE_OK)
+    goto cleanup;
+  for (int j = 0; j < n; j++) {
+    const float *src = vectors + (size_t)j * col->dimensions;
+    uint8_t *dst = qbuf + chunk_offsets[j] * qsize;
+    switch (col->rescore.quantizer_type) {
+    case VEC0_RESCORE_QUANTIZER_BIT:
+      rescore_quantize_float_to_bit(src, dst, col->dimensions);
+      break;
+    case VEC0_RESCORE_QUANTIZER_INT8:
+      rescore_quantize_float_to_int8(src, (int8_t *)dst, col->dimensions);
+      break;
+    }
+  }
+  rc = sqlite3_blob_write(blob, qbuf, blob_size, 0);
+  if (rc != SQLITE_OK)
+    goto cleanup;
+
+  // 2. Insert float vectors into _rescore_vectors (rowid-keyed)
+  {
+    char *zSql = sqlite3_mprintf(
+        "INSERT INTO \"%w\".\"%w\"(rowid, vector) VALUES (?, ?)",
+        p->schemaName, p->shadowRescoreVectorsNames[i]);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK)
+      goto cleanup;
+    for (int j = 0; j < n; j++) {
+      sqlite3_bind_int64(stmt, 1, rowids[j]);
+      sqlite3_bind_blob(stmt, 2, vectors + (size_t)j * col->dimensions, fsize,
+                        SQLITE_STATIC);
+      rc = sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+      if (rc != SQLITE_DONE) {
+        rc = SQLITE_ERROR;
+        goto cleanup;
+      }
+    }
+    rc = SQLITE_OK;
+  }
+
+cleanup:
+  sqlite3_finalize(stmt);
+  sqlite3_free(qbuf);
+  brc = sqlite3_blob_close(blob);
+  if (rc != SQLITE_OK)
+    return rc;
+  return brc;
+}
+
 // ============================================================================
 // Delete path
 // ============================================================================
@@ -362,10 +448,27 @@ static int rescore_knn(vec0_vtab *p, vec0_cursor *pCur,
   size_t qsize = rescore_quantized_byte_size(vector_column);
   size_t fsize = vector_column_byte_size(*vector_column);
 
+  // every buffer below lives in the table's scratch arena
+  struct Vec0ScratchFrame scratch;
+  size_t bitmapSize = p->chunk_size / CHAR_BIT;
+  rc = vec0_scratch_acquire(
+      &p->scratch,
+      vec0_scratch_size(qsize) + vec0_scratch_size(fsize) +
+          vec0_scratch_size(p->chunk_size * sizeof(f32)) +
+          vec0_scratch_size(bitmapSize) +
+          vec0_scratch_size((size_t)p->chunk_size * qsize),
+      &scratch);
+  if (rc != SQLITE_OK)
+    return rc;
+  void *quantizedQuery = vec0_scratch_alloc(&scratch, qsize);
+  void *fBuf = vec0_scratch_alloc(&scratch, fsize);
+  f32 *chunk_distances =
+      vec0_scratch_alloc(&scratch, p->chunk_size * sizeof(f32));
+  u8 *b = vec0_scratch_alloc(&scratch, bitmapSize);
+  void *baseVectors =
+      vec0_scratch_alloc(&scratch, (size_t)p->chunk_size * qsize);
+
   // Quantize the query vector
-  void *quantizedQuery = sqlite3_malloc(qsize);
-  if (!quantizedQuery)
-    return SQLITE_NOMEM;
 
   switch (vector_column->rescore.quantizer_type) {
   case VEC0_RESCORE_QUANTIZER_BIT:
@@ -378,42 +481,37 @@ static int rescore_knn(vec0_vtab *p, vec0_cursor *pCur,
     break;
   }
 
+  vec0_distance_f32_fn quantizedDistance = vec0_column_distance_fn(
+      vector_column->rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT
+          ? SQLITE_VEC_ELEMENT_TYPE_BIT
+          : SQLITE_VEC_ELEMENT_TYPE_INT8,
+      vector_column->distance_metric, qdim, 0);
+
   // Phase 1: Scan quantized chunks for k*oversample candidates
   sqlite3_stmt *stmtChunks = NULL;
   rc = vec0_chunks_iter(p, idxStr, argc, argv, &stmtChunks);
   if (rc != SQLITE_OK) {
-    sqlite3_free(quantizedQuery);
+    vec0_scratch_release(&scratch);
     return rc;
   }
 
-  i64 *cand_rowids = sqlite3_malloc(k_oversample * sizeof(i64));
-  f32 *cand_distances = sqlite3_malloc(k_oversample * sizeof(f32));
-  i64 *tmp_rowids = sqlite3_malloc(k_oversample * sizeof(i64));
-  f32 *tmp_distances = sqlite3_malloc(k_oversample * sizeof(f32));
-  f32 *chunk_distances = sqlite3_malloc(p->chunk_size * sizeof(f32));
-  i32 *chunk_topk_idxs = sqlite3_malloc(k_oversample * sizeof(i32));
-  u8 *b = sqlite3_malloc(p->chunk_size / CHAR_BIT);
-  u8 *bTaken = sqlite3_malloc(p->chunk_size / CHAR_BIT);
-  u8 *bmRowids = NULL;
-  void *baseVectors = sqlite3_malloc((i64)p->chunk_size * (i64)qsize);
-
-  if (!cand_rowids || !cand_distances || !tmp_rowids || !tmp_distances ||
-      !chunk_distances || !chunk_topk_idxs || !b || !bTaken || !baseVectors) {
-    rc = SQLITE_NOMEM;
+  // quantized-distance candidates, then the float-distance top k
+  struct Vec0TopK cands;
+  struct Vec0TopK results;
+  memset(&results, 0, sizeof(results));
+  sqlite3_blob *blobQ = NULL;
+  struct Vec0Prefetch prefetch;
+  memset(&prefetch, 0, sizeof(prefetch));
+  struct Vec0ScanTimer timer;
+  memset(&timer, 0, sizeof(timer));
+  rc = vec0_topk_init(&cands, k_oversample);
+  if (rc != SQLITE_OK) {
     goto cleanup;
   }
-  memset(cand_rowids, 0, k_oversample * sizeof(i64));
-  memset(cand_distances, 0, k_oversample * sizeof(f32));
 
-  if (arrayRowidsIn) {
-    bmRowids = sqlite3_malloc(p->chunk_size / CHAR_BIT);
-    if (!bmRowids) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
-    }
-  }
-
-  i64 cand_used = 0;
+  vec0_prefetch_start(p, p->shadowRescoreChunksNames[vectorColumnIdx],
+                      &prefetch);
+  vec0_scan_timer_start(&timer);
 
   while (1) {
     rc = sqlite3_step(stmtChunks);
@@ -425,6 +523,8 @@ static int rescore_knn(vec0_vtab *p, vec0_cursor *pCur,
     }
 
     i64 chunk_id = sqlite3_column_int64(stmtChunks, 0);
+    vec0_prefetch_advance(&prefetch, chunk_id);
+    timer.stats.chunks++;
     unsigned char *chunkValidity =
         (unsigned char *)sqlite3_column_blob(stmtChunks, 1);
     i64 *chunkRowids = (i64 *)sqlite3_column_blob(stmtChunks, 2);
@@ -442,85 +542,54 @@ static int rescore_knn(vec0_vtab *p, vec0_cursor *pCur,
     }
 
     memset(chunk_distances, 0, p->chunk_size * sizeof(f32));
-    memset(chunk_topk_idxs, 0, k_oversample * sizeof(i32));
     bitmap_copy(b, chunkValidity, p->chunk_size);
 
     if (arrayRowidsIn) {
-      bitmap_clear(bmRowids, p->chunk_size);
-      for (int j = 0; j < p->chunk_size; j++) {
-        if (!bitmap_get(chunkValidity, j))
-          continue;
-        i64 rid = chunkRowids[j];
-        void *found = bsearch(&rid, arrayRowidsIn->z, arrayRowidsIn->length,
-                               sizeof(i64), _cmp);
-        bitmap_set(bmRowids, j, found ? 1 : 0);
-      }
-      bitmap_and_inplace(b, bmRowids, p->chunk_size);
+      bitmap_filter_rowids_in(b, chunkRowids, p->chunk_size, arrayRowidsIn);
     }
 
-    // Read quantized vectors
-    sqlite3_blob *blobQ = NULL;
-    rc = sqlite3_blob_open(p->db, p->schemaName,
-                           p->shadowRescoreChunksNames[vectorColumnIdx],
-                           "vectors", chunk_id, 0, &blobQ);
+    if (bitmap_is_clear(b, p->chunk_size)) {
+      timer.stats.filtered++;
+      vec0_scan_timer_lap(&timer, &timer.stats.compute_ns);
+      continue;
+    }
+
+    // Read quantized vectors. The blob handle is opened on the first chunk
+    // and moved to later chunks with sqlite3_blob_reopen(). When few rows
+    // are candidates only theirs are read, the rest of baseVectors is stale.
+    if (!blobQ) {
+      rc = sqlite3_blob_open(p->db, p->schemaName,
+                             p->shadowRescoreChunksNames[vectorColumnIdx],
+                             "vectors", chunk_id, 0, &blobQ);
+    } else {
+      rc = sqlite3_blob_reopen(blobQ, chunk_id);
+    }
     if (rc != SQLITE_OK)
       goto cleanup;
-    rc = sqlite3_blob_read(blobQ, baseVectors,
-                           (i64)p->chunk_size * (i64)qsize, 0);
-    sqlite3_blob_close(blobQ);
+    if (vec0_chunk_is_sparse(b, p->chunk_size)) {
+      rc = vec0_blob_read_rows(blobQ, b, p->chunk_size, qsize, baseVectors);
+      timer.stats.sparse++;
+    } else {
+      rc = sqlite3_blob_read(blobQ, baseVectors,
+                             (i64)p->chunk_size * (i64)qsize, 0);
+    }
     if (rc != SQLITE_OK)
       goto cleanup;
+    vec0_scan_timer_lap(&timer, &timer.stats.read_ns);
 
     // Compute quantized distances
-    for (int j = 0; j < p->chunk_size; j++) {
-      if (!bitmap_get(b, j))
-        continue;
-      f32 dist = FLT_MAX;
-      switch (vector_column->rescore.quantizer_type) {
-      case VEC0_RESCORE_QUANTIZER_BIT: {
-        const u8 *base_j = ((u8 *)baseVectors) + (j * (qdim / CHAR_BIT));
-        dist = distance_hamming(base_j, (u8 *)quantizedQuery, &qdim);
-        break;
-      }
-      case VEC0_RESCORE_QUANTIZER_INT8: {
-        const i8 *base_j = ((i8 *)baseVectors) + (j * qdim);
-        switch (vector_column->distance_metric) {
-        case VEC0_DISTANCE_METRIC_L2:
-          dist = distance_l2_sqr_int8(base_j, (i8 *)quantizedQuery, &qdim);
-          break;
-        case VEC0_DISTANCE_METRIC_COSINE:
-          dist = distance_cosine_int8(base_j, (i8 *)quantizedQuery, &qdim);
-          break;
-        case VEC0_DISTANCE_METRIC_L1:
-          dist = (f32)distance_l1_int8(base_j, (i8 *)quantizedQuery, &qdim);
-          break;
-        }
-        break;
-      }
-      }
-      chunk_distances[j] = dist;
-    }
-
-    int used1;
-    min_idx(chunk_distances, p->chunk_size, b, chunk_topk_idxs,
-            min(k_oversample, p->chunk_size), bTaken, &used1);
+    distances_for_chunk(quantizedDistance, quantizedQuery, baseVectors, qsize,
+                        &qdim, p->chunk_size, b, chunk_distances);
 
-    i64 merged_used;
-    merge_sorted_lists(cand_distances, cand_rowids, cand_used, chunk_distances,
-                       chunkRowids, chunk_topk_idxs,
-                       min(min(k_oversample, p->chunk_size), used1),
-                       tmp_distances, tmp_rowids, k_oversample, &merged_used);
-
-    for (i64 j = 0; j < merged_used; j++) {
-      cand_rowids[j] = tmp_rowids[j];
-      cand_distances[j] = tmp_distances[j];
-    }
-    cand_used = merged_used;
+    vec0_topk_push_chunk(&cands, chunk_distances, chunkRowids, b,
+                         p->chunk_size);
+    vec0_scan_timer_lap(&timer, &timer.stats.compute_ns);
   }
   rc = SQLITE_OK;
+  vec0_prefetch_stop(&prefetch, &timer.stats);
 
   // Phase 2: Rescore candidates using _rescore_vectors (rowid-keyed)
-  if (cand_used == 0) {
+  if (cands.used == 0) {
     knn_data->current_idx = 0;
     knn_data->k = 0;
     knn_data->rowids = NULL;
@@ -529,12 +598,10 @@ static int rescore_knn(vec0_vtab *p, vec0_cursor *pCur,
     goto cleanup;
   }
   {
-    f32 *float_distances = sqlite3_malloc(cand_used * sizeof(f32));
-    void *fBuf = sqlite3_malloc(fsize);
-    if (!float_distances || !fBuf) {
-      sqlite3_free(float_distances);
-      sqlite3_free(fBuf);
-      rc = SQLITE_NOMEM;
+    // rescore in quantized-distance order, so float ties keep that order
+    vec0_topk_finish(&cands);
+    rc = vec0_topk_init(&results, min(k, cands.used));
+    if (rc != SQLITE_OK) {
       goto cleanup;
     }
 
@@ -543,102 +610,58 @@ static int rescore_knn(vec0_vtab *p, vec0_cursor *pCur,
     sqlite3_blob *blobFloat = NULL;
     rc = sqlite3_blob_open(p->db, p->schemaName,
                            p->shadowRescoreVectorsNames[vectorColumnIdx],
-                           "vector", cand_rowids[0], 0, &blobFloat);
-    if (rc != SQLITE_OK) {
-      sqlite3_free(float_distances);
-      sqlite3_free(fBuf);
-      goto cleanup;
-    }
-
-    rc = sqlite3_blob_read(blobFloat, fBuf, fsize, 0);
+                           "vector", cands.rowids[0], 0, &blobFloat);
     if (rc != SQLITE_OK) {
-      sqlite3_blob_close(blobFloat);
-      sqlite3_free(float_distances);
-      sqlite3_free(fBuf);
       goto cleanup;
     }
-    float_distances[0] =
-        vec0_distance_full(fBuf, queryVector, vector_column->dimensions,
-                           vector_column->element_type,
-                           vector_column->distance_metric);
 
-    for (i64 j = 1; j < cand_used; j++) {
-      rc = sqlite3_blob_reopen(blobFloat, cand_rowids[j]);
-      if (rc != SQLITE_OK) {
-        sqlite3_blob_close(blobFloat);
-        sqlite3_free(float_distances);
-        sqlite3_free(fBuf);
-        goto cleanup;
+    for (i32 j = 0; j < cands.used; j++) {
+      if (j > 0) {
+        rc = sqlite3_blob_reopen(blobFloat, cands.rowids[j]);
+        if (rc != SQLITE_OK) {
+          sqlite3_blob_close(blobFloat);
+          goto cleanup;
+        }
       }
       rc = sqlite3_blob_read(blobFloat, fBuf, fsize, 0);
       if (rc != SQLITE_OK) {
         sqlite3_blob_close(blobFloat);
-        sqlite3_free(float_distances);
-        sqlite3_free(fBuf);
         goto cleanup;
       }
-      float_distances[j] =
-          vec0_distance_full(fBuf, queryVector, vector_column->dimensions,
-                             vector_column->element_type,
-                             vector_column->distance_metric);
+      vec0_scan_timer_lap(&timer, &timer.stats.read_ns);
+      f32 distance =
+          vector_column->distance_bounded_fn
+              ? vector_column->distance_bounded_fn(
+                    fBuf, queryVector, &qdim, vec0_topk_threshold(&results))
+              : vector_column->distance_fn(fBuf, queryVector, &qdim);
+      vec0_topk_push(&results, distance, cands.rowids[j]);
+      vec0_scan_timer_lap(&timer, &timer.stats.compute_ns);
     }
     sqlite3_blob_close(blobFloat);
-    sqlite3_free(fBuf);
-
-    // Sort by float distance
-    for (i64 a = 0; a + 1 < cand_used; a++) {
-      i64 minIdx = a;
-      for (i64 c = a + 1; c < cand_used; c++) {
-        if (float_distances[c] < float_distances[minIdx])
-          minIdx = c;
-      }
-      if (minIdx != a) {
-        f32 td = float_distances[a];
-        float_distances[a] = float_distances[minIdx];
-        float_distances[minIdx] = td;
-        i64 tr = cand_rowids[a];
-        cand_rowids[a] = cand_rowids[minIdx];
-        cand_rowids[minIdx] = tr;
-      }
-    }
-
-    i64 result_k = min(k, cand_used);
-    i64 *out_rowids = sqlite3_malloc(result_k * sizeof(i64));
-    f32 *out_distances = sqlite3_malloc(result_k * sizeof(f32));
-    if (!out_rowids || !out_distances) {
-      sqlite3_free(out_rowids);
-      sqlite3_free(out_distances);
-      sqlite3_free(float_distances);
-      rc = SQLITE_NOMEM;
-      goto cleanup;
-    }
-    for (i64 j = 0; j < result_k; j++) {
-      out_rowids[j] = cand_rowids[j];
-      out_distances[j] = float_distances[j];
-    }
 
+    vec0_topk_finish(&results);
     knn_data->current_idx = 0;
-    knn_data->k = result_k;
-    knn_data->rowids = out_rowids;
-    knn_data->distances = out_distances;
-    knn_data->k_used = result_k;
-
-    sqlite3_free(float_distances);
+    knn_data->k = results.used;
+    knn_data->rowids = results.rowids;
+    knn_data->distances = results.distances;
+    knn_data->distances_squared = vec0_distance_is_squared(
+        vector_column->element_type, vector_column->distance_metric);
+    knn_data->k_used = results.used;
+    // now owned by knn_data
+    memset(&results, 0, sizeof(results));
   }
 
 cleanup:
+  vec0_prefetch_stop(&prefetch, &timer.stats);
+  if (rc == SQLITE_OK) {
+    vec0_scan_stats_record(p, &timer.stats);
+  }
+  // blobQ is opened read-only, so closing it never fails.
+  sqlite3_blob_close(blobQ);
   sqlite3_finalize(stmtChunks);
-  sqlite3_free(quantizedQuery);
-  sqlite3_free(cand_rowids);
-  sqlite3_free(cand_distances);
-  sqlite3_free(tmp_rowids);
-  sqlite3_free(tmp_distances);
-  sqlite3_free(chunk_distances);
-  sqlite3_free(chunk_topk_idxs);
-  sqlite3_free(b);
-  sqlite3_free(bTaken);
-  sqlite3_free(bmRowids);
-  sqlite3_free(baseVectors);
+  vec0_topk_free(&cands);
+  vec0_topk_free(&results);
+  vec0_scratch_release(&scratch);
   return rc;
 }
 
@@ -11,7 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef SQLITE_VEC_DEBUG
+#if defined(SQLITE_VEC_DEBUG) || !defined(SQLITE_VEC_OMIT_FS)
 #include <stdio.h>
 #endif
 
@@ -26,6 +26,27 @@ SQLITE_EXTENSION_INIT1
 #define SQLITE_VEC_ENABLE_DISKANN 1
 #endif
 
+// Read-ahead thread for KNN scans, see struct Vec0Prefetch. Needs pthreads.
+#ifndef SQLITE_VEC_ENABLE_PREFETCH
+#define SQLITE_VEC_ENABLE_PREFETCH 0
+#endif
+
+// Worker threads for flat KNN scans, see struct Vec0KnnParallel. Needs pthreads.
+#ifndef SQLITE_VEC_ENABLE_THREADS
+#define SQLITE_VEC_ENABLE_THREADS 0
+#endif
+
+#if SQLITE_VEC_ENABLE_PREFETCH || SQLITE_VEC_ENABLE_THREADS
+#if defined(_WIN32) || defined(__EMSCRIPTEN__)
+#error "SQLITE_VEC_ENABLE_PREFETCH and SQLITE_VEC_ENABLE_THREADS require POSIX threads"
+#endif
+#include <pthread.h>
+#endif
+
+#if SQLITE_VEC_ENABLE_PREFETCH
+#include <time.h>
+#endif
+
 typedef int8_t i8;
 typedef uint8_t u8;
 typedef int16_t i16;
@@ -58,6 +79,11 @@ typedef size_t usize;
 #define SQLITE_RESULT_SUBTYPE 0x001000000
 #endif
 
+#ifndef SQLITE_MUTEX_STATIC_MAIN
+// named SQLITE_MUTEX_STATIC_MASTER before SQLite 3.35
+#define SQLITE_MUTEX_STATIC_MAIN 2
+#endif
+
 #ifndef SQLITE_INDEX_CONSTRAINT_LIMIT
 #define SQLITE_INDEX_CONSTRAINT_LIMIT 73
 #endif
@@ -73,6 +99,10 @@ typedef size_t usize;
 #define SQLITE_VEC_ENABLE_RESCORE 1
 #endif
 
+// Dimensions scored between checks against the bound in the early-abandoning
+// distance kernels.
+#define VEC0_BOUNDED_BLOCK_DIMS 64
+
 enum VectorElementType {
   // clang-format off
   SQLITE_VEC_ELEMENT_TYPE_FLOAT32 = 223 + 0,
@@ -86,15 +116,94 @@ enum VectorElementType {
 #define PORTABLE_ALIGN32 __attribute__((aligned(32)))
 #define PORTABLE_ALIGN64 __attribute__((aligned(64)))
 
-static f32 l2_sqr_float_avx(const void *pVect1v, const void *pVect2v,
+// x86 kernels are compiled per-function for the ISA they need, so the
+// extension itself doesn't require -mavx and loads on any x86 CPU. Which
+// variant actually runs is decided at runtime, see vec0_distance_kernels_init().
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SQLITE_VEC_TARGET(isa)
+#else
+#define SQLITE_VEC_TARGET(isa) __attribute__((target(isa)))
+#endif
+#define SQLITE_VEC_TARGET_SSE4 SQLITE_VEC_TARGET("sse4.1,popcnt")
+#define SQLITE_VEC_TARGET_AVX2 SQLITE_VEC_TARGET("avx2,fma,popcnt")
+#define SQLITE_VEC_TARGET_AVX512                                               \
+  SQLITE_VEC_TARGET("avx512f,avx512bw,avx2,fma,popcnt")
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SQLITE_VEC_POPCNT64(x) ((u32)_mm_popcnt_u64(x))
+#else
+#define SQLITE_VEC_POPCNT64(x)                                                 \
+  ((u32)_mm_popcnt_u32((u32)(x)) + (u32)_mm_popcnt_u32((u32)((x) >> 32)))
+#endif
+
+// Sliding windows that the tail masks below are loaded from.
+static const i32 vec0_tail_mask_i32[16] = {-1, -1, -1, -1, -1, -1, -1, -1,
+                                           0,  0,  0,  0,  0,  0,  0,  0};
+static const i8 vec0_tail_mask_i8[64] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+
+// For _mm256_maskload_ps: selects the first n (< 8) f32 lanes.
+#define SQLITE_VEC_MASK8(n)                                                    \
+  _mm256_loadu_si256((const __m256i *)(vec0_tail_mask_i32 + 8 - (n)))
+// AVX2 has no byte-granular masked load, so int8 and bit kernels instead
+// reload the last full register ending at the end of the vector, and AND away
+// the lanes that were already counted: these select the last n (< 16 / < 32)
+// bytes.
+#define SQLITE_VEC_LAST16_MASK(n)                                              \
+  _mm_loadu_si128((const __m128i *)(vec0_tail_mask_i8 + 16 + (n)))
+#define SQLITE_VEC_LAST32_MASK(n)                                              \
+  _mm256_loadu_si256((const __m256i *)(vec0_tail_mask_i8 + (n)))
+
+SQLITE_VEC_TARGET_SSE4
+static f32 l2_sqr_float_sse(const void *pVect1v, const void *pVect2v,
                             const void *qty_ptr) {
   f32 *pVect1 = (f32 *)pVect1v;
   f32 *pVect2 = (f32 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
+  f32 PORTABLE_ALIGN32 TmpRes[4];
+  size_t qty4 = qty >> 2;
+
+  const f32 *pEnd1 = pVect1 + (qty4 << 2);
+  const f32 *pEnd2 = pVect1 + qty;
+
+  __m128 diff, v1, v2;
+  __m128 sum = _mm_setzero_ps();
+
+  while (pVect1 < pEnd1) {
+    v1 = _mm_loadu_ps(pVect1);
+    pVect1 += 4;
+    v2 = _mm_loadu_ps(pVect2);
+    pVect2 += 4;
+    diff = _mm_sub_ps(v1, v2);
+    sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+  }
+
+  _mm_store_ps(TmpRes, sum);
+  f32 res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  while (pVect1 < pEnd2) {
+    f32 t = *pVect1 - *pVect2;
+    res += t * t;
+    pVect1++;
+    pVect2++;
+  }
+  return res;
+}
+
+SQLITE_VEC_TARGET_AVX2
+static f32 l2_sqr_float_avx2(const void *pVect1v, const void *pVect2v,
+                             const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
   f32 PORTABLE_ALIGN32 TmpRes[8];
   size_t qty16 = qty >> 4;
+  size_t qty8 = qty >> 3;
 
   const f32 *pEnd1 = pVect1 + (qty16 << 4);
+  const f32 *pEnd2 = pVect1 + (qty8 << 3);
 
   __m256 diff, v1, v2;
   __m256 sum = _mm256_set1_ps(0);
@@ -115,20 +224,37 @@ static f32 l2_sqr_float_avx(const void *pVect1v, const void *pVect2v,
     sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
   }
 
+  if (pVect1 < pEnd2) {
+    v1 = _mm256_loadu_ps(pVect1);
+    pVect1 += 8;
+    v2 = _mm256_loadu_ps(pVect2);
+    pVect2 += 8;
+    diff = _mm256_sub_ps(v1, v2);
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+  }
+
+  // masked-off lanes load as 0 on both sides, so they add nothing
+  if (qty & 7) {
+    __m256i m = SQLITE_VEC_MASK8(qty & 7);
+    v1 = _mm256_maskload_ps(pVect1, m);
+    v2 = _mm256_maskload_ps(pVect2, m);
+    diff = _mm256_sub_ps(v1, v2);
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+  }
+
   _mm256_store_ps(TmpRes, sum);
-  return sqrt(TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
-              TmpRes[5] + TmpRes[6] + TmpRes[7]);
+  return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
+         TmpRes[5] + TmpRes[6] + TmpRes[7];
 }
-#endif
-
-#ifdef SQLITE_VEC_ENABLE_NEON
-#include <arm_neon.h>
 
-#define PORTABLE_ALIGN32 __attribute__((aligned(32)))
+// Mask selecting the first n (< 16) lanes of an AVX-512 f32 register.
+#define SQLITE_VEC_MASK16(n) ((__mmask16)((1u << (n)) - 1))
+// Mask selecting the first n (< 64) bytes of an AVX-512 register.
+#define SQLITE_VEC_MASK64(n) ((__mmask64)((((u64)1) << (n)) - 1))
 
-// thx https://github.com/nmslib/hnswlib/pull/299/files
-static f32 l2_sqr_float_neon(const void *pVect1v, const void *pVect2v,
-                             const void *qty_ptr) {
+SQLITE_VEC_TARGET_AVX512
+static f32 l2_sqr_float_avx512(const void *pVect1v, const void *pVect2v,
+                               const void *qty_ptr) {
   f32 *pVect1 = (f32 *)pVect1v;
   f32 *pVect2 = (f32 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
@@ -136,3838 +262,7435 @@ static f32 l2_sqr_float_neon(const void *pVect1v, const void *pVect2v,
 
   const f32 *pEnd1 = pVect1 + (qty16 << 4);
 
-  float32x4_t diff, v1, v2;
-  float32x4_t sum0 = vdupq_n_f32(0);
-  float32x4_t sum1 = vdupq_n_f32(0);
-  float32x4_t sum2 = vdupq_n_f32(0);
-  float32x4_t sum3 = vdupq_n_f32(0);
+  __m512 diff, v1, v2;
+  __m512 sum = _mm512_setzero_ps();
 
   while (pVect1 < pEnd1) {
-    v1 = vld1q_f32(pVect1);
-    pVect1 += 4;
-    v2 = vld1q_f32(pVect2);
-    pVect2 += 4;
-    diff = vsubq_f32(v1, v2);
-    sum0 = vfmaq_f32(sum0, diff, diff);
+    v1 = _mm512_loadu_ps(pVect1);
+    pVect1 += 16;
+    v2 = _mm512_loadu_ps(pVect2);
+    pVect2 += 16;
+    diff = _mm512_sub_ps(v1, v2);
+    sum = _mm512_fmadd_ps(diff, diff, sum);
+  }
 
-    v1 = vld1q_f32(pVect1);
-    pVect1 += 4;
-    v2 = vld1q_f32(pVect2);
-    pVect2 += 4;
-    diff = vsubq_f32(v1, v2);
-    sum1 = vfmaq_f32(sum1, diff, diff);
+  // masked-off lanes load as 0 on both sides, so they add nothing
+  if (qty & 15) {
+    __mmask16 m = SQLITE_VEC_MASK16(qty & 15);
+    v1 = _mm512_maskz_loadu_ps(m, pVect1);
+    v2 = _mm512_maskz_loadu_ps(m, pVect2);
+    diff = _mm512_sub_ps(v1, v2);
+    sum = _mm512_fmadd_ps(diff, diff, sum);
+  }
 
-    v1 = vld1q_f32(pVect1);
-    pVect1 += 4;
-    v2 = vld1q_f32(pVect2);
-    pVect2 += 4;
-    diff = vsubq_f32(v1, v2);
-    sum2 = vfmaq_f32(sum2, diff, diff);
+  return _mm512_reduce_add_ps(sum);
+}
 
-    v1 = vld1q_f32(pVect1);
+SQLITE_VEC_TARGET_SSE4
+static f32 cosine_float_sse(const void *pVect1v, const void *pVect2v,
+                            const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  f32 PORTABLE_ALIGN32 TmpRes[4];
+  size_t qty4 = qty >> 2;
+
+  const f32 *pEnd1 = pVect1 + (qty4 << 2);
+  const f32 *pEnd2 = pVect1 + qty;
+
+  __m128 dot = _mm_setzero_ps();
+  __m128 amag = _mm_setzero_ps();
+  __m128 bmag = _mm_setzero_ps();
+
+  while (pVect1 < pEnd1) {
+    __m128 v1 = _mm_loadu_ps(pVect1);
+    __m128 v2 = _mm_loadu_ps(pVect2);
     pVect1 += 4;
-    v2 = vld1q_f32(pVect2);
     pVect2 += 4;
-    diff = vsubq_f32(v1, v2);
-    sum3 = vfmaq_f32(sum3, diff, diff);
+    dot = _mm_add_ps(dot, _mm_mul_ps(v1, v2));
+    amag = _mm_add_ps(amag, _mm_mul_ps(v1, v1));
+    bmag = _mm_add_ps(bmag, _mm_mul_ps(v2, v2));
   }
 
-  f32 sum_scalar =
-      vaddvq_f32(vaddq_f32(vaddq_f32(sum0, sum1), vaddq_f32(sum2, sum3)));
-  const f32 *pEnd2 = pVect1 + (qty - (qty16 << 4));
+  _mm_store_ps(TmpRes, dot);
+  f32 dot_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  _mm_store_ps(TmpRes, amag);
+  f32 amag_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  _mm_store_ps(TmpRes, bmag);
+  f32 bmag_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+
   while (pVect1 < pEnd2) {
-    f32 diff = *pVect1 - *pVect2;
-    sum_scalar += diff * diff;
+    dot_s += *pVect1 * *pVect2;
+    amag_s += *pVect1 * *pVect1;
+    bmag_s += *pVect2 * *pVect2;
     pVect1++;
     pVect2++;
   }
 
-  return sqrt(sum_scalar);
+  return 1 - (dot_s / (sqrt(amag_s) * sqrt(bmag_s)));
 }
 
-static f32 cosine_float_neon(const void *pVect1v, const void *pVect2v,
-                              const void *qty_ptr) {
+// 1 - dot(a, b), cosine distance for vectors that are already unit length.
+SQLITE_VEC_TARGET_SSE4
+static f32 cosine_unit_float_sse(const void *pVect1v, const void *pVect2v,
+                                 const void *qty_ptr) {
   f32 *pVect1 = (f32 *)pVect1v;
   f32 *pVect2 = (f32 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
-  size_t qty16 = qty >> 4;
-  const f32 *pEnd1 = pVect1 + (qty16 << 4);
-
-  float32x4_t dot0 = vdupq_n_f32(0), dot1 = vdupq_n_f32(0);
-  float32x4_t dot2 = vdupq_n_f32(0), dot3 = vdupq_n_f32(0);
-  float32x4_t amag0 = vdupq_n_f32(0), amag1 = vdupq_n_f32(0);
-  float32x4_t amag2 = vdupq_n_f32(0), amag3 = vdupq_n_f32(0);
-  float32x4_t bmag0 = vdupq_n_f32(0), bmag1 = vdupq_n_f32(0);
-  float32x4_t bmag2 = vdupq_n_f32(0), bmag3 = vdupq_n_f32(0);
-
-  while (pVect1 < pEnd1) {
-    float32x4_t v1, v2;
-    v1 = vld1q_f32(pVect1); pVect1 += 4;
-    v2 = vld1q_f32(pVect2); pVect2 += 4;
-    dot0 = vfmaq_f32(dot0, v1, v2);
-    amag0 = vfmaq_f32(amag0, v1, v1);
-    bmag0 = vfmaq_f32(bmag0, v2, v2);
+  f32 PORTABLE_ALIGN32 TmpRes[4];
 
-    v1 = vld1q_f32(pVect1); pVect1 += 4;
-    v2 = vld1q_f32(pVect2); pVect2 += 4;
-    dot1 = vfmaq_f32(dot1, v1, v2);
-    amag1 = vfmaq_f32(amag1, v1, v1);
-    bmag1 = vfmaq_f32(bmag1, v2, v2);
+  const f32 *pEnd1 = pVect1 + (qty & ~(size_t)7);
+  const f32 *pEnd2 = pVect1 + qty;
 
-    v1 = vld1q_f32(pVect1); pVect1 += 4;
-    v2 = vld1q_f32(pVect2); pVect2 += 4;
-    dot2 = vfmaq_f32(dot2, v1, v2);
-    amag2 = vfmaq_f32(amag2, v1, v1);
-    bmag2 = vfmaq_f32(bmag2, v2, v2);
+  __m128 dot0 = _mm_setzero_ps();
+  __m128 dot1 = _mm_setzero_ps();
 
-    v1 = vld1q_f32(pVect1); pVect1 += 4;
-    v2 = vld1q_f32(pVect2); pVect2 += 4;
-    dot3 = vfmaq_f32(dot3, v1, v2);
-    amag3 = vfmaq_f32(amag3, v1, v1);
-    bmag3 = vfmaq_f32(bmag3, v2, v2);
+  while (pVect1 < pEnd1) {
+    dot0 = _mm_add_ps(dot0,
+                      _mm_mul_ps(_mm_loadu_ps(pVect1), _mm_loadu_ps(pVect2)));
+    dot1 = _mm_add_ps(dot1, _mm_mul_ps(_mm_loadu_ps(pVect1 + 4),
+                                       _mm_loadu_ps(pVect2 + 4)));
+    pVect1 += 8;
+    pVect2 += 8;
   }
 
-  f32 dot_s = vaddvq_f32(vaddq_f32(vaddq_f32(dot0, dot1), vaddq_f32(dot2, dot3)));
-  f32 amag_s = vaddvq_f32(vaddq_f32(vaddq_f32(amag0, amag1), vaddq_f32(amag2, amag3)));
-  f32 bmag_s = vaddvq_f32(vaddq_f32(vaddq_f32(bmag0, bmag1), vaddq_f32(bmag2, bmag3)));
-
-  const f32 *pEnd2 = pVect1 + (qty - (qty16 << 4));
+  _mm_store_ps(TmpRes, _mm_add_ps(dot0, dot1));
+  f32 dot_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
   while (pVect1 < pEnd2) {
     dot_s += *pVect1 * *pVect2;
-    amag_s += *pVect1 * *pVect1;
-    bmag_s += *pVect2 * *pVect2;
-    pVect1++; pVect2++;
+    pVect1++;
+    pVect2++;
   }
-
-  return 1.0f - (dot_s / (sqrtf(amag_s) * sqrtf(bmag_s)));
+  return 1 - dot_s;
 }
 
-static f32 l2_sqr_int8_neon(const void *pVect1v, const void *pVect2v,
-                            const void *qty_ptr) {
-  i8 *pVect1 = (i8 *)pVect1v;
-  i8 *pVect2 = (i8 *)pVect2v;
+SQLITE_VEC_TARGET_SSE4
+static double l1_f32_sse(const void *pVect1v, const void *pVect2v,
+                         const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
+  double PORTABLE_ALIGN32 TmpRes[2];
+  size_t qty4 = qty >> 2;
 
-  const i8 *pEnd1 = pVect1 + qty;
-  i32 sum_scalar = 0;
-
-  while (pVect1 < pEnd1 - 7) {
-    // loading 8 at a time
-    int8x8_t v1 = vld1_s8(pVect1);
-    int8x8_t v2 = vld1_s8(pVect2);
-    pVect1 += 8;
-    pVect2 += 8;
+  const f32 *pEnd1 = pVect1 + (qty4 << 2);
+  const f32 *pEnd2 = pVect1 + qty;
 
-    // widen i8 to i16 for subtraction
-    int16x8_t v1_wide = vmovl_s8(v1);
-    int16x8_t v2_wide = vmovl_s8(v2);
-    int16x8_t diff = vsubq_s16(v1_wide, v2_wide);
+  // f32 -> f64 before subtracting, same as l1_f32
+  const __m128d sign_mask = _mm_set1_pd(-0.0);
+  __m128d acc = _mm_setzero_pd();
 
-    // widening multiply: i16*i16 -> i32 to avoid i16 overflow
-    // (diff can be up to 255, so diff*diff can be up to 65025 > INT16_MAX)
-    int32x4_t sq_lo = vmull_s16(vget_low_s16(diff), vget_low_s16(diff));
-    int32x4_t sq_hi = vmull_s16(vget_high_s16(diff), vget_high_s16(diff));
-    int32x4_t sum = vaddq_s32(sq_lo, sq_hi);
+  while (pVect1 < pEnd1) {
+    __m128 v1 = _mm_loadu_ps(pVect1);
+    __m128 v2 = _mm_loadu_ps(pVect2);
+    pVect1 += 4;
+    pVect2 += 4;
 
-    sum_scalar += vgetq_lane_s32(sum, 0) + vgetq_lane_s32(sum, 1) +
-                  vgetq_lane_s32(sum, 2) + vgetq_lane_s32(sum, 3);
+    __m128d low_diff = _mm_sub_pd(_mm_cvtps_pd(v1), _mm_cvtps_pd(v2));
+    __m128d high_diff = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(v1, v1)),
+                                   _mm_cvtps_pd(_mm_movehl_ps(v2, v2)));
+    acc = _mm_add_pd(acc, _mm_andnot_pd(sign_mask, low_diff));
+    acc = _mm_add_pd(acc, _mm_andnot_pd(sign_mask, high_diff));
   }
 
-  // handle leftovers
-  while (pVect1 < pEnd1) {
-    i16 diff = (i16)*pVect1 - (i16)*pVect2;
-    sum_scalar += diff * diff;
+  _mm_store_pd(TmpRes, acc);
+  double sum = TmpRes[0] + TmpRes[1];
+  while (pVect1 < pEnd2) {
+    sum += fabs((double)*pVect1 - (double)*pVect2);
     pVect1++;
     pVect2++;
   }
-
-  return sqrtf(sum_scalar);
+  return sum;
 }
 
-static i32 l1_int8_neon(const void *pVect1v, const void *pVect2v,
-                        const void *qty_ptr) {
+SQLITE_VEC_TARGET_SSE4
+static f32 l2_sqr_int8_sse(const void *pVect1v, const void *pVect2v,
+                           const void *qty_ptr) {
   i8 *pVect1 = (i8 *)pVect1v;
   i8 *pVect2 = (i8 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
+  i32 PORTABLE_ALIGN32 TmpRes[4];
 
-  const int8_t *pEnd1 = pVect1 + qty;
+  const i8 *pEnd1 = pVect1 + (qty & ~(size_t)15);
+  const i8 *pEnd2 = pVect1 + qty;
 
-  int32x4_t acc1 = vdupq_n_s32(0);
-  int32x4_t acc2 = vdupq_n_s32(0);
-  int32x4_t acc3 = vdupq_n_s32(0);
-  int32x4_t acc4 = vdupq_n_s32(0);
+  __m128i acc = _mm_setzero_si128();
 
-  while (pVect1 < pEnd1 - 63) {
-    int8x16_t v1 = vld1q_s8(pVect1);
-    int8x16_t v2 = vld1q_s8(pVect2);
-    int8x16_t diff1 = vabdq_s8(v1, v2);
-    acc1 = vaddq_s32(acc1, vpaddlq_u16(vpaddlq_u8(diff1)));
+  while (pVect1 < pEnd1) {
+    __m128i v1 = _mm_loadu_si128((const __m128i *)pVect1);
+    __m128i v2 = _mm_loadu_si128((const __m128i *)pVect2);
+    pVect1 += 16;
+    pVect2 += 16;
 
-    v1 = vld1q_s8(pVect1 + 16);
-    v2 = vld1q_s8(pVect2 + 16);
-    int8x16_t diff2 = vabdq_s8(v1, v2);
-    acc2 = vaddq_s32(acc2, vpaddlq_u16(vpaddlq_u8(diff2)));
+    // widen i8 to i16 for subtraction, then i16*i16 -> i32 pairwise sums
+    __m128i diff_lo =
+        _mm_sub_epi16(_mm_cvtepi8_epi16(v1), _mm_cvtepi8_epi16(v2));
+    __m128i diff_hi = _mm_sub_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(v1, 8)),
+                                    _mm_cvtepi8_epi16(_mm_srli_si128(v2, 8)));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(diff_lo, diff_lo));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(diff_hi, diff_hi));
+  }
 
-    v1 = vld1q_s8(pVect1 + 32);
-    v2 = vld1q_s8(pVect2 + 32);
-    int8x16_t diff3 = vabdq_s8(v1, v2);
-    acc3 = vaddq_s32(acc3, vpaddlq_u16(vpaddlq_u8(diff3)));
+  _mm_store_si128((__m128i *)TmpRes, acc);
+  i32 sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  while (pVect1 < pEnd2) {
+    i32 diff = (i32)*pVect1 - (i32)*pVect2;
+    sum += diff * diff;
+    pVect1++;
+    pVect2++;
+  }
+  return (f32)sum;
+}
 
-    v1 = vld1q_s8(pVect1 + 48);
-    v2 = vld1q_s8(pVect2 + 48);
-    int8x16_t diff4 = vabdq_s8(v1, v2);
-    acc4 = vaddq_s32(acc4, vpaddlq_u16(vpaddlq_u8(diff4)));
+SQLITE_VEC_TARGET_SSE4
+static i32 l1_int8_sse(const void *pVect1v, const void *pVect2v,
+                       const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  i32 PORTABLE_ALIGN32 TmpRes[4];
 
-    pVect1 += 64;
-    pVect2 += 64;
-  }
+  const i8 *pEnd1 = pVect1 + (qty & ~(size_t)15);
+  const i8 *pEnd2 = pVect1 + qty;
 
-  while (pVect1 < pEnd1 - 15) {
-    int8x16_t v1 = vld1q_s8(pVect1);
-    int8x16_t v2 = vld1q_s8(pVect2);
-    int8x16_t diff = vabdq_s8(v1, v2);
-    acc1 = vaddq_s32(acc1, vpaddlq_u16(vpaddlq_u8(diff)));
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i acc = _mm_setzero_si128();
+
+  while (pVect1 < pEnd1) {
+    __m128i v1 = _mm_loadu_si128((const __m128i *)pVect1);
+    __m128i v2 = _mm_loadu_si128((const __m128i *)pVect2);
     pVect1 += 16;
     pVect2 += 16;
-  }
 
-  int32x4_t acc = vaddq_s32(vaddq_s32(acc1, acc2), vaddq_s32(acc3, acc4));
+    __m128i diff_lo = _mm_abs_epi16(
+        _mm_sub_epi16(_mm_cvtepi8_epi16(v1), _mm_cvtepi8_epi16(v2)));
+    __m128i diff_hi = _mm_abs_epi16(
+        _mm_sub_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(v1, 8)),
+                      _mm_cvtepi8_epi16(_mm_srli_si128(v2, 8))));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(diff_lo, ones));
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(diff_hi, ones));
+  }
 
-  int32_t sum = 0;
-  while (pVect1 < pEnd1) {
-    int32_t diff = abs((int32_t)*pVect1 - (int32_t)*pVect2);
-    sum += diff;
+  _mm_store_si128((__m128i *)TmpRes, acc);
+  i32 sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  while (pVect1 < pEnd2) {
+    sum += abs((i32)*pVect1 - (i32)*pVect2);
     pVect1++;
     pVect2++;
   }
-
-  return vaddvq_s32(acc) + sum;
+  return sum;
 }
 
-static double l1_f32_neon(const void *pVect1v, const void *pVect2v,
-                          const void *qty_ptr) {
-  f32 *pVect1 = (f32 *)pVect1v;
-  f32 *pVect2 = (f32 *)pVect2v;
+SQLITE_VEC_TARGET_SSE4
+static f32 cosine_int8_sse(const void *pA, const void *pB, const void *pD) {
+  const i8 *a = (const i8 *)pA;
+  const i8 *b = (const i8 *)pB;
+  size_t d = *((const size_t *)pD);
+  i32 PORTABLE_ALIGN32 TmpRes[4];
+
+  const i8 *aEnd1 = a + (d & ~(size_t)15);
+  const i8 *aEnd2 = a + d;
+
+  __m128i dot_acc = _mm_setzero_si128();
+  __m128i aMag_acc = _mm_setzero_si128();
+  __m128i bMag_acc = _mm_setzero_si128();
+
+  while (a < aEnd1) {
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    __m128i a_lo = _mm_cvtepi8_epi16(va);
+    __m128i a_hi = _mm_cvtepi8_epi16(_mm_srli_si128(va, 8));
+    __m128i b_lo = _mm_cvtepi8_epi16(vb);
+    __m128i b_hi = _mm_cvtepi8_epi16(_mm_srli_si128(vb, 8));
+
+    dot_acc = _mm_add_epi32(dot_acc, _mm_madd_epi16(a_lo, b_lo));
+    dot_acc = _mm_add_epi32(dot_acc, _mm_madd_epi16(a_hi, b_hi));
+    aMag_acc = _mm_add_epi32(aMag_acc, _mm_madd_epi16(a_lo, a_lo));
+    aMag_acc = _mm_add_epi32(aMag_acc, _mm_madd_epi16(a_hi, a_hi));
+    bMag_acc = _mm_add_epi32(bMag_acc, _mm_madd_epi16(b_lo, b_lo));
+    bMag_acc = _mm_add_epi32(bMag_acc, _mm_madd_epi16(b_hi, b_hi));
+
+    a += 16;
+    b += 16;
+  }
+
+  _mm_store_si128((__m128i *)TmpRes, dot_acc);
+  i32 dot = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  _mm_store_si128((__m128i *)TmpRes, aMag_acc);
+  i32 aMag = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+  _mm_store_si128((__m128i *)TmpRes, bMag_acc);
+  i32 bMag = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+
+  while (a < aEnd2) {
+    dot += (i32)*a * (i32)*b;
+    aMag += (i32)*a * (i32)*a;
+    bMag += (i32)*b * (i32)*b;
+    a++;
+    b++;
+  }
+
+  return 1.0f - ((f32)dot / (sqrtf((f32)aMag) * sqrtf((f32)bMag)));
+}
+
+SQLITE_VEC_TARGET_AVX2
+static f32 cosine_float_avx2(const void *pVect1v, const void *pVect2v,
+                             const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
+  f32 PORTABLE_ALIGN32 TmpRes[8];
+  size_t qty16 = qty >> 4;
+  size_t qty8 = qty >> 3;
 
-  const f32 *pEnd1 = pVect1 + qty;
-  float64x2_t acc = vdupq_n_f64(0);
+  const f32 *pEnd1 = pVect1 + (qty16 << 4);
+  const f32 *pEnd2 = pVect1 + (qty8 << 3);
 
-  while (pVect1 < pEnd1 - 3) {
-    float32x4_t v1 = vld1q_f32(pVect1);
-    float32x4_t v2 = vld1q_f32(pVect2);
-    pVect1 += 4;
-    pVect2 += 4;
+  __m256 v1, v2;
+  __m256 dot0 = _mm256_setzero_ps(), dot1 = _mm256_setzero_ps();
+  __m256 amag0 = _mm256_setzero_ps(), amag1 = _mm256_setzero_ps();
+  __m256 bmag0 = _mm256_setzero_ps(), bmag1 = _mm256_setzero_ps();
 
-    // f32x4 -> f64x2 pad for overflow
-    float64x2_t low_diff = vabdq_f64(vcvt_f64_f32(vget_low_f32(v1)),
-                                     vcvt_f64_f32(vget_low_f32(v2)));
-    float64x2_t high_diff =
-        vabdq_f64(vcvt_high_f64_f32(v1), vcvt_high_f64_f32(v2));
+  while (pVect1 < pEnd1) {
+    v1 = _mm256_loadu_ps(pVect1);
+    v2 = _mm256_loadu_ps(pVect2);
+    dot0 = _mm256_fmadd_ps(v1, v2, dot0);
+    amag0 = _mm256_fmadd_ps(v1, v1, amag0);
+    bmag0 = _mm256_fmadd_ps(v2, v2, bmag0);
 
-    acc = vaddq_f64(acc, vaddq_f64(low_diff, high_diff));
+    v1 = _mm256_loadu_ps(pVect1 + 8);
+    v2 = _mm256_loadu_ps(pVect2 + 8);
+    dot1 = _mm256_fmadd_ps(v1, v2, dot1);
+    amag1 = _mm256_fmadd_ps(v1, v1, amag1);
+    bmag1 = _mm256_fmadd_ps(v2, v2, bmag1);
+
+    pVect1 += 16;
+    pVect2 += 16;
   }
 
-  double sum = 0;
-  while (pVect1 < pEnd1) {
-    sum += fabs((double)*pVect1 - (double)*pVect2);
-    pVect1++;
-    pVect2++;
+  if (pVect1 < pEnd2) {
+    v1 = _mm256_loadu_ps(pVect1);
+    v2 = _mm256_loadu_ps(pVect2);
+    dot0 = _mm256_fmadd_ps(v1, v2, dot0);
+    amag0 = _mm256_fmadd_ps(v1, v1, amag0);
+    bmag0 = _mm256_fmadd_ps(v2, v2, bmag0);
+    pVect1 += 8;
+    pVect2 += 8;
   }
 
-  return vaddvq_f64(acc) + sum;
+  if (qty & 7) {
+    __m256i m = SQLITE_VEC_MASK8(qty & 7);
+    v1 = _mm256_maskload_ps(pVect1, m);
+    v2 = _mm256_maskload_ps(pVect2, m);
+    dot1 = _mm256_fmadd_ps(v1, v2, dot1);
+    amag1 = _mm256_fmadd_ps(v1, v1, amag1);
+    bmag1 = _mm256_fmadd_ps(v2, v2, bmag1);
+  }
+
+  _mm256_store_ps(TmpRes, _mm256_add_ps(dot0, dot1));
+  f32 dot_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
+              TmpRes[5] + TmpRes[6] + TmpRes[7];
+  _mm256_store_ps(TmpRes, _mm256_add_ps(amag0, amag1));
+  f32 amag_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
+               TmpRes[5] + TmpRes[6] + TmpRes[7];
+  _mm256_store_ps(TmpRes, _mm256_add_ps(bmag0, bmag1));
+  f32 bmag_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
+               TmpRes[5] + TmpRes[6] + TmpRes[7];
+
+  return 1 - (dot_s / (sqrt(amag_s) * sqrt(bmag_s)));
 }
-#endif
 
-static f32 l2_sqr_float(const void *pVect1v, const void *pVect2v,
-                        const void *qty_ptr) {
+SQLITE_VEC_TARGET_AVX2
+static f32 cosine_unit_float_avx2(const void *pVect1v, const void *pVect2v,
+                                  const void *qty_ptr) {
   f32 *pVect1 = (f32 *)pVect1v;
   f32 *pVect2 = (f32 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
+  f32 PORTABLE_ALIGN32 TmpRes[8];
 
-  f32 res = 0;
-  for (size_t i = 0; i < qty; i++) {
-    f32 t = *pVect1 - *pVect2;
-    pVect1++;
-    pVect2++;
-    res += t * t;
-  }
-  return sqrt(res);
-}
+  const f32 *pEnd1 = pVect1 + (qty & ~(size_t)31);
+  const f32 *pEnd2 = pVect1 + (qty & ~(size_t)7);
 
-static f32 l2_sqr_int8(const void *pA, const void *pB, const void *pD) {
-  i8 *a = (i8 *)pA;
-  i8 *b = (i8 *)pB;
-  size_t d = *((size_t *)pD);
+  __m256 dot0 = _mm256_setzero_ps(), dot1 = _mm256_setzero_ps();
+  __m256 dot2 = _mm256_setzero_ps(), dot3 = _mm256_setzero_ps();
 
-  f32 res = 0;
-  for (size_t i = 0; i < d; i++) {
-    f32 t = *a - *b;
-    a++;
-    b++;
-    res += t * t;
+  while (pVect1 < pEnd1) {
+    dot0 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1), _mm256_loadu_ps(pVect2),
+                           dot0);
+    dot1 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1 + 8),
+                           _mm256_loadu_ps(pVect2 + 8), dot1);
+    dot2 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1 + 16),
+                           _mm256_loadu_ps(pVect2 + 16), dot2);
+    dot3 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1 + 24),
+                           _mm256_loadu_ps(pVect2 + 24), dot3);
+    pVect1 += 32;
+    pVect2 += 32;
   }
-  return sqrt(res);
-}
 
-static f32 distance_l2_sqr_float(const void *a, const void *b, const void *d) {
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if ((*(const size_t *)d) > 16) {
-    return l2_sqr_float_neon(a, b, d);
+  while (pVect1 < pEnd2) {
+    dot0 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1), _mm256_loadu_ps(pVect2),
+                           dot0);
+    pVect1 += 8;
+    pVect2 += 8;
   }
-#endif
-#ifdef SQLITE_VEC_ENABLE_AVX
-  if (((*(const size_t *)d) % 16 == 0)) {
-    return l2_sqr_float_avx(a, b, d);
+
+  if (qty & 7) {
+    __m256i m = SQLITE_VEC_MASK8(qty & 7);
+    dot1 = _mm256_fmadd_ps(_mm256_maskload_ps(pVect1, m),
+                           _mm256_maskload_ps(pVect2, m), dot1);
   }
-#endif
-  return l2_sqr_float(a, b, d);
+
+  _mm256_store_ps(TmpRes,
+                  _mm256_add_ps(_mm256_add_ps(dot0, dot1), _mm256_add_ps(dot2, dot3)));
+  f32 dot_s = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
+              TmpRes[5] + TmpRes[6] + TmpRes[7];
+  return 1 - dot_s;
 }
 
-static f32 distance_l2_sqr_int8(const void *a, const void *b, const void *d) {
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if ((*(const size_t *)d) > 7) {
-    return l2_sqr_int8_neon(a, b, d);
-  }
-#endif
-  return l2_sqr_int8(a, b, d);
+// |a - b| for 8 f32 lanes, widened to f64 before subtracting like l1_f32.
+SQLITE_VEC_TARGET_AVX2
+static __m256d l1_f32_diff4_avx2(__m128 a, __m128 b) {
+  const __m256d sign_mask = _mm256_set1_pd(-0.0);
+  return _mm256_andnot_pd(sign_mask,
+                          _mm256_sub_pd(_mm256_cvtps_pd(a), _mm256_cvtps_pd(b)));
 }
 
-static i32 l1_int8(const void *pA, const void *pB, const void *pD) {
-  i8 *a = (i8 *)pA;
-  i8 *b = (i8 *)pB;
-  size_t d = *((size_t *)pD);
+SQLITE_VEC_TARGET_AVX2
+static double l1_f32_avx2(const void *pVect1v, const void *pVect2v,
+                          const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  double PORTABLE_ALIGN32 TmpRes[4];
+  size_t qty8 = qty >> 3;
 
-  i32 res = 0;
-  for (size_t i = 0; i < d; i++) {
-    res += abs(*a - *b);
-    a++;
-    b++;
+  const f32 *pEnd1 = pVect1 + (qty8 << 3);
+
+  __m256 v1, v2;
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+
+  while (pVect1 < pEnd1) {
+    v1 = _mm256_loadu_ps(pVect1);
+    v2 = _mm256_loadu_ps(pVect2);
+    pVect1 += 8;
+    pVect2 += 8;
+    acc0 = _mm256_add_pd(acc0, l1_f32_diff4_avx2(_mm256_castps256_ps128(v1),
+                                                 _mm256_castps256_ps128(v2)));
+    acc1 = _mm256_add_pd(acc1, l1_f32_diff4_avx2(_mm256_extractf128_ps(v1, 1),
+                                                 _mm256_extractf128_ps(v2, 1)));
   }
 
-  return res;
+  if (qty & 7) {
+    __m256i m = SQLITE_VEC_MASK8(qty & 7);
+    v1 = _mm256_maskload_ps(pVect1, m);
+    v2 = _mm256_maskload_ps(pVect2, m);
+    acc0 = _mm256_add_pd(acc0, l1_f32_diff4_avx2(_mm256_castps256_ps128(v1),
+                                                 _mm256_castps256_ps128(v2)));
+    acc1 = _mm256_add_pd(acc1, l1_f32_diff4_avx2(_mm256_extractf128_ps(v1, 1),
+                                                 _mm256_extractf128_ps(v2, 1)));
+  }
+
+  _mm256_store_pd(TmpRes, _mm256_add_pd(acc0, acc1));
+  return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
 }
 
-static i32 distance_l1_int8(const void *a, const void *b, const void *d) {
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if ((*(const size_t *)d) > 15) {
-    return l1_int8_neon(a, b, d);
-  }
-#endif
-  return l1_int8(a, b, d);
+// Sum of the 8 i32 lanes of an AVX2 register.
+SQLITE_VEC_TARGET_AVX2
+static i32 hsum_epi32_avx2(__m256i v) {
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
 }
 
-static double l1_f32(const void *pA, const void *pB, const void *pD) {
-  f32 *a = (f32 *)pA;
-  f32 *b = (f32 *)pB;
-  size_t d = *((size_t *)pD);
+// Sum of (a - b)^2 over 16 int8 lanes, as 8 i32 partial sums. Widens i8 to
+// i16 for the subtraction, then i16*i16 -> i32 pairwise sums.
+SQLITE_VEC_TARGET_AVX2
+static __m256i l2_sqr_int8_block_avx2(__m128i a, __m128i b) {
+  __m256i diff =
+      _mm256_sub_epi16(_mm256_cvtepi8_epi16(a), _mm256_cvtepi8_epi16(b));
+  return _mm256_madd_epi16(diff, diff);
+}
 
-  double res = 0;
-  for (size_t i = 0; i < d; i++) {
-    res += fabs((double)*a - (double)*b);
-    a++;
-    b++;
+SQLITE_VEC_TARGET_AVX2
+static f32 l2_sqr_int8_avx2(const void *pVect1v, const void *pVect2v,
+                            const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+
+  const i8 *pEnd1 = pVect1 + (qty & ~(size_t)31);
+  const i8 *pEnd2 = pVect1 + (qty & ~(size_t)15);
+  const i8 *pEnd3 = pVect1 + qty;
+
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+
+  while (pVect1 < pEnd1) {
+    acc0 = _mm256_add_epi32(
+        acc0, l2_sqr_int8_block_avx2(_mm_loadu_si128((const __m128i *)pVect1),
+                                     _mm_loadu_si128((const __m128i *)pVect2)));
+    acc1 = _mm256_add_epi32(
+        acc1, l2_sqr_int8_block_avx2(
+                  _mm_loadu_si128((const __m128i *)(pVect1 + 16)),
+                  _mm_loadu_si128((const __m128i *)(pVect2 + 16))));
+    pVect1 += 32;
+    pVect2 += 32;
+  }
+
+  if (pVect1 < pEnd2) {
+    acc0 = _mm256_add_epi32(
+        acc0, l2_sqr_int8_block_avx2(_mm_loadu_si128((const __m128i *)pVect1),
+                                     _mm_loadu_si128((const __m128i *)pVect2)));
+    pVect1 += 16;
+    pVect2 += 16;
   }
 
-  return res;
+  i32 sum = 0;
+  if ((qty & 15) && qty >= 16) {
+    __m128i m = SQLITE_VEC_LAST16_MASK(qty & 15);
+    acc1 = _mm256_add_epi32(
+        acc1, l2_sqr_int8_block_avx2(
+                  _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(pEnd3 - 16))),
+                  _mm_and_si128(m, _mm_loadu_si128(
+                                       (const __m128i *)(pVect2 + (pEnd3 - pVect1) - 16)))));
+  } else {
+    while (pVect1 < pEnd3) {
+      i32 diff = (i32)*pVect1 - (i32)*pVect2;
+      sum += diff * diff;
+      pVect1++;
+      pVect2++;
+    }
+  }
+
+  return (f32)(sum + hsum_epi32_avx2(_mm256_add_epi32(acc0, acc1)));
 }
 
-static double distance_l1_f32(const void *a, const void *b, const void *d) {
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if ((*(const size_t *)d) > 3) {
-    return l1_f32_neon(a, b, d);
-  }
-#endif
-  return l1_f32(a, b, d);
+// Sum of |a - b| over 16 int8 lanes, as 8 i32 partial sums.
+SQLITE_VEC_TARGET_AVX2
+static __m256i l1_int8_block_avx2(__m128i a, __m128i b) {
+  __m256i diff = _mm256_abs_epi16(
+      _mm256_sub_epi16(_mm256_cvtepi8_epi16(a), _mm256_cvtepi8_epi16(b)));
+  return _mm256_madd_epi16(diff, _mm256_set1_epi16(1));
 }
 
-static f32 distance_cosine_float(const void *pVect1v, const void *pVect2v,
-                                 const void *qty_ptr) {
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if ((*(const size_t *)qty_ptr) > 16) {
-    return cosine_float_neon(pVect1v, pVect2v, qty_ptr);
-  }
-#endif
-  f32 *pVect1 = (f32 *)pVect1v;
-  f32 *pVect2 = (f32 *)pVect2v;
+SQLITE_VEC_TARGET_AVX2
+static i32 l1_int8_avx2(const void *pVect1v, const void *pVect2v,
+                        const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
   size_t qty = *((size_t *)qty_ptr);
 
-  f32 dot = 0;
-  f32 aMag = 0;
-  f32 bMag = 0;
-  for (size_t i = 0; i < qty; i++) {
-    dot += *pVect1 * *pVect2;
-    aMag += *pVect1 * *pVect1;
-    bMag += *pVect2 * *pVect2;
-    pVect1++;
-    pVect2++;
+  const i8 *pEnd1 = pVect1 + (qty & ~(size_t)31);
+  const i8 *pEnd2 = pVect1 + (qty & ~(size_t)15);
+  const i8 *pEnd3 = pVect1 + qty;
+
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+
+  while (pVect1 < pEnd1) {
+    acc0 = _mm256_add_epi32(
+        acc0, l1_int8_block_avx2(_mm_loadu_si128((const __m128i *)pVect1),
+                                 _mm_loadu_si128((const __m128i *)pVect2)));
+    acc1 = _mm256_add_epi32(
+        acc1,
+        l1_int8_block_avx2(_mm_loadu_si128((const __m128i *)(pVect1 + 16)),
+                           _mm_loadu_si128((const __m128i *)(pVect2 + 16))));
+    pVect1 += 32;
+    pVect2 += 32;
+  }
+
+  if (pVect1 < pEnd2) {
+    acc0 = _mm256_add_epi32(
+        acc0, l1_int8_block_avx2(_mm_loadu_si128((const __m128i *)pVect1),
+                                 _mm_loadu_si128((const __m128i *)pVect2)));
+    pVect1 += 16;
+    pVect2 += 16;
   }
-  return 1 - (dot / (sqrt(aMag) * sqrt(bMag)));
-}
-static f32 cosine_int8(const void *pA, const void *pB, const void *pD) {
-  i8 *a = (i8 *)pA;
-  i8 *b = (i8 *)pB;
-  size_t d = *((size_t *)pD);
 
-  f32 dot = 0;
-  f32 aMag = 0;
-  f32 bMag = 0;
-  for (size_t i = 0; i < d; i++) {
-    dot += *a * *b;
-    aMag += *a * *a;
-    bMag += *b * *b;
-    a++;
-    b++;
+  i32 sum = 0;
+  if ((qty & 15) && qty >= 16) {
+    __m128i m = SQLITE_VEC_LAST16_MASK(qty & 15);
+    acc1 = _mm256_add_epi32(
+        acc1, l1_int8_block_avx2(
+                  _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(pEnd3 - 16))),
+                  _mm_and_si128(m, _mm_loadu_si128(
+                                       (const __m128i *)(pVect2 + (pEnd3 - pVect1) - 16)))));
+  } else {
+    while (pVect1 < pEnd3) {
+      sum += abs((i32)*pVect1 - (i32)*pVect2);
+      pVect1++;
+      pVect2++;
+    }
   }
-  return 1 - (dot / (sqrt(aMag) * sqrt(bMag)));
+
+  return sum + hsum_epi32_avx2(_mm256_add_epi32(acc0, acc1));
 }
 
-#ifdef SQLITE_VEC_ENABLE_NEON
-static f32 cosine_int8_neon(const void *pA, const void *pB, const void *pD) {
+SQLITE_VEC_TARGET_AVX2
+static f32 cosine_int8_avx2(const void *pA, const void *pB, const void *pD) {
   const i8 *a = (const i8 *)pA;
   const i8 *b = (const i8 *)pB;
   size_t d = *((const size_t *)pD);
-  const i8 *aEnd = a + d;
 
-  int32x4_t dot_acc1 = vdupq_n_s32(0);
-  int32x4_t dot_acc2 = vdupq_n_s32(0);
-  int32x4_t aMag_acc1 = vdupq_n_s32(0);
-  int32x4_t aMag_acc2 = vdupq_n_s32(0);
-  int32x4_t bMag_acc1 = vdupq_n_s32(0);
-  int32x4_t bMag_acc2 = vdupq_n_s32(0);
+  const i8 *aEnd1 = a + (d & ~(size_t)15);
+  const i8 *aEnd2 = a + d;
 
-  while (a < aEnd - 31) {
-    int8x16_t va1 = vld1q_s8(a);
-    int8x16_t vb1 = vld1q_s8(b);
-    int16x8_t a1_lo = vmovl_s8(vget_low_s8(va1));
-    int16x8_t a1_hi = vmovl_s8(vget_high_s8(va1));
-    int16x8_t b1_lo = vmovl_s8(vget_low_s8(vb1));
-    int16x8_t b1_hi = vmovl_s8(vget_high_s8(vb1));
+  __m256i va, vb;
+  __m256i dot_acc = _mm256_setzero_si256();
+  __m256i aMag_acc = _mm256_setzero_si256();
+  __m256i bMag_acc = _mm256_setzero_si256();
 
-    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a1_lo), vget_low_s16(b1_lo));
-    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a1_lo), vget_high_s16(b1_lo));
-    dot_acc2 = vmlal_s16(dot_acc2, vget_low_s16(a1_hi), vget_low_s16(b1_hi));
-    dot_acc2 = vmlal_s16(dot_acc2, vget_high_s16(a1_hi), vget_high_s16(b1_hi));
+  while (a < aEnd1) {
+    va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)a));
+    vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)b));
+    dot_acc = _mm256_add_epi32(dot_acc, _mm256_madd_epi16(va, vb));
+    aMag_acc = _mm256_add_epi32(aMag_acc, _mm256_madd_epi16(va, va));
+    bMag_acc = _mm256_add_epi32(bMag_acc, _mm256_madd_epi16(vb, vb));
+    a += 16;
+    b += 16;
+  }
 
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a1_lo), vget_low_s16(a1_lo));
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a1_lo), vget_high_s16(a1_lo));
-    aMag_acc2 = vmlal_s16(aMag_acc2, vget_low_s16(a1_hi), vget_low_s16(a1_hi));
-    aMag_acc2 = vmlal_s16(aMag_acc2, vget_high_s16(a1_hi), vget_high_s16(a1_hi));
+  i32 dot = 0;
+  i32 aMag = 0;
+  i32 bMag = 0;
+  if ((d & 15) && d >= 16) {
+    __m128i m = SQLITE_VEC_LAST16_MASK(d & 15);
+    va = _mm256_cvtepi8_epi16(
+        _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(aEnd2 - 16))));
+    vb = _mm256_cvtepi8_epi16(_mm_and_si128(
+        m, _mm_loadu_si128((const __m128i *)(b + (aEnd2 - a) - 16))));
+    dot_acc = _mm256_add_epi32(dot_acc, _mm256_madd_epi16(va, vb));
+    aMag_acc = _mm256_add_epi32(aMag_acc, _mm256_madd_epi16(va, va));
+    bMag_acc = _mm256_add_epi32(bMag_acc, _mm256_madd_epi16(vb, vb));
+  } else {
+    while (a < aEnd2) {
+      dot += (i32)*a * (i32)*b;
+      aMag += (i32)*a * (i32)*a;
+      bMag += (i32)*b * (i32)*b;
+      a++;
+      b++;
+    }
+  }
 
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b1_lo), vget_low_s16(b1_lo));
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b1_lo), vget_high_s16(b1_lo));
-    bMag_acc2 = vmlal_s16(bMag_acc2, vget_low_s16(b1_hi), vget_low_s16(b1_hi));
-    bMag_acc2 = vmlal_s16(bMag_acc2, vget_high_s16(b1_hi), vget_high_s16(b1_hi));
+  dot += hsum_epi32_avx2(dot_acc);
+  aMag += hsum_epi32_avx2(aMag_acc);
+  bMag += hsum_epi32_avx2(bMag_acc);
+  return 1.0f - ((f32)dot / (sqrtf((f32)aMag) * sqrtf((f32)bMag)));
+}
 
-    int8x16_t va2 = vld1q_s8(a + 16);
-    int8x16_t vb2 = vld1q_s8(b + 16);
-    int16x8_t a2_lo = vmovl_s8(vget_low_s8(va2));
-    int16x8_t a2_hi = vmovl_s8(vget_high_s8(va2));
-    int16x8_t b2_lo = vmovl_s8(vget_low_s8(vb2));
-    int16x8_t b2_hi = vmovl_s8(vget_high_s8(vb2));
+SQLITE_VEC_TARGET_AVX512
+static f32 cosine_float_avx512(const void *pVect1v, const void *pVect2v,
+                               const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  size_t qty16 = qty >> 4;
 
-    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a2_lo), vget_low_s16(b2_lo));
-    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a2_lo), vget_high_s16(b2_lo));
-    dot_acc2 = vmlal_s16(dot_acc2, vget_low_s16(a2_hi), vget_low_s16(b2_hi));
-    dot_acc2 = vmlal_s16(dot_acc2, vget_high_s16(a2_hi), vget_high_s16(b2_hi));
+  const f32 *pEnd1 = pVect1 + (qty16 << 4);
 
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a2_lo), vget_low_s16(a2_lo));
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a2_lo), vget_high_s16(a2_lo));
-    aMag_acc2 = vmlal_s16(aMag_acc2, vget_low_s16(a2_hi), vget_low_s16(a2_hi));
-    aMag_acc2 = vmlal_s16(aMag_acc2, vget_high_s16(a2_hi), vget_high_s16(a2_hi));
+  __m512 v1, v2;
+  __m512 dot = _mm512_setzero_ps();
+  __m512 amag = _mm512_setzero_ps();
+  __m512 bmag = _mm512_setzero_ps();
 
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b2_lo), vget_low_s16(b2_lo));
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b2_lo), vget_high_s16(b2_lo));
-    bMag_acc2 = vmlal_s16(bMag_acc2, vget_low_s16(b2_hi), vget_low_s16(b2_hi));
-    bMag_acc2 = vmlal_s16(bMag_acc2, vget_high_s16(b2_hi), vget_high_s16(b2_hi));
+  while (pVect1 < pEnd1) {
+    v1 = _mm512_loadu_ps(pVect1);
+    v2 = _mm512_loadu_ps(pVect2);
+    pVect1 += 16;
+    pVect2 += 16;
+    dot = _mm512_fmadd_ps(v1, v2, dot);
+    amag = _mm512_fmadd_ps(v1, v1, amag);
+    bmag = _mm512_fmadd_ps(v2, v2, bmag);
+  }
 
-    a += 32;
-    b += 32;
+  if (qty & 15) {
+    __mmask16 m = SQLITE_VEC_MASK16(qty & 15);
+    v1 = _mm512_maskz_loadu_ps(m, pVect1);
+    v2 = _mm512_maskz_loadu_ps(m, pVect2);
+    dot = _mm512_fmadd_ps(v1, v2, dot);
+    amag = _mm512_fmadd_ps(v1, v1, amag);
+    bmag = _mm512_fmadd_ps(v2, v2, bmag);
   }
 
-  while (a < aEnd - 15) {
-    int8x16_t va = vld1q_s8(a);
-    int8x16_t vb = vld1q_s8(b);
-    int16x8_t a_lo = vmovl_s8(vget_low_s8(va));
-    int16x8_t a_hi = vmovl_s8(vget_high_s8(va));
-    int16x8_t b_lo = vmovl_s8(vget_low_s8(vb));
-    int16x8_t b_hi = vmovl_s8(vget_high_s8(vb));
+  f32 dot_s = _mm512_reduce_add_ps(dot);
+  f32 amag_s = _mm512_reduce_add_ps(amag);
+  f32 bmag_s = _mm512_reduce_add_ps(bmag);
+  return 1 - (dot_s / (sqrt(amag_s) * sqrt(bmag_s)));
+}
 
-    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a_lo), vget_low_s16(b_lo));
-    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a_lo), vget_high_s16(b_lo));
-    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a_hi), vget_low_s16(b_hi));
-    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a_hi), vget_high_s16(b_hi));
+SQLITE_VEC_TARGET_AVX512
+static f32 cosine_unit_float_avx512(const void *pVect1v, const void *pVect2v,
+                                    const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a_lo), vget_low_s16(a_lo));
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a_lo), vget_high_s16(a_lo));
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a_hi), vget_low_s16(a_hi));
-    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a_hi), vget_high_s16(a_hi));
+  const f32 *pEnd1 = pVect1 + (qty & ~(size_t)31);
+  const f32 *pEnd2 = pVect1 + (qty & ~(size_t)15);
 
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b_lo), vget_low_s16(b_lo));
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b_lo), vget_high_s16(b_lo));
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b_hi), vget_low_s16(b_hi));
-    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b_hi), vget_high_s16(b_hi));
+  __m512 dot0 = _mm512_setzero_ps();
+  __m512 dot1 = _mm512_setzero_ps();
 
-    a += 16;
-    b += 16;
+  while (pVect1 < pEnd1) {
+    dot0 = _mm512_fmadd_ps(_mm512_loadu_ps(pVect1), _mm512_loadu_ps(pVect2),
+                           dot0);
+    dot1 = _mm512_fmadd_ps(_mm512_loadu_ps(pVect1 + 16),
+                           _mm512_loadu_ps(pVect2 + 16), dot1);
+    pVect1 += 32;
+    pVect2 += 32;
   }
 
-  int32x4_t dot_sum = vaddq_s32(dot_acc1, dot_acc2);
-  int32x4_t aMag_sum = vaddq_s32(aMag_acc1, aMag_acc2);
-  int32x4_t bMag_sum = vaddq_s32(bMag_acc1, bMag_acc2);
-
-  i32 dot = vaddvq_s32(dot_sum);
-  i32 aMag = vaddvq_s32(aMag_sum);
-  i32 bMag = vaddvq_s32(bMag_sum);
+  if (pVect1 < pEnd2) {
+    dot0 = _mm512_fmadd_ps(_mm512_loadu_ps(pVect1), _mm512_loadu_ps(pVect2),
+                           dot0);
+    pVect1 += 16;
+    pVect2 += 16;
+  }
 
-  while (a < aEnd) {
-    dot += (i32)*a * (i32)*b;
-    aMag += (i32)*a * (i32)*a;
-    bMag += (i32)*b * (i32)*b;
-    a++;
-    b++;
+  if (qty & 15) {
+    __mmask16 m = SQLITE_VEC_MASK16(qty & 15);
+    dot1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, pVect1),
+                           _mm512_maskz_loadu_ps(m, pVect2), dot1);
   }
 
-  return 1.0f - ((f32)dot / (sqrtf((f32)aMag) * sqrtf((f32)bMag)));
+  return 1 - _mm512_reduce_add_ps(_mm512_add_ps(dot0, dot1));
 }
-#endif
 
-static f32 distance_cosine_int8(const void *a, const void *b, const void *d) {
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if ((*(const size_t *)d) > 15) {
-    return cosine_int8_neon(a, b, d);
-  }
-#endif
-  return cosine_int8(a, b, d);
+// |a - b| for 8 f32 lanes, widened to f64 before subtracting like l1_f32.
+SQLITE_VEC_TARGET_AVX512
+static __m512d l1_f32_diff8_avx512(__m256 a, __m256 b) {
+  return _mm512_abs_pd(_mm512_sub_pd(_mm512_cvtps_pd(a), _mm512_cvtps_pd(b)));
 }
 
-// https://github.com/facebookresearch/faiss/blob/77e2e79cd0a680adc343b9840dd865da724c579e/faiss/utils/hamming_distance/common.h#L34
-static u8 hamdist_table[256] = {
-    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4,
-    2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4,
-    2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
-    4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5,
-    3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
-    4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
+SQLITE_VEC_TARGET_AVX512
+static double l1_f32_avx512(const void *pVect1v, const void *pVect2v,
+                            const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  size_t qty16 = qty >> 4;
 
-#ifdef SQLITE_VEC_ENABLE_NEON
-static f32 distance_hamming_neon(const u8 *a, const u8 *b, size_t n_bytes) {
-  const u8 *pEnd = a + n_bytes;
+  const f32 *pEnd1 = pVect1 + (qty16 << 4);
 
-  uint32x4_t acc1 = vdupq_n_u32(0);
-  uint32x4_t acc2 = vdupq_n_u32(0);
-  uint32x4_t acc3 = vdupq_n_u32(0);
-  uint32x4_t acc4 = vdupq_n_u32(0);
+  __m512 v1, v2;
+  __m512d acc0 = _mm512_setzero_pd();
+  __m512d acc1 = _mm512_setzero_pd();
 
-  while (a <= pEnd - 64) {
-    uint8x16_t v1 = vld1q_u8(a);
-    uint8x16_t v2 = vld1q_u8(b);
-    acc1 = vaddq_u32(acc1, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+  while (pVect1 < pEnd1) {
+    v1 = _mm512_loadu_ps(pVect1);
+    v2 = _mm512_loadu_ps(pVect2);
+    pVect1 += 16;
+    pVect2 += 16;
+    acc0 = _mm512_add_pd(acc0, l1_f32_diff8_avx512(_mm512_castps512_ps256(v1),
+                                                   _mm512_castps512_ps256(v2)));
+    acc1 = _mm512_add_pd(
+        acc1, l1_f32_diff8_avx512(
+                  _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v1), 1)),
+                  _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v2), 1))));
+  }
+
+  if (qty & 15) {
+    __mmask16 m = SQLITE_VEC_MASK16(qty & 15);
+    v1 = _mm512_maskz_loadu_ps(m, pVect1);
+    v2 = _mm512_maskz_loadu_ps(m, pVect2);
+    acc0 = _mm512_add_pd(acc0, l1_f32_diff8_avx512(_mm512_castps512_ps256(v1),
+                                                   _mm512_castps512_ps256(v2)));
+    acc1 = _mm512_add_pd(
+        acc1, l1_f32_diff8_avx512(
+                  _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v1), 1)),
+                  _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v2), 1))));
+  }
+
+  return _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+}
 
-    v1 = vld1q_u8(a + 16);
-    v2 = vld1q_u8(b + 16);
-    acc2 = vaddq_u32(acc2, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+// Sum of (a - b)^2 over 64 int8 lanes, as 16 i32 partial sums.
+SQLITE_VEC_TARGET_AVX512
+static __m512i l2_sqr_int8_block_avx512(__m512i a, __m512i b) {
+  __m512i diff_lo =
+      _mm512_sub_epi16(_mm512_cvtepi8_epi16(_mm512_castsi512_si256(a)),
+                       _mm512_cvtepi8_epi16(_mm512_castsi512_si256(b)));
+  __m512i diff_hi =
+      _mm512_sub_epi16(_mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(a, 1)),
+                       _mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(b, 1)));
+  return _mm512_add_epi32(_mm512_madd_epi16(diff_lo, diff_lo),
+                          _mm512_madd_epi16(diff_hi, diff_hi));
+}
 
-    v1 = vld1q_u8(a + 32);
-    v2 = vld1q_u8(b + 32);
-    acc3 = vaddq_u32(acc3, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+SQLITE_VEC_TARGET_AVX512
+static f32 l2_sqr_int8_avx512(const void *pVect1v, const void *pVect2v,
+                              const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-    v1 = vld1q_u8(a + 48);
-    v2 = vld1q_u8(b + 48);
-    acc4 = vaddq_u32(acc4, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+  const i8 *pEnd1 = pVect1 + (qty & ~(size_t)63);
 
-    a += 64;
-    b += 64;
-  }
+  __m512i acc = _mm512_setzero_si512();
 
-  while (a <= pEnd - 16) {
-    uint8x16_t v1 = vld1q_u8(a);
-    uint8x16_t v2 = vld1q_u8(b);
-    acc1 = vaddq_u32(acc1, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
-    a += 16;
-    b += 16;
+  while (pVect1 < pEnd1) {
+    acc = _mm512_add_epi32(
+        acc, l2_sqr_int8_block_avx512(_mm512_loadu_si512((const void *)pVect1),
+                                      _mm512_loadu_si512((const void *)pVect2)));
+    pVect1 += 64;
+    pVect2 += 64;
   }
 
-  acc1 = vaddq_u32(acc1, acc2);
-  acc3 = vaddq_u32(acc3, acc4);
-  acc1 = vaddq_u32(acc1, acc3);
-  u32 sum = vaddvq_u32(acc1);
-
-  while (a < pEnd) {
-    sum += hamdist_table[*a ^ *b];
-    a++;
-    b++;
+  if (qty & 63) {
+    __mmask64 m = SQLITE_VEC_MASK64(qty & 63);
+    acc = _mm512_add_epi32(
+        acc, l2_sqr_int8_block_avx512(_mm512_maskz_loadu_epi8(m, pVect1),
+                                      _mm512_maskz_loadu_epi8(m, pVect2)));
   }
 
-  return (f32)sum;
+  return (f32)_mm512_reduce_add_epi32(acc);
 }
-#endif
-
-#ifdef SQLITE_VEC_ENABLE_AVX
-/**
- * AVX2 Hamming distance using VPSHUFB-based popcount.
- * Processes 32 bytes (256 bits) per iteration.
- */
-static f32 distance_hamming_avx2(const u8 *a, const u8 *b, size_t n_bytes) {
-  const u8 *pEnd = a + n_bytes;
 
-  // VPSHUFB lookup table: popcount of low nibble
-  const __m256i lookup = _mm256_setr_epi8(
-      0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
-      0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
-  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+// Sum of |a - b| over 64 int8 lanes, as 8 u64 partial sums. Flipping the sign
+// bit maps i8 onto u8 while keeping |a - b| the same.
+SQLITE_VEC_TARGET_AVX512
+static __m512i l1_int8_block_avx512(__m512i a, __m512i b) {
+  const __m512i bias = _mm512_set1_epi8((char)0x80);
+  __m512i ua = _mm512_xor_si512(a, bias);
+  __m512i ub = _mm512_xor_si512(b, bias);
+  __m512i diff = _mm512_or_si512(_mm512_subs_epu8(ua, ub),
+                                 _mm512_subs_epu8(ub, ua));
+  return _mm512_sad_epu8(diff, _mm512_setzero_si512());
+}
 
-  __m256i acc = _mm256_setzero_si256();
+SQLITE_VEC_TARGET_AVX512
+static i32 l1_int8_avx512(const void *pVect1v, const void *pVect2v,
+                          const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-  while (a <= pEnd - 32) {
-    __m256i va = _mm256_loadu_si256((const __m256i *)a);
-    __m256i vb = _mm256_loadu_si256((const __m256i *)b);
-    __m256i xored = _mm256_xor_si256(va, vb);
+  const i8 *pEnd1 = pVect1 + (qty & ~(size_t)63);
 
-    // VPSHUFB popcount: split into nibbles, lookup each
-    __m256i lo = _mm256_and_si256(xored, low_mask);
-    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(xored, 4), low_mask);
-    __m256i popcnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
-                                      _mm256_shuffle_epi8(lookup, hi));
+  __m512i acc = _mm512_setzero_si512();
 
-    // Horizontal sum: u8 -> u64 via sad against zero
-    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(popcnt, _mm256_setzero_si256()));
-    a += 32;
-    b += 32;
+  while (pVect1 < pEnd1) {
+    acc = _mm512_add_epi64(
+        acc, l1_int8_block_avx512(_mm512_loadu_si512((const void *)pVect1),
+                                  _mm512_loadu_si512((const void *)pVect2)));
+    pVect1 += 64;
+    pVect2 += 64;
   }
 
-  // Horizontal sum of 4 x u64 lanes
-  u64 tmp[4];
-  _mm256_storeu_si256((__m256i *)tmp, acc);
-  u32 sum = (u32)(tmp[0] + tmp[1] + tmp[2] + tmp[3]);
-
-  // Scalar tail
-  while (a < pEnd) {
-    u8 x = *a ^ *b;
-    x = x - ((x >> 1) & 0x55);
-    x = (x & 0x33) + ((x >> 2) & 0x33);
-    sum += (x + (x >> 4)) & 0x0F;
-    a++;
-    b++;
+  if (qty & 63) {
+    __mmask64 m = SQLITE_VEC_MASK64(qty & 63);
+    acc = _mm512_add_epi64(
+        acc, l1_int8_block_avx512(_mm512_maskz_loadu_epi8(m, pVect1),
+                                  _mm512_maskz_loadu_epi8(m, pVect2)));
   }
 
-  return (f32)sum;
+  return (i32)_mm512_reduce_add_epi64(acc);
 }
-#endif
 
-static f32 distance_hamming_u8(u8 *a, u8 *b, size_t n) {
-  int same = 0;
-  for (unsigned long i = 0; i < n; i++) {
-    same += hamdist_table[a[i] ^ b[i]];
+SQLITE_VEC_TARGET_AVX512
+static f32 cosine_int8_avx512(const void *pA, const void *pB,
+                              const void *pD) {
+  const i8 *a = (const i8 *)pA;
+  const i8 *b = (const i8 *)pB;
+  size_t d = *((const size_t *)pD);
+
+  const i8 *aEnd1 = a + (d & ~(size_t)31);
+
+  __m512i va, vb;
+  __m512i dot_acc = _mm512_setzero_si512();
+  __m512i aMag_acc = _mm512_setzero_si512();
+  __m512i bMag_acc = _mm512_setzero_si512();
+
+  while (a < aEnd1) {
+    va = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)a));
+    vb = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)b));
+    dot_acc = _mm512_add_epi32(dot_acc, _mm512_madd_epi16(va, vb));
+    aMag_acc = _mm512_add_epi32(aMag_acc, _mm512_madd_epi16(va, va));
+    bMag_acc = _mm512_add_epi32(bMag_acc, _mm512_madd_epi16(vb, vb));
+    a += 32;
+    b += 32;
   }
-  return (f32)same;
-}
 
-#ifdef _MSC_VER
-#if !defined(__clang__) && (defined(_M_ARM) || defined(_M_ARM64))
-// From
-// https://github.com/ngtcp2/ngtcp2/blob/b64f1e77b5e0d880b93d31f474147fae4a1d17cc/lib/ngtcp2_ringbuf.c,
-// line 34-43
-static unsigned int __builtin_popcountl(unsigned int x) {
-  unsigned int c = 0;
-  for (; x; ++c) {
-    x &= x - 1;
+  if (d & 31) {
+    __mmask64 m = SQLITE_VEC_MASK64(d & 31);
+    va = _mm512_cvtepi8_epi16(
+        _mm512_castsi512_si256(_mm512_maskz_loadu_epi8(m, a)));
+    vb = _mm512_cvtepi8_epi16(
+        _mm512_castsi512_si256(_mm512_maskz_loadu_epi8(m, b)));
+    dot_acc = _mm512_add_epi32(dot_acc, _mm512_madd_epi16(va, vb));
+    aMag_acc = _mm512_add_epi32(aMag_acc, _mm512_madd_epi16(va, va));
+    bMag_acc = _mm512_add_epi32(bMag_acc, _mm512_madd_epi16(vb, vb));
   }
-  return c;
+
+  i32 dot = _mm512_reduce_add_epi32(dot_acc);
+  i32 aMag = _mm512_reduce_add_epi32(aMag_acc);
+  i32 bMag = _mm512_reduce_add_epi32(bMag_acc);
+  return 1.0f - ((f32)dot / (sqrtf((f32)aMag) * sqrtf((f32)bMag)));
 }
+
+// Fixed-width float kernels for the most common embedding sizes. The bodies
+// below are only ever inlined with a constant qty, so the compiler drops all
+// loop control and tail handling and emits straight-line code. Every width
+// listed in VEC0_FIXED_DIM_FLOAT_KERNELS is a multiple of 64.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SQLITE_VEC_ALWAYS_INLINE __forceinline
+#define SQLITE_VEC_UNROLL
 #else
-#include <intrin.h>
-#define __builtin_popcountl __popcnt64
-#endif
+#define SQLITE_VEC_ALWAYS_INLINE inline __attribute__((always_inline))
+#define SQLITE_VEC_UNROLL _Pragma("GCC unroll 64")
 #endif
 
-static f32 distance_hamming_u64(const u8 *a, const u8 *b, size_t n) {
-  int same = 0;
-  for (unsigned long i = 0; i < n; i++) {
-    u64 va, vb;
-    memcpy(&va, a + i * sizeof(u64), sizeof(u64));
-    memcpy(&vb, b + i * sizeof(u64), sizeof(u64));
-    same += __builtin_popcountl(va ^ vb);
-  }
-  return (f32)same;
+SQLITE_VEC_TARGET_AVX2
+static f32 hsum_ps_avx2(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+SQLITE_VEC_TARGET_AVX2
+static SQLITE_VEC_ALWAYS_INLINE f32 l2_sqr_float_avx2_fixed(const f32 *a,
+                                                            const f32 *b,
+                                                            size_t qty) {
+  __m256 d0, d1, d2, d3;
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+  SQLITE_VEC_UNROLL
+  for (size_t i = 0; i < qty; i += 32) {
+    d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+    d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+    d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+    s0 = _mm256_fmadd_ps(d0, d0, s0);
+    s1 = _mm256_fmadd_ps(d1, d1, s1);
+    s2 = _mm256_fmadd_ps(d2, d2, s2);
+    s3 = _mm256_fmadd_ps(d3, d3, s3);
+  }
+  return hsum_ps_avx2(
+      _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
 }
 
 /**
- * @brief Calculate the hamming distance between two bitvectors.
- *
- * @param a - first bitvector, MUST have d dimensions
- * @param b - second bitvector, MUST have d dimensions
- * @param d - pointer to size_t, MUST be divisible by CHAR_BIT
- * @return f32
+ * Early-abandoning l2_sqr_float_avx2_fixed(): the same sums in the same
+ * order, with the running total checked against bound every
+ * VEC0_BOUNDED_BLOCK_DIMS dimensions. Lanes only grow, so a total past bound
+ * stays past it, and a row that isn't abandoned gets exactly the fixed
+ * kernel's result. Without a finite bound it is the fixed kernel.
  */
-static f32 distance_hamming(const void *a, const void *b, const void *d) {
-  size_t dimensions = *((size_t *)d);
-  size_t n_bytes = dimensions / CHAR_BIT;
-
-#ifdef SQLITE_VEC_ENABLE_NEON
-  if (dimensions >= 128) {
-    return distance_hamming_neon((const u8 *)a, (const u8 *)b, n_bytes);
-  }
-#endif
-#ifdef SQLITE_VEC_ENABLE_AVX
-  if (n_bytes >= 32) {
-    return distance_hamming_avx2((const u8 *)a, (const u8 *)b, n_bytes);
+SQLITE_VEC_TARGET_AVX2
+static SQLITE_VEC_ALWAYS_INLINE f32 l2_sqr_float_avx2_fixed_bounded(
+    const f32 *a, const f32 *b, size_t qty, f32 bound) {
+  if (!(bound < INFINITY)) {
+    return l2_sqr_float_avx2_fixed(a, b, qty);
+  }
+  __m256 d0, d1, d2, d3;
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+  SQLITE_VEC_UNROLL
+  for (size_t i = 0; i < qty; i += 32) {
+    d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+    d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+    d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+    s0 = _mm256_fmadd_ps(d0, d0, s0);
+    s1 = _mm256_fmadd_ps(d1, d1, s1);
+    s2 = _mm256_fmadd_ps(d2, d2, s2);
+    s3 = _mm256_fmadd_ps(d3, d3, s3);
+    if ((i + 32) % VEC0_BOUNDED_BLOCK_DIMS == 0 && i + 32 < qty) {
+      f32 sum = hsum_ps_avx2(
+          _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+      if (sum > bound) {
+        return sum;
+      }
+    }
   }
-#endif
+  return hsum_ps_avx2(
+      _mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+}
 
-  if ((dimensions % 64) == 0) {
-    return distance_hamming_u64((const u8 *)a, (const u8 *)b, n_bytes / sizeof(u64));
-  }
-  return distance_hamming_u8((u8 *)a, (u8 *)b, n_bytes);
+SQLITE_VEC_TARGET_AVX2
+static SQLITE_VEC_ALWAYS_INLINE f32 cosine_float_avx2_fixed(const f32 *a,
+                                                            const f32 *b,
+                                                            size_t qty) {
+  __m256 v1, v2;
+  __m256 dot0 = _mm256_setzero_ps(), dot1 = _mm256_setzero_ps();
+  __m256 amag0 = _mm256_setzero_ps(), amag1 = _mm256_setzero_ps();
+  __m256 bmag0 = _mm256_setzero_ps(), bmag1 = _mm256_setzero_ps();
+  SQLITE_VEC_UNROLL
+  for (size_t i = 0; i < qty; i += 16) {
+    v1 = _mm256_loadu_ps(a + i);
+    v2 = _mm256_loadu_ps(b + i);
+    dot0 = _mm256_fmadd_ps(v1, v2, dot0);
+    amag0 = _mm256_fmadd_ps(v1, v1, amag0);
+    bmag0 = _mm256_fmadd_ps(v2, v2, bmag0);
+    v1 = _mm256_loadu_ps(a + i + 8);
+    v2 = _mm256_loadu_ps(b + i + 8);
+    dot1 = _mm256_fmadd_ps(v1, v2, dot1);
+    amag1 = _mm256_fmadd_ps(v1, v1, amag1);
+    bmag1 = _mm256_fmadd_ps(v2, v2, bmag1);
+  }
+  f32 dot_s = hsum_ps_avx2(_mm256_add_ps(dot0, dot1));
+  f32 amag_s = hsum_ps_avx2(_mm256_add_ps(amag0, amag1));
+  f32 bmag_s = hsum_ps_avx2(_mm256_add_ps(bmag0, bmag1));
+  return 1 - (dot_s / (sqrt(amag_s) * sqrt(bmag_s)));
 }
 
-#ifdef SQLITE_VEC_TEST
-f32 _test_distance_l2_sqr_float(const f32 *a, const f32 *b, size_t dims) {
-  return distance_l2_sqr_float(a, b, &dims);
+SQLITE_VEC_TARGET_AVX512
+static SQLITE_VEC_ALWAYS_INLINE f32 l2_sqr_float_avx512_fixed(const f32 *a,
+                                                              const f32 *b,
+                                                              size_t qty) {
+  __m512 d0, d1, d2, d3;
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+  SQLITE_VEC_UNROLL
+  for (size_t i = 0; i < qty; i += 64) {
+    d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+    d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+    d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+    s0 = _mm512_fmadd_ps(d0, d0, s0);
+    s1 = _mm512_fmadd_ps(d1, d1, s1);
+    s2 = _mm512_fmadd_ps(d2, d2, s2);
+    s3 = _mm512_fmadd_ps(d3, d3, s3);
+  }
+  return _mm512_reduce_add_ps(
+      _mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
 }
-f32 _test_distance_cosine_float(const f32 *a, const f32 *b, size_t dims) {
-  return distance_cosine_float(a, b, &dims);
+
+// l2_sqr_float_avx2_fixed_bounded() for l2_sqr_float_avx512_fixed().
+SQLITE_VEC_TARGET_AVX512
+static SQLITE_VEC_ALWAYS_INLINE f32 l2_sqr_float_avx512_fixed_bounded(
+    const f32 *a, const f32 *b, size_t qty, f32 bound) {
+  if (!(bound < INFINITY)) {
+    return l2_sqr_float_avx512_fixed(a, b, qty);
+  }
+  __m512 d0, d1, d2, d3;
+  __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+  __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+  SQLITE_VEC_UNROLL
+  for (size_t i = 0; i < qty; i += 64) {
+    d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+    d2 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+    d3 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+    s0 = _mm512_fmadd_ps(d0, d0, s0);
+    s1 = _mm512_fmadd_ps(d1, d1, s1);
+    s2 = _mm512_fmadd_ps(d2, d2, s2);
+    s3 = _mm512_fmadd_ps(d3, d3, s3);
+    if ((i + 64) % VEC0_BOUNDED_BLOCK_DIMS == 0 && i + 64 < qty) {
+      f32 sum = _mm512_reduce_add_ps(
+          _mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
+      if (sum > bound) {
+        return sum;
+      }
+    }
+  }
+  return _mm512_reduce_add_ps(
+      _mm512_add_ps(_mm512_add_ps(s0, s1), _mm512_add_ps(s2, s3)));
 }
-f32 _test_distance_hamming(const u8 *a, const u8 *b, size_t dims) {
-  return distance_hamming(a, b, &dims);
+
+SQLITE_VEC_TARGET_AVX512
+static SQLITE_VEC_ALWAYS_INLINE f32 cosine_float_avx512_fixed(const f32 *a,
+                                                              const f32 *b,
+                                                              size_t qty) {
+  __m512 v1, v2;
+  __m512 dot0 = _mm512_setzero_ps(), dot1 = _mm512_setzero_ps();
+  __m512 amag0 = _mm512_setzero_ps(), amag1 = _mm512_setzero_ps();
+  __m512 bmag0 = _mm512_setzero_ps(), bmag1 = _mm512_setzero_ps();
+  SQLITE_VEC_UNROLL
+  for (size_t i = 0; i < qty; i += 32) {
+    v1 = _mm512_loadu_ps(a + i);
+    v2 = _mm512_loadu_ps(b + i);
+    dot0 = _mm512_fmadd_ps(v1, v2, dot0);
+    amag0 = _mm512_fmadd_ps(v1, v1, amag0);
+    bmag0 = _mm512_fmadd_ps(v2, v2, bmag0);
+    v1 = _mm512_loadu_ps(a + i + 16);
+    v2 = _mm512_loadu_ps(b + i + 16);
+    dot1 = _mm512_fmadd_ps(v1, v2, dot1);
+    amag1 = _mm512_fmadd_ps(v1, v1, amag1);
+    bmag1 = _mm512_fmadd_ps(v2, v2, bmag1);
+  }
+  f32 dot_s = _mm512_reduce_add_ps(_mm512_add_ps(dot0, dot1));
+  f32 amag_s = _mm512_reduce_add_ps(_mm512_add_ps(amag0, amag1));
+  f32 bmag_s = _mm512_reduce_add_ps(_mm512_add_ps(bmag0, bmag1));
+  return 1 - (dot_s / (sqrt(amag_s) * sqrt(bmag_s)));
 }
+
+#define VEC0_DEFINE_FIXED_DIM_FLOAT_KERNELS(isa, target, D)                    \
+  target static f32 l2_sqr_float_##isa##_##D(const void *a, const void *b,     \
+                                             const void *d) {                  \
+    UNUSED_PARAMETER(d);                                                       \
+    return l2_sqr_float_##isa##_fixed((const f32 *)a, (const f32 *)b, D);      \
+  }                                                                            \
+  target static f32 l2_sqr_float_##isa##_##D##_bounded(                        \
+      const void *a, const void *b, const void *d, f32 bound) {                \
+    UNUSED_PARAMETER(d);                                                       \
+    return l2_sqr_float_##isa##_fixed_bounded((const f32 *)a, (const f32 *)b,  \
+                                              D, bound);                       \
+  }                                                                            \
+  target static f32 cosine_float_##isa##_##D(const void *a, const void *b,     \
+                                             const void *d) {                  \
+    UNUSED_PARAMETER(d);                                                       \
+    return cosine_float_##isa##_fixed((const f32 *)a, (const f32 *)b, D);      \
+  }
+
+#define VEC0_FIXED_DIM_FLOAT_KERNELS(isa, target)                              \
+  VEC0_DEFINE_FIXED_DIM_FLOAT_KERNELS(isa, target, 384)                        \
+  VEC0_DEFINE_FIXED_DIM_FLOAT_KERNELS(isa, target, 768)                        \
+  VEC0_DEFINE_FIXED_DIM_FLOAT_KERNELS(isa, target, 1024)                       \
+  VEC0_DEFINE_FIXED_DIM_FLOAT_KERNELS(isa, target, 1536)
+
+VEC0_FIXED_DIM_FLOAT_KERNELS(avx2, SQLITE_VEC_TARGET_AVX2)
+VEC0_FIXED_DIM_FLOAT_KERNELS(avx512, SQLITE_VEC_TARGET_AVX512)
 #endif
 
-// from SQLite source:
-// https://github.com/sqlite/sqlite/blob/a509a90958ddb234d1785ed7801880ccb18b497e/src/json.c#L153
-static const char vecJsonIsSpaceX[] = {
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+#ifdef SQLITE_VEC_ENABLE_NEON
+#include <arm_neon.h>
 
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-};
+#define PORTABLE_ALIGN32 __attribute__((aligned(32)))
 
-#define vecJsonIsspace(x) (vecJsonIsSpaceX[(unsigned char)x])
+// thx https://github.com/nmslib/hnswlib/pull/299/files
+static f32 l2_sqr_float_neon(const void *pVect1v, const void *pVect2v,
+                             const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  size_t qty16 = qty >> 4;
 
-typedef void (*vector_cleanup)(void *p);
+  const f32 *pEnd1 = pVect1 + (qty16 << 4);
 
-void vector_cleanup_noop(void *_) { UNUSED_PARAMETER(_); }
+  float32x4_t diff, v1, v2;
+  float32x4_t sum0 = vdupq_n_f32(0);
+  float32x4_t sum1 = vdupq_n_f32(0);
+  float32x4_t sum2 = vdupq_n_f32(0);
+  float32x4_t sum3 = vdupq_n_f32(0);
 
-#define JSON_SUBTYPE 74
+  while (pVect1 < pEnd1) {
+    v1 = vld1q_f32(pVect1);
+    pVect1 += 4;
+    v2 = vld1q_f32(pVect2);
+    pVect2 += 4;
+    diff = vsubq_f32(v1, v2);
+    sum0 = vfmaq_f32(sum0, diff, diff);
 
-void vtab_set_error(sqlite3_vtab *pVTab, const char *zFormat, ...) {
-  va_list args;
-  sqlite3_free(pVTab->zErrMsg);
-  va_start(args, zFormat);
-  pVTab->zErrMsg = sqlite3_vmprintf(zFormat, args);
-  va_end(args);
-}
-struct Array {
-  size_t element_size;
-  size_t length;
-  size_t capacity;
-  void *z;
-};
+    v1 = vld1q_f32(pVect1);
+    pVect1 += 4;
+    v2 = vld1q_f32(pVect2);
+    pVect2 += 4;
+    diff = vsubq_f32(v1, v2);
+    sum1 = vfmaq_f32(sum1, diff, diff);
 
-/**
- * @brief Initial an array with the given element size and capacity.
- *
- * @param array
- * @param element_size
- * @param init_capacity
- * @return SQLITE_OK on success, error code on failure. Only error is
- * SQLITE_NOMEM
- */
-int array_init(struct Array *array, size_t element_size, size_t init_capacity) {
-  int sz = element_size * init_capacity;
-  void *z = sqlite3_malloc(sz);
-  if (!z) {
-    return SQLITE_NOMEM;
-  }
-  memset(z, 0, sz);
+    v1 = vld1q_f32(pVect1);
+    pVect1 += 4;
+    v2 = vld1q_f32(pVect2);
+    pVect2 += 4;
+    diff = vsubq_f32(v1, v2);
+    sum2 = vfmaq_f32(sum2, diff, diff);
 
-  array->element_size = element_size;
-  array->length = 0;
-  array->capacity = init_capacity;
-  array->z = z;
-  return SQLITE_OK;
-}
+    v1 = vld1q_f32(pVect1);
+    pVect1 += 4;
+    v2 = vld1q_f32(pVect2);
+    pVect2 += 4;
+    diff = vsubq_f32(v1, v2);
+    sum3 = vfmaq_f32(sum3, diff, diff);
+  }
 
-int array_append(struct Array *array, const void *element) {
-  if (array->length == array->capacity) {
-    size_t new_capacity = array->capacity * 2 + 100;
-    void *z = sqlite3_realloc64(array->z, array->element_size * new_capacity);
-    if (z) {
-      array->capacity = new_capacity;
-      array->z = z;
-    } else {
-      return SQLITE_NOMEM;
-    }
+  f32 sum_scalar =
+      vaddvq_f32(vaddq_f32(vaddq_f32(sum0, sum1), vaddq_f32(sum2, sum3)));
+  const f32 *pEnd2 = pVect1 + (qty - (qty16 << 4));
+  while (pVect1 < pEnd2) {
+    f32 diff = *pVect1 - *pVect2;
+    sum_scalar += diff * diff;
+    pVect1++;
+    pVect2++;
   }
-  memcpy(&((unsigned char *)array->z)[array->length * array->element_size],
-         element, array->element_size);
-  array->length++;
-  return SQLITE_OK;
-}
 
-void array_cleanup(struct Array *array) {
-  if (!array)
-    return;
-  array->element_size = 0;
-  array->length = 0;
-  array->capacity = 0;
-  sqlite3_free(array->z);
-  array->z = NULL;
+  return sum_scalar;
 }
 
-char *vector_subtype_name(int subtype) {
-  switch (subtype) {
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
-    return "float32";
-  case SQLITE_VEC_ELEMENT_TYPE_INT8:
-    return "int8";
-  case SQLITE_VEC_ELEMENT_TYPE_BIT:
-    return "bit";
+static f32 cosine_float_neon(const void *pVect1v, const void *pVect2v,
+                              const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  size_t qty16 = qty >> 4;
+  const f32 *pEnd1 = pVect1 + (qty16 << 4);
+
+  float32x4_t dot0 = vdupq_n_f32(0), dot1 = vdupq_n_f32(0);
+  float32x4_t dot2 = vdupq_n_f32(0), dot3 = vdupq_n_f32(0);
+  float32x4_t amag0 = vdupq_n_f32(0), amag1 = vdupq_n_f32(0);
+  float32x4_t amag2 = vdupq_n_f32(0), amag3 = vdupq_n_f32(0);
+  float32x4_t bmag0 = vdupq_n_f32(0), bmag1 = vdupq_n_f32(0);
+  float32x4_t bmag2 = vdupq_n_f32(0), bmag3 = vdupq_n_f32(0);
+
+  while (pVect1 < pEnd1) {
+    float32x4_t v1, v2;
+    v1 = vld1q_f32(pVect1); pVect1 += 4;
+    v2 = vld1q_f32(pVect2); pVect2 += 4;
+    dot0 = vfmaq_f32(dot0, v1, v2);
+    amag0 = vfmaq_f32(amag0, v1, v1);
+    bmag0 = vfmaq_f32(bmag0, v2, v2);
+
+    v1 = vld1q_f32(pVect1); pVect1 += 4;
+    v2 = vld1q_f32(pVect2); pVect2 += 4;
+    dot1 = vfmaq_f32(dot1, v1, v2);
+    amag1 = vfmaq_f32(amag1, v1, v1);
+    bmag1 = vfmaq_f32(bmag1, v2, v2);
+
+    v1 = vld1q_f32(pVect1); pVect1 += 4;
+    v2 = vld1q_f32(pVect2); pVect2 += 4;
+    dot2 = vfmaq_f32(dot2, v1, v2);
+    amag2 = vfmaq_f32(amag2, v1, v1);
+    bmag2 = vfmaq_f32(bmag2, v2, v2);
+
+    v1 = vld1q_f32(pVect1); pVect1 += 4;
+    v2 = vld1q_f32(pVect2); pVect2 += 4;
+    dot3 = vfmaq_f32(dot3, v1, v2);
+    amag3 = vfmaq_f32(amag3, v1, v1);
+    bmag3 = vfmaq_f32(bmag3, v2, v2);
   }
-  return "";
-}
-char *type_name(int type) {
-  switch (type) {
-  case SQLITE_INTEGER:
-    return "INTEGER";
-  case SQLITE_BLOB:
-    return "BLOB";
-  case SQLITE_TEXT:
-    return "TEXT";
-  case SQLITE_FLOAT:
-    return "FLOAT";
-  case SQLITE_NULL:
-    return "NULL";
+
+  f32 dot_s = vaddvq_f32(vaddq_f32(vaddq_f32(dot0, dot1), vaddq_f32(dot2, dot3)));
+  f32 amag_s = vaddvq_f32(vaddq_f32(vaddq_f32(amag0, amag1), vaddq_f32(amag2, amag3)));
+  f32 bmag_s = vaddvq_f32(vaddq_f32(vaddq_f32(bmag0, bmag1), vaddq_f32(bmag2, bmag3)));
+
+  const f32 *pEnd2 = pVect1 + (qty - (qty16 << 4));
+  while (pVect1 < pEnd2) {
+    dot_s += *pVect1 * *pVect2;
+    amag_s += *pVect1 * *pVect1;
+    bmag_s += *pVect2 * *pVect2;
+    pVect1++; pVect2++;
   }
-  return "";
+
+  return 1.0f - (dot_s / (sqrtf(amag_s) * sqrtf(bmag_s)));
 }
 
-typedef void (*fvec_cleanup)(void *vector);
+static f32 cosine_unit_float_neon(const void *pVect1v, const void *pVect2v,
+                                  const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+  size_t qty16 = qty >> 4;
+  const f32 *pEnd1 = pVect1 + (qty16 << 4);
 
-void fvec_cleanup_noop(void *_) { UNUSED_PARAMETER(_); }
+  float32x4_t dot0 = vdupq_n_f32(0), dot1 = vdupq_n_f32(0);
+  float32x4_t dot2 = vdupq_n_f32(0), dot3 = vdupq_n_f32(0);
 
-static int fvec_from_value(sqlite3_value *value, f32 **vector,
-                           size_t *dimensions, fvec_cleanup *cleanup,
-                           char **pzErr) {
-  int value_type = sqlite3_value_type(value);
+  while (pVect1 < pEnd1) {
+    dot0 = vfmaq_f32(dot0, vld1q_f32(pVect1), vld1q_f32(pVect2));
+    dot1 = vfmaq_f32(dot1, vld1q_f32(pVect1 + 4), vld1q_f32(pVect2 + 4));
+    dot2 = vfmaq_f32(dot2, vld1q_f32(pVect1 + 8), vld1q_f32(pVect2 + 8));
+    dot3 = vfmaq_f32(dot3, vld1q_f32(pVect1 + 12), vld1q_f32(pVect2 + 12));
+    pVect1 += 16;
+    pVect2 += 16;
+  }
 
-  if (value_type == SQLITE_BLOB) {
-    const void *blob = sqlite3_value_blob(value);
-    int bytes = sqlite3_value_bytes(value);
-    if (bytes == 0) {
-      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-      return SQLITE_ERROR;
-    }
-    if ((bytes % sizeof(f32)) != 0) {
-      *pzErr = sqlite3_mprintf("invalid float32 vector BLOB length. Must be "
-                               "divisible by %d, found %d",
-                               sizeof(f32), bytes);
-      return SQLITE_ERROR;
-    }
-    f32 *buf = sqlite3_malloc(bytes);
-    if (!buf) {
-      *pzErr = sqlite3_mprintf("out of memory");
-      return SQLITE_NOMEM;
-    }
-    memcpy(buf, blob, bytes);
-    size_t n = bytes / sizeof(f32);
-    for (size_t i = 0; i < n; i++) {
-      if (isnan(buf[i]) || isinf(buf[i])) {
-        *pzErr = sqlite3_mprintf(
-            "invalid float32 vector: element %d is %s",
-            (int)i, isnan(buf[i]) ? "NaN" : "Inf");
-        sqlite3_free(buf);
-        return SQLITE_ERROR;
-      }
-    }
-    *vector = buf;
-    *dimensions = n;
-    *cleanup = sqlite3_free;
-    return SQLITE_OK;
+  f32 dot_s = vaddvq_f32(vaddq_f32(vaddq_f32(dot0, dot1), vaddq_f32(dot2, dot3)));
+
+  const f32 *pEnd2 = pVect1 + (qty - (qty16 << 4));
+  while (pVect1 < pEnd2) {
+    dot_s += *pVect1 * *pVect2;
+    pVect1++;
+    pVect2++;
   }
 
-  if (value_type == SQLITE_TEXT) {
-    const char *source = (const char *)sqlite3_value_text(value);
-    int source_len = sqlite3_value_bytes(value);
-    if (source_len == 0) {
-      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-      return SQLITE_ERROR;
-    }
-    int i = 0;
-
-    struct Array x;
-    int rc = array_init(&x, sizeof(f32), ceil(source_len / 2.0));
-    if (rc != SQLITE_OK) {
-      return rc;
-    }
-
-    // advance leading whitespace to first '['
-    while (i < source_len) {
-      if (vecJsonIsspace(source[i])) {
-        i++;
-        continue;
-      }
-      if (source[i] == '[') {
-        break;
-      }
-
-      *pzErr = sqlite3_mprintf(
-          "JSON array parsing error: Input does not start with '['");
-      array_cleanup(&x);
-      return SQLITE_ERROR;
-    }
-    if (source[i] != '[') {
-      *pzErr = sqlite3_mprintf(
-          "JSON array parsing error: Input does not start with '['");
-      array_cleanup(&x);
-      return SQLITE_ERROR;
-    }
-    int offset = i + 1;
+  return 1.0f - dot_s;
+}
 
-    while (offset < source_len) {
-      char *ptr = (char *)&source[offset];
-      char *endptr;
+static f32 l2_sqr_int8_neon(const void *pVect1v, const void *pVect2v,
+                            const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-      errno = 0;
-      double result = strtod(ptr, &endptr);
-      if ((errno != 0 && result == 0) // some interval error?
-          || (errno == ERANGE &&
-              (result == HUGE_VAL || result == -HUGE_VAL)) // too big / smalls
-      ) {
-        sqlite3_free(x.z);
-        *pzErr = sqlite3_mprintf("JSON parsing error");
-        return SQLITE_ERROR;
-      }
+  const i8 *pEnd1 = pVect1 + qty;
+  i32 sum_scalar = 0;
 
-      if (endptr == ptr) {
-        if (*ptr != ']') {
-          sqlite3_free(x.z);
-          *pzErr = sqlite3_mprintf("JSON parsing error");
-          return SQLITE_ERROR;
-        }
-        goto done;
-      }
+  while (pVect1 < pEnd1 - 7) {
+    // loading 8 at a time
+    int8x8_t v1 = vld1_s8(pVect1);
+    int8x8_t v2 = vld1_s8(pVect2);
+    pVect1 += 8;
+    pVect2 += 8;
 
-      f32 res = (f32)result;
-      if (isnan(res) || isinf(res)) {
-        sqlite3_free(x.z);
-        *pzErr = sqlite3_mprintf(
-            "invalid float32 vector: element %d is %s",
-            (int)x.length, isnan(res) ? "NaN" : "Inf");
-        return SQLITE_ERROR;
-      }
-      array_append(&x, (const void *)&res);
+    // widen i8 to i16 for subtraction
+    int16x8_t v1_wide = vmovl_s8(v1);
+    int16x8_t v2_wide = vmovl_s8(v2);
+    int16x8_t diff = vsubq_s16(v1_wide, v2_wide);
 
-      offset += (endptr - ptr);
-      while (offset < source_len) {
-        if (vecJsonIsspace(source[offset])) {
-          offset++;
-          continue;
-        }
-        if (source[offset] == ',') {
-          offset++;
-          continue;
-        }
-        if (source[offset] == ']')
-          goto done;
-        break;
-      }
-    }
+    // widening multiply: i16*i16 -> i32 to avoid i16 overflow
+    // (diff can be up to 255, so diff*diff can be up to 65025 > INT16_MAX)
+    int32x4_t sq_lo = vmull_s16(vget_low_s16(diff), vget_low_s16(diff));
+    int32x4_t sq_hi = vmull_s16(vget_high_s16(diff), vget_high_s16(diff));
+    int32x4_t sum = vaddq_s32(sq_lo, sq_hi);
 
-  done:
+    sum_scalar += vgetq_lane_s32(sum, 0) + vgetq_lane_s32(sum, 1) +
+                  vgetq_lane_s32(sum, 2) + vgetq_lane_s32(sum, 3);
+  }
 
-    if (x.length > 0) {
-      *vector = (f32 *)x.z;
-      *dimensions = x.length;
-      *cleanup = sqlite3_free;
-      return SQLITE_OK;
-    }
-    sqlite3_free(x.z);
-    *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-    return SQLITE_ERROR;
+  // handle leftovers
+  while (pVect1 < pEnd1) {
+    i16 diff = (i16)*pVect1 - (i16)*pVect2;
+    sum_scalar += diff * diff;
+    pVect1++;
+    pVect2++;
   }
 
-  *pzErr = sqlite3_mprintf(
-      "Input must have type BLOB (compact format) or TEXT (JSON), found %s",
-      type_name(value_type));
-  return SQLITE_ERROR;
+  return (f32)sum_scalar;
 }
 
-static int bitvec_from_value(sqlite3_value *value, u8 **vector,
-                             size_t *dimensions, vector_cleanup *cleanup,
-                             char **pzErr) {
-  int value_type = sqlite3_value_type(value);
-  if (value_type == SQLITE_BLOB) {
-    const void *blob = sqlite3_value_blob(value);
-    int bytes = sqlite3_value_bytes(value);
-    if (bytes == 0) {
-      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-      return SQLITE_ERROR;
-    }
-    *vector = (u8 *)blob;
-    *dimensions = bytes * CHAR_BIT;
-    *cleanup = vector_cleanup_noop;
-    return SQLITE_OK;
-  }
-  *pzErr = sqlite3_mprintf("Unknown type for bitvector.");
-  return SQLITE_ERROR;
-}
+static i32 l1_int8_neon(const void *pVect1v, const void *pVect2v,
+                        const void *qty_ptr) {
+  i8 *pVect1 = (i8 *)pVect1v;
+  i8 *pVect2 = (i8 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-static int int8_vec_from_value(sqlite3_value *value, i8 **vector,
-                               size_t *dimensions, vector_cleanup *cleanup,
-                               char **pzErr) {
-  int value_type = sqlite3_value_type(value);
-  if (value_type == SQLITE_BLOB) {
-    const void *blob = sqlite3_value_blob(value);
-    int bytes = sqlite3_value_bytes(value);
-    if (bytes == 0) {
-      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-      return SQLITE_ERROR;
-    }
-    *vector = (i8 *)blob;
-    *dimensions = bytes;
-    *cleanup = vector_cleanup_noop;
-    return SQLITE_OK;
-  }
+  const int8_t *pEnd1 = pVect1 + qty;
 
-  if (value_type == SQLITE_TEXT) {
-    const char *source = (const char *)sqlite3_value_text(value);
-    int source_len = sqlite3_value_bytes(value);
-    int i = 0;
+  int32x4_t acc1 = vdupq_n_s32(0);
+  int32x4_t acc2 = vdupq_n_s32(0);
+  int32x4_t acc3 = vdupq_n_s32(0);
+  int32x4_t acc4 = vdupq_n_s32(0);
 
-    if (source_len == 0) {
-      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-      return SQLITE_ERROR;
-    }
+  while (pVect1 < pEnd1 - 63) {
+    int8x16_t v1 = vld1q_s8(pVect1);
+    int8x16_t v2 = vld1q_s8(pVect2);
+    int8x16_t diff1 = vabdq_s8(v1, v2);
+    acc1 = vaddq_s32(acc1, vpaddlq_u16(vpaddlq_u8(diff1)));
 
-    struct Array x;
-    int rc = array_init(&x, sizeof(i8), ceil(source_len / 2.0));
-    if (rc != SQLITE_OK) {
-      return rc;
-    }
+    v1 = vld1q_s8(pVect1 + 16);
+    v2 = vld1q_s8(pVect2 + 16);
+    int8x16_t diff2 = vabdq_s8(v1, v2);
+    acc2 = vaddq_s32(acc2, vpaddlq_u16(vpaddlq_u8(diff2)));
 
-    // advance leading whitespace to first '['
-    while (i < source_len) {
-      if (vecJsonIsspace(source[i])) {
-        i++;
-        continue;
-      }
-      if (source[i] == '[') {
-        break;
-      }
+    v1 = vld1q_s8(pVect1 + 32);
+    v2 = vld1q_s8(pVect2 + 32);
+    int8x16_t diff3 = vabdq_s8(v1, v2);
+    acc3 = vaddq_s32(acc3, vpaddlq_u16(vpaddlq_u8(diff3)));
 
-      *pzErr = sqlite3_mprintf(
-          "JSON array parsing error: Input does not start with '['");
-      array_cleanup(&x);
-      return SQLITE_ERROR;
-    }
-    if (source[i] != '[') {
-      *pzErr = sqlite3_mprintf(
-          "JSON array parsing error: Input does not start with '['");
-      array_cleanup(&x);
-      return SQLITE_ERROR;
-    }
-    int offset = i + 1;
+    v1 = vld1q_s8(pVect1 + 48);
+    v2 = vld1q_s8(pVect2 + 48);
+    int8x16_t diff4 = vabdq_s8(v1, v2);
+    acc4 = vaddq_s32(acc4, vpaddlq_u16(vpaddlq_u8(diff4)));
 
-    while (offset < source_len) {
-      char *ptr = (char *)&source[offset];
-      char *endptr;
+    pVect1 += 64;
+    pVect2 += 64;
+  }
 
-      errno = 0;
-      long result = strtol(ptr, &endptr, 10);
-      if ((errno != 0 && result == 0) ||
-          (errno == ERANGE && (result == LONG_MAX || result == LONG_MIN))) {
-        sqlite3_free(x.z);
-        *pzErr = sqlite3_mprintf("JSON parsing error");
-        return SQLITE_ERROR;
-      }
+  while (pVect1 < pEnd1 - 15) {
+    int8x16_t v1 = vld1q_s8(pVect1);
+    int8x16_t v2 = vld1q_s8(pVect2);
+    int8x16_t diff = vabdq_s8(v1, v2);
+    acc1 = vaddq_s32(acc1, vpaddlq_u16(vpaddlq_u8(diff)));
+    pVect1 += 16;
+    pVect2 += 16;
+  }
 
-      if (endptr == ptr) {
-        if (*ptr != ']') {
-          sqlite3_free(x.z);
-          *pzErr = sqlite3_mprintf("JSON parsing error");
-          return SQLITE_ERROR;
-        }
-        goto done;
-      }
+  int32x4_t acc = vaddq_s32(vaddq_s32(acc1, acc2), vaddq_s32(acc3, acc4));
 
-      if (result < INT8_MIN || result > INT8_MAX) {
-        sqlite3_free(x.z);
-        *pzErr =
-            sqlite3_mprintf("JSON parsing error: value out of range for int8");
-        return SQLITE_ERROR;
-      }
+  int32_t sum = 0;
+  while (pVect1 < pEnd1) {
+    int32_t diff = abs((int32_t)*pVect1 - (int32_t)*pVect2);
+    sum += diff;
+    pVect1++;
+    pVect2++;
+  }
 
-      i8 res = (i8)result;
-      array_append(&x, (const void *)&res);
+  return vaddvq_s32(acc) + sum;
+}
 
-      offset += (endptr - ptr);
-      while (offset < source_len) {
-        if (vecJsonIsspace(source[offset])) {
-          offset++;
-          continue;
-        }
-        if (source[offset] == ',') {
-          offset++;
-          continue;
-        }
-        if (source[offset] == ']')
-          goto done;
-        break;
-      }
-    }
+static double l1_f32_neon(const void *pVect1v, const void *pVect2v,
+                          const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-  done:
+  const f32 *pEnd1 = pVect1 + qty;
+  float64x2_t acc = vdupq_n_f64(0);
 
-    if (x.length > 0) {
-      *vector = (i8 *)x.z;
-      *dimensions = x.length;
-      *cleanup = (vector_cleanup)sqlite3_free;
-      return SQLITE_OK;
-    }
-    sqlite3_free(x.z);
-    *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
-    return SQLITE_ERROR;
-  }
+  while (pVect1 < pEnd1 - 3) {
+    float32x4_t v1 = vld1q_f32(pVect1);
+    float32x4_t v2 = vld1q_f32(pVect2);
+    pVect1 += 4;
+    pVect2 += 4;
 
-  *pzErr = sqlite3_mprintf("Unknown type for int8 vector.");
-  return SQLITE_ERROR;
-}
+    // f32x4 -> f64x2 pad for overflow
+    float64x2_t low_diff = vabdq_f64(vcvt_f64_f32(vget_low_f32(v1)),
+                                     vcvt_f64_f32(vget_low_f32(v2)));
+    float64x2_t high_diff =
+        vabdq_f64(vcvt_high_f64_f32(v1), vcvt_high_f64_f32(v2));
 
-/**
- * @brief Extract a vector from a sqlite3_value. Can be a float32, int8, or bit
- * vector.
- *
- * @param value: the sqlite3_value to read from.
- * @param vector: Output pointer to vector data.
- * @param dimensions: Output number of dimensions
- * @param dimensions: Output vector element type
- * @param cleanup
- * @param pzErrorMessage
- * @return int SQLITE_OK on success, error code otherwise
- */
-int vector_from_value(sqlite3_value *value, void **vector, size_t *dimensions,
-                      enum VectorElementType *element_type,
-                      vector_cleanup *cleanup, char **pzErrorMessage) {
-  int subtype = sqlite3_value_subtype(value);
-  if (!subtype || (subtype == SQLITE_VEC_ELEMENT_TYPE_FLOAT32) ||
-      (subtype == JSON_SUBTYPE)) {
-    int rc = fvec_from_value(value, (f32 **)vector, dimensions,
-                             (fvec_cleanup *)cleanup, pzErrorMessage);
-    if (rc == SQLITE_OK) {
-      *element_type = SQLITE_VEC_ELEMENT_TYPE_FLOAT32;
-    }
-    return rc;
+    acc = vaddq_f64(acc, vaddq_f64(low_diff, high_diff));
   }
 
-  if (subtype == SQLITE_VEC_ELEMENT_TYPE_BIT) {
-    int rc = bitvec_from_value(value, (u8 **)vector, dimensions, cleanup,
-                               pzErrorMessage);
-    if (rc == SQLITE_OK) {
-      *element_type = SQLITE_VEC_ELEMENT_TYPE_BIT;
-    }
-    return rc;
-  }
-  if (subtype == SQLITE_VEC_ELEMENT_TYPE_INT8) {
-    int rc = int8_vec_from_value(value, (i8 **)vector, dimensions, cleanup,
-                                 pzErrorMessage);
-    if (rc == SQLITE_OK) {
-      *element_type = SQLITE_VEC_ELEMENT_TYPE_INT8;
-    }
-    return rc;
+  double sum = 0;
+  while (pVect1 < pEnd1) {
+    sum += fabs((double)*pVect1 - (double)*pVect2);
+    pVect1++;
+    pVect2++;
   }
-  *pzErrorMessage = sqlite3_mprintf("Unknown subtype: %d", subtype);
-  return SQLITE_ERROR;
+
+  return vaddvq_f64(acc) + sum;
 }
+#endif
 
-int ensure_vector_match(sqlite3_value *aValue, sqlite3_value *bValue, void **a,
-                        void **b, enum VectorElementType *element_type,
-                        size_t *dimensions, vector_cleanup *outACleanup,
-                        vector_cleanup *outBCleanup, char **outError) {
-  int rc;
-  enum VectorElementType aType, bType;
-  size_t aDims, bDims;
-  char *error = NULL;
-  vector_cleanup aCleanup, bCleanup;
+static f32 l2_sqr_float(const void *pVect1v, const void *pVect2v,
+                        const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-  rc = vector_from_value(aValue, a, &aDims, &aType, &aCleanup, &error);
-  if (rc != SQLITE_OK) {
-    *outError = sqlite3_mprintf("Error reading 1st vector: %s", error);
-    sqlite3_free(error);
-    return SQLITE_ERROR;
+  f32 res = 0;
+  for (size_t i = 0; i < qty; i++) {
+    f32 t = *pVect1 - *pVect2;
+    pVect1++;
+    pVect2++;
+    res += t * t;
   }
+  return res;
+}
 
-  rc = vector_from_value(bValue, b, &bDims, &bType, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    *outError = sqlite3_mprintf("Error reading 2nd vector: %s", error);
-    sqlite3_free(error);
-    aCleanup(*a);
-    return SQLITE_ERROR;
-  }
+static f32 l2_sqr_int8(const void *pA, const void *pB, const void *pD) {
+  i8 *a = (i8 *)pA;
+  i8 *b = (i8 *)pB;
+  size_t d = *((size_t *)pD);
 
-  if (aType != bType) {
-    *outError =
-        sqlite3_mprintf("Vector type mistmatch. First vector has type %s, "
-                        "while the second has type %s.",
-                        vector_subtype_name(aType), vector_subtype_name(bType));
-    aCleanup(*a);
-    bCleanup(*b);
-    return SQLITE_ERROR;
-  }
-  if (aDims != bDims) {
-    *outError = sqlite3_mprintf(
-        "Vector dimension mistmatch. First vector has %ld dimensions, "
-        "while the second has %ld dimensions.",
-        aDims, bDims);
-    aCleanup(*a);
-    bCleanup(*b);
-    return SQLITE_ERROR;
+  f32 res = 0;
+  for (size_t i = 0; i < d; i++) {
+    f32 t = *a - *b;
+    a++;
+    b++;
+    res += t * t;
   }
-  *element_type = aType;
-  *dimensions = aDims;
-  *outACleanup = aCleanup;
-  *outBCleanup = bCleanup;
-  return SQLITE_OK;
+  return res;
 }
 
-int _cmp(const void *a, const void *b) { return (*(i64 *)a - *(i64 *)b); }
+static i32 l1_int8(const void *pA, const void *pB, const void *pD) {
+  i8 *a = (i8 *)pA;
+  i8 *b = (i8 *)pB;
+  size_t d = *((size_t *)pD);
 
-#pragma region scalar functions
-static void vec_f32(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  assert(argc == 1);
-  int rc;
-  f32 *vector = NULL;
-  size_t dimensions;
-  fvec_cleanup cleanup;
-  char *errmsg;
-  rc = fvec_from_value(argv[0], &vector, &dimensions, &cleanup, &errmsg);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, errmsg, -1);
-    sqlite3_free(errmsg);
-    return;
+  i32 res = 0;
+  for (size_t i = 0; i < d; i++) {
+    res += abs(*a - *b);
+    a++;
+    b++;
   }
-  sqlite3_result_blob(context, vector, dimensions * sizeof(f32),
-                      (void (*)(void *))cleanup);
-  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
-}
 
-static void vec_bit(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  assert(argc == 1);
-  int rc;
-  u8 *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *errmsg;
-  rc = bitvec_from_value(argv[0], &vector, &dimensions, &cleanup, &errmsg);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, errmsg, -1);
-    sqlite3_free(errmsg);
-    return;
-  }
-  sqlite3_result_blob(context, vector, dimensions / CHAR_BIT, SQLITE_TRANSIENT);
-  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_BIT);
-  cleanup(vector);
+  return res;
 }
-static void vec_int8(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  assert(argc == 1);
-  int rc;
-  i8 *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *errmsg;
-  rc = int8_vec_from_value(argv[0], &vector, &dimensions, &cleanup, &errmsg);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, errmsg, -1);
-    sqlite3_free(errmsg);
-    return;
+
+static double l1_f32(const void *pA, const void *pB, const void *pD) {
+  f32 *a = (f32 *)pA;
+  f32 *b = (f32 *)pB;
+  size_t d = *((size_t *)pD);
+
+  double res = 0;
+  for (size_t i = 0; i < d; i++) {
+    res += fabs((double)*a - (double)*b);
+    a++;
+    b++;
   }
-  sqlite3_result_blob(context, vector, dimensions, SQLITE_TRANSIENT);
-  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
-  cleanup(vector);
+
+  return res;
 }
 
-static void vec_length(sqlite3_context *context, int argc,
-                       sqlite3_value **argv) {
-  assert(argc == 1);
-  int rc;
-  void *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *errmsg;
-  enum VectorElementType elementType;
-  rc = vector_from_value(argv[0], &vector, &dimensions, &elementType, &cleanup,
-                         &errmsg);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, errmsg, -1);
-    sqlite3_free(errmsg);
-    return;
+static f32 cosine_float(const void *pVect1v, const void *pVect2v,
+                        const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
+
+  f32 dot = 0;
+  f32 aMag = 0;
+  f32 bMag = 0;
+  for (size_t i = 0; i < qty; i++) {
+    dot += *pVect1 * *pVect2;
+    aMag += *pVect1 * *pVect1;
+    bMag += *pVect2 * *pVect2;
+    pVect1++;
+    pVect2++;
   }
-  sqlite3_result_int64(context, dimensions);
-  cleanup(vector);
+  return 1 - (dot / (sqrt(aMag) * sqrt(bMag)));
 }
 
-static void vec_distance_cosine(sqlite3_context *context, int argc,
-                                sqlite3_value **argv) {
-  assert(argc == 2);
-  int rc;
-  void *a = NULL, *b = NULL;
-  size_t dimensions;
-  vector_cleanup aCleanup, bCleanup;
-  char *error;
-  enum VectorElementType elementType;
-  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
-                           &aCleanup, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, error, -1);
-    sqlite3_free(error);
-    return;
-  }
+// 1 - dot(a, b), cosine distance for vectors that are already unit length.
+static f32 cosine_unit_float(const void *pVect1v, const void *pVect2v,
+                             const void *qty_ptr) {
+  f32 *pVect1 = (f32 *)pVect1v;
+  f32 *pVect2 = (f32 *)pVect2v;
+  size_t qty = *((size_t *)qty_ptr);
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_error(
-        context, "Cannot calculate cosine distance between two bitvectors.",
-        -1);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    f32 result = distance_cosine_float(a, b, &dimensions);
-    sqlite3_result_double(context, result);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    f32 result = distance_cosine_int8(a, b, &dimensions);
-    sqlite3_result_double(context, result);
-    goto finish;
-  }
+  f32 dot = 0;
+  for (size_t i = 0; i < qty; i++) {
+    dot += *pVect1 * *pVect2;
+    pVect1++;
+    pVect2++;
   }
-
-finish:
-  aCleanup(a);
-  bCleanup(b);
-  return;
+  return 1 - dot;
 }
 
-static void vec_distance_l2(sqlite3_context *context, int argc,
-                            sqlite3_value **argv) {
-  assert(argc == 2);
-  int rc;
-  void *a = NULL, *b = NULL;
-  size_t dimensions;
-  vector_cleanup aCleanup, bCleanup;
-  char *error;
-  enum VectorElementType elementType;
-  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
-                           &aCleanup, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, error, -1);
-    sqlite3_free(error);
-    return;
-  }
+static f32 cosine_int8(const void *pA, const void *pB, const void *pD) {
+  i8 *a = (i8 *)pA;
+  i8 *b = (i8 *)pB;
+  size_t d = *((size_t *)pD);
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_error(
-        context, "Cannot calculate L2 distance between two bitvectors.", -1);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    f32 result = distance_l2_sqr_float(a, b, &dimensions);
-    sqlite3_result_double(context, result);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    f32 result = distance_l2_sqr_int8(a, b, &dimensions);
-    sqlite3_result_double(context, result);
-    goto finish;
-  }
+  f32 dot = 0;
+  f32 aMag = 0;
+  f32 bMag = 0;
+  for (size_t i = 0; i < d; i++) {
+    dot += *a * *b;
+    aMag += *a * *a;
+    bMag += *b * *b;
+    a++;
+    b++;
   }
-
-finish:
-  aCleanup(a);
-  bCleanup(b);
-  return;
+  return 1 - (dot / (sqrt(aMag) * sqrt(bMag)));
 }
 
-static void vec_distance_l1(sqlite3_context *context, int argc,
-                            sqlite3_value **argv) {
-  assert(argc == 2);
-  int rc;
-  void *a, *b;
-  size_t dimensions;
-  vector_cleanup aCleanup, bCleanup;
-  char *error;
-  enum VectorElementType elementType;
-  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
-                           &aCleanup, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, error, -1);
-    sqlite3_free(error);
-    return;
-  }
+#ifdef SQLITE_VEC_ENABLE_NEON
+static f32 cosine_int8_neon(const void *pA, const void *pB, const void *pD) {
+  const i8 *a = (const i8 *)pA;
+  const i8 *b = (const i8 *)pB;
+  size_t d = *((const size_t *)pD);
+  const i8 *aEnd = a + d;
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_error(
-        context, "Cannot calculate L1 distance between two bitvectors.", -1);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    double result = distance_l1_f32(a, b, &dimensions);
-    sqlite3_result_double(context, result);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    i64 result = distance_l1_int8(a, b, &dimensions);
-    sqlite3_result_int(context, result);
-    goto finish;
-  }
-  }
+  int32x4_t dot_acc1 = vdupq_n_s32(0);
+  int32x4_t dot_acc2 = vdupq_n_s32(0);
+  int32x4_t aMag_acc1 = vdupq_n_s32(0);
+  int32x4_t aMag_acc2 = vdupq_n_s32(0);
+  int32x4_t bMag_acc1 = vdupq_n_s32(0);
+  int32x4_t bMag_acc2 = vdupq_n_s32(0);
 
-finish:
-  aCleanup(a);
-  bCleanup(b);
-  return;
-}
+  while (a < aEnd - 31) {
+    int8x16_t va1 = vld1q_s8(a);
+    int8x16_t vb1 = vld1q_s8(b);
+    int16x8_t a1_lo = vmovl_s8(vget_low_s8(va1));
+    int16x8_t a1_hi = vmovl_s8(vget_high_s8(va1));
+    int16x8_t b1_lo = vmovl_s8(vget_low_s8(vb1));
+    int16x8_t b1_hi = vmovl_s8(vget_high_s8(vb1));
 
-static void vec_distance_hamming(sqlite3_context *context, int argc,
-                                 sqlite3_value **argv) {
-  assert(argc == 2);
-  int rc;
-  void *a = NULL, *b = NULL;
-  size_t dimensions;
-  vector_cleanup aCleanup, bCleanup;
-  char *error;
-  enum VectorElementType elementType;
-  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
-                           &aCleanup, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, error, -1);
-    sqlite3_free(error);
-    return;
-  }
+    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a1_lo), vget_low_s16(b1_lo));
+    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a1_lo), vget_high_s16(b1_lo));
+    dot_acc2 = vmlal_s16(dot_acc2, vget_low_s16(a1_hi), vget_low_s16(b1_hi));
+    dot_acc2 = vmlal_s16(dot_acc2, vget_high_s16(a1_hi), vget_high_s16(b1_hi));
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_double(context, distance_hamming(a, b, &dimensions));
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    sqlite3_result_error(
-        context,
-        "Cannot calculate hamming distance between two float32 vectors.", -1);
-    goto finish;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    sqlite3_result_error(
-        context, "Cannot calculate hamming distance between two int8 vectors.",
-        -1);
-    goto finish;
-  }
-  }
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a1_lo), vget_low_s16(a1_lo));
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a1_lo), vget_high_s16(a1_lo));
+    aMag_acc2 = vmlal_s16(aMag_acc2, vget_low_s16(a1_hi), vget_low_s16(a1_hi));
+    aMag_acc2 = vmlal_s16(aMag_acc2, vget_high_s16(a1_hi), vget_high_s16(a1_hi));
 
-finish:
-  aCleanup(a);
-  bCleanup(b);
-  return;
-}
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b1_lo), vget_low_s16(b1_lo));
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b1_lo), vget_high_s16(b1_lo));
+    bMag_acc2 = vmlal_s16(bMag_acc2, vget_low_s16(b1_hi), vget_low_s16(b1_hi));
+    bMag_acc2 = vmlal_s16(bMag_acc2, vget_high_s16(b1_hi), vget_high_s16(b1_hi));
 
-char *vec_type_name(enum VectorElementType elementType) {
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
-    return "float32";
-  case SQLITE_VEC_ELEMENT_TYPE_INT8:
-    return "int8";
-  case SQLITE_VEC_ELEMENT_TYPE_BIT:
-    return "bit";
-  }
-  return "";
-}
+    int8x16_t va2 = vld1q_s8(a + 16);
+    int8x16_t vb2 = vld1q_s8(b + 16);
+    int16x8_t a2_lo = vmovl_s8(vget_low_s8(va2));
+    int16x8_t a2_hi = vmovl_s8(vget_high_s8(va2));
+    int16x8_t b2_lo = vmovl_s8(vget_low_s8(vb2));
+    int16x8_t b2_hi = vmovl_s8(vget_high_s8(vb2));
 
-static void vec_type(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  assert(argc == 1);
-  void *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *pzError;
-  enum VectorElementType elementType;
-  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
-                             &cleanup, &pzError);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, pzError, -1);
-    sqlite3_free(pzError);
-    return;
-  }
-  sqlite3_result_text(context, vec_type_name(elementType), -1, SQLITE_STATIC);
-  cleanup(vector);
-}
-static void vec_quantize_binary(sqlite3_context *context, int argc,
-                                sqlite3_value **argv) {
-  assert(argc == 1);
-  void *vector;
-  size_t dimensions;
-  vector_cleanup vectorCleanup;
-  char *pzError;
-  enum VectorElementType elementType;
-  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
-                             &vectorCleanup, &pzError);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, pzError, -1);
-    sqlite3_free(pzError);
-    return;
-  }
+    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a2_lo), vget_low_s16(b2_lo));
+    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a2_lo), vget_high_s16(b2_lo));
+    dot_acc2 = vmlal_s16(dot_acc2, vget_low_s16(a2_hi), vget_low_s16(b2_hi));
+    dot_acc2 = vmlal_s16(dot_acc2, vget_high_s16(a2_hi), vget_high_s16(b2_hi));
 
-  if (dimensions <= 0) {
-    sqlite3_result_error(context, "Zero length vectors are not supported.", -1);
-    goto cleanup;
-    return;
-  }
-  if ((dimensions % CHAR_BIT) != 0) {
-    sqlite3_result_error(
-        context,
-        "Binary quantization requires vectors with a length divisible by 8",
-        -1);
-    goto cleanup;
-    return;
-  }
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a2_lo), vget_low_s16(a2_lo));
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a2_lo), vget_high_s16(a2_lo));
+    aMag_acc2 = vmlal_s16(aMag_acc2, vget_low_s16(a2_hi), vget_low_s16(a2_hi));
+    aMag_acc2 = vmlal_s16(aMag_acc2, vget_high_s16(a2_hi), vget_high_s16(a2_hi));
 
-  int sz = dimensions / CHAR_BIT;
-  u8 *out = sqlite3_malloc(sz);
-  if (!out) {
-    sqlite3_result_error_code(context, SQLITE_NOMEM);
-    goto cleanup;
-    return;
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b2_lo), vget_low_s16(b2_lo));
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b2_lo), vget_high_s16(b2_lo));
+    bMag_acc2 = vmlal_s16(bMag_acc2, vget_low_s16(b2_hi), vget_low_s16(b2_hi));
+    bMag_acc2 = vmlal_s16(bMag_acc2, vget_high_s16(b2_hi), vget_high_s16(b2_hi));
+
+    a += 32;
+    b += 32;
   }
-  memset(out, 0, sz);
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+  while (a < aEnd - 15) {
+    int8x16_t va = vld1q_s8(a);
+    int8x16_t vb = vld1q_s8(b);
+    int16x8_t a_lo = vmovl_s8(vget_low_s8(va));
+    int16x8_t a_hi = vmovl_s8(vget_high_s8(va));
+    int16x8_t b_lo = vmovl_s8(vget_low_s8(vb));
+    int16x8_t b_hi = vmovl_s8(vget_high_s8(vb));
 
-    for (size_t i = 0; i < dimensions; i++) {
-      int res = ((f32 *)vector)[i] > 0.0;
-      out[i / 8] |= (res << (i % 8));
-    }
-    break;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    for (size_t i = 0; i < dimensions; i++) {
-      int res = ((i8 *)vector)[i] > 0;
-      out[i / 8] |= (res << (i % 8));
-    }
-    break;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_error(context,
-                         "Can only binary quantize float or int8 vectors", -1);
-    sqlite3_free(out);
-    return;
+    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a_lo), vget_low_s16(b_lo));
+    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a_lo), vget_high_s16(b_lo));
+    dot_acc1 = vmlal_s16(dot_acc1, vget_low_s16(a_hi), vget_low_s16(b_hi));
+    dot_acc1 = vmlal_s16(dot_acc1, vget_high_s16(a_hi), vget_high_s16(b_hi));
+
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a_lo), vget_low_s16(a_lo));
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a_lo), vget_high_s16(a_lo));
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_low_s16(a_hi), vget_low_s16(a_hi));
+    aMag_acc1 = vmlal_s16(aMag_acc1, vget_high_s16(a_hi), vget_high_s16(a_hi));
+
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b_lo), vget_low_s16(b_lo));
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b_lo), vget_high_s16(b_lo));
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_low_s16(b_hi), vget_low_s16(b_hi));
+    bMag_acc1 = vmlal_s16(bMag_acc1, vget_high_s16(b_hi), vget_high_s16(b_hi));
+
+    a += 16;
+    b += 16;
   }
+
+  int32x4_t dot_sum = vaddq_s32(dot_acc1, dot_acc2);
+  int32x4_t aMag_sum = vaddq_s32(aMag_acc1, aMag_acc2);
+  int32x4_t bMag_sum = vaddq_s32(bMag_acc1, bMag_acc2);
+
+  i32 dot = vaddvq_s32(dot_sum);
+  i32 aMag = vaddvq_s32(aMag_sum);
+  i32 bMag = vaddvq_s32(bMag_sum);
+
+  while (a < aEnd) {
+    dot += (i32)*a * (i32)*b;
+    aMag += (i32)*a * (i32)*a;
+    bMag += (i32)*b * (i32)*b;
+    a++;
+    b++;
   }
-  sqlite3_result_blob(context, out, sz, sqlite3_free);
-  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_BIT);
 
-cleanup:
-  vectorCleanup(vector);
+  return 1.0f - ((f32)dot / (sqrtf((f32)aMag) * sqrtf((f32)bMag)));
 }
+#endif
 
-static void vec_quantize_int8(sqlite3_context *context, int argc,
-                              sqlite3_value **argv) {
-  assert(argc == 2);
-  f32 *srcVector;
-  size_t dimensions;
-  fvec_cleanup srcCleanup;
-  char *err;
-  i8 *out = NULL;
-  int rc = fvec_from_value(argv[0], &srcVector, &dimensions, &srcCleanup, &err);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, err, -1);
-    sqlite3_free(err);
-    return;
-  }
+// https://github.com/facebookresearch/faiss/blob/77e2e79cd0a680adc343b9840dd865da724c579e/faiss/utils/hamming_distance/common.h#L34
+static u8 hamdist_table[256] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4,
+    2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4,
+    2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
+    4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5,
+    3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6,
+    4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
 
-  int sz = dimensions * sizeof(i8);
-  out = sqlite3_malloc(sz);
-  if (!out) {
-    sqlite3_result_error_nomem(context);
-    goto cleanup;
-  }
-  memset(out, 0, sz);
+#ifdef SQLITE_VEC_ENABLE_NEON
+static f32 distance_hamming_neon(const u8 *a, const u8 *b, size_t n_bytes) {
+  const u8 *pEnd = a + n_bytes;
 
-  if ((sqlite3_value_type(argv[1]) != SQLITE_TEXT) ||
-      (sqlite3_value_bytes(argv[1]) != strlen("unit")) ||
-      (sqlite3_stricmp((const char *)sqlite3_value_text(argv[1]), "unit") !=
-       0)) {
-    sqlite3_result_error(
-        context, "2nd argument to vec_quantize_int8() must be 'unit'.", -1);
-    sqlite3_free(out);
-    goto cleanup;
-  }
-  f32 step = (1.0 - (-1.0)) / 255;
-  for (size_t i = 0; i < dimensions; i++) {
-    double val = ((srcVector[i] - (-1.0)) / step) - 128;
-    if (!(val <= 127.0)) val = 127.0;   /* also clamps NaN */
-    if (!(val >= -128.0)) val = -128.0;
-    out[i] = (i8)val;
-  }
+  uint32x4_t acc1 = vdupq_n_u32(0);
+  uint32x4_t acc2 = vdupq_n_u32(0);
+  uint32x4_t acc3 = vdupq_n_u32(0);
+  uint32x4_t acc4 = vdupq_n_u32(0);
 
-  sqlite3_result_blob(context, out, dimensions * sizeof(i8), sqlite3_free);
-  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
+  while (a <= pEnd - 64) {
+    uint8x16_t v1 = vld1q_u8(a);
+    uint8x16_t v2 = vld1q_u8(b);
+    acc1 = vaddq_u32(acc1, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
 
-cleanup:
-  srcCleanup(srcVector);
-}
+    v1 = vld1q_u8(a + 16);
+    v2 = vld1q_u8(b + 16);
+    acc2 = vaddq_u32(acc2, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
 
-static void vec_add(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  assert(argc == 2);
-  int rc;
-  void *a = NULL, *b = NULL;
-  size_t dimensions;
-  vector_cleanup aCleanup, bCleanup;
-  char *error;
-  enum VectorElementType elementType;
-  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
-                           &aCleanup, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, error, -1);
-    sqlite3_free(error);
-    return;
+    v1 = vld1q_u8(a + 32);
+    v2 = vld1q_u8(b + 32);
+    acc3 = vaddq_u32(acc3, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+
+    v1 = vld1q_u8(a + 48);
+    v2 = vld1q_u8(b + 48);
+    acc4 = vaddq_u32(acc4, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+
+    a += 64;
+    b += 64;
   }
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_error(context, "Cannot add two bitvectors together.", -1);
-    goto finish;
+  while (a <= pEnd - 16) {
+    uint8x16_t v1 = vld1q_u8(a);
+    uint8x16_t v2 = vld1q_u8(b);
+    acc1 = vaddq_u32(acc1, vpaddlq_u16(vpaddlq_u8(vcntq_u8(veorq_u8(v1, v2)))));
+    a += 16;
+    b += 16;
   }
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    size_t outSize = dimensions * sizeof(f32);
-    f32 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      goto finish;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < dimensions; i++) {
-      out[i] = ((f32 *)a)[i] + ((f32 *)b)[i];
-    }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
-    goto finish;
+
+  acc1 = vaddq_u32(acc1, acc2);
+  acc3 = vaddq_u32(acc3, acc4);
+  acc1 = vaddq_u32(acc1, acc3);
+  u32 sum = vaddvq_u32(acc1);
+
+  while (a < pEnd) {
+    sum += hamdist_table[*a ^ *b];
+    a++;
+    b++;
   }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    size_t outSize = dimensions * sizeof(i8);
-    i8 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      goto finish;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < dimensions; i++) {
-      out[i] = ((i8 *)a)[i] + ((i8 *)b)[i];
-    }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
-    goto finish;
-  }
-  }
-finish:
-  aCleanup(a);
-  bCleanup(b);
-  return;
+
+  return (f32)sum;
 }
-static void vec_sub(sqlite3_context *context, int argc, sqlite3_value **argv) {
-  assert(argc == 2);
-  int rc;
-  void *a = NULL, *b = NULL;
-  size_t dimensions;
-  vector_cleanup aCleanup, bCleanup;
-  char *error;
-  enum VectorElementType elementType;
-  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
-                           &aCleanup, &bCleanup, &error);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, error, -1);
-    sqlite3_free(error);
-    return;
-  }
+#endif
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    sqlite3_result_error(context, "Cannot subtract two bitvectors together.",
-                         -1);
-    goto finish;
+#ifdef SQLITE_VEC_ENABLE_AVX
+/**
+ * AVX2 Hamming distance using VPSHUFB-based popcount.
+ * Processes 32 bytes (256 bits) per iteration.
+ */
+SQLITE_VEC_TARGET_AVX2
+static f32 distance_hamming_avx2(const u8 *a, const u8 *b, size_t n_bytes) {
+  const u8 *pEnd = a + n_bytes;
+
+  // VPSHUFB lookup table: popcount of low nibble
+  const __m256i lookup = _mm256_setr_epi8(
+      0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+      0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+
+  __m256i acc = _mm256_setzero_si256();
+
+  while (pEnd - a >= 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)a);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+    __m256i xored = _mm256_xor_si256(va, vb);
+
+    // VPSHUFB popcount: split into nibbles, lookup each
+    __m256i lo = _mm256_and_si256(xored, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(xored, 4), low_mask);
+    __m256i popcnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                      _mm256_shuffle_epi8(lookup, hi));
+
+    // Horizontal sum: u8 -> u64 via sad against zero
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(popcnt, _mm256_setzero_si256()));
+    a += 32;
+    b += 32;
   }
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    size_t outSize = dimensions * sizeof(f32);
-    f32 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      goto finish;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < dimensions; i++) {
-      out[i] = ((f32 *)a)[i] - ((f32 *)b)[i];
+
+  u32 sum = 0;
+  if (a < pEnd && n_bytes >= 32) {
+    // last 32 bytes, with the ones already counted masked off
+    __m256i m = SQLITE_VEC_LAST32_MASK(pEnd - a);
+    __m256i va = _mm256_loadu_si256((const __m256i *)(pEnd - 32));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + (pEnd - a) - 32));
+    __m256i xored = _mm256_and_si256(m, _mm256_xor_si256(va, vb));
+    __m256i lo = _mm256_and_si256(xored, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(xored, 4), low_mask);
+    __m256i popcnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                      _mm256_shuffle_epi8(lookup, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(popcnt, _mm256_setzero_si256()));
+  } else {
+    while (a < pEnd) {
+      sum += hamdist_table[*a ^ *b];
+      a++;
+      b++;
     }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
-    goto finish;
   }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    size_t outSize = dimensions * sizeof(i8);
-    i8 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      goto finish;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < dimensions; i++) {
-      out[i] = ((i8 *)a)[i] - ((i8 *)b)[i];
-    }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
-    goto finish;
+
+  // Horizontal sum of 4 x u64 lanes
+  u64 tmp[4];
+  _mm256_storeu_si256((__m256i *)tmp, acc);
+  sum += (u32)(tmp[0] + tmp[1] + tmp[2] + tmp[3]);
+
+  return (f32)sum;
+}
+
+/**
+ * Hamming distance with the POPCNT instruction, 8 bytes per iteration.
+ */
+SQLITE_VEC_TARGET_SSE4
+static f32 distance_hamming_popcnt(const u8 *a, const u8 *b, size_t n_bytes) {
+  const u8 *pEnd = a + n_bytes;
+  u32 sum = 0;
+
+  while (pEnd - a >= 8) {
+    u64 va, vb;
+    memcpy(&va, a, sizeof(u64));
+    memcpy(&vb, b, sizeof(u64));
+    sum += SQLITE_VEC_POPCNT64(va ^ vb);
+    a += 8;
+    b += 8;
   }
+
+  while (a < pEnd) {
+    sum += hamdist_table[*a ^ *b];
+    a++;
+    b++;
   }
-finish:
-  aCleanup(a);
-  bCleanup(b);
-  return;
+
+  return (f32)sum;
 }
-static void vec_slice(sqlite3_context *context, int argc,
-                      sqlite3_value **argv) {
-  assert(argc == 3);
 
-  void *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *err;
-  enum VectorElementType elementType;
+/**
+ * AVX-512BW Hamming distance, same VPSHUFB popcount as the AVX2 version but
+ * 64 bytes (512 bits) per iteration.
+ */
+SQLITE_VEC_TARGET_AVX512
+static f32 distance_hamming_avx512(const u8 *a, const u8 *b, size_t n_bytes) {
+  const u8 *pEnd = a + n_bytes;
 
-  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
-                             &cleanup, &err);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, err, -1);
-    sqlite3_free(err);
-    return;
-  }
+  const __m512i lookup = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+  const __m512i low_mask = _mm512_set1_epi8(0x0f);
 
-  int start = sqlite3_value_int(argv[1]);
-  int end = sqlite3_value_int(argv[2]);
+  __m512i acc = _mm512_setzero_si512();
 
-  if (start < 0) {
-    sqlite3_result_error(context,
-                         "slice 'start' index must be a postive number.", -1);
-    goto done;
+  while (pEnd - a >= 64) {
+    __m512i va = _mm512_loadu_si512((const void *)a);
+    __m512i vb = _mm512_loadu_si512((const void *)b);
+    __m512i xored = _mm512_xor_si512(va, vb);
+
+    __m512i lo = _mm512_and_si512(xored, low_mask);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(xored, 4), low_mask);
+    __m512i popcnt = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo),
+                                     _mm512_shuffle_epi8(lookup, hi));
+
+    acc = _mm512_add_epi64(acc, _mm512_sad_epu8(popcnt, _mm512_setzero_si512()));
+    a += 64;
+    b += 64;
   }
-  if (end < 0) {
-    sqlite3_result_error(context, "slice 'end' index must be a postive number.",
-                         -1);
-    goto done;
+
+  if (a < pEnd) {
+    __mmask64 m = SQLITE_VEC_MASK64(pEnd - a);
+    __m512i xored = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, a),
+                                     _mm512_maskz_loadu_epi8(m, b));
+    __m512i lo = _mm512_and_si512(xored, low_mask);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(xored, 4), low_mask);
+    __m512i popcnt = _mm512_add_epi8(_mm512_shuffle_epi8(lookup, lo),
+                                     _mm512_shuffle_epi8(lookup, hi));
+    acc = _mm512_add_epi64(acc, _mm512_sad_epu8(popcnt, _mm512_setzero_si512()));
   }
-  if (((size_t)start) > dimensions) {
-    sqlite3_result_error(
-        context, "slice 'start' index is greater than the number of dimensions",
-        -1);
-    goto done;
+
+  u32 sum = (u32)_mm512_reduce_add_epi64(acc);
+  return (f32)sum;
+}
+#endif
+
+static f32 distance_hamming_u8(u8 *a, u8 *b, size_t n) {
+  int same = 0;
+  for (unsigned long i = 0; i < n; i++) {
+    same += hamdist_table[a[i] ^ b[i]];
   }
-  if (((size_t)end) > dimensions) {
-    sqlite3_result_error(
-        context, "slice 'end' index is greater than the number of dimensions",
-        -1);
-    goto done;
+  return (f32)same;
+}
+
+#ifdef _MSC_VER
+#if !defined(__clang__) && (defined(_M_ARM) || defined(_M_ARM64))
+// From
+// https://github.com/ngtcp2/ngtcp2/blob/b64f1e77b5e0d880b93d31f474147fae4a1d17cc/lib/ngtcp2_ringbuf.c,
+// line 34-43
+static unsigned int __builtin_popcountl(unsigned int x) {
+  unsigned int c = 0;
+  for (; x; ++c) {
+    x &= x - 1;
   }
-  if (start > end) {
-    sqlite3_result_error(context,
-                         "slice 'start' index is greater than 'end' index", -1);
-    goto done;
+  return c;
+}
+#else
+#include <intrin.h>
+#define __builtin_popcountl __popcnt64
+#endif
+#endif
+
+static f32 distance_hamming_u64(const u8 *a, const u8 *b, size_t n) {
+  int same = 0;
+  for (unsigned long i = 0; i < n; i++) {
+    u64 va, vb;
+    memcpy(&va, a + i * sizeof(u64), sizeof(u64));
+    memcpy(&vb, b + i * sizeof(u64), sizeof(u64));
+    same += __builtin_popcountl(va ^ vb);
   }
-  if (start == end) {
-    sqlite3_result_error(context,
-                         "slice 'start' index is equal to the 'end' index, "
-                         "vectors must have non-zero length",
-                         -1);
-    goto done;
+  return (f32)same;
+}
+
+static f32 distance_hamming_scalar(const u8 *a, const u8 *b, size_t n_bytes) {
+  if ((n_bytes % sizeof(u64)) == 0) {
+    return distance_hamming_u64(a, b, n_bytes / sizeof(u64));
   }
-  size_t n = end - start;
+  return distance_hamming_u8((u8 *)a, (u8 *)b, n_bytes);
+}
 
-  switch (elementType) {
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-    int outSize = n * sizeof(f32);
-    f32 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      goto done;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < n; i++) {
-      out[i] = ((f32 *)vector)[start + i];
-    }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
-    goto done;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-    int outSize = n * sizeof(i8);
-    i8 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      return;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < n; i++) {
-      out[i] = ((i8 *)vector)[start + i];
-    }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
-    goto done;
-  }
-  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-    if ((start % CHAR_BIT) != 0) {
-      sqlite3_result_error(context, "start index must be divisible by 8.", -1);
-      goto done;
-    }
-    if ((end % CHAR_BIT) != 0) {
-      sqlite3_result_error(context, "end index must be divisible by 8.", -1);
-      goto done;
-    }
-    int outSize = n / CHAR_BIT;
-    u8 *out = sqlite3_malloc(outSize);
-    if (!out) {
-      sqlite3_result_error_nomem(context);
-      return;
-    }
-    memset(out, 0, outSize);
-    for (size_t i = 0; i < n / CHAR_BIT; i++) {
-      out[i] = ((u8 *)vector)[(start / CHAR_BIT) + i];
-    }
-    sqlite3_result_blob(context, out, outSize, sqlite3_free);
-    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_BIT);
-    goto done;
+#pragma region distance kernel dispatch
+
+enum Vec0SimdLevel {
+  VEC0_SIMD_SCALAR = 0,
+  VEC0_SIMD_SSE4 = 1,
+  VEC0_SIMD_AVX2 = 2,
+  VEC0_SIMD_AVX512 = 3,
+};
+
+static const char *vec0_simd_level_names[] = {"scalar", "sse4", "avx2",
+                                              "avx512"};
+
+typedef f32 (*vec0_distance_f32_fn)(const void *a, const void *b,
+                                    const void *d);
+
+/**
+ * The distance kernels used by every distance_*() function, along with the
+ * name of the ISA each one was compiled for (reported by vec_debug()). The L2
+ * kernels return the squared distance.
+ *
+ * Starts out with the portable scalar kernels, and is upgraded once by
+ * vec0_distance_kernels_init() to the best variants the current CPU supports.
+ */
+struct Vec0DistanceKernels {
+  enum Vec0SimdLevel level;
+  vec0_distance_f32_fn l2_sqr_float;
+  const char *l2_sqr_float_isa;
+  vec0_distance_f32_fn cosine_float;
+  const char *cosine_float_isa;
+  vec0_distance_f32_fn cosine_unit_float;
+  const char *cosine_unit_float_isa;
+  double (*l1_f32)(const void *a, const void *b, const void *d);
+  const char *l1_f32_isa;
+  vec0_distance_f32_fn l2_sqr_int8;
+  const char *l2_sqr_int8_isa;
+  vec0_distance_f32_fn cosine_int8;
+  const char *cosine_int8_isa;
+  i32 (*l1_int8)(const void *a, const void *b, const void *d);
+  const char *l1_int8_isa;
+  f32 (*hamming)(const u8 *a, const u8 *b, size_t n_bytes);
+  const char *hamming_isa;
+};
+
+// clang-format off
+#define VEC0_DISTANCE_KERNELS_SCALAR                                           \
+  {                                                                            \
+    VEC0_SIMD_SCALAR,                                                          \
+    l2_sqr_float,            "scalar",                                         \
+    cosine_float,            "scalar",                                         \
+    cosine_unit_float,       "scalar",                                         \
+    l1_f32,                  "scalar",                                         \
+    l2_sqr_int8,             "scalar",                                         \
+    cosine_int8,             "scalar",                                         \
+    l1_int8,                 "scalar",                                         \
+    distance_hamming_scalar, "scalar",                                         \
   }
+// clang-format on
+
+static struct Vec0DistanceKernels vec0_kernels = VEC0_DISTANCE_KERNELS_SCALAR;
+
+#ifdef SQLITE_VEC_ENABLE_AVX
+#if defined(_MSC_VER) && !defined(__clang__)
+static void vec0_cpuid(u32 leaf, u32 subleaf, u32 out[4]) {
+  int regs[4];
+  __cpuidex(regs, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; i++) {
+    out[i] = (u32)regs[i];
   }
-done:
-  cleanup(vector);
 }
+static u64 vec0_xgetbv(void) { return _xgetbv(0); }
+#else
+#include <cpuid.h>
+static void vec0_cpuid(u32 leaf, u32 subleaf, u32 out[4]) {
+  __cpuid_count(leaf, subleaf, out[0], out[1], out[2], out[3]);
+}
+static u64 vec0_xgetbv(void) {
+  u32 eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((u64)edx << 32) | eax;
+}
+#endif
 
-static void vec_to_json(sqlite3_context *context, int argc,
-                        sqlite3_value **argv) {
-  assert(argc == 1);
-  void *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *err;
-  enum VectorElementType elementType;
+/**
+ * Highest SIMD level that both the CPU and the OS support. AVX and AVX-512
+ * also need the OS to save the wider registers, which is checked with XGETBV.
+ */
+static enum Vec0SimdLevel vec0_cpu_simd_level(void) {
+  u32 regs[4];
+  vec0_cpuid(0, 0, regs);
+  u32 max_leaf = regs[0];
+  if (max_leaf < 1) {
+    return VEC0_SIMD_SCALAR;
+  }
+
+  vec0_cpuid(1, 0, regs);
+  u32 ecx1 = regs[2];
+  int has_sse41 = (ecx1 >> 19) & 1;
+  int has_popcnt = (ecx1 >> 23) & 1;
+  int has_fma = (ecx1 >> 12) & 1;
+  int has_osxsave = (ecx1 >> 27) & 1;
+  int has_avx = (ecx1 >> 28) & 1;
+  if (!has_sse41 || !has_popcnt) {
+    return VEC0_SIMD_SCALAR;
+  }
+  if (!has_osxsave || !has_avx || !has_fma || max_leaf < 7) {
+    return VEC0_SIMD_SSE4;
+  }
+
+  u64 xcr0 = vec0_xgetbv();
+  // XMM + YMM state
+  if ((xcr0 & 0x6) != 0x6) {
+    return VEC0_SIMD_SSE4;
+  }
+
+  vec0_cpuid(7, 0, regs);
+  u32 ebx7 = regs[1];
+  int has_avx2 = (ebx7 >> 5) & 1;
+  int has_avx512f = (ebx7 >> 16) & 1;
+  int has_avx512bw = (ebx7 >> 30) & 1;
+  if (!has_avx2) {
+    return VEC0_SIMD_SSE4;
+  }
+  // opmask + upper ZMM state
+  if (!has_avx512f || !has_avx512bw || (xcr0 & 0xe0) != 0xe0) {
+    return VEC0_SIMD_AVX2;
+  }
+  return VEC0_SIMD_AVX512;
+}
+#endif
 
-  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
-                             &cleanup, &err);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, err, -1);
-    sqlite3_free(err);
-    return;
+/**
+ * Fill vec0_kernels with the best kernels available on the current CPU, never
+ * going above max_level. Returns the level that was selected.
+ *
+ * sqlite3_vec_init() runs this once per process, under SQLite's static main
+ * mutex, so concurrent loads don't race on the table.
+ */
+static enum Vec0SimdLevel
+vec0_distance_kernels_init(enum Vec0SimdLevel max_level) {
+  struct Vec0DistanceKernels k = VEC0_DISTANCE_KERNELS_SCALAR;
+#ifdef SQLITE_VEC_ENABLE_AVX
+  enum Vec0SimdLevel level = vec0_cpu_simd_level();
+  if (level > max_level) {
+    level = max_level;
+  }
+  k.level = level;
+  if (level >= VEC0_SIMD_SSE4) {
+    k.l2_sqr_float = l2_sqr_float_sse;
+    k.l2_sqr_float_isa = "sse4";
+    k.cosine_float = cosine_float_sse;
+    k.cosine_float_isa = "sse4";
+    k.cosine_unit_float = cosine_unit_float_sse;
+    k.cosine_unit_float_isa = "sse4";
+    k.l1_f32 = l1_f32_sse;
+    k.l1_f32_isa = "sse4";
+    k.l2_sqr_int8 = l2_sqr_int8_sse;
+    k.l2_sqr_int8_isa = "sse4";
+    k.cosine_int8 = cosine_int8_sse;
+    k.cosine_int8_isa = "sse4";
+    k.l1_int8 = l1_int8_sse;
+    k.l1_int8_isa = "sse4";
+    k.hamming = distance_hamming_popcnt;
+    k.hamming_isa = "sse4";
+  }
+  if (level >= VEC0_SIMD_AVX2) {
+    k.l2_sqr_float = l2_sqr_float_avx2;
+    k.l2_sqr_float_isa = "avx2";
+    k.cosine_float = cosine_float_avx2;
+    k.cosine_float_isa = "avx2";
+    k.cosine_unit_float = cosine_unit_float_avx2;
+    k.cosine_unit_float_isa = "avx2";
+    k.l1_f32 = l1_f32_avx2;
+    k.l1_f32_isa = "avx2";
+    k.l2_sqr_int8 = l2_sqr_int8_avx2;
+    k.l2_sqr_int8_isa = "avx2";
+    k.cosine_int8 = cosine_int8_avx2;
+    k.cosine_int8_isa = "avx2";
+    k.l1_int8 = l1_int8_avx2;
+    k.l1_int8_isa = "avx2";
+    k.hamming = distance_hamming_avx2;
+    k.hamming_isa = "avx2";
+  }
+  if (level >= VEC0_SIMD_AVX512) {
+    k.l2_sqr_float = l2_sqr_float_avx512;
+    k.l2_sqr_float_isa = "avx512";
+    k.cosine_float = cosine_float_avx512;
+    k.cosine_float_isa = "avx512";
+    k.cosine_unit_float = cosine_unit_float_avx512;
+    k.cosine_unit_float_isa = "avx512";
+    k.l1_f32 = l1_f32_avx512;
+    k.l1_f32_isa = "avx512";
+    k.l2_sqr_int8 = l2_sqr_int8_avx512;
+    k.l2_sqr_int8_isa = "avx512";
+    k.cosine_int8 = cosine_int8_avx512;
+    k.cosine_int8_isa = "avx512";
+    k.l1_int8 = l1_int8_avx512;
+    k.l1_int8_isa = "avx512";
+    k.hamming = distance_hamming_avx512;
+    k.hamming_isa = "avx512";
   }
+#else
+  UNUSED_PARAMETER(max_level);
+#endif
+#ifdef SQLITE_VEC_ENABLE_NEON
+  // NEON kernels are chosen at compile time by the distance_*() wrappers, the
+  // scalar entries are only used for short vectors.
+  k.l2_sqr_float_isa = k.cosine_float_isa = k.l1_f32_isa = "neon";
+  k.cosine_unit_float_isa = "neon";
+  k.l2_sqr_int8_isa = k.cosine_int8_isa = k.l1_int8_isa = "neon";
+  k.hamming_isa = "neon";
+#endif
+  vec0_kernels = k;
+  return k.level;
+}
 
-  sqlite3_str *str = sqlite3_str_new(sqlite3_context_db_handle(context));
-  sqlite3_str_appendall(str, "[");
-  for (size_t i = 0; i < dimensions; i++) {
-    if (i != 0) {
-      sqlite3_str_appendall(str, ",");
-    }
-    if (elementType == SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
-      f32 value = ((f32 *)vector)[i];
-      if (isnan(value)) {
-        sqlite3_str_appendall(str, "null");
-      } else {
-        sqlite3_str_appendf(str, "%f", value);
-      }
+#pragma endregion
 
-    } else if (elementType == SQLITE_VEC_ELEMENT_TYPE_INT8) {
-      sqlite3_str_appendf(str, "%d", ((i8 *)vector)[i]);
-    } else if (elementType == SQLITE_VEC_ELEMENT_TYPE_BIT) {
-      u8 b = (((u8 *)vector)[i / 8] >> (i % CHAR_BIT)) & 1;
-      sqlite3_str_appendf(str, "%d", b);
-    }
+/**
+ * Squared L2 distance. Ranks vectors in the same order as the true L2
+ * distance, so KNN scans compare these and only take the square root of the
+ * distances they return.
+ */
+static f32 distance_l2_squared_float(const void *a, const void *b,
+                                     const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 16) {
+    return l2_sqr_float_neon(a, b, d);
   }
-  sqlite3_str_appendall(str, "]");
-  int len = sqlite3_str_length(str);
-  char *s = sqlite3_str_finish(str);
-  if (s) {
-    sqlite3_result_text(context, s, len, sqlite3_free);
-    sqlite3_result_subtype(context, JSON_SUBTYPE);
-  } else {
-    sqlite3_result_error_nomem(context);
+#endif
+  return vec0_kernels.l2_sqr_float(a, b, d);
+}
+
+static f32 distance_l2_squared_int8(const void *a, const void *b,
+                                    const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 7) {
+    return l2_sqr_int8_neon(a, b, d);
   }
-  cleanup(vector);
+#endif
+  return vec0_kernels.l2_sqr_int8(a, b, d);
 }
 
-static void vec_normalize(sqlite3_context *context, int argc,
-                          sqlite3_value **argv) {
-  assert(argc == 1);
-  void *vector;
-  size_t dimensions;
-  vector_cleanup cleanup;
-  char *err;
-  enum VectorElementType elementType;
+static f32 distance_l2_sqr_float(const void *a, const void *b, const void *d) {
+  return sqrtf(distance_l2_squared_float(a, b, d));
+}
 
-  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
-                             &cleanup, &err);
-  if (rc != SQLITE_OK) {
-    sqlite3_result_error(context, err, -1);
-    sqlite3_free(err);
-    return;
-  }
+static f32 distance_l2_sqr_int8(const void *a, const void *b, const void *d) {
+  return sqrtf(distance_l2_squared_int8(a, b, d));
+}
 
-  if (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
-    sqlite3_result_error(
-        context, "only float32 vectors are supported when normalizing", -1);
-    cleanup(vector);
-    return;
+static i32 distance_l1_int8(const void *a, const void *b, const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 15) {
+    return l1_int8_neon(a, b, d);
   }
+#endif
+  return vec0_kernels.l1_int8(a, b, d);
+}
 
-  int outSize = dimensions * sizeof(f32);
-  f32 *out = sqlite3_malloc(outSize);
-  if (!out) {
-    cleanup(vector);
-    sqlite3_result_error_code(context, SQLITE_NOMEM);
-    return;
+static double distance_l1_f32(const void *a, const void *b, const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 3) {
+    return l1_f32_neon(a, b, d);
   }
-  memset(out, 0, outSize);
-
-  f32 *v = (f32 *)vector;
+#endif
+  return vec0_kernels.l1_f32(a, b, d);
+}
 
-  f32 norm = 0;
-  for (size_t i = 0; i < dimensions; i++) {
-    norm += v[i] * v[i];
-  }
-  norm = sqrt(norm);
-  for (size_t i = 0; i < dimensions; i++) {
-    out[i] = v[i] / norm;
+static f32 distance_cosine_float(const void *a, const void *b, const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 16) {
+    return cosine_float_neon(a, b, d);
   }
+#endif
+  return vec0_kernels.cosine_float(a, b, d);
+}
 
-  sqlite3_result_blob(context, out, dimensions * sizeof(f32), sqlite3_free);
-  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
-  cleanup(vector);
+/**
+ * Cosine distance between two unit-length vectors, 1 - dot(a, b). Used by
+ * normalize=1 columns, where stored and query vectors are normalized up front.
+ */
+static f32 distance_cosine_unit_float(const void *a, const void *b,
+                                      const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 16) {
+    return cosine_unit_float_neon(a, b, d);
+  }
+#endif
+  return vec0_kernels.cosine_unit_float(a, b, d);
 }
 
-static void _static_text_func(sqlite3_context *context, int argc,
-                              sqlite3_value **argv) {
-  UNUSED_PARAMETER(argc);
-  UNUSED_PARAMETER(argv);
-  sqlite3_result_text(context, sqlite3_user_data(context), -1, SQLITE_STATIC);
+static f32 distance_cosine_int8(const void *a, const void *b, const void *d) {
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if ((*(const size_t *)d) > 15) {
+    return cosine_int8_neon(a, b, d);
+  }
+#endif
+  return vec0_kernels.cosine_int8(a, b, d);
 }
 
-#pragma endregion
+/**
+ * @brief Calculate the hamming distance between two bitvectors.
+ *
+ * @param a - first bitvector, MUST have d dimensions
+ * @param b - second bitvector, MUST have d dimensions
+ * @param d - pointer to size_t, MUST be divisible by CHAR_BIT
+ * @return f32
+ */
+static f32 distance_hamming(const void *a, const void *b, const void *d) {
+  size_t dimensions = *((size_t *)d);
+  size_t n_bytes = dimensions / CHAR_BIT;
 
-enum Vec0TokenType {
-  TOKEN_TYPE_IDENTIFIER,
-  TOKEN_TYPE_DIGIT,
-  TOKEN_TYPE_LBRACKET,
-  TOKEN_TYPE_RBRACKET,
-  TOKEN_TYPE_PLUS,
-  TOKEN_TYPE_EQ,
-  TOKEN_TYPE_LPAREN,
-  TOKEN_TYPE_RPAREN,
-  TOKEN_TYPE_COMMA,
-};
-struct Vec0Token {
-  enum Vec0TokenType token_type;
-  char *start;
-  char *end;
-};
+#ifdef SQLITE_VEC_ENABLE_NEON
+  if (dimensions >= 128) {
+    return distance_hamming_neon((const u8 *)a, (const u8 *)b, n_bytes);
+  }
+#endif
+  return vec0_kernels.hamming((const u8 *)a, (const u8 *)b, n_bytes);
+}
 
-int is_alpha(char x) {
-  return (x >= 'a' && x <= 'z') || (x >= 'A' && x <= 'Z');
+#ifdef SQLITE_VEC_TEST
+int _test_distance_kernels_init(int max_level) {
+  return (int)vec0_distance_kernels_init((enum Vec0SimdLevel)max_level);
 }
-int is_digit(char x) { return (x >= '0' && x <= '9'); }
-int is_whitespace(char x) {
-  return x == ' ' || x == '\t' || x == '\n' || x == '\r';
+f32 _test_distance_l2_sqr_float(const f32 *a, const f32 *b, size_t dims) {
+  return distance_l2_sqr_float(a, b, &dims);
 }
+f32 _test_distance_l2_squared_float(const f32 *a, const f32 *b, size_t dims) {
+  return distance_l2_squared_float(a, b, &dims);
+}
+f32 _test_distance_cosine_float(const f32 *a, const f32 *b, size_t dims) {
+  return distance_cosine_float(a, b, &dims);
+}
+f32 _test_distance_cosine_unit_float(const f32 *a, const f32 *b, size_t dims) {
+  return distance_cosine_unit_float(a, b, &dims);
+}
+double _test_distance_l1_f32(const f32 *a, const f32 *b, size_t dims) {
+  return distance_l1_f32(a, b, &dims);
+}
+f32 _test_distance_l2_sqr_int8(const i8 *a, const i8 *b, size_t dims) {
+  return distance_l2_sqr_int8(a, b, &dims);
+}
+f32 _test_distance_cosine_int8(const i8 *a, const i8 *b, size_t dims) {
+  return distance_cosine_int8(a, b, &dims);
+}
+i32 _test_distance_l1_int8(const i8 *a, const i8 *b, size_t dims) {
+  return distance_l1_int8(a, b, &dims);
+}
+f32 _test_distance_hamming(const u8 *a, const u8 *b, size_t dims) {
+  return distance_hamming(a, b, &dims);
+}
+#endif
 
-#define VEC0_TOKEN_RESULT_EOF 1
-#define VEC0_TOKEN_RESULT_SOME 2
-#define VEC0_TOKEN_RESULT_ERROR 3
+// from SQLite source:
+// https://github.com/sqlite/sqlite/blob/a509a90958ddb234d1785ed7801880ccb18b497e/src/json.c#L153
+static const char vecJsonIsSpaceX[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 
-int vec0_token_next(char *start, char *end, struct Vec0Token *out) {
-  char *ptr = start;
-  while (ptr < end) {
-    char curr = *ptr;
-    if (is_whitespace(curr)) {
-      ptr++;
-      continue;
-    } else if (curr == '+') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_PLUS;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (curr == '[') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_LBRACKET;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (curr == ']') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_RBRACKET;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (curr == '=') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_EQ;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (curr == '(') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_LPAREN;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (curr == ')') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_RPAREN;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (curr == ',') {
-      ptr++;
-      out->start = ptr;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_COMMA;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (is_alpha(curr)) {
-      char *start = ptr;
-      while (ptr < end && (is_alpha(*ptr) || is_digit(*ptr) || *ptr == '_')) {
-        ptr++;
-      }
-      out->start = start;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_IDENTIFIER;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else if (is_digit(curr)) {
-      char *start = ptr;
-      while (ptr < end && (is_digit(*ptr))) {
-        ptr++;
-      }
-      out->start = start;
-      out->end = ptr;
-      out->token_type = TOKEN_TYPE_DIGIT;
-      return VEC0_TOKEN_RESULT_SOME;
-    } else {
-      return VEC0_TOKEN_RESULT_ERROR;
-    }
-  }
-  return VEC0_TOKEN_RESULT_EOF;
-}
-
-struct Vec0Scanner {
-  char *start;
-  char *end;
-  char *ptr;
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
-void vec0_scanner_init(struct Vec0Scanner *scanner, const char *source,
-                       int source_length) {
-  scanner->start = (char *)source;
-  scanner->end = (char *)source + source_length;
-  scanner->ptr = (char *)source;
-}
-int vec0_scanner_next(struct Vec0Scanner *scanner, struct Vec0Token *out) {
-  int rc = vec0_token_next(scanner->start, scanner->end, out);
-  if (rc == VEC0_TOKEN_RESULT_SOME) {
-    scanner->start = out->end;
-  }
-  return rc;
-}
-
-int vec0_parse_table_option(const char *source, int source_length,
-                            char **out_key, int *out_key_length,
-                            char **out_value, int *out_value_length) {
-  int rc;
-  struct Vec0Scanner scanner;
-  struct Vec0Token token;
-  char *key;
-  char *value;
-  int keyLength, valueLength;
-
-  vec0_scanner_init(&scanner, source, source_length);
+#define vecJsonIsspace(x) (vecJsonIsSpaceX[(unsigned char)x])
 
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  key = token.start;
-  keyLength = token.end - token.start;
+typedef void (*vector_cleanup)(void *p);
 
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_EQ) {
-    return SQLITE_EMPTY;
-  }
+void vector_cleanup_noop(void *_) { UNUSED_PARAMETER(_); }
 
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      !((token.token_type == TOKEN_TYPE_IDENTIFIER) ||
-        (token.token_type == TOKEN_TYPE_DIGIT))) {
-    return SQLITE_ERROR;
-  }
-  value = token.start;
-  valueLength = token.end - token.start;
+#define JSON_SUBTYPE 74
 
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc == VEC0_TOKEN_RESULT_EOF) {
-    *out_key = key;
-    *out_key_length = keyLength;
-    *out_value = value;
-    *out_value_length = valueLength;
-    return SQLITE_OK;
-  }
-  return SQLITE_ERROR;
+void vtab_set_error(sqlite3_vtab *pVTab, const char *zFormat, ...) {
+  va_list args;
+  sqlite3_free(pVTab->zErrMsg);
+  va_start(args, zFormat);
+  pVTab->zErrMsg = sqlite3_vmprintf(zFormat, args);
+  va_end(args);
 }
+struct Array {
+  size_t element_size;
+  size_t length;
+  size_t capacity;
+  void *z;
+};
+
 /**
- * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
- * it's a PARTITION KEY definition.
+ * @brief Initial an array with the given element size and capacity.
  *
- * @param source: argv[i] source string
- * @param source_length: length of the source string
- * @param out_column_name: If it is a partition key, the output column name. Same lifetime
- * as source, points to specific char *
- * @param out_column_name_length: Length of out_column_name in bytes
- * @param out_column_type: SQLITE_TEXT or SQLITE_INTEGER.
- * @return int: SQLITE_EMPTY if not a PK, SQLITE_OK if it is.
+ * @param array
+ * @param element_size
+ * @param init_capacity
+ * @return SQLITE_OK on success, error code on failure. Only error is
+ * SQLITE_NOMEM
  */
-int vec0_parse_partition_key_definition(const char *source, int source_length,
-                                 char **out_column_name,
-                                 int *out_column_name_length,
-                                 int *out_column_type) {
-  struct Vec0Scanner scanner;
-  struct Vec0Token token;
-  char *column_name;
-  int column_name_length;
-  int column_type;
-  vec0_scanner_init(&scanner, source, source_length);
-
-  // Check first token is identifier, will be the column name
-  int rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-
-  column_name = token.start;
-  column_name_length = token.end - token.start;
-
-  // Check the next token matches "text" or "integer", as column type
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  if (sqlite3_strnicmp(token.start, "text", token.end - token.start) == 0) {
-    column_type = SQLITE_TEXT;
-  } else if (sqlite3_strnicmp(token.start, "int", token.end - token.start) ==
-                 0 ||
-             sqlite3_strnicmp(token.start, "integer",
-                              token.end - token.start) == 0) {
-    column_type = SQLITE_INTEGER;
-  } else {
-    return SQLITE_EMPTY;
+int array_init(struct Array *array, size_t element_size, size_t init_capacity) {
+  int sz = element_size * init_capacity;
+  void *z = sqlite3_malloc(sz);
+  if (!z) {
+    return SQLITE_NOMEM;
   }
+  memset(z, 0, sz);
 
-  // Check the next token is identifier and matches "partition"
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  if (sqlite3_strnicmp(token.start, "partition", token.end - token.start) != 0) {
-    return SQLITE_EMPTY;
-  }
+  array->element_size = element_size;
+  array->length = 0;
+  array->capacity = init_capacity;
+  array->z = z;
+  return SQLITE_OK;
+}
 
-  // Check the next token is identifier and matches "key"
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  if (sqlite3_strnicmp(token.start, "key", token.end - token.start) != 0) {
-    return SQLITE_EMPTY;
+int array_append(struct Array *array, const void *element) {
+  if (array->length == array->capacity) {
+    size_t new_capacity = array->capacity * 2 + 100;
+    void *z = sqlite3_realloc64(array->z, array->element_size * new_capacity);
+    if (z) {
+      array->capacity = new_capacity;
+      array->z = z;
+    } else {
+      return SQLITE_NOMEM;
+    }
   }
-
-  *out_column_name = column_name;
-  *out_column_name_length = column_name_length;
-  *out_column_type = column_type;
-
+  memcpy(&((unsigned char *)array->z)[array->length * array->element_size],
+         element, array->element_size);
+  array->length++;
   return SQLITE_OK;
 }
 
-/**
- * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
- * it's an auxiliar column definition, ie `+[name] [type]` like `+contents text`
- *
- * @param source: argv[i] source string
- * @param source_length: length of the source string
- * @param out_column_name: If it is a partition key, the output column name. Same lifetime
- * as source, points to specific char *
- * @param out_column_name_length: Length of out_column_name in bytes
- * @param out_column_type: SQLITE_TEXT, SQLITE_INTEGER, SQLITE_FLOAT, or SQLITE_BLOB.
- * @return int: SQLITE_EMPTY if not an aux column, SQLITE_OK if it is.
- */
-int vec0_parse_auxiliary_column_definition(const char *source, int source_length,
-                                 char **out_column_name,
-                                 int *out_column_name_length,
-                                 int *out_column_type) {
-  struct Vec0Scanner scanner;
-  struct Vec0Token token;
-  char *column_name;
-  int column_name_length;
-  int column_type;
-  vec0_scanner_init(&scanner, source, source_length);
-
-  // Check first token is '+', which denotes aux columns
-  int rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME ||
-      token.token_type != TOKEN_TYPE_PLUS) {
-    return SQLITE_EMPTY;
-  }
-
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-
-  column_name = token.start;
-  column_name_length = token.end - token.start;
+void array_cleanup(struct Array *array) {
+  if (!array)
+    return;
+  array->element_size = 0;
+  array->length = 0;
+  array->capacity = 0;
+  sqlite3_free(array->z);
+  array->z = NULL;
+}
 
-  // Check the next token matches "text" or "integer", as column type
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
+char *vector_subtype_name(int subtype) {
+  switch (subtype) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
+    return "float32";
+  case SQLITE_VEC_ELEMENT_TYPE_INT8:
+    return "int8";
+  case SQLITE_VEC_ELEMENT_TYPE_BIT:
+    return "bit";
   }
-  if (sqlite3_strnicmp(token.start, "text", token.end - token.start) == 0) {
-    column_type = SQLITE_TEXT;
-  } else if (sqlite3_strnicmp(token.start, "int", token.end - token.start) ==
-                 0 ||
-             sqlite3_strnicmp(token.start, "integer",
-                              token.end - token.start) == 0) {
-    column_type = SQLITE_INTEGER;
-  } else if (sqlite3_strnicmp(token.start, "float", token.end - token.start) ==
-                 0 ||
-             sqlite3_strnicmp(token.start, "double",
-                              token.end - token.start) == 0) {
-    column_type = SQLITE_FLOAT;
-  } else if (sqlite3_strnicmp(token.start, "blob", token.end - token.start) ==0) {
-    column_type = SQLITE_BLOB;
-  } else {
-    return SQLITE_EMPTY;
+  return "";
+}
+char *type_name(int type) {
+  switch (type) {
+  case SQLITE_INTEGER:
+    return "INTEGER";
+  case SQLITE_BLOB:
+    return "BLOB";
+  case SQLITE_TEXT:
+    return "TEXT";
+  case SQLITE_FLOAT:
+    return "FLOAT";
+  case SQLITE_NULL:
+    return "NULL";
   }
-
-  *out_column_name = column_name;
-  *out_column_name_length = column_name_length;
-  *out_column_type = column_type;
-
-  return SQLITE_OK;
+  return "";
 }
 
-typedef enum {
-  VEC0_METADATA_COLUMN_KIND_BOOLEAN,
-  VEC0_METADATA_COLUMN_KIND_INTEGER,
-  VEC0_METADATA_COLUMN_KIND_FLOAT,
-  VEC0_METADATA_COLUMN_KIND_TEXT,
-  // future: blob, date, datetime
-} vec0_metadata_column_kind;
-
-/**
- * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
- * it's an metadata column definition, ie `[name] [type]` like `is_released boolean`
- *
- * @param source: argv[i] source string
- * @param source_length: length of the source string
- * @param out_column_name: If it is a metadata column, the output column name. Same lifetime
- * as source, points to specific char *
- * @param out_column_name_length: Length of out_column_name in bytes
- * @param out_column_type: one of vec0_metadata_column_kind
- * @return int: SQLITE_EMPTY if not an metadata column, SQLITE_OK if it is.
- */
-int vec0_parse_metadata_column_definition(const char *source, int source_length,
-                                 char **out_column_name,
-                                 int *out_column_name_length,
-                                 vec0_metadata_column_kind *out_column_type) {
-  struct Vec0Scanner scanner;
-  struct Vec0Token token;
-  char *column_name;
-  int column_name_length;
-  vec0_metadata_column_kind column_type;
-  int rc;
-  vec0_scanner_init(&scanner, source, source_length);
+typedef void (*fvec_cleanup)(void *vector);
 
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME ||
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
+void fvec_cleanup_noop(void *_) { UNUSED_PARAMETER(_); }
 
-  column_name = token.start;
-  column_name_length = token.end - token.start;
+static int fvec_from_value(sqlite3_value *value, f32 **vector,
+                           size_t *dimensions, fvec_cleanup *cleanup,
+                           char **pzErr) {
+  int value_type = sqlite3_value_type(value);
 
-  // Check the next token matches a valid metadata type
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME ||
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  char * t = token.start;
-  int n = token.end - token.start;
-  if (sqlite3_strnicmp(t, "boolean", n) == 0 || sqlite3_strnicmp(t, "bool", n) == 0) {
-    column_type = VEC0_METADATA_COLUMN_KIND_BOOLEAN;
-  }else if (sqlite3_strnicmp(t, "int64", n) == 0 || sqlite3_strnicmp(t, "integer64", n) == 0 || sqlite3_strnicmp(t, "integer", n) == 0 || sqlite3_strnicmp(t, "int", n) == 0) {
-    column_type = VEC0_METADATA_COLUMN_KIND_INTEGER;
-  }else if (sqlite3_strnicmp(t, "float", n) == 0 || sqlite3_strnicmp(t, "double", n) == 0 || sqlite3_strnicmp(t, "float64", n) == 0 || sqlite3_strnicmp(t, "f64", n) == 0) {
-    column_type = VEC0_METADATA_COLUMN_KIND_FLOAT;
-  } else if (sqlite3_strnicmp(t, "text", n) == 0) {
-    column_type = VEC0_METADATA_COLUMN_KIND_TEXT;
-  } else {
-    return SQLITE_EMPTY;
+  if (value_type == SQLITE_BLOB) {
+    const void *blob = sqlite3_value_blob(value);
+    int bytes = sqlite3_value_bytes(value);
+    if (bytes == 0) {
+      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+      return SQLITE_ERROR;
+    }
+    if ((bytes % sizeof(f32)) != 0) {
+      *pzErr = sqlite3_mprintf("invalid float32 vector BLOB length. Must be "
+                               "divisible by %d, found %d",
+                               sizeof(f32), bytes);
+      return SQLITE_ERROR;
+    }
+    f32 *buf = sqlite3_malloc(bytes);
+    if (!buf) {
+      *pzErr = sqlite3_mprintf("out of memory");
+      return SQLITE_NOMEM;
+    }
+    memcpy(buf, blob, bytes);
+    size_t n = bytes / sizeof(f32);
+    for (size_t i = 0; i < n; i++) {
+      if (isnan(buf[i]) || isinf(buf[i])) {
+        *pzErr = sqlite3_mprintf(
+            "invalid float32 vector: element %d is %s",
+            (int)i, isnan(buf[i]) ? "NaN" : "Inf");
+        sqlite3_free(buf);
+        return SQLITE_ERROR;
+      }
+    }
+    *vector = buf;
+    *dimensions = n;
+    *cleanup = sqlite3_free;
+    return SQLITE_OK;
   }
 
-  *out_column_name = column_name;
-  *out_column_name_length = column_name_length;
-  *out_column_type = column_type;
+  if (value_type == SQLITE_TEXT) {
+    const char *source = (const char *)sqlite3_value_text(value);
+    int source_len = sqlite3_value_bytes(value);
+    if (source_len == 0) {
+      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+      return SQLITE_ERROR;
+    }
+    int i = 0;
 
-  return SQLITE_OK;
-}
+    struct Array x;
+    int rc = array_init(&x, sizeof(f32), ceil(source_len / 2.0));
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
 
-/**
- * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
- * it's a PRIMARY KEY definition.
- *
- * @param source: argv[i] source string
- * @param source_length: length of the source string
- * @param out_column_name: If it is a PK, the output column name. Same lifetime
- * as source, points to specific char *
- * @param out_column_name_length: Length of out_column_name in bytes
- * @param out_column_type: SQLITE_TEXT or SQLITE_INTEGER.
- * @return int: SQLITE_EMPTY if not a PK, SQLITE_OK if it is.
- */
-int vec0_parse_primary_key_definition(const char *source, int source_length,
-                                 char **out_column_name,
-                                 int *out_column_name_length,
-                                 int *out_column_type) {
-  struct Vec0Scanner scanner;
-  struct Vec0Token token;
-  char *column_name;
-  int column_name_length;
-  int column_type;
-  vec0_scanner_init(&scanner, source, source_length);
+    // advance leading whitespace to first '['
+    while (i < source_len) {
+      if (vecJsonIsspace(source[i])) {
+        i++;
+        continue;
+      }
+      if (source[i] == '[') {
+        break;
+      }
 
-  // Check first token is identifier, will be the column name
-  int rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
+      *pzErr = sqlite3_mprintf(
+          "JSON array parsing error: Input does not start with '['");
+      array_cleanup(&x);
+      return SQLITE_ERROR;
+    }
+    if (source[i] != '[') {
+      *pzErr = sqlite3_mprintf(
+          "JSON array parsing error: Input does not start with '['");
+      array_cleanup(&x);
+      return SQLITE_ERROR;
+    }
+    int offset = i + 1;
 
-  column_name = token.start;
-  column_name_length = token.end - token.start;
+    while (offset < source_len) {
+      char *ptr = (char *)&source[offset];
+      char *endptr;
 
-  // Check the next token matches "text" or "integer", as column type
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  if (sqlite3_strnicmp(token.start, "text", token.end - token.start) == 0) {
-    column_type = SQLITE_TEXT;
-  } else if (sqlite3_strnicmp(token.start, "int", token.end - token.start) ==
-                 0 ||
-             sqlite3_strnicmp(token.start, "integer",
-                              token.end - token.start) == 0) {
-    column_type = SQLITE_INTEGER;
-  } else {
-    return SQLITE_EMPTY;
-  }
+      errno = 0;
+      double result = strtod(ptr, &endptr);
+      if ((errno != 0 && result == 0) // some interval error?
+          || (errno == ERANGE &&
+              (result == HUGE_VAL || result == -HUGE_VAL)) // too big / smalls
+      ) {
+        sqlite3_free(x.z);
+        *pzErr = sqlite3_mprintf("JSON parsing error");
+        return SQLITE_ERROR;
+      }
 
-  // Check the next token is identifier and matches "primary"
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  if (sqlite3_strnicmp(token.start, "primary", token.end - token.start) != 0) {
-    return SQLITE_EMPTY;
-  }
+      if (endptr == ptr) {
+        if (*ptr != ']') {
+          sqlite3_free(x.z);
+          *pzErr = sqlite3_mprintf("JSON parsing error");
+          return SQLITE_ERROR;
+        }
+        goto done;
+      }
 
-  // Check the next token is identifier and matches "key"
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
-  }
-  if (sqlite3_strnicmp(token.start, "key", token.end - token.start) != 0) {
-    return SQLITE_EMPTY;
-  }
+      f32 res = (f32)result;
+      if (isnan(res) || isinf(res)) {
+        sqlite3_free(x.z);
+        *pzErr = sqlite3_mprintf(
+            "invalid float32 vector: element %d is %s",
+            (int)x.length, isnan(res) ? "NaN" : "Inf");
+        return SQLITE_ERROR;
+      }
+      array_append(&x, (const void *)&res);
 
-  *out_column_name = column_name;
-  *out_column_name_length = column_name_length;
-  *out_column_type = column_type;
+      offset += (endptr - ptr);
+      while (offset < source_len) {
+        if (vecJsonIsspace(source[offset])) {
+          offset++;
+          continue;
+        }
+        if (source[offset] == ',') {
+          offset++;
+          continue;
+        }
+        if (source[offset] == ']')
+          goto done;
+        break;
+      }
+    }
 
-  return SQLITE_OK;
-}
+  done:
 
-enum Vec0DistanceMetrics {
-  VEC0_DISTANCE_METRIC_L2 = 1,
-  VEC0_DISTANCE_METRIC_COSINE = 2,
-  VEC0_DISTANCE_METRIC_L1 = 3,
-};
+    if (x.length > 0) {
+      *vector = (f32 *)x.z;
+      *dimensions = x.length;
+      *cleanup = sqlite3_free;
+      return SQLITE_OK;
+    }
+    sqlite3_free(x.z);
+    *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+    return SQLITE_ERROR;
+  }
 
-/**
- * Compute distance between two full-precision vectors using the appropriate
- * distance function for the given element type and metric.
- * Shared utility used by ANN index implementations.
- */
-static f32 vec0_distance_full(
-    const void *a, const void *b, size_t dimensions,
-    enum VectorElementType elementType,
-    enum Vec0DistanceMetrics metric) {
-  switch (elementType) {
-    case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
-      switch (metric) {
-        case VEC0_DISTANCE_METRIC_L2:
-          return distance_l2_sqr_float(a, b, &dimensions);
-        case VEC0_DISTANCE_METRIC_COSINE:
-          return distance_cosine_float(a, b, &dimensions);
-        case VEC0_DISTANCE_METRIC_L1:
-          return (f32)distance_l1_f32(a, b, &dimensions);
-      }
-      break;
-    case SQLITE_VEC_ELEMENT_TYPE_INT8:
-      switch (metric) {
-        case VEC0_DISTANCE_METRIC_L2:
-          return distance_l2_sqr_int8(a, b, &dimensions);
-        case VEC0_DISTANCE_METRIC_COSINE:
-          return distance_cosine_int8(a, b, &dimensions);
-        case VEC0_DISTANCE_METRIC_L1:
-          return (f32)distance_l1_int8(a, b, &dimensions);
-      }
-      break;
-    case SQLITE_VEC_ELEMENT_TYPE_BIT:
-      return distance_hamming(a, b, &dimensions);
+  *pzErr = sqlite3_mprintf(
+      "Input must have type BLOB (compact format) or TEXT (JSON), found %s",
+      type_name(value_type));
+  return SQLITE_ERROR;
+}
+
+static int bitvec_from_value(sqlite3_value *value, u8 **vector,
+                             size_t *dimensions, vector_cleanup *cleanup,
+                             char **pzErr) {
+  int value_type = sqlite3_value_type(value);
+  if (value_type == SQLITE_BLOB) {
+    const void *blob = sqlite3_value_blob(value);
+    int bytes = sqlite3_value_bytes(value);
+    if (bytes == 0) {
+      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+      return SQLITE_ERROR;
+    }
+    *vector = (u8 *)blob;
+    *dimensions = bytes * CHAR_BIT;
+    *cleanup = vector_cleanup_noop;
+    return SQLITE_OK;
   }
-  return 0.0f;
+  *pzErr = sqlite3_mprintf("Unknown type for bitvector.");
+  return SQLITE_ERROR;
 }
 
-enum Vec0IndexType {
-  VEC0_INDEX_TYPE_FLAT = 1,
-#if SQLITE_VEC_ENABLE_RESCORE
-  VEC0_INDEX_TYPE_RESCORE = 2,
-#endif
-  VEC0_INDEX_TYPE_IVF = 3,
-  VEC0_INDEX_TYPE_DISKANN = 4,
-};
+static int int8_vec_from_value(sqlite3_value *value, i8 **vector,
+                               size_t *dimensions, vector_cleanup *cleanup,
+                               char **pzErr) {
+  int value_type = sqlite3_value_type(value);
+  if (value_type == SQLITE_BLOB) {
+    const void *blob = sqlite3_value_blob(value);
+    int bytes = sqlite3_value_bytes(value);
+    if (bytes == 0) {
+      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+      return SQLITE_ERROR;
+    }
+    *vector = (i8 *)blob;
+    *dimensions = bytes;
+    *cleanup = vector_cleanup_noop;
+    return SQLITE_OK;
+  }
 
-#if SQLITE_VEC_ENABLE_RESCORE
-enum Vec0RescoreQuantizerType {
-  VEC0_RESCORE_QUANTIZER_BIT = 1,
-  VEC0_RESCORE_QUANTIZER_INT8 = 2,
-};
+  if (value_type == SQLITE_TEXT) {
+    const char *source = (const char *)sqlite3_value_text(value);
+    int source_len = sqlite3_value_bytes(value);
+    int i = 0;
 
-struct Vec0RescoreConfig {
-  enum Vec0RescoreQuantizerType quantizer_type;
-  int oversample;          // CREATE-time default
-  int oversample_search;   // runtime override (0 = use default)
-};
-#endif
+    if (source_len == 0) {
+      *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+      return SQLITE_ERROR;
+    }
 
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-enum Vec0IvfQuantizer {
-  VEC0_IVF_QUANTIZER_NONE = 0,
-  VEC0_IVF_QUANTIZER_INT8 = 1,
-  VEC0_IVF_QUANTIZER_BINARY = 2,
-};
+    struct Array x;
+    int rc = array_init(&x, sizeof(i8), ceil(source_len / 2.0));
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
 
-struct Vec0IvfConfig {
-  int nlist;       // number of centroids (0 = deferred)
-  int nprobe;      // cells to probe at query time
-  int quantizer;   // VEC0_IVF_QUANTIZER_NONE / INT8 / BINARY
-  int oversample;  // >= 1 (1 = no oversampling)
-};
-#else
-struct Vec0IvfConfig { char _unused; };
-#endif
+    // advance leading whitespace to first '['
+    while (i < source_len) {
+      if (vecJsonIsspace(source[i])) {
+        i++;
+        continue;
+      }
+      if (source[i] == '[') {
+        break;
+      }
 
-// ============================================================
-// DiskANN types and constants
-// ============================================================
+      *pzErr = sqlite3_mprintf(
+          "JSON array parsing error: Input does not start with '['");
+      array_cleanup(&x);
+      return SQLITE_ERROR;
+    }
+    if (source[i] != '[') {
+      *pzErr = sqlite3_mprintf(
+          "JSON array parsing error: Input does not start with '['");
+      array_cleanup(&x);
+      return SQLITE_ERROR;
+    }
+    int offset = i + 1;
 
-#define VEC0_DISKANN_DEFAULT_N_NEIGHBORS 72
-#define VEC0_DISKANN_MAX_N_NEIGHBORS 256
-#define VEC0_DISKANN_DEFAULT_SEARCH_LIST_SIZE 128
-#define VEC0_DISKANN_DEFAULT_ALPHA 1.2f
+    while (offset < source_len) {
+      char *ptr = (char *)&source[offset];
+      char *endptr;
 
-/**
- * Quantizer type used for compressing neighbor vectors in the DiskANN graph.
- */
-enum Vec0DiskannQuantizerType {
-  VEC0_DISKANN_QUANTIZER_BINARY = 1,   // 1 bit per dimension (1/32 compression)
-  VEC0_DISKANN_QUANTIZER_INT8   = 2,   // 1 byte per dimension (1/4 compression)
-};
+      errno = 0;
+      long result = strtol(ptr, &endptr, 10);
+      if ((errno != 0 && result == 0) ||
+          (errno == ERANGE && (result == LONG_MAX || result == LONG_MIN))) {
+        sqlite3_free(x.z);
+        *pzErr = sqlite3_mprintf("JSON parsing error");
+        return SQLITE_ERROR;
+      }
 
-/**
- * Configuration for a DiskANN index on a single vector column.
- * Parsed from `INDEXED BY diskann(neighbor_quantizer=binary, n_neighbors=72)`.
- */
-struct Vec0DiskannConfig {
-  // Quantizer type for neighbor vectors
-  enum Vec0DiskannQuantizerType quantizer_type;
+      if (endptr == ptr) {
+        if (*ptr != ']') {
+          sqlite3_free(x.z);
+          *pzErr = sqlite3_mprintf("JSON parsing error");
+          return SQLITE_ERROR;
+        }
+        goto done;
+      }
 
-  // Maximum number of neighbors per node (R in the paper). Must be divisible by 8.
-  int n_neighbors;
+      if (result < INT8_MIN || result > INT8_MAX) {
+        sqlite3_free(x.z);
+        *pzErr =
+            sqlite3_mprintf("JSON parsing error: value out of range for int8");
+        return SQLITE_ERROR;
+      }
 
-  // Search list size (L in the paper) — unified default for both insert and query.
-  int search_list_size;
+      i8 res = (i8)result;
+      array_append(&x, (const void *)&res);
 
-  // Per-path overrides (0 = fall back to search_list_size).
-  int search_list_size_search;
-  int search_list_size_insert;
+      offset += (endptr - ptr);
+      while (offset < source_len) {
+        if (vecJsonIsspace(source[offset])) {
+          offset++;
+          continue;
+        }
+        if (source[offset] == ',') {
+          offset++;
+          continue;
+        }
+        if (source[offset] == ']')
+          goto done;
+        break;
+      }
+    }
 
-  // Alpha parameter for RobustPrune (distance scaling factor, typically 1.0-1.5)
-  f32 alpha;
+  done:
 
-  // Buffer threshold for batched inserts. When > 0, inserts go into a flat
-  // buffer table and are flushed into the graph when the buffer reaches this
-  // size. 0 = disabled (legacy per-row insert behavior).
-  int buffer_threshold;
-};
+    if (x.length > 0) {
+      *vector = (i8 *)x.z;
+      *dimensions = x.length;
+      *cleanup = (vector_cleanup)sqlite3_free;
+      return SQLITE_OK;
+    }
+    sqlite3_free(x.z);
+    *pzErr = sqlite3_mprintf("zero-length vectors are not supported.");
+    return SQLITE_ERROR;
+  }
 
-/**
- * Represents a single candidate during greedy beam search.
- * Used in priority queues / sorted arrays during LM-Search.
- */
-struct Vec0DiskannCandidate {
-  i64 rowid;
-  f32 distance;
-  int visited;   // 1 if this candidate's neighbors have been explored
-  int confirmed; // 1 if full-precision vector was successfully read (node exists)
-};
+  *pzErr = sqlite3_mprintf("Unknown type for int8 vector.");
+  return SQLITE_ERROR;
+}
 
 /**
- * Returns the byte size of a quantized vector for the given quantizer type
- * and number of dimensions.
+ * @brief Extract a vector from a sqlite3_value. Can be a float32, int8, or bit
+ * vector.
+ *
+ * @param value: the sqlite3_value to read from.
+ * @param vector: Output pointer to vector data.
+ * @param dimensions: Output number of dimensions
+ * @param dimensions: Output vector element type
+ * @param cleanup
+ * @param pzErrorMessage
+ * @return int SQLITE_OK on success, error code otherwise
  */
-size_t diskann_quantized_vector_byte_size(
-    enum Vec0DiskannQuantizerType quantizer_type, size_t dimensions) {
-  switch (quantizer_type) {
-    case VEC0_DISKANN_QUANTIZER_BINARY:
-      return dimensions / CHAR_BIT;  // 1 bit per dimension
-    case VEC0_DISKANN_QUANTIZER_INT8:
-      return dimensions * sizeof(i8);  // 1 byte per dimension
+int vector_from_value(sqlite3_value *value, void **vector, size_t *dimensions,
+                      enum VectorElementType *element_type,
+                      vector_cleanup *cleanup, char **pzErrorMessage) {
+  int subtype = sqlite3_value_subtype(value);
+  if (!subtype || (subtype == SQLITE_VEC_ELEMENT_TYPE_FLOAT32) ||
+      (subtype == JSON_SUBTYPE)) {
+    int rc = fvec_from_value(value, (f32 **)vector, dimensions,
+                             (fvec_cleanup *)cleanup, pzErrorMessage);
+    if (rc == SQLITE_OK) {
+      *element_type = SQLITE_VEC_ELEMENT_TYPE_FLOAT32;
+    }
+    return rc;
   }
-  return 0;
-}
-
-struct VectorColumnDefinition {
-  char *name;
-  int name_length;
-  size_t dimensions;
-  enum VectorElementType element_type;
-  enum Vec0DistanceMetrics distance_metric;
-  enum Vec0IndexType index_type;
-#if SQLITE_VEC_ENABLE_RESCORE
-  struct Vec0RescoreConfig rescore;
-#endif
-  struct Vec0IvfConfig ivf;
-  struct Vec0DiskannConfig diskann;
-};
-
-struct Vec0PartitionColumnDefinition {
-  int type;
-  char * name;
-  int name_length;
-};
-
-struct Vec0AuxiliaryColumnDefinition {
-  int type;
-  char * name;
-  int name_length;
-};
-struct Vec0MetadataColumnDefinition {
-  vec0_metadata_column_kind kind;
-  char * name;
-  int name_length;
-};
 
-size_t vector_byte_size(enum VectorElementType element_type,
-                        size_t dimensions) {
-  switch (element_type) {
-  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
-    return dimensions * sizeof(f32);
-  case SQLITE_VEC_ELEMENT_TYPE_INT8:
-    return dimensions * sizeof(i8);
-  case SQLITE_VEC_ELEMENT_TYPE_BIT:
-    return dimensions / CHAR_BIT;
+  if (subtype == SQLITE_VEC_ELEMENT_TYPE_BIT) {
+    int rc = bitvec_from_value(value, (u8 **)vector, dimensions, cleanup,
+                               pzErrorMessage);
+    if (rc == SQLITE_OK) {
+      *element_type = SQLITE_VEC_ELEMENT_TYPE_BIT;
+    }
+    return rc;
   }
-  return 0;
-}
-
-size_t vector_column_byte_size(struct VectorColumnDefinition column) {
-  return vector_byte_size(column.element_type, column.dimensions);
+  if (subtype == SQLITE_VEC_ELEMENT_TYPE_INT8) {
+    int rc = int8_vec_from_value(value, (i8 **)vector, dimensions, cleanup,
+                                 pzErrorMessage);
+    if (rc == SQLITE_OK) {
+      *element_type = SQLITE_VEC_ELEMENT_TYPE_INT8;
+    }
+    return rc;
+  }
+  *pzErrorMessage = sqlite3_mprintf("Unknown subtype: %d", subtype);
+  return SQLITE_ERROR;
 }
 
-#if SQLITE_VEC_ENABLE_RESCORE
 /**
- * @brief Parse rescore options from an "INDEXED BY rescore(...)" clause.
+ * @brief Replace count packed float32 vectors from vector_from_value() with
+ * unit-length copies, for normalize=1 columns. All-zero vectors are left as
+ * zeros.
  *
- * @param scanner Scanner positioned right after the opening '(' of rescore(...)
- * @param outConfig Output rescore config
- * @param pzErr Error message output
- * @return int SQLITE_OK on success, SQLITE_ERROR on error.
+ * The copy is always made, as vector_from_value() may point directly into a
+ * sqlite3_value. On success, the old vector is released and *cleanup is
+ * updated to free the new one.
+ *
+ * @return int SQLITE_OK on success, SQLITE_NOMEM otherwise
  */
-static int vec0_parse_rescore_options(struct Vec0Scanner *scanner,
-                                      struct Vec0RescoreConfig *outConfig,
-                                      char **pzErr) {
-  struct Vec0Token token;
-  int rc;
-  int hasQuantizer = 0;
-  outConfig->oversample = 8;
-  outConfig->quantizer_type = 0;
-
-  while (1) {
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc == VEC0_TOKEN_RESULT_EOF) {
-      break;
-    }
-    // ')' closes rescore options
-    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
-      break;
+static int vector_normalize_f32_rows(void **vector, size_t dimensions,
+                                     size_t count, vector_cleanup *cleanup) {
+  const f32 *v = (const f32 *)*vector;
+  f32 *out = sqlite3_malloc64(count * dimensions * sizeof(f32));
+  if (!out) {
+    return SQLITE_NOMEM;
+  }
+  for (size_t r = 0; r < count; r++) {
+    const f32 *row = v + r * dimensions;
+    f32 norm = 0;
+    for (size_t i = 0; i < dimensions; i++) {
+      norm += row[i] * row[i];
     }
-    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_IDENTIFIER) {
-      *pzErr = sqlite3_mprintf("Expected option name in rescore(...)");
-      return SQLITE_ERROR;
+    f32 scale = norm > 0 ? 1.0f / sqrtf(norm) : 0;
+    for (size_t i = 0; i < dimensions; i++) {
+      out[r * dimensions + i] = row[i] * scale;
     }
+  }
+  (*cleanup)(*vector);
+  *vector = out;
+  *cleanup = sqlite3_free;
+  return SQLITE_OK;
+}
 
-    char *key = token.start;
-    int keyLength = token.end - token.start;
+// vector_normalize_f32_rows() for a single vector.
+static int vector_normalize_f32(void **vector, size_t dimensions,
+                                vector_cleanup *cleanup) {
+  return vector_normalize_f32_rows(vector, dimensions, 1, cleanup);
+}
 
-    // expect '='
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
-      *pzErr = sqlite3_mprintf("Expected '=' after option name in rescore(...)");
-      return SQLITE_ERROR;
-    }
+int ensure_vector_match(sqlite3_value *aValue, sqlite3_value *bValue, void **a,
+                        void **b, enum VectorElementType *element_type,
+                        size_t *dimensions, vector_cleanup *outACleanup,
+                        vector_cleanup *outBCleanup, char **outError) {
+  int rc;
+  enum VectorElementType aType, bType;
+  size_t aDims, bDims;
+  char *error = NULL;
+  vector_cleanup aCleanup, bCleanup;
 
-    // value
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc != VEC0_TOKEN_RESULT_SOME) {
-      *pzErr = sqlite3_mprintf("Expected value after '=' in rescore(...)");
-      return SQLITE_ERROR;
-    }
+  rc = vector_from_value(aValue, a, &aDims, &aType, &aCleanup, &error);
+  if (rc != SQLITE_OK) {
+    *outError = sqlite3_mprintf("Error reading 1st vector: %s", error);
+    sqlite3_free(error);
+    return SQLITE_ERROR;
+  }
 
-    if (sqlite3_strnicmp(key, "quantizer", keyLength) == 0) {
-      if (token.token_type != TOKEN_TYPE_IDENTIFIER) {
-        *pzErr = sqlite3_mprintf("Expected identifier for quantizer value in rescore(...)");
-        return SQLITE_ERROR;
-      }
-      int valLen = token.end - token.start;
-      if (sqlite3_strnicmp(token.start, "bit", valLen) == 0) {
-        outConfig->quantizer_type = VEC0_RESCORE_QUANTIZER_BIT;
-      } else if (sqlite3_strnicmp(token.start, "int8", valLen) == 0) {
-        outConfig->quantizer_type = VEC0_RESCORE_QUANTIZER_INT8;
-      } else {
-        *pzErr = sqlite3_mprintf("Unknown quantizer type '%.*s' in rescore(...). Expected 'bit' or 'int8'.", valLen, token.start);
-        return SQLITE_ERROR;
-      }
-      hasQuantizer = 1;
-    } else if (sqlite3_strnicmp(key, "oversample", keyLength) == 0) {
-      if (token.token_type != TOKEN_TYPE_DIGIT) {
-        *pzErr = sqlite3_mprintf("Expected integer for oversample value in rescore(...)");
-        return SQLITE_ERROR;
-      }
-      outConfig->oversample = atoi(token.start);
-      if (outConfig->oversample <= 0 || outConfig->oversample > 128) {
-        *pzErr = sqlite3_mprintf("oversample in rescore(...) must be between 1 and 128, got %d", outConfig->oversample);
-        return SQLITE_ERROR;
-      }
-    } else {
-      *pzErr = sqlite3_mprintf("Unknown option '%.*s' in rescore(...)", keyLength, key);
-      return SQLITE_ERROR;
-    }
-
-    // optional comma between options
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc == VEC0_TOKEN_RESULT_EOF) {
-      break;
-    }
-    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
-      break;
-    }
-    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_COMMA) {
-      continue;
-    }
-    // If it's not a comma or rparen, it might be the next key — push back isn't
-    // possible with this scanner, so we'll treat unexpected tokens as errors
-    *pzErr = sqlite3_mprintf("Unexpected token in rescore(...) options");
+  rc = vector_from_value(bValue, b, &bDims, &bType, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    *outError = sqlite3_mprintf("Error reading 2nd vector: %s", error);
+    sqlite3_free(error);
+    aCleanup(*a);
     return SQLITE_ERROR;
   }
 
-  if (!hasQuantizer) {
-    *pzErr = sqlite3_mprintf("rescore(...) requires a 'quantizer' option (quantizer=bit or quantizer=int8)");
+  if (aType != bType) {
+    *outError =
+        sqlite3_mprintf("Vector type mistmatch. First vector has type %s, "
+                        "while the second has type %s.",
+                        vector_subtype_name(aType), vector_subtype_name(bType));
+    aCleanup(*a);
+    bCleanup(*b);
     return SQLITE_ERROR;
   }
-
+  if (aDims != bDims) {
+    *outError = sqlite3_mprintf(
+        "Vector dimension mistmatch. First vector has %ld dimensions, "
+        "while the second has %ld dimensions.",
+        aDims, bDims);
+    aCleanup(*a);
+    bCleanup(*b);
+    return SQLITE_ERROR;
+  }
+  *element_type = aType;
+  *dimensions = aDims;
+  *outACleanup = aCleanup;
+  *outBCleanup = bCleanup;
   return SQLITE_OK;
 }
-#endif /* SQLITE_VEC_ENABLE_RESCORE */
 
-/**
- * @brief Parse an vec0 vtab argv[i] column definition and see if
- * it's a vector column defintion, ex `contents_embedding float[768]`.
- *
- * @param source vec0 argv[i] item
- * @param source_length length of source in bytes
- * @param outColumn Output the parse vector column to this struct, if success
- * @return int SQLITE_OK on success, SQLITE_EMPTY is it's not a vector column
- * definition, SQLITE_ERROR on error.
- */
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-// Forward declaration — defined in sqlite-vec-ivf.c
-static int vec0_parse_ivf_options(struct Vec0Scanner *scanner,
-                                   struct Vec0IvfConfig *config);
-#endif
+int _cmp(const void *a, const void *b) { return (*(i64 *)a - *(i64 *)b); }
 
-/**
- * Parse the options inside diskann(...) parentheses.
- * Scanner should be positioned right before the '(' token.
- *
- * Recognized options:
- *   neighbor_quantizer = binary | int8       (required)
- *   n_neighbors = <integer>                  (optional, default 72)
- *   search_list_size = <integer>             (optional, default 128)
- */
-static int vec0_parse_diskann_options(struct Vec0Scanner *scanner,
-                                       struct Vec0DiskannConfig *config) {
+#pragma region scalar functions
+static void vec_f32(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  assert(argc == 1);
   int rc;
-  struct Vec0Token token;
-  int hasQuantizer = 0;
-
-  // Set defaults
-  config->n_neighbors = VEC0_DISKANN_DEFAULT_N_NEIGHBORS;
-  config->search_list_size = VEC0_DISKANN_DEFAULT_SEARCH_LIST_SIZE;
-  config->search_list_size_search = 0;
-  config->search_list_size_insert = 0;
-  config->alpha = VEC0_DISKANN_DEFAULT_ALPHA;
-  config->buffer_threshold = 0;
-  int hasSearchListSize = 0;
-  int hasSearchListSizeSplit = 0;
-
-  // Expect '('
-  rc = vec0_scanner_next(scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_LPAREN) {
-    return SQLITE_ERROR;
+  f32 *vector = NULL;
+  size_t dimensions;
+  fvec_cleanup cleanup;
+  char *errmsg;
+  rc = fvec_from_value(argv[0], &vector, &dimensions, &cleanup, &errmsg);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, errmsg, -1);
+    sqlite3_free(errmsg);
+    return;
   }
+  sqlite3_result_blob(context, vector, dimensions * sizeof(f32),
+                      (void (*)(void *))cleanup);
+  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
+}
 
-  while (1) {
-    // key
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
-      break;  // empty parens or trailing comma
-    }
-    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_IDENTIFIER) {
-      return SQLITE_ERROR;
-    }
-    char *optKey = token.start;
-    int optKeyLen = token.end - token.start;
-
-    // '='
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
-      return SQLITE_ERROR;
-    }
-
-    // value (identifier or digit)
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc != VEC0_TOKEN_RESULT_SOME) {
-      return SQLITE_ERROR;
-    }
-    char *optVal = token.start;
-    int optValLen = token.end - token.start;
-
-    if (sqlite3_strnicmp(optKey, "neighbor_quantizer", optKeyLen) == 0) {
-      if (sqlite3_strnicmp(optVal, "binary", optValLen) == 0) {
-        config->quantizer_type = VEC0_DISKANN_QUANTIZER_BINARY;
-      } else if (sqlite3_strnicmp(optVal, "int8", optValLen) == 0) {
-        config->quantizer_type = VEC0_DISKANN_QUANTIZER_INT8;
-      } else {
-        return SQLITE_ERROR;  // unknown quantizer
-      }
-      hasQuantizer = 1;
-    } else if (sqlite3_strnicmp(optKey, "n_neighbors", optKeyLen) == 0) {
-      config->n_neighbors = atoi(optVal);
-      if (config->n_neighbors <= 0 || (config->n_neighbors % 8) != 0 ||
-          config->n_neighbors > VEC0_DISKANN_MAX_N_NEIGHBORS) {
-        return SQLITE_ERROR;
-      }
-    } else if (sqlite3_strnicmp(optKey, "search_list_size_search", optKeyLen) == 0 && optKeyLen == 23) {
-      config->search_list_size_search = atoi(optVal);
-      if (config->search_list_size_search <= 0) {
-        return SQLITE_ERROR;
-      }
-      hasSearchListSizeSplit = 1;
-    } else if (sqlite3_strnicmp(optKey, "search_list_size_insert", optKeyLen) == 0 && optKeyLen == 23) {
-      config->search_list_size_insert = atoi(optVal);
-      if (config->search_list_size_insert <= 0) {
-        return SQLITE_ERROR;
-      }
-      hasSearchListSizeSplit = 1;
-    } else if (sqlite3_strnicmp(optKey, "search_list_size", optKeyLen) == 0) {
-      config->search_list_size = atoi(optVal);
-      if (config->search_list_size <= 0) {
-        return SQLITE_ERROR;
-      }
-      hasSearchListSize = 1;
-    } else if (sqlite3_strnicmp(optKey, "buffer_threshold", optKeyLen) == 0) {
-      config->buffer_threshold = atoi(optVal);
-      if (config->buffer_threshold < 0) {
-        return SQLITE_ERROR;
-      }
-    } else {
-      return SQLITE_ERROR;  // unknown option
-    }
-
-    // Expect ',' or ')'
-    rc = vec0_scanner_next(scanner, &token);
-    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
-      break;
-    }
-    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_COMMA) {
-      return SQLITE_ERROR;
-    }
+static void vec_bit(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  assert(argc == 1);
+  int rc;
+  u8 *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+  char *errmsg;
+  rc = bitvec_from_value(argv[0], &vector, &dimensions, &cleanup, &errmsg);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, errmsg, -1);
+    sqlite3_free(errmsg);
+    return;
   }
-
-  if (!hasQuantizer) {
-    return SQLITE_ERROR;  // neighbor_quantizer is required
+  sqlite3_result_blob(context, vector, dimensions / CHAR_BIT, SQLITE_TRANSIENT);
+  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_BIT);
+  cleanup(vector);
+}
+static void vec_int8(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  assert(argc == 1);
+  int rc;
+  i8 *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+  char *errmsg;
+  rc = int8_vec_from_value(argv[0], &vector, &dimensions, &cleanup, &errmsg);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, errmsg, -1);
+    sqlite3_free(errmsg);
+    return;
   }
+  sqlite3_result_blob(context, vector, dimensions, SQLITE_TRANSIENT);
+  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
+  cleanup(vector);
+}
 
-  if (hasSearchListSize && hasSearchListSizeSplit) {
-    return SQLITE_ERROR;  // cannot mix search_list_size with search_list_size_search/insert
+static void vec_length(sqlite3_context *context, int argc,
+                       sqlite3_value **argv) {
+  assert(argc == 1);
+  int rc;
+  void *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+  char *errmsg;
+  enum VectorElementType elementType;
+  rc = vector_from_value(argv[0], &vector, &dimensions, &elementType, &cleanup,
+                         &errmsg);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, errmsg, -1);
+    sqlite3_free(errmsg);
+    return;
   }
-
-  return SQLITE_OK;
+  sqlite3_result_int64(context, dimensions);
+  cleanup(vector);
 }
 
-int vec0_parse_vector_column(const char *source, int source_length,
-                        struct VectorColumnDefinition *outColumn) {
-  // parses a vector column definition like so:
-  // "abc float[123]", "abc_123 bit[1234]", eetc.
-  // https://github.com/asg017/sqlite-vec/issues/46
+static void vec_distance_cosine(sqlite3_context *context, int argc,
+                                sqlite3_value **argv) {
+  assert(argc == 2);
   int rc;
-  struct Vec0Scanner scanner;
-  struct Vec0Token token;
-
-  char *name;
-  int nameLength;
+  void *a = NULL, *b = NULL;
+  size_t dimensions;
+  vector_cleanup aCleanup, bCleanup;
+  char *error;
   enum VectorElementType elementType;
-  enum Vec0DistanceMetrics distanceMetric = VEC0_DISTANCE_METRIC_L2;
-  enum Vec0IndexType indexType = VEC0_INDEX_TYPE_FLAT;
-#if SQLITE_VEC_ENABLE_RESCORE
-  struct Vec0RescoreConfig rescoreConfig;
-  memset(&rescoreConfig, 0, sizeof(rescoreConfig));
-#endif
-  struct Vec0IvfConfig ivfConfig;
-  memset(&ivfConfig, 0, sizeof(ivfConfig));
-  struct Vec0DiskannConfig diskannConfig;
-  memset(&diskannConfig, 0, sizeof(diskannConfig));
-  int dimensions;
-  vec0_scanner_init(&scanner, source, source_length);
-
-  // starts with an identifier
-  rc = vec0_scanner_next(&scanner, &token);
+  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
+                           &aCleanup, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, error, -1);
+    sqlite3_free(error);
+    return;
+  }
 
-  if (rc != VEC0_TOKEN_RESULT_SOME &&
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_error(
+        context, "Cannot calculate cosine distance between two bitvectors.",
+        -1);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    f32 result = distance_cosine_float(a, b, &dimensions);
+    sqlite3_result_double(context, result);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    f32 result = distance_cosine_int8(a, b, &dimensions);
+    sqlite3_result_double(context, result);
+    goto finish;
+  }
   }
 
-  name = token.start;
-  nameLength = token.end - token.start;
+finish:
+  aCleanup(a);
+  bCleanup(b);
+  return;
+}
 
-  // vector column type comes next: float, int, or bit
-  rc = vec0_scanner_next(&scanner, &token);
+static void vec_distance_l2(sqlite3_context *context, int argc,
+                            sqlite3_value **argv) {
+  assert(argc == 2);
+  int rc;
+  void *a = NULL, *b = NULL;
+  size_t dimensions;
+  vector_cleanup aCleanup, bCleanup;
+  char *error;
+  enum VectorElementType elementType;
+  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
+                           &aCleanup, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, error, -1);
+    sqlite3_free(error);
+    return;
+  }
 
-  if (rc != VEC0_TOKEN_RESULT_SOME ||
-      token.token_type != TOKEN_TYPE_IDENTIFIER) {
-    return SQLITE_EMPTY;
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_error(
+        context, "Cannot calculate L2 distance between two bitvectors.", -1);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    f32 result = distance_l2_sqr_float(a, b, &dimensions);
+    sqlite3_result_double(context, result);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    f32 result = distance_l2_sqr_int8(a, b, &dimensions);
+    sqlite3_result_double(context, result);
+    goto finish;
   }
-  if (sqlite3_strnicmp(token.start, "float", 5) == 0 ||
-      sqlite3_strnicmp(token.start, "f32", 3) == 0) {
-    elementType = SQLITE_VEC_ELEMENT_TYPE_FLOAT32;
-  } else if (sqlite3_strnicmp(token.start, "int8", 4) == 0 ||
-             sqlite3_strnicmp(token.start, "i8", 2) == 0) {
-    elementType = SQLITE_VEC_ELEMENT_TYPE_INT8;
-  } else if (sqlite3_strnicmp(token.start, "bit", 3) == 0) {
-    elementType = SQLITE_VEC_ELEMENT_TYPE_BIT;
-  } else {
-    return SQLITE_EMPTY;
   }
 
-  // left '[' bracket
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_LBRACKET) {
-    return SQLITE_EMPTY;
+finish:
+  aCleanup(a);
+  bCleanup(b);
+  return;
+}
+
+static void vec_distance_l1(sqlite3_context *context, int argc,
+                            sqlite3_value **argv) {
+  assert(argc == 2);
+  int rc;
+  void *a, *b;
+  size_t dimensions;
+  vector_cleanup aCleanup, bCleanup;
+  char *error;
+  enum VectorElementType elementType;
+  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
+                           &aCleanup, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, error, -1);
+    sqlite3_free(error);
+    return;
   }
 
-  // digit, for vector dimension length
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_DIGIT) {
-    return SQLITE_ERROR;
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_error(
+        context, "Cannot calculate L1 distance between two bitvectors.", -1);
+    goto finish;
   }
-  dimensions = atoi(token.start);
-  if (dimensions <= 0) {
-    return SQLITE_ERROR;
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    double result = distance_l1_f32(a, b, &dimensions);
+    sqlite3_result_double(context, result);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    i64 result = distance_l1_int8(a, b, &dimensions);
+    sqlite3_result_int(context, result);
+    goto finish;
   }
-
-  // // right ']' bracket
-  rc = vec0_scanner_next(&scanner, &token);
-  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_RBRACKET) {
-    return SQLITE_ERROR;
   }
 
-  // any other tokens left should be column-level options , ex `key=value`
-  // ex `distance_metric=L2 distance_metric=cosine` should error
-  while (1) {
-    // should be EOF or identifier (option key)
-    rc = vec0_scanner_next(&scanner, &token);
-    if (rc == VEC0_TOKEN_RESULT_EOF) {
-      break;
-    }
-
-    if (rc != VEC0_TOKEN_RESULT_SOME &&
-        token.token_type != TOKEN_TYPE_IDENTIFIER) {
-      return SQLITE_ERROR;
-    }
+finish:
+  aCleanup(a);
+  bCleanup(b);
+  return;
+}
 
-    char *key = token.start;
-    int keyLength = token.end - token.start;
+static void vec_distance_hamming(sqlite3_context *context, int argc,
+                                 sqlite3_value **argv) {
+  assert(argc == 2);
+  int rc;
+  void *a = NULL, *b = NULL;
+  size_t dimensions;
+  vector_cleanup aCleanup, bCleanup;
+  char *error;
+  enum VectorElementType elementType;
+  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
+                           &aCleanup, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, error, -1);
+    sqlite3_free(error);
+    return;
+  }
 
-    if (sqlite3_strnicmp(key, "distance_metric", keyLength) == 0) {
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_double(context, distance_hamming(a, b, &dimensions));
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    sqlite3_result_error(
+        context,
+        "Cannot calculate hamming distance between two float32 vectors.", -1);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    sqlite3_result_error(
+        context, "Cannot calculate hamming distance between two int8 vectors.",
+        -1);
+    goto finish;
+  }
+  }
 
-      if (elementType == SQLITE_VEC_ELEMENT_TYPE_BIT) {
-        return SQLITE_ERROR;
-      }
-      // ensure equal sign after distance_metric
-      rc = vec0_scanner_next(&scanner, &token);
-      if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_EQ) {
-        return SQLITE_ERROR;
-      }
+finish:
+  aCleanup(a);
+  bCleanup(b);
+  return;
+}
 
-      // distance_metric value, an identifier (L2, cosine, etc)
-      rc = vec0_scanner_next(&scanner, &token);
-      if (rc != VEC0_TOKEN_RESULT_SOME &&
-          token.token_type != TOKEN_TYPE_IDENTIFIER) {
-        return SQLITE_ERROR;
-      }
+char *vec_type_name(enum VectorElementType elementType) {
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
+    return "float32";
+  case SQLITE_VEC_ELEMENT_TYPE_INT8:
+    return "int8";
+  case SQLITE_VEC_ELEMENT_TYPE_BIT:
+    return "bit";
+  }
+  return "";
+}
 
-      char *value = token.start;
-      int valueLength = token.end - token.start;
-      if (sqlite3_strnicmp(value, "l2", valueLength) == 0) {
-        distanceMetric = VEC0_DISTANCE_METRIC_L2;
-      } else if (sqlite3_strnicmp(value, "l1", valueLength) == 0) {
-        distanceMetric = VEC0_DISTANCE_METRIC_L1;
-      } else if (sqlite3_strnicmp(value, "cosine", valueLength) == 0) {
-        distanceMetric = VEC0_DISTANCE_METRIC_COSINE;
-      } else {
-        return SQLITE_ERROR;
-      }
-    }
-    // INDEXED BY flat() | rescore(...)
-    else if (sqlite3_strnicmp(key, "indexed", keyLength) == 0) {
-      // expect "by"
-      rc = vec0_scanner_next(&scanner, &token);
-      if (rc != VEC0_TOKEN_RESULT_SOME ||
-          token.token_type != TOKEN_TYPE_IDENTIFIER ||
-          sqlite3_strnicmp(token.start, "by", token.end - token.start) != 0) {
-        return SQLITE_ERROR;
-      }
-      // expect index type name
-      rc = vec0_scanner_next(&scanner, &token);
-      if (rc != VEC0_TOKEN_RESULT_SOME ||
-          token.token_type != TOKEN_TYPE_IDENTIFIER) {
-        return SQLITE_ERROR;
-      }
-      int indexNameLen = token.end - token.start;
-      if (sqlite3_strnicmp(token.start, "flat", indexNameLen) == 0) {
-        indexType = VEC0_INDEX_TYPE_FLAT;
-        // expect '('
-        rc = vec0_scanner_next(&scanner, &token);
-        if (rc != VEC0_TOKEN_RESULT_SOME ||
-            token.token_type != TOKEN_TYPE_LPAREN) {
-          return SQLITE_ERROR;
-        }
-        // expect ')'
-        rc = vec0_scanner_next(&scanner, &token);
-        if (rc != VEC0_TOKEN_RESULT_SOME ||
-            token.token_type != TOKEN_TYPE_RPAREN) {
-          return SQLITE_ERROR;
-        }
-      }
-#if SQLITE_VEC_ENABLE_RESCORE
-      else if (sqlite3_strnicmp(token.start, "rescore", indexNameLen) == 0) {
-        indexType = VEC0_INDEX_TYPE_RESCORE;
-        if (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
-          return SQLITE_ERROR;
-        }
-        // expect '('
-        rc = vec0_scanner_next(&scanner, &token);
-        if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_LPAREN) {
-          return SQLITE_ERROR;
-        }
-        char *rescoreErr = NULL;
-        rc = vec0_parse_rescore_options(&scanner, &rescoreConfig, &rescoreErr);
-        if (rc != SQLITE_OK) {
-          if (rescoreErr) sqlite3_free(rescoreErr);
-          return SQLITE_ERROR;
-        }
-        // validate dimensions for bit quantizer
-        if (rescoreConfig.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT &&
-            (dimensions % CHAR_BIT) != 0) {
-          return SQLITE_ERROR;
-        }
-      }
-#endif
-      else if (sqlite3_strnicmp(token.start, "ivf", indexNameLen) == 0) {
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-        indexType = VEC0_INDEX_TYPE_IVF;
-        memset(&ivfConfig, 0, sizeof(ivfConfig));
-        rc = vec0_parse_ivf_options(&scanner, &ivfConfig);
-        if (rc != SQLITE_OK) {
-          return SQLITE_ERROR;
-        }
-        if (ivfConfig.quantizer == VEC0_IVF_QUANTIZER_BINARY && (dimensions % 8) != 0) {
-          return SQLITE_ERROR;
-        }
-#else
-        return SQLITE_ERROR; // IVF not compiled in
-#endif
-      } else if (sqlite3_strnicmp(token.start, "diskann", indexNameLen) == 0) {
-#if SQLITE_VEC_ENABLE_DISKANN
-        indexType = VEC0_INDEX_TYPE_DISKANN;
-        rc = vec0_parse_diskann_options(&scanner, &diskannConfig);
-        if (rc != SQLITE_OK) {
-          return rc;
-        }
-#else
-        return SQLITE_ERROR;
-#endif
-      } else {
-        // unknown index type
-        return SQLITE_ERROR;
-      }
-    }
-    // unknown key
-    else {
-      return SQLITE_ERROR;
-    }
-  }
-
-  outColumn->name = sqlite3_mprintf("%.*s", nameLength, name);
-  if (!outColumn->name) {
-    return SQLITE_ERROR;
-  }
-  outColumn->name_length = nameLength;
-  outColumn->distance_metric = distanceMetric;
-  outColumn->element_type = elementType;
-  outColumn->dimensions = dimensions;
-  outColumn->index_type = indexType;
-#if SQLITE_VEC_ENABLE_RESCORE
-  outColumn->rescore = rescoreConfig;
-#endif
-  outColumn->ivf = ivfConfig;
-  outColumn->diskann = diskannConfig;
-  return SQLITE_OK;
-}
-
-#pragma region vec_each table function
-
-typedef struct vec_each_vtab vec_each_vtab;
-struct vec_each_vtab {
-  sqlite3_vtab base;
-};
-
-typedef struct vec_each_cursor vec_each_cursor;
-struct vec_each_cursor {
-  sqlite3_vtab_cursor base;
-  i64 iRowid;
-  enum VectorElementType vector_type;
+static void vec_type(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  assert(argc == 1);
   void *vector;
   size_t dimensions;
   vector_cleanup cleanup;
-};
-
-static int vec_eachConnect(sqlite3 *db, void *pAux, int argc,
-                           const char *const *argv, sqlite3_vtab **ppVtab,
-                           char **pzErr) {
-  UNUSED_PARAMETER(pAux);
-  UNUSED_PARAMETER(argc);
-  UNUSED_PARAMETER(argv);
-  UNUSED_PARAMETER(pzErr);
-  vec_each_vtab *pNew;
-  int rc;
-
-  rc = sqlite3_declare_vtab(db, "CREATE TABLE x(value, vector hidden)");
-#define VEC_EACH_COLUMN_VALUE 0
-#define VEC_EACH_COLUMN_VECTOR 1
-  if (rc == SQLITE_OK) {
-    pNew = sqlite3_malloc(sizeof(*pNew));
-    *ppVtab = (sqlite3_vtab *)pNew;
-    if (pNew == 0)
-      return SQLITE_NOMEM;
-    memset(pNew, 0, sizeof(*pNew));
+  char *pzError;
+  enum VectorElementType elementType;
+  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
+                             &cleanup, &pzError);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, pzError, -1);
+    sqlite3_free(pzError);
+    return;
   }
-  return rc;
-}
-
-static int vec_eachDisconnect(sqlite3_vtab *pVtab) {
-  vec_each_vtab *p = (vec_each_vtab *)pVtab;
-  sqlite3_free(p);
-  return SQLITE_OK;
+  sqlite3_result_text(context, vec_type_name(elementType), -1, SQLITE_STATIC);
+  cleanup(vector);
 }
+static void vec_quantize_binary(sqlite3_context *context, int argc,
+                                sqlite3_value **argv) {
+  assert(argc == 1);
+  void *vector;
+  size_t dimensions;
+  vector_cleanup vectorCleanup;
+  char *pzError;
+  enum VectorElementType elementType;
+  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
+                             &vectorCleanup, &pzError);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, pzError, -1);
+    sqlite3_free(pzError);
+    return;
+  }
 
-static int vec_eachOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
-  UNUSED_PARAMETER(p);
-  vec_each_cursor *pCur;
-  pCur = sqlite3_malloc(sizeof(*pCur));
-  if (pCur == 0)
-    return SQLITE_NOMEM;
-  memset(pCur, 0, sizeof(*pCur));
-  *ppCursor = &pCur->base;
-  return SQLITE_OK;
-}
+  if (dimensions <= 0) {
+    sqlite3_result_error(context, "Zero length vectors are not supported.", -1);
+    goto cleanup;
+    return;
+  }
+  if ((dimensions % CHAR_BIT) != 0) {
+    sqlite3_result_error(
+        context,
+        "Binary quantization requires vectors with a length divisible by 8",
+        -1);
+    goto cleanup;
+    return;
+  }
 
-static int vec_eachClose(sqlite3_vtab_cursor *cur) {
-  vec_each_cursor *pCur = (vec_each_cursor *)cur;
-  if(pCur->vector) {
-    pCur->cleanup(pCur->vector);
+  int sz = dimensions / CHAR_BIT;
+  u8 *out = sqlite3_malloc(sz);
+  if (!out) {
+    sqlite3_result_error_code(context, SQLITE_NOMEM);
+    goto cleanup;
+    return;
   }
-  sqlite3_free(pCur);
-  return SQLITE_OK;
-}
+  memset(out, 0, sz);
 
-static int vec_eachBestIndex(sqlite3_vtab *pVTab,
-                             sqlite3_index_info *pIdxInfo) {
-  UNUSED_PARAMETER(pVTab);
-  int hasVector = 0;
-  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
-    // printf("i=%d iColumn=%d, op=%d, usable=%d\n", i, pCons->iColumn,
-    // pCons->op, pCons->usable);
-    switch (pCons->iColumn) {
-    case VEC_EACH_COLUMN_VECTOR: {
-      if (pCons->op == SQLITE_INDEX_CONSTRAINT_EQ && pCons->usable) {
-        hasVector = 1;
-        pIdxInfo->aConstraintUsage[i].argvIndex = 1;
-        pIdxInfo->aConstraintUsage[i].omit = 1;
-      }
-      break;
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+
+    for (size_t i = 0; i < dimensions; i++) {
+      int res = ((f32 *)vector)[i] > 0.0;
+      out[i / 8] |= (res << (i % 8));
     }
+    break;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    for (size_t i = 0; i < dimensions; i++) {
+      int res = ((i8 *)vector)[i] > 0;
+      out[i / 8] |= (res << (i % 8));
     }
+    break;
   }
-  if (!hasVector) {
-    return SQLITE_CONSTRAINT;
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_error(context,
+                         "Can only binary quantize float or int8 vectors", -1);
+    sqlite3_free(out);
+    return;
   }
+  }
+  sqlite3_result_blob(context, out, sz, sqlite3_free);
+  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_BIT);
 
-  pIdxInfo->estimatedCost = (double)100000;
-  pIdxInfo->estimatedRows = 100000;
-
-  return SQLITE_OK;
+cleanup:
+  vectorCleanup(vector);
 }
 
-static int vec_eachFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
-                          const char *idxStr, int argc, sqlite3_value **argv) {
-  UNUSED_PARAMETER(idxNum);
-  UNUSED_PARAMETER(idxStr);
-  assert(argc == 1);
-  vec_each_cursor *pCur = (vec_each_cursor *)pVtabCursor;
-
-  if (pCur->vector) {
-    pCur->cleanup(pCur->vector);
-    pCur->vector = NULL;
+static void vec_quantize_int8(sqlite3_context *context, int argc,
+                              sqlite3_value **argv) {
+  assert(argc == 2);
+  f32 *srcVector;
+  size_t dimensions;
+  fvec_cleanup srcCleanup;
+  char *err;
+  i8 *out = NULL;
+  int rc = fvec_from_value(argv[0], &srcVector, &dimensions, &srcCleanup, &err);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, err, -1);
+    sqlite3_free(err);
+    return;
   }
 
-  char *pzErrMsg;
-  int rc = vector_from_value(argv[0], &pCur->vector, &pCur->dimensions,
-                             &pCur->vector_type, &pCur->cleanup, &pzErrMsg);
-  if (rc != SQLITE_OK) {
-    sqlite3_free(pzErrMsg);
-    return SQLITE_ERROR;
+  int sz = dimensions * sizeof(i8);
+  out = sqlite3_malloc(sz);
+  if (!out) {
+    sqlite3_result_error_nomem(context);
+    goto cleanup;
   }
-  pCur->iRowid = 0;
-  return SQLITE_OK;
-}
+  memset(out, 0, sz);
 
-static int vec_eachRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
-  vec_each_cursor *pCur = (vec_each_cursor *)cur;
-  *pRowid = pCur->iRowid;
-  return SQLITE_OK;
-}
+  if ((sqlite3_value_type(argv[1]) != SQLITE_TEXT) ||
+      (sqlite3_value_bytes(argv[1]) != strlen("unit")) ||
+      (sqlite3_stricmp((const char *)sqlite3_value_text(argv[1]), "unit") !=
+       0)) {
+    sqlite3_result_error(
+        context, "2nd argument to vec_quantize_int8() must be 'unit'.", -1);
+    sqlite3_free(out);
+    goto cleanup;
+  }
+  f32 step = (1.0 - (-1.0)) / 255;
+  for (size_t i = 0; i < dimensions; i++) {
+    double val = ((srcVector[i] - (-1.0)) / step) - 128;
+    if (!(val <= 127.0)) val = 127.0;   /* also clamps NaN */
+    if (!(val >= -128.0)) val = -128.0;
+    out[i] = (i8)val;
+  }
 
-static int vec_eachEof(sqlite3_vtab_cursor *cur) {
-  vec_each_cursor *pCur = (vec_each_cursor *)cur;
-  return pCur->iRowid >= (i64)pCur->dimensions;
-}
+  sqlite3_result_blob(context, out, dimensions * sizeof(i8), sqlite3_free);
+  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
 
-static int vec_eachNext(sqlite3_vtab_cursor *cur) {
-  vec_each_cursor *pCur = (vec_each_cursor *)cur;
-  pCur->iRowid++;
-  return SQLITE_OK;
+cleanup:
+  srcCleanup(srcVector);
 }
 
-static int vec_eachColumn(sqlite3_vtab_cursor *cur, sqlite3_context *context,
-                          int i) {
-  vec_each_cursor *pCur = (vec_each_cursor *)cur;
-  switch (i) {
-  case VEC_EACH_COLUMN_VALUE:
-    switch (pCur->vector_type) {
-    case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-      sqlite3_result_double(context, ((f32 *)pCur->vector)[pCur->iRowid]);
-      break;
+static void vec_add(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  assert(argc == 2);
+  int rc;
+  void *a = NULL, *b = NULL;
+  size_t dimensions;
+  vector_cleanup aCleanup, bCleanup;
+  char *error;
+  enum VectorElementType elementType;
+  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
+                           &aCleanup, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, error, -1);
+    sqlite3_free(error);
+    return;
+  }
+
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_error(context, "Cannot add two bitvectors together.", -1);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    size_t outSize = dimensions * sizeof(f32);
+    f32 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      goto finish;
     }
-    case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-      u8 x = ((u8 *)pCur->vector)[pCur->iRowid / CHAR_BIT];
-      sqlite3_result_int(context,
-                         (x & (0b10000000 >> ((pCur->iRowid % CHAR_BIT)))) > 0);
-      break;
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < dimensions; i++) {
+      out[i] = ((f32 *)a)[i] + ((f32 *)b)[i];
     }
-    case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-      sqlite3_result_int(context, ((i8 *)pCur->vector)[pCur->iRowid]);
-      break;
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    size_t outSize = dimensions * sizeof(i8);
+    i8 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      goto finish;
     }
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < dimensions; i++) {
+      out[i] = ((i8 *)a)[i] + ((i8 *)b)[i];
     }
-
-    break;
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
+    goto finish;
   }
-  return SQLITE_OK;
+  }
+finish:
+  aCleanup(a);
+  bCleanup(b);
+  return;
 }
+static void vec_sub(sqlite3_context *context, int argc, sqlite3_value **argv) {
+  assert(argc == 2);
+  int rc;
+  void *a = NULL, *b = NULL;
+  size_t dimensions;
+  vector_cleanup aCleanup, bCleanup;
+  char *error;
+  enum VectorElementType elementType;
+  rc = ensure_vector_match(argv[0], argv[1], &a, &b, &elementType, &dimensions,
+                           &aCleanup, &bCleanup, &error);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, error, -1);
+    sqlite3_free(error);
+    return;
+  }
 
-static sqlite3_module vec_eachModule = {
-    /* iVersion    */ 0,
-    /* xCreate     */ 0,
-    /* xConnect    */ vec_eachConnect,
-    /* xBestIndex  */ vec_eachBestIndex,
-    /* xDisconnect */ vec_eachDisconnect,
-    /* xDestroy    */ 0,
-    /* xOpen       */ vec_eachOpen,
-    /* xClose      */ vec_eachClose,
-    /* xFilter     */ vec_eachFilter,
-    /* xNext       */ vec_eachNext,
-    /* xEof        */ vec_eachEof,
-    /* xColumn     */ vec_eachColumn,
-    /* xRowid      */ vec_eachRowid,
-    /* xUpdate     */ 0,
-    /* xBegin      */ 0,
-    /* xSync       */ 0,
-    /* xCommit     */ 0,
-    /* xRollback   */ 0,
-    /* xFindMethod */ 0,
-    /* xRename     */ 0,
-    /* xSavepoint  */ 0,
-    /* xRelease    */ 0,
-    /* xRollbackTo */ 0,
-    /* xShadowName */ 0,
-#if SQLITE_VERSION_NUMBER >= 3044000
-    /* xIntegrity  */ 0
-#endif
-};
-
-#pragma endregion
-
-
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    sqlite3_result_error(context, "Cannot subtract two bitvectors together.",
+                         -1);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    size_t outSize = dimensions * sizeof(f32);
+    f32 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      goto finish;
+    }
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < dimensions; i++) {
+      out[i] = ((f32 *)a)[i] - ((f32 *)b)[i];
+    }
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
+    goto finish;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    size_t outSize = dimensions * sizeof(i8);
+    i8 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      goto finish;
+    }
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < dimensions; i++) {
+      out[i] = ((i8 *)a)[i] - ((i8 *)b)[i];
+    }
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
+    goto finish;
+  }
+  }
+finish:
+  aCleanup(a);
+  bCleanup(b);
+  return;
+}
+static void vec_slice(sqlite3_context *context, int argc,
+                      sqlite3_value **argv) {
+  assert(argc == 3);
 
-#pragma region vec0 virtual table
+  void *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+  char *err;
+  enum VectorElementType elementType;
 
-#define VEC0_COLUMN_ID 0
-#define VEC0_COLUMN_USERN_START 1
-#define VEC0_COLUMN_OFFSET_COMMAND 1
-#define VEC0_COLUMN_OFFSET_DISTANCE 2
-#define VEC0_COLUMN_OFFSET_K 3
+  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
+                             &cleanup, &err);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, err, -1);
+    sqlite3_free(err);
+    return;
+  }
 
-#define VEC0_SHADOW_INFO_NAME "\"%w\".\"%w_info\""
+  int start = sqlite3_value_int(argv[1]);
+  int end = sqlite3_value_int(argv[2]);
 
-#define VEC0_SHADOW_CHUNKS_NAME "\"%w\".\"%w_chunks\""
-/// 1) schema, 2) original vtab table name
-#define VEC0_SHADOW_CHUNKS_CREATE                                              \
-  "CREATE TABLE " VEC0_SHADOW_CHUNKS_NAME "("                                  \
-  "chunk_id INTEGER PRIMARY KEY AUTOINCREMENT,"                                \
-  "size INTEGER NOT NULL,"                                                     \
-  "validity BLOB NOT NULL,"                                                    \
-  "rowids BLOB NOT NULL"                                                       \
-  ");"
-
-#define VEC0_SHADOW_ROWIDS_NAME "\"%w\".\"%w_rowids\""
-/// 1) schema, 2) original vtab table name
-#define VEC0_SHADOW_ROWIDS_CREATE_BASIC                                        \
-  "CREATE TABLE " VEC0_SHADOW_ROWIDS_NAME "("                                  \
-  "rowid INTEGER PRIMARY KEY AUTOINCREMENT,"                                   \
-  "id,"                                                                        \
-  "chunk_id INTEGER,"                                                          \
-  "chunk_offset INTEGER"                                                       \
-  ");"
-
-// vec0 tables with a text primary keys are still backed by int64 primary keys,
-// since a fixed-length rowid is required for vec0 chunks. But we add a new 'id
-// text unique' column to emulate a text primary key interface.
-#define VEC0_SHADOW_ROWIDS_CREATE_PK_TEXT                                      \
-  "CREATE TABLE " VEC0_SHADOW_ROWIDS_NAME "("                                  \
-  "rowid INTEGER PRIMARY KEY AUTOINCREMENT,"                                   \
-  "id TEXT UNIQUE NOT NULL,"                                                   \
-  "chunk_id INTEGER,"                                                          \
-  "chunk_offset INTEGER"                                                       \
-  ");"
+  if (start < 0) {
+    sqlite3_result_error(context,
+                         "slice 'start' index must be a postive number.", -1);
+    goto done;
+  }
+  if (end < 0) {
+    sqlite3_result_error(context, "slice 'end' index must be a postive number.",
+                         -1);
+    goto done;
+  }
+  if (((size_t)start) > dimensions) {
+    sqlite3_result_error(
+        context, "slice 'start' index is greater than the number of dimensions",
+        -1);
+    goto done;
+  }
+  if (((size_t)end) > dimensions) {
+    sqlite3_result_error(
+        context, "slice 'end' index is greater than the number of dimensions",
+        -1);
+    goto done;
+  }
+  if (start > end) {
+    sqlite3_result_error(context,
+                         "slice 'start' index is greater than 'end' index", -1);
+    goto done;
+  }
+  if (start == end) {
+    sqlite3_result_error(context,
+                         "slice 'start' index is equal to the 'end' index, "
+                         "vectors must have non-zero length",
+                         -1);
+    goto done;
+  }
+  size_t n = end - start;
 
-/// 1) schema, 2) original vtab table name
-#define VEC0_SHADOW_VECTOR_N_NAME "\"%w\".\"%w_vector_chunks%02d\""
+  switch (elementType) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    int outSize = n * sizeof(f32);
+    f32 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      goto done;
+    }
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < n; i++) {
+      out[i] = ((f32 *)vector)[start + i];
+    }
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
+    goto done;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    int outSize = n * sizeof(i8);
+    i8 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < n; i++) {
+      out[i] = ((i8 *)vector)[start + i];
+    }
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_INT8);
+    goto done;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+    if ((start % CHAR_BIT) != 0) {
+      sqlite3_result_error(context, "start index must be divisible by 8.", -1);
+      goto done;
+    }
+    if ((end % CHAR_BIT) != 0) {
+      sqlite3_result_error(context, "end index must be divisible by 8.", -1);
+      goto done;
+    }
+    int outSize = n / CHAR_BIT;
+    u8 *out = sqlite3_malloc(outSize);
+    if (!out) {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    memset(out, 0, outSize);
+    for (size_t i = 0; i < n / CHAR_BIT; i++) {
+      out[i] = ((u8 *)vector)[(start / CHAR_BIT) + i];
+    }
+    sqlite3_result_blob(context, out, outSize, sqlite3_free);
+    sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_BIT);
+    goto done;
+  }
+  }
+done:
+  cleanup(vector);
+}
 
-/// 1) schema, 2) original vtab table name
-//
-// IMPORTANT: "rowid" is declared as PRIMARY KEY but WITHOUT the INTEGER type.
-// This means it is NOT a true SQLite rowid alias — the user-defined "rowid"
-// column and the internal SQLite rowid (_rowid_) are two separate values.
-// When inserting, both must be set explicitly to keep them in sync. See the
-// _rowid_ bindings in vec0_new_chunk() and the explanation in
-// SHADOW_TABLE_ROWID_QUIRK below.
-#define VEC0_SHADOW_VECTOR_N_CREATE                                            \
-  "CREATE TABLE " VEC0_SHADOW_VECTOR_N_NAME "("                                \
-  "rowid PRIMARY KEY,"                                                         \
-  "vectors BLOB NOT NULL"                                                      \
-  ");"
+static void vec_to_json(sqlite3_context *context, int argc,
+                        sqlite3_value **argv) {
+  assert(argc == 1);
+  void *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+  char *err;
+  enum VectorElementType elementType;
 
-#define VEC0_SHADOW_AUXILIARY_NAME "\"%w\".\"%w_auxiliary\""
+  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
+                             &cleanup, &err);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, err, -1);
+    sqlite3_free(err);
+    return;
+  }
 
-#define VEC0_SHADOW_METADATA_N_NAME "\"%w\".\"%w_metadatachunks%02d\""
-#define VEC0_SHADOW_VECTORS_N_NAME "\"%w\".\"%w_vectors%02d\""
-#define VEC0_SHADOW_DISKANN_NODES_N_NAME "\"%w\".\"%w_diskann_nodes%02d\""
-#define VEC0_SHADOW_DISKANN_BUFFER_N_NAME "\"%w\".\"%w_diskann_buffer%02d\""
-#define VEC0_SHADOW_METADATA_TEXT_DATA_NAME "\"%w\".\"%w_metadatatext%02d\""
+  sqlite3_str *str = sqlite3_str_new(sqlite3_context_db_handle(context));
+  sqlite3_str_appendall(str, "[");
+  for (size_t i = 0; i < dimensions; i++) {
+    if (i != 0) {
+      sqlite3_str_appendall(str, ",");
+    }
+    if (elementType == SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+      f32 value = ((f32 *)vector)[i];
+      if (isnan(value)) {
+        sqlite3_str_appendall(str, "null");
+      } else {
+        sqlite3_str_appendf(str, "%f", value);
+      }
 
-#define VEC_INTERAL_ERROR "Internal sqlite-vec error: "
-#define REPORT_URL "https://github.com/asg017/sqlite-vec/issues/new"
+    } else if (elementType == SQLITE_VEC_ELEMENT_TYPE_INT8) {
+      sqlite3_str_appendf(str, "%d", ((i8 *)vector)[i]);
+    } else if (elementType == SQLITE_VEC_ELEMENT_TYPE_BIT) {
+      u8 b = (((u8 *)vector)[i / 8] >> (i % CHAR_BIT)) & 1;
+      sqlite3_str_appendf(str, "%d", b);
+    }
+  }
+  sqlite3_str_appendall(str, "]");
+  int len = sqlite3_str_length(str);
+  char *s = sqlite3_str_finish(str);
+  if (s) {
+    sqlite3_result_text(context, s, len, sqlite3_free);
+    sqlite3_result_subtype(context, JSON_SUBTYPE);
+  } else {
+    sqlite3_result_error_nomem(context);
+  }
+  cleanup(vector);
+}
 
-typedef struct vec0_vtab vec0_vtab;
+static void vec_normalize(sqlite3_context *context, int argc,
+                          sqlite3_value **argv) {
+  assert(argc == 1);
+  void *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+  char *err;
+  enum VectorElementType elementType;
 
-#define VEC0_MAX_VECTOR_COLUMNS   16
-#define VEC0_MAX_PARTITION_COLUMNS 4
-#define VEC0_MAX_AUXILIARY_COLUMNS 16
-#define VEC0_MAX_METADATA_COLUMNS 16
+  int rc = vector_from_value(argv[0], &vector, &dimensions, &elementType,
+                             &cleanup, &err);
+  if (rc != SQLITE_OK) {
+    sqlite3_result_error(context, err, -1);
+    sqlite3_free(err);
+    return;
+  }
 
-#define SQLITE_VEC_VEC0_MAX_DIMENSIONS 8192
-#define VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH 16
-#define VEC0_METADATA_TEXT_VIEW_DATA_LENGTH 12
+  if (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+    sqlite3_result_error(
+        context, "only float32 vectors are supported when normalizing", -1);
+    cleanup(vector);
+    return;
+  }
 
-typedef enum {
-  // vector column, ie "contents_embedding float[1024]"
-  SQLITE_VEC0_USER_COLUMN_KIND_VECTOR = 1,
+  int outSize = dimensions * sizeof(f32);
+  f32 *out = sqlite3_malloc(outSize);
+  if (!out) {
+    cleanup(vector);
+    sqlite3_result_error_code(context, SQLITE_NOMEM);
+    return;
+  }
+  memset(out, 0, outSize);
 
-  // partition key column, ie "user_id integer partition key"
-  SQLITE_VEC0_USER_COLUMN_KIND_PARTITION = 2,
+  f32 *v = (f32 *)vector;
 
-  //
-  SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY = 3,
+  f32 norm = 0;
+  for (size_t i = 0; i < dimensions; i++) {
+    norm += v[i] * v[i];
+  }
+  norm = sqrt(norm);
+  for (size_t i = 0; i < dimensions; i++) {
+    out[i] = v[i] / norm;
+  }
 
-  // metadata column that can be filtered, ie "genre text"
-  SQLITE_VEC0_USER_COLUMN_KIND_METADATA = 4,
-} vec0_user_column_kind;
+  sqlite3_result_blob(context, out, dimensions * sizeof(f32), sqlite3_free);
+  sqlite3_result_subtype(context, SQLITE_VEC_ELEMENT_TYPE_FLOAT32);
+  cleanup(vector);
+}
 
-struct vec0_vtab {
-  sqlite3_vtab base;
+static void _static_text_func(sqlite3_context *context, int argc,
+                              sqlite3_value **argv) {
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+  sqlite3_result_text(context, sqlite3_user_data(context), -1, SQLITE_STATIC);
+}
 
-  // the SQLite connection of the host database
-  sqlite3 *db;
+#pragma endregion
 
-  // True if the primary key of the vec0 table has a column type TEXT.
-  // Will change the schema of the _rowids table, and insert/query logic.
-  int pkIsText;
+enum Vec0TokenType {
+  TOKEN_TYPE_IDENTIFIER,
+  TOKEN_TYPE_DIGIT,
+  TOKEN_TYPE_LBRACKET,
+  TOKEN_TYPE_RBRACKET,
+  TOKEN_TYPE_PLUS,
+  TOKEN_TYPE_EQ,
+  TOKEN_TYPE_LPAREN,
+  TOKEN_TYPE_RPAREN,
+  TOKEN_TYPE_COMMA,
+};
+struct Vec0Token {
+  enum Vec0TokenType token_type;
+  char *start;
+  char *end;
+};
 
-  // True if the hidden command column (named after the table) exists.
-  // Tables created before v0.1.10 or without _info table don't have it.
-  int hasCommandColumn;
+int is_alpha(char x) {
+  return (x >= 'a' && x <= 'z') || (x >= 'A' && x <= 'Z');
+}
+int is_digit(char x) { return (x >= '0' && x <= '9'); }
+int is_whitespace(char x) {
+  return x == ' ' || x == '\t' || x == '\n' || x == '\r';
+}
 
-  // number of defined vector columns.
-  int numVectorColumns;
+#define VEC0_TOKEN_RESULT_EOF 1
+#define VEC0_TOKEN_RESULT_SOME 2
+#define VEC0_TOKEN_RESULT_ERROR 3
 
-  // number of defined PARTITION KEY columns.
-  int numPartitionColumns;
+int vec0_token_next(char *start, char *end, struct Vec0Token *out) {
+  char *ptr = start;
+  while (ptr < end) {
+    char curr = *ptr;
+    if (is_whitespace(curr)) {
+      ptr++;
+      continue;
+    } else if (curr == '+') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_PLUS;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (curr == '[') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_LBRACKET;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (curr == ']') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_RBRACKET;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (curr == '=') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_EQ;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (curr == '(') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_LPAREN;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (curr == ')') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_RPAREN;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (curr == ',') {
+      ptr++;
+      out->start = ptr;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_COMMA;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (is_alpha(curr)) {
+      char *start = ptr;
+      while (ptr < end && (is_alpha(*ptr) || is_digit(*ptr) || *ptr == '_')) {
+        ptr++;
+      }
+      out->start = start;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_IDENTIFIER;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else if (is_digit(curr)) {
+      char *start = ptr;
+      while (ptr < end && (is_digit(*ptr))) {
+        ptr++;
+      }
+      out->start = start;
+      out->end = ptr;
+      out->token_type = TOKEN_TYPE_DIGIT;
+      return VEC0_TOKEN_RESULT_SOME;
+    } else {
+      return VEC0_TOKEN_RESULT_ERROR;
+    }
+  }
+  return VEC0_TOKEN_RESULT_EOF;
+}
 
-  // number of defined auxiliary columns
-  int numAuxiliaryColumns;
+struct Vec0Scanner {
+  char *start;
+  char *end;
+  char *ptr;
+};
 
-  // number of defined metadata columns
-  int numMetadataColumns;
+void vec0_scanner_init(struct Vec0Scanner *scanner, const char *source,
+                       int source_length) {
+  scanner->start = (char *)source;
+  scanner->end = (char *)source + source_length;
+  scanner->ptr = (char *)source;
+}
+int vec0_scanner_next(struct Vec0Scanner *scanner, struct Vec0Token *out) {
+  int rc = vec0_token_next(scanner->start, scanner->end, out);
+  if (rc == VEC0_TOKEN_RESULT_SOME) {
+    scanner->start = out->end;
+  }
+  return rc;
+}
 
+int vec0_parse_table_option(const char *source, int source_length,
+                            char **out_key, int *out_key_length,
+                            char **out_value, int *out_value_length) {
+  int rc;
+  struct Vec0Scanner scanner;
+  struct Vec0Token token;
+  char *key;
+  char *value;
+  int keyLength, valueLength;
 
-  // Name of the schema the table exists on.
-  // Must be freed with sqlite3_free()
-  char *schemaName;
+  vec0_scanner_init(&scanner, source, source_length);
 
-  // Name of the table the table exists on.
-  // Must be freed with sqlite3_free()
-  char *tableName;
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  key = token.start;
+  keyLength = token.end - token.start;
 
-  // Name of the _rowids shadow table.
-  // Must be freed with sqlite3_free()
-  char *shadowRowidsName;
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_EQ) {
+    return SQLITE_EMPTY;
+  }
 
-  // Name of the _chunks shadow table.
-  // Must be freed with sqlite3_free()
-  char *shadowChunksName;
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      !((token.token_type == TOKEN_TYPE_IDENTIFIER) ||
+        (token.token_type == TOKEN_TYPE_DIGIT))) {
+    return SQLITE_ERROR;
+  }
+  value = token.start;
+  valueLength = token.end - token.start;
 
-  // contains enum vec0_user_column_kind values for up to
-  // numVectorColumns + numPartitionColumns entries
-  vec0_user_column_kind user_column_kinds[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc == VEC0_TOKEN_RESULT_EOF) {
+    *out_key = key;
+    *out_key_length = keyLength;
+    *out_value = value;
+    *out_value_length = valueLength;
+    return SQLITE_OK;
+  }
+  return SQLITE_ERROR;
+}
+/**
+ * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
+ * it's a PARTITION KEY definition.
+ *
+ * @param source: argv[i] source string
+ * @param source_length: length of the source string
+ * @param out_column_name: If it is a partition key, the output column name. Same lifetime
+ * as source, points to specific char *
+ * @param out_column_name_length: Length of out_column_name in bytes
+ * @param out_column_type: SQLITE_TEXT or SQLITE_INTEGER.
+ * @return int: SQLITE_EMPTY if not a PK, SQLITE_OK if it is.
+ */
+int vec0_parse_partition_key_definition(const char *source, int source_length,
+                                 char **out_column_name,
+                                 int *out_column_name_length,
+                                 int *out_column_type) {
+  struct Vec0Scanner scanner;
+  struct Vec0Token token;
+  char *column_name;
+  int column_name_length;
+  int column_type;
+  vec0_scanner_init(&scanner, source, source_length);
 
-  uint8_t user_column_idxs[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+  // Check first token is identifier, will be the column name
+  int rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
 
+  column_name = token.start;
+  column_name_length = token.end - token.start;
 
-  // Name of all the vector chunk shadow tables.
-  // Ex '_vector_chunks00'
-  // Only the first numVectorColumns entries will be available.
-  // The first numVectorColumns entries must be freed with sqlite3_free()
-  char *shadowVectorChunksNames[VEC0_MAX_VECTOR_COLUMNS];
+  // Check the next token matches "text" or "integer", as column type
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "text", token.end - token.start) == 0) {
+    column_type = SQLITE_TEXT;
+  } else if (sqlite3_strnicmp(token.start, "int", token.end - token.start) ==
+                 0 ||
+             sqlite3_strnicmp(token.start, "integer",
+                              token.end - token.start) == 0) {
+    column_type = SQLITE_INTEGER;
+  } else {
+    return SQLITE_EMPTY;
+  }
 
-#if SQLITE_VEC_ENABLE_RESCORE
-  // Name of all rescore chunk shadow tables, ie `_rescore_chunks00`
-  // Only populated for vector columns with rescore enabled.
-  // Must be freed with sqlite3_free()
-  char *shadowRescoreChunksNames[VEC0_MAX_VECTOR_COLUMNS];
+  // Check the next token is identifier and matches "partition"
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "partition", token.end - token.start) != 0) {
+    return SQLITE_EMPTY;
+  }
 
-  // Name of all rescore vector shadow tables, ie `_rescore_vectors00`
-  // Rowid-keyed table for fast random-access float vector reads during rescore.
-  // Only populated for vector columns with rescore enabled.
-  // Must be freed with sqlite3_free()
-  char *shadowRescoreVectorsNames[VEC0_MAX_VECTOR_COLUMNS];
+  // Check the next token is identifier and matches "key"
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "key", token.end - token.start) != 0) {
+    return SQLITE_EMPTY;
+  }
+
+  *out_column_name = column_name;
+  *out_column_name_length = column_name_length;
+  *out_column_type = column_type;
+
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
+ * it's an auxiliar column definition, ie `+[name] [type]` like `+contents text`
+ *
+ * @param source: argv[i] source string
+ * @param source_length: length of the source string
+ * @param out_column_name: If it is a partition key, the output column name. Same lifetime
+ * as source, points to specific char *
+ * @param out_column_name_length: Length of out_column_name in bytes
+ * @param out_column_type: SQLITE_TEXT, SQLITE_INTEGER, SQLITE_FLOAT, or SQLITE_BLOB.
+ * @return int: SQLITE_EMPTY if not an aux column, SQLITE_OK if it is.
+ */
+int vec0_parse_auxiliary_column_definition(const char *source, int source_length,
+                                 char **out_column_name,
+                                 int *out_column_name_length,
+                                 int *out_column_type) {
+  struct Vec0Scanner scanner;
+  struct Vec0Token token;
+  char *column_name;
+  int column_name_length;
+  int column_type;
+  vec0_scanner_init(&scanner, source, source_length);
+
+  // Check first token is '+', which denotes aux columns
+  int rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME ||
+      token.token_type != TOKEN_TYPE_PLUS) {
+    return SQLITE_EMPTY;
+  }
+
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+
+  column_name = token.start;
+  column_name_length = token.end - token.start;
+
+  // Check the next token matches "text" or "integer", as column type
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "text", token.end - token.start) == 0) {
+    column_type = SQLITE_TEXT;
+  } else if (sqlite3_strnicmp(token.start, "int", token.end - token.start) ==
+                 0 ||
+             sqlite3_strnicmp(token.start, "integer",
+                              token.end - token.start) == 0) {
+    column_type = SQLITE_INTEGER;
+  } else if (sqlite3_strnicmp(token.start, "float", token.end - token.start) ==
+                 0 ||
+             sqlite3_strnicmp(token.start, "double",
+                              token.end - token.start) == 0) {
+    column_type = SQLITE_FLOAT;
+  } else if (sqlite3_strnicmp(token.start, "blob", token.end - token.start) ==0) {
+    column_type = SQLITE_BLOB;
+  } else {
+    return SQLITE_EMPTY;
+  }
+
+  *out_column_name = column_name;
+  *out_column_name_length = column_name_length;
+  *out_column_type = column_type;
+
+  return SQLITE_OK;
+}
+
+typedef enum {
+  VEC0_METADATA_COLUMN_KIND_BOOLEAN,
+  VEC0_METADATA_COLUMN_KIND_INTEGER,
+  VEC0_METADATA_COLUMN_KIND_FLOAT,
+  VEC0_METADATA_COLUMN_KIND_TEXT,
+  // future: blob, date, datetime
+} vec0_metadata_column_kind;
+
+/**
+ * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
+ * it's an metadata column definition, ie `[name] [type]` like `is_released boolean`,
+ * optionally followed by `dictionary` for TEXT columns, like `genre text dictionary`
+ *
+ * @param source: argv[i] source string
+ * @param source_length: length of the source string
+ * @param out_column_name: If it is a metadata column, the output column name. Same lifetime
+ * as source, points to specific char *
+ * @param out_column_name_length: Length of out_column_name in bytes
+ * @param out_column_type: one of vec0_metadata_column_kind
+ * @param out_dictionary: 1 if the column is dictionary-encoded, 0 otherwise
+ * @return int: SQLITE_EMPTY if not an metadata column, SQLITE_OK if it is,
+ * SQLITE_ERROR if `dictionary` follows a type other than TEXT.
+ */
+int vec0_parse_metadata_column_definition(const char *source, int source_length,
+                                 char **out_column_name,
+                                 int *out_column_name_length,
+                                 vec0_metadata_column_kind *out_column_type,
+                                 int *out_dictionary) {
+  struct Vec0Scanner scanner;
+  struct Vec0Token token;
+  char *column_name;
+  int column_name_length;
+  vec0_metadata_column_kind column_type;
+  int rc;
+  vec0_scanner_init(&scanner, source, source_length);
+
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME ||
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+
+  column_name = token.start;
+  column_name_length = token.end - token.start;
+
+  // Check the next token matches a valid metadata type
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME ||
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  char * t = token.start;
+  int n = token.end - token.start;
+  if (sqlite3_strnicmp(t, "boolean", n) == 0 || sqlite3_strnicmp(t, "bool", n) == 0) {
+    column_type = VEC0_METADATA_COLUMN_KIND_BOOLEAN;
+  }else if (sqlite3_strnicmp(t, "int64", n) == 0 || sqlite3_strnicmp(t, "integer64", n) == 0 || sqlite3_strnicmp(t, "integer", n) == 0 || sqlite3_strnicmp(t, "int", n) == 0) {
+    column_type = VEC0_METADATA_COLUMN_KIND_INTEGER;
+  }else if (sqlite3_strnicmp(t, "float", n) == 0 || sqlite3_strnicmp(t, "double", n) == 0 || sqlite3_strnicmp(t, "float64", n) == 0 || sqlite3_strnicmp(t, "f64", n) == 0) {
+    column_type = VEC0_METADATA_COLUMN_KIND_FLOAT;
+  } else if (sqlite3_strnicmp(t, "text", n) == 0) {
+    column_type = VEC0_METADATA_COLUMN_KIND_TEXT;
+  } else {
+    return SQLITE_EMPTY;
+  }
+
+  int dictionary = 0;
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc == VEC0_TOKEN_RESULT_SOME &&
+      token.token_type == TOKEN_TYPE_IDENTIFIER &&
+      token.end - token.start == (int)strlen("dictionary") &&
+      sqlite3_strnicmp(token.start, "dictionary", token.end - token.start) == 0) {
+    if (column_type != VEC0_METADATA_COLUMN_KIND_TEXT) {
+      return SQLITE_ERROR;
+    }
+    dictionary = 1;
+  }
+
+  *out_column_name = column_name;
+  *out_column_name_length = column_name_length;
+  *out_column_type = column_type;
+  *out_dictionary = dictionary;
+
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Parse an argv[i] entry of a vec0 virtual table definition, and see if
+ * it's a PRIMARY KEY definition.
+ *
+ * @param source: argv[i] source string
+ * @param source_length: length of the source string
+ * @param out_column_name: If it is a PK, the output column name. Same lifetime
+ * as source, points to specific char *
+ * @param out_column_name_length: Length of out_column_name in bytes
+ * @param out_column_type: SQLITE_TEXT or SQLITE_INTEGER.
+ * @return int: SQLITE_EMPTY if not a PK, SQLITE_OK if it is.
+ */
+int vec0_parse_primary_key_definition(const char *source, int source_length,
+                                 char **out_column_name,
+                                 int *out_column_name_length,
+                                 int *out_column_type) {
+  struct Vec0Scanner scanner;
+  struct Vec0Token token;
+  char *column_name;
+  int column_name_length;
+  int column_type;
+  vec0_scanner_init(&scanner, source, source_length);
+
+  // Check first token is identifier, will be the column name
+  int rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+
+  column_name = token.start;
+  column_name_length = token.end - token.start;
+
+  // Check the next token matches "text" or "integer", as column type
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "text", token.end - token.start) == 0) {
+    column_type = SQLITE_TEXT;
+  } else if (sqlite3_strnicmp(token.start, "int", token.end - token.start) ==
+                 0 ||
+             sqlite3_strnicmp(token.start, "integer",
+                              token.end - token.start) == 0) {
+    column_type = SQLITE_INTEGER;
+  } else {
+    return SQLITE_EMPTY;
+  }
+
+  // Check the next token is identifier and matches "primary"
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "primary", token.end - token.start) != 0) {
+    return SQLITE_EMPTY;
+  }
+
+  // Check the next token is identifier and matches "key"
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "key", token.end - token.start) != 0) {
+    return SQLITE_EMPTY;
+  }
+
+  *out_column_name = column_name;
+  *out_column_name_length = column_name_length;
+  *out_column_type = column_type;
+
+  return SQLITE_OK;
+}
+
+enum Vec0DistanceMetrics {
+  VEC0_DISTANCE_METRIC_L2 = 1,
+  VEC0_DISTANCE_METRIC_COSINE = 2,
+  VEC0_DISTANCE_METRIC_L1 = 3,
+};
+
+/**
+ * Compute distance between two full-precision vectors using the appropriate
+ * distance function for the given element type and metric.
+ * Shared utility used by ANN index implementations.
+ */
+static f32 vec0_distance_full(
+    const void *a, const void *b, size_t dimensions,
+    enum VectorElementType elementType,
+    enum Vec0DistanceMetrics metric) {
+  switch (elementType) {
+    case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
+      switch (metric) {
+        case VEC0_DISTANCE_METRIC_L2:
+          return distance_l2_sqr_float(a, b, &dimensions);
+        case VEC0_DISTANCE_METRIC_COSINE:
+          return distance_cosine_float(a, b, &dimensions);
+        case VEC0_DISTANCE_METRIC_L1:
+          return (f32)distance_l1_f32(a, b, &dimensions);
+      }
+      break;
+    case SQLITE_VEC_ELEMENT_TYPE_INT8:
+      switch (metric) {
+        case VEC0_DISTANCE_METRIC_L2:
+          return distance_l2_sqr_int8(a, b, &dimensions);
+        case VEC0_DISTANCE_METRIC_COSINE:
+          return distance_cosine_int8(a, b, &dimensions);
+        case VEC0_DISTANCE_METRIC_L1:
+          return (f32)distance_l1_int8(a, b, &dimensions);
+      }
+      break;
+    case SQLITE_VEC_ELEMENT_TYPE_BIT:
+      return distance_hamming(a, b, &dimensions);
+  }
+  return 0.0f;
+}
+
+enum Vec0IndexType {
+  VEC0_INDEX_TYPE_FLAT = 1,
+#if SQLITE_VEC_ENABLE_RESCORE
+  VEC0_INDEX_TYPE_RESCORE = 2,
+#endif
+  VEC0_INDEX_TYPE_IVF = 3,
+  VEC0_INDEX_TYPE_DISKANN = 4,
+};
+
+#if SQLITE_VEC_ENABLE_RESCORE
+enum Vec0RescoreQuantizerType {
+  VEC0_RESCORE_QUANTIZER_BIT = 1,
+  VEC0_RESCORE_QUANTIZER_INT8 = 2,
+};
+
+struct Vec0RescoreConfig {
+  enum Vec0RescoreQuantizerType quantizer_type;
+  int oversample;          // CREATE-time default
+  int oversample_search;   // runtime override (0 = use default)
+};
+#endif
+
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+enum Vec0IvfQuantizer {
+  VEC0_IVF_QUANTIZER_NONE = 0,
+  VEC0_IVF_QUANTIZER_INT8 = 1,
+  VEC0_IVF_QUANTIZER_BINARY = 2,
+};
+
+struct Vec0IvfConfig {
+  int nlist;       // number of centroids (0 = deferred)
+  int nprobe;      // cells to probe at query time
+  int quantizer;   // VEC0_IVF_QUANTIZER_NONE / INT8 / BINARY
+  int oversample;  // >= 1 (1 = no oversampling)
+};
+#else
+struct Vec0IvfConfig { char _unused; };
+#endif
+
+// ============================================================
+// DiskANN types and constants
+// ============================================================
+
+#define VEC0_DISKANN_DEFAULT_N_NEIGHBORS 72
+#define VEC0_DISKANN_MAX_N_NEIGHBORS 256
+#define VEC0_DISKANN_DEFAULT_SEARCH_LIST_SIZE 128
+#define VEC0_DISKANN_DEFAULT_ALPHA 1.2f
+
+/**
+ * Quantizer type used for compressing neighbor vectors in the DiskANN graph.
+ */
+enum Vec0DiskannQuantizerType {
+  VEC0_DISKANN_QUANTIZER_BINARY = 1,   // 1 bit per dimension (1/32 compression)
+  VEC0_DISKANN_QUANTIZER_INT8   = 2,   // 1 byte per dimension (1/4 compression)
+};
+
+/**
+ * Configuration for a DiskANN index on a single vector column.
+ * Parsed from `INDEXED BY diskann(neighbor_quantizer=binary, n_neighbors=72)`.
+ */
+struct Vec0DiskannConfig {
+  // Quantizer type for neighbor vectors
+  enum Vec0DiskannQuantizerType quantizer_type;
+
+  // Maximum number of neighbors per node (R in the paper). Must be divisible by 8.
+  int n_neighbors;
+
+  // Search list size (L in the paper) — unified default for both insert and query.
+  int search_list_size;
+
+  // Per-path overrides (0 = fall back to search_list_size).
+  int search_list_size_search;
+  int search_list_size_insert;
+
+  // Alpha parameter for RobustPrune (distance scaling factor, typically 1.0-1.5)
+  f32 alpha;
+
+  // Buffer threshold for batched inserts. When > 0, inserts go into a flat
+  // buffer table and are flushed into the graph when the buffer reaches this
+  // size. 0 = disabled (legacy per-row insert behavior).
+  int buffer_threshold;
+};
+
+/**
+ * Represents a single candidate during greedy beam search.
+ * Used in priority queues / sorted arrays during LM-Search.
+ */
+struct Vec0DiskannCandidate {
+  i64 rowid;
+  f32 distance;
+  int visited;   // 1 if this candidate's neighbors have been explored
+  int confirmed; // 1 if full-precision vector was successfully read (node exists)
+};
+
+/**
+ * Returns the byte size of a quantized vector for the given quantizer type
+ * and number of dimensions.
+ */
+size_t diskann_quantized_vector_byte_size(
+    enum Vec0DiskannQuantizerType quantizer_type, size_t dimensions) {
+  switch (quantizer_type) {
+    case VEC0_DISKANN_QUANTIZER_BINARY:
+      return dimensions / CHAR_BIT;  // 1 bit per dimension
+    case VEC0_DISKANN_QUANTIZER_INT8:
+      return dimensions * sizeof(i8);  // 1 byte per dimension
+  }
+  return 0;
+}
+
+static f32 distance_l1_f32_as_f32(const void *a, const void *b,
+                                  const void *d) {
+  return (f32)distance_l1_f32(a, b, d);
+}
+
+static f32 distance_l1_int8_as_f32(const void *a, const void *b,
+                                   const void *d) {
+  return (f32)distance_l1_int8(a, b, d);
+}
+
+typedef f32 (*vec0_bounded_distance_f32_fn)(const void *a, const void *b,
+                                            const void *d, f32 bound);
+
+/**
+ * Early-abandoning squared L2: sums VEC0_BOUNDED_BLOCK_DIMS dimensions at a
+ * time with the regular kernels, and gives up once the partial sum is past
+ * bound. The result is exact when it is <= bound, otherwise it is only known
+ * to be > bound. Every row of a column goes through the same blocks, so
+ * distances stay comparable to each other.
+ */
+static f32 distance_l2_squared_float_bounded(const void *a, const void *b,
+                                             const void *d, f32 bound) {
+  const f32 *pa = (const f32 *)a;
+  const f32 *pb = (const f32 *)b;
+  size_t dimensions = *(const size_t *)d;
+  f32 sum = 0;
+  for (size_t off = 0; off < dimensions; off += VEC0_BOUNDED_BLOCK_DIMS) {
+    size_t n = min(dimensions - off, (size_t)VEC0_BOUNDED_BLOCK_DIMS);
+    sum += distance_l2_squared_float(pa + off, pb + off, &n);
+    if (sum > bound) {
+      break;
+    }
+  }
+  return sum;
+}
+
+static f32 distance_l1_f32_bounded(const void *a, const void *b, const void *d,
+                                   f32 bound) {
+  const f32 *pa = (const f32 *)a;
+  const f32 *pb = (const f32 *)b;
+  size_t dimensions = *(const size_t *)d;
+  double sum = 0;
+  for (size_t off = 0; off < dimensions; off += VEC0_BOUNDED_BLOCK_DIMS) {
+    size_t n = min(dimensions - off, (size_t)VEC0_BOUNDED_BLOCK_DIMS);
+    sum += distance_l1_f32(pa + off, pb + off, &n);
+    if (sum > bound) {
+      break;
+    }
+  }
+  return (f32)sum;
+}
+
+/**
+ * Whether vec0_column_distance_fn() returns squared distances for this kind
+ * of column, which then need a sqrtf() before they are reported.
+ */
+static int vec0_distance_is_squared(enum VectorElementType element_type,
+                                    enum Vec0DistanceMetrics metric) {
+  return metric == VEC0_DISTANCE_METRIC_L2 &&
+         element_type != SQLITE_VEC_ELEMENT_TYPE_BIT;
+}
+
+/**
+ * Smallest squared distance s for which sqrtf(s) is >= target (or > target
+ * when strict is set). Lets `distance < X` style constraints be checked
+ * against squared distances with exactly the same result as comparing the
+ * reported sqrtf() value.
+ */
+static f32 vec0_squared_distance_bound(f32 target, int strict) {
+  if (!(target > 0.0f)) {
+    // every distance is >= 0, and only 0 itself fails `> 0`
+    return (strict && target == 0.0f) ? nextafterf(0.0f, INFINITY) : 0.0f;
+  }
+  if (isinf(target)) {
+    return INFINITY;
+  }
+  f32 s = (f32)((double)target * (double)target);
+#define VEC0_BOUND_OK(x) (strict ? sqrtf(x) > target : sqrtf(x) >= target)
+  while (s > 0.0f && VEC0_BOUND_OK(nextafterf(s, 0.0f))) {
+    s = nextafterf(s, 0.0f);
+  }
+  while (!VEC0_BOUND_OK(s)) {
+    s = nextafterf(s, INFINITY);
+  }
+#undef VEC0_BOUND_OK
+  return s;
+}
+
+/**
+ * Lower bound on the distance from query to any vector inside the box
+ * bounds (dims minimums, then dims maximums), in the domain the column's
+ * kernel reports: squared for L2 when squared is set. An empty box is
+ * infinitely far away.
+ *
+ * Summed in double and then shaved by a few ulps per dimension, so that the
+ * rounding of the float32 kernels can never score a row inside the box below
+ * the returned value.
+ */
+static f32 vec0_vector_bounds_distance(enum Vec0DistanceMetrics metric,
+                                       int squared, const f32 *bounds,
+                                       const f32 *query, size_t dims) {
+  double sum = 0.0;
+  for (size_t d = 0; d < dims; d++) {
+    f32 lo = bounds[d];
+    f32 hi = bounds[dims + d];
+    if (lo > hi) {
+      return INFINITY;
+    }
+    double gap = 0.0;
+    if (query[d] < lo) {
+      gap = (double)lo - (double)query[d];
+    } else if (query[d] > hi) {
+      gap = (double)query[d] - (double)hi;
+    }
+    sum += metric == VEC0_DISTANCE_METRIC_L2 ? gap * gap : gap;
+  }
+  sum *= 1.0 - (double)(2 * dims + 4) * FLT_EPSILON;
+  if (!(sum > 0.0)) {
+    return 0.0f;
+  }
+  if (metric == VEC0_DISTANCE_METRIC_L2 && !squared) {
+    sum = sqrt(sum);
+  }
+  f32 bound = (f32)sum;
+  if ((double)bound > sum) {
+    bound = nextafterf(bound, 0.0f);
+  }
+  return bound;
+}
+
+#ifdef SQLITE_VEC_ENABLE_AVX
+struct Vec0FixedDimKernels {
+  size_t dimensions;
+  enum Vec0SimdLevel level;
+  vec0_distance_f32_fn l2_sqr_float;
+  vec0_bounded_distance_f32_fn l2_sqr_float_bounded;
+  vec0_distance_f32_fn cosine_float;
+};
+
+// Ordered best ISA first, the first entry the CPU supports wins.
+static const struct Vec0FixedDimKernels vec0_fixed_dim_kernels[] = {
+    // clang-format off
+  {384,  VEC0_SIMD_AVX512, l2_sqr_float_avx512_384,  l2_sqr_float_avx512_384_bounded,  cosine_float_avx512_384},
+  {768,  VEC0_SIMD_AVX512, l2_sqr_float_avx512_768,  l2_sqr_float_avx512_768_bounded,  cosine_float_avx512_768},
+  {1024, VEC0_SIMD_AVX512, l2_sqr_float_avx512_1024, l2_sqr_float_avx512_1024_bounded, cosine_float_avx512_1024},
+  {1536, VEC0_SIMD_AVX512, l2_sqr_float_avx512_1536, l2_sqr_float_avx512_1536_bounded, cosine_float_avx512_1536},
+  {384,  VEC0_SIMD_AVX2,   l2_sqr_float_avx2_384,    l2_sqr_float_avx2_384_bounded,    cosine_float_avx2_384},
+  {768,  VEC0_SIMD_AVX2,   l2_sqr_float_avx2_768,    l2_sqr_float_avx2_768_bounded,    cosine_float_avx2_768},
+  {1024, VEC0_SIMD_AVX2,   l2_sqr_float_avx2_1024,   l2_sqr_float_avx2_1024_bounded,   cosine_float_avx2_1024},
+  {1536, VEC0_SIMD_AVX2,   l2_sqr_float_avx2_1536,   l2_sqr_float_avx2_1536_bounded,   cosine_float_avx2_1536},
+    // clang-format on
+};
+#endif
+
+/**
+ * Picks the distance function for a vector column, so hot loops can call it
+ * directly instead of switching on the element type and metric for every row.
+ * float[384], float[768], float[1024] and float[1536] columns get a kernel
+ * specialized for that exact width when the CPU supports one.
+ *
+ * L2 distances come back squared, see vec0_distance_is_squared(). When
+ * normalize is set, vectors are known to be unit length and cosine reduces to
+ * 1 - dot(a, b).
+ *
+ * Must run after vec0_distance_kernels_init(), as it reads vec0_kernels.level.
+ */
+static vec0_distance_f32_fn
+vec0_column_distance_fn(enum VectorElementType element_type,
+                        enum Vec0DistanceMetrics metric, size_t dimensions,
+                        int normalize) {
+#ifndef SQLITE_VEC_ENABLE_AVX
+  // only fixed-width kernels depend on the width
+  UNUSED_PARAMETER(dimensions);
+#endif
+  switch (element_type) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+    if (normalize && metric == VEC0_DISTANCE_METRIC_COSINE) {
+      return distance_cosine_unit_float;
+    }
+#ifdef SQLITE_VEC_ENABLE_AVX
+    if (metric == VEC0_DISTANCE_METRIC_L2 ||
+        metric == VEC0_DISTANCE_METRIC_COSINE) {
+      for (size_t i = 0; i < countof(vec0_fixed_dim_kernels); i++) {
+        const struct Vec0FixedDimKernels *k = &vec0_fixed_dim_kernels[i];
+        if (k->dimensions == dimensions && k->level <= vec0_kernels.level) {
+          return metric == VEC0_DISTANCE_METRIC_L2 ? k->l2_sqr_float
+                                                   : k->cosine_float;
+        }
+      }
+    }
+#endif
+    switch (metric) {
+    case VEC0_DISTANCE_METRIC_L2:
+      return distance_l2_squared_float;
+    case VEC0_DISTANCE_METRIC_L1:
+      return distance_l1_f32_as_f32;
+    case VEC0_DISTANCE_METRIC_COSINE:
+      return distance_cosine_float;
+    }
+    break;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+    switch (metric) {
+    case VEC0_DISTANCE_METRIC_L2:
+      return distance_l2_squared_int8;
+    case VEC0_DISTANCE_METRIC_L1:
+      return distance_l1_int8_as_f32;
+    case VEC0_DISTANCE_METRIC_COSINE:
+      return distance_cosine_int8;
+    }
+    break;
+  }
+  case SQLITE_VEC_ELEMENT_TYPE_BIT:
+    return distance_hamming;
+  }
+  return NULL;
+}
+
+/**
+ * Early-abandoning distance function for a vector column, or NULL when the
+ * metric has no useful partial sum (cosine) or the vectors are too short to
+ * split into blocks. Columns with a fixed-width L2 kernel get its bounded
+ * twin, which returns the same distances whenever it doesn't give up early,
+ * so rows scored with or without a bound stay comparable.
+ */
+static vec0_bounded_distance_f32_fn
+vec0_column_bounded_distance_fn(enum VectorElementType element_type,
+                                enum Vec0DistanceMetrics metric,
+                                size_t dimensions) {
+  if (element_type != SQLITE_VEC_ELEMENT_TYPE_FLOAT32 ||
+      dimensions <= VEC0_BOUNDED_BLOCK_DIMS) {
+    return NULL;
+  }
+  switch (metric) {
+  case VEC0_DISTANCE_METRIC_L2:
+#ifdef SQLITE_VEC_ENABLE_AVX
+    for (size_t i = 0; i < countof(vec0_fixed_dim_kernels); i++) {
+      const struct Vec0FixedDimKernels *k = &vec0_fixed_dim_kernels[i];
+      if (k->dimensions == dimensions && k->level <= vec0_kernels.level) {
+        return k->l2_sqr_float_bounded;
+      }
+    }
+#endif
+    return distance_l2_squared_float_bounded;
+  case VEC0_DISTANCE_METRIC_L1:
+    return distance_l1_f32_bounded;
+  case VEC0_DISTANCE_METRIC_COSINE:
+    break;
+  }
+  return NULL;
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#define SQLITE_VEC_PREFETCH(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define SQLITE_VEC_PREFETCH(p) ((void)(p))
+#endif
+static int vec0_ctz64(u64 x) {
+  unsigned long idx;
+#if defined(_M_X64) || defined(_M_ARM64)
+  _BitScanForward64(&idx, x);
+#else
+  if (!_BitScanForward(&idx, (unsigned long)x)) {
+    _BitScanForward(&idx, (unsigned long)(x >> 32));
+    idx += 32;
+  }
+#endif
+  return (int)idx;
+}
+static int vec0_msb64(u64 x) {
+  unsigned long idx;
+#if defined(_M_X64) || defined(_M_ARM64)
+  _BitScanReverse64(&idx, x);
+#else
+  if (_BitScanReverse(&idx, (unsigned long)(x >> 32))) {
+    idx += 32;
+  } else {
+    _BitScanReverse(&idx, (unsigned long)x);
+  }
+#endif
+  return (int)idx;
+}
+#else
+#define SQLITE_VEC_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+static int vec0_ctz64(u64 x) { return __builtin_ctzll(x); }
+static int vec0_msb64(u64 x) { return 63 - __builtin_clzll(x); }
+#endif
+
+// 64 bits of a validity bitmap starting at bit word_start (a multiple of 64),
+// with bits at or past n cleared.
+static u64 bitmap_word64(const u8 *bitmap, i32 n, i32 word_start) {
+  i32 n_bytes = (n + CHAR_BIT - 1) / CHAR_BIT;
+  i32 byte_start = word_start / CHAR_BIT;
+  i32 bytes = min(n_bytes - byte_start, 8);
+  if (n - word_start >= 64) {
+    // spelled out so compilers turn it into a single 64-bit load
+    const u8 *w = bitmap + byte_start;
+    return (u64)w[0] | ((u64)w[1] << 8) | ((u64)w[2] << 16) |
+           ((u64)w[3] << 24) | ((u64)w[4] << 32) | ((u64)w[5] << 40) |
+           ((u64)w[6] << 48) | ((u64)w[7] << 56);
+  }
+  u64 word = 0;
+  for (i32 j = 0; j < bytes; j++) {
+    word |= ((u64)bitmap[byte_start + j]) << (j * CHAR_BIT);
+  }
+  if (n - word_start < 64) {
+    word &= (((u64)1) << (n - word_start)) - 1;
+  }
+  return word;
+}
+
+// Writes back a word read with bitmap_word64(), for bitmaps of a whole number
+// of bytes.
+static void bitmap_word64_store(u8 *bitmap, i32 n, i32 word_start, u64 word) {
+  assert(n % CHAR_BIT == 0);
+  i32 byte_start = word_start / CHAR_BIT;
+  i32 bytes = min(n / CHAR_BIT - byte_start, 8);
+  for (i32 j = 0; j < bytes; j++) {
+    bitmap[byte_start + j] = (u8)(word >> (j * CHAR_BIT));
+  }
+}
+
+/**
+ * Computes the distance from query to every row of a chunk that is set in
+ * validity, writing it to out[i]. Rows that aren't set are left untouched.
+ *
+ * base holds n vectors of vector_size bytes each, back to back, and validity
+ * is a bitmap with (at least) n bits. Empty runs of 64 rows are skipped a
+ * whole word at a time, and while one row is being scored the next valid row
+ * is prefetched, so sparse chunks don't stall on every gap.
+ *
+ * Rows are scored with bounded against bound when it is set, with distance
+ * otherwise.
+ */
+static void distances_for_chunk_impl(vec0_distance_f32_fn distance,
+                                     vec0_bounded_distance_f32_fn bounded,
+                                     f32 bound, const void *query,
+                                     const void *base, size_t vector_size,
+                                     const size_t *dimensions, i32 n,
+                                     const u8 *validity, f32 *out) {
+#define VEC0_SCORE_ROW(i)                                                      \
+  (bounded ? bounded(rows + (size_t)(i)*vector_size, query, dimensions, bound) \
+           : distance(rows + (size_t)(i)*vector_size, query, dimensions))
+  const u8 *rows = (const u8 *)base;
+  // the valid row found on the previous step, scored once the next valid row
+  // has been prefetched
+  i32 pending = -1;
+
+  for (i32 word_start = 0; word_start < n; word_start += 64) {
+    u64 word = bitmap_word64(validity, n, word_start);
+    while (word) {
+      i32 i = word_start + vec0_ctz64(word);
+      word &= word - 1;
+      const u8 *row = rows + (size_t)i * vector_size;
+      for (size_t off = 0; off < vector_size; off += 64) {
+        SQLITE_VEC_PREFETCH(row + off);
+      }
+      if (pending >= 0) {
+        out[pending] = VEC0_SCORE_ROW(pending);
+      }
+      pending = i;
+    }
+  }
+  if (pending >= 0) {
+    out[pending] = VEC0_SCORE_ROW(pending);
+  }
+#undef VEC0_SCORE_ROW
+}
+
+static void distances_for_chunk(vec0_distance_f32_fn distance,
+                                const void *query, const void *base,
+                                size_t vector_size, const size_t *dimensions,
+                                i32 n, const u8 *validity, f32 *out) {
+  distances_for_chunk_impl(distance, NULL, 0, query, base, vector_size,
+                           dimensions, n, validity, out);
+}
+
+/**
+ * distances_for_chunk() with an early-abandoning kernel: rows further than
+ * bound may be left with any value > bound instead of their exact distance.
+ */
+static void distances_for_chunk_bounded(vec0_bounded_distance_f32_fn distance,
+                                        f32 bound, const void *query,
+                                        const void *base, size_t vector_size,
+                                        const size_t *dimensions, i32 n,
+                                        const u8 *validity, f32 *out) {
+  distances_for_chunk_impl(NULL, distance, bound, query, base, vector_size,
+                           dimensions, n, validity, out);
+}
+
+/**
+ * Running top-k for KNN scans: a bounded max-heap of the k closest rows seen
+ * so far, kept across every chunk of a query. The root is the current k-th
+ * distance, so a row that can't make the cut costs one comparison.
+ *
+ * Rows with equal distances keep the order they were pushed in. NaN distances,
+ * like cosine against a zero vector, rank after every other distance, +inf
+ * included, so such rows still fill the k results.
+ */
+struct Vec0TopK {
+  i32 k;
+  i32 used;
+  // OWNED BY CALLER after vec0_topk_finish()
+  f32 *distances;
+  i64 *rowids;
+  // push order of each entry, to break ties
+  i64 *seqs;
+  i64 next_seq;
+};
+
+static int vec0_topk_init(struct Vec0TopK *topk, i32 k) {
+  memset(topk, 0, sizeof(*topk));
+  topk->distances = sqlite3_malloc(k * sizeof(f32));
+  topk->rowids = sqlite3_malloc(k * sizeof(i64));
+  topk->seqs = sqlite3_malloc(k * sizeof(i64));
+  if (!topk->distances || !topk->rowids || !topk->seqs) {
+    sqlite3_free(topk->distances);
+    sqlite3_free(topk->rowids);
+    sqlite3_free(topk->seqs);
+    memset(topk, 0, sizeof(*topk));
+    return SQLITE_NOMEM;
+  }
+  topk->k = k;
+  return SQLITE_OK;
+}
+
+static void vec0_topk_free(struct Vec0TopK *topk) {
+  sqlite3_free(topk->distances);
+  sqlite3_free(topk->rowids);
+  sqlite3_free(topk->seqs);
+  memset(topk, 0, sizeof(*topk));
+}
+
+// whether distance a ranks before b, NaN after everything else
+static int vec0_topk_distance_before(f32 a, f32 b) {
+  return a < b || (isnan(b) && !isnan(a));
+}
+
+static int vec0_topk_distance_equal(f32 a, f32 b) {
+  return a == b || (isnan(a) && isnan(b));
+}
+
+// whether entry a ranks after (is further than) entry b
+static int vec0_topk_after(const struct Vec0TopK *topk, i32 a, i32 b) {
+  f32 da = topk->distances[a], db = topk->distances[b];
+  return vec0_topk_distance_before(db, da) ||
+         (vec0_topk_distance_equal(da, db) && topk->seqs[a] > topk->seqs[b]);
+}
+
+static void vec0_topk_swap(struct Vec0TopK *topk, i32 a, i32 b) {
+  f32 d = topk->distances[a];
+  i64 r = topk->rowids[a];
+  i64 q = topk->seqs[a];
+  topk->distances[a] = topk->distances[b];
+  topk->rowids[a] = topk->rowids[b];
+  topk->seqs[a] = topk->seqs[b];
+  topk->distances[b] = d;
+  topk->rowids[b] = r;
+  topk->seqs[b] = q;
+}
+
+static void vec0_topk_sift_down(struct Vec0TopK *topk, i32 pos, i32 size) {
+  for (;;) {
+    i32 l = 2 * pos + 1, r = l + 1, largest = pos;
+    if (l < size && vec0_topk_after(topk, l, largest)) {
+      largest = l;
+    }
+    if (r < size && vec0_topk_after(topk, r, largest)) {
+      largest = r;
+    }
+    if (largest == pos) {
+      return;
+    }
+    vec0_topk_swap(topk, pos, largest);
+    pos = largest;
+  }
+}
+
+/**
+ * Distance a new row has to beat to enter the top-k, INFINITY until k rows
+ * have been seen. Only a bound for pruning: rows at +inf or NaN still enter
+ * a heap that isn't full, and NaN means nothing can be pruned yet.
+ */
+static f32 vec0_topk_threshold(const struct Vec0TopK *topk) {
+  return topk->used < topk->k ? INFINITY : topk->distances[0];
+}
+
+/**
+ * Offers a row with an explicit push order. Once the heap is full, the row
+ * replaces the k-th entry only if it ranks before it, ties going to the lower
+ * seq, so merging heaps built over disjoint rows gives the same top-k as
+ * pushing every row into one heap.
+ */
+static void vec0_topk_insert(struct Vec0TopK *topk, f32 distance, i64 rowid,
+                             i64 seq) {
+  if (topk->used < topk->k) {
+    i32 c = topk->used++;
+    topk->distances[c] = distance;
+    topk->rowids[c] = rowid;
+    topk->seqs[c] = seq;
+    while (c > 0) {
+      i32 parent = (c - 1) / 2;
+      if (!vec0_topk_after(topk, c, parent)) {
+        break;
+      }
+      vec0_topk_swap(topk, c, parent);
+      c = parent;
+    }
+    return;
+  }
+  // ties lose to the earlier push already in the heap
+  f32 threshold = topk->distances[0];
+  if (!(vec0_topk_distance_before(distance, threshold) ||
+        (vec0_topk_distance_equal(distance, threshold) &&
+         seq < topk->seqs[0]))) {
+    return;
+  }
+  topk->distances[0] = distance;
+  topk->rowids[0] = rowid;
+  topk->seqs[0] = seq;
+  vec0_topk_sift_down(topk, 0, topk->used);
+}
+
+static void vec0_topk_push(struct Vec0TopK *topk, f32 distance, i64 rowid) {
+  vec0_topk_insert(topk, distance, rowid, topk->next_seq++);
+}
+
+/**
+ * Offers every row of a chunk whose bit is set in candidates. Rows are pushed
+ * from the end of the chunk backwards, so equal distances within a chunk come
+ * out latest row first, as they always have. Each chunk takes up n push
+ * orders whether or not its rows are kept, starting at topk->next_seq.
+ */
+static void vec0_topk_push_chunk(struct Vec0TopK *topk, const f32 *distances,
+                                 const i64 *rowids, const u8 *candidates,
+                                 i32 n) {
+  i64 seq_base = topk->next_seq;
+  topk->next_seq += n;
+  for (i32 word_start = ((n - 1) / 64) * 64; word_start >= 0;
+       word_start -= 64) {
+    u64 word = bitmap_word64(candidates, n, word_start);
+    while (word) {
+      int bit = vec0_msb64(word);
+      word &= ~(((u64)1) << bit);
+      i32 i = word_start + bit;
+      if (topk->used < topk->k ||
+          vec0_topk_distance_before(distances[i], topk->distances[0])) {
+        vec0_topk_insert(topk, distances[i], rowids[i],
+                         seq_base + (n - 1 - i));
+      }
+    }
+  }
+}
+
+/**
+ * Sorts the heap in place by ascending distance. topk->distances and
+ * topk->rowids then hold the final results, topk->used of them. The tie-break
+ * orders are freed, so nothing can be pushed afterwards.
+ */
+static void vec0_topk_finish(struct Vec0TopK *topk) {
+  for (i32 i = topk->used - 1; i > 0; i--) {
+    vec0_topk_swap(topk, 0, i);
+    vec0_topk_sift_down(topk, 0, i);
+  }
+  sqlite3_free(topk->seqs);
+  topk->seqs = NULL;
+}
+
+/**
+ * Concatenates the results of n finished heaps into new arrays, in heap
+ * order, with the index of the heap each row came from in *out_idxs. The
+ * heaps are left untouched.
+ */
+static int vec0_topk_concat(const struct Vec0TopK *topks, i64 n,
+                            i64 **out_rowids, f32 **out_distances,
+                            i32 **out_idxs, i64 *out_used) {
+  i64 used = 0;
+  for (i64 i = 0; i < n; i++) {
+    used += topks[i].used;
+  }
+  // never 0 bytes, so a NULL return always means out of memory
+  i64 *rowids = sqlite3_malloc64((used + 1) * sizeof(i64));
+  f32 *distances = sqlite3_malloc64((used + 1) * sizeof(f32));
+  i32 *idxs = sqlite3_malloc64((used + 1) * sizeof(i32));
+  if (!rowids || !distances || !idxs) {
+    sqlite3_free(rowids);
+    sqlite3_free(distances);
+    sqlite3_free(idxs);
+    return SQLITE_NOMEM;
+  }
+  i64 offset = 0;
+  for (i64 i = 0; i < n; i++) {
+    memcpy(rowids + offset, topks[i].rowids, topks[i].used * sizeof(i64));
+    memcpy(distances + offset, topks[i].distances,
+           topks[i].used * sizeof(f32));
+    for (i32 j = 0; j < topks[i].used; j++) {
+      idxs[offset + j] = (i32)i;
+    }
+    offset += topks[i].used;
+  }
+  *out_rowids = rowids;
+  *out_distances = distances;
+  *out_idxs = idxs;
+  *out_used = used;
+  return SQLITE_OK;
+}
+
+#ifndef SQLITE_VEC_SCRATCH_MAX
+// Largest scratch arena a vec0 table keeps between queries, in bytes. Queries
+// that need more get a one-off allocation instead.
+#define SQLITE_VEC_SCRATCH_MAX (64 * 1024 * 1024)
+#endif
+
+/**
+ * Grow-only scratch memory for KNN query buffers, kept on the vec0 table so
+ * back-to-back queries don't go through the allocator for every chunk buffer
+ * and bitmap. Released with the 'release-scratch' command, or when the table
+ * is disconnected.
+ */
+struct Vec0Scratch {
+  u8 *data;
+  size_t capacity;
+  // set while a query holds the arena, a nested query falls back to malloc
+  int busy;
+};
+
+/**
+ * One query's view of the scratch arena, carved up with vec0_scratch_alloc().
+ */
+struct Vec0ScratchFrame {
+  struct Vec0Scratch *arena;
+  u8 *data;
+  size_t capacity;
+  size_t used;
+  // data was allocated for this frame alone, not borrowed from arena
+  int owned;
+};
+
+// bytes a vec0_scratch_alloc(n) takes out of a frame
+static size_t vec0_scratch_size(size_t n) { return (n + 63) & ~(size_t)63; }
+
+/**
+ * Reserves size bytes (a sum of vec0_scratch_size() values) for one query,
+ * growing the table's arena if needed.
+ */
+static int vec0_scratch_acquire(struct Vec0Scratch *arena, size_t size,
+                                struct Vec0ScratchFrame *frame) {
+  memset(frame, 0, sizeof(*frame));
+  if (!arena->busy && size <= SQLITE_VEC_SCRATCH_MAX) {
+    if (arena->capacity < size) {
+      // the old contents don't matter, so skip realloc's copy
+      sqlite3_free(arena->data);
+      arena->capacity = 0;
+      arena->data = sqlite3_malloc64(size);
+      if (!arena->data) {
+        return SQLITE_NOMEM;
+      }
+      arena->capacity = size;
+    }
+    arena->busy = 1;
+    frame->arena = arena;
+    frame->data = arena->data;
+    frame->capacity = arena->capacity;
+    return SQLITE_OK;
+  }
+  frame->data = sqlite3_malloc64(size ? size : 1);
+  if (!frame->data) {
+    return SQLITE_NOMEM;
+  }
+  frame->capacity = size;
+  frame->owned = 1;
+  return SQLITE_OK;
+}
+
+/**
+ * Uninitialized memory from a frame, at least 8-byte aligned. Only valid until
+ * vec0_scratch_release().
+ */
+static void *vec0_scratch_alloc(struct Vec0ScratchFrame *frame, size_t n) {
+  size_t size = vec0_scratch_size(n);
+  assert(frame->used + size <= frame->capacity);
+  void *ptr = frame->data + frame->used;
+  frame->used += size;
+  return ptr;
+}
+
+static void vec0_scratch_release(struct Vec0ScratchFrame *frame) {
+  if (frame->owned) {
+    sqlite3_free(frame->data);
+  } else if (frame->arena) {
+    frame->arena->busy = 0;
+  }
+  memset(frame, 0, sizeof(*frame));
+}
+
+static void vec0_scratch_free(struct Vec0Scratch *arena) {
+  assert(!arena->busy);
+  sqlite3_free(arena->data);
+  arena->data = NULL;
+  arena->capacity = 0;
+}
+
+#ifdef SQLITE_VEC_TEST
+int _test_topk(const f32 *distances, const i64 *rowids, i32 n, i32 k,
+               f32 *out_distances, i64 *out_rowids) {
+  struct Vec0TopK topk;
+  if (vec0_topk_init(&topk, k) != SQLITE_OK) {
+    return -1;
+  }
+  for (i32 i = 0; i < n; i++) {
+    vec0_topk_push(&topk, distances[i], rowids[i]);
+  }
+  vec0_topk_finish(&topk);
+  memcpy(out_distances, topk.distances, topk.used * sizeof(f32));
+  memcpy(out_rowids, topk.rowids, topk.used * sizeof(i64));
+  i32 used = topk.used;
+  vec0_topk_free(&topk);
+  return used;
+}
+f32 _test_squared_distance_bound(f32 target, int strict) {
+  return vec0_squared_distance_bound(target, strict);
+}
+f32 _test_vector_bounds_distance(int l1, int squared, const f32 *bounds,
+                                 const f32 *query, size_t dims) {
+  return vec0_vector_bounds_distance(
+      l1 ? VEC0_DISTANCE_METRIC_L1 : VEC0_DISTANCE_METRIC_L2, squared, bounds,
+      query, dims);
+}
+void _test_distances_for_chunk_l2_float(const f32 *query, const f32 *base,
+                                        size_t dims, i32 n, const u8 *validity,
+                                        f32 *out) {
+  distances_for_chunk(distance_l2_sqr_float, query, base, dims * sizeof(f32),
+                      &dims, n, validity, out);
+}
+#endif
+
+struct VectorColumnDefinition {
+  char *name;
+  int name_length;
+  size_t dimensions;
+  enum VectorElementType element_type;
+  enum Vec0DistanceMetrics distance_metric;
+  enum Vec0IndexType index_type;
+#if SQLITE_VEC_ENABLE_RESCORE
+  struct Vec0RescoreConfig rescore;
+#endif
+  struct Vec0IvfConfig ivf;
+  struct Vec0DiskannConfig diskann;
+  // normalize=1: vectors are scaled to unit length on insert and at query time,
+  // so cosine distance is a single dot product.
+  int normalize;
+  // chunk_bounds=1: chunks keep a bounding box that KNN scans use to skip
+  // them, see vec0_vector_bounds_supported().
+  int chunk_bounds;
+  // Distance between two vectors of this column, see vec0_column_distance_fn()
+  vec0_distance_f32_fn distance_fn;
+  // NULL if the column has none, see vec0_column_bounded_distance_fn()
+  vec0_bounded_distance_f32_fn distance_bounded_fn;
+};
+
+struct Vec0PartitionColumnDefinition {
+  int type;
+  char * name;
+  int name_length;
+};
+
+struct Vec0AuxiliaryColumnDefinition {
+  int type;
+  char * name;
+  int name_length;
+};
+struct Vec0MetadataColumnDefinition {
+  vec0_metadata_column_kind kind;
+  char * name;
+  int name_length;
+  // TEXT columns declared with `dictionary`: each distinct value is stored
+  // once in _metadatadictNN, and chunks hold its i64 code like an INTEGER
+  // column would.
+  int dictionary;
+};
+
+size_t vector_byte_size(enum VectorElementType element_type,
+                        size_t dimensions) {
+  switch (element_type) {
+  case SQLITE_VEC_ELEMENT_TYPE_FLOAT32:
+    return dimensions * sizeof(f32);
+  case SQLITE_VEC_ELEMENT_TYPE_INT8:
+    return dimensions * sizeof(i8);
+  case SQLITE_VEC_ELEMENT_TYPE_BIT:
+    return dimensions / CHAR_BIT;
+  }
+  return 0;
+}
+
+size_t vector_column_byte_size(struct VectorColumnDefinition column) {
+  return vector_byte_size(column.element_type, column.dimensions);
+}
+
+#if SQLITE_VEC_ENABLE_RESCORE
+/**
+ * @brief Parse rescore options from an "INDEXED BY rescore(...)" clause.
+ *
+ * @param scanner Scanner positioned right after the opening '(' of rescore(...)
+ * @param outConfig Output rescore config
+ * @param pzErr Error message output
+ * @return int SQLITE_OK on success, SQLITE_ERROR on error.
+ */
+static int vec0_parse_rescore_options(struct Vec0Scanner *scanner,
+                                      struct Vec0RescoreConfig *outConfig,
+                                      char **pzErr) {
+  struct Vec0Token token;
+  int rc;
+  int hasQuantizer = 0;
+  outConfig->oversample = 8;
+  outConfig->quantizer_type = 0;
+
+  while (1) {
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc == VEC0_TOKEN_RESULT_EOF) {
+      break;
+    }
+    // ')' closes rescore options
+    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
+      break;
+    }
+    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_IDENTIFIER) {
+      *pzErr = sqlite3_mprintf("Expected option name in rescore(...)");
+      return SQLITE_ERROR;
+    }
+
+    char *key = token.start;
+    int keyLength = token.end - token.start;
+
+    // expect '='
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
+      *pzErr = sqlite3_mprintf("Expected '=' after option name in rescore(...)");
+      return SQLITE_ERROR;
+    }
+
+    // value
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc != VEC0_TOKEN_RESULT_SOME) {
+      *pzErr = sqlite3_mprintf("Expected value after '=' in rescore(...)");
+      return SQLITE_ERROR;
+    }
+
+    if (sqlite3_strnicmp(key, "quantizer", keyLength) == 0) {
+      if (token.token_type != TOKEN_TYPE_IDENTIFIER) {
+        *pzErr = sqlite3_mprintf("Expected identifier for quantizer value in rescore(...)");
+        return SQLITE_ERROR;
+      }
+      int valLen = token.end - token.start;
+      if (sqlite3_strnicmp(token.start, "bit", valLen) == 0) {
+        outConfig->quantizer_type = VEC0_RESCORE_QUANTIZER_BIT;
+      } else if (sqlite3_strnicmp(token.start, "int8", valLen) == 0) {
+        outConfig->quantizer_type = VEC0_RESCORE_QUANTIZER_INT8;
+      } else {
+        *pzErr = sqlite3_mprintf("Unknown quantizer type '%.*s' in rescore(...). Expected 'bit' or 'int8'.", valLen, token.start);
+        return SQLITE_ERROR;
+      }
+      hasQuantizer = 1;
+    } else if (sqlite3_strnicmp(key, "oversample", keyLength) == 0) {
+      if (token.token_type != TOKEN_TYPE_DIGIT) {
+        *pzErr = sqlite3_mprintf("Expected integer for oversample value in rescore(...)");
+        return SQLITE_ERROR;
+      }
+      outConfig->oversample = atoi(token.start);
+      if (outConfig->oversample <= 0 || outConfig->oversample > 128) {
+        *pzErr = sqlite3_mprintf("oversample in rescore(...) must be between 1 and 128, got %d", outConfig->oversample);
+        return SQLITE_ERROR;
+      }
+    } else {
+      *pzErr = sqlite3_mprintf("Unknown option '%.*s' in rescore(...)", keyLength, key);
+      return SQLITE_ERROR;
+    }
+
+    // optional comma between options
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc == VEC0_TOKEN_RESULT_EOF) {
+      break;
+    }
+    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
+      break;
+    }
+    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_COMMA) {
+      continue;
+    }
+    // If it's not a comma or rparen, it might be the next key — push back isn't
+    // possible with this scanner, so we'll treat unexpected tokens as errors
+    *pzErr = sqlite3_mprintf("Unexpected token in rescore(...) options");
+    return SQLITE_ERROR;
+  }
+
+  if (!hasQuantizer) {
+    *pzErr = sqlite3_mprintf("rescore(...) requires a 'quantizer' option (quantizer=bit or quantizer=int8)");
+    return SQLITE_ERROR;
+  }
+
+  return SQLITE_OK;
+}
+#endif /* SQLITE_VEC_ENABLE_RESCORE */
+
+/**
+ * @brief Parse an vec0 vtab argv[i] column definition and see if
+ * it's a vector column defintion, ex `contents_embedding float[768]`.
+ *
+ * @param source vec0 argv[i] item
+ * @param source_length length of source in bytes
+ * @param outColumn Output the parse vector column to this struct, if success
+ * @return int SQLITE_OK on success, SQLITE_EMPTY is it's not a vector column
+ * definition, SQLITE_ERROR on error.
+ */
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+// Forward declaration — defined in sqlite-vec-ivf.c
+static int vec0_parse_ivf_options(struct Vec0Scanner *scanner,
+                                   struct Vec0IvfConfig *config);
+#endif
+
+/**
+ * Parse the options inside diskann(...) parentheses.
+ * Scanner should be positioned right before the '(' token.
+ *
+ * Recognized options:
+ *   neighbor_quantizer = binary | int8       (required)
+ *   n_neighbors = <integer>                  (optional, default 72)
+ *   search_list_size = <integer>             (optional, default 128)
+ */
+static int vec0_parse_diskann_options(struct Vec0Scanner *scanner,
+                                       struct Vec0DiskannConfig *config) {
+  int rc;
+  struct Vec0Token token;
+  int hasQuantizer = 0;
+
+  // Set defaults
+  config->n_neighbors = VEC0_DISKANN_DEFAULT_N_NEIGHBORS;
+  config->search_list_size = VEC0_DISKANN_DEFAULT_SEARCH_LIST_SIZE;
+  config->search_list_size_search = 0;
+  config->search_list_size_insert = 0;
+  config->alpha = VEC0_DISKANN_DEFAULT_ALPHA;
+  config->buffer_threshold = 0;
+  int hasSearchListSize = 0;
+  int hasSearchListSizeSplit = 0;
+
+  // Expect '('
+  rc = vec0_scanner_next(scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_LPAREN) {
+    return SQLITE_ERROR;
+  }
+
+  while (1) {
+    // key
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
+      break;  // empty parens or trailing comma
+    }
+    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_IDENTIFIER) {
+      return SQLITE_ERROR;
+    }
+    char *optKey = token.start;
+    int optKeyLen = token.end - token.start;
+
+    // '='
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
+      return SQLITE_ERROR;
+    }
+
+    // value (identifier or digit)
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc != VEC0_TOKEN_RESULT_SOME) {
+      return SQLITE_ERROR;
+    }
+    char *optVal = token.start;
+    int optValLen = token.end - token.start;
+
+    if (sqlite3_strnicmp(optKey, "neighbor_quantizer", optKeyLen) == 0) {
+      if (sqlite3_strnicmp(optVal, "binary", optValLen) == 0) {
+        config->quantizer_type = VEC0_DISKANN_QUANTIZER_BINARY;
+      } else if (sqlite3_strnicmp(optVal, "int8", optValLen) == 0) {
+        config->quantizer_type = VEC0_DISKANN_QUANTIZER_INT8;
+      } else {
+        return SQLITE_ERROR;  // unknown quantizer
+      }
+      hasQuantizer = 1;
+    } else if (sqlite3_strnicmp(optKey, "n_neighbors", optKeyLen) == 0) {
+      config->n_neighbors = atoi(optVal);
+      if (config->n_neighbors <= 0 || (config->n_neighbors % 8) != 0 ||
+          config->n_neighbors > VEC0_DISKANN_MAX_N_NEIGHBORS) {
+        return SQLITE_ERROR;
+      }
+    } else if (sqlite3_strnicmp(optKey, "search_list_size_search", optKeyLen) == 0 && optKeyLen == 23) {
+      config->search_list_size_search = atoi(optVal);
+      if (config->search_list_size_search <= 0) {
+        return SQLITE_ERROR;
+      }
+      hasSearchListSizeSplit = 1;
+    } else if (sqlite3_strnicmp(optKey, "search_list_size_insert", optKeyLen) == 0 && optKeyLen == 23) {
+      config->search_list_size_insert = atoi(optVal);
+      if (config->search_list_size_insert <= 0) {
+        return SQLITE_ERROR;
+      }
+      hasSearchListSizeSplit = 1;
+    } else if (sqlite3_strnicmp(optKey, "search_list_size", optKeyLen) == 0) {
+      config->search_list_size = atoi(optVal);
+      if (config->search_list_size <= 0) {
+        return SQLITE_ERROR;
+      }
+      hasSearchListSize = 1;
+    } else if (sqlite3_strnicmp(optKey, "buffer_threshold", optKeyLen) == 0) {
+      config->buffer_threshold = atoi(optVal);
+      if (config->buffer_threshold < 0) {
+        return SQLITE_ERROR;
+      }
+    } else {
+      return SQLITE_ERROR;  // unknown option
+    }
+
+    // Expect ',' or ')'
+    rc = vec0_scanner_next(scanner, &token);
+    if (rc == VEC0_TOKEN_RESULT_SOME && token.token_type == TOKEN_TYPE_RPAREN) {
+      break;
+    }
+    if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_COMMA) {
+      return SQLITE_ERROR;
+    }
+  }
+
+  if (!hasQuantizer) {
+    return SQLITE_ERROR;  // neighbor_quantizer is required
+  }
+
+  if (hasSearchListSize && hasSearchListSizeSplit) {
+    return SQLITE_ERROR;  // cannot mix search_list_size with search_list_size_search/insert
+  }
+
+  return SQLITE_OK;
+}
+
+int vec0_parse_vector_column(const char *source, int source_length,
+                        struct VectorColumnDefinition *outColumn) {
+  // parses a vector column definition like so:
+  // "abc float[123]", "abc_123 bit[1234]", eetc.
+  // https://github.com/asg017/sqlite-vec/issues/46
+  int rc;
+  struct Vec0Scanner scanner;
+  struct Vec0Token token;
+
+  char *name;
+  int nameLength;
+  enum VectorElementType elementType;
+  enum Vec0DistanceMetrics distanceMetric = VEC0_DISTANCE_METRIC_L2;
+  enum Vec0IndexType indexType = VEC0_INDEX_TYPE_FLAT;
+#if SQLITE_VEC_ENABLE_RESCORE
+  struct Vec0RescoreConfig rescoreConfig;
+  memset(&rescoreConfig, 0, sizeof(rescoreConfig));
+#endif
+  struct Vec0IvfConfig ivfConfig;
+  memset(&ivfConfig, 0, sizeof(ivfConfig));
+  struct Vec0DiskannConfig diskannConfig;
+  memset(&diskannConfig, 0, sizeof(diskannConfig));
+  int normalize = 0;
+  int chunkBounds = 0;
+  int dimensions;
+  vec0_scanner_init(&scanner, source, source_length);
+
+  // starts with an identifier
+  rc = vec0_scanner_next(&scanner, &token);
+
+  if (rc != VEC0_TOKEN_RESULT_SOME &&
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+
+  name = token.start;
+  nameLength = token.end - token.start;
+
+  // vector column type comes next: float, int, or bit
+  rc = vec0_scanner_next(&scanner, &token);
+
+  if (rc != VEC0_TOKEN_RESULT_SOME ||
+      token.token_type != TOKEN_TYPE_IDENTIFIER) {
+    return SQLITE_EMPTY;
+  }
+  if (sqlite3_strnicmp(token.start, "float", 5) == 0 ||
+      sqlite3_strnicmp(token.start, "f32", 3) == 0) {
+    elementType = SQLITE_VEC_ELEMENT_TYPE_FLOAT32;
+  } else if (sqlite3_strnicmp(token.start, "int8", 4) == 0 ||
+             sqlite3_strnicmp(token.start, "i8", 2) == 0) {
+    elementType = SQLITE_VEC_ELEMENT_TYPE_INT8;
+  } else if (sqlite3_strnicmp(token.start, "bit", 3) == 0) {
+    elementType = SQLITE_VEC_ELEMENT_TYPE_BIT;
+  } else {
+    return SQLITE_EMPTY;
+  }
+
+  // left '[' bracket
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_LBRACKET) {
+    return SQLITE_EMPTY;
+  }
+
+  // digit, for vector dimension length
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_DIGIT) {
+    return SQLITE_ERROR;
+  }
+  dimensions = atoi(token.start);
+  if (dimensions <= 0) {
+    return SQLITE_ERROR;
+  }
+
+  // // right ']' bracket
+  rc = vec0_scanner_next(&scanner, &token);
+  if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_RBRACKET) {
+    return SQLITE_ERROR;
+  }
+
+  // any other tokens left should be column-level options , ex `key=value`
+  // ex `distance_metric=L2 distance_metric=cosine` should error
+  while (1) {
+    // should be EOF or identifier (option key)
+    rc = vec0_scanner_next(&scanner, &token);
+    if (rc == VEC0_TOKEN_RESULT_EOF) {
+      break;
+    }
+
+    if (rc != VEC0_TOKEN_RESULT_SOME &&
+        token.token_type != TOKEN_TYPE_IDENTIFIER) {
+      return SQLITE_ERROR;
+    }
+
+    char *key = token.start;
+    int keyLength = token.end - token.start;
+
+    if (sqlite3_strnicmp(key, "distance_metric", keyLength) == 0) {
+
+      if (elementType == SQLITE_VEC_ELEMENT_TYPE_BIT) {
+        return SQLITE_ERROR;
+      }
+      // ensure equal sign after distance_metric
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME && token.token_type != TOKEN_TYPE_EQ) {
+        return SQLITE_ERROR;
+      }
+
+      // distance_metric value, an identifier (L2, cosine, etc)
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME &&
+          token.token_type != TOKEN_TYPE_IDENTIFIER) {
+        return SQLITE_ERROR;
+      }
+
+      char *value = token.start;
+      int valueLength = token.end - token.start;
+      if (sqlite3_strnicmp(value, "l2", valueLength) == 0) {
+        distanceMetric = VEC0_DISTANCE_METRIC_L2;
+      } else if (sqlite3_strnicmp(value, "l1", valueLength) == 0) {
+        distanceMetric = VEC0_DISTANCE_METRIC_L1;
+      } else if (sqlite3_strnicmp(value, "cosine", valueLength) == 0) {
+        distanceMetric = VEC0_DISTANCE_METRIC_COSINE;
+      } else {
+        return SQLITE_ERROR;
+      }
+    }
+    // INDEXED BY flat() | rescore(...)
+    else if (sqlite3_strnicmp(key, "indexed", keyLength) == 0) {
+      // expect "by"
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME ||
+          token.token_type != TOKEN_TYPE_IDENTIFIER ||
+          sqlite3_strnicmp(token.start, "by", token.end - token.start) != 0) {
+        return SQLITE_ERROR;
+      }
+      // expect index type name
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME ||
+          token.token_type != TOKEN_TYPE_IDENTIFIER) {
+        return SQLITE_ERROR;
+      }
+      int indexNameLen = token.end - token.start;
+      if (sqlite3_strnicmp(token.start, "flat", indexNameLen) == 0) {
+        indexType = VEC0_INDEX_TYPE_FLAT;
+        // expect '('
+        rc = vec0_scanner_next(&scanner, &token);
+        if (rc != VEC0_TOKEN_RESULT_SOME ||
+            token.token_type != TOKEN_TYPE_LPAREN) {
+          return SQLITE_ERROR;
+        }
+        // expect ')'
+        rc = vec0_scanner_next(&scanner, &token);
+        if (rc != VEC0_TOKEN_RESULT_SOME ||
+            token.token_type != TOKEN_TYPE_RPAREN) {
+          return SQLITE_ERROR;
+        }
+      }
+#if SQLITE_VEC_ENABLE_RESCORE
+      else if (sqlite3_strnicmp(token.start, "rescore", indexNameLen) == 0) {
+        indexType = VEC0_INDEX_TYPE_RESCORE;
+        if (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+          return SQLITE_ERROR;
+        }
+        // expect '('
+        rc = vec0_scanner_next(&scanner, &token);
+        if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_LPAREN) {
+          return SQLITE_ERROR;
+        }
+        char *rescoreErr = NULL;
+        rc = vec0_parse_rescore_options(&scanner, &rescoreConfig, &rescoreErr);
+        if (rc != SQLITE_OK) {
+          if (rescoreErr) sqlite3_free(rescoreErr);
+          return SQLITE_ERROR;
+        }
+        // validate dimensions for bit quantizer
+        if (rescoreConfig.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT &&
+            (dimensions % CHAR_BIT) != 0) {
+          return SQLITE_ERROR;
+        }
+      }
+#endif
+      else if (sqlite3_strnicmp(token.start, "ivf", indexNameLen) == 0) {
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+        indexType = VEC0_INDEX_TYPE_IVF;
+        memset(&ivfConfig, 0, sizeof(ivfConfig));
+        rc = vec0_parse_ivf_options(&scanner, &ivfConfig);
+        if (rc != SQLITE_OK) {
+          return SQLITE_ERROR;
+        }
+        if (ivfConfig.quantizer == VEC0_IVF_QUANTIZER_BINARY && (dimensions % 8) != 0) {
+          return SQLITE_ERROR;
+        }
+#else
+        return SQLITE_ERROR; // IVF not compiled in
+#endif
+      } else if (sqlite3_strnicmp(token.start, "diskann", indexNameLen) == 0) {
+#if SQLITE_VEC_ENABLE_DISKANN
+        indexType = VEC0_INDEX_TYPE_DISKANN;
+        rc = vec0_parse_diskann_options(&scanner, &diskannConfig);
+        if (rc != SQLITE_OK) {
+          return rc;
+        }
+#else
+        return SQLITE_ERROR;
+#endif
+      } else {
+        // unknown index type
+        return SQLITE_ERROR;
+      }
+    }
+    // normalize=0 | normalize=1
+    else if (sqlite3_strnicmp(key, "normalize", keyLength) == 0) {
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
+        return SQLITE_ERROR;
+      }
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME ||
+          token.token_type != TOKEN_TYPE_DIGIT ||
+          (token.end - token.start) != 1 ||
+          (token.start[0] != '0' && token.start[0] != '1')) {
+        return SQLITE_ERROR;
+      }
+      normalize = token.start[0] == '1';
+    }
+    // chunk_bounds=0 | chunk_bounds=1
+    else if (sqlite3_strnicmp(key, "chunk_bounds", keyLength) == 0) {
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
+        return SQLITE_ERROR;
+      }
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME ||
+          token.token_type != TOKEN_TYPE_DIGIT ||
+          (token.end - token.start) != 1 ||
+          (token.start[0] != '0' && token.start[0] != '1')) {
+        return SQLITE_ERROR;
+      }
+      chunkBounds = token.start[0] == '1';
+    }
+    // unknown key
+    else {
+      return SQLITE_ERROR;
+    }
+  }
+
+  // normalizing only preserves the ranking of cosine distance, and int8/bit
+  // vectors can't hold unit-length values.
+  if (normalize && (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32 ||
+                    distanceMetric != VEC0_DISTANCE_METRIC_COSINE)) {
+    return SQLITE_ERROR;
+  }
+  // bounding boxes only bound float32 L2 and L1 distances in plain chunks
+  if (chunkBounds && (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32 ||
+                      indexType != VEC0_INDEX_TYPE_FLAT ||
+                      (distanceMetric != VEC0_DISTANCE_METRIC_L2 &&
+                       distanceMetric != VEC0_DISTANCE_METRIC_L1))) {
+    return SQLITE_ERROR;
+  }
+
+  outColumn->name = sqlite3_mprintf("%.*s", nameLength, name);
+  if (!outColumn->name) {
+    return SQLITE_ERROR;
+  }
+  outColumn->name_length = nameLength;
+  outColumn->distance_metric = distanceMetric;
+  outColumn->element_type = elementType;
+  outColumn->dimensions = dimensions;
+  outColumn->index_type = indexType;
+#if SQLITE_VEC_ENABLE_RESCORE
+  outColumn->rescore = rescoreConfig;
+#endif
+  outColumn->ivf = ivfConfig;
+  outColumn->diskann = diskannConfig;
+  outColumn->normalize = normalize;
+  outColumn->chunk_bounds = chunkBounds;
+  outColumn->distance_fn = vec0_column_distance_fn(elementType, distanceMetric,
+                                                   dimensions, normalize);
+  outColumn->distance_bounded_fn =
+      vec0_column_bounded_distance_fn(elementType, distanceMetric, dimensions);
+  return SQLITE_OK;
+}
+
+#pragma region vec_each table function
+
+typedef struct vec_each_vtab vec_each_vtab;
+struct vec_each_vtab {
+  sqlite3_vtab base;
+};
+
+typedef struct vec_each_cursor vec_each_cursor;
+struct vec_each_cursor {
+  sqlite3_vtab_cursor base;
+  i64 iRowid;
+  enum VectorElementType vector_type;
+  void *vector;
+  size_t dimensions;
+  vector_cleanup cleanup;
+};
+
+static int vec_eachConnect(sqlite3 *db, void *pAux, int argc,
+                           const char *const *argv, sqlite3_vtab **ppVtab,
+                           char **pzErr) {
+  UNUSED_PARAMETER(pAux);
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+  UNUSED_PARAMETER(pzErr);
+  vec_each_vtab *pNew;
+  int rc;
+
+  rc = sqlite3_declare_vtab(db, "CREATE TABLE x(value, vector hidden)");
+#define VEC_EACH_COLUMN_VALUE 0
+#define VEC_EACH_COLUMN_VECTOR 1
+  if (rc == SQLITE_OK) {
+    pNew = sqlite3_malloc(sizeof(*pNew));
+    *ppVtab = (sqlite3_vtab *)pNew;
+    if (pNew == 0)
+      return SQLITE_NOMEM;
+    memset(pNew, 0, sizeof(*pNew));
+  }
+  return rc;
+}
+
+static int vec_eachDisconnect(sqlite3_vtab *pVtab) {
+  vec_each_vtab *p = (vec_each_vtab *)pVtab;
+  sqlite3_free(p);
+  return SQLITE_OK;
+}
+
+static int vec_eachOpen(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
+  UNUSED_PARAMETER(p);
+  vec_each_cursor *pCur;
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if (pCur == 0)
+    return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static int vec_eachClose(sqlite3_vtab_cursor *cur) {
+  vec_each_cursor *pCur = (vec_each_cursor *)cur;
+  if(pCur->vector) {
+    pCur->cleanup(pCur->vector);
+  }
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+static int vec_eachBestIndex(sqlite3_vtab *pVTab,
+                             sqlite3_index_info *pIdxInfo) {
+  UNUSED_PARAMETER(pVTab);
+  int hasVector = 0;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    const struct sqlite3_index_constraint *pCons = &pIdxInfo->aConstraint[i];
+    // printf("i=%d iColumn=%d, op=%d, usable=%d\n", i, pCons->iColumn,
+    // pCons->op, pCons->usable);
+    switch (pCons->iColumn) {
+    case VEC_EACH_COLUMN_VECTOR: {
+      if (pCons->op == SQLITE_INDEX_CONSTRAINT_EQ && pCons->usable) {
+        hasVector = 1;
+        pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+        pIdxInfo->aConstraintUsage[i].omit = 1;
+      }
+      break;
+    }
+    }
+  }
+  if (!hasVector) {
+    return SQLITE_CONSTRAINT;
+  }
+
+  pIdxInfo->estimatedCost = (double)100000;
+  pIdxInfo->estimatedRows = 100000;
+
+  return SQLITE_OK;
+}
+
+static int vec_eachFilter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
+                          const char *idxStr, int argc, sqlite3_value **argv) {
+  UNUSED_PARAMETER(idxNum);
+  UNUSED_PARAMETER(idxStr);
+  assert(argc == 1);
+  vec_each_cursor *pCur = (vec_each_cursor *)pVtabCursor;
+
+  if (pCur->vector) {
+    pCur->cleanup(pCur->vector);
+    pCur->vector = NULL;
+  }
+
+  char *pzErrMsg;
+  int rc = vector_from_value(argv[0], &pCur->vector, &pCur->dimensions,
+                             &pCur->vector_type, &pCur->cleanup, &pzErrMsg);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(pzErrMsg);
+    return SQLITE_ERROR;
+  }
+  pCur->iRowid = 0;
+  return SQLITE_OK;
+}
+
+static int vec_eachRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
+  vec_each_cursor *pCur = (vec_each_cursor *)cur;
+  *pRowid = pCur->iRowid;
+  return SQLITE_OK;
+}
+
+static int vec_eachEof(sqlite3_vtab_cursor *cur) {
+  vec_each_cursor *pCur = (vec_each_cursor *)cur;
+  return pCur->iRowid >= (i64)pCur->dimensions;
+}
+
+static int vec_eachNext(sqlite3_vtab_cursor *cur) {
+  vec_each_cursor *pCur = (vec_each_cursor *)cur;
+  pCur->iRowid++;
+  return SQLITE_OK;
+}
+
+static int vec_eachColumn(sqlite3_vtab_cursor *cur, sqlite3_context *context,
+                          int i) {
+  vec_each_cursor *pCur = (vec_each_cursor *)cur;
+  switch (i) {
+  case VEC_EACH_COLUMN_VALUE:
+    switch (pCur->vector_type) {
+    case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
+      sqlite3_result_double(context, ((f32 *)pCur->vector)[pCur->iRowid]);
+      break;
+    }
+    case SQLITE_VEC_ELEMENT_TYPE_BIT: {
+      u8 x = ((u8 *)pCur->vector)[pCur->iRowid / CHAR_BIT];
+      sqlite3_result_int(context,
+                         (x & (0b10000000 >> ((pCur->iRowid % CHAR_BIT)))) > 0);
+      break;
+    }
+    case SQLITE_VEC_ELEMENT_TYPE_INT8: {
+      sqlite3_result_int(context, ((i8 *)pCur->vector)[pCur->iRowid]);
+      break;
+    }
+    }
+
+    break;
+  }
+  return SQLITE_OK;
+}
+
+static sqlite3_module vec_eachModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ vec_eachConnect,
+    /* xBestIndex  */ vec_eachBestIndex,
+    /* xDisconnect */ vec_eachDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ vec_eachOpen,
+    /* xClose      */ vec_eachClose,
+    /* xFilter     */ vec_eachFilter,
+    /* xNext       */ vec_eachNext,
+    /* xEof        */ vec_eachEof,
+    /* xColumn     */ vec_eachColumn,
+    /* xRowid      */ vec_eachRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+#if SQLITE_VERSION_NUMBER >= 3044000
+    /* xIntegrity  */ 0
+#endif
+};
+
+#pragma endregion
+
+
+
+#pragma region vec0 virtual table
+
+#define VEC0_COLUMN_ID 0
+#define VEC0_COLUMN_USERN_START 1
+#define VEC0_COLUMN_OFFSET_COMMAND 1
+#define VEC0_COLUMN_OFFSET_DISTANCE 2
+#define VEC0_COLUMN_OFFSET_K 3
+
+#define VEC0_SHADOW_INFO_NAME "\"%w\".\"%w_info\""
+
+#define VEC0_SHADOW_CHUNKS_NAME "\"%w\".\"%w_chunks\""
+/// 1) schema, 2) original vtab table name
+#define VEC0_SHADOW_CHUNKS_CREATE                                              \
+  "CREATE TABLE " VEC0_SHADOW_CHUNKS_NAME "("                                  \
+  "chunk_id INTEGER PRIMARY KEY AUTOINCREMENT,"                                \
+  "size INTEGER NOT NULL,"                                                     \
+  "validity BLOB NOT NULL,"                                                    \
+  "rowids BLOB NOT NULL"                                                       \
+  ");"
+
+#define VEC0_SHADOW_ROWIDS_NAME "\"%w\".\"%w_rowids\""
+/// 1) schema, 2) original vtab table name
+#define VEC0_SHADOW_ROWIDS_CREATE_BASIC                                        \
+  "CREATE TABLE " VEC0_SHADOW_ROWIDS_NAME "("                                  \
+  "rowid INTEGER PRIMARY KEY AUTOINCREMENT,"                                   \
+  "id,"                                                                        \
+  "chunk_id INTEGER,"                                                          \
+  "chunk_offset INTEGER"                                                       \
+  ");"
+
+// vec0 tables with a text primary keys are still backed by int64 primary keys,
+// since a fixed-length rowid is required for vec0 chunks. But we add a new 'id
+// text unique' column to emulate a text primary key interface.
+#define VEC0_SHADOW_ROWIDS_CREATE_PK_TEXT                                      \
+  "CREATE TABLE " VEC0_SHADOW_ROWIDS_NAME "("                                  \
+  "rowid INTEGER PRIMARY KEY AUTOINCREMENT,"                                   \
+  "id TEXT UNIQUE NOT NULL,"                                                   \
+  "chunk_id INTEGER,"                                                          \
+  "chunk_offset INTEGER"                                                       \
+  ");"
+
+/// 1) schema, 2) original vtab table name
+#define VEC0_SHADOW_VECTOR_N_NAME "\"%w\".\"%w_vector_chunks%02d\""
+
+/// 1) schema, 2) original vtab table name
+//
+// IMPORTANT: "rowid" is declared as PRIMARY KEY but WITHOUT the INTEGER type.
+// This means it is NOT a true SQLite rowid alias — the user-defined "rowid"
+// column and the internal SQLite rowid (_rowid_) are two separate values.
+// When inserting, both must be set explicitly to keep them in sync. See the
+// _rowid_ bindings in vec0_new_chunk() and the explanation in
+// SHADOW_TABLE_ROWID_QUIRK below.
+#define VEC0_SHADOW_VECTOR_N_CREATE                                            \
+  "CREATE TABLE " VEC0_SHADOW_VECTOR_N_NAME "("                                \
+  "rowid PRIMARY KEY,"                                                         \
+  "vectors BLOB NOT NULL"                                                      \
+  ");"
+
+/// 1) schema, 2) original vtab table name, 3) vector column index
+//
+// One row per chunk, keyed by the chunk's rowid in _chunks. "bounds" holds
+// the per-dimension minimum and then maximum (float32) of every vector
+// written to the chunk, "deletes" how many rows were removed or overwritten
+// since the box was last rebuilt. See vec0_vector_bounds_supported().
+#define VEC0_SHADOW_VECTOR_BOUNDS_N_NAME "\"%w\".\"%w_vector_bounds%02d\""
+
+// A chunk's box is rebuilt from its remaining rows once 1/N of the chunk has
+// been deleted or overwritten since the last rebuild.
+#define VEC0_VECTOR_BOUNDS_REBUILD_FRACTION 8
+
+#define VEC0_SHADOW_VECTOR_BOUNDS_N_CREATE                                     \
+  "CREATE TABLE " VEC0_SHADOW_VECTOR_BOUNDS_N_NAME "("                         \
+  "rowid INTEGER PRIMARY KEY,"                                                 \
+  "bounds BLOB NOT NULL,"                                                      \
+  "deletes INTEGER NOT NULL DEFAULT 0"                                         \
+  ");"
+
+/// 1) schema, 2) original vtab table name
+//
+// One row per chunk with empty slots, keyed by the chunk's rowid in _chunks.
+// "free" counts the chunk's empty slots, whether never used or freed by a
+// delete. Inserts fill the oldest chunk of their partition listed here before
+// starting a new one. See vec0_free_slots_next_chunk().
+#define VEC0_SHADOW_FREE_SLOTS_NAME "\"%w\".\"%w_free_slots\""
+
+#define VEC0_SHADOW_FREE_SLOTS_CREATE                                          \
+  "CREATE TABLE " VEC0_SHADOW_FREE_SLOTS_NAME "("                              \
+  "rowid INTEGER PRIMARY KEY,"                                                 \
+  "free INTEGER NOT NULL"                                                      \
+  ");"
+
+#define VEC0_SHADOW_AUXILIARY_NAME "\"%w\".\"%w_auxiliary\""
+
+#define VEC0_SHADOW_METADATA_N_NAME "\"%w\".\"%w_metadatachunks%02d\""
+#define VEC0_SHADOW_VECTORS_N_NAME "\"%w\".\"%w_vectors%02d\""
+#define VEC0_SHADOW_DISKANN_NODES_N_NAME "\"%w\".\"%w_diskann_nodes%02d\""
+#define VEC0_SHADOW_DISKANN_BUFFER_N_NAME "\"%w\".\"%w_diskann_buffer%02d\""
+#define VEC0_SHADOW_METADATA_TEXT_DATA_NAME "\"%w\".\"%w_metadatatext%02d\""
+
+/// 1) schema, 2) original vtab table name, 3) metadata column index
+//
+// The distinct values of a `text dictionary` metadata column. A value's rowid
+// is its code in _metadatachunksNN. Codes start at 1, empty slots hold 0.
+// Values stay in the dictionary after the last row using them is deleted.
+#define VEC0_SHADOW_METADATA_DICT_N_NAME "\"%w\".\"%w_metadatadict%02d\""
+
+#define VEC0_SHADOW_METADATA_DICT_N_CREATE                                     \
+  "CREATE TABLE " VEC0_SHADOW_METADATA_DICT_N_NAME "("                         \
+  "rowid INTEGER PRIMARY KEY,"                                                 \
+  "value TEXT NOT NULL UNIQUE"                                                 \
+  ");"
+
+/// 1) schema, 2) original vtab table name, 3) metadata column index
+//
+// One row per chunk, keyed by the chunk's rowid in _chunks: the smallest
+// ("lo") and largest ("hi") value written to the chunk's slots, NULL while
+// none has been, and how many rows were removed or overwritten since the
+// range was last rebuilt. Booleans are 0 or 1, so lo = 1 means all true and
+// hi = 0 all false. TEXT columns don't keep one.
+#define VEC0_SHADOW_METADATA_BOUNDS_N_NAME "\"%w\".\"%w_metadatabounds%02d\""
+
+#define VEC0_SHADOW_METADATA_BOUNDS_N_CREATE                                   \
+  "CREATE TABLE " VEC0_SHADOW_METADATA_BOUNDS_N_NAME "("                       \
+  "rowid INTEGER PRIMARY KEY,"                                                 \
+  "lo,"                                                                        \
+  "hi,"                                                                        \
+  "deletes INTEGER NOT NULL DEFAULT 0"                                         \
+  ");"
+
+// Rows still to be moved by the 'reorganize' command, in order. Created by
+// the first 'reorganize', see sqlite-vec-reorganize.c.
+#define VEC0_SHADOW_REORGANIZE_NAME "\"%w\".\"%w_reorganize\""
+
+#define VEC_INTERAL_ERROR "Internal sqlite-vec error: "
+#define REPORT_URL "https://github.com/asg017/sqlite-vec/issues/new"
+
+typedef struct vec0_vtab vec0_vtab;
+
+#define VEC0_MAX_VECTOR_COLUMNS   16
+#define VEC0_MAX_PARTITION_COLUMNS 4
+#define VEC0_MAX_AUXILIARY_COLUMNS 16
+#define VEC0_MAX_METADATA_COLUMNS 16
+
+#define SQLITE_VEC_VEC0_MAX_DIMENSIONS 8192
+#define VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH 16
+#define VEC0_METADATA_TEXT_VIEW_DATA_LENGTH 12
+
+typedef enum {
+  // vector column, ie "contents_embedding float[1024]"
+  SQLITE_VEC0_USER_COLUMN_KIND_VECTOR = 1,
+
+  // partition key column, ie "user_id integer partition key"
+  SQLITE_VEC0_USER_COLUMN_KIND_PARTITION = 2,
+
+  //
+  SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY = 3,
+
+  // metadata column that can be filtered, ie "genre text"
+  SQLITE_VEC0_USER_COLUMN_KIND_METADATA = 4,
+} vec0_user_column_kind;
+
+struct vec0_vtab {
+  sqlite3_vtab base;
+
+  // the SQLite connection of the host database
+  sqlite3 *db;
+
+  // True if the primary key of the vec0 table has a column type TEXT.
+  // Will change the schema of the _rowids table, and insert/query logic.
+  int pkIsText;
+
+  // True if the hidden command column (named after the table) exists.
+  // Tables created before v0.1.10 or without _info table don't have it.
+  int hasCommandColumn;
+
+  // True if the hidden query_idx column exists. Left out when a user column
+  // already has that name.
+  int hasQueryIdxColumn;
+
+  // number of defined vector columns.
+  int numVectorColumns;
+
+  // number of defined PARTITION KEY columns.
+  int numPartitionColumns;
+
+  // number of defined auxiliary columns
+  int numAuxiliaryColumns;
+
+  // number of defined metadata columns
+  int numMetadataColumns;
+
+
+  // Name of the schema the table exists on.
+  // Must be freed with sqlite3_free()
+  char *schemaName;
+
+  // Name of the table the table exists on.
+  // Must be freed with sqlite3_free()
+  char *tableName;
+
+  // Name of the _rowids shadow table.
+  // Must be freed with sqlite3_free()
+  char *shadowRowidsName;
+
+  // Name of the _chunks shadow table.
+  // Must be freed with sqlite3_free()
+  char *shadowChunksName;
+
+  // contains enum vec0_user_column_kind values for up to
+  // numVectorColumns + numPartitionColumns entries
+  vec0_user_column_kind user_column_kinds[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+
+  uint8_t user_column_idxs[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+
+
+  // Name of all the vector chunk shadow tables.
+  // Ex '_vector_chunks00'
+  // Only the first numVectorColumns entries will be available.
+  // The first numVectorColumns entries must be freed with sqlite3_free()
+  char *shadowVectorChunksNames[VEC0_MAX_VECTOR_COLUMNS];
+
+  // Name of the per-chunk bounding box shadow tables, ie `_vector_bounds00`.
+  // NULL for vector columns without bounds, either because the column isn't
+  // supported or because the table was created before they existed.
+  // Must be freed with sqlite3_free()
+  char *shadowVectorBoundsNames[VEC0_MAX_VECTOR_COLUMNS];
+
+  // Name of the _free_slots shadow table. NULL for tables created before it
+  // existed, until an 'optimize' adds it, and for tables without chunks.
+  // Must be freed with sqlite3_free()
+  char *shadowFreeSlotsName;
+
+#if SQLITE_VEC_ENABLE_RESCORE
+  // Name of all rescore chunk shadow tables, ie `_rescore_chunks00`
+  // Only populated for vector columns with rescore enabled.
+  // Must be freed with sqlite3_free()
+  char *shadowRescoreChunksNames[VEC0_MAX_VECTOR_COLUMNS];
+
+  // Name of all rescore vector shadow tables, ie `_rescore_vectors00`
+  // Rowid-keyed table for fast random-access float vector reads during rescore.
+  // Only populated for vector columns with rescore enabled.
+  // Must be freed with sqlite3_free()
+  char *shadowRescoreVectorsNames[VEC0_MAX_VECTOR_COLUMNS];
+#endif
+
+  // Name of all metadata chunk shadow tables, ie `_metadatachunks00`
+  // Only the first numMetadataColumns entries will be available.
+  // The first numMetadataColumns entries must be freed with sqlite3_free()
+  char *shadowMetadataChunksNames[VEC0_MAX_METADATA_COLUMNS];
+
+  // Name of the per-chunk value range shadow tables, ie `_metadatabounds00`.
+  // NULL for TEXT columns, and for tables created before ranges were kept.
+  // Must be freed with sqlite3_free()
+  char *shadowMetadataBoundsNames[VEC0_MAX_METADATA_COLUMNS];
+
+  struct VectorColumnDefinition vector_columns[VEC0_MAX_VECTOR_COLUMNS];
+  struct Vec0PartitionColumnDefinition paritition_columns[VEC0_MAX_PARTITION_COLUMNS];
+  struct Vec0AuxiliaryColumnDefinition auxiliary_columns[VEC0_MAX_AUXILIARY_COLUMNS];
+  struct Vec0MetadataColumnDefinition metadata_columns[VEC0_MAX_METADATA_COLUMNS];
+
+  int chunk_size;
+
+  // KNN query buffers, reused across queries
+  struct Vec0Scratch scratch;
+
+  // Where the last insert into each partition went, so the next one can skip
+  // looking up a chunk with room. A hash table of insertCursorsCapacity
+  // buckets, see vec0_insert_cursor_get(). Dropped on rollbacks, deletes and
+  // commits from other connections.
+  struct Vec0InsertCursor **insertCursors;
+  int insertCursorsCapacity;
+  int numInsertCursors;
+  // PRAGMA data_version the cursors are valid for, and whether it was checked
+  // in the current transaction
+  i64 insertCursorsDataVersion;
+  int insertCursorsChecked;
+
+  // set with the 'write_behind=N' command: inserted rows are staged here and
+  // written to their chunks at most N rows later, see
+  // vec0_write_behind_flush(). 0 writes every row right away.
+  int writeBehind;
+  struct Vec0StagedRow *stagedRows;
+  int numStagedRows;
+  int stagedRowsCapacity;
+
+#if SQLITE_VEC_ENABLE_PREFETCH
+  // set with the 'prefetch=0|1' command: KNN scans read the next chunk ahead
+  // on a helper thread while the current one is scored.
+  int prefetch;
+  // read-only connection the helper thread reads through, lazily opened
+  sqlite3 *prefetchDb;
+  // per-connection stats of the last KNN scan, owned by the vec0 module
+  struct Vec0ScanStats *scanStats;
+#endif
+
+#if SQLITE_VEC_ENABLE_THREADS
+  // set with the 'threads=N' command: flat KNN scans score chunks on N
+  // worker threads, 0 scans serially.
+  int threads;
+  // workers for parallel scans, started on the first one
+  struct Vec0ThreadPool *threadPool;
+#endif
+
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+  // IVF cached state per vector column
+  char *shadowIvfCellsNames[VEC0_MAX_VECTOR_COLUMNS];   // table name for blob_open
+  int ivfTrainedCache[VEC0_MAX_VECTOR_COLUMNS];          // -1=unknown, 0=no, 1=yes
+  sqlite3_stmt *stmtIvfCellMeta[VEC0_MAX_VECTOR_COLUMNS];      // SELECT n_vectors, length(validity)*8 FROM cells WHERE cell_id=?
+  sqlite3_stmt *stmtIvfCellUpdateN[VEC0_MAX_VECTOR_COLUMNS];   // UPDATE cells SET n_vectors=n_vectors+? WHERE cell_id=?
+  sqlite3_stmt *stmtIvfRowidMapInsert[VEC0_MAX_VECTOR_COLUMNS]; // INSERT INTO rowid_map(rowid,cell_id,slot) VALUES(?,?,?)
+  sqlite3_stmt *stmtIvfRowidMapLookup[VEC0_MAX_VECTOR_COLUMNS]; // SELECT cell_id,slot FROM rowid_map WHERE rowid=?
+  sqlite3_stmt *stmtIvfRowidMapDelete[VEC0_MAX_VECTOR_COLUMNS]; // DELETE FROM rowid_map WHERE rowid=?
+  sqlite3_stmt *stmtIvfCentroidsAll[VEC0_MAX_VECTOR_COLUMNS];   // SELECT centroid_id,centroid FROM centroids
+#endif
+
+  // select latest chunk from _chunks, getting chunk_id
+  sqlite3_stmt *stmtLatestChunk;
+
+  // PRAGMA data_version, see vec0_insert_cursors_check()
+  sqlite3_stmt *stmtDataVersion;
+
+  // select the oldest chunk with free slots, see vec0_free_slots_next_chunk()
+  sqlite3_stmt *stmtFreeSlotsNextChunk;
+
+  // add to a chunk's count in _free_slots, and drop the row once it's full.
+  // See vec0_free_slots_update()
+  sqlite3_stmt *stmtFreeSlotsUpdate;
+  sqlite3_stmt *stmtFreeSlotsDeleteFull;
+
+  /**
+   * Statement to insert a row into the _rowids table, with a rowid.
+   * Parameters:
+   *    1: int64, rowid to insert
+   * Result columns: none
+   * SQL: "INSERT INTO _rowids(rowid) VALUES (?)"
+   *
+   * Must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtRowidsInsertRowid;
+
+  /**
+   * Statement to insert a row into the _rowids table, with an id.
+   * The id column isn't a tradition primary key, but instead a unique
+   * column to handle "text primary key" vec0 tables. The true int64 rowid
+   * can be retrieved after inserting with sqlite3_last_rowid().
+   *
+   * Parameters:
+   *    1: text or null, id to insert
+   * Result columns: none
+   *
+   * Must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtRowidsInsertId;
+
+  /**
+   * Statement to update the "position" columns chunk_id and chunk_offset for
+   * a given _rowids row. Used when the "next available" chunk position is found
+   * for a vector.
+   *
+   * Parameters:
+   *    1: int64, chunk_id value
+   *    2: int64, chunk_offset value
+   *    3: int64, rowid value
+   * Result columns: none
+   *
+   * Must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtRowidsUpdatePosition;
+
+  /**
+   * Statement to quickly find the chunk_id + chunk_offset of a given row.
+   * Parameters:
+   *  1: rowid of the row/vector to lookup
+   * Result columns:
+   *  0: chunk_id (i64)
+   *  1: chunk_offset (i64)
+   * SQL: "SELECT id, chunk_id, chunk_offset FROM _rowids WHERE rowid = ?""
+   *
+   * Must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtRowidsGetChunkPosition;
+
+  /**
+   * Statement to read a whole vector chunk, per vector column. KNN scans
+   * compute distances straight off the sqlite3_column_blob() pointer while
+   * the statement is positioned, instead of copying the chunk out.
+   * Parameters:
+   *  1: chunk_id of the chunk to read
+   * Result columns:
+   *  0: vectors (blob)
+   * SQL: "SELECT vectors FROM _vector_chunksNN WHERE rowid = ?"
+   *
+   * Lazily prepared, must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtVectorChunksRead[VEC0_MAX_VECTOR_COLUMNS];
+
+  /**
+   * Statement to read the bounding box of a chunk.
+   *  1: chunk_id
+   * Result columns:
+   *  0: bounds (blob)
+   * SQL: "SELECT bounds FROM _vector_boundsNN WHERE rowid = ?"
+   *
+   * Lazily prepared, must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtVectorBoundsRead[VEC0_MAX_VECTOR_COLUMNS];
+
+  /**
+   * Statements to count a row gone from a chunk since its box was rebuilt.
+   *  1: chunk_id
+   *  - stmtVectorBoundsDelete: "UPDATE _vector_boundsNN
+   *    SET deletes = deletes + 1 WHERE rowid = ?"
+   *  - stmtVectorBoundsDeletes: "SELECT deletes FROM _vector_boundsNN
+   *    WHERE rowid = ?"
+   *
+   * Lazily prepared, must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtVectorBoundsDelete[VEC0_MAX_VECTOR_COLUMNS];
+  sqlite3_stmt *stmtVectorBoundsDeletes[VEC0_MAX_VECTOR_COLUMNS];
+
+  /**
+   * Statement to widen the value range of a chunk.
+   *  1: lo, 2: hi, 3: chunk_id
+   * SQL: "UPDATE _metadataboundsNN SET lo = min(lo, ?1), hi = max(hi, ?2)
+   *       WHERE rowid = ?3", where a NULL lo or hi takes the new value
+   *
+   * Lazily prepared, must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtMetadataBoundsWiden[VEC0_MAX_METADATA_COLUMNS];
+
+  /**
+   * Statement to read the value range of a chunk.
+   *  1: chunk_id
+   * Result columns:
+   *  0: lo, 1: hi
+   * SQL: "SELECT lo, hi FROM _metadataboundsNN WHERE rowid = ?"
+   *
+   * Lazily prepared, must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtMetadataBoundsRead[VEC0_MAX_METADATA_COLUMNS];
+
+  /**
+   * Statements on the dictionary of a `text dictionary` metadata column:
+   *  - stmtMetadataDictCode: "SELECT rowid FROM _metadatadictNN WHERE value = ?"
+   *  - stmtMetadataDictInsert: "INSERT INTO _metadatadictNN(value) VALUES (?)"
+   *  - stmtMetadataDictValue: "SELECT value FROM _metadatadictNN WHERE rowid = ?"
+   *
+   * Lazily prepared, must be cleaned up with sqlite3_finalize().
+   */
+  sqlite3_stmt *stmtMetadataDictCode[VEC0_MAX_METADATA_COLUMNS];
+  sqlite3_stmt *stmtMetadataDictInsert[VEC0_MAX_METADATA_COLUMNS];
+  sqlite3_stmt *stmtMetadataDictValue[VEC0_MAX_METADATA_COLUMNS];
+
+  // === DiskANN additions ===
+#if SQLITE_VEC_ENABLE_DISKANN
+  // Shadow table names for DiskANN, per vector column
+  // e.g., "{schema}"."{table}_vectors{00..15}"
+  char *shadowVectorsNames[VEC0_MAX_VECTOR_COLUMNS];
+
+  // e.g., "{schema}"."{table}_diskann_nodes{00..15}"
+  char *shadowDiskannNodesNames[VEC0_MAX_VECTOR_COLUMNS];
+
+  // Prepared statements for DiskANN operations (per vector column)
+  // These will be lazily prepared on first use.
+  sqlite3_stmt *stmtDiskannNodeRead[VEC0_MAX_VECTOR_COLUMNS];
+  sqlite3_stmt *stmtDiskannNodeWrite[VEC0_MAX_VECTOR_COLUMNS];
+  sqlite3_stmt *stmtDiskannNodeInsert[VEC0_MAX_VECTOR_COLUMNS];
+  sqlite3_stmt *stmtVectorsRead[VEC0_MAX_VECTOR_COLUMNS];
+  sqlite3_stmt *stmtVectorsInsert[VEC0_MAX_VECTOR_COLUMNS];
+#endif
+};
+
+#if SQLITE_VEC_ENABLE_THREADS
+// defined next to the flat KNN scan that uses it
+static void vec0_thread_pool_destroy(struct Vec0ThreadPool *pool);
+#endif
+
+// defined next to vec0Update_InsertNextAvailableStep(), which uses them
+static void vec0_insert_cursors_clear(vec0_vtab *p);
+// defined next to vec0Update_Insert(), which stages rows for them
+static void vec0_write_behind_discard(vec0_vtab *p);
+static int vec0_write_behind_flush(vec0_vtab *p);
+
+#if SQLITE_VEC_ENABLE_RESCORE
+// Forward declarations for rescore functions (defined in sqlite-vec-rescore.c,
+// included later after all helpers they depend on are defined).
+static int rescore_create_tables(vec0_vtab *p, sqlite3 *db, char **pzErr);
+static int rescore_drop_tables(vec0_vtab *p);
+static int rescore_new_chunk(vec0_vtab *p, i64 chunk_rowid);
+static int rescore_on_insert(vec0_vtab *p, i64 chunk_rowid, i64 chunk_offset,
+                             i64 rowid, void *vectorDatas[]);
+static int rescore_on_delete(vec0_vtab *p, i64 chunk_id, u64 chunk_offset, i64 rowid);
+static int rescore_delete_chunk(vec0_vtab *p, i64 chunk_id);
+#endif
+
+/**
+ * @brief Finalize all the sqlite3_stmt members in a vec0_vtab.
+ *
+ * @param p vec0_vtab pointer
+ */
+void vec0_free_resources(vec0_vtab *p) {
+  sqlite3_finalize(p->stmtLatestChunk);
+  p->stmtLatestChunk = NULL;
+  sqlite3_finalize(p->stmtDataVersion);
+  p->stmtDataVersion = NULL;
+  sqlite3_finalize(p->stmtFreeSlotsNextChunk);
+  p->stmtFreeSlotsNextChunk = NULL;
+  sqlite3_finalize(p->stmtFreeSlotsUpdate);
+  p->stmtFreeSlotsUpdate = NULL;
+  sqlite3_finalize(p->stmtFreeSlotsDeleteFull);
+  p->stmtFreeSlotsDeleteFull = NULL;
+  sqlite3_finalize(p->stmtRowidsInsertRowid);
+  p->stmtRowidsInsertRowid = NULL;
+  sqlite3_finalize(p->stmtRowidsInsertId);
+  p->stmtRowidsInsertId = NULL;
+  sqlite3_finalize(p->stmtRowidsUpdatePosition);
+  p->stmtRowidsUpdatePosition = NULL;
+  sqlite3_finalize(p->stmtRowidsGetChunkPosition);
+  p->stmtRowidsGetChunkPosition = NULL;
+  for (int i = 0; i < VEC0_MAX_VECTOR_COLUMNS; i++) {
+    sqlite3_finalize(p->stmtVectorChunksRead[i]);
+    p->stmtVectorChunksRead[i] = NULL;
+    sqlite3_finalize(p->stmtVectorBoundsRead[i]);
+    p->stmtVectorBoundsRead[i] = NULL;
+    sqlite3_finalize(p->stmtVectorBoundsDelete[i]);
+    p->stmtVectorBoundsDelete[i] = NULL;
+    sqlite3_finalize(p->stmtVectorBoundsDeletes[i]);
+    p->stmtVectorBoundsDeletes[i] = NULL;
+  }
+  for (int i = 0; i < VEC0_MAX_METADATA_COLUMNS; i++) {
+    sqlite3_finalize(p->stmtMetadataBoundsWiden[i]);
+    p->stmtMetadataBoundsWiden[i] = NULL;
+    sqlite3_finalize(p->stmtMetadataBoundsRead[i]);
+    p->stmtMetadataBoundsRead[i] = NULL;
+    sqlite3_finalize(p->stmtMetadataDictCode[i]);
+    p->stmtMetadataDictCode[i] = NULL;
+    sqlite3_finalize(p->stmtMetadataDictInsert[i]);
+    p->stmtMetadataDictInsert[i] = NULL;
+    sqlite3_finalize(p->stmtMetadataDictValue[i]);
+    p->stmtMetadataDictValue[i] = NULL;
+  }
+
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+  for (int i = 0; i < VEC0_MAX_VECTOR_COLUMNS; i++) {
+    sqlite3_finalize(p->stmtIvfCellMeta[i]); p->stmtIvfCellMeta[i] = NULL;
+    sqlite3_finalize(p->stmtIvfCellUpdateN[i]); p->stmtIvfCellUpdateN[i] = NULL;
+    sqlite3_finalize(p->stmtIvfRowidMapInsert[i]); p->stmtIvfRowidMapInsert[i] = NULL;
+    sqlite3_finalize(p->stmtIvfRowidMapLookup[i]); p->stmtIvfRowidMapLookup[i] = NULL;
+    sqlite3_finalize(p->stmtIvfRowidMapDelete[i]); p->stmtIvfRowidMapDelete[i] = NULL;
+    sqlite3_finalize(p->stmtIvfCentroidsAll[i]); p->stmtIvfCentroidsAll[i] = NULL;
+#if SQLITE_VEC_ENABLE_DISKANN
+    sqlite3_finalize(p->stmtDiskannNodeRead[i]); p->stmtDiskannNodeRead[i] = NULL;
+    sqlite3_finalize(p->stmtDiskannNodeWrite[i]); p->stmtDiskannNodeWrite[i] = NULL;
+    sqlite3_finalize(p->stmtDiskannNodeInsert[i]); p->stmtDiskannNodeInsert[i] = NULL;
+    sqlite3_finalize(p->stmtVectorsRead[i]); p->stmtVectorsRead[i] = NULL;
+    sqlite3_finalize(p->stmtVectorsInsert[i]); p->stmtVectorsInsert[i] = NULL;
+#endif
+  }
+#endif
+}
+
+/**
+ * @brief Free all memory and sqlite3_stmt members of a vec0_vtab
+ *
+ * @param p vec0_vtab pointer
+ */
+void vec0_free(vec0_vtab *p) {
+  vec0_free_resources(p);
+  vec0_scratch_free(&p->scratch);
+  vec0_insert_cursors_clear(p);
+  sqlite3_free(p->insertCursors);
+  p->insertCursors = NULL;
+  vec0_write_behind_discard(p);
+  sqlite3_free(p->stagedRows);
+  p->stagedRows = NULL;
+#if SQLITE_VEC_ENABLE_PREFETCH
+  sqlite3_close(p->prefetchDb);
+  p->prefetchDb = NULL;
+#endif
+#if SQLITE_VEC_ENABLE_THREADS
+  vec0_thread_pool_destroy(p->threadPool);
+  p->threadPool = NULL;
+#endif
+
+  sqlite3_free(p->schemaName);
+  p->schemaName = NULL;
+  sqlite3_free(p->tableName);
+  p->tableName = NULL;
+  sqlite3_free(p->shadowChunksName);
+  p->shadowChunksName = NULL;
+  sqlite3_free(p->shadowRowidsName);
+  p->shadowRowidsName = NULL;
+  sqlite3_free(p->shadowFreeSlotsName);
+  p->shadowFreeSlotsName = NULL;
+
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    sqlite3_free(p->shadowVectorChunksNames[i]);
+    p->shadowVectorChunksNames[i] = NULL;
+    sqlite3_free(p->shadowVectorBoundsNames[i]);
+    p->shadowVectorBoundsNames[i] = NULL;
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+    sqlite3_free(p->shadowIvfCellsNames[i]);
+    p->shadowIvfCellsNames[i] = NULL;
+#endif
+
+#if SQLITE_VEC_ENABLE_RESCORE
+    sqlite3_free(p->shadowRescoreChunksNames[i]);
+    p->shadowRescoreChunksNames[i] = NULL;
+
+    sqlite3_free(p->shadowRescoreVectorsNames[i]);
+    p->shadowRescoreVectorsNames[i] = NULL;
+#endif
+
+#if SQLITE_VEC_ENABLE_DISKANN
+    sqlite3_free(p->shadowVectorsNames[i]);
+    p->shadowVectorsNames[i] = NULL;
+    sqlite3_free(p->shadowDiskannNodesNames[i]);
+    p->shadowDiskannNodesNames[i] = NULL;
+#endif
+
+    sqlite3_free(p->vector_columns[i].name);
+    p->vector_columns[i].name = NULL;
+  }
+
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_free(p->paritition_columns[i].name);
+    p->paritition_columns[i].name = NULL;
+  }
+
+  for (int i = 0; i < p->numAuxiliaryColumns; i++) {
+    sqlite3_free(p->auxiliary_columns[i].name);
+    p->auxiliary_columns[i].name = NULL;
+  }
+
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    sqlite3_free(p->metadata_columns[i].name);
+    p->metadata_columns[i].name = NULL;
+    sqlite3_free(p->shadowMetadataBoundsNames[i]);
+    p->shadowMetadataBoundsNames[i] = NULL;
+  }
+}
+
+#if SQLITE_VEC_ENABLE_DISKANN
+#include "sqlite-vec-diskann.c"
+#else
+static int vec0_all_columns_diskann(vec0_vtab *p) { (void)p; return 0; }
+#endif
+
+int vec0_num_defined_user_columns(vec0_vtab *p) {
+  return p->numVectorColumns + p->numPartitionColumns + p->numAuxiliaryColumns + p->numMetadataColumns;
+}
+
+/**
+ * @brief Returns the index of the distance hidden column for the given vec0
+ * table.
+ *
+ * @param p vec0 table
+ * @return int
+ */
+int vec0_column_command_idx(vec0_vtab *p) {
+  // Command column is the first hidden column (right after user columns)
+  return VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(p);
+}
+
+int vec0_column_distance_idx(vec0_vtab *p) {
+  int base = VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(p);
+  return base + (p->hasCommandColumn ? 1 : 0);
+}
+
+int vec0_column_k_idx(vec0_vtab *p) {
+  int base = VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(p);
+  return base + (p->hasCommandColumn ? 2 : 1);
+}
+
+/**
+ * @brief Returns the index of the hidden query_idx column, or -1 if the table
+ * doesn't have one.
+ */
+int vec0_column_query_idx_idx(vec0_vtab *p) {
+  if (!p->hasQueryIdxColumn) {
+    return -1;
+  }
+  return vec0_column_k_idx(p) + 1;
+}
+
+/**
+ * Returns 1 if the given column-based index is a valid vector column,
+ * 0 otherwise.
+ */
+int vec0_column_idx_is_vector(vec0_vtab *pVtab, int column_idx) {
+  return column_idx >= VEC0_COLUMN_USERN_START &&
+         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
+         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_VECTOR;
+}
+
+/**
+ * Returns the vector index of the given user column index.
+ * ONLY call if validated with vec0_column_idx_is_vector before
+ */
+int vec0_column_idx_to_vector_idx(vec0_vtab *pVtab, int column_idx) {
+  UNUSED_PARAMETER(pVtab);
+  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+}
+/**
+ * Returns 1 if the given column-based index is a "partition key" column,
+ * 0 otherwise.
+ */
+int vec0_column_idx_is_partition(vec0_vtab *pVtab, int column_idx) {
+  return column_idx >= VEC0_COLUMN_USERN_START &&
+         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
+         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_PARTITION;
+}
+
+/**
+ * Returns the partition column index of the given user column index.
+ * ONLY call if validated with vec0_column_idx_is_vector before
+ */
+int vec0_column_idx_to_partition_idx(vec0_vtab *pVtab, int column_idx) {
+  UNUSED_PARAMETER(pVtab);
+  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+}
+
+/**
+ * Returns 1 if the given column-based index is a auxiliary column,
+ * 0 otherwise.
+ */
+int vec0_column_idx_is_auxiliary(vec0_vtab *pVtab, int column_idx) {
+  return column_idx >= VEC0_COLUMN_USERN_START &&
+         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
+         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY;
+}
+
+/**
+ * Returns the auxiliary column index of the given user column index.
+ * ONLY call if validated with vec0_column_idx_to_partition_idx before
+ */
+int vec0_column_idx_to_auxiliary_idx(vec0_vtab *pVtab, int column_idx) {
+  UNUSED_PARAMETER(pVtab);
+  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+}
+
+/**
+ * Returns 1 if the given column-based index is a metadata column,
+ * 0 otherwise.
+ */
+int vec0_column_idx_is_metadata(vec0_vtab *pVtab, int column_idx) {
+  return column_idx >= VEC0_COLUMN_USERN_START &&
+         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
+         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_METADATA;
+}
+
+/**
+ * Returns the metadata column index of the given user column index.
+ * ONLY call if validated with vec0_column_idx_is_metadata before
+ */
+int vec0_column_idx_to_metadata_idx(vec0_vtab *pVtab, int column_idx) {
+  UNUSED_PARAMETER(pVtab);
+  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+}
+
+/**
+ * @brief Retrieve the chunk_id, chunk_offset, and possible "id" value
+ * of a vec0_vtab row with the provided rowid
+ *
+ * @param p vec0_vtab
+ * @param rowid the rowid of the row to query
+ * @param id output, optional sqlite3_value to provide the id.
+ *            Useful for text PK rows. Must be freed with sqlite3_value_free()
+ * @param chunk_id output, the chunk_id the row belongs to
+ * @param chunk_offset  output, the offset within the chunk the row belongs to
+ * @return SQLITE_ROW on success, error code otherwise. SQLITE_EMPTY if row DNE
+ */
+int vec0_get_chunk_position(vec0_vtab *p, i64 rowid, sqlite3_value **id,
+                            i64 *chunk_id, i64 *chunk_offset) {
+  int rc;
+
+  if (!p->stmtRowidsGetChunkPosition) {
+    const char *zSql =
+        sqlite3_mprintf("SELECT id, chunk_id, chunk_offset "
+                        "FROM " VEC0_SHADOW_ROWIDS_NAME " WHERE rowid = ?",
+                        p->schemaName, p->tableName);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsGetChunkPosition, 0);
+    sqlite3_free((void *)zSql);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(
+          &p->base, VEC_INTERAL_ERROR
+          "could not initialize 'rowids get chunk position' statement");
+      goto cleanup;
+    }
+  }
+
+  sqlite3_bind_int64(p->stmtRowidsGetChunkPosition, 1, rowid);
+  rc = sqlite3_step(p->stmtRowidsGetChunkPosition);
+  // special case: when no results, return SQLITE_EMPTY to convey "that chunk
+  // position doesnt exist"
+  if (rc == SQLITE_DONE) {
+    rc = SQLITE_EMPTY;
+    goto cleanup;
+  }
+  if (rc != SQLITE_ROW) {
+    goto cleanup;
+  }
+
+  if (id) {
+    sqlite3_value *value =
+        sqlite3_column_value(p->stmtRowidsGetChunkPosition, 0);
+    *id = sqlite3_value_dup(value);
+    if (!*id) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+  }
+
+  if (chunk_id) {
+    *chunk_id = sqlite3_column_int64(p->stmtRowidsGetChunkPosition, 1);
+  }
+  if (chunk_offset) {
+    *chunk_offset = sqlite3_column_int64(p->stmtRowidsGetChunkPosition, 2);
+  }
+
+  rc = SQLITE_OK;
+
+cleanup:
+  sqlite3_reset(p->stmtRowidsGetChunkPosition);
+  sqlite3_clear_bindings(p->stmtRowidsGetChunkPosition);
+  return rc;
+}
+
+/**
+ * @brief Return the id value from the _rowids table where _rowids.rowid =
+ * rowid.
+ *
+ * @param pVtab: vec0 table to query
+ * @param rowid: rowid of the row to query.
+ * @param out: A dup'ed sqlite3_value of the id column. Might be null.
+ *                         Must be cleaned up with sqlite3_value_free().
+ * @returns SQLITE_OK on success, error code on failure
+ */
+int vec0_get_id_value_from_rowid(vec0_vtab *pVtab, i64 rowid,
+                                 sqlite3_value **out) {
+  // PERF: different strategy than get_chunk_position?
+  return vec0_get_chunk_position((vec0_vtab *)pVtab, rowid, out, NULL, NULL);
+}
+
+int vec0_rowid_from_id(vec0_vtab *p, sqlite3_value *valueId, i64 *rowid) {
+  sqlite3_stmt *stmt = NULL;
+  int rc;
+  char *zSql;
+  zSql = sqlite3_mprintf("SELECT rowid"
+                         " FROM " VEC0_SHADOW_ROWIDS_NAME " WHERE id = ?",
+                         p->schemaName, p->tableName);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  sqlite3_bind_value(stmt, 1, valueId);
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_DONE) {
+    rc = SQLITE_EMPTY;
+    goto cleanup;
+  }
+  if (rc != SQLITE_ROW) {
+    goto cleanup;
+  }
+  *rowid = sqlite3_column_int64(stmt, 0);
+  rc = sqlite3_step(stmt);
+  if (rc != SQLITE_DONE) {
+    goto cleanup;
+  }
+
+  rc = SQLITE_OK;
+
+cleanup:
+  sqlite3_finalize(stmt);
+  return rc;
+}
+
+int vec0_result_id(vec0_vtab *p, sqlite3_context *context, i64 rowid) {
+  if (!p->pkIsText) {
+    sqlite3_result_int64(context, rowid);
+    return SQLITE_OK;
+  }
+  sqlite3_value *valueId;
+  int rc = vec0_get_id_value_from_rowid(p, rowid, &valueId);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  if (!valueId) {
+    sqlite3_result_error_nomem(context);
+  } else {
+    sqlite3_result_value(context, valueId);
+    sqlite3_value_free(valueId);
+  }
+  return SQLITE_OK;
+}
+
+/**
+ * @brief
+ *
+ * @param pVtab: virtual table to query
+ * @param rowid: row to lookup
+ * @param vector_column_idx: which vector column to query
+ * @param outVector: Output pointer to the vector buffer.
+ *                    Must be sqlite3_free()'ed.
+ * @param outVectorSize: Pointer to a int where the size of outVector
+ *                       will be stored.
+ * @return int SQLITE_OK on success.
+ */
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+// Forward declaration — defined in sqlite-vec-ivf.c (included later)
+static int ivf_get_vector_data(vec0_vtab *p, i64 rowid, int col_idx,
+                                void **outVector, int *outVectorSize);
+#endif
+
+int vec0_get_vector_data(vec0_vtab *pVtab, i64 rowid, int vector_column_idx,
+                         void **outVector, int *outVectorSize) {
+  vec0_vtab *p = pVtab;
+  int rc, brc;
+
+#if SQLITE_VEC_ENABLE_DISKANN
+  // DiskANN fast path: read from _vectors table
+  if (p->vector_columns[vector_column_idx].index_type == VEC0_INDEX_TYPE_DISKANN) {
+    void *vec = NULL;
+    int vecSize;
+    rc = diskann_vector_read(p, vector_column_idx, rowid, &vec, &vecSize);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&pVtab->base,
+                     "Could not fetch vector data for %lld from DiskANN vectors table",
+                     rowid);
+      return SQLITE_ERROR;
+    }
+    *outVector = vec;
+    if (outVectorSize) *outVectorSize = vecSize;
+    return SQLITE_OK;
+  }
+#endif
+
+  i64 chunk_id;
+  i64 chunk_offset;
+
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+  // IVF-indexed columns store vectors in _ivf_cells, not _vector_chunks
+  if (p->vector_columns[vector_column_idx].index_type == VEC0_INDEX_TYPE_IVF) {
+    return ivf_get_vector_data(p, rowid, vector_column_idx, outVector, outVectorSize);
+  }
 #endif
+  size_t size;
+  void *buf = NULL;
+  int blobOffset;
+  sqlite3_blob *vectorBlob = NULL;
+  assert((vector_column_idx >= 0) &&
+         (vector_column_idx < pVtab->numVectorColumns));
+
+#if SQLITE_VEC_ENABLE_RESCORE
+  // Rescore columns store float vectors in _rescore_vectors (rowid-keyed)
+  if (p->vector_columns[vector_column_idx].index_type == VEC0_INDEX_TYPE_RESCORE) {
+    size = vector_column_byte_size(p->vector_columns[vector_column_idx]);
+    rc = sqlite3_blob_open(p->db, p->schemaName,
+                           p->shadowRescoreVectorsNames[vector_column_idx],
+                           "vector", rowid, 0, &vectorBlob);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&pVtab->base,
+                     "Could not fetch vector data for %lld from rescore vectors",
+                     rowid);
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+    buf = sqlite3_malloc(size);
+    if (!buf) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_blob_read(vectorBlob, buf, size, 0);
+    if (rc != SQLITE_OK) {
+      sqlite3_free(buf);
+      buf = NULL;
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+    *outVector = buf;
+    if (outVectorSize) {
+      *outVectorSize = size;
+    }
+    rc = SQLITE_OK;
+    goto cleanup;
+  }
+#endif /* SQLITE_VEC_ENABLE_RESCORE */
+
+  rc = vec0_get_chunk_position(pVtab, rowid, NULL, &chunk_id, &chunk_offset);
+  if (rc == SQLITE_EMPTY) {
+    vtab_set_error(&pVtab->base, "Could not find a row with rowid %lld", rowid);
+    goto cleanup;
+  }
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  rc = sqlite3_blob_open(p->db, p->schemaName,
+                         p->shadowVectorChunksNames[vector_column_idx],
+                         "vectors", chunk_id, 0, &vectorBlob);
+
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&pVtab->base,
+                   "Could not fetch vector data for %lld, opening blob failed",
+                   rowid);
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
+
+  size = vector_column_byte_size(pVtab->vector_columns[vector_column_idx]);
+  blobOffset = chunk_offset * size;
+
+  buf = sqlite3_malloc(size);
+  if (!buf) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+
+  rc = sqlite3_blob_read(vectorBlob, buf, size, blobOffset);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(buf);
+    buf = NULL;
+    vtab_set_error(
+        &pVtab->base,
+        "Could not fetch vector data for %lld, reading from blob failed",
+        rowid);
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
+
+  *outVector = buf;
+  if (outVectorSize) {
+    *outVectorSize = size;
+  }
+  rc = SQLITE_OK;
+
+cleanup:
+  brc = sqlite3_blob_close(vectorBlob);
+  if ((rc == SQLITE_OK) && (brc != SQLITE_OK)) {
+    vtab_set_error(
+        &p->base, VEC_INTERAL_ERROR
+        "unknown error, could not close vector blob, please file an issue");
+    return brc;
+  }
+
+  return rc;
+}
+
+/**
+ * @brief Retrieve the sqlite3_value of the i'th partition value for the given row.
+ *
+ * @param pVtab - the vec0_vtab in questions
+ * @param rowid - rowid of target row
+ * @param partition_idx - which partition column to retrieve
+ * @param outValue - output sqlite3_value
+ * @return int - SQLITE_OK on success, otherwise error code
+ */
+int vec0_get_partition_value_for_rowid(vec0_vtab *pVtab, i64 rowid, int partition_idx, sqlite3_value ** outValue) {
+  int rc;
+  i64 chunk_id;
+  i64 chunk_offset;
+  rc = vec0_get_chunk_position(pVtab, rowid, NULL, &chunk_id, &chunk_offset);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_stmt * stmt = NULL;
+  char * zSql = sqlite3_mprintf("SELECT partition%02d FROM " VEC0_SHADOW_CHUNKS_NAME " WHERE chunk_id = ?", partition_idx, pVtab->schemaName, pVtab->tableName);
+  if(!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(pVtab->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  if(rc != SQLITE_ROW) {
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  *outValue = sqlite3_value_dup(sqlite3_column_value(stmt, 0));
+  if(!*outValue) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = SQLITE_OK;
 
-  // Name of all metadata chunk shadow tables, ie `_metadatachunks00`
-  // Only the first numMetadataColumns entries will be available.
-  // The first numMetadataColumns entries must be freed with sqlite3_free()
-  char *shadowMetadataChunksNames[VEC0_MAX_METADATA_COLUMNS];
+  done:
+    sqlite3_finalize(stmt);
+    return rc;
 
-  struct VectorColumnDefinition vector_columns[VEC0_MAX_VECTOR_COLUMNS];
-  struct Vec0PartitionColumnDefinition paritition_columns[VEC0_MAX_PARTITION_COLUMNS];
-  struct Vec0AuxiliaryColumnDefinition auxiliary_columns[VEC0_MAX_AUXILIARY_COLUMNS];
-  struct Vec0MetadataColumnDefinition metadata_columns[VEC0_MAX_METADATA_COLUMNS];
+}
 
-  int chunk_size;
+/**
+ * @brief Get the value of an auxiliary column for the given rowid
+ *
+ * @param pVtab vec0_vtab
+ * @param rowid the rowid of the row to lookup
+ * @param auxiliary_idx aux index of the column we care about
+ * @param outValue Output sqlite3_value to store
+ * @return int SQLITE_OK on success, error code otherwise
+ */
+int vec0_get_auxiliary_value_for_rowid(vec0_vtab *pVtab, i64 rowid, int auxiliary_idx, sqlite3_value ** outValue) {
+  int rc;
+  sqlite3_stmt * stmt = NULL;
+  char * zSql = sqlite3_mprintf("SELECT value%02d FROM " VEC0_SHADOW_AUXILIARY_NAME " WHERE rowid = ?", auxiliary_idx, pVtab->schemaName, pVtab->tableName);
+  if(!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(pVtab->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_bind_int64(stmt, 1, rowid);
+  rc = sqlite3_step(stmt);
+  if(rc != SQLITE_ROW) {
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  *outValue = sqlite3_value_dup(sqlite3_column_value(stmt, 0));
+  if(!*outValue) {
+    rc = SQLITE_NOMEM;
+    goto done;
+  }
+  rc = SQLITE_OK;
 
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-  // IVF cached state per vector column
-  char *shadowIvfCellsNames[VEC0_MAX_VECTOR_COLUMNS];   // table name for blob_open
-  int ivfTrainedCache[VEC0_MAX_VECTOR_COLUMNS];          // -1=unknown, 0=no, 1=yes
-  sqlite3_stmt *stmtIvfCellMeta[VEC0_MAX_VECTOR_COLUMNS];      // SELECT n_vectors, length(validity)*8 FROM cells WHERE cell_id=?
-  sqlite3_stmt *stmtIvfCellUpdateN[VEC0_MAX_VECTOR_COLUMNS];   // UPDATE cells SET n_vectors=n_vectors+? WHERE cell_id=?
-  sqlite3_stmt *stmtIvfRowidMapInsert[VEC0_MAX_VECTOR_COLUMNS]; // INSERT INTO rowid_map(rowid,cell_id,slot) VALUES(?,?,?)
-  sqlite3_stmt *stmtIvfRowidMapLookup[VEC0_MAX_VECTOR_COLUMNS]; // SELECT cell_id,slot FROM rowid_map WHERE rowid=?
-  sqlite3_stmt *stmtIvfRowidMapDelete[VEC0_MAX_VECTOR_COLUMNS]; // DELETE FROM rowid_map WHERE rowid=?
-  sqlite3_stmt *stmtIvfCentroidsAll[VEC0_MAX_VECTOR_COLUMNS];   // SELECT centroid_id,centroid FROM centroids
-#endif
+  done:
+    sqlite3_finalize(stmt);
+    return rc;
+}
 
-  // select latest chunk from _chunks, getting chunk_id
-  sqlite3_stmt *stmtLatestChunk;
+/**
+ * @brief How a metadata column's values are laid out in _metadatachunksNN.
+ * Dictionary-encoded TEXT columns hold i64 codes, like INTEGER columns.
+ */
+static vec0_metadata_column_kind
+vec0_metadata_storage_kind(const struct Vec0MetadataColumnDefinition *column) {
+  if (column->dictionary) {
+    return VEC0_METADATA_COLUMN_KIND_INTEGER;
+  }
+  return column->kind;
+}
 
-  /**
-   * Statement to insert a row into the _rowids table, with a rowid.
-   * Parameters:
-   *    1: int64, rowid to insert
-   * Result columns: none
-   * SQL: "INSERT INTO _rowids(rowid) VALUES (?)"
-   *
-   * Must be cleaned up with sqlite3_finalize().
-   */
-  sqlite3_stmt *stmtRowidsInsertRowid;
+/**
+ * @brief Look up the code of value in the dictionary of a `text dictionary`
+ * metadata column.
+ *
+ * @param p vec0_vtab
+ * @param i index of the metadata column, which must be dictionary-encoded
+ * @param value the text to look up
+ * @param create if set, values not in the dictionary yet are added to it.
+ * Otherwise they get code 0, which no row holds.
+ * @param outCode output code
+ * @return int SQLITE_OK on success, error code otherwise
+ */
+static int vec0_metadata_dict_code(vec0_vtab *p, int i, sqlite3_value *value,
+                                   int create, i64 *outCode) {
+  int rc;
+  *outCode = 0;
+  if (!p->stmtMetadataDictCode[i]) {
+    char *zSql = sqlite3_mprintf("SELECT rowid FROM " VEC0_SHADOW_METADATA_DICT_N_NAME
+                                 " WHERE value = ?",
+                                 p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtMetadataDictCode[i], NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  sqlite3_stmt *stmt = p->stmtMetadataDictCode[i];
+  sqlite3_bind_value(stmt, 1, value);
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_ROW) {
+    *outCode = sqlite3_column_int64(stmt, 0);
+  }
+  sqlite3_reset(stmt);
+  if (rc == SQLITE_ROW || (rc == SQLITE_DONE && !create)) {
+    return SQLITE_OK;
+  }
+  if (rc != SQLITE_DONE) {
+    return rc;
+  }
+
+  if (!p->stmtMetadataDictInsert[i]) {
+    char *zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_METADATA_DICT_N_NAME
+                                 "(value) VALUES (?)",
+                                 p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtMetadataDictInsert[i],
+                            NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  stmt = p->stmtMetadataDictInsert[i];
+  sqlite3_bind_value(stmt, 1, value);
+  rc = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  if (rc != SQLITE_DONE) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "could not add to dictionary of metadata column %d",
+                   i);
+    return SQLITE_ERROR;
+  }
+  *outCode = sqlite3_last_insert_rowid(p->db);
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Result the text behind code in the dictionary of a `text dictionary`
+ * metadata column.
+ */
+static int vec0_metadata_dict_result(vec0_vtab *p, int i, i64 code,
+                                     sqlite3_context *context) {
+  int rc;
+  if (!p->stmtMetadataDictValue[i]) {
+    char *zSql = sqlite3_mprintf("SELECT value FROM " VEC0_SHADOW_METADATA_DICT_N_NAME
+                                 " WHERE rowid = ?",
+                                 p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtMetadataDictValue[i],
+                            NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  sqlite3_stmt *stmt = p->stmtMetadataDictValue[i];
+  sqlite3_bind_int64(stmt, 1, code);
+  rc = sqlite3_step(stmt);
+  if (rc != SQLITE_ROW) {
+    sqlite3_reset(stmt);
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "code %lld missing from dictionary of metadata column %d",
+                   code, i);
+    return SQLITE_ERROR;
+  }
+  sqlite3_result_value(context, sqlite3_column_value(stmt, 0));
+  sqlite3_reset(stmt);
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Result the given metadata value for the given row and metadata column index.
+ * Will traverse the metadatachunksNN table with BLOB I/0 for the given rowid.
+ *
+ * @param p
+ * @param rowid
+ * @param metadata_idx
+ * @param context
+ * @return int
+ */
+int vec0_result_metadata_value_for_rowid(vec0_vtab *p, i64 rowid, int metadata_idx, sqlite3_context * context) {
+  int rc;
+  i64 chunk_id;
+  i64 chunk_offset;
+  rc = vec0_get_chunk_position(p, rowid, NULL, &chunk_id, &chunk_offset);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_blob * blobValue;
+  rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowMetadataChunksNames[metadata_idx], "data", chunk_id, 0, &blobValue);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+
+  switch(p->metadata_columns[metadata_idx].kind) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+      u8 block;
+      rc = sqlite3_blob_read(blobValue, &block, sizeof(block), chunk_offset / CHAR_BIT);
+      if(rc != SQLITE_OK) {
+        goto done;
+      }
+      int value = block >> ((chunk_offset % CHAR_BIT)) & 1;
+      sqlite3_result_int(context, value);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
+      i64 value;
+      rc = sqlite3_blob_read(blobValue, &value, sizeof(value), chunk_offset * sizeof(i64));
+      if(rc != SQLITE_OK) {
+        goto done;
+      }
+      sqlite3_result_int64(context, value);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
+      double value;
+      rc = sqlite3_blob_read(blobValue, &value, sizeof(value), chunk_offset * sizeof(double));
+      if(rc != SQLITE_OK) {
+        goto done;
+      }
+      sqlite3_result_double(context, value);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      if(p->metadata_columns[metadata_idx].dictionary) {
+        i64 code;
+        rc = sqlite3_blob_read(blobValue, &code, sizeof(code), chunk_offset * sizeof(i64));
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        rc = vec0_metadata_dict_result(p, metadata_idx, code, context);
+        break;
+      }
+      u8 view[VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+      rc = sqlite3_blob_read(blobValue, &view, VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH, chunk_offset * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH);
+      if(rc != SQLITE_OK) {
+        goto done;
+      }
+      int length = ((int *)view)[0];
+      if(length <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+        sqlite3_result_text(context, (const char*) (view + 4), length, SQLITE_TRANSIENT);
+      }
+      else {
+        sqlite3_stmt * stmt;
+        const char * zSql = sqlite3_mprintf("SELECT data FROM " VEC0_SHADOW_METADATA_TEXT_DATA_NAME " WHERE rowid = ?", p->schemaName, p->tableName, metadata_idx);
+        if(!zSql) {
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+        sqlite3_free((void *) zSql);
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        sqlite3_bind_int64(stmt, 1, rowid);
+        rc = sqlite3_step(stmt);
+        if(rc != SQLITE_ROW) {
+          sqlite3_finalize(stmt);
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        sqlite3_result_value(context, sqlite3_column_value(stmt, 0));
+        sqlite3_finalize(stmt);
+        rc = SQLITE_OK;
+      }
+      break;
+    }
+  }
+  done:
+    // blobValue is read-only, will not fail on close
+    sqlite3_blob_close(blobValue);
+    return rc;
 
-  /**
-   * Statement to insert a row into the _rowids table, with an id.
-   * The id column isn't a tradition primary key, but instead a unique
-   * column to handle "text primary key" vec0 tables. The true int64 rowid
-   * can be retrieved after inserting with sqlite3_last_rowid().
-   *
-   * Parameters:
-   *    1: text or null, id to insert
-   * Result columns: none
-   *
-   * Must be cleaned up with sqlite3_finalize().
-   */
-  sqlite3_stmt *stmtRowidsInsertId;
+}
 
-  /**
-   * Statement to update the "position" columns chunk_id and chunk_offset for
-   * a given _rowids row. Used when the "next available" chunk position is found
-   * for a vector.
-   *
-   * Parameters:
-   *    1: int64, chunk_id value
-   *    2: int64, chunk_offset value
-   *    3: int64, rowid value
-   * Result columns: none
-   *
-   * Must be cleaned up with sqlite3_finalize().
-   */
-  sqlite3_stmt *stmtRowidsUpdatePosition;
+int vec0_get_latest_chunk_rowid(vec0_vtab *p, i64 *chunk_rowid, sqlite3_value ** partitionKeyValues) {
+  int rc;
+  const char *zSql;
+  // lazy initialize stmtLatestChunk when needed. May be cleared during xSync()
+  if (!p->stmtLatestChunk) {
+    if(p->numPartitionColumns > 0) {
+      sqlite3_str * s = sqlite3_str_new(NULL);
+      sqlite3_str_appendf(s, "SELECT max(rowid) FROM " VEC0_SHADOW_CHUNKS_NAME " WHERE ",
+                           p->schemaName, p->tableName);
 
-  /**
-   * Statement to quickly find the chunk_id + chunk_offset of a given row.
-   * Parameters:
-   *  1: rowid of the row/vector to lookup
-   * Result columns:
-   *  0: chunk_id (i64)
-   *  1: chunk_offset (i64)
-   * SQL: "SELECT id, chunk_id, chunk_offset FROM _rowids WHERE rowid = ?""
-   *
-   * Must be cleaned up with sqlite3_finalize().
-   */
-  sqlite3_stmt *stmtRowidsGetChunkPosition;
+      for(int i = 0; i < p->numPartitionColumns; i++) {
+        if(i != 0) {
+          sqlite3_str_appendall(s, " AND ");
+        }
+        sqlite3_str_appendf(s, " partition%02d = ? ", i);
+      }
+      zSql = sqlite3_str_finish(s);
+    }else {
+      zSql = sqlite3_mprintf("SELECT max(rowid) FROM " VEC0_SHADOW_CHUNKS_NAME,
+                           p->schemaName, p->tableName);
+    }
 
-  // === DiskANN additions ===
-#if SQLITE_VEC_ENABLE_DISKANN
-  // Shadow table names for DiskANN, per vector column
-  // e.g., "{schema}"."{table}_vectors{00..15}"
-  char *shadowVectorsNames[VEC0_MAX_VECTOR_COLUMNS];
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtLatestChunk, 0);
+    sqlite3_free((void *)zSql);
+    if (rc != SQLITE_OK) {
+      // IMP: V21406_05476
+      vtab_set_error(&p->base, VEC_INTERAL_ERROR
+                     "could not initialize 'latest chunk' statement");
+      goto cleanup;
+    }
+  }
 
-  // e.g., "{schema}"."{table}_diskann_nodes{00..15}"
-  char *shadowDiskannNodesNames[VEC0_MAX_VECTOR_COLUMNS];
+  for(int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_bind_value(p->stmtLatestChunk, i+1, (partitionKeyValues[i]));
+  }
 
-  // Prepared statements for DiskANN operations (per vector column)
-  // These will be lazily prepared on first use.
-  sqlite3_stmt *stmtDiskannNodeRead[VEC0_MAX_VECTOR_COLUMNS];
-  sqlite3_stmt *stmtDiskannNodeWrite[VEC0_MAX_VECTOR_COLUMNS];
-  sqlite3_stmt *stmtDiskannNodeInsert[VEC0_MAX_VECTOR_COLUMNS];
-  sqlite3_stmt *stmtVectorsRead[VEC0_MAX_VECTOR_COLUMNS];
-  sqlite3_stmt *stmtVectorsInsert[VEC0_MAX_VECTOR_COLUMNS];
-#endif
-};
+  rc = sqlite3_step(p->stmtLatestChunk);
+  if (rc != SQLITE_ROW) {
+    // IMP: V31559_15629
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "Could not find latest chunk");
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
+  if(sqlite3_column_type(p->stmtLatestChunk, 0) == SQLITE_NULL){
+    rc = SQLITE_EMPTY;
+    goto cleanup;
+  }
+  *chunk_rowid = sqlite3_column_int64(p->stmtLatestChunk, 0);
+  rc = sqlite3_step(p->stmtLatestChunk);
+  if (rc != SQLITE_DONE) {
+    vtab_set_error(&p->base,
+                   VEC_INTERAL_ERROR
+                   "unknown result code when closing out stmtLatestChunk. "
+                   "Please file an issue: " REPORT_URL,
+                   p->schemaName, p->shadowChunksName);
+    goto cleanup;
+  }
+  rc = SQLITE_OK;
 
-#if SQLITE_VEC_ENABLE_RESCORE
-// Forward declarations for rescore functions (defined in sqlite-vec-rescore.c,
-// included later after all helpers they depend on are defined).
-static int rescore_create_tables(vec0_vtab *p, sqlite3 *db, char **pzErr);
-static int rescore_drop_tables(vec0_vtab *p);
-static int rescore_new_chunk(vec0_vtab *p, i64 chunk_rowid);
-static int rescore_on_insert(vec0_vtab *p, i64 chunk_rowid, i64 chunk_offset,
-                             i64 rowid, void *vectorDatas[]);
-static int rescore_on_delete(vec0_vtab *p, i64 chunk_id, u64 chunk_offset, i64 rowid);
-static int rescore_delete_chunk(vec0_vtab *p, i64 chunk_id);
-#endif
+cleanup:
+  if (p->stmtLatestChunk) {
+    sqlite3_reset(p->stmtLatestChunk);
+    sqlite3_clear_bindings(p->stmtLatestChunk);
+  }
+  return rc;
+}
 
-/**
- * @brief Finalize all the sqlite3_stmt members in a vec0_vtab.
- *
- * @param p vec0_vtab pointer
- */
-void vec0_free_resources(vec0_vtab *p) {
-  sqlite3_finalize(p->stmtLatestChunk);
-  p->stmtLatestChunk = NULL;
-  sqlite3_finalize(p->stmtRowidsInsertRowid);
-  p->stmtRowidsInsertRowid = NULL;
-  sqlite3_finalize(p->stmtRowidsInsertId);
-  p->stmtRowidsInsertId = NULL;
-  sqlite3_finalize(p->stmtRowidsUpdatePosition);
-  p->stmtRowidsUpdatePosition = NULL;
-  sqlite3_finalize(p->stmtRowidsGetChunkPosition);
-  p->stmtRowidsGetChunkPosition = NULL;
+int vec0_rowids_insert_rowid(vec0_vtab *p, i64 rowid) {
+  int rc = SQLITE_OK;
+  int entered = 0;
+  UNUSED_PARAMETER(entered); // temporary
+  if (!p->stmtRowidsInsertRowid) {
+    const char *zSql =
+        sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_ROWIDS_NAME "(rowid)"
+                        "VALUES (?);",
+                        p->schemaName, p->tableName);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsInsertRowid, 0);
+    sqlite3_free((void *)zSql);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, VEC_INTERAL_ERROR
+                     "could not initialize 'insert rowids' statement");
+      goto cleanup;
+    }
+  }
 
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-  for (int i = 0; i < VEC0_MAX_VECTOR_COLUMNS; i++) {
-    sqlite3_finalize(p->stmtIvfCellMeta[i]); p->stmtIvfCellMeta[i] = NULL;
-    sqlite3_finalize(p->stmtIvfCellUpdateN[i]); p->stmtIvfCellUpdateN[i] = NULL;
-    sqlite3_finalize(p->stmtIvfRowidMapInsert[i]); p->stmtIvfRowidMapInsert[i] = NULL;
-    sqlite3_finalize(p->stmtIvfRowidMapLookup[i]); p->stmtIvfRowidMapLookup[i] = NULL;
-    sqlite3_finalize(p->stmtIvfRowidMapDelete[i]); p->stmtIvfRowidMapDelete[i] = NULL;
-    sqlite3_finalize(p->stmtIvfCentroidsAll[i]); p->stmtIvfCentroidsAll[i] = NULL;
-#if SQLITE_VEC_ENABLE_DISKANN
-    sqlite3_finalize(p->stmtDiskannNodeRead[i]); p->stmtDiskannNodeRead[i] = NULL;
-    sqlite3_finalize(p->stmtDiskannNodeWrite[i]); p->stmtDiskannNodeWrite[i] = NULL;
-    sqlite3_finalize(p->stmtDiskannNodeInsert[i]); p->stmtDiskannNodeInsert[i] = NULL;
-    sqlite3_finalize(p->stmtVectorsRead[i]); p->stmtVectorsRead[i] = NULL;
-    sqlite3_finalize(p->stmtVectorsInsert[i]); p->stmtVectorsInsert[i] = NULL;
-#endif
+#if SQLITE_THREADSAFE
+  if (sqlite3_mutex_enter) {
+    sqlite3_mutex_enter(sqlite3_db_mutex(p->db));
+    entered = 1;
   }
 #endif
-}
-
-/**
- * @brief Free all memory and sqlite3_stmt members of a vec0_vtab
- *
- * @param p vec0_vtab pointer
- */
-void vec0_free(vec0_vtab *p) {
-  vec0_free_resources(p);
+  sqlite3_bind_int64(p->stmtRowidsInsertRowid, 1, rowid);
+  rc = sqlite3_step(p->stmtRowidsInsertRowid);
 
-  sqlite3_free(p->schemaName);
-  p->schemaName = NULL;
-  sqlite3_free(p->tableName);
-  p->tableName = NULL;
-  sqlite3_free(p->shadowChunksName);
-  p->shadowChunksName = NULL;
-  sqlite3_free(p->shadowRowidsName);
-  p->shadowRowidsName = NULL;
+  if (rc != SQLITE_DONE) {
+    if (sqlite3_extended_errcode(p->db) == SQLITE_CONSTRAINT_PRIMARYKEY) {
+      // IMP: V17090_01160
+      vtab_set_error(&p->base, "UNIQUE constraint failed on %s primary key",
+                     p->tableName);
+    } else {
+      // IMP: V04679_21517
+      vtab_set_error(&p->base,
+                     "Error inserting rowid into rowids shadow table: %s",
+                     sqlite3_errmsg(sqlite3_db_handle(p->stmtRowidsInsertId)));
+    }
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
 
-  for (int i = 0; i < p->numVectorColumns; i++) {
-    sqlite3_free(p->shadowVectorChunksNames[i]);
-    p->shadowVectorChunksNames[i] = NULL;
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-    sqlite3_free(p->shadowIvfCellsNames[i]);
-    p->shadowIvfCellsNames[i] = NULL;
-#endif
+  rc = SQLITE_OK;
 
-#if SQLITE_VEC_ENABLE_RESCORE
-    sqlite3_free(p->shadowRescoreChunksNames[i]);
-    p->shadowRescoreChunksNames[i] = NULL;
+cleanup:
+  if (p->stmtRowidsInsertRowid) {
+    sqlite3_reset(p->stmtRowidsInsertRowid);
+    sqlite3_clear_bindings(p->stmtRowidsInsertRowid);
+  }
 
-    sqlite3_free(p->shadowRescoreVectorsNames[i]);
-    p->shadowRescoreVectorsNames[i] = NULL;
+#if SQLITE_THREADSAFE
+  if (sqlite3_mutex_leave && entered) {
+    sqlite3_mutex_leave(sqlite3_db_mutex(p->db));
+  }
 #endif
+  return rc;
+}
+
+int vec0_rowids_insert_id(vec0_vtab *p, sqlite3_value *idValue, i64 *rowid) {
+  int rc = SQLITE_OK;
+  int entered = 0;
+  UNUSED_PARAMETER(entered); // temporary
+  if (!p->stmtRowidsInsertId) {
+    const char *zSql =
+        sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_ROWIDS_NAME "(id)"
+                        "VALUES (?);",
+                        p->schemaName, p->tableName);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto complete;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsInsertId, 0);
+    sqlite3_free((void *)zSql);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, VEC_INTERAL_ERROR
+                     "could not initialize 'insert rowids id' statement");
+      goto complete;
+    }
+  }
 
-#if SQLITE_VEC_ENABLE_DISKANN
-    sqlite3_free(p->shadowVectorsNames[i]);
-    p->shadowVectorsNames[i] = NULL;
-    sqlite3_free(p->shadowDiskannNodesNames[i]);
-    p->shadowDiskannNodesNames[i] = NULL;
+#if SQLITE_THREADSAFE
+  if (sqlite3_mutex_enter) {
+    sqlite3_mutex_enter(sqlite3_db_mutex(p->db));
+    entered = 1;
+  }
 #endif
 
-    sqlite3_free(p->vector_columns[i].name);
-    p->vector_columns[i].name = NULL;
+  if (idValue) {
+    sqlite3_bind_value(p->stmtRowidsInsertId, 1, idValue);
   }
+  rc = sqlite3_step(p->stmtRowidsInsertId);
 
-  for (int i = 0; i < p->numPartitionColumns; i++) {
-    sqlite3_free(p->paritition_columns[i].name);
-    p->paritition_columns[i].name = NULL;
+  if (rc != SQLITE_DONE) {
+    if (sqlite3_extended_errcode(p->db) == SQLITE_CONSTRAINT_UNIQUE) {
+      // IMP: V20497_04568
+      vtab_set_error(&p->base, "UNIQUE constraint failed on %s primary key",
+                     p->tableName);
+    } else {
+      // IMP: V24016_08086
+      // IMP: V15177_32015
+      vtab_set_error(&p->base,
+                     "Error inserting id into rowids shadow table: %s",
+                     sqlite3_errmsg(sqlite3_db_handle(p->stmtRowidsInsertId)));
+    }
+    rc = SQLITE_ERROR;
+    goto complete;
   }
 
-  for (int i = 0; i < p->numAuxiliaryColumns; i++) {
-    sqlite3_free(p->auxiliary_columns[i].name);
-    p->auxiliary_columns[i].name = NULL;
-  }
+  *rowid = sqlite3_last_insert_rowid(p->db);
+  rc = SQLITE_OK;
 
-  for (int i = 0; i < p->numMetadataColumns; i++) {
-    sqlite3_free(p->metadata_columns[i].name);
-    p->metadata_columns[i].name = NULL;
+complete:
+  if (p->stmtRowidsInsertId) {
+    sqlite3_reset(p->stmtRowidsInsertId);
+    sqlite3_clear_bindings(p->stmtRowidsInsertId);
   }
-}
 
-#if SQLITE_VEC_ENABLE_DISKANN
-#include "sqlite-vec-diskann.c"
-#else
-static int vec0_all_columns_diskann(vec0_vtab *p) { (void)p; return 0; }
+#if SQLITE_THREADSAFE
+  if (sqlite3_mutex_leave && entered) {
+    sqlite3_mutex_leave(sqlite3_db_mutex(p->db));
+  }
 #endif
-
-int vec0_num_defined_user_columns(vec0_vtab *p) {
-  return p->numVectorColumns + p->numPartitionColumns + p->numAuxiliaryColumns + p->numMetadataColumns;
+  return rc;
 }
 
-/**
- * @brief Returns the index of the distance hidden column for the given vec0
- * table.
- *
- * @param p vec0 table
- * @return int
- */
-int vec0_column_command_idx(vec0_vtab *p) {
-  // Command column is the first hidden column (right after user columns)
-  return VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(p);
+int vec0_metadata_chunk_size(vec0_metadata_column_kind kind, int chunk_size) {
+  switch(kind) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN:
+      return chunk_size / 8;
+    case VEC0_METADATA_COLUMN_KIND_INTEGER:
+      return chunk_size * sizeof(i64);
+    case VEC0_METADATA_COLUMN_KIND_FLOAT:
+      return chunk_size * sizeof(double);
+    case VEC0_METADATA_COLUMN_KIND_TEXT:
+      return chunk_size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+  }
+  return 0;
 }
 
-int vec0_column_distance_idx(vec0_vtab *p) {
-  int base = VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(p);
-  return base + (p->hasCommandColumn ? 1 : 0);
-}
+int vec0_rowids_update_position(vec0_vtab *p, i64 rowid, i64 chunk_rowid,
+                                i64 chunk_offset) {
+  int rc = SQLITE_OK;
 
-int vec0_column_k_idx(vec0_vtab *p) {
-  int base = VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(p);
-  return base + (p->hasCommandColumn ? 2 : 1);
-}
+  if (!p->stmtRowidsUpdatePosition) {
+    const char *zSql = sqlite3_mprintf(" UPDATE " VEC0_SHADOW_ROWIDS_NAME
+                                       " SET chunk_id = ?, chunk_offset = ?"
+                                       " WHERE rowid = ?",
+                                       p->schemaName, p->tableName);
+    if (!zSql) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsUpdatePosition, 0);
+    sqlite3_free((void *)zSql);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, VEC_INTERAL_ERROR
+                     "could not initialize 'update rowids position' statement");
+      goto cleanup;
+    }
+  }
 
-/**
- * Returns 1 if the given column-based index is a valid vector column,
- * 0 otherwise.
- */
-int vec0_column_idx_is_vector(vec0_vtab *pVtab, int column_idx) {
-  return column_idx >= VEC0_COLUMN_USERN_START &&
-         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
-         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_VECTOR;
-}
+  sqlite3_bind_int64(p->stmtRowidsUpdatePosition, 1, chunk_rowid);
+  sqlite3_bind_int64(p->stmtRowidsUpdatePosition, 2, chunk_offset);
+  sqlite3_bind_int64(p->stmtRowidsUpdatePosition, 3, rowid);
 
-/**
- * Returns the vector index of the given user column index.
- * ONLY call if validated with vec0_column_idx_is_vector before
- */
-int vec0_column_idx_to_vector_idx(vec0_vtab *pVtab, int column_idx) {
-  UNUSED_PARAMETER(pVtab);
-  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
-}
-/**
- * Returns 1 if the given column-based index is a "partition key" column,
- * 0 otherwise.
- */
-int vec0_column_idx_is_partition(vec0_vtab *pVtab, int column_idx) {
-  return column_idx >= VEC0_COLUMN_USERN_START &&
-         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
-         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_PARTITION;
-}
+  rc = sqlite3_step(p->stmtRowidsUpdatePosition);
+  if (rc != SQLITE_DONE) {
+    // IMP: V21925_05995
+    vtab_set_error(&p->base,
+                   VEC_INTERAL_ERROR
+                   "could not update rowids position for rowid=%lld, "
+                   "chunk_rowid=%lld, chunk_offset=%lld",
+                   rowid, chunk_rowid, chunk_offset);
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
+  rc = SQLITE_OK;
 
-/**
- * Returns the partition column index of the given user column index.
- * ONLY call if validated with vec0_column_idx_is_vector before
- */
-int vec0_column_idx_to_partition_idx(vec0_vtab *pVtab, int column_idx) {
-  UNUSED_PARAMETER(pVtab);
-  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+cleanup:
+  if (p->stmtRowidsUpdatePosition) {
+    sqlite3_reset(p->stmtRowidsUpdatePosition);
+    sqlite3_clear_bindings(p->stmtRowidsUpdatePosition);
+  }
+
+  return rc;
 }
 
 /**
- * Returns 1 if the given column-based index is a auxiliary column,
- * 0 otherwise.
+ * @brief Whether chunks of a vector column can keep a bounding box.
+ *
+ * KNN scans use the box of a chunk to skip it when no vector inside could
+ * beat the current k-th distance. That needs a lower bound on the distance
+ * from the query to any point of the box, which only exists cheaply for
+ * float32 L2 and L1 columns stored in plain chunks. Boxes cost every write a
+ * blob read and write, and only prune when chunks hold tight clusters in
+ * few dimensions, so new columns keep them only with chunk_bounds=1.
  */
-int vec0_column_idx_is_auxiliary(vec0_vtab *pVtab, int column_idx) {
-  return column_idx >= VEC0_COLUMN_USERN_START &&
-         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
-         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY;
+static int vec0_vector_bounds_supported(const struct VectorColumnDefinition *column) {
+  return column->index_type == VEC0_INDEX_TYPE_FLAT &&
+         column->element_type == SQLITE_VEC_ELEMENT_TYPE_FLOAT32 &&
+         (column->distance_metric == VEC0_DISTANCE_METRIC_L2 ||
+          column->distance_metric == VEC0_DISTANCE_METRIC_L1);
 }
 
 /**
- * Returns the auxiliary column index of the given user column index.
- * ONLY call if validated with vec0_column_idx_to_partition_idx before
+ * @brief Whether an existing table keeps bounding boxes for a vector column.
+ * Tables created before boxes existed have no 'vector_bounds_NN' key in _info.
  */
-int vec0_column_idx_to_auxiliary_idx(vec0_vtab *pVtab, int column_idx) {
-  UNUSED_PARAMETER(pVtab);
-  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+static int vec0_vector_bounds_stored(sqlite3 *db, const char *schemaName,
+                                     const char *tableName, int vectorColumnIdx) {
+  int found = 0;
+  sqlite3_stmt *stmt = NULL;
+  char *zSql = sqlite3_mprintf("SELECT 1 FROM " VEC0_SHADOW_INFO_NAME
+                               " WHERE key = 'vector_bounds_%02d'",
+                               schemaName, tableName, vectorColumnIdx);
+  if (!zSql) {
+    return 0;
+  }
+  if (sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL) == SQLITE_OK) {
+    found = sqlite3_step(stmt) == SQLITE_ROW;
+  }
+  sqlite3_free(zSql);
+  sqlite3_finalize(stmt);
+  return found;
 }
 
 /**
- * Returns 1 if the given column-based index is a metadata column,
- * 0 otherwise.
+ * @brief Fill bounds (lo[dims] then hi[dims]) with the empty box, which every
+ * vector widens and every distance bound treats as infinitely far away.
  */
-int vec0_column_idx_is_metadata(vec0_vtab *pVtab, int column_idx) {
-  return column_idx >= VEC0_COLUMN_USERN_START &&
-         column_idx <= (VEC0_COLUMN_USERN_START + vec0_num_defined_user_columns(pVtab) - 1) &&
-         pVtab->user_column_kinds[column_idx - VEC0_COLUMN_USERN_START] == SQLITE_VEC0_USER_COLUMN_KIND_METADATA;
+static void vec0_vector_bounds_empty(f32 *bounds, size_t dims) {
+  for (size_t d = 0; d < dims; d++) {
+    bounds[d] = INFINITY;
+    bounds[dims + d] = -INFINITY;
+  }
 }
 
 /**
- * Returns the metadata column index of the given user column index.
- * ONLY call if validated with vec0_column_idx_is_metadata before
+ * @brief Widen bounds to cover vector.
+ * @return 1 if bounds changed, 0 otherwise
  */
-int vec0_column_idx_to_metadata_idx(vec0_vtab *pVtab, int column_idx) {
-  UNUSED_PARAMETER(pVtab);
-  return pVtab->user_column_idxs[column_idx - VEC0_COLUMN_USERN_START];
+static int vec0_vector_bounds_widen(f32 *bounds, size_t dims,
+                                    const f32 *vector) {
+  int widened = 0;
+  for (size_t d = 0; d < dims; d++) {
+    if (vector[d] < bounds[d]) {
+      bounds[d] = vector[d];
+      widened = 1;
+    }
+    if (vector[d] > bounds[dims + d]) {
+      bounds[dims + d] = vector[d];
+      widened = 1;
+    }
+  }
+  return widened;
 }
 
 /**
- * @brief Retrieve the chunk_id, chunk_offset, and possible "id" value
- * of a vec0_vtab row with the provided rowid
- *
- * @param p vec0_vtab
- * @param rowid the rowid of the row to query
- * @param id output, optional sqlite3_value to provide the id.
- *            Useful for text PK rows. Must be freed with sqlite3_value_free()
- * @param chunk_id output, the chunk_id the row belongs to
- * @param chunk_offset  output, the offset within the chunk the row belongs to
- * @return SQLITE_ROW on success, error code otherwise. SQLITE_EMPTY if row DNE
+ * @brief Insert an empty box for a new chunk into every _vector_boundsNN table.
  */
-int vec0_get_chunk_position(vec0_vtab *p, i64 rowid, sqlite3_value **id,
-                            i64 *chunk_id, i64 *chunk_offset) {
+static int vec0_vector_bounds_new_chunk(vec0_vtab *p, i64 chunk_id) {
   int rc;
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (!p->shadowVectorBoundsNames[i]) {
+      continue;
+    }
+    size_t dims = p->vector_columns[i].dimensions;
+    f32 *bounds = sqlite3_malloc64(2 * dims * sizeof(f32));
+    if (!bounds) {
+      return SQLITE_NOMEM;
+    }
+    vec0_vector_bounds_empty(bounds, dims);
 
-  if (!p->stmtRowidsGetChunkPosition) {
-    const char *zSql =
-        sqlite3_mprintf("SELECT id, chunk_id, chunk_offset "
-                        "FROM " VEC0_SHADOW_ROWIDS_NAME " WHERE rowid = ?",
-                        p->schemaName, p->tableName);
+    sqlite3_stmt *stmt;
+    char *zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_VECTOR_BOUNDS_N_NAME
+                                 "(rowid, bounds) VALUES (?, ?)",
+                                 p->schemaName, p->tableName, i);
     if (!zSql) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
+      sqlite3_free(bounds);
+      return SQLITE_NOMEM;
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsGetChunkPosition, 0);
-    sqlite3_free((void *)zSql);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
     if (rc != SQLITE_OK) {
-      vtab_set_error(
-          &p->base, VEC_INTERAL_ERROR
-          "could not initialize 'rowids get chunk position' statement");
-      goto cleanup;
+      sqlite3_free(bounds);
+      return rc;
+    }
+    sqlite3_bind_int64(stmt, 1, chunk_id);
+    sqlite3_bind_blob(stmt, 2, bounds, 2 * dims * sizeof(f32), sqlite3_free);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+      return SQLITE_ERROR;
     }
   }
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Widen the box of a chunk to cover vectors just written to it.
+ *
+ * @param p vec0_vtab
+ * @param i index of the vector column, which must keep bounds
+ * @param chunk_id rowid of the chunk
+ * @param vectors n float32 vectors of the column's dimensions, back to back
+ * @param n number of vectors
+ * @return int SQLITE_OK on success, error code otherwise
+ */
+static int vec0_vector_bounds_add(vec0_vtab *p, int i, i64 chunk_id,
+                                  const f32 *vectors, int n) {
+  int rc, brc;
+  size_t dims = p->vector_columns[i].dimensions;
+  i64 size = 2 * dims * sizeof(f32);
+  sqlite3_blob *blob = NULL;
+  f32 *bounds = NULL;
 
-  sqlite3_bind_int64(p->stmtRowidsGetChunkPosition, 1, rowid);
-  rc = sqlite3_step(p->stmtRowidsGetChunkPosition);
-  // special case: when no results, return SQLITE_EMPTY to convey "that chunk
-  // position doesnt exist"
-  if (rc == SQLITE_DONE) {
-    rc = SQLITE_EMPTY;
+  rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowVectorBoundsNames[i],
+                         "bounds", chunk_id, 1, &blob);
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "could not open bounds blob on %s.%s.%lld",
+                   p->schemaName, p->shadowVectorBoundsNames[i], chunk_id);
+    return rc;
+  }
+  if (sqlite3_blob_bytes(blob) != size) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "bounds blob size mismatch on %s.%s.%lld",
+                   p->schemaName, p->shadowVectorBoundsNames[i], chunk_id);
+    rc = SQLITE_ERROR;
     goto cleanup;
   }
-  if (rc != SQLITE_ROW) {
+  bounds = sqlite3_malloc64(size);
+  if (!bounds) {
+    rc = SQLITE_NOMEM;
     goto cleanup;
   }
-
-  if (id) {
-    sqlite3_value *value =
-        sqlite3_column_value(p->stmtRowidsGetChunkPosition, 0);
-    *id = sqlite3_value_dup(value);
-    if (!*id) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
-    }
+  rc = sqlite3_blob_read(blob, bounds, size, 0);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
   }
 
-  if (chunk_id) {
-    *chunk_id = sqlite3_column_int64(p->stmtRowidsGetChunkPosition, 1);
+  int widened = 0;
+  for (int j = 0; j < n; j++) {
+    widened |= vec0_vector_bounds_widen(bounds, dims, vectors + j * dims);
   }
-  if (chunk_offset) {
-    *chunk_offset = sqlite3_column_int64(p->stmtRowidsGetChunkPosition, 2);
+  if (widened) {
+    rc = sqlite3_blob_write(blob, bounds, size, 0);
   }
 
-  rc = SQLITE_OK;
-
 cleanup:
-  sqlite3_reset(p->stmtRowidsGetChunkPosition);
-  sqlite3_clear_bindings(p->stmtRowidsGetChunkPosition);
-  return rc;
+  sqlite3_free(bounds);
+  brc = sqlite3_blob_close(blob);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  return brc;
 }
 
 /**
- * @brief Return the id value from the _rowids table where _rowids.rowid =
- * rowid.
- *
- * @param pVtab: vec0 table to query
- * @param rowid: rowid of the row to query.
- * @param out: A dup'ed sqlite3_value of the id column. Might be null.
- *                         Must be cleaned up with sqlite3_value_free().
- * @returns SQLITE_OK on success, error code on failure
+ * @brief Recompute the box of a chunk from its remaining rows, resetting its
+ * delete count.
  */
-int vec0_get_id_value_from_rowid(vec0_vtab *pVtab, i64 rowid,
-                                 sqlite3_value **out) {
-  // PERF: different strategy than get_chunk_position?
-  return vec0_get_chunk_position((vec0_vtab *)pVtab, rowid, out, NULL, NULL);
-}
-
-int vec0_rowid_from_id(vec0_vtab *p, sqlite3_value *valueId, i64 *rowid) {
-  sqlite3_stmt *stmt = NULL;
+static int vec0_vector_bounds_rebuild(vec0_vtab *p, int i, i64 chunk_id) {
   int rc;
-  char *zSql;
-  zSql = sqlite3_mprintf("SELECT rowid"
-                         " FROM " VEC0_SHADOW_ROWIDS_NAME " WHERE id = ?",
-                         p->schemaName, p->tableName);
+  size_t dims = p->vector_columns[i].dimensions;
+  sqlite3_stmt *stmt = NULL;
+  f32 *bounds = sqlite3_malloc64(2 * dims * sizeof(f32));
+  if (!bounds) {
+    return SQLITE_NOMEM;
+  }
+  vec0_vector_bounds_empty(bounds, dims);
+
+  char *zSql = sqlite3_mprintf(
+      "SELECT chunks.validity, vectors.vectors FROM " VEC0_SHADOW_CHUNKS_NAME
+      " AS chunks, " VEC0_SHADOW_VECTOR_N_NAME " AS vectors"
+      " WHERE chunks.rowid = ?1 AND vectors.rowid = ?1",
+      p->schemaName, p->tableName, p->schemaName, p->tableName, i);
   if (!zSql) {
     rc = SQLITE_NOMEM;
     goto cleanup;
@@ -3977,3385 +7700,5042 @@ int vec0_rowid_from_id(vec0_vtab *p, sqlite3_value *valueId, i64 *rowid) {
   if (rc != SQLITE_OK) {
     goto cleanup;
   }
-  sqlite3_bind_value(stmt, 1, valueId);
+  sqlite3_bind_int64(stmt, 1, chunk_id);
   rc = sqlite3_step(stmt);
-  if (rc == SQLITE_DONE) {
-    rc = SQLITE_EMPTY;
-    goto cleanup;
-  }
   if (rc != SQLITE_ROW) {
+    rc = SQLITE_ERROR;
     goto cleanup;
   }
-  *rowid = sqlite3_column_int64(stmt, 0);
-  rc = sqlite3_step(stmt);
-  if (rc != SQLITE_DONE) {
+  const u8 *validity = sqlite3_column_blob(stmt, 0);
+  const f32 *vectors = sqlite3_column_blob(stmt, 1);
+  if (sqlite3_column_bytes(stmt, 0) != p->chunk_size / CHAR_BIT ||
+      sqlite3_column_bytes(stmt, 1) !=
+          (i64)(p->chunk_size * dims * sizeof(f32))) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "chunk %lld has corrupt validity or vectors",
+                   chunk_id);
+    rc = SQLITE_ERROR;
     goto cleanup;
   }
-
-  rc = SQLITE_OK;
-
-cleanup:
+  for (i64 j = 0; j < p->chunk_size; j++) {
+    if (!(validity[j / CHAR_BIT] & (1 << (j % CHAR_BIT)))) {
+      continue;
+    }
+    vec0_vector_bounds_widen(bounds, dims, vectors + j * dims);
+  }
   sqlite3_finalize(stmt);
-  return rc;
-}
+  stmt = NULL;
 
-int vec0_result_id(vec0_vtab *p, sqlite3_context *context, i64 rowid) {
-  if (!p->pkIsText) {
-    sqlite3_result_int64(context, rowid);
-    return SQLITE_OK;
+  zSql = sqlite3_mprintf("UPDATE " VEC0_SHADOW_VECTOR_BOUNDS_N_NAME
+                         " SET bounds = ?, deletes = 0 WHERE rowid = ?",
+                         p->schemaName, p->tableName, i);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
   }
-  sqlite3_value *valueId;
-  int rc = vec0_get_id_value_from_rowid(p, rowid, &valueId);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
   if (rc != SQLITE_OK) {
-    return rc;
-  }
-  if (!valueId) {
-    sqlite3_result_error_nomem(context);
-  } else {
-    sqlite3_result_value(context, valueId);
-    sqlite3_value_free(valueId);
+    goto cleanup;
   }
-  return SQLITE_OK;
+  sqlite3_bind_blob(stmt, 1, bounds, 2 * dims * sizeof(f32), SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, chunk_id);
+  rc = sqlite3_step(stmt);
+  rc = rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+
+cleanup:
+  sqlite3_finalize(stmt);
+  sqlite3_free(bounds);
+  return rc;
 }
 
 /**
- * @brief
+ * @brief Record that a row of a chunk was deleted or overwritten.
  *
- * @param pVtab: virtual table to query
- * @param rowid: row to lookup
- * @param vector_column_idx: which vector column to query
- * @param outVector: Output pointer to the vector buffer.
- *                    Must be sqlite3_free()'ed.
- * @param outVectorSize: Pointer to a int where the size of outVector
- *                       will be stored.
- * @return int SQLITE_OK on success.
+ * The box stays a valid bound without that row, just a looser one, so it's
+ * only rebuilt once VEC0_VECTOR_BOUNDS_REBUILD_FRACTION of the chunk's rows
+ * have gone since the last rebuild.
  */
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-// Forward declaration — defined in sqlite-vec-ivf.c (included later)
-static int ivf_get_vector_data(vec0_vtab *p, i64 rowid, int col_idx,
-                                void **outVector, int *outVectorSize);
-#endif
-
-int vec0_get_vector_data(vec0_vtab *pVtab, i64 rowid, int vector_column_idx,
-                         void **outVector, int *outVectorSize) {
-  vec0_vtab *p = pVtab;
-  int rc, brc;
-
-#if SQLITE_VEC_ENABLE_DISKANN
-  // DiskANN fast path: read from _vectors table
-  if (p->vector_columns[vector_column_idx].index_type == VEC0_INDEX_TYPE_DISKANN) {
-    void *vec = NULL;
-    int vecSize;
-    rc = diskann_vector_read(p, vector_column_idx, rowid, &vec, &vecSize);
+static int vec0_vector_bounds_remove(vec0_vtab *p, int i, i64 chunk_id) {
+  int rc;
+  if (!p->stmtVectorBoundsDelete[i]) {
+    char *zSql = sqlite3_mprintf("UPDATE " VEC0_SHADOW_VECTOR_BOUNDS_N_NAME
+                                 " SET deletes = deletes + 1 WHERE rowid = ?",
+                                 p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtVectorBoundsDelete[i],
+                            NULL);
+    sqlite3_free(zSql);
     if (rc != SQLITE_OK) {
-      vtab_set_error(&pVtab->base,
-                     "Could not fetch vector data for %lld from DiskANN vectors table",
-                     rowid);
-      return SQLITE_ERROR;
+      return rc;
     }
-    *outVector = vec;
-    if (outVectorSize) *outVectorSize = vecSize;
-    return SQLITE_OK;
   }
-#endif
-
-  i64 chunk_id;
-  i64 chunk_offset;
-
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-  // IVF-indexed columns store vectors in _ivf_cells, not _vector_chunks
-  if (p->vector_columns[vector_column_idx].index_type == VEC0_INDEX_TYPE_IVF) {
-    return ivf_get_vector_data(p, rowid, vector_column_idx, outVector, outVectorSize);
+  sqlite3_stmt *stmt = p->stmtVectorBoundsDelete[i];
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  if (rc != SQLITE_DONE) {
+    return SQLITE_ERROR;
   }
-#endif
-  size_t size;
-  void *buf = NULL;
-  int blobOffset;
-  sqlite3_blob *vectorBlob = NULL;
-  assert((vector_column_idx >= 0) &&
-         (vector_column_idx < pVtab->numVectorColumns));
 
-#if SQLITE_VEC_ENABLE_RESCORE
-  // Rescore columns store float vectors in _rescore_vectors (rowid-keyed)
-  if (p->vector_columns[vector_column_idx].index_type == VEC0_INDEX_TYPE_RESCORE) {
-    size = vector_column_byte_size(p->vector_columns[vector_column_idx]);
-    rc = sqlite3_blob_open(p->db, p->schemaName,
-                           p->shadowRescoreVectorsNames[vector_column_idx],
-                           "vector", rowid, 0, &vectorBlob);
-    if (rc != SQLITE_OK) {
-      vtab_set_error(&pVtab->base,
-                     "Could not fetch vector data for %lld from rescore vectors",
-                     rowid);
-      rc = SQLITE_ERROR;
-      goto cleanup;
-    }
-    buf = sqlite3_malloc(size);
-    if (!buf) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
+  if (!p->stmtVectorBoundsDeletes[i]) {
+    char *zSql = sqlite3_mprintf("SELECT deletes FROM "
+                                 VEC0_SHADOW_VECTOR_BOUNDS_N_NAME
+                                 " WHERE rowid = ?",
+                                 p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
     }
-    rc = sqlite3_blob_read(vectorBlob, buf, size, 0);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtVectorBoundsDeletes[i],
+                            NULL);
+    sqlite3_free(zSql);
     if (rc != SQLITE_OK) {
-      sqlite3_free(buf);
-      buf = NULL;
-      rc = SQLITE_ERROR;
-      goto cleanup;
-    }
-    *outVector = buf;
-    if (outVectorSize) {
-      *outVectorSize = size;
+      return rc;
     }
-    rc = SQLITE_OK;
-    goto cleanup;
-  }
-#endif /* SQLITE_VEC_ENABLE_RESCORE */
-
-  rc = vec0_get_chunk_position(pVtab, rowid, NULL, &chunk_id, &chunk_offset);
-  if (rc == SQLITE_EMPTY) {
-    vtab_set_error(&pVtab->base, "Could not find a row with rowid %lld", rowid);
-    goto cleanup;
   }
-  if (rc != SQLITE_OK) {
-    goto cleanup;
+  stmt = p->stmtVectorBoundsDeletes[i];
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  i64 deletes = sqlite3_column_int64(stmt, 0);
+  sqlite3_reset(stmt);
+  if (rc != SQLITE_ROW) {
+    return SQLITE_ERROR;
   }
 
-  rc = sqlite3_blob_open(p->db, p->schemaName,
-                         p->shadowVectorChunksNames[vector_column_idx],
-                         "vectors", chunk_id, 0, &vectorBlob);
-
-  if (rc != SQLITE_OK) {
-    vtab_set_error(&pVtab->base,
-                   "Could not fetch vector data for %lld, opening blob failed",
-                   rowid);
-    rc = SQLITE_ERROR;
-    goto cleanup;
+  if (deletes * VEC0_VECTOR_BOUNDS_REBUILD_FRACTION >= p->chunk_size) {
+    return vec0_vector_bounds_rebuild(p, i, chunk_id);
   }
+  return SQLITE_OK;
+}
 
-  size = vector_column_byte_size(pVtab->vector_columns[vector_column_idx]);
-  blobOffset = chunk_offset * size;
+/**
+ * @brief One end of the value range of a metadata column in a chunk: 0 or 1
+ * for BOOLEAN columns, the value itself for INTEGER and FLOAT columns.
+ */
+union Vec0MetadataBound {
+  i64 i;
+  double f;
+};
 
-  buf = sqlite3_malloc(size);
-  if (!buf) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+/**
+ * @brief Whether an existing table keeps value ranges for a metadata column.
+ * Tables created before ranges existed have no 'metadata_bounds_NN' key in
+ * _info.
+ */
+static int vec0_metadata_bounds_stored(sqlite3 *db, const char *schemaName,
+                                       const char *tableName,
+                                       int metadataColumnIdx) {
+  int found = 0;
+  sqlite3_stmt *stmt = NULL;
+  char *zSql = sqlite3_mprintf("SELECT 1 FROM " VEC0_SHADOW_INFO_NAME
+                               " WHERE key = 'metadata_bounds_%02d'",
+                               schemaName, tableName, metadataColumnIdx);
+  if (!zSql) {
+    return 0;
   }
+  if (sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL) == SQLITE_OK) {
+    found = sqlite3_step(stmt) == SQLITE_ROW;
+  }
+  sqlite3_free(zSql);
+  sqlite3_finalize(stmt);
+  return found;
+}
 
-  rc = sqlite3_blob_read(vectorBlob, buf, size, blobOffset);
-  if (rc != SQLITE_OK) {
-    sqlite3_free(buf);
-    buf = NULL;
-    vtab_set_error(
-        &pVtab->base,
-        "Could not fetch vector data for %lld, reading from blob failed",
-        rowid);
-    rc = SQLITE_ERROR;
-    goto cleanup;
+/**
+ * @brief Value of the row at offset in a _metadatachunksNN data blob.
+ */
+static union Vec0MetadataBound
+vec0_metadata_bound_at(vec0_metadata_column_kind kind, const u8 *data,
+                       i64 offset) {
+  union Vec0MetadataBound value;
+  value.i = 0;
+  switch (kind) {
+  case VEC0_METADATA_COLUMN_KIND_BOOLEAN:
+    value.i = (data[offset / CHAR_BIT] >> (offset % CHAR_BIT)) & 1;
+    break;
+  case VEC0_METADATA_COLUMN_KIND_INTEGER:
+    memcpy(&value.i, data + offset * sizeof(i64), sizeof(i64));
+    break;
+  case VEC0_METADATA_COLUMN_KIND_FLOAT:
+    memcpy(&value.f, data + offset * sizeof(double), sizeof(double));
+    break;
+  case VEC0_METADATA_COLUMN_KIND_TEXT:
+    break;
   }
+  return value;
+}
 
-  *outVector = buf;
-  if (outVectorSize) {
-    *outVectorSize = size;
+/**
+ * @brief Widen the range [lo, hi] to cover value. kind picks the union member.
+ */
+static void vec0_metadata_bound_widen(vec0_metadata_column_kind kind,
+                                      union Vec0MetadataBound *lo,
+                                      union Vec0MetadataBound *hi,
+                                      union Vec0MetadataBound value) {
+  if (kind == VEC0_METADATA_COLUMN_KIND_FLOAT) {
+    if (value.f < lo->f) {
+      lo->f = value.f;
+    }
+    if (value.f > hi->f) {
+      hi->f = value.f;
+    }
+  } else {
+    if (value.i < lo->i) {
+      lo->i = value.i;
+    }
+    if (value.i > hi->i) {
+      hi->i = value.i;
+    }
   }
-  rc = SQLITE_OK;
+}
 
-cleanup:
-  brc = sqlite3_blob_close(vectorBlob);
-  if ((rc == SQLITE_OK) && (brc != SQLITE_OK)) {
-    vtab_set_error(
-        &p->base, VEC_INTERAL_ERROR
-        "unknown error, could not close vector blob, please file an issue");
-    return brc;
+/**
+ * @brief Bind value to a statement parameter as an INTEGER or a REAL.
+ */
+static void vec0_metadata_bound_bind(sqlite3_stmt *stmt, int param,
+                                     vec0_metadata_column_kind kind,
+                                     union Vec0MetadataBound value) {
+  if (kind == VEC0_METADATA_COLUMN_KIND_FLOAT) {
+    sqlite3_bind_double(stmt, param, value.f);
+  } else {
+    sqlite3_bind_int64(stmt, param, value.i);
   }
+}
 
-  return rc;
+/**
+ * @brief Insert an empty range for a new chunk into every _metadataboundsNN
+ * table.
+ */
+static int vec0_metadata_bounds_new_chunk(vec0_vtab *p, i64 chunk_id) {
+  int rc;
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    if (!p->shadowMetadataBoundsNames[i]) {
+      continue;
+    }
+    sqlite3_stmt *stmt;
+    char *zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_METADATA_BOUNDS_N_NAME
+                                 "(rowid) VALUES (?)",
+                                 p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    sqlite3_bind_int64(stmt, 1, chunk_id);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+      return SQLITE_ERROR;
+    }
+  }
+  return SQLITE_OK;
 }
 
 /**
- * @brief Retrieve the sqlite3_value of the i'th partition value for the given row.
+ * @brief Widen the value range of a chunk to cover [lo, hi], the smallest and
+ * largest values just written to it.
  *
- * @param pVtab - the vec0_vtab in questions
- * @param rowid - rowid of target row
- * @param partition_idx - which partition column to retrieve
- * @param outValue - output sqlite3_value
- * @return int - SQLITE_OK on success, otherwise error code
+ * @param p vec0_vtab
+ * @param i index of the metadata column, which must keep bounds
+ * @param chunk_id rowid of the chunk
+ * @return int SQLITE_OK on success, error code otherwise
  */
-int vec0_get_partition_value_for_rowid(vec0_vtab *pVtab, i64 rowid, int partition_idx, sqlite3_value ** outValue) {
+static int vec0_metadata_bounds_add(vec0_vtab *p, int i, i64 chunk_id,
+                                    union Vec0MetadataBound lo,
+                                    union Vec0MetadataBound hi) {
   int rc;
-  i64 chunk_id;
-  i64 chunk_offset;
-  rc = vec0_get_chunk_position(pVtab, rowid, NULL, &chunk_id, &chunk_offset);
-  if(rc != SQLITE_OK) {
-    return rc;
+  vec0_metadata_column_kind kind = p->metadata_columns[i].kind;
+  if (!p->stmtMetadataBoundsWiden[i]) {
+    char *zSql = sqlite3_mprintf(
+        "UPDATE " VEC0_SHADOW_METADATA_BOUNDS_N_NAME
+        " SET lo = CASE WHEN lo IS NULL OR ?1 < lo THEN ?1 ELSE lo END,"
+        " hi = CASE WHEN hi IS NULL OR ?2 > hi THEN ?2 ELSE hi END"
+        " WHERE rowid = ?3",
+        p->schemaName, p->tableName, i);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtMetadataBoundsWiden[i],
+                            NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
   }
-  sqlite3_stmt * stmt = NULL;
-  char * zSql = sqlite3_mprintf("SELECT partition%02d FROM " VEC0_SHADOW_CHUNKS_NAME " WHERE chunk_id = ?", partition_idx, pVtab->schemaName, pVtab->tableName);
-  if(!zSql) {
-    return SQLITE_NOMEM;
+  sqlite3_stmt *stmt = p->stmtMetadataBoundsWiden[i];
+  vec0_metadata_bound_bind(stmt, 1, kind, lo);
+  vec0_metadata_bound_bind(stmt, 2, kind, hi);
+  sqlite3_bind_int64(stmt, 3, chunk_id);
+  rc = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  return rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+}
+
+/**
+ * @brief Widen the value range of a chunk to cover the value in the given
+ * slot, which was just copied there.
+ */
+static int vec0_metadata_bounds_add_slot(vec0_vtab *p, int i, i64 chunk_id,
+                                         i64 chunk_offset) {
+  int rc, brc;
+  vec0_metadata_column_kind kind = p->metadata_columns[i].kind;
+  sqlite3_blob *blob = NULL;
+  u8 buf[sizeof(i64)];
+  i64 offset = 0;
+  int n;
+  switch (kind) {
+  case VEC0_METADATA_COLUMN_KIND_BOOLEAN:
+    n = 1;
+    offset = chunk_offset % CHAR_BIT;
+    break;
+  case VEC0_METADATA_COLUMN_KIND_INTEGER:
+    n = sizeof(i64);
+    break;
+  default:
+    n = sizeof(double);
+    break;
   }
-  rc = sqlite3_prepare_v2(pVtab->db, zSql, -1, &stmt, NULL);
-  sqlite3_free(zSql);
-  if(rc != SQLITE_OK) {
+
+  rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowMetadataChunksNames[i],
+                         "data", chunk_id, 0, &blob);
+  if (rc != SQLITE_OK) {
     return rc;
   }
-  sqlite3_bind_int64(stmt, 1, chunk_id);
-  rc = sqlite3_step(stmt);
-  if(rc != SQLITE_ROW) {
-    rc = SQLITE_ERROR;
-    goto done;
+  rc = sqlite3_blob_read(blob, buf, n,
+                         kind == VEC0_METADATA_COLUMN_KIND_BOOLEAN
+                             ? chunk_offset / CHAR_BIT
+                             : chunk_offset * n);
+  brc = sqlite3_blob_close(blob);
+  if (rc != SQLITE_OK) {
+    return rc;
   }
-  *outValue = sqlite3_value_dup(sqlite3_column_value(stmt, 0));
-  if(!*outValue) {
-    rc = SQLITE_NOMEM;
-    goto done;
+  if (brc != SQLITE_OK) {
+    return brc;
   }
-  rc = SQLITE_OK;
-
-  done:
-    sqlite3_finalize(stmt);
-    return rc;
-
+  union Vec0MetadataBound value = vec0_metadata_bound_at(kind, buf, offset);
+  return vec0_metadata_bounds_add(p, i, chunk_id, value, value);
 }
 
 /**
- * @brief Get the value of an auxiliary column for the given rowid
- *
- * @param pVtab vec0_vtab
- * @param rowid the rowid of the row to lookup
- * @param auxiliary_idx aux index of the column we care about
- * @param outValue Output sqlite3_value to store
- * @return int SQLITE_OK on success, error code otherwise
+ * @brief Recompute the value range of a chunk from its remaining rows,
+ * resetting its delete count. A chunk without rows gets a NULL range.
  */
-int vec0_get_auxiliary_value_for_rowid(vec0_vtab *pVtab, i64 rowid, int auxiliary_idx, sqlite3_value ** outValue) {
+static int vec0_metadata_bounds_rebuild(vec0_vtab *p, int i, i64 chunk_id) {
   int rc;
-  sqlite3_stmt * stmt = NULL;
-  char * zSql = sqlite3_mprintf("SELECT value%02d FROM " VEC0_SHADOW_AUXILIARY_NAME " WHERE rowid = ?", auxiliary_idx, pVtab->schemaName, pVtab->tableName);
-  if(!zSql) {
+  vec0_metadata_column_kind kind = p->metadata_columns[i].kind;
+  sqlite3_stmt *stmt = NULL;
+  union Vec0MetadataBound lo = {0}, hi = {0};
+  int any = 0;
+
+  char *zSql = sqlite3_mprintf(
+      "SELECT chunks.validity, metadata.data FROM " VEC0_SHADOW_CHUNKS_NAME
+      " AS chunks, " VEC0_SHADOW_METADATA_N_NAME " AS metadata"
+      " WHERE chunks.rowid = ?1 AND metadata.rowid = ?1",
+      p->schemaName, p->tableName, p->schemaName, p->tableName, i);
+  if (!zSql) {
     return SQLITE_NOMEM;
   }
-  rc = sqlite3_prepare_v2(pVtab->db, zSql, -1, &stmt, NULL);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
   sqlite3_free(zSql);
-  if(rc != SQLITE_OK) {
-    return rc;
+  if (rc != SQLITE_OK) {
+    goto cleanup;
   }
-  sqlite3_bind_int64(stmt, 1, rowid);
+  sqlite3_bind_int64(stmt, 1, chunk_id);
   rc = sqlite3_step(stmt);
-  if(rc != SQLITE_ROW) {
+  if (rc != SQLITE_ROW) {
     rc = SQLITE_ERROR;
-    goto done;
+    goto cleanup;
   }
-  *outValue = sqlite3_value_dup(sqlite3_column_value(stmt, 0));
-  if(!*outValue) {
+  const u8 *validity = sqlite3_column_blob(stmt, 0);
+  const u8 *data = sqlite3_column_blob(stmt, 1);
+  if (sqlite3_column_bytes(stmt, 0) != p->chunk_size / CHAR_BIT ||
+      sqlite3_column_bytes(stmt, 1) !=
+          vec0_metadata_chunk_size(kind, p->chunk_size)) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "chunk %lld has corrupt validity or metadata",
+                   chunk_id);
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
+  for (i64 j = 0; j < p->chunk_size; j++) {
+    if (!(validity[j / CHAR_BIT] & (1 << (j % CHAR_BIT)))) {
+      continue;
+    }
+    union Vec0MetadataBound value = vec0_metadata_bound_at(kind, data, j);
+    if (!any) {
+      lo = hi = value;
+      any = 1;
+    } else {
+      vec0_metadata_bound_widen(kind, &lo, &hi, value);
+    }
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  zSql = sqlite3_mprintf("UPDATE " VEC0_SHADOW_METADATA_BOUNDS_N_NAME
+                         " SET lo = ?, hi = ?, deletes = 0 WHERE rowid = ?",
+                         p->schemaName, p->tableName, i);
+  if (!zSql) {
     rc = SQLITE_NOMEM;
-    goto done;
+    goto cleanup;
   }
-  rc = SQLITE_OK;
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  if (any) {
+    vec0_metadata_bound_bind(stmt, 1, kind, lo);
+    vec0_metadata_bound_bind(stmt, 2, kind, hi);
+  }
+  sqlite3_bind_int64(stmt, 3, chunk_id);
+  rc = sqlite3_step(stmt);
+  rc = rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
 
-  done:
-    sqlite3_finalize(stmt);
-    return rc;
+cleanup:
+  sqlite3_finalize(stmt);
+  return rc;
 }
 
 /**
- * @brief Result the given metadata value for the given row and metadata column index.
- * Will traverse the metadatachunksNN table with BLOB I/0 for the given rowid.
- *
- * @param p
- * @param rowid
- * @param metadata_idx
- * @param context
- * @return int
+ * @brief Record that a row of a chunk was deleted or overwritten. Like
+ * vec0_vector_bounds_remove(), the range is only rebuilt once
+ * VEC0_VECTOR_BOUNDS_REBUILD_FRACTION of the chunk's rows have gone.
  */
-int vec0_result_metadata_value_for_rowid(vec0_vtab *p, i64 rowid, int metadata_idx, sqlite3_context * context) {
+static int vec0_metadata_bounds_remove(vec0_vtab *p, int i, i64 chunk_id) {
   int rc;
-  i64 chunk_id;
-  i64 chunk_offset;
-  rc = vec0_get_chunk_position(p, rowid, NULL, &chunk_id, &chunk_offset);
-  if(rc != SQLITE_OK) {
-    return rc;
+  sqlite3_stmt *stmt;
+  char *zSql = sqlite3_mprintf("UPDATE " VEC0_SHADOW_METADATA_BOUNDS_N_NAME
+                               " SET deletes = deletes + 1 WHERE rowid = ?",
+                               p->schemaName, p->tableName, i);
+  if (!zSql) {
+    return SQLITE_NOMEM;
   }
-  sqlite3_blob * blobValue;
-  rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowMetadataChunksNames[metadata_idx], "data", chunk_id, 0, &blobValue);
-  if(rc != SQLITE_OK) {
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
     return rc;
   }
-
-  switch(p->metadata_columns[metadata_idx].kind) {
-    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
-      u8 block;
-      rc = sqlite3_blob_read(blobValue, &block, sizeof(block), chunk_offset / CHAR_BIT);
-      if(rc != SQLITE_OK) {
-        goto done;
-      }
-      int value = block >> ((chunk_offset % CHAR_BIT)) & 1;
-      sqlite3_result_int(context, value);
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
-      i64 value;
-      rc = sqlite3_blob_read(blobValue, &value, sizeof(value), chunk_offset * sizeof(i64));
-      if(rc != SQLITE_OK) {
-        goto done;
-      }
-      sqlite3_result_int64(context, value);
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
-      double value;
-      rc = sqlite3_blob_read(blobValue, &value, sizeof(value), chunk_offset * sizeof(double));
-      if(rc != SQLITE_OK) {
-        goto done;
-      }
-      sqlite3_result_double(context, value);
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_TEXT: {
-      u8 view[VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-      rc = sqlite3_blob_read(blobValue, &view, VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH, chunk_offset * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH);
-      if(rc != SQLITE_OK) {
-        goto done;
-      }
-      int length = ((int *)view)[0];
-      if(length <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-        sqlite3_result_text(context, (const char*) (view + 4), length, SQLITE_TRANSIENT);
-      }
-      else {
-        sqlite3_stmt * stmt;
-        const char * zSql = sqlite3_mprintf("SELECT data FROM " VEC0_SHADOW_METADATA_TEXT_DATA_NAME " WHERE rowid = ?", p->schemaName, p->tableName, metadata_idx);
-        if(!zSql) {
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
-        sqlite3_free((void *) zSql);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        sqlite3_bind_int64(stmt, 1, rowid);
-        rc = sqlite3_step(stmt);
-        if(rc != SQLITE_ROW) {
-          sqlite3_finalize(stmt);
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        sqlite3_result_value(context, sqlite3_column_value(stmt, 0));
-        sqlite3_finalize(stmt);
-        rc = SQLITE_OK;
-      }
-      break;
-    }
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  if (rc != SQLITE_DONE) {
+    return SQLITE_ERROR;
   }
-  done:
-    // blobValue is read-only, will not fail on close
-    sqlite3_blob_close(blobValue);
+
+  zSql = sqlite3_mprintf("SELECT deletes FROM " VEC0_SHADOW_METADATA_BOUNDS_N_NAME
+                         " WHERE rowid = ?",
+                         p->schemaName, p->tableName, i);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
     return rc;
+  }
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  i64 deletes = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  if (rc != SQLITE_ROW) {
+    return SQLITE_ERROR;
+  }
 
+  if (deletes * VEC0_VECTOR_BOUNDS_REBUILD_FRACTION >= p->chunk_size) {
+    return vec0_metadata_bounds_rebuild(p, i, chunk_id);
+  }
+  return SQLITE_OK;
 }
 
-int vec0_get_latest_chunk_rowid(vec0_vtab *p, i64 *chunk_rowid, sqlite3_value ** partitionKeyValues) {
+/**
+ * @brief Whether an existing table tracks free slots in _free_slots. Tables
+ * created before it existed have no 'free_slots' key in _info.
+ */
+static int vec0_free_slots_stored(sqlite3 *db, const char *schemaName,
+                                  const char *tableName) {
+  int found = 0;
+  sqlite3_stmt *stmt = NULL;
+  char *zSql = sqlite3_mprintf("SELECT 1 FROM " VEC0_SHADOW_INFO_NAME
+                               " WHERE key = 'free_slots'",
+                               schemaName, tableName);
+  if (!zSql) {
+    return 0;
+  }
+  if (sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL) == SQLITE_OK) {
+    found = sqlite3_step(stmt) == SQLITE_ROW;
+  }
+  sqlite3_free(zSql);
+  sqlite3_finalize(stmt);
+  return found;
+}
+
+/**
+ * @brief Add delta to the free slot count of a chunk, dropping its row once
+ * the chunk is full. No-op for tables without _free_slots.
+ */
+static int vec0_free_slots_update(vec0_vtab *p, i64 chunk_id, i64 delta) {
   int rc;
-  const char *zSql;
-  // lazy initialize stmtLatestChunk when needed. May be cleared during xSync()
-  if (!p->stmtLatestChunk) {
-    if(p->numPartitionColumns > 0) {
-      sqlite3_str * s = sqlite3_str_new(NULL);
-      sqlite3_str_appendf(s, "SELECT max(rowid) FROM " VEC0_SHADOW_CHUNKS_NAME " WHERE ",
-                           p->schemaName, p->tableName);
+  if (!p->shadowFreeSlotsName || delta == 0) {
+    return SQLITE_OK;
+  }
+  if (!p->stmtFreeSlotsUpdate) {
+    char *zSql = sqlite3_mprintf(
+        "INSERT INTO " VEC0_SHADOW_FREE_SLOTS_NAME "(rowid, free) VALUES (?, ?)"
+        " ON CONFLICT(rowid) DO UPDATE SET free = free + excluded.free",
+        p->schemaName, p->tableName);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtFreeSlotsUpdate, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  sqlite3_bind_int64(p->stmtFreeSlotsUpdate, 1, chunk_id);
+  sqlite3_bind_int64(p->stmtFreeSlotsUpdate, 2, delta);
+  rc = sqlite3_step(p->stmtFreeSlotsUpdate);
+  sqlite3_reset(p->stmtFreeSlotsUpdate);
+  if (rc != SQLITE_DONE) {
+    return SQLITE_ERROR;
+  }
+  if (delta > 0) {
+    return SQLITE_OK;
+  }
 
-      for(int i = 0; i < p->numPartitionColumns; i++) {
-        if(i != 0) {
-          sqlite3_str_appendall(s, " AND ");
-        }
-        sqlite3_str_appendf(s, " partition%02d = ? ", i);
-      }
-      zSql = sqlite3_str_finish(s);
-    }else {
-      zSql = sqlite3_mprintf("SELECT max(rowid) FROM " VEC0_SHADOW_CHUNKS_NAME,
-                           p->schemaName, p->tableName);
+  if (!p->stmtFreeSlotsDeleteFull) {
+    char *zSql = sqlite3_mprintf("DELETE FROM " VEC0_SHADOW_FREE_SLOTS_NAME
+                                 " WHERE rowid = ? AND free <= 0",
+                                 p->schemaName, p->tableName);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtFreeSlotsDeleteFull,
+                            NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
     }
+  }
+  sqlite3_bind_int64(p->stmtFreeSlotsDeleteFull, 1, chunk_id);
+  rc = sqlite3_step(p->stmtFreeSlotsDeleteFull);
+  sqlite3_reset(p->stmtFreeSlotsDeleteFull);
+  return rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+}
+
+/**
+ * @brief Forget a chunk's free slots, when it's deleted or found to be full.
+ */
+static int vec0_free_slots_clear(vec0_vtab *p, i64 chunk_id) {
+  int rc;
+  sqlite3_stmt *stmt;
+  if (!p->shadowFreeSlotsName) {
+    return SQLITE_OK;
+  }
+  char *zSql = sqlite3_mprintf("DELETE FROM " VEC0_SHADOW_FREE_SLOTS_NAME
+                               " WHERE rowid = ?",
+                               p->schemaName, p->tableName);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+}
 
+/**
+ * @brief Find the oldest chunk of a partition with a free slot, for the next
+ * insert. Filling old chunks first keeps deletes from leaving holes behind.
+ *
+ * @return SQLITE_EMPTY when every chunk of the partition is full.
+ */
+static int vec0_free_slots_next_chunk(vec0_vtab *p,
+                                      sqlite3_value **partitionKeyValues,
+                                      i64 *chunk_id) {
+  int rc;
+  // lazily prepared like stmtLatestChunk, and cleared with it in xSync()
+  if (!p->stmtFreeSlotsNextChunk) {
+    sqlite3_str *s = sqlite3_str_new(NULL);
+    sqlite3_str_appendf(s,
+                        "SELECT c.chunk_id FROM " VEC0_SHADOW_FREE_SLOTS_NAME
+                        " AS f JOIN " VEC0_SHADOW_CHUNKS_NAME
+                        " AS c ON c.chunk_id = f.rowid"
+                        // chunks a 'reorganize' is emptying are not refilled
+                        " WHERE f.rowid > coalesce((SELECT value FROM "
+                        VEC0_SHADOW_INFO_NAME
+                        " WHERE key = 'reorganize_chunk'), 0)",
+                        p->schemaName, p->tableName, p->schemaName,
+                        p->tableName, p->schemaName, p->tableName);
+    for (int i = 0; i < p->numPartitionColumns; i++) {
+      sqlite3_str_appendf(s, " AND c.partition%02d = ?", i);
+    }
+    sqlite3_str_appendall(s, " ORDER BY f.rowid LIMIT 1");
+    char *zSql = sqlite3_str_finish(s);
     if (!zSql) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
+      return SQLITE_NOMEM;
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtLatestChunk, 0);
-    sqlite3_free((void *)zSql);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtFreeSlotsNextChunk, NULL);
+    sqlite3_free(zSql);
     if (rc != SQLITE_OK) {
-      // IMP: V21406_05476
       vtab_set_error(&p->base, VEC_INTERAL_ERROR
-                     "could not initialize 'latest chunk' statement");
-      goto cleanup;
+                     "could not initialize 'free slots' statement");
+      return rc;
     }
   }
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_bind_value(p->stmtFreeSlotsNextChunk, i + 1, partitionKeyValues[i]);
+  }
+  rc = sqlite3_step(p->stmtFreeSlotsNextChunk);
+  if (rc == SQLITE_ROW) {
+    *chunk_id = sqlite3_column_int64(p->stmtFreeSlotsNextChunk, 0);
+    rc = SQLITE_OK;
+  } else if (rc == SQLITE_DONE) {
+    rc = SQLITE_EMPTY;
+  } else {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR
+                   "Could not find a chunk with free slots");
+    rc = SQLITE_ERROR;
+  }
+  sqlite3_reset(p->stmtFreeSlotsNextChunk);
+  sqlite3_clear_bindings(p->stmtFreeSlotsNextChunk);
+  return rc;
+}
 
-  for(int i = 0; i < p->numPartitionColumns; i++) {
-    sqlite3_bind_value(p->stmtLatestChunk, i+1, (partitionKeyValues[i]));
+/**
+ * @brief Adds a new chunk for the vec0 table, and the corresponding vector
+ * chunks.
+ *
+ * Inserts a new row into the _chunks table, with blank data, and uses that new
+ * rowid to insert new blank rows into _vector_chunksXX tables.
+ *
+ * @param p: vec0 table to add new chunk
+ * @param paritionKeyValues: Array of partition key valeus for the new chunk, if available
+ * @param chunk_rowid: Output pointer, if not NULL, then will be filled with the
+ * new chunk rowid.
+ * @return int SQLITE_OK on success, error code otherwise.
+ */
+int vec0_new_chunk(vec0_vtab *p, sqlite3_value ** partitionKeyValues, i64 *chunk_rowid) {
+  int rc;
+  char *zSql;
+  sqlite3_stmt *stmt;
+  i64 rowid;
+
+  // Step 1: Insert a new row in _chunks, capture that new rowid
+  if(p->numPartitionColumns > 0) {
+    sqlite3_str * s = sqlite3_str_new(NULL);
+    sqlite3_str_appendf(s, "INSERT INTO " VEC0_SHADOW_CHUNKS_NAME, p->schemaName, p->tableName);
+    sqlite3_str_appendall(s, "(size, validity, rowids");
+    for(int i = 0; i < p->numPartitionColumns; i++) {
+      sqlite3_str_appendf(s, ", partition%02d", i);
+    }
+    sqlite3_str_appendall(s, ") VALUES (?, ?, ?");
+    for(int i = 0; i < p->numPartitionColumns; i++) {
+      sqlite3_str_appendall(s, ", ?");
+    }
+    sqlite3_str_appendall(s, ")");
+
+    zSql = sqlite3_str_finish(s);
+  }else {
+    zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_CHUNKS_NAME
+                         "(size, validity, rowids) "
+                         "VALUES (?, ?, ?);",
+                         p->schemaName, p->tableName);
   }
 
-  rc = sqlite3_step(p->stmtLatestChunk);
-  if (rc != SQLITE_ROW) {
-    // IMP: V31559_15629
-    vtab_set_error(&p->base, VEC_INTERAL_ERROR "Could not find latest chunk");
-    rc = SQLITE_ERROR;
-    goto cleanup;
+  if (!zSql) {
+    return SQLITE_NOMEM;
   }
-  if(sqlite3_column_type(p->stmtLatestChunk, 0) == SQLITE_NULL){
-    rc = SQLITE_EMPTY;
-    goto cleanup;
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return rc;
   }
-  *chunk_rowid = sqlite3_column_int64(p->stmtLatestChunk, 0);
-  rc = sqlite3_step(p->stmtLatestChunk);
-  if (rc != SQLITE_DONE) {
-    vtab_set_error(&p->base,
-                   VEC_INTERAL_ERROR
-                   "unknown result code when closing out stmtLatestChunk. "
-                   "Please file an issue: " REPORT_URL,
-                   p->schemaName, p->shadowChunksName);
-    goto cleanup;
+
+#if SQLITE_THREADSAFE
+  if (sqlite3_mutex_enter) {
+    sqlite3_mutex_enter(sqlite3_db_mutex(p->db));
   }
-  rc = SQLITE_OK;
+#endif
 
-cleanup:
-  if (p->stmtLatestChunk) {
-    sqlite3_reset(p->stmtLatestChunk);
-    sqlite3_clear_bindings(p->stmtLatestChunk);
+  sqlite3_bind_int64(stmt, 1, p->chunk_size);               // size
+  sqlite3_bind_zeroblob(stmt, 2, p->chunk_size / CHAR_BIT); // validity bitmap
+  sqlite3_bind_zeroblob(stmt, 3, p->chunk_size * sizeof(i64)); // rowids
+
+  for(int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_bind_value(stmt, 4 + i, partitionKeyValues[i]);
   }
-  return rc;
-}
 
-int vec0_rowids_insert_rowid(vec0_vtab *p, i64 rowid) {
-  int rc = SQLITE_OK;
-  int entered = 0;
-  UNUSED_PARAMETER(entered); // temporary
-  if (!p->stmtRowidsInsertRowid) {
-    const char *zSql =
-        sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_ROWIDS_NAME "(rowid)"
-                        "VALUES (?);",
-                        p->schemaName, p->tableName);
+  rc = sqlite3_step(stmt);
+  int failed = rc != SQLITE_DONE;
+  rowid = sqlite3_last_insert_rowid(p->db);
+#if SQLITE_THREADSAFE
+  if (sqlite3_mutex_leave) {
+    sqlite3_mutex_leave(sqlite3_db_mutex(p->db));
+  }
+#endif
+  sqlite3_finalize(stmt);
+  if (failed) {
+    return SQLITE_ERROR;
+  }
+
+  // Step 2: Create new vector chunks for each vector column, with
+  //          that new chunk_rowid.
+  //
+  // SHADOW_TABLE_ROWID_QUIRK: The _vector_chunksNN and _metadatachunksNN
+  // shadow tables declare "rowid PRIMARY KEY" without the INTEGER type, so
+  // the user-defined "rowid" column is NOT an alias for the internal SQLite
+  // rowid (_rowid_). When only appending rows these two happen to stay in
+  // sync, but after a chunk is deleted (vec0Update_Delete_DeleteChunkIfEmpty)
+  // and a new one is created, the auto-assigned _rowid_ can diverge from the
+  // user "rowid" value. Since sqlite3_blob_open() addresses rows by internal
+  // _rowid_, we must explicitly set BOTH _rowid_ and "rowid" to the same
+  // value so that later blob operations can find the row.
+  //
+  // The correct long-term fix is changing the schema to
+  //   "rowid INTEGER PRIMARY KEY"
+  // which makes it a true alias, but that would break existing databases.
+
+  for (int i = 0; i < vec0_num_defined_user_columns(p); i++) {
+    if(p->user_column_kinds[i] != SQLITE_VEC0_USER_COLUMN_KIND_VECTOR) {
+      continue;
+    }
+    int vector_column_idx = p->user_column_idxs[i];
+
+    // Non-FLAT columns (rescore, IVF, DiskANN) don't use _vector_chunks
+    if (p->vector_columns[vector_column_idx].index_type != VEC0_INDEX_TYPE_FLAT) {
+      continue;
+    }
+
+    i64 vectorsSize =
+        p->chunk_size * vector_column_byte_size(p->vector_columns[vector_column_idx]);
+
+    // See SHADOW_TABLE_ROWID_QUIRK above for why _rowid_ and rowid are both set.
+    zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_VECTOR_N_NAME
+                           "(_rowid_, rowid, vectors)"
+                           "VALUES (?, ?, ?)",
+                           p->schemaName, p->tableName, vector_column_idx);
     if (!zSql) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
+      return SQLITE_NOMEM;
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsInsertRowid, 0);
-    sqlite3_free((void *)zSql);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+
     if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, VEC_INTERAL_ERROR
-                     "could not initialize 'insert rowids' statement");
-      goto cleanup;
+      sqlite3_finalize(stmt);
+      return rc;
     }
-  }
 
-#if SQLITE_THREADSAFE
-  if (sqlite3_mutex_enter) {
-    sqlite3_mutex_enter(sqlite3_db_mutex(p->db));
-    entered = 1;
-  }
-#endif
-  sqlite3_bind_int64(p->stmtRowidsInsertRowid, 1, rowid);
-  rc = sqlite3_step(p->stmtRowidsInsertRowid);
+    sqlite3_bind_int64(stmt, 1, rowid);  // _rowid_ (internal SQLite rowid)
+    sqlite3_bind_int64(stmt, 2, rowid);  // rowid   (user-defined column)
+    sqlite3_bind_zeroblob64(stmt, 3, vectorsSize);
 
-  if (rc != SQLITE_DONE) {
-    if (sqlite3_extended_errcode(p->db) == SQLITE_CONSTRAINT_PRIMARYKEY) {
-      // IMP: V17090_01160
-      vtab_set_error(&p->base, "UNIQUE constraint failed on %s primary key",
-                     p->tableName);
-    } else {
-      // IMP: V04679_21517
-      vtab_set_error(&p->base,
-                     "Error inserting rowid into rowids shadow table: %s",
-                     sqlite3_errmsg(sqlite3_db_handle(p->stmtRowidsInsertId)));
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+      return rc;
     }
-    rc = SQLITE_ERROR;
-    goto cleanup;
   }
 
-  rc = SQLITE_OK;
+  rc = vec0_vector_bounds_new_chunk(p, rowid);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
 
-cleanup:
-  if (p->stmtRowidsInsertRowid) {
-    sqlite3_reset(p->stmtRowidsInsertRowid);
-    sqlite3_clear_bindings(p->stmtRowidsInsertRowid);
+  rc = vec0_free_slots_update(p, rowid, p->chunk_size);
+  if (rc != SQLITE_OK) {
+    return rc;
   }
 
-#if SQLITE_THREADSAFE
-  if (sqlite3_mutex_leave && entered) {
-    sqlite3_mutex_leave(sqlite3_db_mutex(p->db));
+#if SQLITE_VEC_ENABLE_RESCORE
+  // Create new rescore chunks for each rescore-enabled vector column
+  rc = rescore_new_chunk(p, rowid);
+  if (rc != SQLITE_OK) {
+    return rc;
   }
 #endif
-  return rc;
-}
 
-int vec0_rowids_insert_id(vec0_vtab *p, sqlite3_value *idValue, i64 *rowid) {
-  int rc = SQLITE_OK;
-  int entered = 0;
-  UNUSED_PARAMETER(entered); // temporary
-  if (!p->stmtRowidsInsertId) {
-    const char *zSql =
-        sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_ROWIDS_NAME "(id)"
-                        "VALUES (?);",
-                        p->schemaName, p->tableName);
+  // Step 3: Create new metadata chunks for each metadata column
+  for (int i = 0; i < vec0_num_defined_user_columns(p); i++) {
+    if(p->user_column_kinds[i] != SQLITE_VEC0_USER_COLUMN_KIND_METADATA) {
+      continue;
+    }
+    int metadata_column_idx = p->user_column_idxs[i];
+    // See SHADOW_TABLE_ROWID_QUIRK above for why _rowid_ and rowid are both set.
+    zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_METADATA_N_NAME
+                           "(_rowid_, rowid, data)"
+                           "VALUES (?, ?, ?)",
+                           p->schemaName, p->tableName, metadata_column_idx);
     if (!zSql) {
-      rc = SQLITE_NOMEM;
-      goto complete;
+      return SQLITE_NOMEM;
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsInsertId, 0);
-    sqlite3_free((void *)zSql);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+
     if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, VEC_INTERAL_ERROR
-                     "could not initialize 'insert rowids id' statement");
-      goto complete;
+      sqlite3_finalize(stmt);
+      return rc;
     }
-  }
 
-#if SQLITE_THREADSAFE
-  if (sqlite3_mutex_enter) {
-    sqlite3_mutex_enter(sqlite3_db_mutex(p->db));
-    entered = 1;
+    sqlite3_bind_int64(stmt, 1, rowid);  // _rowid_ (internal SQLite rowid)
+    sqlite3_bind_int64(stmt, 2, rowid);  // rowid   (user-defined column)
+    sqlite3_bind_zeroblob64(stmt, 3, vec0_metadata_chunk_size(vec0_metadata_storage_kind(&p->metadata_columns[metadata_column_idx]), p->chunk_size));
+
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+      return rc;
+    }
   }
-#endif
 
-  if (idValue) {
-    sqlite3_bind_value(p->stmtRowidsInsertId, 1, idValue);
+  rc = vec0_metadata_bounds_new_chunk(p, rowid);
+  if (rc != SQLITE_OK) {
+    return rc;
   }
-  rc = sqlite3_step(p->stmtRowidsInsertId);
 
-  if (rc != SQLITE_DONE) {
-    if (sqlite3_extended_errcode(p->db) == SQLITE_CONSTRAINT_UNIQUE) {
-      // IMP: V20497_04568
-      vtab_set_error(&p->base, "UNIQUE constraint failed on %s primary key",
-                     p->tableName);
-    } else {
-      // IMP: V24016_08086
-      // IMP: V15177_32015
-      vtab_set_error(&p->base,
-                     "Error inserting id into rowids shadow table: %s",
-                     sqlite3_errmsg(sqlite3_db_handle(p->stmtRowidsInsertId)));
-    }
-    rc = SQLITE_ERROR;
-    goto complete;
+  if (chunk_rowid) {
+    *chunk_rowid = rowid;
   }
 
-  *rowid = sqlite3_last_insert_rowid(p->db);
-  rc = SQLITE_OK;
+  return SQLITE_OK;
+}
 
-complete:
-  if (p->stmtRowidsInsertId) {
-    sqlite3_reset(p->stmtRowidsInsertId);
-    sqlite3_clear_bindings(p->stmtRowidsInsertId);
+struct vec0_query_fullscan_data {
+  sqlite3_stmt *rowids_stmt;
+  i8 done;
+};
+void vec0_query_fullscan_data_clear(
+    struct vec0_query_fullscan_data *fullscan_data) {
+  if (!fullscan_data)
+    return;
+
+  if (fullscan_data->rowids_stmt) {
+    sqlite3_finalize(fullscan_data->rowids_stmt);
+    fullscan_data->rowids_stmt = NULL;
   }
+}
 
-#if SQLITE_THREADSAFE
-  if (sqlite3_mutex_leave && entered) {
-    sqlite3_mutex_leave(sqlite3_db_mutex(p->db));
+struct vec0_query_knn_data {
+  i64 k;
+  i64 k_used;
+  // Array of rowids of size k. Must be freed with sqlite3_free().
+  i64 *rowids;
+  // Array of distances of size k. Must be freed with sqlite3_free().
+  f32 *distances;
+  // When set, distances holds squared L2 distances that are only converted
+  // with sqrtf() as they are read out in vec0Column_knn().
+  int distances_squared;
+  // For batched queries, the query each row belongs to, k_used of them. NULL
+  // for a single query vector. Must be freed with sqlite3_free().
+  i32 *query_idxs;
+  i64 current_idx;
+};
+void vec0_query_knn_data_clear(struct vec0_query_knn_data *knn_data) {
+  if (!knn_data)
+    return;
+
+  sqlite3_free(knn_data->query_idxs);
+  knn_data->query_idxs = NULL;
+
+  if (knn_data->rowids) {
+    sqlite3_free(knn_data->rowids);
+    knn_data->rowids = NULL;
+  }
+  if (knn_data->distances) {
+    sqlite3_free(knn_data->distances);
+    knn_data->distances = NULL;
   }
-#endif
-  return rc;
 }
 
-int vec0_metadata_chunk_size(vec0_metadata_column_kind kind, int chunk_size) {
-  switch(kind) {
-    case VEC0_METADATA_COLUMN_KIND_BOOLEAN:
-      return chunk_size / 8;
-    case VEC0_METADATA_COLUMN_KIND_INTEGER:
-      return chunk_size * sizeof(i64);
-    case VEC0_METADATA_COLUMN_KIND_FLOAT:
-      return chunk_size * sizeof(double);
-    case VEC0_METADATA_COLUMN_KIND_TEXT:
-      return chunk_size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+struct vec0_query_point_data {
+  i64 rowid;
+  void *vectors[VEC0_MAX_VECTOR_COLUMNS];
+  int done;
+};
+void vec0_query_point_data_clear(struct vec0_query_point_data *point_data) {
+  if (!point_data)
+    return;
+  for (int i = 0; i < VEC0_MAX_VECTOR_COLUMNS; i++) {
+    sqlite3_free(point_data->vectors[i]);
+    point_data->vectors[i] = NULL;
   }
-  return 0;
 }
 
-int vec0_rowids_update_position(vec0_vtab *p, i64 rowid, i64 chunk_rowid,
-                                i64 chunk_offset) {
-  int rc = SQLITE_OK;
+typedef enum {
+  // If any values are updated, please update the ARCHITECTURE.md docs accordingly!
 
-  if (!p->stmtRowidsUpdatePosition) {
-    const char *zSql = sqlite3_mprintf(" UPDATE " VEC0_SHADOW_ROWIDS_NAME
-                                       " SET chunk_id = ?, chunk_offset = ?"
-                                       " WHERE rowid = ?",
-                                       p->schemaName, p->tableName);
-    if (!zSql) {
-      rc = SQLITE_NOMEM;
-      goto cleanup;
-    }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtRowidsUpdatePosition, 0);
-    sqlite3_free((void *)zSql);
-    if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, VEC_INTERAL_ERROR
-                     "could not initialize 'update rowids position' statement");
-      goto cleanup;
-    }
-  }
+ VEC0_QUERY_PLAN_FULLSCAN = '1',
+ VEC0_QUERY_PLAN_POINT = '2',
+ VEC0_QUERY_PLAN_KNN = '3',
+} vec0_query_plan;
 
-  sqlite3_bind_int64(p->stmtRowidsUpdatePosition, 1, chunk_rowid);
-  sqlite3_bind_int64(p->stmtRowidsUpdatePosition, 2, chunk_offset);
-  sqlite3_bind_int64(p->stmtRowidsUpdatePosition, 3, rowid);
+typedef struct vec0_cursor vec0_cursor;
+struct vec0_cursor {
+  sqlite3_vtab_cursor base;
 
-  rc = sqlite3_step(p->stmtRowidsUpdatePosition);
-  if (rc != SQLITE_DONE) {
-    // IMP: V21925_05995
-    vtab_set_error(&p->base,
-                   VEC_INTERAL_ERROR
-                   "could not update rowids position for rowid=%lld, "
-                   "chunk_rowid=%lld, chunk_offset=%lld",
-                   rowid, chunk_rowid, chunk_offset);
-    rc = SQLITE_ERROR;
-    goto cleanup;
+  vec0_query_plan query_plan;
+  struct vec0_query_fullscan_data *fullscan_data;
+  struct vec0_query_knn_data *knn_data;
+  struct vec0_query_point_data *point_data;
+};
+
+void vec0_cursor_clear(vec0_cursor *pCur) {
+  if (pCur->fullscan_data) {
+    vec0_query_fullscan_data_clear(pCur->fullscan_data);
+    sqlite3_free(pCur->fullscan_data);
+    pCur->fullscan_data = NULL;
   }
-  rc = SQLITE_OK;
-
-cleanup:
-  if (p->stmtRowidsUpdatePosition) {
-    sqlite3_reset(p->stmtRowidsUpdatePosition);
-    sqlite3_clear_bindings(p->stmtRowidsUpdatePosition);
+  if (pCur->knn_data) {
+    vec0_query_knn_data_clear(pCur->knn_data);
+    sqlite3_free(pCur->knn_data);
+    pCur->knn_data = NULL;
+  }
+  if (pCur->point_data) {
+    vec0_query_point_data_clear(pCur->point_data);
+    sqlite3_free(pCur->point_data);
+    pCur->point_data = NULL;
   }
-
-  return rc;
 }
 
-/**
- * @brief Adds a new chunk for the vec0 table, and the corresponding vector
- * chunks.
- *
- * Inserts a new row into the _chunks table, with blank data, and uses that new
- * rowid to insert new blank rows into _vector_chunksXX tables.
- *
- * @param p: vec0 table to add new chunk
- * @param paritionKeyValues: Array of partition key valeus for the new chunk, if available
- * @param chunk_rowid: Output pointer, if not NULL, then will be filled with the
- * new chunk rowid.
- * @return int SQLITE_OK on success, error code otherwise.
- */
-int vec0_new_chunk(vec0_vtab *p, sqlite3_value ** partitionKeyValues, i64 *chunk_rowid) {
+// k-means, used by IVF and by the 'reorganize' command
+#include "sqlite-vec-ivf-kmeans.c"
+
+// IVF index implementation — #include'd here after all struct/helper definitions
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+#include "sqlite-vec-ivf.c"
+#endif
+
+#define VEC_CONSTRUCTOR_ERROR "vec0 constructor error: "
+static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
+                     sqlite3_vtab **ppVtab, char **pzErr, bool isCreate) {
+  UNUSED_PARAMETER(pAux);
+  vec0_vtab *pNew;
   int rc;
-  char *zSql;
-  sqlite3_stmt *stmt;
-  i64 rowid;
+  const char *zSql;
 
-  // Step 1: Insert a new row in _chunks, capture that new rowid
-  if(p->numPartitionColumns > 0) {
-    sqlite3_str * s = sqlite3_str_new(NULL);
-    sqlite3_str_appendf(s, "INSERT INTO " VEC0_SHADOW_CHUNKS_NAME, p->schemaName, p->tableName);
-    sqlite3_str_appendall(s, "(size, validity, rowids");
-    for(int i = 0; i < p->numPartitionColumns; i++) {
-      sqlite3_str_appendf(s, ", partition%02d", i);
-    }
-    sqlite3_str_appendall(s, ") VALUES (?, ?, ?");
-    for(int i = 0; i < p->numPartitionColumns; i++) {
-      sqlite3_str_appendall(s, ", ?");
+  pNew = sqlite3_malloc(sizeof(*pNew));
+  if (pNew == 0)
+    return SQLITE_NOMEM;
+  memset(pNew, 0, sizeof(*pNew));
+
+  // Declared chunk_size=N for entire table.
+  // -1 to use the defualt, otherwise will get re-assigned on `chunk_size=N`
+  // option
+  int chunk_size = -1;
+  int numVectorColumns = 0;
+  int numPartitionColumns = 0;
+  int numAuxiliaryColumns = 0;
+  int numMetadataColumns = 0;
+  int user_column_idx = 0;
+
+  // track if a "primary key" column is defined
+  char *pkColumnName = NULL;
+  int pkColumnNameLength = 0;
+  int pkColumnType = SQLITE_INTEGER;
+
+  for (int i = 3; i < argc; i++) {
+    struct VectorColumnDefinition vecColumn;
+    struct Vec0PartitionColumnDefinition partitionColumn;
+    struct Vec0AuxiliaryColumnDefinition auxColumn;
+    struct Vec0MetadataColumnDefinition metadataColumn;
+    char *cName = NULL;
+    int cNameLength;
+    int cType;
+
+    // Scenario #1: Constructor argument is a vector column definition, ie `foo float[1024]`
+    rc = vec0_parse_vector_column(argv[i], strlen(argv[i]), &vecColumn);
+    if (rc == SQLITE_ERROR) {
+      *pzErr = sqlite3_mprintf(
+          VEC_CONSTRUCTOR_ERROR "could not parse vector column '%s'", argv[i]);
+      goto error;
     }
-    sqlite3_str_appendall(s, ")");
+    if (rc == SQLITE_OK) {
+      if (numVectorColumns >= VEC0_MAX_VECTOR_COLUMNS) {
+        sqlite3_free(vecColumn.name);
+        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+                                 "Too many provided vector columns, maximum %d",
+                                 VEC0_MAX_VECTOR_COLUMNS);
+        goto error;
+      }
 
-    zSql = sqlite3_str_finish(s);
-  }else {
-    zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_CHUNKS_NAME
-                         "(size, validity, rowids) "
-                         "VALUES (?, ?, ?);",
-                         p->schemaName, p->tableName);
-  }
+      if (vecColumn.dimensions > SQLITE_VEC_VEC0_MAX_DIMENSIONS) {
+        sqlite3_free(vecColumn.name);
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "Dimension on vector column too large, provided %lld, maximum %lld",
+            (i64)vecColumn.dimensions, SQLITE_VEC_VEC0_MAX_DIMENSIONS);
+        goto error;
+      }
 
-  if (!zSql) {
-    return SQLITE_NOMEM;
-  }
-  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
-  sqlite3_free(zSql);
-  if (rc != SQLITE_OK) {
-    sqlite3_finalize(stmt);
-    return rc;
-  }
+      // DiskANN validation
+      if (vecColumn.index_type == VEC0_INDEX_TYPE_DISKANN) {
+        if (vecColumn.element_type == SQLITE_VEC_ELEMENT_TYPE_BIT) {
+          sqlite3_free(vecColumn.name);
+          *pzErr = sqlite3_mprintf(
+              VEC_CONSTRUCTOR_ERROR
+              "DiskANN index is not supported on bit vector columns");
+          goto error;
+        }
+        if (vecColumn.diskann.quantizer_type == VEC0_DISKANN_QUANTIZER_BINARY &&
+            (vecColumn.dimensions % CHAR_BIT) != 0) {
+          sqlite3_free(vecColumn.name);
+          *pzErr = sqlite3_mprintf(
+              VEC_CONSTRUCTOR_ERROR
+              "DiskANN with binary quantizer requires dimensions divisible by 8");
+          goto error;
+        }
+      }
 
-#if SQLITE_THREADSAFE
-  if (sqlite3_mutex_enter) {
-    sqlite3_mutex_enter(sqlite3_db_mutex(p->db));
-  }
-#endif
+      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_VECTOR;
+      pNew->user_column_idxs[user_column_idx] = numVectorColumns;
+      memcpy(&pNew->vector_columns[numVectorColumns], &vecColumn, sizeof(vecColumn));
+      numVectorColumns++;
+      pNew->numVectorColumns = numVectorColumns;
+      user_column_idx++;
 
-  sqlite3_bind_int64(stmt, 1, p->chunk_size);               // size
-  sqlite3_bind_zeroblob(stmt, 2, p->chunk_size / CHAR_BIT); // validity bitmap
-  sqlite3_bind_zeroblob(stmt, 3, p->chunk_size * sizeof(i64)); // rowids
+      continue;
+    }
 
-  for(int i = 0; i < p->numPartitionColumns; i++) {
-    sqlite3_bind_value(stmt, 4 + i, partitionKeyValues[i]);
-  }
+    // Scenario #2: Constructor argument is a partition key column definition, ie `user_id text partition key`
+    rc = vec0_parse_partition_key_definition(argv[i], strlen(argv[i]), &cName,
+                                      &cNameLength, &cType);
+    if (rc == SQLITE_OK) {
+      if (numPartitionColumns >= VEC0_MAX_PARTITION_COLUMNS) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "More than %d partition key columns were provided",
+            VEC0_MAX_PARTITION_COLUMNS);
+        goto error;
+      }
+      partitionColumn.type = cType;
+      partitionColumn.name_length = cNameLength;
+      partitionColumn.name = sqlite3_mprintf("%.*s", cNameLength, cName);
+      if(!partitionColumn.name) {
+        rc = SQLITE_NOMEM;
+        goto error;
+      }
 
-  rc = sqlite3_step(stmt);
-  int failed = rc != SQLITE_DONE;
-  rowid = sqlite3_last_insert_rowid(p->db);
-#if SQLITE_THREADSAFE
-  if (sqlite3_mutex_leave) {
-    sqlite3_mutex_leave(sqlite3_db_mutex(p->db));
-  }
-#endif
-  sqlite3_finalize(stmt);
-  if (failed) {
-    return SQLITE_ERROR;
-  }
+      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_PARTITION;
+      pNew->user_column_idxs[user_column_idx] = numPartitionColumns;
+      memcpy(&pNew->paritition_columns[numPartitionColumns], &partitionColumn, sizeof(partitionColumn));
+      numPartitionColumns++;
+      pNew->numPartitionColumns = numPartitionColumns;
+      user_column_idx++;
+      continue;
+    }
 
-  // Step 2: Create new vector chunks for each vector column, with
-  //          that new chunk_rowid.
-  //
-  // SHADOW_TABLE_ROWID_QUIRK: The _vector_chunksNN and _metadatachunksNN
-  // shadow tables declare "rowid PRIMARY KEY" without the INTEGER type, so
-  // the user-defined "rowid" column is NOT an alias for the internal SQLite
-  // rowid (_rowid_). When only appending rows these two happen to stay in
-  // sync, but after a chunk is deleted (vec0Update_Delete_DeleteChunkIfEmpty)
-  // and a new one is created, the auto-assigned _rowid_ can diverge from the
-  // user "rowid" value. Since sqlite3_blob_open() addresses rows by internal
-  // _rowid_, we must explicitly set BOTH _rowid_ and "rowid" to the same
-  // value so that later blob operations can find the row.
-  //
-  // The correct long-term fix is changing the schema to
-  //   "rowid INTEGER PRIMARY KEY"
-  // which makes it a true alias, but that would break existing databases.
+    // Scenario #3: Constructor argument is a primary key column definition, ie `article_id text primary key`
+    rc = vec0_parse_primary_key_definition(argv[i], strlen(argv[i]), &cName,
+                                      &cNameLength, &cType);
+    if (rc == SQLITE_OK) {
+      if (pkColumnName) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "More than one primary key definition was provided, vec0 only "
+            "suports a single primary key column",
+            argv[i]);
+        goto error;
+      }
+      pkColumnName = cName;
+      pkColumnNameLength = cNameLength;
+      pkColumnType = cType;
+      continue;
+    }
 
-  for (int i = 0; i < vec0_num_defined_user_columns(p); i++) {
-    if(p->user_column_kinds[i] != SQLITE_VEC0_USER_COLUMN_KIND_VECTOR) {
+    // Scenario #4: Constructor argument is a auxiliary column definition, ie `+contents text`
+    rc = vec0_parse_auxiliary_column_definition(argv[i], strlen(argv[i]), &cName,
+                                      &cNameLength, &cType);
+    if(rc == SQLITE_OK) {
+      if (numAuxiliaryColumns >= VEC0_MAX_AUXILIARY_COLUMNS) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "More than %d auxiliary columns were provided",
+            VEC0_MAX_AUXILIARY_COLUMNS);
+        goto error;
+      }
+      auxColumn.type = cType;
+      auxColumn.name_length = cNameLength;
+      auxColumn.name = sqlite3_mprintf("%.*s", cNameLength, cName);
+      if(!auxColumn.name) {
+        rc = SQLITE_NOMEM;
+        goto error;
+      }
+
+      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY;
+      pNew->user_column_idxs[user_column_idx] = numAuxiliaryColumns;
+      memcpy(&pNew->auxiliary_columns[numAuxiliaryColumns], &auxColumn, sizeof(auxColumn));
+      numAuxiliaryColumns++;
+      pNew->numAuxiliaryColumns = numAuxiliaryColumns;
+      user_column_idx++;
       continue;
     }
-    int vector_column_idx = p->user_column_idxs[i];
 
-    // Non-FLAT columns (rescore, IVF, DiskANN) don't use _vector_chunks
-    if (p->vector_columns[vector_column_idx].index_type != VEC0_INDEX_TYPE_FLAT) {
+    vec0_metadata_column_kind kind;
+    int dictionary;
+    rc = vec0_parse_metadata_column_definition(argv[i], strlen(argv[i]), &cName,
+                                      &cNameLength, &kind, &dictionary);
+    if(rc == SQLITE_ERROR) {
+      *pzErr = sqlite3_mprintf(
+          VEC_CONSTRUCTOR_ERROR
+          "'dictionary' is only available on TEXT metadata columns");
+      goto error;
+    }
+    if(rc == SQLITE_OK) {
+      if (numMetadataColumns >= VEC0_MAX_METADATA_COLUMNS) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "More than %d metadata columns were provided",
+            VEC0_MAX_METADATA_COLUMNS);
+        goto error;
+      }
+      metadataColumn.kind = kind;
+      metadataColumn.dictionary = dictionary;
+      metadataColumn.name_length = cNameLength;
+      metadataColumn.name = sqlite3_mprintf("%.*s", cNameLength, cName);
+      if(!metadataColumn.name) {
+        rc = SQLITE_NOMEM;
+        goto error;
+      }
+
+      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_METADATA;
+      pNew->user_column_idxs[user_column_idx] = numMetadataColumns;
+      memcpy(&pNew->metadata_columns[numMetadataColumns], &metadataColumn, sizeof(metadataColumn));
+      numMetadataColumns++;
+      pNew->numMetadataColumns = numMetadataColumns;
+      user_column_idx++;
       continue;
     }
 
-    i64 vectorsSize =
-        p->chunk_size * vector_column_byte_size(p->vector_columns[vector_column_idx]);
+    // Scenario #4: Constructor argument is a table-level option, ie `chunk_size`
 
-    // See SHADOW_TABLE_ROWID_QUIRK above for why _rowid_ and rowid are both set.
-    zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_VECTOR_N_NAME
-                           "(_rowid_, rowid, vectors)"
-                           "VALUES (?, ?, ?)",
-                           p->schemaName, p->tableName, vector_column_idx);
-    if (!zSql) {
-      return SQLITE_NOMEM;
+    char *key;
+    char *value;
+    int keyLength, valueLength;
+    rc = vec0_parse_table_option(argv[i], strlen(argv[i]), &key, &keyLength,
+                                 &value, &valueLength);
+    if (rc == SQLITE_ERROR) {
+      *pzErr = sqlite3_mprintf(
+          VEC_CONSTRUCTOR_ERROR "could not parse table option '%s'", argv[i]);
+      goto error;
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
-    sqlite3_free(zSql);
-
-    if (rc != SQLITE_OK) {
-      sqlite3_finalize(stmt);
-      return rc;
+    if (rc == SQLITE_OK) {
+      if (sqlite3_strnicmp(key, "chunk_size", keyLength) == 0) {
+        chunk_size = atoi(value);
+        if (chunk_size <= 0) {
+          // IMP: V01931_18769
+          *pzErr =
+              sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+                              "chunk_size must be a non-zero positive integer");
+          goto error;
+        }
+        if ((chunk_size % 8) != 0) {
+          // IMP: V14110_30948
+          *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+                                   "chunk_size must be divisible by 8");
+          goto error;
+        }
+#define SQLITE_VEC_CHUNK_SIZE_MAX 4096
+        if (chunk_size > SQLITE_VEC_CHUNK_SIZE_MAX) {
+          *pzErr =
+              sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR "chunk_size too large");
+          goto error;
+        }
+      } else {
+        // IMP: V27642_11712
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR "Unknown table option: %.*s", keyLength, key);
+        goto error;
+      }
+      continue;
     }
 
-    sqlite3_bind_int64(stmt, 1, rowid);  // _rowid_ (internal SQLite rowid)
-    sqlite3_bind_int64(stmt, 2, rowid);  // rowid   (user-defined column)
-    sqlite3_bind_zeroblob64(stmt, 3, vectorsSize);
+    // Scenario #5: Unknown constructor argument
+    *pzErr =
+        sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR "Could not parse '%s'", argv[i]);
+    goto error;
+  }
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    if (rc != SQLITE_DONE) {
-      return rc;
-    }
+  if (chunk_size < 0) {
+    chunk_size = 1024;
+  }
+
+  if (numVectorColumns <= 0) {
+    *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+                             "At least one vector column is required");
+    goto error;
   }
 
 #if SQLITE_VEC_ENABLE_RESCORE
-  // Create new rescore chunks for each rescore-enabled vector column
-  rc = rescore_new_chunk(p, rowid);
-  if (rc != SQLITE_OK) {
-    return rc;
+  {
+    int hasRescore = 0;
+    for (int i = 0; i < numVectorColumns; i++) {
+      if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_RESCORE) {
+        hasRescore = 1;
+        break;
+      }
+    }
+    if (hasRescore) {
+      if (numMetadataColumns > 0) {
+        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+            "Metadata columns are not supported with rescore indexes");
+        goto error;
+      }
+      if (numPartitionColumns > 0) {
+        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+            "Partition key columns are not supported with rescore indexes");
+        goto error;
+      }
+    }
   }
 #endif
 
-  // Step 3: Create new metadata chunks for each metadata column
-  for (int i = 0; i < vec0_num_defined_user_columns(p); i++) {
-    if(p->user_column_kinds[i] != SQLITE_VEC0_USER_COLUMN_KIND_METADATA) {
-      continue;
+  // IVF indexes do not support auxiliary, metadata, or partition key columns.
+  {
+    int has_ivf = 0;
+    for (int i = 0; i < numVectorColumns; i++) {
+      if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_IVF) {
+        has_ivf = 1;
+        break;
+      }
     }
-    int metadata_column_idx = p->user_column_idxs[i];
-    // See SHADOW_TABLE_ROWID_QUIRK above for why _rowid_ and rowid are both set.
-    zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_METADATA_N_NAME
-                           "(_rowid_, rowid, data)"
-                           "VALUES (?, ?, ?)",
-                           p->schemaName, p->tableName, metadata_column_idx);
-    if (!zSql) {
-      return SQLITE_NOMEM;
+    if (has_ivf) {
+      if (numPartitionColumns > 0) {
+        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+            "partition key columns are not supported with IVF indexes");
+        goto error;
+      }
+      if (numMetadataColumns > 0) {
+        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+            "metadata columns are not supported with IVF indexes");
+        goto error;
+      }
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
-    sqlite3_free(zSql);
+  }
 
-    if (rc != SQLITE_OK) {
-      sqlite3_finalize(stmt);
-      return rc;
+  // DiskANN columns cannot coexist with aux/metadata/partition columns
+  for (int i = 0; i < numVectorColumns; i++) {
+    if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_DISKANN) {
+      if (numMetadataColumns > 0) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "Metadata columns are not supported with DiskANN-indexed vector columns");
+        goto error;
+      }
+      if (numPartitionColumns > 0) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "Partition key columns are not supported with DiskANN-indexed vector columns");
+        goto error;
+      }
+      break;
     }
+  }
 
-    sqlite3_bind_int64(stmt, 1, rowid);  // _rowid_ (internal SQLite rowid)
-    sqlite3_bind_int64(stmt, 2, rowid);  // rowid   (user-defined column)
-    sqlite3_bind_zeroblob64(stmt, 3, vec0_metadata_chunk_size(p->metadata_columns[metadata_column_idx].kind, p->chunk_size));
-
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    if (rc != SQLITE_DONE) {
-      return rc;
+  // Determine whether to add the FTS5-style hidden command column.
+  // New tables (isCreate) always get it; existing tables only if created
+  // with v0.1.10+ (which validated no column name == table name).
+  int hasCommandColumn = 0;
+  if (isCreate) {
+    // Validate no user column name conflicts with the table name
+    const char *tblName = argv[2];
+    int tblNameLen = (int)strlen(tblName);
+    for (int i = 0; i < numVectorColumns; i++) {
+      if (pNew->vector_columns[i].name_length == tblNameLen &&
+          sqlite3_strnicmp(pNew->vector_columns[i].name, tblName, tblNameLen) == 0) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "column name '%s' conflicts with table name (reserved for command column)",
+            tblName);
+        goto error;
+      }
+    }
+    for (int i = 0; i < numPartitionColumns; i++) {
+      if (pNew->paritition_columns[i].name_length == tblNameLen &&
+          sqlite3_strnicmp(pNew->paritition_columns[i].name, tblName, tblNameLen) == 0) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "column name '%s' conflicts with table name (reserved for command column)",
+            tblName);
+        goto error;
+      }
+    }
+    for (int i = 0; i < numAuxiliaryColumns; i++) {
+      if (pNew->auxiliary_columns[i].name_length == tblNameLen &&
+          sqlite3_strnicmp(pNew->auxiliary_columns[i].name, tblName, tblNameLen) == 0) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "column name '%s' conflicts with table name (reserved for command column)",
+            tblName);
+        goto error;
+      }
+    }
+    for (int i = 0; i < numMetadataColumns; i++) {
+      if (pNew->metadata_columns[i].name_length == tblNameLen &&
+          sqlite3_strnicmp(pNew->metadata_columns[i].name, tblName, tblNameLen) == 0) {
+        *pzErr = sqlite3_mprintf(
+            VEC_CONSTRUCTOR_ERROR
+            "column name '%s' conflicts with table name (reserved for command column)",
+            tblName);
+        goto error;
+      }
+    }
+    hasCommandColumn = 1;
+  } else {
+    // xConnect: check _info shadow table for version
+    sqlite3_stmt *stmtInfo = NULL;
+    char *zInfoSql = sqlite3_mprintf(
+        "SELECT value FROM " VEC0_SHADOW_INFO_NAME " WHERE key = 'CREATE_VERSION_PATCH'",
+        argv[1], argv[2]);
+    if (zInfoSql) {
+      int infoRc = sqlite3_prepare_v2(db, zInfoSql, -1, &stmtInfo, NULL);
+      sqlite3_free(zInfoSql);
+      if (infoRc == SQLITE_OK && sqlite3_step(stmtInfo) == SQLITE_ROW) {
+        int patch = sqlite3_column_int(stmtInfo, 0);
+        hasCommandColumn = (patch >= 10);  // v0.1.10+
+      }
+      // If _info doesn't exist or has no version, assume old table
+      sqlite3_finalize(stmtInfo);
     }
   }
+  pNew->hasCommandColumn = hasCommandColumn;
 
-
-  if (chunk_rowid) {
-    *chunk_rowid = rowid;
+  sqlite3_str *createStr = sqlite3_str_new(NULL);
+  sqlite3_str_appendall(createStr, "CREATE TABLE x(");
+  if (pkColumnName) {
+    sqlite3_str_appendf(createStr, "\"%.*w\" primary key, ", pkColumnNameLength,
+                        pkColumnName);
+  } else {
+    sqlite3_str_appendall(createStr, "rowid, ");
   }
-
-  return SQLITE_OK;
-}
-
-struct vec0_query_fullscan_data {
-  sqlite3_stmt *rowids_stmt;
-  i8 done;
-};
-void vec0_query_fullscan_data_clear(
-    struct vec0_query_fullscan_data *fullscan_data) {
-  if (!fullscan_data)
-    return;
-
-  if (fullscan_data->rowids_stmt) {
-    sqlite3_finalize(fullscan_data->rowids_stmt);
-    fullscan_data->rowids_stmt = NULL;
+  // The hidden query_idx column was added after tables could already have a
+  // user column of that name, so it's only declared when the name is free.
+  int hasQueryIdxColumn =
+      !(pkColumnName && pkColumnNameLength == 9 &&
+        sqlite3_strnicmp(pkColumnName, "query_idx", 9) == 0) &&
+      !(hasCommandColumn && sqlite3_stricmp(argv[2], "query_idx") == 0);
+  for (int i = 0; i < numVectorColumns + numPartitionColumns + numAuxiliaryColumns + numMetadataColumns; i++) {
+    const char *zName = NULL;
+    int nName = 0;
+    switch(pNew->user_column_kinds[i]) {
+      case SQLITE_VEC0_USER_COLUMN_KIND_VECTOR: {
+        int vector_idx = pNew->user_column_idxs[i];
+        zName = pNew->vector_columns[vector_idx].name;
+        nName = pNew->vector_columns[vector_idx].name_length;
+        break;
+      }
+      case SQLITE_VEC0_USER_COLUMN_KIND_PARTITION: {
+        int partition_idx = pNew->user_column_idxs[i];
+        zName = pNew->paritition_columns[partition_idx].name;
+        nName = pNew->paritition_columns[partition_idx].name_length;
+        break;
+      }
+      case SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY: {
+        int auxiliary_idx = pNew->user_column_idxs[i];
+        zName = pNew->auxiliary_columns[auxiliary_idx].name;
+        nName = pNew->auxiliary_columns[auxiliary_idx].name_length;
+        break;
+      }
+      case SQLITE_VEC0_USER_COLUMN_KIND_METADATA: {
+        int metadata_idx = pNew->user_column_idxs[i];
+        zName = pNew->metadata_columns[metadata_idx].name;
+        nName = pNew->metadata_columns[metadata_idx].name_length;
+        break;
+      }
+    }
+    sqlite3_str_appendf(createStr, "\"%.*w\", ", nName, zName);
+    if (nName == 9 && sqlite3_strnicmp(zName, "query_idx", 9) == 0) {
+      hasQueryIdxColumn = 0;
+    }
   }
-}
-
-struct vec0_query_knn_data {
-  i64 k;
-  i64 k_used;
-  // Array of rowids of size k. Must be freed with sqlite3_free().
-  i64 *rowids;
-  // Array of distances of size k. Must be freed with sqlite3_free().
-  f32 *distances;
-  i64 current_idx;
-};
-void vec0_query_knn_data_clear(struct vec0_query_knn_data *knn_data) {
-  if (!knn_data)
-    return;
-
-  if (knn_data->rowids) {
-    sqlite3_free(knn_data->rowids);
-    knn_data->rowids = NULL;
+  if (hasCommandColumn) {
+    sqlite3_str_appendf(createStr, " \"%w\" hidden,", argv[2]);
   }
-  if (knn_data->distances) {
-    sqlite3_free(knn_data->distances);
-    knn_data->distances = NULL;
+  sqlite3_str_appendall(createStr, " distance hidden, k hidden");
+  if (hasQueryIdxColumn) {
+    sqlite3_str_appendall(createStr, ", query_idx hidden");
   }
-}
-
-struct vec0_query_point_data {
-  i64 rowid;
-  void *vectors[VEC0_MAX_VECTOR_COLUMNS];
-  int done;
-};
-void vec0_query_point_data_clear(struct vec0_query_point_data *point_data) {
-  if (!point_data)
-    return;
-  for (int i = 0; i < VEC0_MAX_VECTOR_COLUMNS; i++) {
-    sqlite3_free(point_data->vectors[i]);
-    point_data->vectors[i] = NULL;
+  sqlite3_str_appendall(createStr, ") ");
+  pNew->hasQueryIdxColumn = hasQueryIdxColumn;
+  if (pkColumnName) {
+    sqlite3_str_appendall(createStr, "without rowid ");
+  }
+  zSql = sqlite3_str_finish(createStr);
+  if (!zSql) {
+    goto error;
+  }
+  rc = sqlite3_declare_vtab(db, zSql);
+  sqlite3_free((void *)zSql);
+  if (rc != SQLITE_OK) {
+    *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
+                             "could not declare virtual table, '%s'",
+                             sqlite3_errmsg(db));
+    goto error;
   }
-}
-
-typedef enum {
-  // If any values are updated, please update the ARCHITECTURE.md docs accordingly!
-
- VEC0_QUERY_PLAN_FULLSCAN = '1',
- VEC0_QUERY_PLAN_POINT = '2',
- VEC0_QUERY_PLAN_KNN = '3',
-} vec0_query_plan;
-
-typedef struct vec0_cursor vec0_cursor;
-struct vec0_cursor {
-  sqlite3_vtab_cursor base;
 
-  vec0_query_plan query_plan;
-  struct vec0_query_fullscan_data *fullscan_data;
-  struct vec0_query_knn_data *knn_data;
-  struct vec0_query_point_data *point_data;
-};
+  const char *schemaName = argv[1];
+  const char *tableName = argv[2];
 
-void vec0_cursor_clear(vec0_cursor *pCur) {
-  if (pCur->fullscan_data) {
-    vec0_query_fullscan_data_clear(pCur->fullscan_data);
-    sqlite3_free(pCur->fullscan_data);
-    pCur->fullscan_data = NULL;
+  pNew->db = db;
+#if SQLITE_VEC_ENABLE_PREFETCH
+  pNew->scanStats = (struct Vec0ScanStats *)pAux;
+#endif
+  pNew->pkIsText = pkColumnType == SQLITE_TEXT;
+  pNew->schemaName = sqlite3_mprintf("%s", schemaName);
+  if (!pNew->schemaName) {
+    goto error;
   }
-  if (pCur->knn_data) {
-    vec0_query_knn_data_clear(pCur->knn_data);
-    sqlite3_free(pCur->knn_data);
-    pCur->knn_data = NULL;
+  pNew->tableName = sqlite3_mprintf("%s", tableName);
+  if (!pNew->tableName) {
+    goto error;
   }
-  if (pCur->point_data) {
-    vec0_query_point_data_clear(pCur->point_data);
-    sqlite3_free(pCur->point_data);
-    pCur->point_data = NULL;
+  pNew->shadowRowidsName = sqlite3_mprintf("%s_rowids", tableName);
+  if (!pNew->shadowRowidsName) {
+    goto error;
   }
-}
+  pNew->shadowChunksName = sqlite3_mprintf("%s_chunks", tableName);
+  if (!pNew->shadowChunksName) {
+    goto error;
+  }
+  pNew->numVectorColumns = numVectorColumns;
+  pNew->numPartitionColumns = numPartitionColumns;
+  pNew->numAuxiliaryColumns = numAuxiliaryColumns;
+  pNew->numMetadataColumns = numMetadataColumns;
 
-// IVF index implementation — #include'd here after all struct/helper definitions
+  if (!vec0_all_columns_diskann(pNew) &&
+      (isCreate || vec0_free_slots_stored(db, schemaName, tableName))) {
+    pNew->shadowFreeSlotsName = sqlite3_mprintf("%s_free_slots", tableName);
+    if (!pNew->shadowFreeSlotsName) {
+      goto error;
+    }
+  }
+
+  for (int i = 0; i < pNew->numVectorColumns; i++) {
+    pNew->shadowVectorChunksNames[i] =
+        sqlite3_mprintf("%s_vector_chunks%02d", tableName, i);
+    if (!pNew->shadowVectorChunksNames[i]) {
+      goto error;
+    }
+    if (vec0_vector_bounds_supported(&pNew->vector_columns[i]) &&
+        (isCreate ? pNew->vector_columns[i].chunk_bounds
+                  : vec0_vector_bounds_stored(db, schemaName, tableName, i))) {
+      pNew->shadowVectorBoundsNames[i] =
+          sqlite3_mprintf("%s_vector_bounds%02d", tableName, i);
+      if (!pNew->shadowVectorBoundsNames[i]) {
+        goto error;
+      }
+    }
+#if SQLITE_VEC_ENABLE_RESCORE
+    if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_RESCORE) {
+      pNew->shadowRescoreChunksNames[i] =
+          sqlite3_mprintf("%s_rescore_chunks%02d", tableName, i);
+      if (!pNew->shadowRescoreChunksNames[i]) {
+        goto error;
+      }
+      pNew->shadowRescoreVectorsNames[i] =
+          sqlite3_mprintf("%s_rescore_vectors%02d", tableName, i);
+      if (!pNew->shadowRescoreVectorsNames[i]) {
+        goto error;
+      }
+    }
+#endif
+#if SQLITE_VEC_ENABLE_DISKANN
+    if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_DISKANN) {
+      pNew->shadowVectorsNames[i] =
+          sqlite3_mprintf("%s_vectors%02d", tableName, i);
+      if (!pNew->shadowVectorsNames[i]) {
+        goto error;
+      }
+      pNew->shadowDiskannNodesNames[i] =
+          sqlite3_mprintf("%s_diskann_nodes%02d", tableName, i);
+      if (!pNew->shadowDiskannNodesNames[i]) {
+        goto error;
+      }
+    }
+#endif
+  }
 #if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-#include "sqlite-vec-ivf-kmeans.c"
-#include "sqlite-vec-ivf.c"
+  for (int i = 0; i < pNew->numVectorColumns; i++) {
+    if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_IVF) continue;
+    pNew->shadowIvfCellsNames[i] =
+        sqlite3_mprintf("%s_ivf_cells%02d", tableName, i);
+    if (!pNew->shadowIvfCellsNames[i]) goto error;
+    pNew->ivfTrainedCache[i] = -1; // unknown
+  }
 #endif
+  for (int i = 0; i < pNew->numMetadataColumns; i++) {
+    pNew->shadowMetadataChunksNames[i] =
+        sqlite3_mprintf("%s_metadatachunks%02d", tableName, i);
+    if (!pNew->shadowMetadataChunksNames[i]) {
+      goto error;
+    }
+    if (pNew->metadata_columns[i].kind != VEC0_METADATA_COLUMN_KIND_TEXT &&
+        (isCreate ||
+         vec0_metadata_bounds_stored(db, schemaName, tableName, i))) {
+      pNew->shadowMetadataBoundsNames[i] =
+          sqlite3_mprintf("%s_metadatabounds%02d", tableName, i);
+      if (!pNew->shadowMetadataBoundsNames[i]) {
+        goto error;
+      }
+    }
+  }
+  pNew->chunk_size = chunk_size;
 
-#define VEC_CONSTRUCTOR_ERROR "vec0 constructor error: "
-static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
-                     sqlite3_vtab **ppVtab, char **pzErr, bool isCreate) {
-  UNUSED_PARAMETER(pAux);
-  vec0_vtab *pNew;
-  int rc;
-  const char *zSql;
-
-  pNew = sqlite3_malloc(sizeof(*pNew));
-  if (pNew == 0)
-    return SQLITE_NOMEM;
-  memset(pNew, 0, sizeof(*pNew));
+  // if xCreate, then create the necessary shadow tables
+  if (isCreate) {
+    sqlite3_stmt *stmt;
+    int rc;
 
-  // Declared chunk_size=N for entire table.
-  // -1 to use the defualt, otherwise will get re-assigned on `chunk_size=N`
-  // option
-  int chunk_size = -1;
-  int numVectorColumns = 0;
-  int numPartitionColumns = 0;
-  int numAuxiliaryColumns = 0;
-  int numMetadataColumns = 0;
-  int user_column_idx = 0;
+    char * zCreateInfo = sqlite3_mprintf("CREATE TABLE "VEC0_SHADOW_INFO_NAME " (key text primary key, value any)", pNew->schemaName, pNew->tableName);
+    if(!zCreateInfo) {
+      goto error;
+    }
+    rc = sqlite3_prepare_v2(db, zCreateInfo, -1, &stmt, NULL);
 
-  // track if a "primary key" column is defined
-  char *pkColumnName = NULL;
-  int pkColumnNameLength;
-  int pkColumnType = SQLITE_INTEGER;
+    sqlite3_free((void *) zCreateInfo);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      // TODO(IMP)
+      sqlite3_finalize(stmt);
+      *pzErr = sqlite3_mprintf("Could not create '_info' shadow table: %s",
+                               sqlite3_errmsg(db));
+      goto error;
+    }
+    sqlite3_finalize(stmt);
 
-  for (int i = 3; i < argc; i++) {
-    struct VectorColumnDefinition vecColumn;
-    struct Vec0PartitionColumnDefinition partitionColumn;
-    struct Vec0AuxiliaryColumnDefinition auxColumn;
-    struct Vec0MetadataColumnDefinition metadataColumn;
-    char *cName = NULL;
-    int cNameLength;
-    int cType;
+    char * zSeedInfo = sqlite3_mprintf(
+      "INSERT INTO "VEC0_SHADOW_INFO_NAME "(key, value) VALUES "
+      "(?1, ?2), (?3, ?4), (?5, ?6), (?7, ?8) ",
+      pNew->schemaName, pNew->tableName
+    );
+    if(!zSeedInfo) {
+      goto error;
+    }
+    rc = sqlite3_prepare_v2(db, zSeedInfo, -1, &stmt, NULL);
+    sqlite3_free((void *) zSeedInfo);
+    if (rc != SQLITE_OK) {
+      // TODO(IMP)
+      sqlite3_finalize(stmt);
+      *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
+                               sqlite3_errmsg(db));
+      goto error;
+    }
+    sqlite3_bind_text(stmt, 1, "CREATE_VERSION", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, SQLITE_VEC_VERSION, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, "CREATE_VERSION_MAJOR", -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 4, SQLITE_VEC_VERSION_MAJOR);
+    sqlite3_bind_text(stmt, 5, "CREATE_VERSION_MINOR", -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 6, SQLITE_VEC_VERSION_MINOR);
+    sqlite3_bind_text(stmt, 7, "CREATE_VERSION_PATCH", -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 8, SQLITE_VEC_VERSION_PATCH);
 
-    // Scenario #1: Constructor argument is a vector column definition, ie `foo float[1024]`
-    rc = vec0_parse_vector_column(argv[i], strlen(argv[i]), &vecColumn);
-    if (rc == SQLITE_ERROR) {
-      *pzErr = sqlite3_mprintf(
-          VEC_CONSTRUCTOR_ERROR "could not parse vector column '%s'", argv[i]);
+    if(sqlite3_step(stmt) != SQLITE_DONE) {
+      // TODO(IMP)
+      sqlite3_finalize(stmt);
+      *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
+                               sqlite3_errmsg(db));
       goto error;
     }
-    if (rc == SQLITE_OK) {
-      if (numVectorColumns >= VEC0_MAX_VECTOR_COLUMNS) {
-        sqlite3_free(vecColumn.name);
-        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-                                 "Too many provided vector columns, maximum %d",
-                                 VEC0_MAX_VECTOR_COLUMNS);
+    sqlite3_finalize(stmt);
+
+#if SQLITE_VEC_ENABLE_DISKANN
+    // Seed medoid entries for DiskANN-indexed columns
+    for (int i = 0; i < pNew->numVectorColumns; i++) {
+      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_DISKANN) {
+        continue;
+      }
+      char *key = sqlite3_mprintf("diskann_medoid_%02d", i);
+      char *zInsert = sqlite3_mprintf(
+          "INSERT INTO " VEC0_SHADOW_INFO_NAME "(key, value) VALUES (?1, ?2)",
+          pNew->schemaName, pNew->tableName);
+      rc = sqlite3_prepare_v2(db, zInsert, -1, &stmt, NULL);
+      sqlite3_free(zInsert);
+      if (rc != SQLITE_OK) {
+        sqlite3_free(key);
+        sqlite3_finalize(stmt);
         goto error;
       }
-
-      if (vecColumn.dimensions > SQLITE_VEC_VEC0_MAX_DIMENSIONS) {
-        sqlite3_free(vecColumn.name);
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "Dimension on vector column too large, provided %lld, maximum %lld",
-            (i64)vecColumn.dimensions, SQLITE_VEC_VEC0_MAX_DIMENSIONS);
+      sqlite3_bind_text(stmt, 1, key, -1, sqlite3_free);
+      sqlite3_bind_null(stmt, 2);  // NULL means empty graph
+      if (sqlite3_step(stmt) != SQLITE_DONE) {
+        sqlite3_finalize(stmt);
         goto error;
       }
+      sqlite3_finalize(stmt);
+    }
+#endif
 
-      // DiskANN validation
-      if (vecColumn.index_type == VEC0_INDEX_TYPE_DISKANN) {
-        if (vecColumn.element_type == SQLITE_VEC_ELEMENT_TYPE_BIT) {
-          sqlite3_free(vecColumn.name);
-          *pzErr = sqlite3_mprintf(
-              VEC_CONSTRUCTOR_ERROR
-              "DiskANN index is not supported on bit vector columns");
-          goto error;
-        }
-        if (vecColumn.diskann.quantizer_type == VEC0_DISKANN_QUANTIZER_BINARY &&
-            (vecColumn.dimensions % CHAR_BIT) != 0) {
-          sqlite3_free(vecColumn.name);
-          *pzErr = sqlite3_mprintf(
-              VEC_CONSTRUCTOR_ERROR
-              "DiskANN with binary quantizer requires dimensions divisible by 8");
-          goto error;
-        }
+    // create the _chunks shadow table
+    char *zCreateShadowChunks = NULL;
+    if(pNew->numPartitionColumns) {
+      sqlite3_str * s = sqlite3_str_new(NULL);
+      sqlite3_str_appendf(s, "CREATE TABLE " VEC0_SHADOW_CHUNKS_NAME "(", pNew->schemaName, pNew->tableName);
+      sqlite3_str_appendall(s, "chunk_id INTEGER PRIMARY KEY AUTOINCREMENT," "size INTEGER NOT NULL,");
+      sqlite3_str_appendall(s, "sequence_id integer,");
+      for(int i = 0; i < pNew->numPartitionColumns;i++) {
+        sqlite3_str_appendf(s, "partition%02d,", i);
       }
+      sqlite3_str_appendall(s, "validity BLOB NOT NULL, rowids BLOB NOT NULL);");
+      zCreateShadowChunks = sqlite3_str_finish(s);
+    }else {
+      zCreateShadowChunks = sqlite3_mprintf(VEC0_SHADOW_CHUNKS_CREATE,
+                                          pNew->schemaName, pNew->tableName);
+    }
+    if (!zCreateShadowChunks) {
+        goto error;
+      }
+    rc = sqlite3_prepare_v2(db, zCreateShadowChunks, -1, &stmt, 0);
+    sqlite3_free((void *)zCreateShadowChunks);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      // IMP: V17740_01811
+      sqlite3_finalize(stmt);
+      *pzErr = sqlite3_mprintf("Could not create '_chunks' shadow table: %s",
+                               sqlite3_errmsg(db));
+      goto error;
+    }
+    sqlite3_finalize(stmt);
 
-      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_VECTOR;
-      pNew->user_column_idxs[user_column_idx] = numVectorColumns;
-      memcpy(&pNew->vector_columns[numVectorColumns], &vecColumn, sizeof(vecColumn));
-      numVectorColumns++;
-      pNew->numVectorColumns = numVectorColumns;
-      user_column_idx++;
-
-      continue;
+    // create the _rowids shadow table
+    char *zCreateShadowRowids;
+    if (pNew->pkIsText) {
+      // adds a "text unique not null" constraint to the id column
+      zCreateShadowRowids = sqlite3_mprintf(VEC0_SHADOW_ROWIDS_CREATE_PK_TEXT,
+                                            pNew->schemaName, pNew->tableName);
+    } else {
+      zCreateShadowRowids = sqlite3_mprintf(VEC0_SHADOW_ROWIDS_CREATE_BASIC,
+                                            pNew->schemaName, pNew->tableName);
+    }
+    if (!zCreateShadowRowids) {
+      goto error;
+    }
+    rc = sqlite3_prepare_v2(db, zCreateShadowRowids, -1, &stmt, 0);
+    sqlite3_free((void *)zCreateShadowRowids);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      // IMP: V11631_28470
+      sqlite3_finalize(stmt);
+      *pzErr = sqlite3_mprintf("Could not create '_rowids' shadow table: %s",
+                               sqlite3_errmsg(db));
+      goto error;
     }
+    sqlite3_finalize(stmt);
 
-    // Scenario #2: Constructor argument is a partition key column definition, ie `user_id text partition key`
-    rc = vec0_parse_partition_key_definition(argv[i], strlen(argv[i]), &cName,
-                                      &cNameLength, &cType);
-    if (rc == SQLITE_OK) {
-      if (numPartitionColumns >= VEC0_MAX_PARTITION_COLUMNS) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "More than %d partition key columns were provided",
-            VEC0_MAX_PARTITION_COLUMNS);
+    for (int i = 0; i < pNew->numVectorColumns; i++) {
+      // Non-FLAT columns (rescore, IVF, DiskANN) don't use _vector_chunks
+      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_FLAT)
+        continue;
+      char *zSql = sqlite3_mprintf(VEC0_SHADOW_VECTOR_N_CREATE,
+                                   pNew->schemaName, pNew->tableName, i);
+      if (!zSql) {
         goto error;
       }
-      partitionColumn.type = cType;
-      partitionColumn.name_length = cNameLength;
-      partitionColumn.name = sqlite3_mprintf("%.*s", cNameLength, cName);
-      if(!partitionColumn.name) {
-        rc = SQLITE_NOMEM;
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        // IMP: V25919_09989
+        sqlite3_finalize(stmt);
+        *pzErr = sqlite3_mprintf(
+            "Could not create '_vector_chunks%02d' shadow table: %s", i,
+            sqlite3_errmsg(db));
         goto error;
       }
-
-      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_PARTITION;
-      pNew->user_column_idxs[user_column_idx] = numPartitionColumns;
-      memcpy(&pNew->paritition_columns[numPartitionColumns], &partitionColumn, sizeof(partitionColumn));
-      numPartitionColumns++;
-      pNew->numPartitionColumns = numPartitionColumns;
-      user_column_idx++;
-      continue;
+      sqlite3_finalize(stmt);
     }
 
-    // Scenario #3: Constructor argument is a primary key column definition, ie `article_id text primary key`
-    rc = vec0_parse_primary_key_definition(argv[i], strlen(argv[i]), &cName,
-                                      &cNameLength, &cType);
-    if (rc == SQLITE_OK) {
-      if (pkColumnName) {
+    for (int i = 0; i < pNew->numVectorColumns; i++) {
+      if (!pNew->shadowVectorBoundsNames[i]) {
+        continue;
+      }
+      char *zSql = sqlite3_mprintf(VEC0_SHADOW_VECTOR_BOUNDS_N_CREATE,
+                                   pNew->schemaName, pNew->tableName, i);
+      if (!zSql) {
+        goto error;
+      }
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
         *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "More than one primary key definition was provided, vec0 only "
-            "suports a single primary key column",
-            argv[i]);
+            "Could not create '_vector_bounds%02d' shadow table: %s", i,
+            sqlite3_errmsg(db));
         goto error;
       }
-      pkColumnName = cName;
-      pkColumnNameLength = cNameLength;
-      pkColumnType = cType;
-      continue;
+      sqlite3_finalize(stmt);
+
+      // tells later connections that this column's chunks have boxes
+      zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_INFO_NAME
+                             "(key, value) VALUES ('vector_bounds_%02d', 1)",
+                             pNew->schemaName, pNew->tableName, i);
+      if (!zSql) {
+        goto error;
+      }
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
+        *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
+                                 sqlite3_errmsg(db));
+        goto error;
+      }
+      sqlite3_finalize(stmt);
     }
 
-    // Scenario #4: Constructor argument is a auxiliary column definition, ie `+contents text`
-    rc = vec0_parse_auxiliary_column_definition(argv[i], strlen(argv[i]), &cName,
-                                      &cNameLength, &cType);
-    if(rc == SQLITE_OK) {
-      if (numAuxiliaryColumns >= VEC0_MAX_AUXILIARY_COLUMNS) {
+    if (pNew->shadowFreeSlotsName) {
+      char *zSql = sqlite3_mprintf(VEC0_SHADOW_FREE_SLOTS_CREATE,
+                                   pNew->schemaName, pNew->tableName);
+      if (!zSql) {
+        goto error;
+      }
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
         *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "More than %d auxiliary columns were provided",
-            VEC0_MAX_AUXILIARY_COLUMNS);
+            "Could not create '_free_slots' shadow table: %s",
+            sqlite3_errmsg(db));
         goto error;
       }
-      auxColumn.type = cType;
-      auxColumn.name_length = cNameLength;
-      auxColumn.name = sqlite3_mprintf("%.*s", cNameLength, cName);
-      if(!auxColumn.name) {
-        rc = SQLITE_NOMEM;
+      sqlite3_finalize(stmt);
+
+      // tells later connections that free slots are tracked
+      zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_INFO_NAME
+                             "(key, value) VALUES ('free_slots', 1)",
+                             pNew->schemaName, pNew->tableName);
+      if (!zSql) {
+        goto error;
+      }
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
+        *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
+                                 sqlite3_errmsg(db));
         goto error;
       }
+      sqlite3_finalize(stmt);
+    }
 
-      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY;
-      pNew->user_column_idxs[user_column_idx] = numAuxiliaryColumns;
-      memcpy(&pNew->auxiliary_columns[numAuxiliaryColumns], &auxColumn, sizeof(auxColumn));
-      numAuxiliaryColumns++;
-      pNew->numAuxiliaryColumns = numAuxiliaryColumns;
-      user_column_idx++;
-      continue;
+#if SQLITE_VEC_ENABLE_RESCORE
+    rc = rescore_create_tables(pNew, db, pzErr);
+    if (rc != SQLITE_OK) {
+      goto error;
     }
+#endif
 
-    vec0_metadata_column_kind kind;
-    rc = vec0_parse_metadata_column_definition(argv[i], strlen(argv[i]), &cName,
-                                      &cNameLength, &kind);
-    if(rc == SQLITE_OK) {
-      if (numMetadataColumns >= VEC0_MAX_METADATA_COLUMNS) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "More than %d metadata columns were provided",
-            VEC0_MAX_METADATA_COLUMNS);
-        goto error;
-      }
-      metadataColumn.kind = kind;
-      metadataColumn.name_length = cNameLength;
-      metadataColumn.name = sqlite3_mprintf("%.*s", cNameLength, cName);
-      if(!metadataColumn.name) {
-        rc = SQLITE_NOMEM;
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+    // Create IVF shadow tables for IVF-indexed vector columns
+    for (int i = 0; i < pNew->numVectorColumns; i++) {
+      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_IVF) continue;
+      rc = ivf_create_shadow_tables(pNew, i);
+      if (rc != SQLITE_OK) {
+        *pzErr = sqlite3_mprintf("Could not create IVF shadow tables for column %d", i);
         goto error;
       }
-
-      pNew->user_column_kinds[user_column_idx] = SQLITE_VEC0_USER_COLUMN_KIND_METADATA;
-      pNew->user_column_idxs[user_column_idx] = numMetadataColumns;
-      memcpy(&pNew->metadata_columns[numMetadataColumns], &metadataColumn, sizeof(metadataColumn));
-      numMetadataColumns++;
-      pNew->numMetadataColumns = numMetadataColumns;
-      user_column_idx++;
-      continue;
     }
+#endif
 
-    // Scenario #4: Constructor argument is a table-level option, ie `chunk_size`
+#if SQLITE_VEC_ENABLE_DISKANN
+    // Create DiskANN shadow tables for indexed vector columns
+    for (int i = 0; i < pNew->numVectorColumns; i++) {
+      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_DISKANN) {
+        continue;
+      }
 
-    char *key;
-    char *value;
-    int keyLength, valueLength;
-    rc = vec0_parse_table_option(argv[i], strlen(argv[i]), &key, &keyLength,
-                                 &value, &valueLength);
-    if (rc == SQLITE_ERROR) {
-      *pzErr = sqlite3_mprintf(
-          VEC_CONSTRUCTOR_ERROR "could not parse table option '%s'", argv[i]);
-      goto error;
-    }
-    if (rc == SQLITE_OK) {
-      if (sqlite3_strnicmp(key, "chunk_size", keyLength) == 0) {
-        chunk_size = atoi(value);
-        if (chunk_size <= 0) {
-          // IMP: V01931_18769
-          *pzErr =
-              sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-                              "chunk_size must be a non-zero positive integer");
+      // Create _vectors{NN} table
+      {
+        char *zSql = sqlite3_mprintf(
+            "CREATE TABLE " VEC0_SHADOW_VECTORS_N_NAME
+            " (rowid INTEGER PRIMARY KEY, vector BLOB NOT NULL);",
+            pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
           goto error;
         }
-        if ((chunk_size % 8) != 0) {
-          // IMP: V14110_30948
-          *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-                                   "chunk_size must be divisible by 8");
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free(zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf(
+              "Could not create '_vectors%02d' shadow table: %s", i,
+              sqlite3_errmsg(db));
           goto error;
         }
-#define SQLITE_VEC_CHUNK_SIZE_MAX 4096
-        if (chunk_size > SQLITE_VEC_CHUNK_SIZE_MAX) {
-          *pzErr =
-              sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR "chunk_size too large");
+        sqlite3_finalize(stmt);
+      }
+
+      // Create _diskann_nodes{NN} table
+      {
+        char *zSql = sqlite3_mprintf(
+            "CREATE TABLE " VEC0_SHADOW_DISKANN_NODES_N_NAME " ("
+            "rowid INTEGER PRIMARY KEY, "
+            "neighbors_validity BLOB NOT NULL, "
+            "neighbor_ids BLOB NOT NULL, "
+            "neighbor_quantized_vectors BLOB NOT NULL"
+            ");",
+            pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
           goto error;
         }
-      } else {
-        // IMP: V27642_11712
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR "Unknown table option: %.*s", keyLength, key);
-        goto error;
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free(zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf(
+              "Could not create '_diskann_nodes%02d' shadow table: %s", i,
+              sqlite3_errmsg(db));
+          goto error;
+        }
+        sqlite3_finalize(stmt);
       }
-      continue;
-    }
 
-    // Scenario #5: Unknown constructor argument
-    *pzErr =
-        sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR "Could not parse '%s'", argv[i]);
-    goto error;
-  }
-
-  if (chunk_size < 0) {
-    chunk_size = 1024;
-  }
-
-  if (numVectorColumns <= 0) {
-    *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-                             "At least one vector column is required");
-    goto error;
-  }
-
-#if SQLITE_VEC_ENABLE_RESCORE
-  {
-    int hasRescore = 0;
-    for (int i = 0; i < numVectorColumns; i++) {
-      if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_RESCORE) {
-        hasRescore = 1;
-        break;
-      }
-    }
-    if (hasRescore) {
-      if (numMetadataColumns > 0) {
-        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-            "Metadata columns are not supported with rescore indexes");
-        goto error;
-      }
-      if (numPartitionColumns > 0) {
-        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-            "Partition key columns are not supported with rescore indexes");
-        goto error;
+      // Create _diskann_buffer{NN} table (for batched inserts)
+      {
+        char *zSql = sqlite3_mprintf(
+            "CREATE TABLE " VEC0_SHADOW_DISKANN_BUFFER_N_NAME " ("
+            "rowid INTEGER PRIMARY KEY, "
+            "vector BLOB NOT NULL"
+            ");",
+            pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
+          goto error;
+        }
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free(zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf(
+              "Could not create '_diskann_buffer%02d' shadow table: %s", i,
+              sqlite3_errmsg(db));
+          goto error;
+        }
+        sqlite3_finalize(stmt);
       }
     }
-  }
 #endif
 
-  // IVF indexes do not support auxiliary, metadata, or partition key columns.
-  {
-    int has_ivf = 0;
-    for (int i = 0; i < numVectorColumns; i++) {
-      if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_IVF) {
-        has_ivf = 1;
-        break;
-      }
-    }
-    if (has_ivf) {
-      if (numPartitionColumns > 0) {
-        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-            "partition key columns are not supported with IVF indexes");
+    // See SHADOW_TABLE_ROWID_QUIRK in vec0_new_chunk() — same "rowid PRIMARY KEY"
+    // without INTEGER type issue applies here.
+    for (int i = 0; i < pNew->numMetadataColumns; i++) {
+      char *zSql = sqlite3_mprintf("CREATE TABLE " VEC0_SHADOW_METADATA_N_NAME "(rowid PRIMARY KEY, data BLOB NOT NULL);",
+                                   pNew->schemaName, pNew->tableName, i);
+      if (!zSql) {
         goto error;
       }
-      if (numMetadataColumns > 0) {
-        *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-            "metadata columns are not supported with IVF indexes");
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
+        *pzErr = sqlite3_mprintf(
+            "Could not create '_metata_chunks%02d' shadow table: %s", i,
+            sqlite3_errmsg(db));
         goto error;
       }
-    }
-  }
+      sqlite3_finalize(stmt);
 
-  // DiskANN columns cannot coexist with aux/metadata/partition columns
-  for (int i = 0; i < numVectorColumns; i++) {
-    if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_DISKANN) {
-      if (numMetadataColumns > 0) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "Metadata columns are not supported with DiskANN-indexed vector columns");
-        goto error;
+      if(pNew->metadata_columns[i].dictionary) {
+        char *zSql = sqlite3_mprintf(VEC0_SHADOW_METADATA_DICT_N_CREATE,
+                                     pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
+          goto error;
+        }
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf(
+              "Could not create '_metadatadict%02d' shadow table: %s", i,
+              sqlite3_errmsg(db));
+          goto error;
+        }
+        sqlite3_finalize(stmt);
       }
-      if (numPartitionColumns > 0) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "Partition key columns are not supported with DiskANN-indexed vector columns");
-        goto error;
+      else if(pNew->metadata_columns[i].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
+        char *zSql = sqlite3_mprintf("CREATE TABLE " VEC0_SHADOW_METADATA_TEXT_DATA_NAME "(rowid PRIMARY KEY, data TEXT);",
+                                   pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
+          goto error;
+        }
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf(
+              "Could not create '_metadatatext%02d' shadow table: %s", i,
+              sqlite3_errmsg(db));
+          goto error;
+        }
+        sqlite3_finalize(stmt);
+
       }
-      break;
-    }
-  }
 
-  // Determine whether to add the FTS5-style hidden command column.
-  // New tables (isCreate) always get it; existing tables only if created
-  // with v0.1.10+ (which validated no column name == table name).
-  int hasCommandColumn = 0;
-  if (isCreate) {
-    // Validate no user column name conflicts with the table name
-    const char *tblName = argv[2];
-    int tblNameLen = (int)strlen(tblName);
-    for (int i = 0; i < numVectorColumns; i++) {
-      if (pNew->vector_columns[i].name_length == tblNameLen &&
-          sqlite3_strnicmp(pNew->vector_columns[i].name, tblName, tblNameLen) == 0) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "column name '%s' conflicts with table name (reserved for command column)",
-            tblName);
-        goto error;
+      if (pNew->shadowMetadataBoundsNames[i]) {
+        zSql = sqlite3_mprintf(VEC0_SHADOW_METADATA_BOUNDS_N_CREATE,
+                               pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
+          goto error;
+        }
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf(
+              "Could not create '_metadatabounds%02d' shadow table: %s", i,
+              sqlite3_errmsg(db));
+          goto error;
+        }
+        sqlite3_finalize(stmt);
+
+        // tells later connections that this column's chunks keep ranges
+        zSql = sqlite3_mprintf("INSERT INTO " VEC0_SHADOW_INFO_NAME
+                               "(key, value) VALUES ('metadata_bounds_%02d', 1)",
+                               pNew->schemaName, pNew->tableName, i);
+        if (!zSql) {
+          goto error;
+        }
+        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          sqlite3_finalize(stmt);
+          *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
+                                   sqlite3_errmsg(db));
+          goto error;
+        }
+        sqlite3_finalize(stmt);
       }
     }
-    for (int i = 0; i < numPartitionColumns; i++) {
-      if (pNew->paritition_columns[i].name_length == tblNameLen &&
-          sqlite3_strnicmp(pNew->paritition_columns[i].name, tblName, tblNameLen) == 0) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "column name '%s' conflicts with table name (reserved for command column)",
-            tblName);
-        goto error;
+
+    if(pNew->numAuxiliaryColumns > 0) {
+      sqlite3_stmt * stmt;
+      sqlite3_str * s = sqlite3_str_new(NULL);
+      sqlite3_str_appendf(s, "CREATE TABLE " VEC0_SHADOW_AUXILIARY_NAME "( rowid integer PRIMARY KEY ", pNew->schemaName, pNew->tableName);
+      for(int i = 0; i < pNew->numAuxiliaryColumns; i++) {
+        sqlite3_str_appendf(s, ", value%02d", i);
       }
-    }
-    for (int i = 0; i < numAuxiliaryColumns; i++) {
-      if (pNew->auxiliary_columns[i].name_length == tblNameLen &&
-          sqlite3_strnicmp(pNew->auxiliary_columns[i].name, tblName, tblNameLen) == 0) {
-        *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "column name '%s' conflicts with table name (reserved for command column)",
-            tblName);
+      sqlite3_str_appendall(s, ")");
+      char *zSql = sqlite3_str_finish(s);
+      if(!zSql) {
         goto error;
       }
-    }
-    for (int i = 0; i < numMetadataColumns; i++) {
-      if (pNew->metadata_columns[i].name_length == tblNameLen &&
-          sqlite3_strnicmp(pNew->metadata_columns[i].name, tblName, tblNameLen) == 0) {
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
         *pzErr = sqlite3_mprintf(
-            VEC_CONSTRUCTOR_ERROR
-            "column name '%s' conflicts with table name (reserved for command column)",
-            tblName);
+            "Could not create auxiliary shadow table: %s",
+            sqlite3_errmsg(db));
+
         goto error;
       }
-    }
-    hasCommandColumn = 1;
-  } else {
-    // xConnect: check _info shadow table for version
-    sqlite3_stmt *stmtInfo = NULL;
-    char *zInfoSql = sqlite3_mprintf(
-        "SELECT value FROM " VEC0_SHADOW_INFO_NAME " WHERE key = 'CREATE_VERSION_PATCH'",
-        argv[1], argv[2]);
-    if (zInfoSql) {
-      int infoRc = sqlite3_prepare_v2(db, zInfoSql, -1, &stmtInfo, NULL);
-      sqlite3_free(zInfoSql);
-      if (infoRc == SQLITE_OK && sqlite3_step(stmtInfo) == SQLITE_ROW) {
-        int patch = sqlite3_column_int(stmtInfo, 0);
-        hasCommandColumn = (patch >= 10);  // v0.1.10+
-      }
-      // If _info doesn't exist or has no version, assume old table
-      sqlite3_finalize(stmtInfo);
+      sqlite3_finalize(stmt);
     }
   }
-  pNew->hasCommandColumn = hasCommandColumn;
 
-  sqlite3_str *createStr = sqlite3_str_new(NULL);
-  sqlite3_str_appendall(createStr, "CREATE TABLE x(");
-  if (pkColumnName) {
-    sqlite3_str_appendf(createStr, "\"%.*w\" primary key, ", pkColumnNameLength,
-                        pkColumnName);
-  } else {
-    sqlite3_str_appendall(createStr, "rowid, ");
+  *ppVtab = (sqlite3_vtab *)pNew;
+  return SQLITE_OK;
+
+error:
+  vec0_free(pNew);
+  sqlite3_free(pNew);
+  return SQLITE_ERROR;
+}
+
+static int vec0Create(sqlite3 *db, void *pAux, int argc,
+                      const char *const *argv, sqlite3_vtab **ppVtab,
+                      char **pzErr) {
+  return vec0_init(db, pAux, argc, argv, ppVtab, pzErr, true);
+}
+static int vec0Connect(sqlite3 *db, void *pAux, int argc,
+                       const char *const *argv, sqlite3_vtab **ppVtab,
+                       char **pzErr) {
+  return vec0_init(db, pAux, argc, argv, ppVtab, pzErr, false);
+}
+
+static int vec0Disconnect(sqlite3_vtab *pVtab) {
+  vec0_vtab *p = (vec0_vtab *)pVtab;
+  vec0_free(p);
+  sqlite3_free(p);
+  return SQLITE_OK;
+}
+static int vec0Destroy(sqlite3_vtab *pVtab) {
+  vec0_vtab *p = (vec0_vtab *)pVtab;
+  sqlite3_stmt *stmt;
+  int rc;
+  const char *zSql;
+
+  // Free up any sqlite3_stmt, otherwise DROPs on those tables will fail
+  vec0_free_resources(p);
+  vec0_write_behind_discard(p);
+
+  // TODO(test) later: can't evidence-of here, bc always gives "SQL logic error" instead of
+  // provided error
+  zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_CHUNKS_NAME, p->schemaName,
+                         p->tableName);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+  sqlite3_free((void *)zSql);
+  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+    rc = SQLITE_ERROR;
+    vtab_set_error(pVtab, "could not drop chunks shadow table");
+    goto done;
   }
-  for (int i = 0; i < numVectorColumns + numPartitionColumns + numAuxiliaryColumns + numMetadataColumns; i++) {
-    switch(pNew->user_column_kinds[i]) {
-      case SQLITE_VEC0_USER_COLUMN_KIND_VECTOR: {
-        int vector_idx = pNew->user_column_idxs[i];
-        sqlite3_str_appendf(createStr, "\"%.*w\", ",
-                        pNew->vector_columns[vector_idx].name_length,
-                        pNew->vector_columns[vector_idx].name);
-        break;
-      }
-      case SQLITE_VEC0_USER_COLUMN_KIND_PARTITION: {
-        int partition_idx = pNew->user_column_idxs[i];
-        sqlite3_str_appendf(createStr, "\"%.*w\", ",
-                        pNew->paritition_columns[partition_idx].name_length,
-                        pNew->paritition_columns[partition_idx].name);
-        break;
+  sqlite3_finalize(stmt);
+
+  zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_INFO_NAME, p->schemaName,
+                         p->tableName);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+  sqlite3_free((void *)zSql);
+  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+    rc = SQLITE_ERROR;
+    vtab_set_error(pVtab, "could not drop info shadow table");
+    goto done;
+  }
+  sqlite3_finalize(stmt);
+
+  zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_ROWIDS_NAME, p->schemaName,
+                         p->tableName);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+  sqlite3_free((void *)zSql);
+  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  sqlite3_finalize(stmt);
+
+  for (int i = 0; i < p->numVectorColumns; i++) {
+#if SQLITE_VEC_ENABLE_DISKANN
+    if (p->vector_columns[i].index_type == VEC0_INDEX_TYPE_DISKANN) {
+      // Drop DiskANN shadow tables
+      zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_VECTORS_N_NAME,
+                             p->schemaName, p->tableName, i);
+      if (zSql) {
+        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        sqlite3_finalize(stmt);
       }
-      case SQLITE_VEC0_USER_COLUMN_KIND_AUXILIARY: {
-        int auxiliary_idx = pNew->user_column_idxs[i];
-        sqlite3_str_appendf(createStr, "\"%.*w\", ",
-                        pNew->auxiliary_columns[auxiliary_idx].name_length,
-                        pNew->auxiliary_columns[auxiliary_idx].name);
-        break;
+      zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_DISKANN_NODES_N_NAME,
+                             p->schemaName, p->tableName, i);
+      if (zSql) {
+        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        sqlite3_finalize(stmt);
       }
-      case SQLITE_VEC0_USER_COLUMN_KIND_METADATA: {
-        int metadata_idx = pNew->user_column_idxs[i];
-        sqlite3_str_appendf(createStr, "\"%.*w\", ",
-                        pNew->metadata_columns[metadata_idx].name_length,
-                        pNew->metadata_columns[metadata_idx].name);
-        break;
+      zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_DISKANN_BUFFER_N_NAME,
+                             p->schemaName, p->tableName, i);
+      if (zSql) {
+        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+        sqlite3_free((void *)zSql);
+        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        sqlite3_finalize(stmt);
       }
+      continue;
+    }
+#endif
+    // Non-FLAT columns (rescore, IVF, DiskANN) don't use _vector_chunks
+    if (p->vector_columns[i].index_type != VEC0_INDEX_TYPE_FLAT)
+      continue;
+    zSql = sqlite3_mprintf("DROP TABLE \"%w\".\"%w\"", p->schemaName,
+                           p->shadowVectorChunksNames[i]);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+    sqlite3_free((void *)zSql);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      rc = SQLITE_ERROR;
+      goto done;
     }
+    sqlite3_finalize(stmt);
 
+    if (p->shadowVectorBoundsNames[i]) {
+      zSql = sqlite3_mprintf("DROP TABLE \"%w\".\"%w\"", p->schemaName,
+                             p->shadowVectorBoundsNames[i]);
+      rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        rc = SQLITE_ERROR;
+        goto done;
+      }
+      sqlite3_finalize(stmt);
+    }
   }
-  if (hasCommandColumn) {
-    sqlite3_str_appendf(createStr, " \"%w\" hidden, distance hidden, k hidden) ", argv[2]);
-  } else {
-    sqlite3_str_appendall(createStr, " distance hidden, k hidden) ");
-  }
-  if (pkColumnName) {
-    sqlite3_str_appendall(createStr, "without rowid ");
-  }
-  zSql = sqlite3_str_finish(createStr);
-  if (!zSql) {
-    goto error;
-  }
-  rc = sqlite3_declare_vtab(db, zSql);
-  sqlite3_free((void *)zSql);
+
+#if SQLITE_VEC_ENABLE_RESCORE
+  rc = rescore_drop_tables(p);
   if (rc != SQLITE_OK) {
-    *pzErr = sqlite3_mprintf(VEC_CONSTRUCTOR_ERROR
-                             "could not declare virtual table, '%s'",
-                             sqlite3_errmsg(db));
-    goto error;
+    goto done;
   }
+#endif
 
-  const char *schemaName = argv[1];
-  const char *tableName = argv[2];
-
-  pNew->db = db;
-  pNew->pkIsText = pkColumnType == SQLITE_TEXT;
-  pNew->schemaName = sqlite3_mprintf("%s", schemaName);
-  if (!pNew->schemaName) {
-    goto error;
+#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+  // Drop IVF shadow tables
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (p->vector_columns[i].index_type != VEC0_INDEX_TYPE_IVF) continue;
+    ivf_drop_shadow_tables(p, i);
   }
-  pNew->tableName = sqlite3_mprintf("%s", tableName);
-  if (!pNew->tableName) {
-    goto error;
+#endif
+
+  if (p->shadowFreeSlotsName) {
+    zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_FREE_SLOTS_NAME,
+                           p->schemaName, p->tableName);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+    sqlite3_free((void *)zSql);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    sqlite3_finalize(stmt);
   }
-  pNew->shadowRowidsName = sqlite3_mprintf("%s_rowids", tableName);
-  if (!pNew->shadowRowidsName) {
-    goto error;
+
+  zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_REORGANIZE_NAME,
+                         p->schemaName, p->tableName);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+  sqlite3_free((void *)zSql);
+  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+    rc = SQLITE_ERROR;
+    goto done;
   }
-  pNew->shadowChunksName = sqlite3_mprintf("%s_chunks", tableName);
-  if (!pNew->shadowChunksName) {
-    goto error;
+  sqlite3_finalize(stmt);
+
+  if(p->numAuxiliaryColumns > 0) {
+    zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_AUXILIARY_NAME, p->schemaName, p->tableName);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+    sqlite3_free((void *)zSql);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    sqlite3_finalize(stmt);
   }
-  pNew->numVectorColumns = numVectorColumns;
-  pNew->numPartitionColumns = numPartitionColumns;
-  pNew->numAuxiliaryColumns = numAuxiliaryColumns;
-  pNew->numMetadataColumns = numMetadataColumns;
 
-  for (int i = 0; i < pNew->numVectorColumns; i++) {
-    pNew->shadowVectorChunksNames[i] =
-        sqlite3_mprintf("%s_vector_chunks%02d", tableName, i);
-    if (!pNew->shadowVectorChunksNames[i]) {
-      goto error;
+
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_METADATA_N_NAME, p->schemaName,p->tableName, i);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+    sqlite3_free((void *)zSql);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      rc = SQLITE_ERROR;
+      goto done;
     }
-#if SQLITE_VEC_ENABLE_RESCORE
-    if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_RESCORE) {
-      pNew->shadowRescoreChunksNames[i] =
-          sqlite3_mprintf("%s_rescore_chunks%02d", tableName, i);
-      if (!pNew->shadowRescoreChunksNames[i]) {
-        goto error;
-      }
-      pNew->shadowRescoreVectorsNames[i] =
-          sqlite3_mprintf("%s_rescore_vectors%02d", tableName, i);
-      if (!pNew->shadowRescoreVectorsNames[i]) {
-        goto error;
+    sqlite3_finalize(stmt);
+
+    if(p->metadata_columns[i].dictionary) {
+      zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_METADATA_DICT_N_NAME, p->schemaName,p->tableName, i);
+      rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        rc = SQLITE_ERROR;
+        goto done;
       }
+      sqlite3_finalize(stmt);
     }
-#endif
-#if SQLITE_VEC_ENABLE_DISKANN
-    if (pNew->vector_columns[i].index_type == VEC0_INDEX_TYPE_DISKANN) {
-      pNew->shadowVectorsNames[i] =
-          sqlite3_mprintf("%s_vectors%02d", tableName, i);
-      if (!pNew->shadowVectorsNames[i]) {
-        goto error;
+    else if(p->metadata_columns[i].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
+      zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_METADATA_TEXT_DATA_NAME, p->schemaName,p->tableName, i);
+      rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        rc = SQLITE_ERROR;
+        goto done;
       }
-      pNew->shadowDiskannNodesNames[i] =
-          sqlite3_mprintf("%s_diskann_nodes%02d", tableName, i);
-      if (!pNew->shadowDiskannNodesNames[i]) {
-        goto error;
+      sqlite3_finalize(stmt);
+    }
+
+    if (p->shadowMetadataBoundsNames[i]) {
+      zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_METADATA_BOUNDS_N_NAME,
+                             p->schemaName, p->tableName, i);
+      rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        rc = SQLITE_ERROR;
+        goto done;
       }
+      sqlite3_finalize(stmt);
     }
-#endif
   }
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-  for (int i = 0; i < pNew->numVectorColumns; i++) {
-    if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_IVF) continue;
-    pNew->shadowIvfCellsNames[i] =
-        sqlite3_mprintf("%s_ivf_cells%02d", tableName, i);
-    if (!pNew->shadowIvfCellsNames[i]) goto error;
-    pNew->ivfTrainedCache[i] = -1; // unknown
+
+  stmt = NULL;
+  rc = SQLITE_OK;
+
+done:
+  sqlite3_finalize(stmt);
+  vec0_free(p);
+  // If there was an error
+  if (rc == SQLITE_OK) {
+    sqlite3_free(p);
   }
+  return rc;
+}
+
+static int vec0Open(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
+  UNUSED_PARAMETER(p);
+  vec0_cursor *pCur;
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if (pCur == 0)
+    return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static int vec0Close(sqlite3_vtab_cursor *cur) {
+  vec0_cursor *pCur = (vec0_cursor *)cur;
+  vec0_cursor_clear(pCur);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+// All the different type of "values" provided to argv/argc in vec0Filter.
+// These enums denote the use and purpose of all of them.
+typedef enum  {
+  // If any values are updated, please update the ARCHITECTURE.md docs accordingly!
+
+  // ~~~ KNN QUERIES ~~~ //
+  VEC0_IDXSTR_KIND_KNN_MATCH = '{',
+  VEC0_IDXSTR_KIND_KNN_K = '}',
+  VEC0_IDXSTR_KIND_KNN_ROWID_IN = '[',
+  // argv[i] is a constraint on a PARTITON KEY column in a KNN query
+  // 
+  VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT = ']',
+
+  // argv[i] is a constraint on the distance column in a KNN query
+  VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT = '*',
+
+  // ~~~ POINT QUERIES ~~~ //
+  VEC0_IDXSTR_KIND_POINT_ID = '!',
+
+  // ~~~ ??? ~~~ //
+  VEC0_IDXSTR_KIND_METADATA_CONSTRAINT = '&',
+} vec0_idxstr_kind;
+
+// Second character of a VEC0_IDXSTR_KIND_KNN_K block when k is the query's
+// LIMIT rather than a `k = ?` constraint.
+#define VEC0_IDXSTR_KNN_K_FROM_LIMIT 'L'
+
+// Second character of a VEC0_IDXSTR_KIND_KNN_MATCH block when the statement
+// reads query_idx, which lets the MATCH value be a matrix of query vectors.
+#define VEC0_IDXSTR_KNN_MATCH_BATCH 'B'
+
+// The different SQLITE_INDEX_CONSTRAINT values that vec0 partition key columns
+// support, but as characters that fit nicely in idxstr.
+typedef enum  {
+  // If any values are updated, please update the ARCHITECTURE.md docs accordingly!
+
+  // Equality constraint on a PARTITON KEY column, ex `user_id = 123`
+  VEC0_PARTITION_OPERATOR_EQ = 'a',
+  
+  // "Greater than" constraint on a PARTITON KEY column, ex `year > 2024`
+  VEC0_PARTITION_OPERATOR_GT = 'b',
+  
+  // "Less than or equal to" constraint on a PARTITON KEY column, ex `year <= 2024`
+  VEC0_PARTITION_OPERATOR_LE = 'c',
+
+  // "Less than" constraint on a PARTITON KEY column, ex `year < 2024`
+  VEC0_PARTITION_OPERATOR_LT = 'd',
+  
+  // "Greater than or equal to" constraint on a PARTITON KEY column, ex `year >= 2024`
+  VEC0_PARTITION_OPERATOR_GE = 'e',
+  
+  // "Not equal to" constraint on a PARTITON KEY column, ex `year != 2024`
+  VEC0_PARTITION_OPERATOR_NE = 'f',
+} vec0_partition_operator;
+typedef enum  {
+  VEC0_METADATA_OPERATOR_EQ = 'a',
+  VEC0_METADATA_OPERATOR_GT = 'b',
+  VEC0_METADATA_OPERATOR_LE = 'c',
+  VEC0_METADATA_OPERATOR_LT = 'd',
+  VEC0_METADATA_OPERATOR_GE = 'e',
+  VEC0_METADATA_OPERATOR_NE = 'f',
+  VEC0_METADATA_OPERATOR_IN = 'g',
+} vec0_metadata_operator;
+
+
+typedef enum {
+
+  VEC0_DISTANCE_CONSTRAINT_GT = 'a',
+  VEC0_DISTANCE_CONSTRAINT_GE = 'b',
+  VEC0_DISTANCE_CONSTRAINT_LT = 'c',
+  VEC0_DISTANCE_CONSTRAINT_LE = 'd',
+} vec0_distance_constraint_operator;
+
+static int vec0BestIndex(sqlite3_vtab *pVTab, sqlite3_index_info *pIdxInfo) {
+  vec0_vtab *p = (vec0_vtab *)pVTab;
+  /**
+   * Possible query plans are:
+   * 1. KNN when:
+   *    a) An `MATCH` op on vector column
+   *    b) ORDER BY on distance column
+   *    c) LIMIT
+   *    d) rowid in (...) OPTIONAL
+   * 2. Point when:
+   *    a) An `EQ` op on rowid column
+   * 3. else: fullscan
+   *
+   */
+  int iMatchTerm = -1;
+  int iMatchVectorTerm = -1;
+  int iLimitTerm = -1;
+  int iRowidTerm = -1;
+  int iKTerm = -1;
+  int iRowidInTerm = -1;
+  int hasAuxConstraint = 0;
+
+#ifdef SQLITE_VEC_DEBUG
+  printf("pIdxInfo->nOrderBy=%d, pIdxInfo->nConstraint=%d\n", pIdxInfo->nOrderBy, pIdxInfo->nConstraint);
 #endif
-  for (int i = 0; i < pNew->numMetadataColumns; i++) {
-    pNew->shadowMetadataChunksNames[i] =
-        sqlite3_mprintf("%s_metadatachunks%02d", tableName, i);
-    if (!pNew->shadowMetadataChunksNames[i]) {
-      goto error;
-    }
-  }
-  pNew->chunk_size = chunk_size;
 
-  // if xCreate, then create the necessary shadow tables
-  if (isCreate) {
-    sqlite3_stmt *stmt;
-    int rc;
+  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+    u8 vtabIn = 0;
 
-    char * zCreateInfo = sqlite3_mprintf("CREATE TABLE "VEC0_SHADOW_INFO_NAME " (key text primary key, value any)", pNew->schemaName, pNew->tableName);
-    if(!zCreateInfo) {
-      goto error;
+#if COMPILER_SUPPORTS_VTAB_IN
+    if (sqlite3_libversion_number() >= 3038000) {
+      vtabIn = sqlite3_vtab_in(pIdxInfo, i, -1);
     }
-    rc = sqlite3_prepare_v2(db, zCreateInfo, -1, &stmt, NULL);
+#endif
 
-    sqlite3_free((void *) zCreateInfo);
-    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-      // TODO(IMP)
-      sqlite3_finalize(stmt);
-      *pzErr = sqlite3_mprintf("Could not create '_info' shadow table: %s",
-                               sqlite3_errmsg(db));
-      goto error;
+#ifdef SQLITE_VEC_DEBUG
+    printf("xBestIndex [%d] usable=%d iColumn=%d op=%d vtabin=%d\n", i,
+           pIdxInfo->aConstraint[i].usable, pIdxInfo->aConstraint[i].iColumn,
+           pIdxInfo->aConstraint[i].op, vtabIn);
+#endif
+    if (!pIdxInfo->aConstraint[i].usable)
+      continue;
+
+    int iColumn = pIdxInfo->aConstraint[i].iColumn;
+    int op = pIdxInfo->aConstraint[i].op;
+
+    if (op == SQLITE_INDEX_CONSTRAINT_LIMIT) {
+      iLimitTerm = i;
     }
-    sqlite3_finalize(stmt);
+    if (op == SQLITE_INDEX_CONSTRAINT_MATCH &&
+        vec0_column_idx_is_vector(p, iColumn)) {
+      if (iMatchTerm > -1) {
+        vtab_set_error(
+            pVTab, "only 1 MATCH operator is allowed in a single vec0 query");
+        return SQLITE_ERROR;
+      }
+      iMatchTerm = i;
+      iMatchVectorTerm = vec0_column_idx_to_vector_idx(p, iColumn);
+    }
+    if (op == SQLITE_INDEX_CONSTRAINT_EQ && iColumn == VEC0_COLUMN_ID) {
+      if (vtabIn) {
+        if (iRowidInTerm != -1) {
+          vtab_set_error(pVTab, "only 1 'rowid in (..)' operator is allowed in "
+                                "a single vec0 query");
+          return SQLITE_ERROR;
+        }
+        iRowidInTerm = i;
 
-    char * zSeedInfo = sqlite3_mprintf(
-      "INSERT INTO "VEC0_SHADOW_INFO_NAME "(key, value) VALUES "
-      "(?1, ?2), (?3, ?4), (?5, ?6), (?7, ?8) ",
-      pNew->schemaName, pNew->tableName
-    );
-    if(!zSeedInfo) {
-      goto error;
+      } else {
+        iRowidTerm = i;
+      }
     }
-    rc = sqlite3_prepare_v2(db, zSeedInfo, -1, &stmt, NULL);
-    sqlite3_free((void *) zSeedInfo);
-    if (rc != SQLITE_OK) {
-      // TODO(IMP)
-      sqlite3_finalize(stmt);
-      *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
-                               sqlite3_errmsg(db));
-      goto error;
+    if (op == SQLITE_INDEX_CONSTRAINT_EQ && iColumn == vec0_column_k_idx(p)) {
+      iKTerm = i;
     }
-    sqlite3_bind_text(stmt, 1, "CREATE_VERSION", -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, SQLITE_VEC_VERSION, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, "CREATE_VERSION_MAJOR", -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 4, SQLITE_VEC_VERSION_MAJOR);
-    sqlite3_bind_text(stmt, 5, "CREATE_VERSION_MINOR", -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 6, SQLITE_VEC_VERSION_MINOR);
-    sqlite3_bind_text(stmt, 7, "CREATE_VERSION_PATCH", -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 8, SQLITE_VEC_VERSION_PATCH);
+    if(
+      (op != SQLITE_INDEX_CONSTRAINT_LIMIT && op != SQLITE_INDEX_CONSTRAINT_OFFSET)
+      && vec0_column_idx_is_auxiliary(p, iColumn)) {
+        hasAuxConstraint = 1;
+      }
+  }
 
-    if(sqlite3_step(stmt) != SQLITE_DONE) {
-      // TODO(IMP)
-      sqlite3_finalize(stmt);
-      *pzErr = sqlite3_mprintf("Could not seed '_info' shadow table: %s",
-                               sqlite3_errmsg(db));
-      goto error;
+  sqlite3_str *idxStr = sqlite3_str_new(NULL);
+  int rc;
+
+  if (iMatchTerm >= 0) {
+    if (iLimitTerm < 0 && iKTerm < 0) {
+      vtab_set_error(
+          pVTab,
+          "A LIMIT or 'k = ?' constraint is required on vec0 knn queries.");
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    if (iLimitTerm >= 0 && iKTerm >= 0) {
+      vtab_set_error(pVTab, "Only LIMIT or 'k =?' can be provided, not both");
+      rc = SQLITE_ERROR;
+      goto done;
     }
-    sqlite3_finalize(stmt);
 
-#if SQLITE_VEC_ENABLE_DISKANN
-    // Seed medoid entries for DiskANN-indexed columns
-    for (int i = 0; i < pNew->numVectorColumns; i++) {
-      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_DISKANN) {
-        continue;
+    if (pIdxInfo->nOrderBy) {
+      // batched KNN queries may also be ordered by query_idx, distance
+      int iOrderByDistance = 0;
+      if (pIdxInfo->nOrderBy == 2 && p->hasQueryIdxColumn &&
+          pIdxInfo->aOrderBy[0].iColumn == vec0_column_query_idx_idx(p)) {
+        if (pIdxInfo->aOrderBy[0].desc) {
+          vtab_set_error(
+              pVTab, "Only ascending in ORDER BY query_idx clause is "
+                     "supported, DESC is not supported yet.");
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        iOrderByDistance = 1;
+      } else if (pIdxInfo->nOrderBy > 1) {
+        vtab_set_error(pVTab, "Only a single 'ORDER BY distance' clause is "
+                              "allowed on vec0 KNN queries");
+        rc = SQLITE_ERROR;
+      goto done;
       }
-      char *key = sqlite3_mprintf("diskann_medoid_%02d", i);
-      char *zInsert = sqlite3_mprintf(
-          "INSERT INTO " VEC0_SHADOW_INFO_NAME "(key, value) VALUES (?1, ?2)",
-          pNew->schemaName, pNew->tableName);
-      rc = sqlite3_prepare_v2(db, zInsert, -1, &stmt, NULL);
-      sqlite3_free(zInsert);
-      if (rc != SQLITE_OK) {
-        sqlite3_free(key);
-        sqlite3_finalize(stmt);
-        goto error;
+      if (pIdxInfo->aOrderBy[iOrderByDistance].iColumn !=
+          vec0_column_distance_idx(p)) {
+        vtab_set_error(pVTab,
+                       "Only a single 'ORDER BY distance' clause is allowed on "
+                       "vec0 KNN queries, not on other columns");
+        rc = SQLITE_ERROR;
+      goto done;
       }
-      sqlite3_bind_text(stmt, 1, key, -1, sqlite3_free);
-      sqlite3_bind_null(stmt, 2);  // NULL means empty graph
-      if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
-        goto error;
+      if (pIdxInfo->aOrderBy[iOrderByDistance].desc) {
+        vtab_set_error(
+            pVTab, "Only ascending in ORDER BY distance clause is supported, "
+                   "DESC is not supported yet.");
+        rc = SQLITE_ERROR;
+      goto done;
       }
-      sqlite3_finalize(stmt);
     }
-#endif
 
-    // create the _chunks shadow table
-    char *zCreateShadowChunks = NULL;
-    if(pNew->numPartitionColumns) {
-      sqlite3_str * s = sqlite3_str_new(NULL);
-      sqlite3_str_appendf(s, "CREATE TABLE " VEC0_SHADOW_CHUNKS_NAME "(", pNew->schemaName, pNew->tableName);
-      sqlite3_str_appendall(s, "chunk_id INTEGER PRIMARY KEY AUTOINCREMENT," "size INTEGER NOT NULL,");
-      sqlite3_str_appendall(s, "sequence_id integer,");
-      for(int i = 0; i < pNew->numPartitionColumns;i++) {
-        sqlite3_str_appendf(s, "partition%02d,", i);
-      }
-      sqlite3_str_appendall(s, "validity BLOB NOT NULL, rowids BLOB NOT NULL);");
-      zCreateShadowChunks = sqlite3_str_finish(s);
-    }else {
-      zCreateShadowChunks = sqlite3_mprintf(VEC0_SHADOW_CHUNKS_CREATE,
-                                          pNew->schemaName, pNew->tableName);
-    }
-    if (!zCreateShadowChunks) {
-        goto error;
-      }
-    rc = sqlite3_prepare_v2(db, zCreateShadowChunks, -1, &stmt, 0);
-    sqlite3_free((void *)zCreateShadowChunks);
-    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-      // IMP: V17740_01811
-      sqlite3_finalize(stmt);
-      *pzErr = sqlite3_mprintf("Could not create '_chunks' shadow table: %s",
-                               sqlite3_errmsg(db));
-      goto error;
+    if(hasAuxConstraint) {
+      // IMP: V25623_09693
+      vtab_set_error(pVTab, "An illegal WHERE constraint was provided on a vec0 auxiliary column in a KNN query.");
+      rc = SQLITE_ERROR;
+      goto done;
     }
-    sqlite3_finalize(stmt);
 
-    // create the _rowids shadow table
-    char *zCreateShadowRowids;
-    if (pNew->pkIsText) {
-      // adds a "text unique not null" constraint to the id column
-      zCreateShadowRowids = sqlite3_mprintf(VEC0_SHADOW_ROWIDS_CREATE_PK_TEXT,
-                                            pNew->schemaName, pNew->tableName);
-    } else {
-      zCreateShadowRowids = sqlite3_mprintf(VEC0_SHADOW_ROWIDS_CREATE_BASIC,
-                                            pNew->schemaName, pNew->tableName);
-    }
-    if (!zCreateShadowRowids) {
-      goto error;
-    }
-    rc = sqlite3_prepare_v2(db, zCreateShadowRowids, -1, &stmt, 0);
-    sqlite3_free((void *)zCreateShadowRowids);
-    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-      // IMP: V11631_28470
-      sqlite3_finalize(stmt);
-      *pzErr = sqlite3_mprintf("Could not create '_rowids' shadow table: %s",
-                               sqlite3_errmsg(db));
-      goto error;
+    sqlite3_str_appendchar(idxStr, 1, VEC0_QUERY_PLAN_KNN);
+
+    int argvIndex = 1;
+    pIdxInfo->aConstraintUsage[iMatchTerm].argvIndex = argvIndex++;
+    pIdxInfo->aConstraintUsage[iMatchTerm].omit = 1;
+    sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_MATCH);
+    // batches are opt-in: a query that never reads query_idx couldn't tell
+    // their rows apart, so its MATCH must be a single vector
+    int batch = 0;
+    if (p->hasQueryIdxColumn) {
+      int iQueryIdx = vec0_column_query_idx_idx(p);
+      batch = (pIdxInfo->colUsed & ((sqlite3_uint64)1 << min(iQueryIdx, 63))) != 0;
     }
-    sqlite3_finalize(stmt);
+    sqlite3_str_appendchar(idxStr, 1, batch ? VEC0_IDXSTR_KNN_MATCH_BATCH : '_');
+    sqlite3_str_appendchar(idxStr, 2, '_');
 
-    for (int i = 0; i < pNew->numVectorColumns; i++) {
-      // Non-FLAT columns (rescore, IVF, DiskANN) don't use _vector_chunks
-      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_FLAT)
-        continue;
-      char *zSql = sqlite3_mprintf(VEC0_SHADOW_VECTOR_N_CREATE,
-                                   pNew->schemaName, pNew->tableName, i);
-      if (!zSql) {
-        goto error;
-      }
-      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
-      sqlite3_free((void *)zSql);
-      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-        // IMP: V25919_09989
-        sqlite3_finalize(stmt);
-        *pzErr = sqlite3_mprintf(
-            "Could not create '_vector_chunks%02d' shadow table: %s", i,
-            sqlite3_errmsg(db));
-        goto error;
-      }
-      sqlite3_finalize(stmt);
+    if (iLimitTerm >= 0) {
+      pIdxInfo->aConstraintUsage[iLimitTerm].argvIndex = argvIndex++;
+      pIdxInfo->aConstraintUsage[iLimitTerm].omit = 1;
+    } else {
+      pIdxInfo->aConstraintUsage[iKTerm].argvIndex = argvIndex++;
+      pIdxInfo->aConstraintUsage[iKTerm].omit = 1;
     }
+    sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_K);
+    sqlite3_str_appendchar(idxStr, 1,
+                           iLimitTerm >= 0 ? VEC0_IDXSTR_KNN_K_FROM_LIMIT : '_');
+    sqlite3_str_appendchar(idxStr, 2, '_');
 
-#if SQLITE_VEC_ENABLE_RESCORE
-    rc = rescore_create_tables(pNew, db, pzErr);
-    if (rc != SQLITE_OK) {
-      goto error;
+#if COMPILER_SUPPORTS_VTAB_IN
+    if (iRowidInTerm >= 0) {
+      // already validated as  >= SQLite 3.38 bc iRowidInTerm is only >= 0 when
+      // vtabIn == 1
+      sqlite3_vtab_in(pIdxInfo, iRowidInTerm, 1);
+      pIdxInfo->aConstraintUsage[iRowidInTerm].argvIndex = argvIndex++;
+      pIdxInfo->aConstraintUsage[iRowidInTerm].omit = 1;
+      sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_ROWID_IN);
+      sqlite3_str_appendchar(idxStr, 3, '_');
     }
 #endif
 
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-    // Create IVF shadow tables for IVF-indexed vector columns
-    for (int i = 0; i < pNew->numVectorColumns; i++) {
-      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_IVF) continue;
-      rc = ivf_create_shadow_tables(pNew, i);
-      if (rc != SQLITE_OK) {
-        *pzErr = sqlite3_mprintf("Could not create IVF shadow tables for column %d", i);
-        goto error;
-      }
-    }
-#endif
+    // find any PARTITION KEY column constraints
+    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+      if (!pIdxInfo->aConstraint[i].usable)
+        continue;
 
-#if SQLITE_VEC_ENABLE_DISKANN
-    // Create DiskANN shadow tables for indexed vector columns
-    for (int i = 0; i < pNew->numVectorColumns; i++) {
-      if (pNew->vector_columns[i].index_type != VEC0_INDEX_TYPE_DISKANN) {
+      int iColumn = pIdxInfo->aConstraint[i].iColumn;
+      int op = pIdxInfo->aConstraint[i].op;
+      if(op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
         continue;
       }
-
-      // Create _vectors{NN} table
-      {
-        char *zSql = sqlite3_mprintf(
-            "CREATE TABLE " VEC0_SHADOW_VECTORS_N_NAME
-            " (rowid INTEGER PRIMARY KEY, vector BLOB NOT NULL);",
-            pNew->schemaName, pNew->tableName, i);
-        if (!zSql) {
-          goto error;
-        }
-        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
-        sqlite3_free(zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-          sqlite3_finalize(stmt);
-          *pzErr = sqlite3_mprintf(
-              "Could not create '_vectors%02d' shadow table: %s", i,
-              sqlite3_errmsg(db));
-          goto error;
-        }
-        sqlite3_finalize(stmt);
+      if(!vec0_column_idx_is_partition(p, iColumn)) {
+        continue;
       }
 
-      // Create _diskann_nodes{NN} table
-      {
-        char *zSql = sqlite3_mprintf(
-            "CREATE TABLE " VEC0_SHADOW_DISKANN_NODES_N_NAME " ("
-            "rowid INTEGER PRIMARY KEY, "
-            "neighbors_validity BLOB NOT NULL, "
-            "neighbor_ids BLOB NOT NULL, "
-            "neighbor_quantized_vectors BLOB NOT NULL"
-            ");",
-            pNew->schemaName, pNew->tableName, i);
-        if (!zSql) {
-          goto error;
+      int partition_idx = vec0_column_idx_to_partition_idx(p, iColumn);
+      char value = 0;
+
+      switch(op) {
+        case SQLITE_INDEX_CONSTRAINT_EQ: {
+          value = VEC0_PARTITION_OPERATOR_EQ;
+          break;
         }
-        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
-        sqlite3_free(zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-          sqlite3_finalize(stmt);
-          *pzErr = sqlite3_mprintf(
-              "Could not create '_diskann_nodes%02d' shadow table: %s", i,
-              sqlite3_errmsg(db));
-          goto error;
+        case SQLITE_INDEX_CONSTRAINT_GT: {
+          value = VEC0_PARTITION_OPERATOR_GT;
+          break;
         }
-        sqlite3_finalize(stmt);
-      }
-
-      // Create _diskann_buffer{NN} table (for batched inserts)
-      {
-        char *zSql = sqlite3_mprintf(
-            "CREATE TABLE " VEC0_SHADOW_DISKANN_BUFFER_N_NAME " ("
-            "rowid INTEGER PRIMARY KEY, "
-            "vector BLOB NOT NULL"
-            ");",
-            pNew->schemaName, pNew->tableName, i);
-        if (!zSql) {
-          goto error;
+        case SQLITE_INDEX_CONSTRAINT_LE: {
+          value = VEC0_PARTITION_OPERATOR_LE;
+          break;
         }
-        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
-        sqlite3_free(zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-          sqlite3_finalize(stmt);
-          *pzErr = sqlite3_mprintf(
-              "Could not create '_diskann_buffer%02d' shadow table: %s", i,
-              sqlite3_errmsg(db));
-          goto error;
+        case SQLITE_INDEX_CONSTRAINT_LT: {
+          value = VEC0_PARTITION_OPERATOR_LT;
+          break;
         }
-        sqlite3_finalize(stmt);
-      }
-    }
-#endif
-
-    // See SHADOW_TABLE_ROWID_QUIRK in vec0_new_chunk() — same "rowid PRIMARY KEY"
-    // without INTEGER type issue applies here.
-    for (int i = 0; i < pNew->numMetadataColumns; i++) {
-      char *zSql = sqlite3_mprintf("CREATE TABLE " VEC0_SHADOW_METADATA_N_NAME "(rowid PRIMARY KEY, data BLOB NOT NULL);",
-                                   pNew->schemaName, pNew->tableName, i);
-      if (!zSql) {
-        goto error;
-      }
-      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
-      sqlite3_free((void *)zSql);
-      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-        sqlite3_finalize(stmt);
-        *pzErr = sqlite3_mprintf(
-            "Could not create '_metata_chunks%02d' shadow table: %s", i,
-            sqlite3_errmsg(db));
-        goto error;
-      }
-      sqlite3_finalize(stmt);
-
-      if(pNew->metadata_columns[i].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
-        char *zSql = sqlite3_mprintf("CREATE TABLE " VEC0_SHADOW_METADATA_TEXT_DATA_NAME "(rowid PRIMARY KEY, data TEXT);",
-                                   pNew->schemaName, pNew->tableName, i);
-        if (!zSql) {
-          goto error;
+        case SQLITE_INDEX_CONSTRAINT_GE: {
+          value = VEC0_PARTITION_OPERATOR_GE;
+          break;
         }
-        rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
-        sqlite3_free((void *)zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-          sqlite3_finalize(stmt);
-          *pzErr = sqlite3_mprintf(
-              "Could not create '_metadatatext%02d' shadow table: %s", i,
-              sqlite3_errmsg(db));
-          goto error;
+        case SQLITE_INDEX_CONSTRAINT_NE: {
+          value = VEC0_PARTITION_OPERATOR_NE;
+          break;
         }
-        sqlite3_finalize(stmt);
-
       }
-    }
 
-    if(pNew->numAuxiliaryColumns > 0) {
-      sqlite3_stmt * stmt;
-      sqlite3_str * s = sqlite3_str_new(NULL);
-      sqlite3_str_appendf(s, "CREATE TABLE " VEC0_SHADOW_AUXILIARY_NAME "( rowid integer PRIMARY KEY ", pNew->schemaName, pNew->tableName);
-      for(int i = 0; i < pNew->numAuxiliaryColumns; i++) {
-        sqlite3_str_appendf(s, ", value%02d", i);
-      }
-      sqlite3_str_appendall(s, ")");
-      char *zSql = sqlite3_str_finish(s);
-      if(!zSql) {
-        goto error;
+      if(value) {
+        pIdxInfo->aConstraintUsage[i].argvIndex = argvIndex++;
+        pIdxInfo->aConstraintUsage[i].omit = 1;
+        sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT);
+        sqlite3_str_appendchar(idxStr, 1, 'A' + partition_idx);
+        sqlite3_str_appendchar(idxStr, 1, value);
+        sqlite3_str_appendchar(idxStr, 1, '_');
       }
-      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
-      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-        sqlite3_finalize(stmt);
-        *pzErr = sqlite3_mprintf(
-            "Could not create auxiliary shadow table: %s",
-            sqlite3_errmsg(db));
 
-        goto error;
-      }
-      sqlite3_finalize(stmt);
     }
-  }
-
-  *ppVtab = (sqlite3_vtab *)pNew;
-  return SQLITE_OK;
-
-error:
-  vec0_free(pNew);
-  sqlite3_free(pNew);
-  return SQLITE_ERROR;
-}
-
-static int vec0Create(sqlite3 *db, void *pAux, int argc,
-                      const char *const *argv, sqlite3_vtab **ppVtab,
-                      char **pzErr) {
-  return vec0_init(db, pAux, argc, argv, ppVtab, pzErr, true);
-}
-static int vec0Connect(sqlite3 *db, void *pAux, int argc,
-                       const char *const *argv, sqlite3_vtab **ppVtab,
-                       char **pzErr) {
-  return vec0_init(db, pAux, argc, argv, ppVtab, pzErr, false);
-}
-
-static int vec0Disconnect(sqlite3_vtab *pVtab) {
-  vec0_vtab *p = (vec0_vtab *)pVtab;
-  vec0_free(p);
-  sqlite3_free(p);
-  return SQLITE_OK;
-}
-static int vec0Destroy(sqlite3_vtab *pVtab) {
-  vec0_vtab *p = (vec0_vtab *)pVtab;
-  sqlite3_stmt *stmt;
-  int rc;
-  const char *zSql;
-
-  // Free up any sqlite3_stmt, otherwise DROPs on those tables will fail
-  vec0_free_resources(p);
 
-  // TODO(test) later: can't evidence-of here, bc always gives "SQL logic error" instead of
-  // provided error
-  zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_CHUNKS_NAME, p->schemaName,
-                         p->tableName);
-  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-  sqlite3_free((void *)zSql);
-  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-    rc = SQLITE_ERROR;
-    vtab_set_error(pVtab, "could not drop chunks shadow table");
-    goto done;
-  }
-  sqlite3_finalize(stmt);
+    // find any metadata column constraints
+    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+      if (!pIdxInfo->aConstraint[i].usable)
+        continue;
 
-  zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_INFO_NAME, p->schemaName,
-                         p->tableName);
-  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-  sqlite3_free((void *)zSql);
-  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-    rc = SQLITE_ERROR;
-    vtab_set_error(pVtab, "could not drop info shadow table");
-    goto done;
-  }
-  sqlite3_finalize(stmt);
+      int iColumn = pIdxInfo->aConstraint[i].iColumn;
+      int op = pIdxInfo->aConstraint[i].op;
+      if(op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
+        continue;
+      }
+      if(!vec0_column_idx_is_metadata(p, iColumn)) {
+        continue;
+      }
 
-  zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_ROWIDS_NAME, p->schemaName,
-                         p->tableName);
-  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-  sqlite3_free((void *)zSql);
-  if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-    rc = SQLITE_ERROR;
-    goto done;
-  }
-  sqlite3_finalize(stmt);
+      int metadata_idx = vec0_column_idx_to_metadata_idx(p, iColumn);
+      char value = 0;
 
-  for (int i = 0; i < p->numVectorColumns; i++) {
-#if SQLITE_VEC_ENABLE_DISKANN
-    if (p->vector_columns[i].index_type == VEC0_INDEX_TYPE_DISKANN) {
-      // Drop DiskANN shadow tables
-      zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_VECTORS_N_NAME,
-                             p->schemaName, p->tableName, i);
-      if (zSql) {
-        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-        sqlite3_free((void *)zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-          rc = SQLITE_ERROR;
-          goto done;
+      switch(op) {
+        case SQLITE_INDEX_CONSTRAINT_EQ: {
+          int vtabIn = 0;
+          #if COMPILER_SUPPORTS_VTAB_IN
+          if (sqlite3_libversion_number() >= 3038000) {
+            vtabIn = sqlite3_vtab_in(pIdxInfo, i, -1);
+          }
+          if(vtabIn) {
+            switch(p->metadata_columns[metadata_idx].kind) {
+              case VEC0_METADATA_COLUMN_KIND_FLOAT:
+              case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+                // IMP: V15248_32086
+                rc = SQLITE_ERROR;
+                vtab_set_error(pVTab, "'xxx in (...)' is only available on INTEGER or TEXT metadata columns.");
+                goto done;
+                break;
+              }
+              case VEC0_METADATA_COLUMN_KIND_INTEGER:
+              case VEC0_METADATA_COLUMN_KIND_TEXT: {
+                break;
+              }
+            }
+            value = VEC0_METADATA_OPERATOR_IN;
+            sqlite3_vtab_in(pIdxInfo, i, 1);
+          }else
+          #endif
+           {
+            value = VEC0_PARTITION_OPERATOR_EQ;
+          }
+          break;
         }
-        sqlite3_finalize(stmt);
-      }
-      zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_DISKANN_NODES_N_NAME,
-                             p->schemaName, p->tableName, i);
-      if (zSql) {
-        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-        sqlite3_free((void *)zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        case SQLITE_INDEX_CONSTRAINT_GT: {
+          value = VEC0_METADATA_OPERATOR_GT;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_LE: {
+          value = VEC0_METADATA_OPERATOR_LE;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_LT: {
+          value = VEC0_METADATA_OPERATOR_LT;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_GE: {
+          value = VEC0_METADATA_OPERATOR_GE;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_NE: {
+          value = VEC0_METADATA_OPERATOR_NE;
+          break;
+        }
+        default: {
+          // IMP: V16511_00582
           rc = SQLITE_ERROR;
+          vtab_set_error(pVTab,
+          "An illegal WHERE constraint was provided on a vec0 metadata column in a KNN query. "
+          "Only one of EQUALS, GREATER_THAN, LESS_THAN_OR_EQUAL, LESS_THAN, GREATER_THAN_OR_EQUAL, NOT_EQUALS is allowed."
+          );
           goto done;
         }
-        sqlite3_finalize(stmt);
       }
-      zSql = sqlite3_mprintf("DROP TABLE IF EXISTS " VEC0_SHADOW_DISKANN_BUFFER_N_NAME,
-                             p->schemaName, p->tableName, i);
-      if (zSql) {
-        rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-        sqlite3_free((void *)zSql);
-        if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+
+      if(p->metadata_columns[metadata_idx].kind == VEC0_METADATA_COLUMN_KIND_BOOLEAN) {
+        if(!(value == VEC0_METADATA_OPERATOR_EQ || value == VEC0_METADATA_OPERATOR_NE)) {
+          // IMP: V10145_26984
           rc = SQLITE_ERROR;
+          vtab_set_error(pVTab, "ONLY EQUALS (=) or NOT_EQUALS (!=) operators are allowed on boolean metadata columns.");
           goto done;
         }
-        sqlite3_finalize(stmt);
       }
-      continue;
-    }
-#endif
-    // Non-FLAT columns (rescore, IVF, DiskANN) don't use _vector_chunks
-    if (p->vector_columns[i].index_type != VEC0_INDEX_TYPE_FLAT)
-      continue;
-    zSql = sqlite3_mprintf("DROP TABLE \"%w\".\"%w\"", p->schemaName,
-                           p->shadowVectorChunksNames[i]);
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-    sqlite3_free((void *)zSql);
-    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-      rc = SQLITE_ERROR;
-      goto done;
-    }
-    sqlite3_finalize(stmt);
-  }
-
-#if SQLITE_VEC_ENABLE_RESCORE
-  rc = rescore_drop_tables(p);
-  if (rc != SQLITE_OK) {
-    goto done;
-  }
-#endif
 
-#if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
-  // Drop IVF shadow tables
-  for (int i = 0; i < p->numVectorColumns; i++) {
-    if (p->vector_columns[i].index_type != VEC0_INDEX_TYPE_IVF) continue;
-    ivf_drop_shadow_tables(p, i);
-  }
-#endif
+      pIdxInfo->aConstraintUsage[i].argvIndex = argvIndex++;
+      pIdxInfo->aConstraintUsage[i].omit = 1;
+      sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_METADATA_CONSTRAINT);
+      sqlite3_str_appendchar(idxStr, 1, 'A' + metadata_idx);
+      sqlite3_str_appendchar(idxStr, 1, value);
+      sqlite3_str_appendchar(idxStr, 1, '_');
 
-  if(p->numAuxiliaryColumns > 0) {
-    zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_AUXILIARY_NAME, p->schemaName, p->tableName);
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-    sqlite3_free((void *)zSql);
-    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-      rc = SQLITE_ERROR;
-      goto done;
     }
-    sqlite3_finalize(stmt);
-  }
-
 
-  for (int i = 0; i < p->numMetadataColumns; i++) {
-    zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_METADATA_N_NAME, p->schemaName,p->tableName, i);
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-    sqlite3_free((void *)zSql);
-    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-      rc = SQLITE_ERROR;
-      goto done;
-    }
-    sqlite3_finalize(stmt);
+    // find any distance column constraints
+    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
+      if (!pIdxInfo->aConstraint[i].usable)
+        continue;
 
-    if(p->metadata_columns[i].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
-      zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_METADATA_TEXT_DATA_NAME, p->schemaName,p->tableName, i);
-      rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
-      sqlite3_free((void *)zSql);
-      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
-        rc = SQLITE_ERROR;
-        goto done;
+      int iColumn = pIdxInfo->aConstraint[i].iColumn;
+      int op = pIdxInfo->aConstraint[i].op;
+      if(op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
+        continue;
+      }
+      if(vec0_column_distance_idx(p) != iColumn) {
+        continue;
       }
-      sqlite3_finalize(stmt);
-    }
-  }
-
-  stmt = NULL;
-  rc = SQLITE_OK;
-
-done:
-  sqlite3_finalize(stmt);
-  vec0_free(p);
-  // If there was an error
-  if (rc == SQLITE_OK) {
-    sqlite3_free(p);
-  }
-  return rc;
-}
-
-static int vec0Open(sqlite3_vtab *p, sqlite3_vtab_cursor **ppCursor) {
-  UNUSED_PARAMETER(p);
-  vec0_cursor *pCur;
-  pCur = sqlite3_malloc(sizeof(*pCur));
-  if (pCur == 0)
-    return SQLITE_NOMEM;
-  memset(pCur, 0, sizeof(*pCur));
-  *ppCursor = &pCur->base;
-  return SQLITE_OK;
-}
-
-static int vec0Close(sqlite3_vtab_cursor *cur) {
-  vec0_cursor *pCur = (vec0_cursor *)cur;
-  vec0_cursor_clear(pCur);
-  sqlite3_free(pCur);
-  return SQLITE_OK;
-}
-
-// All the different type of "values" provided to argv/argc in vec0Filter.
-// These enums denote the use and purpose of all of them.
-typedef enum  {
-  // If any values are updated, please update the ARCHITECTURE.md docs accordingly!
 
-  // ~~~ KNN QUERIES ~~~ //
-  VEC0_IDXSTR_KIND_KNN_MATCH = '{',
-  VEC0_IDXSTR_KIND_KNN_K = '}',
-  VEC0_IDXSTR_KIND_KNN_ROWID_IN = '[',
-  // argv[i] is a constraint on a PARTITON KEY column in a KNN query
-  // 
-  VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT = ']',
+      char value = 0;
+      switch(op) {
+        case SQLITE_INDEX_CONSTRAINT_GT: {
+          value = VEC0_DISTANCE_CONSTRAINT_GT;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_GE: {
+          value = VEC0_DISTANCE_CONSTRAINT_GE;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_LT: {
+          value = VEC0_DISTANCE_CONSTRAINT_LT;
+          break;
+        }
+        case SQLITE_INDEX_CONSTRAINT_LE: {
+          value = VEC0_DISTANCE_CONSTRAINT_LE;
+          break;
+        }
+        default: {
+          // IMP TODO
+          rc = SQLITE_ERROR;
+          vtab_set_error(
+            pVTab, 
+            "Illegal WHERE constraint on distance column in a KNN query. "
+            "Only one of GT, GE, LT, LE constraints are allowed."
+          );
+          goto done;
+        }
+      }
 
-  // argv[i] is a constraint on the distance column in a KNN query
-  VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT = '*',
+      pIdxInfo->aConstraintUsage[i].argvIndex = argvIndex++;
+      pIdxInfo->aConstraintUsage[i].omit = 1;
+      sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT);
+      sqlite3_str_appendchar(idxStr, 1, value);
+      sqlite3_str_appendchar(idxStr, 1, '_');
+      sqlite3_str_appendchar(idxStr, 1, '_');
+    }
 
-  // ~~~ POINT QUERIES ~~~ //
-  VEC0_IDXSTR_KIND_POINT_ID = '!',
 
-  // ~~~ ??? ~~~ //
-  VEC0_IDXSTR_KIND_METADATA_CONSTRAINT = '&',
-} vec0_idxstr_kind;
 
-// The different SQLITE_INDEX_CONSTRAINT values that vec0 partition key columns
-// support, but as characters that fit nicely in idxstr.
-typedef enum  {
-  // If any values are updated, please update the ARCHITECTURE.md docs accordingly!
+    pIdxInfo->idxNum = iMatchVectorTerm;
+    pIdxInfo->estimatedCost = 30.0;
+    pIdxInfo->estimatedRows = 10;
 
-  // Equality constraint on a PARTITON KEY column, ex `user_id = 123`
-  VEC0_PARTITION_OPERATOR_EQ = 'a',
-  
-  // "Greater than" constraint on a PARTITON KEY column, ex `year > 2024`
-  VEC0_PARTITION_OPERATOR_GT = 'b',
-  
-  // "Less than or equal to" constraint on a PARTITON KEY column, ex `year <= 2024`
-  VEC0_PARTITION_OPERATOR_LE = 'c',
+  } else if (iRowidTerm >= 0) {
+    sqlite3_str_appendchar(idxStr, 1, VEC0_QUERY_PLAN_POINT);
+    pIdxInfo->aConstraintUsage[iRowidTerm].argvIndex = 1;
+    pIdxInfo->aConstraintUsage[iRowidTerm].omit = 1;
+    sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_POINT_ID);
+    sqlite3_str_appendchar(idxStr, 3, '_');
+    pIdxInfo->idxNum = pIdxInfo->colUsed;
+    pIdxInfo->estimatedCost = 10.0;
+    pIdxInfo->estimatedRows = 1;
+  } else {
+    sqlite3_str_appendchar(idxStr, 1, VEC0_QUERY_PLAN_FULLSCAN);
+    pIdxInfo->estimatedCost = 3000000.0;
+    pIdxInfo->estimatedRows = 100000;
+  }
+  pIdxInfo->idxStr = sqlite3_str_finish(idxStr);
+  idxStr = NULL;
+  if (!pIdxInfo->idxStr) {
+    rc = SQLITE_OK;
+    goto done;
+  }
+  pIdxInfo->needToFreeIdxStr = 1;
 
-  // "Less than" constraint on a PARTITON KEY column, ex `year < 2024`
-  VEC0_PARTITION_OPERATOR_LT = 'd',
-  
-  // "Greater than or equal to" constraint on a PARTITON KEY column, ex `year >= 2024`
-  VEC0_PARTITION_OPERATOR_GE = 'e',
-  
-  // "Not equal to" constraint on a PARTITON KEY column, ex `year != 2024`
-  VEC0_PARTITION_OPERATOR_NE = 'f',
-} vec0_partition_operator;
-typedef enum  {
-  VEC0_METADATA_OPERATOR_EQ = 'a',
-  VEC0_METADATA_OPERATOR_GT = 'b',
-  VEC0_METADATA_OPERATOR_LE = 'c',
-  VEC0_METADATA_OPERATOR_LT = 'd',
-  VEC0_METADATA_OPERATOR_GE = 'e',
-  VEC0_METADATA_OPERATOR_NE = 'f',
-  VEC0_METADATA_OPERATOR_IN = 'g',
-} vec0_metadata_operator;
+  rc = SQLITE_OK;
 
+  done:
+    if(idxStr) {
+      sqlite3_str_finish(idxStr);
+    }
+    return rc;
+}
 
-typedef enum {
+// forward delcaration bc vec0Filter uses it
+static int vec0Next(sqlite3_vtab_cursor *cur);
 
-  VEC0_DISTANCE_CONSTRAINT_GT = 'a',
-  VEC0_DISTANCE_CONSTRAINT_GE = 'b',
-  VEC0_DISTANCE_CONSTRAINT_LT = 'c',
-  VEC0_DISTANCE_CONSTRAINT_LE = 'd',
-} vec0_distance_constraint_operator;
+u8 *bitmap_new(i32 n) {
+  assert(n % 8 == 0);
+  u8 *p = sqlite3_malloc(n * sizeof(u8) / CHAR_BIT);
+  if (p) {
+    memset(p, 0, n * sizeof(u8) / CHAR_BIT);
+  }
+  return p;
+}
+u8 *bitmap_new_from(i32 n, u8 *from) {
+  assert(n % 8 == 0);
+  u8 *p = sqlite3_malloc(n * sizeof(u8) / CHAR_BIT);
+  if (p) {
+    memcpy(p, from, n / CHAR_BIT);
+  }
+  return p;
+}
 
-static int vec0BestIndex(sqlite3_vtab *pVTab, sqlite3_index_info *pIdxInfo) {
-  vec0_vtab *p = (vec0_vtab *)pVTab;
-  /**
-   * Possible query plans are:
-   * 1. KNN when:
-   *    a) An `MATCH` op on vector column
-   *    b) ORDER BY on distance column
-   *    c) LIMIT
-   *    d) rowid in (...) OPTIONAL
-   * 2. Point when:
-   *    a) An `EQ` op on rowid column
-   * 3. else: fullscan
-   *
-   */
-  int iMatchTerm = -1;
-  int iMatchVectorTerm = -1;
-  int iLimitTerm = -1;
-  int iRowidTerm = -1;
-  int iKTerm = -1;
-  int iRowidInTerm = -1;
-  int hasAuxConstraint = 0;
+void bitmap_copy(u8 *base, u8 *from, i32 n) {
+  assert(n % 8 == 0);
+  memcpy(base, from, n / CHAR_BIT);
+}
 
-#ifdef SQLITE_VEC_DEBUG
-  printf("pIdxInfo->nOrderBy=%d, pIdxInfo->nConstraint=%d\n", pIdxInfo->nOrderBy, pIdxInfo->nConstraint);
-#endif
+void bitmap_and_inplace(u8 *base, u8 *other, i32 n) {
+  assert((n % 8) == 0);
+  for (i32 word_start = 0; word_start < n; word_start += 64) {
+    bitmap_word64_store(base, n, word_start,
+                        bitmap_word64(base, n, word_start) &
+                            bitmap_word64(other, n, word_start));
+  }
+}
 
-  for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-    u8 vtabIn = 0;
+void bitmap_set(u8 *bitmap, i32 position, int value) {
+  if (value) {
+    bitmap[position / CHAR_BIT] |= 1 << (position % CHAR_BIT);
+  } else {
+    bitmap[position / CHAR_BIT] &= ~(1 << (position % CHAR_BIT));
+  }
+}
 
-#if COMPILER_SUPPORTS_VTAB_IN
-    if (sqlite3_libversion_number() >= 3038000) {
-      vtabIn = sqlite3_vtab_in(pIdxInfo, i, -1);
-    }
-#endif
+int bitmap_get(u8 *bitmap, i32 position) {
+  return (((bitmap[position / CHAR_BIT]) >> (position % CHAR_BIT)) & 1);
+}
 
-#ifdef SQLITE_VEC_DEBUG
-    printf("xBestIndex [%d] usable=%d iColumn=%d op=%d vtabin=%d\n", i,
-           pIdxInfo->aConstraint[i].usable, pIdxInfo->aConstraint[i].iColumn,
-           pIdxInfo->aConstraint[i].op, vtabIn);
-#endif
-    if (!pIdxInfo->aConstraint[i].usable)
-      continue;
+void bitmap_clear(u8 *bitmap, i32 n) {
+  assert((n % 8) == 0);
+  memset(bitmap, 0, n / CHAR_BIT);
+}
 
-    int iColumn = pIdxInfo->aConstraint[i].iColumn;
-    int op = pIdxInfo->aConstraint[i].op;
+void bitmap_fill(u8 *bitmap, i32 n) {
+  assert((n % 8) == 0);
+  memset(bitmap, 0xFF, n / CHAR_BIT);
+}
 
-    if (op == SQLITE_INDEX_CONSTRAINT_LIMIT) {
-      iLimitTerm = i;
-    }
-    if (op == SQLITE_INDEX_CONSTRAINT_MATCH &&
-        vec0_column_idx_is_vector(p, iColumn)) {
-      if (iMatchTerm > -1) {
-        vtab_set_error(
-            pVTab, "only 1 MATCH operator is allowed in a single vec0 query");
-        return SQLITE_ERROR;
-      }
-      iMatchTerm = i;
-      iMatchVectorTerm = vec0_column_idx_to_vector_idx(p, iColumn);
+int bitmap_is_clear(u8 *bitmap, i32 n) {
+  assert((n % 8) == 0);
+  for (i32 word_start = 0; word_start < n; word_start += 64) {
+    if (bitmap_word64(bitmap, n, word_start)) {
+      return 0;
     }
-    if (op == SQLITE_INDEX_CONSTRAINT_EQ && iColumn == VEC0_COLUMN_ID) {
-      if (vtabIn) {
-        if (iRowidInTerm != -1) {
-          vtab_set_error(pVTab, "only 1 'rowid in (..)' operator is allowed in "
-                                "a single vec0 query");
-          return SQLITE_ERROR;
-        }
-        iRowidInTerm = i;
+  }
+  return 1;
+}
 
-      } else {
-        iRowidTerm = i;
+/**
+ * @brief Clear the bits of b whose rowid isn't in rowidsIn, a sorted array of
+ * i64 rowids. Only rows whose bit is set are looked up.
+ */
+void bitmap_filter_rowids_in(u8 *b, const i64 *rowids, i32 n,
+                             const struct Array *rowidsIn) {
+  for (i32 word_start = 0; word_start < n; word_start += 64) {
+    u64 word = bitmap_word64(b, n, word_start);
+    for (u64 bits = word; bits; bits &= bits - 1) {
+      int j = vec0_ctz64(bits);
+      if (!bsearch(&rowids[word_start + j], rowidsIn->z, rowidsIn->length,
+                   sizeof(i64), _cmp)) {
+        word &= ~((u64)1 << j);
       }
     }
-    if (op == SQLITE_INDEX_CONSTRAINT_EQ && iColumn == vec0_column_k_idx(p)) {
-      iKTerm = i;
-    }
-    if(
-      (op != SQLITE_INDEX_CONSTRAINT_LIMIT && op != SQLITE_INDEX_CONSTRAINT_OFFSET)
-      && vec0_column_idx_is_auxiliary(p, iColumn)) {
-        hasAuxConstraint = 1;
-      }
+    bitmap_word64_store(b, n, word_start, word);
   }
+}
 
-  sqlite3_str *idxStr = sqlite3_str_new(NULL);
+int vec0_get_metadata_text_long_value(
+  vec0_vtab * p,
+  sqlite3_stmt ** stmt,
+  int metadata_idx,
+  i64 rowid,
+  int *n,
+  char ** s) {
   int rc;
-
-  if (iMatchTerm >= 0) {
-    if (iLimitTerm < 0 && iKTerm < 0) {
-      vtab_set_error(
-          pVTab,
-          "A LIMIT or 'k = ?' constraint is required on vec0 knn queries.");
-      rc = SQLITE_ERROR;
+  if(!(*stmt)) {
+    const char * zSql = sqlite3_mprintf("select data from " VEC0_SHADOW_METADATA_TEXT_DATA_NAME " where rowid = ?", p->schemaName, p->tableName, metadata_idx);
+    if(!zSql) {
+      rc = SQLITE_NOMEM;
       goto done;
     }
-    if (iLimitTerm >= 0 && iKTerm >= 0) {
-      vtab_set_error(pVTab, "Only LIMIT or 'k =?' can be provided, not both");
-      rc = SQLITE_ERROR;
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, stmt, NULL);
+    sqlite3_free( (void *) zSql);
+    if(rc != SQLITE_OK) {
       goto done;
     }
+  }
+
+  sqlite3_reset(*stmt);
+  sqlite3_bind_int64(*stmt, 1, rowid);
+  rc = sqlite3_step(*stmt);
+  if(rc != SQLITE_ROW) {
+    rc = SQLITE_ERROR;
+    goto done;
+  }
+  *s = (char *) sqlite3_column_text(*stmt, 0);
+  *n = sqlite3_column_bytes(*stmt, 0);
+  rc = SQLITE_OK;
+  done:
+    return rc;
+}
+
+/**
+ * @brief Crete at "iterator" (sqlite3_stmt) of chunks with the given constraints
+ *
+ * Any VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT values in idxStr/argv will be applied
+ * as WHERE constraints in the underlying stmt SQL, and any consumer of the stmt
+ * can freely step through the stmt with all constraints satisfied.
+ *
+ * @param p - vec0_vtab
+ * @param idxStr - the xBestIndex/xFilter idxstr containing VEC0_IDXSTR values
+ * @param argc - number of argv values from xFilter
+ * @param argv - array of sqlite3_value from xFilter
+ * @param outStmt - output sqlite3_stmt of chunks with all filters applied
+ * @return int SQLITE_OK on success, error code otherwise
+ */
+int vec0_chunks_iter(vec0_vtab * p, const char * idxStr, int argc, sqlite3_value ** argv, sqlite3_stmt** outStmt) {
+  // always null terminated, enforced by SQLite
+  int idxStrLength = strlen(idxStr);
+  // "1" refers to the initial vec0_query_plan char, 4 is the number of chars per "element"
+  int numValueEntries = (idxStrLength-1) / 4;
+  assert(argc == numValueEntries);
+
+  int rc;
+  sqlite3_str * s = sqlite3_str_new(NULL);
+  sqlite3_str_appendf(s, "select chunk_id, validity, rowids "
+                         " from " VEC0_SHADOW_CHUNKS_NAME,
+                         p->schemaName, p->tableName);
+
+  int appendedWhere = 0;
+  for(int i = 0; i < numValueEntries; i++) {
+    int idx = 1 + (i * 4);
+    char kind = idxStr[idx + 0];
+    if(kind != VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT) {
+      continue;
+    }
 
-    if (pIdxInfo->nOrderBy) {
-      if (pIdxInfo->nOrderBy > 1) {
-        vtab_set_error(pVTab, "Only a single 'ORDER BY distance' clause is "
-                              "allowed on vec0 KNN queries");
-        rc = SQLITE_ERROR;
-      goto done;
-      }
-      if (pIdxInfo->aOrderBy[0].iColumn != vec0_column_distance_idx(p)) {
-        vtab_set_error(pVTab,
-                       "Only a single 'ORDER BY distance' clause is allowed on "
-                       "vec0 KNN queries, not on other columns");
-        rc = SQLITE_ERROR;
-      goto done;
-      }
-      if (pIdxInfo->aOrderBy[0].desc) {
-        vtab_set_error(
-            pVTab, "Only ascending in ORDER BY distance clause is supported, "
-                   "DESC is not supported yet.");
-        rc = SQLITE_ERROR;
-      goto done;
-      }
+    int partition_idx = idxStr[idx + 1] - 'A';
+    int operator = idxStr[idx + 2];
+    // idxStr[idx + 3] is just null, a '_' placeholder
+
+    if(!appendedWhere) {
+      sqlite3_str_appendall(s, " WHERE ");
+      appendedWhere = 1;
+    }else {
+      sqlite3_str_appendall(s, " AND ");
     }
+    switch(operator) {
+     case VEC0_PARTITION_OPERATOR_EQ:
+      sqlite3_str_appendf(s, " partition%02d = ? ", partition_idx);
+      break;
+     case VEC0_PARTITION_OPERATOR_GT:
+      sqlite3_str_appendf(s, " partition%02d > ? ", partition_idx);
+      break;
+     case VEC0_PARTITION_OPERATOR_LE:
+      sqlite3_str_appendf(s, " partition%02d <= ? ", partition_idx);
+      break;
+     case VEC0_PARTITION_OPERATOR_LT:
+      sqlite3_str_appendf(s, " partition%02d < ? ", partition_idx);
+      break;
+     case VEC0_PARTITION_OPERATOR_GE:
+      sqlite3_str_appendf(s, " partition%02d >= ? ", partition_idx);
+      break;
+     case VEC0_PARTITION_OPERATOR_NE:
+      sqlite3_str_appendf(s, " partition%02d != ? ", partition_idx);
+      break;
+     default: {
+      char * zSql = sqlite3_str_finish(s);
+      sqlite3_free(zSql);
+      return SQLITE_ERROR;
+     }
 
-    if(hasAuxConstraint) {
-      // IMP: V25623_09693
-      vtab_set_error(pVTab, "An illegal WHERE constraint was provided on a vec0 auxiliary column in a KNN query.");
-      rc = SQLITE_ERROR;
-      goto done;
     }
 
-    sqlite3_str_appendchar(idxStr, 1, VEC0_QUERY_PLAN_KNN);
+  }
 
-    int argvIndex = 1;
-    pIdxInfo->aConstraintUsage[iMatchTerm].argvIndex = argvIndex++;
-    pIdxInfo->aConstraintUsage[iMatchTerm].omit = 1;
-    sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_MATCH);
-    sqlite3_str_appendchar(idxStr, 3, '_');
+  char *zSql = sqlite3_str_finish(s);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
 
-    if (iLimitTerm >= 0) {
-      pIdxInfo->aConstraintUsage[iLimitTerm].argvIndex = argvIndex++;
-      pIdxInfo->aConstraintUsage[iLimitTerm].omit = 1;
-    } else {
-      pIdxInfo->aConstraintUsage[iKTerm].argvIndex = argvIndex++;
-      pIdxInfo->aConstraintUsage[iKTerm].omit = 1;
-    }
-    sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_K);
-    sqlite3_str_appendchar(idxStr, 3, '_');
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, outStmt, NULL);
+  sqlite3_free(zSql);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
 
-#if COMPILER_SUPPORTS_VTAB_IN
-    if (iRowidInTerm >= 0) {
-      // already validated as  >= SQLite 3.38 bc iRowidInTerm is only >= 0 when
-      // vtabIn == 1
-      sqlite3_vtab_in(pIdxInfo, iRowidInTerm, 1);
-      pIdxInfo->aConstraintUsage[iRowidInTerm].argvIndex = argvIndex++;
-      pIdxInfo->aConstraintUsage[iRowidInTerm].omit = 1;
-      sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_ROWID_IN);
-      sqlite3_str_appendchar(idxStr, 3, '_');
+  int n = 1;
+  for(int i = 0; i < numValueEntries; i++) {
+    int idx = 1 + (i * 4);
+    char kind = idxStr[idx + 0];
+    if(kind != VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT) {
+      continue;
     }
-#endif
+    sqlite3_bind_value(*outStmt, n++, argv[i]);
+  }
 
-    // find any PARTITION KEY column constraints
-    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-      if (!pIdxInfo->aConstraint[i].usable)
-        continue;
+  return rc;
+}
 
-      int iColumn = pIdxInfo->aConstraint[i].iColumn;
-      int op = pIdxInfo->aConstraint[i].op;
-      if(op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
-        continue;
-      }
-      if(!vec0_column_idx_is_partition(p, iColumn)) {
-        continue;
-      }
+// a single `xxx in (...)` constraint on a metadata column. TEXT or INTEGER only for now.
+struct Vec0MetadataIn{
+  // index of argv[i]` the constraint is on
+  int argv_idx;
+  // metadata column index of the constraint, derived from idxStr + argv_idx
+  int metadata_idx;
+  // array of the copied `(...)` values from sqlite3_vtab_in_first()/sqlite3_vtab_in_next()
+  struct Array array;
+  // open-addressing hash set over array, built by vec0_metadata_in_index().
+  // Each slot holds 1 + the index of a value in array, 0 when empty.
+  u32 * hashSlots;
+  u32 hashMask;
+};
 
-      int partition_idx = vec0_column_idx_to_partition_idx(p, iColumn);
-      char value = 0;
+// Array elements for `xxx in (...)` values for a text column. basically just a string
+struct Vec0MetadataInTextEntry {
+  int n;
+  char * zString;
+};
 
-      switch(op) {
-        case SQLITE_INDEX_CONSTRAINT_EQ: {
-          value = VEC0_PARTITION_OPERATOR_EQ;
-          break;
-        }
-        case SQLITE_INDEX_CONSTRAINT_GT: {
-          value = VEC0_PARTITION_OPERATOR_GT;
-          break;
-        }
-        case SQLITE_INDEX_CONSTRAINT_LE: {
-          value = VEC0_PARTITION_OPERATOR_LE;
-          break;
-        }
-        case SQLITE_INDEX_CONSTRAINT_LT: {
-          value = VEC0_PARTITION_OPERATOR_LT;
-          break;
-        }
-        case SQLITE_INDEX_CONSTRAINT_GE: {
-          value = VEC0_PARTITION_OPERATOR_GE;
-          break;
-        }
-        case SQLITE_INDEX_CONSTRAINT_NE: {
-          value = VEC0_PARTITION_OPERATOR_NE;
-          break;
-        }
-      }
+/**
+ * @brief Read the rowids of a chunk of size rows into a new array, freed by
+ * the caller with sqlite3_free().
+ */
+static int vec0_chunk_rowids_read(vec0_vtab *p, i64 chunk_rowid, i32 size,
+                                  i64 **out) {
+  sqlite3_blob *rowidsBlob;
+  int rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowChunksName,
+                             "rowids", chunk_rowid, 0, &rowidsBlob);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  if (sqlite3_blob_bytes(rowidsBlob) != size * (int)sizeof(i64)) {
+    sqlite3_blob_close(rowidsBlob);
+    return SQLITE_ERROR;
+  }
+  i64 *rowids = sqlite3_malloc(sqlite3_blob_bytes(rowidsBlob));
+  if (!rowids) {
+    sqlite3_blob_close(rowidsBlob);
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_blob_read(rowidsBlob, rowids, sqlite3_blob_bytes(rowidsBlob), 0);
+  sqlite3_blob_close(rowidsBlob);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(rowids);
+    return rc;
+  }
+  *out = rowids;
+  return SQLITE_OK;
+}
 
-      if(value) {
-        pIdxInfo->aConstraintUsage[i].argvIndex = argvIndex++;
-        pIdxInfo->aConstraintUsage[i].omit = 1;
-        sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT);
-        sqlite3_str_appendchar(idxStr, 1, 'A' + partition_idx);
-        sqlite3_str_appendchar(idxStr, 1, value);
-        sqlite3_str_appendchar(idxStr, 1, '_');
-      }
+static u64 vec0_metadata_in_hash_int(i64 value) {
+  // splitmix64 finalizer
+  u64 x = (u64)value;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
 
-    }
+// Hashes what a text metadata view holds of a string: its length and its
+// first VEC0_METADATA_TEXT_VIEW_DATA_LENGTH bytes. Long strings that share
+// both land in the same chain, and are told apart by their full value.
+static u64 vec0_metadata_in_hash_text(int n, const char *s) {
+  // FNV-1a
+  u64 h = 0xcbf29ce484222325ULL ^ (u64)(u32)n;
+  int nView = min(n, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH);
+  for (int i = 0; i < nView; i++) {
+    h = (h ^ (u8)s[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
 
-    // find any metadata column constraints
-    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-      if (!pIdxInfo->aConstraint[i].usable)
-        continue;
+/**
+ * @brief Build the hash set of an `xxx in (...)` constraint's values, so each
+ * row is checked with one probe instead of a compare against every value.
+ */
+static int vec0_metadata_in_index(struct Vec0MetadataIn *metadataIn,
+                                  vec0_metadata_column_kind kind) {
+  size_t n = metadataIn->array.length;
+  u32 capacity = 16;
+  while (capacity < 2 * n) {
+    if (capacity > (u32)INT32_MAX) {
+      return SQLITE_TOOBIG;
+    }
+    capacity *= 2;
+  }
+  metadataIn->hashSlots = sqlite3_malloc64((i64)capacity * sizeof(u32));
+  if (!metadataIn->hashSlots) {
+    return SQLITE_NOMEM;
+  }
+  memset(metadataIn->hashSlots, 0, (size_t)capacity * sizeof(u32));
+  metadataIn->hashMask = capacity - 1;
+  for (size_t i = 0; i < n; i++) {
+    u64 hash;
+    if (kind == VEC0_METADATA_COLUMN_KIND_INTEGER) {
+      hash = vec0_metadata_in_hash_int(((i64 *)metadataIn->array.z)[i]);
+    } else {
+      struct Vec0MetadataInTextEntry *entry =
+          &((struct Vec0MetadataInTextEntry *)metadataIn->array.z)[i];
+      hash = vec0_metadata_in_hash_text(entry->n, entry->zString);
+    }
+    u32 slot = (u32)hash & metadataIn->hashMask;
+    while (metadataIn->hashSlots[slot]) {
+      slot = (slot + 1) & metadataIn->hashMask;
+    }
+    metadataIn->hashSlots[slot] = (u32)i + 1;
+  }
+  return SQLITE_OK;
+}
 
-      int iColumn = pIdxInfo->aConstraint[i].iColumn;
-      int op = pIdxInfo->aConstraint[i].op;
-      if(op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
-        continue;
+/**
+ * @brief Collect into codes the dictionary codes of a `text dictionary`
+ * metadata column whose text satisfies `column op value`, so the constraint
+ * can be checked on codes alone. For = and != that's the target's own code,
+ * if it's in the dictionary. Text compares as SQLite compares TEXT values.
+ */
+static int vec0_metadata_dict_codes(vec0_vtab *p, int metadata_idx,
+                                    vec0_metadata_operator op,
+                                    sqlite3_value *value, struct Array *codes) {
+  int rc;
+  i64 code;
+  const char *zOp;
+  switch (op) {
+  case VEC0_METADATA_OPERATOR_EQ:
+  case VEC0_METADATA_OPERATOR_NE:
+    rc = vec0_metadata_dict_code(p, metadata_idx, value, 0, &code);
+    if (rc != SQLITE_OK || !code) {
+      return rc;
+    }
+    return array_append(codes, &code);
+  case VEC0_METADATA_OPERATOR_IN: {
+#if COMPILER_SUPPORTS_VTAB_IN
+    sqlite3_value *entry;
+    for (rc = sqlite3_vtab_in_first(value, &entry); rc == SQLITE_OK && entry;
+         rc = sqlite3_vtab_in_next(value, &entry)) {
+      rc = vec0_metadata_dict_code(p, metadata_idx, entry, 0, &code);
+      if (rc == SQLITE_OK && code) {
+        rc = array_append(codes, &code);
       }
-      if(!vec0_column_idx_is_metadata(p, iColumn)) {
-        continue;
+      if (rc != SQLITE_OK) {
+        return rc;
       }
+    }
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+#else
+    return SQLITE_ERROR;
+#endif
+  }
+  case VEC0_METADATA_OPERATOR_GT:
+    zOp = ">";
+    break;
+  case VEC0_METADATA_OPERATOR_LE:
+    zOp = "<=";
+    break;
+  case VEC0_METADATA_OPERATOR_LT:
+    zOp = "<";
+    break;
+  case VEC0_METADATA_OPERATOR_GE:
+    zOp = ">=";
+    break;
+  default:
+    return SQLITE_ERROR;
+  }
 
-      int metadata_idx = vec0_column_idx_to_metadata_idx(p, iColumn);
-      char value = 0;
+  sqlite3_stmt *stmt;
+  char *zSql = sqlite3_mprintf("SELECT rowid FROM " VEC0_SHADOW_METADATA_DICT_N_NAME
+                               " WHERE value %s ?",
+                               p->schemaName, p->tableName, metadata_idx, zOp);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  sqlite3_bind_value(stmt, 1, value);
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    code = sqlite3_column_int64(stmt, 0);
+    rc = array_append(codes, &code);
+    if (rc != SQLITE_OK) {
+      break;
+    }
+  }
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
 
-      switch(op) {
-        case SQLITE_INDEX_CONSTRAINT_EQ: {
-          int vtabIn = 0;
-          #if COMPILER_SUPPORTS_VTAB_IN
-          if (sqlite3_libversion_number() >= 3038000) {
-            vtabIn = sqlite3_vtab_in(pIdxInfo, i, -1);
+static int vec0_metadata_in_contains_int(const struct Vec0MetadataIn *metadataIn,
+                                         i64 value) {
+  const i64 *values = (const i64 *)metadataIn->array.z;
+  u32 slot = (u32)vec0_metadata_in_hash_int(value) & metadataIn->hashMask;
+  for (; metadataIn->hashSlots[slot];
+       slot = (slot + 1) & metadataIn->hashMask) {
+    if (values[metadataIn->hashSlots[slot] - 1] == value) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Clear the bits of the candidate bitmap b whose value isn't in the
+ * `xxx in (...)` list of metadataIn. Only candidates are probed, and the full
+ * value of a long string is only read when a listed value shares its length
+ * and prefix.
+ */
+static int vec0_metadata_filter_in(vec0_vtab *p,
+                                   const struct Vec0MetadataIn *metadataIn,
+                                   vec0_metadata_column_kind kind,
+                                   const void *buffer, i32 size, u8 *b,
+                                   i64 chunk_rowid) {
+  int rc = SQLITE_OK;
+  sqlite3_stmt *stmt = NULL;
+  i64 *rowids = NULL;
+  const struct Vec0MetadataInTextEntry *entries =
+      (const struct Vec0MetadataInTextEntry *)metadataIn->array.z;
+
+  for (i32 word_start = 0; word_start < size; word_start += 64) {
+    u64 word = bitmap_word64(b, size, word_start);
+    for (u64 bits = word; bits; bits &= bits - 1) {
+      int j = vec0_ctz64(bits);
+      i32 i = word_start + j;
+      int found = 0;
+      if (kind == VEC0_METADATA_COLUMN_KIND_INTEGER) {
+        found = vec0_metadata_in_contains_int(metadataIn,
+                                              ((const i64 *)buffer)[i]);
+      } else {
+        const u8 *view =
+            &((const u8 *)buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        int n = ((const int *)view)[0];
+        const char *prefix = (const char *)&view[4];
+        int nView = min(n, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH);
+        const char *sFull = NULL;
+        int nFull;
+        u32 slot = (u32)vec0_metadata_in_hash_text(n, prefix) &
+                   metadataIn->hashMask;
+        for (; metadataIn->hashSlots[slot] && !found;
+             slot = (slot + 1) & metadataIn->hashMask) {
+          const struct Vec0MetadataInTextEntry *entry =
+              &entries[metadataIn->hashSlots[slot] - 1];
+          if (entry->n != n || memcmp(entry->zString, prefix, nView) != 0) {
+            continue;
           }
-          if(vtabIn) {
-            switch(p->metadata_columns[metadata_idx].kind) {
-              case VEC0_METADATA_COLUMN_KIND_FLOAT:
-              case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
-                // IMP: V15248_32086
-                rc = SQLITE_ERROR;
-                vtab_set_error(pVTab, "'xxx in (...)' is only available on INTEGER or TEXT metadata columns.");
+          if (n <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+            found = 1;
+            continue;
+          }
+          // consult the full string, once per row
+          if (!sFull) {
+            if (!rowids) {
+              rc = vec0_chunk_rowids_read(p, chunk_rowid, size, &rowids);
+              if (rc != SQLITE_OK) {
                 goto done;
-                break;
-              }
-              case VEC0_METADATA_COLUMN_KIND_INTEGER:
-              case VEC0_METADATA_COLUMN_KIND_TEXT: {
-                break;
               }
             }
-            value = VEC0_METADATA_OPERATOR_IN;
-            sqlite3_vtab_in(pIdxInfo, i, 1);
-          }else
-          #endif
-           {
-            value = VEC0_PARTITION_OPERATOR_EQ;
+            rc = vec0_get_metadata_text_long_value(
+                p, &stmt, metadataIn->metadata_idx, rowids[i], &nFull,
+                (char **)&sFull);
+            if (rc != SQLITE_OK) {
+              goto done;
+            }
+            if (nFull != n) {
+              rc = SQLITE_ERROR;
+              goto done;
+            }
           }
-          break;
-        }
-        case SQLITE_INDEX_CONSTRAINT_GT: {
-          value = VEC0_METADATA_OPERATOR_GT;
-          break;
+          found = memcmp(sFull, entry->zString, n) == 0;
         }
-        case SQLITE_INDEX_CONSTRAINT_LE: {
-          value = VEC0_METADATA_OPERATOR_LE;
-          break;
+      }
+      if (!found) {
+        word &= ~((u64)1 << j);
+      }
+    }
+    bitmap_word64_store(b, size, word_start, word);
+  }
+
+done:
+  sqlite3_finalize(stmt);
+  sqlite3_free(rowids);
+  return rc;
+}
+
+
+int vec0_metadata_filter_text(vec0_vtab * p, sqlite3_value * value, const void * buffer, int size, vec0_metadata_operator op, u8* b, int metadata_idx, int chunk_rowid) {
+  int rc;
+  sqlite3_stmt * stmt = NULL;
+  i64 * rowids = NULL;
+  const char * sTarget = (const char *) sqlite3_value_text(value);
+  int nTarget = sqlite3_value_bytes(value);
+
+
+  // TODO(perf): only text metadata news the rowids BLOB. Make it so that
+  // rowids BLOB is re-used when multiple fitlers on text columns,
+  // ex "name BETWEEN 'a' and 'b'""
+  rc = vec0_chunk_rowids_read(p, chunk_rowid, size, &rowids);
+  if(rc != SQLITE_OK) {
+    return rc;
+  }
+
+  switch(op) {
+    int nPrefix;
+    char * sPrefix;
+    char *sFull;
+    int nFull;
+    u8 * view;
+    case VEC0_METADATA_OPERATOR_EQ: {
+      for(int i = 0; i < size; i++) {
+        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        nPrefix = ((int*) view)[0];
+        sPrefix = (char *) &view[4];
+
+        // for EQ the text lengths must match
+        if(nPrefix != nTarget) {
+          bitmap_set(b, i, 0);
+          continue;
         }
-        case SQLITE_INDEX_CONSTRAINT_LT: {
-          value = VEC0_METADATA_OPERATOR_LT;
-          break;
+        int cmpPrefix = strncmp(sPrefix, sTarget, min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH));
+
+        // for short strings, use the prefix comparison direclty
+        if(nPrefix <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          bitmap_set(b, i, cmpPrefix == 0);
+          continue;
         }
-        case SQLITE_INDEX_CONSTRAINT_GE: {
-          value = VEC0_METADATA_OPERATOR_GE;
-          break;
+        // for EQ on longs strings, the prefix must match
+        if(cmpPrefix) {
+          bitmap_set(b, i, 0);
+          continue;
         }
-        case SQLITE_INDEX_CONSTRAINT_NE: {
-          value = VEC0_METADATA_OPERATOR_NE;
-          break;
+        // consult the full string
+        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
+        if(rc != SQLITE_OK) {
+          goto done;
         }
-        default: {
-          // IMP: V16511_00582
+        if(nPrefix != nFull) {
           rc = SQLITE_ERROR;
-          vtab_set_error(pVTab,
-          "An illegal WHERE constraint was provided on a vec0 metadata column in a KNN query. "
-          "Only one of EQUALS, GREATER_THAN, LESS_THAN_OR_EQUAL, LESS_THAN, GREATER_THAN_OR_EQUAL, NOT_EQUALS is allowed."
-          );
           goto done;
         }
+        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) == 0);
       }
+      break;
+    }
+    case VEC0_METADATA_OPERATOR_NE: {
+      for(int i = 0; i < size; i++) {
+        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        nPrefix = ((int*) view)[0];
+        sPrefix = (char *) &view[4];
 
-      if(p->metadata_columns[metadata_idx].kind == VEC0_METADATA_COLUMN_KIND_BOOLEAN) {
-        if(!(value == VEC0_METADATA_OPERATOR_EQ || value == VEC0_METADATA_OPERATOR_NE)) {
-          // IMP: V10145_26984
+        // for NE if text lengths dont match, it never will
+        if(nPrefix != nTarget) {
+          bitmap_set(b, i, 1);
+          continue;
+        }
+
+        int cmpPrefix = strncmp(sPrefix, sTarget, min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH));
+
+        // for short strings, use the prefix comparison direclty
+        if(nPrefix <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          bitmap_set(b, i, cmpPrefix != 0);
+          continue;
+        }
+        // for NE on longs strings, if prefixes dont match, then long string wont
+        if(cmpPrefix) {
+          bitmap_set(b, i, 1);
+          continue;
+        }
+        // consult the full string
+        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        if(nPrefix != nFull) {
           rc = SQLITE_ERROR;
-          vtab_set_error(pVTab, "ONLY EQUALS (=) or NOT_EQUALS (!=) operators are allowed on boolean metadata columns.");
           goto done;
         }
+        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) != 0);
       }
-
-      pIdxInfo->aConstraintUsage[i].argvIndex = argvIndex++;
-      pIdxInfo->aConstraintUsage[i].omit = 1;
-      sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_METADATA_CONSTRAINT);
-      sqlite3_str_appendchar(idxStr, 1, 'A' + metadata_idx);
-      sqlite3_str_appendchar(idxStr, 1, value);
-      sqlite3_str_appendchar(idxStr, 1, '_');
-
+      break;
     }
+    case VEC0_METADATA_OPERATOR_GT: {
+      for(int i = 0; i < size; i++) {
+        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        nPrefix = ((int*) view)[0];
+        sPrefix = (char *) &view[4];
+        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
 
-    // find any distance column constraints
-    for (int i = 0; i < pIdxInfo->nConstraint; i++) {
-      if (!pIdxInfo->aConstraint[i].usable)
-        continue;
+        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          // if prefix match, check which is longer
+          if(cmpPrefix == 0) {
+            bitmap_set(b, i, nPrefix > nTarget);
+          }
+          else {
+            bitmap_set(b, i, cmpPrefix > 0);
+          }
+          continue;
+        }
+        // TODO(perf): may not need to compare full text in some cases
 
-      int iColumn = pIdxInfo->aConstraint[i].iColumn;
-      int op = pIdxInfo->aConstraint[i].op;
-      if(op == SQLITE_INDEX_CONSTRAINT_LIMIT || op == SQLITE_INDEX_CONSTRAINT_OFFSET) {
-        continue;
-      }
-      if(vec0_column_distance_idx(p) != iColumn) {
-        continue;
+        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        if(nPrefix != nFull) {
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) > 0);
       }
+      break;
+    }
+    case VEC0_METADATA_OPERATOR_GE: {
+      for(int i = 0; i < size; i++) {
+        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        nPrefix = ((int*) view)[0];
+        sPrefix = (char *) &view[4];
+        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
 
-      char value = 0;
-      switch(op) {
-        case SQLITE_INDEX_CONSTRAINT_GT: {
-          value = VEC0_DISTANCE_CONSTRAINT_GT;
-          break;
+        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          // if prefix match, check which is longer
+          if(cmpPrefix == 0) {
+            bitmap_set(b, i, nPrefix >= nTarget);
+          }
+          else {
+            bitmap_set(b, i, cmpPrefix >= 0);
+          }
+          continue;
         }
-        case SQLITE_INDEX_CONSTRAINT_GE: {
-          value = VEC0_DISTANCE_CONSTRAINT_GE;
-          break;
+        // TODO(perf): may not need to compare full text in some cases
+
+        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
+        if(rc != SQLITE_OK) {
+          goto done;
         }
-        case SQLITE_INDEX_CONSTRAINT_LT: {
-          value = VEC0_DISTANCE_CONSTRAINT_LT;
-          break;
+        if(nPrefix != nFull) {
+          rc = SQLITE_ERROR;
+          goto done;
         }
-        case SQLITE_INDEX_CONSTRAINT_LE: {
-          value = VEC0_DISTANCE_CONSTRAINT_LE;
-          break;
+        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) >= 0);
+      }
+      break;
+    }
+    case VEC0_METADATA_OPERATOR_LE: {
+      for(int i = 0; i < size; i++) {
+        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        nPrefix = ((int*) view)[0];
+        sPrefix = (char *) &view[4];
+        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
+
+        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          // if prefix match, check which is longer
+          if(cmpPrefix == 0) {
+            bitmap_set(b, i, nPrefix <= nTarget);
+          }
+          else {
+            bitmap_set(b, i, cmpPrefix <= 0);
+          }
+          continue;
         }
-        default: {
-          // IMP TODO
+        // TODO(perf): may not need to compare full text in some cases
+
+        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        if(nPrefix != nFull) {
           rc = SQLITE_ERROR;
-          vtab_set_error(
-            pVTab, 
-            "Illegal WHERE constraint on distance column in a KNN query. "
-            "Only one of GT, GE, LT, LE constraints are allowed."
-          );
           goto done;
         }
+        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) <= 0);
       }
-
-      pIdxInfo->aConstraintUsage[i].argvIndex = argvIndex++;
-      pIdxInfo->aConstraintUsage[i].omit = 1;
-      sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT);
-      sqlite3_str_appendchar(idxStr, 1, value);
-      sqlite3_str_appendchar(idxStr, 1, '_');
-      sqlite3_str_appendchar(idxStr, 1, '_');
+      break;
     }
+    case VEC0_METADATA_OPERATOR_LT: {
+      for(int i = 0; i < size; i++) {
+        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
+        nPrefix = ((int*) view)[0];
+        sPrefix = (char *) &view[4];
+        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
 
+        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          // if prefix match, check which is longer
+          if(cmpPrefix == 0) {
+            bitmap_set(b, i, nPrefix < nTarget);
+          }
+          else {
+            bitmap_set(b, i, cmpPrefix < 0);
+          }
+          continue;
+        }
+        // TODO(perf): may not need to compare full text in some cases
 
-
-    pIdxInfo->idxNum = iMatchVectorTerm;
-    pIdxInfo->estimatedCost = 30.0;
-    pIdxInfo->estimatedRows = 10;
-
-  } else if (iRowidTerm >= 0) {
-    sqlite3_str_appendchar(idxStr, 1, VEC0_QUERY_PLAN_POINT);
-    pIdxInfo->aConstraintUsage[iRowidTerm].argvIndex = 1;
-    pIdxInfo->aConstraintUsage[iRowidTerm].omit = 1;
-    sqlite3_str_appendchar(idxStr, 1, VEC0_IDXSTR_KIND_POINT_ID);
-    sqlite3_str_appendchar(idxStr, 3, '_');
-    pIdxInfo->idxNum = pIdxInfo->colUsed;
-    pIdxInfo->estimatedCost = 10.0;
-    pIdxInfo->estimatedRows = 1;
-  } else {
-    sqlite3_str_appendchar(idxStr, 1, VEC0_QUERY_PLAN_FULLSCAN);
-    pIdxInfo->estimatedCost = 3000000.0;
-    pIdxInfo->estimatedRows = 100000;
-  }
-  pIdxInfo->idxStr = sqlite3_str_finish(idxStr);
-  idxStr = NULL;
-  if (!pIdxInfo->idxStr) {
-    rc = SQLITE_OK;
-    goto done;
+        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        if(nPrefix != nFull) {
+          rc = SQLITE_ERROR;
+          goto done;
+        }
+        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) < 0);
+      }
+      break;
+    }
+    case VEC0_METADATA_OPERATOR_IN: {
+      // handled by vec0_metadata_filter_in()
+      break;
+    }
   }
-  pIdxInfo->needToFreeIdxStr = 1;
-
   rc = SQLITE_OK;
 
   done:
-    if(idxStr) {
-      sqlite3_str_finish(idxStr);
-    }
+    sqlite3_finalize(stmt);
+    sqlite3_free(rowids);
     return rc;
-}
 
-// forward delcaration bc vec0Filter uses it
-static int vec0Next(sqlite3_vtab_cursor *cur);
+}
 
-void merge_sorted_lists(f32 *a, i64 *a_rowids, i64 a_length, f32 *b,
-                        i64 *b_rowids, i32 *b_top_idxs, i64 b_length, f32 *out,
-                        i64 *out_rowids, i64 out_length, i64 *out_used) {
-  // assert((a_length >= out_length) || (b_length >= out_length));
-  i64 ptrA = 0;
-  i64 ptrB = 0;
-  for (int i = 0; i < out_length; i++) {
-    if ((ptrA >= a_length) && (ptrB >= b_length)) {
-      *out_used = i;
-      return;
-    }
-    if (ptrA >= a_length) {
-      out[i] = b[b_top_idxs[ptrB]];
-      out_rowids[i] = b_rowids[b_top_idxs[ptrB]];
-      ptrB++;
-    } else if (ptrB >= b_length) {
-      out[i] = a[ptrA];
-      out_rowids[i] = a_rowids[ptrA];
-      ptrA++;
-    } else {
-      if (a[ptrA] <= b[b_top_idxs[ptrB]]) {
-        out[i] = a[ptrA];
-        out_rowids[i] = a_rowids[ptrA];
-        ptrA++;
-      } else {
-        out[i] = b[b_top_idxs[ptrB]];
-        out_rowids[i] = b_rowids[b_top_idxs[ptrB]];
-        ptrB++;
-      }
-    }
-  }
+// Bit i of the result is set when `values[i] op target` holds, for the
+// n <= 64 values. op is any metadata operator but IN.
+#define VEC0_METADATA_MASK_SCALAR(values, n, op, target, mask)                 \
+  do {                                                                         \
+    switch (op) {                                                              \
+    case VEC0_METADATA_OPERATOR_EQ:                                            \
+      for (i32 i = 0; i < (n); i++)                                            \
+        (mask) |= (u64)((values)[i] == (target)) << i;                         \
+      break;                                                                   \
+    case VEC0_METADATA_OPERATOR_NE:                                            \
+      for (i32 i = 0; i < (n); i++)                                            \
+        (mask) |= (u64)((values)[i] != (target)) << i;                         \
+      break;                                                                   \
+    case VEC0_METADATA_OPERATOR_GT:                                            \
+      for (i32 i = 0; i < (n); i++)                                            \
+        (mask) |= (u64)((values)[i] > (target)) << i;                          \
+      break;                                                                   \
+    case VEC0_METADATA_OPERATOR_GE:                                            \
+      for (i32 i = 0; i < (n); i++)                                            \
+        (mask) |= (u64)((values)[i] >= (target)) << i;                         \
+      break;                                                                   \
+    case VEC0_METADATA_OPERATOR_LT:                                            \
+      for (i32 i = 0; i < (n); i++)                                            \
+        (mask) |= (u64)((values)[i] < (target)) << i;                          \
+      break;                                                                   \
+    case VEC0_METADATA_OPERATOR_LE:                                            \
+      for (i32 i = 0; i < (n); i++)                                            \
+        (mask) |= (u64)((values)[i] <= (target)) << i;                         \
+      break;                                                                   \
+    case VEC0_METADATA_OPERATOR_IN:                                            \
+      break;                                                                   \
+    }                                                                          \
+  } while (0)
+
+static u64 metadata_mask_i64_scalar(const i64 *values, i32 n,
+                                    vec0_metadata_operator op, i64 target) {
+  u64 mask = 0;
+  VEC0_METADATA_MASK_SCALAR(values, n, op, target, mask);
+  return mask;
+}
 
-  *out_used = out_length;
+static u64 metadata_mask_f64_scalar(const double *values, i32 n,
+                                    vec0_metadata_operator op, double target) {
+  u64 mask = 0;
+  VEC0_METADATA_MASK_SCALAR(values, n, op, target, mask);
+  return mask;
 }
 
-u8 *bitmap_new(i32 n) {
-  assert(n % 8 == 0);
-  u8 *p = sqlite3_malloc(n * sizeof(u8) / CHAR_BIT);
-  if (p) {
-    memset(p, 0, n * sizeof(u8) / CHAR_BIT);
+#ifdef SQLITE_VEC_ENABLE_AVX
+// metadata_mask_i64_scalar() for exactly 64 values, 4 compares at a time.
+// AVX2 only has == and > on 64-bit integers, the other operators are their
+// complements.
+SQLITE_VEC_TARGET_AVX2
+static u64 metadata_mask64_i64_avx2(const i64 *values,
+                                    vec0_metadata_operator op, i64 target) {
+  __m256i t = _mm256_set1_epi64x(target);
+  u64 mask = 0;
+#define VEC0_MASK_EPI64(cmp)                                                   \
+  for (i32 i = 0; i < 64; i += 4) {                                            \
+    __m256i v = _mm256_loadu_si256((const __m256i *)(values + i));             \
+    mask |= (u64)_mm256_movemask_pd(_mm256_castsi256_pd(cmp)) << i;            \
+  }
+  switch (op) {
+  case VEC0_METADATA_OPERATOR_EQ:
+  case VEC0_METADATA_OPERATOR_NE:
+    VEC0_MASK_EPI64(_mm256_cmpeq_epi64(v, t));
+    break;
+  case VEC0_METADATA_OPERATOR_GT:
+  case VEC0_METADATA_OPERATOR_LE:
+    VEC0_MASK_EPI64(_mm256_cmpgt_epi64(v, t));
+    break;
+  case VEC0_METADATA_OPERATOR_LT:
+  case VEC0_METADATA_OPERATOR_GE:
+    VEC0_MASK_EPI64(_mm256_cmpgt_epi64(t, v));
+    break;
+  case VEC0_METADATA_OPERATOR_IN:
+    break;
   }
-  return p;
-}
-u8 *bitmap_new_from(i32 n, u8 *from) {
-  assert(n % 8 == 0);
-  u8 *p = sqlite3_malloc(n * sizeof(u8) / CHAR_BIT);
-  if (p) {
-    memcpy(p, from, n / CHAR_BIT);
+#undef VEC0_MASK_EPI64
+  if (op == VEC0_METADATA_OPERATOR_NE || op == VEC0_METADATA_OPERATOR_LE ||
+      op == VEC0_METADATA_OPERATOR_GE) {
+    mask = ~mask;
   }
-  return p;
-}
-
-void bitmap_copy(u8 *base, u8 *from, i32 n) {
-  assert(n % 8 == 0);
-  memcpy(base, from, n / CHAR_BIT);
+  return mask;
 }
 
-void bitmap_and_inplace(u8 *base, u8 *other, i32 n) {
-  assert((n % 8) == 0);
-  for (int i = 0; i < n / CHAR_BIT; i++) {
-    base[i] = base[i] & other[i];
+// metadata_mask_f64_scalar() for exactly 64 values, 4 compares at a time.
+SQLITE_VEC_TARGET_AVX2
+static u64 metadata_mask64_f64_avx2(const double *values,
+                                    vec0_metadata_operator op, double target) {
+  __m256d t = _mm256_set1_pd(target);
+  u64 mask = 0;
+#define VEC0_MASK_PD(predicate)                                                \
+  for (i32 i = 0; i < 64; i += 4) {                                            \
+    __m256d v = _mm256_loadu_pd(values + i);                                   \
+    mask |= (u64)_mm256_movemask_pd(_mm256_cmp_pd(v, t, predicate)) << i;      \
+  }
+  // ordered predicates, except != which like C is true for NaN
+  switch (op) {
+  case VEC0_METADATA_OPERATOR_EQ:
+    VEC0_MASK_PD(_CMP_EQ_OQ);
+    break;
+  case VEC0_METADATA_OPERATOR_NE:
+    VEC0_MASK_PD(_CMP_NEQ_UQ);
+    break;
+  case VEC0_METADATA_OPERATOR_GT:
+    VEC0_MASK_PD(_CMP_GT_OQ);
+    break;
+  case VEC0_METADATA_OPERATOR_GE:
+    VEC0_MASK_PD(_CMP_GE_OQ);
+    break;
+  case VEC0_METADATA_OPERATOR_LT:
+    VEC0_MASK_PD(_CMP_LT_OQ);
+    break;
+  case VEC0_METADATA_OPERATOR_LE:
+    VEC0_MASK_PD(_CMP_LE_OQ);
+    break;
+  case VEC0_METADATA_OPERATOR_IN:
+    break;
   }
+#undef VEC0_MASK_PD
+  return mask;
 }
+#endif
 
-void bitmap_set(u8 *bitmap, i32 position, int value) {
-  if (value) {
-    bitmap[position / CHAR_BIT] |= 1 << (position % CHAR_BIT);
-  } else {
-    bitmap[position / CHAR_BIT] &= ~(1 << (position % CHAR_BIT));
+static u64 metadata_mask_i64(const i64 *values, i32 n,
+                             vec0_metadata_operator op, i64 target) {
+#ifdef SQLITE_VEC_ENABLE_AVX
+  if (n == 64 && vec0_kernels.level >= VEC0_SIMD_AVX2) {
+    return metadata_mask64_i64_avx2(values, op, target);
   }
+#endif
+  return metadata_mask_i64_scalar(values, n, op, target);
 }
 
-int bitmap_get(u8 *bitmap, i32 position) {
-  return (((bitmap[position / CHAR_BIT]) >> (position % CHAR_BIT)) & 1);
+static u64 metadata_mask_f64(const double *values, i32 n,
+                             vec0_metadata_operator op, double target) {
+#ifdef SQLITE_VEC_ENABLE_AVX
+  if (n == 64 && vec0_kernels.level >= VEC0_SIMD_AVX2) {
+    return metadata_mask64_f64_avx2(values, op, target);
+  }
+#endif
+  return metadata_mask_f64_scalar(values, n, op, target);
 }
 
-void bitmap_clear(u8 *bitmap, i32 n) {
-  assert((n % 8) == 0);
-  memset(bitmap, 0, n / CHAR_BIT);
+/**
+ * @brief Clear the bits of the candidate bitmap b whose integer or float
+ * metadata value fails `value op target`, 64 rows at a time. Words with no
+ * candidates left aren't compared. INTEGER columns compare with targetInt,
+ * FLOAT columns with targetFloat.
+ */
+static void vec0_metadata_filter_numeric(u8 *b, i32 size,
+                                         vec0_metadata_column_kind kind,
+                                         const void *values,
+                                         vec0_metadata_operator op,
+                                         i64 targetInt, double targetFloat) {
+  for (i32 word_start = 0; word_start < size; word_start += 64) {
+    u64 word = bitmap_word64(b, size, word_start);
+    if (!word) {
+      continue;
+    }
+    i32 n = min(size - word_start, 64);
+    if (kind == VEC0_METADATA_COLUMN_KIND_INTEGER) {
+      word &= metadata_mask_i64((const i64 *)values + word_start, n, op,
+                                targetInt);
+    } else {
+      word &= metadata_mask_f64((const double *)values + word_start, n, op,
+                                targetFloat);
+    }
+    bitmap_word64_store(b, size, word_start, word);
+  }
 }
 
-void bitmap_fill(u8 *bitmap, i32 n) {
-  assert((n % 8) == 0);
-  memset(bitmap, 0xFF, n / CHAR_BIT);
+#ifdef SQLITE_VEC_TEST
+void _test_metadata_filter_numeric(u8 *b, i32 size, int isFloat,
+                                   const void *values, char op, i64 targetInt,
+                                   double targetFloat) {
+  vec0_metadata_filter_numeric(b, size,
+                               isFloat ? VEC0_METADATA_COLUMN_KIND_FLOAT
+                                       : VEC0_METADATA_COLUMN_KIND_INTEGER,
+                               values, (vec0_metadata_operator)op, targetInt,
+                               targetFloat);
 }
+#endif
 
 /**
- * @brief Finds the minimum k items in distances, and writes the indicies to
- * out.
+ * @brief Clear the bits of a chunk's candidate bitmap whose values don't match a metadata constraint
  *
- * @param distances input f32 array of size n, the items to consider.
- * @param n: size of distances array.
- * @param out: Output array of size k, will contain at most k element indicies
- * @param k: Size of output array
- * @return int
+ * @param p vec0_vtab
+ * @param metadata_idx index of the metatadata column to perfrom constraints on
+ * @param value sqlite3_value of the constraints value
+ * @param blob sqlite3_blob that is already opened on the metdata column's shadow chunk table
+ * @param chunk_rowid rowid of the chunk to calculate on
+ * @param b bitmap of the chunk's candidate rows, ANDed with the constraint in place
+ * @param scratch caller-owned bitmap of size bits, for TEXT constraints
+ * @param size size of the chunk
+ * @param buffer caller-owned space of at least
+ *   size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH bytes (the widest metadata
+ *   kind), that the chunk's values are read into. Reused across chunks.
+ * @return int SQLITE_OK on success, error code otherwise
  */
-int min_idx(const f32 *distances, i32 n, u8 *candidates, i32 *out, i32 k,
-            u8 *bTaken, i32 *k_used) {
-  assert(k > 0);
-  assert(k <= n);
-
-#ifdef SQLITE_VEC_EXPERIMENTAL_MIN_IDX
-  // Max-heap variant: O(n log k) single-pass.
-  // out[0..heap_size-1] stores indices; heap ordered by distances descending
-  // so out[0] is always the index of the LARGEST distance in the top-k.
-  (void)bTaken;
-  int heap_size = 0;
-
-  #define HEAP_SIFT_UP(pos) do {                          \
-    int _c = (pos);                                       \
-    while (_c > 0) {                                      \
-      int _p = (_c - 1) / 2;                              \
-      if (distances[out[_p]] < distances[out[_c]]) {      \
-        i32 _tmp = out[_p]; out[_p] = out[_c]; out[_c] = _tmp; \
-        _c = _p;                                          \
-      } else break;                                       \
-    }                                                     \
-  } while(0)
-
-  #define HEAP_SIFT_DOWN(pos, sz) do {                    \
-    int _p = (pos);                                       \
-    for (;;) {                                            \
-      int _l = 2*_p + 1, _r = 2*_p + 2, _largest = _p;  \
-      if (_l < (sz) && distances[out[_l]] > distances[out[_largest]]) \
-        _largest = _l;                                    \
-      if (_r < (sz) && distances[out[_r]] > distances[out[_largest]]) \
-        _largest = _r;                                    \
-      if (_largest == _p) break;                          \
-      i32 _tmp = out[_p]; out[_p] = out[_largest]; out[_largest] = _tmp; \
-      _p = _largest;                                      \
-    }                                                     \
-  } while(0)
-
-  for (int i = 0; i < n; i++) {
-    if (!bitmap_get(candidates, i))
-      continue;
-    if (heap_size < k) {
-      out[heap_size] = i;
-      heap_size++;
-      HEAP_SIFT_UP(heap_size - 1);
-    } else if (distances[i] < distances[out[0]]) {
-      out[0] = i;
-      HEAP_SIFT_DOWN(0, heap_size);
-    }
-  }
+int vec0_set_metadata_filter_bitmap(
+  vec0_vtab *p,
+  int metadata_idx,
+  vec0_metadata_operator op,
+  sqlite3_value * value,
+  sqlite3_blob * blob,
+  i64 chunk_rowid,
+  u8* b,
+  u8* scratch,
+  int size,
+  void * buffer,
+  struct Array * aMetadataIn, int argv_idx) {
 
-  // Heapsort to produce ascending order.
-  for (int i = heap_size - 1; i > 0; i--) {
-    i32 tmp = out[0]; out[0] = out[i]; out[i] = tmp;
-    HEAP_SIFT_DOWN(0, i);
+  int rc;
+  rc = sqlite3_blob_reopen(blob, chunk_rowid);
+  if(rc != SQLITE_OK) {
+    return rc;
   }
 
-  #undef HEAP_SIFT_UP
-  #undef HEAP_SIFT_DOWN
-
-  *k_used = heap_size;
-  return SQLITE_OK;
-
-#else
-  // Original: O(n*k) repeated linear scan with bitmap.
-  bitmap_clear(bTaken, n);
-
-  for (int ik = 0; ik < k; ik++) {
-    int min_idx = 0;
-    while (min_idx < n &&
-           (bitmap_get(bTaken, min_idx) || !bitmap_get(candidates, min_idx))) {
-      min_idx++;
+  vec0_metadata_column_kind kind = vec0_metadata_storage_kind(&p->metadata_columns[metadata_idx]);
+  int szMatch = 0;
+  int blobSize = sqlite3_blob_bytes(blob);
+  switch(kind) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+      szMatch = blobSize == size / CHAR_BIT;
+      break;
     }
-    if (min_idx >= n) {
-      *k_used = ik;
-      return SQLITE_OK;
+    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
+      szMatch = blobSize == size * sizeof(i64);
+      break;
     }
-
-    for (int i = 0; i < n; i++) {
-      if (distances[i] <= distances[min_idx] && !bitmap_get(bTaken, i) &&
-          (bitmap_get(candidates, i))) {
-        min_idx = i;
-      }
+    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
+      szMatch = blobSize == size * sizeof(double);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      szMatch = blobSize == size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+      break;
     }
-
-    out[ik] = min_idx;
-    bitmap_set(bTaken, min_idx, 1);
   }
-  *k_used = k;
-  return SQLITE_OK;
-#endif
-}
-
-int vec0_get_metadata_text_long_value(
-  vec0_vtab * p,
-  sqlite3_stmt ** stmt,
-  int metadata_idx,
-  i64 rowid,
-  int *n,
-  char ** s) {
-  int rc;
-  if(!(*stmt)) {
-    const char * zSql = sqlite3_mprintf("select data from " VEC0_SHADOW_METADATA_TEXT_DATA_NAME " where rowid = ?", p->schemaName, p->tableName, metadata_idx);
-    if(!zSql) {
-      rc = SQLITE_NOMEM;
+  if(!szMatch) {
+    return SQLITE_ERROR;
+  }
+  rc = sqlite3_blob_read(blob, buffer, blobSize, 0);
+  if(rc != SQLITE_OK) {
+    goto done;
+  }
+  int dictionary = p->metadata_columns[metadata_idx].dictionary;
+  if(op == VEC0_METADATA_OPERATOR_IN || dictionary) {
+    struct Vec0MetadataIn * metadataIn = NULL;
+    for(size_t i = 0; aMetadataIn && i < aMetadataIn->length; i++) {
+      if(((struct Vec0MetadataIn *) aMetadataIn->z)[i].argv_idx == argv_idx) {
+        metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[i];
+        break;
+      }
+    }
+    if(!metadataIn) {
+      rc = SQLITE_ERROR;
       goto done;
     }
-    rc = sqlite3_prepare_v2(p->db, zSql, -1, stmt, NULL);
-    sqlite3_free( (void *) zSql);
-    if(rc != SQLITE_OK) {
+    // dictionary columns compare codes: = and != against the target's code
+    // (when it has one), every other operator through the set of codes that
+    // satisfy it
+    if(dictionary && (op == VEC0_METADATA_OPERATOR_EQ || op == VEC0_METADATA_OPERATOR_NE)) {
+      if(metadataIn->array.length == 0) {
+        if(op == VEC0_METADATA_OPERATOR_EQ) {
+          bitmap_clear(b, size);
+        }
+      }else {
+        vec0_metadata_filter_numeric(b, size, kind, buffer, op,
+                                     ((i64 *) metadataIn->array.z)[0], 0);
+      }
       goto done;
     }
-  }
-
-  sqlite3_reset(*stmt);
-  sqlite3_bind_int64(*stmt, 1, rowid);
-  rc = sqlite3_step(*stmt);
-  if(rc != SQLITE_ROW) {
-    rc = SQLITE_ERROR;
+    rc = vec0_metadata_filter_in(p, metadataIn, kind, buffer, size, b, chunk_rowid);
     goto done;
   }
-  *s = (char *) sqlite3_column_text(*stmt, 0);
-  *n = sqlite3_column_bytes(*stmt, 0);
-  rc = SQLITE_OK;
+  switch(kind) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+      int target = sqlite3_value_int(value);
+      int want = (target && op == VEC0_METADATA_OPERATOR_EQ) || (!target && op == VEC0_METADATA_OPERATOR_NE);
+      for(i32 word_start = 0; word_start < size; word_start += 64) {
+        u64 values = bitmap_word64((u8*) buffer, size, word_start);
+        u64 word = bitmap_word64(b, size, word_start) & (want ? values : ~values);
+        bitmap_word64_store(b, size, word_start, word);
+      }
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
+      vec0_metadata_filter_numeric(b, size, kind, buffer, op,
+                                   sqlite3_value_int64(value), 0);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
+      vec0_metadata_filter_numeric(b, size, kind, buffer, op, 0,
+                                   sqlite3_value_double(value));
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      bitmap_clear(scratch, size);
+      rc = vec0_metadata_filter_text(p, value, buffer, size, op, scratch, metadata_idx, chunk_rowid);
+      if(rc != SQLITE_OK) {
+        goto done;
+      }
+      bitmap_and_inplace(b, scratch, size);
+      break;
+    }
+  }
   done:
     return rc;
 }
 
 /**
- * @brief Crete at "iterator" (sqlite3_stmt) of chunks with the given constraints
- *
- * Any VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT values in idxStr/argv will be applied
- * as WHERE constraints in the underlying stmt SQL, and any consumer of the stmt
- * can freely step through the stmt with all constraints satisfied.
+ * @brief Whether no row of a chunk can satisfy `column op value`, judged from
+ * the chunk's value range in _metadataboundsNN alone.
  *
- * @param p - vec0_vtab
- * @param idxStr - the xBestIndex/xFilter idxstr containing VEC0_IDXSTR values
- * @param argc - number of argv values from xFilter
- * @param argv - array of sqlite3_value from xFilter
- * @param outStmt - output sqlite3_stmt of chunks with all filters applied
- * @return int SQLITE_OK on success, error code otherwise
+ * Targets are converted like vec0_set_metadata_filter_bitmap() converts them,
+ * so a chunk is only ruled out when the filter would clear all of its rows.
+ * IN constraints and chunks without a stored range are never ruled out.
  */
-int vec0_chunks_iter(vec0_vtab * p, const char * idxStr, int argc, sqlite3_value ** argv, sqlite3_stmt** outStmt) {
-  // always null terminated, enforced by SQLite
-  int idxStrLength = strlen(idxStr);
-  // "1" refers to the initial vec0_query_plan char, 4 is the number of chars per "element"
-  int numValueEntries = (idxStrLength-1) / 4;
-  assert(argc == numValueEntries);
-
+static int vec0_metadata_bounds_exclude(vec0_vtab *p, int metadata_idx,
+                                        vec0_metadata_operator op,
+                                        sqlite3_value *value, i64 chunk_id,
+                                        int *excluded) {
   int rc;
-  sqlite3_str * s = sqlite3_str_new(NULL);
-  sqlite3_str_appendf(s, "select chunk_id, validity, rowids "
-                         " from " VEC0_SHADOW_CHUNKS_NAME,
-                         p->schemaName, p->tableName);
-
-  int appendedWhere = 0;
-  for(int i = 0; i < numValueEntries; i++) {
-    int idx = 1 + (i * 4);
-    char kind = idxStr[idx + 0];
-    if(kind != VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT) {
-      continue;
-    }
-
-    int partition_idx = idxStr[idx + 1] - 'A';
-    int operator = idxStr[idx + 2];
-    // idxStr[idx + 3] is just null, a '_' placeholder
-
-    if(!appendedWhere) {
-      sqlite3_str_appendall(s, " WHERE ");
-      appendedWhere = 1;
-    }else {
-      sqlite3_str_appendall(s, " AND ");
+  vec0_metadata_column_kind kind = p->metadata_columns[metadata_idx].kind;
+  *excluded = 0;
+  if (op == VEC0_METADATA_OPERATOR_IN) {
+    return SQLITE_OK;
+  }
+  if (!p->stmtMetadataBoundsRead[metadata_idx]) {
+    char *zSql = sqlite3_mprintf("SELECT lo, hi FROM " VEC0_SHADOW_METADATA_BOUNDS_N_NAME
+                                 " WHERE rowid = ?",
+                                 p->schemaName, p->tableName, metadata_idx);
+    if (!zSql) {
+      return SQLITE_NOMEM;
     }
-    switch(operator) {
-     case VEC0_PARTITION_OPERATOR_EQ:
-      sqlite3_str_appendf(s, " partition%02d = ? ", partition_idx);
-      break;
-     case VEC0_PARTITION_OPERATOR_GT:
-      sqlite3_str_appendf(s, " partition%02d > ? ", partition_idx);
-      break;
-     case VEC0_PARTITION_OPERATOR_LE:
-      sqlite3_str_appendf(s, " partition%02d <= ? ", partition_idx);
-      break;
-     case VEC0_PARTITION_OPERATOR_LT:
-      sqlite3_str_appendf(s, " partition%02d < ? ", partition_idx);
-      break;
-     case VEC0_PARTITION_OPERATOR_GE:
-      sqlite3_str_appendf(s, " partition%02d >= ? ", partition_idx);
-      break;
-     case VEC0_PARTITION_OPERATOR_NE:
-      sqlite3_str_appendf(s, " partition%02d != ? ", partition_idx);
-      break;
-     default: {
-      char * zSql = sqlite3_str_finish(s);
-      sqlite3_free(zSql);
-      return SQLITE_ERROR;
-     }
-
+    rc = sqlite3_prepare_v2(p->db, zSql, -1,
+                            &p->stmtMetadataBoundsRead[metadata_idx], NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
     }
-
   }
 
-  char *zSql = sqlite3_str_finish(s);
-  if (!zSql) {
-    return SQLITE_NOMEM;
+  sqlite3_stmt *stmt = p->stmtMetadataBoundsRead[metadata_idx];
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_DONE) {
+    sqlite3_reset(stmt);
+    return SQLITE_OK;
   }
-
-  rc = sqlite3_prepare_v2(p->db, zSql, -1, outStmt, NULL);
-  sqlite3_free(zSql);
-  if(rc != SQLITE_OK) {
+  if (rc != SQLITE_ROW) {
+    sqlite3_reset(stmt);
     return rc;
   }
-
-  int n = 1;
-  for(int i = 0; i < numValueEntries; i++) {
-    int idx = 1 + (i * 4);
-    char kind = idxStr[idx + 0];
-    if(kind != VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT) {
-      continue;
+  if (sqlite3_column_type(stmt, 0) == SQLITE_NULL) {
+    // no rows have been written since the chunk's range was last rebuilt
+    *excluded = 1;
+  } else if (kind == VEC0_METADATA_COLUMN_KIND_BOOLEAN) {
+    int target = sqlite3_value_int(value);
+    int want = (target && op == VEC0_METADATA_OPERATOR_EQ) ||
+               (!target && op == VEC0_METADATA_OPERATOR_NE);
+    *excluded = want ? sqlite3_column_int64(stmt, 1) == 0
+                     : sqlite3_column_int64(stmt, 0) == 1;
+  } else if (kind == VEC0_METADATA_COLUMN_KIND_INTEGER) {
+    i64 target = sqlite3_value_int64(value);
+    i64 lo = sqlite3_column_int64(stmt, 0);
+    i64 hi = sqlite3_column_int64(stmt, 1);
+    switch (op) {
+    case VEC0_METADATA_OPERATOR_EQ: *excluded = target < lo || target > hi; break;
+    case VEC0_METADATA_OPERATOR_NE: *excluded = lo == target && hi == target; break;
+    case VEC0_METADATA_OPERATOR_GT: *excluded = hi <= target; break;
+    case VEC0_METADATA_OPERATOR_GE: *excluded = hi < target; break;
+    case VEC0_METADATA_OPERATOR_LT: *excluded = lo >= target; break;
+    case VEC0_METADATA_OPERATOR_LE: *excluded = lo > target; break;
+    default: break;
     }
-    sqlite3_bind_value(*outStmt, n++, argv[i]);
-  }
-
-  return rc;
+  } else {
+    double target = sqlite3_value_double(value);
+    double lo = sqlite3_column_double(stmt, 0);
+    double hi = sqlite3_column_double(stmt, 1);
+    switch (op) {
+    case VEC0_METADATA_OPERATOR_EQ: *excluded = target < lo || target > hi; break;
+    case VEC0_METADATA_OPERATOR_NE: *excluded = lo == target && hi == target; break;
+    case VEC0_METADATA_OPERATOR_GT: *excluded = hi <= target; break;
+    case VEC0_METADATA_OPERATOR_GE: *excluded = hi < target; break;
+    case VEC0_METADATA_OPERATOR_LT: *excluded = lo >= target; break;
+    case VEC0_METADATA_OPERATOR_LE: *excluded = lo > target; break;
+    default: break;
+    }
+  }
+  sqlite3_reset(stmt);
+  return SQLITE_OK;
 }
-
-// a single `xxx in (...)` constraint on a metadata column. TEXT or INTEGER only for now.
-struct Vec0MetadataIn{
-  // index of argv[i]` the constraint is on
-  int argv_idx;
-  // metadata column index of the constraint, derived from idxStr + argv_idx
-  int metadata_idx;
-  // array of the copied `(...)` values from sqlite3_vtab_in_first()/sqlite3_vtab_in_next()
-  struct Array array;
+/**
+ * Where the last KNN scan on a connection spent its time, reported by
+ * vec0_scan_stats(). Only collected when built with SQLITE_VEC_ENABLE_PREFETCH.
+ */
+struct Vec0ScanStats {
+  i64 chunks;
+  // chunks passed over because their bounding box was out of reach
+  i64 skipped;
+  // chunks whose vectors weren't read, since no row passed the filters
+  i64 filtered;
+  // chunks of which only the candidate rows' vectors were read
+  i64 sparse;
+  // stepping the chunks table and reading vector and metadata chunks
+  i64 read_ns;
+  // rowid/metadata/distance filters, distances and top-k upkeep
+  i64 compute_ns;
+  // whether the scan ran with a read-ahead thread
+  int prefetch;
+  // chunks the read-ahead thread pulled in, and the time it spent on them
+  i64 prefetched;
+  i64 prefetch_ns;
 };
 
-// Array elements for `xxx in (...)` values for a text column. basically just a string
-struct Vec0MetadataInTextEntry {
-  int n;
-  char * zString;
+struct Vec0ScanTimer {
+  struct Vec0ScanStats stats;
+  i64 mark;
 };
 
+#if SQLITE_VEC_ENABLE_PREFETCH
+static i64 vec0_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (i64)ts.tv_sec * 1000000000 + (i64)ts.tv_nsec;
+}
+#endif
 
-int vec0_metadata_filter_text(vec0_vtab * p, sqlite3_value * value, const void * buffer, int size, vec0_metadata_operator op, u8* b, int metadata_idx, int chunk_rowid, struct Array * aMetadataIn, int argv_idx) {
-  int rc;
-  sqlite3_stmt * stmt = NULL;
-  i64 * rowids = NULL;
-  sqlite3_blob * rowidsBlob;
-  const char * sTarget = (const char *) sqlite3_value_text(value);
-  int nTarget = sqlite3_value_bytes(value);
+static void vec0_scan_timer_start(struct Vec0ScanTimer *timer) {
+  memset(timer, 0, sizeof(*timer));
+#if SQLITE_VEC_ENABLE_PREFETCH
+  timer->mark = vec0_clock_ns();
+#endif
+}
 
+/**
+ * Adds the time since the previous lap to *bucket, one of timer->stats'
+ * read_ns or compute_ns. A no-op unless built with SQLITE_VEC_ENABLE_PREFETCH.
+ */
+static void vec0_scan_timer_lap(struct Vec0ScanTimer *timer, i64 *bucket) {
+#if SQLITE_VEC_ENABLE_PREFETCH
+  i64 now = vec0_clock_ns();
+  *bucket += now - timer->mark;
+  timer->mark = now;
+#else
+  UNUSED_PARAMETER(timer);
+  UNUSED_PARAMETER(bucket);
+#endif
+}
 
-  // TODO(perf): only text metadata news the rowids BLOB. Make it so that
-  // rowids BLOB is re-used when multiple fitlers on text columns,
-  // ex "name BETWEEN 'a' and 'b'""
-  rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowChunksName, "rowids", chunk_rowid, 0, &rowidsBlob);
-  if(rc != SQLITE_OK) {
-    return rc;
-  }
-  assert(sqlite3_blob_bytes(rowidsBlob) % sizeof(i64) == 0);
-  assert((sqlite3_blob_bytes(rowidsBlob) / sizeof(i64)) == size);
+/**
+ * Read-ahead for KNN scans over cold, disk-resident tables. While the scan
+ * scores chunk N, a helper thread reads the chunk after it through its own
+ * read-only connection, so that chunk's pages are already in the OS page
+ * cache (or mapped, with mmap) when the scan gets there. The helper only
+ * warms caches: it never hands data back, and if it can't read (in-memory
+ * databases, a writer holding an exclusive lock) the scan just runs without it.
+ */
+struct Vec0Prefetch {
+  int running;
+#if SQLITE_VEC_ENABLE_PREFETCH
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  // on vec0_vtab.prefetchDb: the first chunk with a rowid past ?
+  sqlite3_stmt *stmt;
+  // chunk the scan is on, and the last one the helper read ahead of
+  i64 target;
+  i64 handled;
+  int stop;
+  // only touched by the helper until it is joined
+  i64 chunks;
+  i64 ns;
+#endif
+};
 
-  rowids = sqlite3_malloc(sqlite3_blob_bytes(rowidsBlob));
-  if(!rowids) {
-    sqlite3_blob_close(rowidsBlob);
-    return SQLITE_NOMEM;
+#if SQLITE_VEC_ENABLE_PREFETCH
+static void *vec0_prefetch_main(void *arg) {
+  struct Vec0Prefetch *pf = (struct Vec0Prefetch *)arg;
+  pthread_mutex_lock(&pf->mutex);
+  while (1) {
+    while (!pf->stop && pf->target == pf->handled) {
+      pthread_cond_wait(&pf->cond, &pf->mutex);
+    }
+    if (pf->stop) {
+      break;
+    }
+    i64 target = pf->target;
+    pf->handled = target;
+    pthread_mutex_unlock(&pf->mutex);
+
+    i64 start = vec0_clock_ns();
+    sqlite3_bind_int64(pf->stmt, 1, target);
+    if (sqlite3_step(pf->stmt) == SQLITE_ROW) {
+      // loading the blob pulls in every overflow page of the chunk
+      (void)sqlite3_column_blob(pf->stmt, 0);
+      pf->chunks++;
+    }
+    sqlite3_reset(pf->stmt);
+    pf->ns += vec0_clock_ns() - start;
+
+    pthread_mutex_lock(&pf->mutex);
   }
+  pthread_mutex_unlock(&pf->mutex);
+  return NULL;
+}
+#endif
 
-  rc = sqlite3_blob_read(rowidsBlob, rowids, sqlite3_blob_bytes(rowidsBlob), 0);
-  if(rc != SQLITE_OK) {
-    sqlite3_blob_close(rowidsBlob);
-    return rc;
+/**
+ * @brief Start reading ahead of a scan over the "vectors" column of
+ * zChunksTable, if the table has prefetch enabled.
+ *
+ * Never fails the query: when read-ahead isn't possible pf->running stays 0
+ * and the other vec0_prefetch_* functions are no-ops.
+ *
+ * @param p vec0_vtab
+ * @param zChunksTable unquoted name of the chunk table the scan reads, in the
+ *   same schema as the vec0 table
+ * @param pf read-ahead state, stopped with vec0_prefetch_stop()
+ */
+static void vec0_prefetch_start(vec0_vtab *p, const char *zChunksTable,
+                                struct Vec0Prefetch *pf) {
+  memset(pf, 0, sizeof(*pf));
+#if SQLITE_VEC_ENABLE_PREFETCH
+  if (!p->prefetch || !sqlite3_threadsafe()) {
+    return;
+  }
+  if (!p->prefetchDb) {
+    const char *zFilename = sqlite3_db_filename(p->db, p->schemaName);
+    if (!zFilename || !zFilename[0]) {
+      // in-memory or temp database, nothing to read ahead from
+      return;
+    }
+    sqlite3 *db = NULL;
+    if (sqlite3_open_v2(zFilename, &db,
+                        SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                        NULL) != SQLITE_OK) {
+      sqlite3_close(db);
+      return;
+    }
+    p->prefetchDb = db;
   }
-  sqlite3_blob_close(rowidsBlob);
 
-  switch(op) {
-    int nPrefix;
-    char * sPrefix;
-    char *sFull;
-    int nFull;
-    u8 * view;
-    case VEC0_METADATA_OPERATOR_EQ: {
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
+  char *zSql = sqlite3_mprintf("SELECT vectors FROM \"main\".\"%w\" "
+                               "WHERE rowid > ? ORDER BY rowid LIMIT 1",
+                               zChunksTable);
+  if (!zSql) {
+    return;
+  }
+  int rc = sqlite3_prepare_v2(p->prefetchDb, zSql, -1, &pf->stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(pf->stmt);
+    pf->stmt = NULL;
+    return;
+  }
 
-        // for EQ the text lengths must match
-        if(nPrefix != nTarget) {
-          bitmap_set(b, i, 0);
-          continue;
-        }
-        int cmpPrefix = strncmp(sPrefix, sTarget, min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH));
+  pf->target = pf->handled = -1;
+  pthread_mutex_init(&pf->mutex, NULL);
+  pthread_cond_init(&pf->cond, NULL);
+  if (pthread_create(&pf->thread, NULL, vec0_prefetch_main, pf) != 0) {
+    pthread_cond_destroy(&pf->cond);
+    pthread_mutex_destroy(&pf->mutex);
+    sqlite3_finalize(pf->stmt);
+    pf->stmt = NULL;
+    return;
+  }
+  pf->running = 1;
+#else
+  UNUSED_PARAMETER(p);
+  UNUSED_PARAMETER(zChunksTable);
+#endif
+}
 
-        // for short strings, use the prefix comparison direclty
-        if(nPrefix <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-          bitmap_set(b, i, cmpPrefix == 0);
-          continue;
-        }
-        // for EQ on longs strings, the prefix must match
-        if(cmpPrefix) {
-          bitmap_set(b, i, 0);
-          continue;
-        }
-        // consult the full string
-        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        if(nPrefix != nFull) {
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) == 0);
-      }
-      break;
-    }
-    case VEC0_METADATA_OPERATOR_NE: {
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
+/**
+ * @brief Tell the read-ahead thread the scan has reached chunk_id, so it
+ * starts reading the chunk after it, by rowid.
+ */
+static void vec0_prefetch_advance(struct Vec0Prefetch *pf, i64 chunk_id) {
+#if SQLITE_VEC_ENABLE_PREFETCH
+  if (!pf->running) {
+    return;
+  }
+  pthread_mutex_lock(&pf->mutex);
+  pf->target = chunk_id;
+  pthread_cond_signal(&pf->cond);
+  pthread_mutex_unlock(&pf->mutex);
+#else
+  UNUSED_PARAMETER(pf);
+  UNUSED_PARAMETER(chunk_id);
+#endif
+}
 
-        // for NE if text lengths dont match, it never will
-        if(nPrefix != nTarget) {
-          bitmap_set(b, i, 1);
-          continue;
-        }
+/**
+ * @brief Stop and join the read-ahead thread, adding what it did to stats.
+ */
+static void vec0_prefetch_stop(struct Vec0Prefetch *pf,
+                               struct Vec0ScanStats *stats) {
+#if SQLITE_VEC_ENABLE_PREFETCH
+  if (!pf->running) {
+    return;
+  }
+  pthread_mutex_lock(&pf->mutex);
+  pf->stop = 1;
+  pthread_cond_signal(&pf->cond);
+  pthread_mutex_unlock(&pf->mutex);
+  pthread_join(pf->thread, NULL);
+  pthread_cond_destroy(&pf->cond);
+  pthread_mutex_destroy(&pf->mutex);
+  sqlite3_finalize(pf->stmt);
+  pf->stmt = NULL;
+  pf->running = 0;
+
+  stats->prefetch = 1;
+  stats->prefetched = pf->chunks;
+  stats->prefetch_ns = pf->ns;
+#else
+  UNUSED_PARAMETER(pf);
+  UNUSED_PARAMETER(stats);
+#endif
+}
 
-        int cmpPrefix = strncmp(sPrefix, sTarget, min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH));
+/**
+ * @brief Publish a finished scan's stats as the connection's last scan.
+ */
+static void vec0_scan_stats_record(vec0_vtab *p,
+                                   const struct Vec0ScanStats *stats) {
+#if SQLITE_VEC_ENABLE_PREFETCH
+  if (p->scanStats) {
+    *p->scanStats = *stats;
+  }
+#else
+  UNUSED_PARAMETER(p);
+  UNUSED_PARAMETER(stats);
+#endif
+}
 
-        // for short strings, use the prefix comparison direclty
-        if(nPrefix <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-          bitmap_set(b, i, cmpPrefix != 0);
-          continue;
-        }
-        // for NE on longs strings, if prefixes dont match, then long string wont
-        if(cmpPrefix) {
-          bitmap_set(b, i, 1);
-          continue;
-        }
-        // consult the full string
-        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        if(nPrefix != nFull) {
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) != 0);
-      }
-      break;
+/**
+ * @brief Position the chunk-read statement of a vector column on chunk_id.
+ *
+ * On success *outVectors points at the chunk's vectors blob, owned by SQLite
+ * and only valid until vec0_vector_chunk_release() is called for the same
+ * vector column. No copy is made; for chunks that span overflow pages SQLite
+ * assembles the blob once, which is no worse than sqlite3_blob_read().
+ *
+ * @param p vec0_vtab
+ * @param vectorColumnIdx index of the vector column to read
+ * @param chunk_id rowid of the chunk in _vector_chunksNN
+ * @param outVectors output pointer to the chunk's vectors
+ * @param outSize output size of the vectors blob, in bytes
+ * @return int SQLITE_OK on success, error code otherwise
+ */
+static int vec0_vector_chunk_read(vec0_vtab *p, int vectorColumnIdx,
+                                  i64 chunk_id, const void **outVectors,
+                                  i64 *outSize) {
+  int rc;
+  if (!p->stmtVectorChunksRead[vectorColumnIdx]) {
+    char *zSql = sqlite3_mprintf(
+        "SELECT vectors FROM " VEC0_SHADOW_VECTOR_N_NAME " WHERE rowid = ?",
+        p->schemaName, p->tableName, vectorColumnIdx);
+    if (!zSql) {
+      return SQLITE_NOMEM;
     }
-    case VEC0_METADATA_OPERATOR_GT: {
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
-        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
+    rc = sqlite3_prepare_v2(p->db, zSql, -1,
+                            &p->stmtVectorChunksRead[vectorColumnIdx], NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
 
-        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-          // if prefix match, check which is longer
-          if(cmpPrefix == 0) {
-            bitmap_set(b, i, nPrefix > nTarget);
-          }
-          else {
-            bitmap_set(b, i, cmpPrefix > 0);
-          }
-          continue;
-        }
-        // TODO(perf): may not need to compare full text in some cases
+  sqlite3_stmt *stmt = p->stmtVectorChunksRead[vectorColumnIdx];
+  sqlite3_reset(stmt);
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  if (rc != SQLITE_ROW) {
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? SQLITE_ERROR : rc;
+  }
+  *outVectors = sqlite3_column_blob(stmt, 0);
+  *outSize = sqlite3_column_bytes(stmt, 0);
+  return SQLITE_OK;
+}
 
-        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        if(nPrefix != nFull) {
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) > 0);
-      }
-      break;
-    }
-    case VEC0_METADATA_OPERATOR_GE: {
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
-        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
+/**
+ * @brief Reset the chunk-read statement of a vector column, invalidating the
+ * pointer handed out by vec0_vector_chunk_read().
+ */
+static void vec0_vector_chunk_release(vec0_vtab *p, int vectorColumnIdx) {
+  if (p->stmtVectorChunksRead[vectorColumnIdx]) {
+    sqlite3_reset(p->stmtVectorChunksRead[vectorColumnIdx]);
+  }
+}
 
-        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-          // if prefix match, check which is longer
-          if(cmpPrefix == 0) {
-            bitmap_set(b, i, nPrefix >= nTarget);
-          }
-          else {
-            bitmap_set(b, i, cmpPrefix >= 0);
-          }
-          continue;
-        }
-        // TODO(perf): may not need to compare full text in some cases
+#ifndef SQLITE_VEC_KNN_SPARSE_READ_DIVISOR
+// KNN scans read only the candidate rows of a chunk's vectors, rather than
+// the whole blob, when at most 1/N of the chunk's rows are candidates.
+#define SQLITE_VEC_KNN_SPARSE_READ_DIVISOR 32
+#endif
 
-        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        if(nPrefix != nFull) {
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) >= 0);
+/**
+ * @brief Whether few enough rows of a chunk are candidates to read them with
+ * vec0_blob_read_rows() instead of reading the whole chunk.
+ */
+static int vec0_chunk_is_sparse(const u8 *candidates, i32 chunk_size) {
+  i32 limit = chunk_size / SQLITE_VEC_KNN_SPARSE_READ_DIVISOR;
+  i32 count = 0;
+  for (i32 word_start = 0; word_start < chunk_size; word_start += 64) {
+    for (u64 bits = bitmap_word64(candidates, chunk_size, word_start); bits;
+         bits &= bits - 1) {
+      if (++count > limit) {
+        return 0;
       }
-      break;
     }
-    case VEC0_METADATA_OPERATOR_LE: {
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
-        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
+  }
+  return 1;
+}
 
-        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-          // if prefix match, check which is longer
-          if(cmpPrefix == 0) {
-            bitmap_set(b, i, nPrefix <= nTarget);
-          }
-          else {
-            bitmap_set(b, i, cmpPrefix <= 0);
+/**
+ * @brief Read the rows of blob whose bit is set in rows into out, each at its
+ * own offset. Runs of adjacent rows are read at once, and the other rows of
+ * out are left untouched.
+ *
+ * @param blob open on a blob of n rows of rowSize bytes each
+ * @param rows bitmap of the n rows, the rows to read
+ * @param out n * rowSize bytes
+ */
+static int vec0_blob_read_rows(sqlite3_blob *blob, const u8 *rows, i32 n,
+                               size_t rowSize, u8 *out) {
+  int rc;
+  // the current run of rows, [start, end)
+  i32 start = 0;
+  i32 end = 0;
+  for (i32 word_start = 0; word_start < n; word_start += 64) {
+    for (u64 bits = bitmap_word64(rows, n, word_start); bits;
+         bits &= bits - 1) {
+      i32 i = word_start + vec0_ctz64(bits);
+      if (i != end) {
+        if (end > start) {
+          rc = sqlite3_blob_read(blob, out + (size_t)start * rowSize,
+                                 (int)((end - start) * rowSize),
+                                 (int)(start * rowSize));
+          if (rc != SQLITE_OK) {
+            return rc;
           }
-          continue;
-        }
-        // TODO(perf): may not need to compare full text in some cases
-
-        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        if(nPrefix != nFull) {
-          rc = SQLITE_ERROR;
-          goto done;
         }
-        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) <= 0);
+        start = i;
       }
-      break;
+      end = i + 1;
     }
-    case VEC0_METADATA_OPERATOR_LT: {
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
-        int cmpPrefix = strncmp(sPrefix, sTarget, min(min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH), nTarget));
-
-        if(nPrefix < VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-          // if prefix match, check which is longer
-          if(cmpPrefix == 0) {
-            bitmap_set(b, i, nPrefix < nTarget);
-          }
-          else {
-            bitmap_set(b, i, cmpPrefix < 0);
-          }
-          continue;
-        }
-        // TODO(perf): may not need to compare full text in some cases
+  }
+  if (end > start) {
+    return sqlite3_blob_read(blob, out + (size_t)start * rowSize,
+                             (int)((end - start) * rowSize),
+                             (int)(start * rowSize));
+  }
+  return SQLITE_OK;
+}
 
-        rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-        if(rc != SQLITE_OK) {
-          goto done;
-        }
-        if(nPrefix != nFull) {
-          rc = SQLITE_ERROR;
-          goto done;
-        }
-        bitmap_set(b, i, strncmp(sFull, sTarget, nFull) < 0);
-      }
-      break;
+/**
+ * @brief Read the bounding box of a chunk, lo[dims] then hi[dims].
+ *
+ * Like vec0_vector_chunk_read(), *outBounds points into SQLite's row buffer
+ * until vec0_vector_bounds_release() is called for the same vector column.
+ * It is NULL when the chunk has no usable box, which only costs the skip.
+ */
+static int vec0_vector_bounds_read(vec0_vtab *p, int vectorColumnIdx,
+                                   i64 chunk_id, const f32 **outBounds) {
+  int rc;
+  *outBounds = NULL;
+  if (!p->stmtVectorBoundsRead[vectorColumnIdx]) {
+    char *zSql = sqlite3_mprintf("SELECT bounds FROM " VEC0_SHADOW_VECTOR_BOUNDS_N_NAME
+                                 " WHERE rowid = ?",
+                                 p->schemaName, p->tableName, vectorColumnIdx);
+    if (!zSql) {
+      return SQLITE_NOMEM;
     }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1,
+                            &p->stmtVectorBoundsRead[vectorColumnIdx], NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
 
-    case VEC0_METADATA_OPERATOR_IN: {
-      size_t metadataInIdx = -1;
-      for(size_t i = 0; i < aMetadataIn->length; i++) {
-        struct Vec0MetadataIn * metadataIn = &(((struct Vec0MetadataIn *) aMetadataIn->z)[i]);
-        if(metadataIn->argv_idx == argv_idx) {
-          metadataInIdx = i;
-          break;
-        }
-      }
-      if(metadataInIdx < 0) {
-        rc = SQLITE_ERROR;
-        goto done;
-      }
+  sqlite3_stmt *stmt = p->stmtVectorBoundsRead[vectorColumnIdx];
+  sqlite3_reset(stmt);
+  sqlite3_bind_int64(stmt, 1, chunk_id);
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_DONE) {
+    sqlite3_reset(stmt);
+    return SQLITE_OK;
+  }
+  if (rc != SQLITE_ROW) {
+    sqlite3_reset(stmt);
+    return rc;
+  }
+  if (sqlite3_column_bytes(stmt, 0) ==
+      (int)(2 * p->vector_columns[vectorColumnIdx].dimensions * sizeof(f32))) {
+    *outBounds = sqlite3_column_blob(stmt, 0);
+  }
+  return SQLITE_OK;
+}
 
-      struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[metadataInIdx];
-      struct Array * aTarget = &(metadataIn->array);
+/**
+ * @brief Reset the bounds-read statement of a vector column, invalidating the
+ * pointer handed out by vec0_vector_bounds_read().
+ */
+static void vec0_vector_bounds_release(vec0_vtab *p, int vectorColumnIdx) {
+  if (p->stmtVectorBoundsRead[vectorColumnIdx]) {
+    sqlite3_reset(p->stmtVectorBoundsRead[vectorColumnIdx]);
+  }
+}
 
+/**
+ * A `distance <op> target` constraint of a KNN query, read out of its
+ * sqlite3_value once per query. Chunks are then filtered without touching
+ * the query's arguments, which worker threads must not do.
+ */
+struct Vec0DistanceConstraint {
+  vec0_distance_constraint_operator op;
+  // what scanned distances are compared against: the target, or the squared
+  // bound of it when distances are squared
+  f32 bound;
+};
 
-      int nPrefix;
-      char * sPrefix;
-      char *sFull;
-      int nFull;
-      u8 * view;
-      for(int i = 0; i < size; i++) {
-        view = &((u8*) buffer)[i * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH];
-        nPrefix = ((int*) view)[0];
-        sPrefix = (char *) &view[4];
-        for(size_t target_idx = 0; target_idx < aTarget->length; target_idx++) {
-          struct Vec0MetadataInTextEntry * entry = &(((struct Vec0MetadataInTextEntry*)aTarget->z)[target_idx]);
-          if(entry->n != nPrefix) {
-            continue;
-          }
-          int cmpPrefix = strncmp(sPrefix, entry->zString, min(nPrefix, VEC0_METADATA_TEXT_VIEW_DATA_LENGTH));
-          if(nPrefix <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
-            if(cmpPrefix == 0) {
-              bitmap_set(b, i, 1);
-              break;
-            }
-            continue;
-          }
-          if(cmpPrefix) {
-            continue;
-          }
+/**
+ * @brief Collect the distance constraints of a KNN query plan.
+ *
+ * Distances are f32, so each target is rounded to the f32 that selects the
+ * same distances as the double did: up for `<` and `>=`, down for `<=` and
+ * `>`. Squared bounds are then worked out here, once per query.
+ *
+ * @param distancesSquared whether the scan compares squared distances
+ * @param out array with room for argc constraints
+ * @return number of constraints written to out
+ */
+static int vec0_distance_constraints_init(const char *idxStr, int argc,
+                                          sqlite3_value **argv,
+                                          int distancesSquared,
+                                          struct Vec0DistanceConstraint *out) {
+  int n = 0;
+  for (int i = 0; i < argc; i++) {
+    int idx = 1 + (i * 4);
+    if (idxStr[idx + 0] != VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT) {
+      continue;
+    }
+    vec0_distance_constraint_operator op = idxStr[idx + 1];
+    double value = sqlite3_value_double(argv[i]);
+    f32 target = (f32)value;
+    int strict = op == VEC0_DISTANCE_CONSTRAINT_LE ||
+                 op == VEC0_DISTANCE_CONSTRAINT_GT;
+    if (strict ? (double)target > value : (double)target < value) {
+      target = nextafterf(target, strict ? -INFINITY : INFINITY);
+    }
+    out[n].op = op;
+    // distances are squared, so `d < X` becomes `s < bound(X)`
+    // and `d <= X` becomes `s < strict bound(X)`, and so on.
+    out[n].bound =
+        distancesSquared ? vec0_squared_distance_bound(target, strict) : target;
+    n++;
+  }
+  return n;
+}
 
-          rc = vec0_get_metadata_text_long_value(p, &stmt, metadata_idx, rowids[i], &nFull, &sFull);
-          if(rc != SQLITE_OK) {
-            goto done;
-          }
-          if(nPrefix != nFull) {
-            rc = SQLITE_ERROR;
-            goto done;
-          }
-          if(strncmp(sFull, entry->zString, nFull) == 0) {
-            bitmap_set(b, i, 1);
+/**
+ * @brief Clear the bits of b whose distance fails any of the constraints.
+ * Only rows whose bit is still set are checked, a word of b at a time.
+ */
+static void vec0_distance_constraints_apply(
+    const struct Vec0DistanceConstraint *constraints, int n,
+    int distancesSquared, const f32 *distances, u8 *b, i32 size) {
+  for (int c = 0; c < n; c++) {
+    vec0_distance_constraint_operator op = constraints[c].op;
+    f32 bound = constraints[c].bound;
+    int below = op == VEC0_DISTANCE_CONSTRAINT_LT ||
+                op == VEC0_DISTANCE_CONSTRAINT_LE;
+
+    for (i32 word_start = 0; word_start < size; word_start += 64) {
+      u64 word = bitmap_word64(b, size, word_start);
+      for (u64 bits = word; bits; bits &= bits - 1) {
+        int j = vec0_ctz64(bits);
+        f32 distance = distances[word_start + j];
+        int pass;
+        if (distancesSquared) {
+          pass = (distance < bound) == below;
+        } else {
+          switch (op) {
+          case VEC0_DISTANCE_CONSTRAINT_GE:
+            pass = distance >= bound;
+            break;
+          case VEC0_DISTANCE_CONSTRAINT_GT:
+            pass = distance > bound;
+            break;
+          case VEC0_DISTANCE_CONSTRAINT_LE:
+            pass = distance <= bound;
+            break;
+          case VEC0_DISTANCE_CONSTRAINT_LT:
+            pass = distance < bound;
+            break;
+          default:
+            pass = 1;
             break;
           }
         }
+        if (!pass) {
+          word &= ~((u64)1 << j);
+        }
       }
-      break;
+      bitmap_word64_store(b, size, word_start, word);
     }
+  }
+}
 
+/**
+ * Everything needed to score a chunk of a flat KNN scan, fixed for the whole
+ * query and only read while scoring.
+ */
+struct Vec0KnnScoreArgs {
+  const struct VectorColumnDefinition *vector_column;
+  const void *queryVector;
+  size_t vectorSize;
+  i32 chunk_size;
+  const struct Vec0DistanceConstraint *constraints;
+  int nConstraints;
+  int distancesSquared;
+};
+
+/**
+ * @brief Score the candidate rows of one chunk and offer them to topk.
+ *
+ * @param baseVectors the chunk's vectors, chunk_size * vectorSize bytes
+ * @param rowids the chunk's rowids
+ * @param candidates rows to score, cleared for rows failing a distance
+ *   constraint
+ * @param distances chunk_size floats of working space
+ */
+static void vec0_knn_score_chunk(const struct Vec0KnnScoreArgs *args,
+                                 struct Vec0TopK *topk,
+                                 const void *baseVectors, const i64 *rowids,
+                                 u8 *candidates, f32 *distances) {
+  const struct VectorColumnDefinition *vector_column = args->vector_column;
+  if (vector_column->distance_bounded_fn) {
+    // rows past the current k-th distance can't make the top-k, so their
+    // distances only need to be known to be past it.
+    distances_for_chunk_bounded(
+        vector_column->distance_bounded_fn, vec0_topk_threshold(topk),
+        args->queryVector, baseVectors, args->vectorSize,
+        &vector_column->dimensions, args->chunk_size, candidates, distances);
+  } else {
+    distances_for_chunk(vector_column->distance_fn, args->queryVector,
+                        baseVectors, args->vectorSize,
+                        &vector_column->dimensions, args->chunk_size,
+                        candidates, distances);
   }
-  rc = SQLITE_OK;
-
-  done:
-    sqlite3_finalize(stmt);
-    sqlite3_free(rowids);
-    return rc;
+  if (args->nConstraints) {
+    vec0_distance_constraints_apply(args->constraints, args->nConstraints,
+                                    args->distancesSquared, distances,
+                                    candidates, args->chunk_size);
+  }
+  vec0_topk_push_chunk(topk, distances, rowids, candidates, args->chunk_size);
+}
 
+/**
+ * @brief Whether distance constraints reject every row at least lb away.
+ * Only `distance < X` and `distance <= X` can; lb says nothing of how far
+ * the rows might be.
+ */
+static int vec0_distance_constraints_exclude(
+    const struct Vec0DistanceConstraint *constraints, int n,
+    int distancesSquared, f32 lb) {
+  for (int c = 0; c < n; c++) {
+    vec0_distance_constraint_operator op = constraints[c].op;
+    f32 bound = constraints[c].bound;
+    if (op != VEC0_DISTANCE_CONSTRAINT_LT &&
+        op != VEC0_DISTANCE_CONSTRAINT_LE) {
+      continue;
+    }
+    // same comparisons as vec0_distance_constraints_apply()
+    if ((distancesSquared || op == VEC0_DISTANCE_CONSTRAINT_LT) ? lb >= bound
+                                                                 : lb > bound) {
+      return 1;
+    }
+  }
+  return 0;
 }
 
 /**
- * @brief Fill in bitmap of chunk values, whether or not the values match a metadata constraint
+ * @brief Whether no row of a chunk can make it into the results of a KNN
+ * scan, judging only by the chunk's bounding box.
  *
- * @param p vec0_vtab
- * @param metadata_idx index of the metatadata column to perfrom constraints on
- * @param value sqlite3_value of the constraints value
- * @param blob sqlite3_blob that is already opened on the metdata column's shadow chunk table
- * @param chunk_rowid rowid of the chunk to calculate on
- * @param b pre-allocated and zero'd out bitmap to write results to
- * @param size size of the chunk
- * @return int SQLITE_OK on success, error code otherwise
+ * That's the case for a query when the box is no closer than its current
+ * k-th distance (rows scanned later lose ties), or too far for a distance
+ * constraint. Batched scans only skip chunks out of reach of every query.
+ *
+ * @param topks one heap per query vector
+ * @param bounds the chunk's box, from vec0_vector_bounds_read()
  */
-int vec0_set_metadata_filter_bitmap(
-  vec0_vtab *p,
-  int metadata_idx,
-  vec0_metadata_operator op,
-  sqlite3_value * value,
-  sqlite3_blob * blob,
-  i64 chunk_rowid,
-  u8* b,
-  int size,
-  struct Array * aMetadataIn, int argv_idx) {
-  // TODO: shouldn't this skip in-valid entries from the chunk's  validity bitmap?
-
-  int rc;
-  rc = sqlite3_blob_reopen(blob, chunk_rowid);
-  if(rc != SQLITE_OK) {
-    return rc;
+static int vec0_knn_chunk_out_of_reach(const struct Vec0KnnScoreArgs *args,
+                                       const struct Vec0TopK *topks,
+                                       i64 nQueries, const f32 *bounds) {
+  const struct VectorColumnDefinition *vector_column = args->vector_column;
+  for (i64 q = 0; q < nQueries; q++) {
+    const f32 *query =
+        (const f32 *)args->queryVector + q * vector_column->dimensions;
+    f32 lb = vec0_vector_bounds_distance(vector_column->distance_metric,
+                                         args->distancesSquared, bounds,
+                                         query, vector_column->dimensions);
+    f32 threshold = vec0_topk_threshold(&topks[q]);
+    if (threshold < INFINITY && lb >= threshold) {
+      continue;
+    }
+    if (vec0_distance_constraints_exclude(args->constraints,
+                                          args->nConstraints,
+                                          args->distancesSquared, lb)) {
+      continue;
+    }
+    return 0;
   }
+  return 1;
+}
 
-  vec0_metadata_column_kind kind = p->metadata_columns[metadata_idx].kind;
-  int szMatch = 0;
-  int blobSize = sqlite3_blob_bytes(blob);
-  switch(kind) {
-    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
-      szMatch = blobSize == size / CHAR_BIT;
-      break;
+#ifndef SQLITE_VEC_KNN_BATCH_BLOCK
+// How many queries of a batched KNN scan are scored together against each
+// tile of a chunk.
+#define SQLITE_VEC_KNN_BATCH_BLOCK 8
+#endif
+
+/**
+ * @brief Score one chunk against every query of a batched KNN scan, offering
+ * the rows to one heap per query.
+ *
+ * Works like a blocked matrix product: the chunk is walked in tiles of 64
+ * rows, and every query of a block is scored against a tile while it is
+ * still in cache, instead of streaming the whole chunk once per query.
+ *
+ * @param args the scan, with args->queryVector holding nQueries vectors
+ * @param candidates rows to score, left untouched
+ * @param mask chunk_size bits of working space
+ * @param distances SQLITE_VEC_KNN_BATCH_BLOCK * chunk_size floats of working
+ *   space
+ */
+static void vec0_knn_score_chunk_batch(const struct Vec0KnnScoreArgs *args,
+                                       struct Vec0TopK *topks, i64 nQueries,
+                                       const void *baseVectors,
+                                       const i64 *rowids, u8 *candidates,
+                                       u8 *mask, f32 *distances) {
+  const struct VectorColumnDefinition *vector_column = args->vector_column;
+  const u8 *queries = (const u8 *)args->queryVector;
+  const u8 *base = (const u8 *)baseVectors;
+  i32 n = args->chunk_size;
+  f32 bounds[SQLITE_VEC_KNN_BATCH_BLOCK];
+
+  for (i64 q0 = 0; q0 < nQueries; q0 += SQLITE_VEC_KNN_BATCH_BLOCK) {
+    i64 nBlock = min(nQueries - q0, SQLITE_VEC_KNN_BATCH_BLOCK);
+    for (i64 j = 0; j < nBlock; j++) {
+      bounds[j] = vec0_topk_threshold(&topks[q0 + j]);
+    }
+    for (i32 r0 = 0; r0 < n; r0 += 64) {
+      i32 rows = min(n - r0, 64);
+      for (i64 j = 0; j < nBlock; j++) {
+        // same as distances_for_chunk(_bounded) on the tile's rows
+        distances_for_chunk_impl(
+            vector_column->distance_bounded_fn ? NULL
+                                               : vector_column->distance_fn,
+            vector_column->distance_bounded_fn, bounds[j],
+            queries + (q0 + j) * args->vectorSize,
+            base + (size_t)r0 * args->vectorSize, args->vectorSize,
+            &vector_column->dimensions, rows, candidates + r0 / CHAR_BIT,
+            distances + j * n + r0);
+      }
     }
-    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
-      szMatch = blobSize == size * sizeof(i64);
-      break;
+    for (i64 j = 0; j < nBlock; j++) {
+      u8 *rowsToPush = candidates;
+      if (args->nConstraints) {
+        bitmap_copy(mask, candidates, n);
+        vec0_distance_constraints_apply(args->constraints, args->nConstraints,
+                                        args->distancesSquared,
+                                        distances + j * n, mask, n);
+        rowsToPush = mask;
+      }
+      vec0_topk_push_chunk(&topks[q0 + j], distances + j * n, rowids,
+                           rowsToPush, n);
     }
-    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
-      szMatch = blobSize == size * sizeof(double);
-      break;
+  }
+}
+
+#ifndef SQLITE_VEC_MAX_THREADS
+// Most worker threads the 'threads=N' command accepts.
+#define SQLITE_VEC_MAX_THREADS 64
+#endif
+
+#if SQLITE_VEC_ENABLE_THREADS
+/**
+ * Long-lived worker threads owned by a vec0 table, created on the first
+ * parallel scan and joined when the table is disconnected. A task runs once
+ * on every worker; the workers themselves decide how to share it out.
+ */
+struct Vec0ThreadPool {
+  int nthreads;
+  pthread_t *threads;
+  pthread_mutex_t mutex;
+  // signalled when a task is posted, or on shutdown
+  pthread_cond_t work;
+  // signalled when the last worker finishes the current task
+  pthread_cond_t idle;
+  void (*task)(void *arg, int worker);
+  void *arg;
+  // bumped for every posted task
+  i64 generation;
+  // workers that haven't finished the current task yet
+  int active;
+  int shutdown;
+  // worker index handed to each thread
+  struct Vec0ThreadPoolWorker {
+    struct Vec0ThreadPool *pool;
+    int idx;
+  } *workers;
+};
+
+static void *vec0_thread_pool_main(void *arg) {
+  struct Vec0ThreadPoolWorker *worker = (struct Vec0ThreadPoolWorker *)arg;
+  struct Vec0ThreadPool *pool = worker->pool;
+  i64 seen = 0;
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    while (!pool->shutdown && pool->generation == seen) {
+      pthread_cond_wait(&pool->work, &pool->mutex);
     }
-    case VEC0_METADATA_COLUMN_KIND_TEXT: {
-      szMatch = blobSize == size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+    if (pool->shutdown) {
       break;
     }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+    pool->task(pool->arg, worker->idx);
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->active == 0) {
+      pthread_cond_signal(&pool->idle);
+    }
   }
-  if(!szMatch) {
-    return SQLITE_ERROR;
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+static void vec0_thread_pool_destroy(struct Vec0ThreadPool *pool) {
+  if (!pool) {
+    return;
   }
-  void * buffer = sqlite3_malloc(blobSize);
-  if(!buffer) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 0; i < pool->nthreads; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pthread_cond_destroy(&pool->idle);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->mutex);
+  sqlite3_free(pool->workers);
+  sqlite3_free(pool->threads);
+  sqlite3_free(pool);
+}
+
+/**
+ * @brief Start nthreads idle workers.
+ * @return SQLITE_OK, SQLITE_NOMEM, or SQLITE_ERROR if a thread couldn't be
+ *   created.
+ */
+static int vec0_thread_pool_create(int nthreads,
+                                   struct Vec0ThreadPool **out) {
+  struct Vec0ThreadPool *pool = sqlite3_malloc(sizeof(*pool));
+  if (!pool) {
     return SQLITE_NOMEM;
   }
-  rc = sqlite3_blob_read(blob, buffer, blobSize, 0);
-  if(rc != SQLITE_OK) {
-    goto done;
+  memset(pool, 0, sizeof(*pool));
+  pool->threads = sqlite3_malloc(nthreads * sizeof(pthread_t));
+  pool->workers =
+      sqlite3_malloc(nthreads * sizeof(struct Vec0ThreadPoolWorker));
+  if (!pool->threads || !pool->workers) {
+    sqlite3_free(pool->workers);
+    sqlite3_free(pool->threads);
+    sqlite3_free(pool);
+    return SQLITE_NOMEM;
   }
-  switch(kind) {
-    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
-      int target = sqlite3_value_int(value);
-      if( (target && op == VEC0_METADATA_OPERATOR_EQ) || (!target && op == VEC0_METADATA_OPERATOR_NE)) {
-        for(int i = 0; i < size; i++) { bitmap_set(b, i, bitmap_get((u8*) buffer, i)); }
-      }
-      else {
-        for(int i = 0; i < size; i++) { bitmap_set(b, i, !bitmap_get((u8*) buffer, i)); }
-      }
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
-      i64 * array = (i64*) buffer;
-      i64 target = sqlite3_value_int64(value);
-      switch(op) {
-        case VEC0_METADATA_OPERATOR_EQ: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] == target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] > target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] <= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] < target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] >= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_NE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] != target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_IN: {
-          int metadataInIdx = -1;
-          for(size_t i = 0; i < aMetadataIn->length; i++) {
-            struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[i];
-            if(metadataIn->argv_idx == argv_idx) {
-              metadataInIdx = i;
-              break;
-            }
-          }
-          if(metadataInIdx < 0) {
-            rc = SQLITE_ERROR;
-            goto done;
-          }
-          struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[metadataInIdx];
-          struct Array * aTarget = &(metadataIn->array);
-
-          for(int i = 0; i < size; i++) {
-            for(size_t target_idx = 0; target_idx < aTarget->length; target_idx++) {
-              if( ((i64*)aTarget->z)[target_idx] == array[i]) {
-                bitmap_set(b, i, 1);
-                break;
-              }
-            }
-          }
-          break;
-        }
-      }
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
-      double * array = (double*) buffer;
-      double target = sqlite3_value_double(value);
-      switch(op) {
-        case VEC0_METADATA_OPERATOR_EQ: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] == target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] > target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] <= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] < target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] >= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_NE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] != target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_IN: {
-          // should never be reached
-          break;
-        }
-      }
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_TEXT: {
-      rc = vec0_metadata_filter_text(p, value, buffer, size, op, b, metadata_idx, chunk_rowid, aMetadataIn, argv_idx);
-      if(rc != SQLITE_OK) {
-        goto done;
-      }
-      break;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  for (int i = 0; i < nthreads; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].idx = i;
+    if (pthread_create(&pool->threads[i], NULL, vec0_thread_pool_main,
+                       &pool->workers[i]) != 0) {
+      // only join the threads that were started
+      pool->nthreads = i;
+      vec0_thread_pool_destroy(pool);
+      return SQLITE_ERROR;
     }
   }
-  done:
-    sqlite3_free(buffer);
-    return rc;
+  pool->nthreads = nthreads;
+  *out = pool;
+  return SQLITE_OK;
 }
 
-int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
-                               struct VectorColumnDefinition *vector_column,
-                               int vectorColumnIdx, struct Array *arrayRowidsIn,
-                               struct Array * aMetadataIn,
-                               const char * idxStr, int argc, sqlite3_value ** argv,
-                               void *queryVector, i64 k, i64 **out_topk_rowids,
-                               f32 **out_topk_distances, i64 *out_used) {
-  // for each chunk, get top min(k, chunk_size) rowid + distances to query vec.
-  // then reconcile all topk_chunks for a true top k.
-  // output only rowids + distances for now
+/**
+ * @brief Run task(arg, worker) once on every worker, without waiting for it.
+ * Wait with vec0_thread_pool_wait() before posting the next task.
+ */
+static void vec0_thread_pool_post(struct Vec0ThreadPool *pool,
+                                  void (*task)(void *, int), void *arg) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->task = task;
+  pool->arg = arg;
+  pool->active = pool->nthreads;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->mutex);
+}
 
-  int rc = SQLITE_OK;
-  sqlite3_blob *blobVectors = NULL;
+static void vec0_thread_pool_wait(struct Vec0ThreadPool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->active > 0) {
+    pthread_cond_wait(&pool->idle, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
 
-  void *baseVectors = NULL; // memory: chunk_size * dimensions * element_size
+// A chunk handed from the scan to the workers.
+struct Vec0KnnSlot {
+  u8 *vectors;
+  i64 *rowids;
+  u8 *candidates;
+  // push order of the chunk's first row, as a serial scan would number it
+  i64 seq;
+  // set from submit until a worker has scored it
+  int busy;
+};
 
-  // OWNED BY CALLER ON SUCCESS
-  i64 *topk_rowids = NULL; // memory: k * 4
-  // OWNED BY CALLER ON SUCCESS
-  f32 *topk_distances = NULL; // memory: k * 4
+// A worker's share of the scan: its own heap and distance buffer.
+struct Vec0KnnWorker {
+  struct Vec0TopK topk;
+  f32 *distances;
+};
+#endif
 
-  i64 *tmp_topk_rowids = NULL;    // memory: k * 4
-  f32 *tmp_topk_distances = NULL; // memory: k * 4
-  f32 *chunk_distances = NULL;    // memory: chunk_size * 4
-  u8 *b = NULL;                   // memory: chunk_size / 8
-  u8 *bTaken = NULL;              // memory: chunk_size / 8
-  i32 *chunk_topk_idxs = NULL;    // memory: k * 4
-  u8 *bmRowids = NULL;            // memory: chunk_size / 8
-  u8 *bmMetadata = NULL;            // memory: chunk_size / 8
-  //                        // total: a lot???
+/**
+ * Parallel flat KNN scan. The SQLite thread keeps doing all chunk I/O and
+ * rowid/metadata filtering, then copies each chunk's vectors, rowids and
+ * candidate bitmap into a free slot of a small ring. The table's thread pool
+ * workers take slots in order, score them into their own top-k heaps, and
+ * the heaps are merged when the scan ends. Chunks keep the push order a
+ * serial scan would give them, so results are identical to the serial path.
+ */
+struct Vec0KnnParallel {
+  int running;
+#if SQLITE_VEC_ENABLE_THREADS
+  const struct Vec0KnnScoreArgs *score;
+  struct Vec0ThreadPool *pool;
+  pthread_mutex_t mutex;
+  // signalled when a slot is submitted, or the scan is done
+  pthread_cond_t ready;
+  // signalled when a worker frees a slot
+  pthread_cond_t freed;
+  struct Vec0KnnSlot *slots;
+  int nslots;
+  // slots submitted and taken so far; slot i lives at slots[i % nslots]
+  i64 filled;
+  i64 taken;
+  int done;
+  i64 next_seq;
+  struct Vec0KnnWorker *workers;
+  int nworkers;
+#endif
+};
 
-  // 6 * (k * 4) + (k * 2) + (chunk_size / 8) + (chunk_size * dimensions * 4)
+#if SQLITE_VEC_ENABLE_THREADS
+static void vec0_knn_parallel_worker(void *arg, int idx) {
+  struct Vec0KnnParallel *par = (struct Vec0KnnParallel *)arg;
+  struct Vec0KnnWorker *worker = &par->workers[idx];
+  while (1) {
+    pthread_mutex_lock(&par->mutex);
+    while (!par->done && par->taken == par->filled) {
+      pthread_cond_wait(&par->ready, &par->mutex);
+    }
+    if (par->taken == par->filled) {
+      pthread_mutex_unlock(&par->mutex);
+      return;
+    }
+    struct Vec0KnnSlot *slot = &par->slots[par->taken++ % par->nslots];
+    pthread_mutex_unlock(&par->mutex);
 
-  topk_rowids = sqlite3_malloc(k * sizeof(i64));
-  if (!topk_rowids) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
-  }
-  memset(topk_rowids, 0, k * sizeof(i64));
+    worker->topk.next_seq = slot->seq;
+    vec0_knn_score_chunk(par->score, &worker->topk, slot->vectors,
+                         slot->rowids, slot->candidates, worker->distances);
 
-  topk_distances = sqlite3_malloc(k * sizeof(f32));
-  if (!topk_distances) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+    pthread_mutex_lock(&par->mutex);
+    slot->busy = 0;
+    pthread_cond_signal(&par->freed);
+    pthread_mutex_unlock(&par->mutex);
   }
-  memset(topk_distances, 0, k * sizeof(f32));
+}
+#endif
 
-  tmp_topk_rowids = sqlite3_malloc(k * sizeof(i64));
-  if (!tmp_topk_rowids) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
-  }
-  memset(tmp_topk_rowids, 0, k * sizeof(i64));
+static void vec0_knn_parallel_free(struct Vec0KnnParallel *par);
 
-  tmp_topk_distances = sqlite3_malloc(k * sizeof(f32));
-  if (!tmp_topk_distances) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+/**
+ * @brief Start a parallel scan if the table has 'threads=N' set.
+ *
+ * When the table is serial, or its workers can't be started, par->running
+ * stays 0 and the caller scores chunks itself.
+ *
+ * @param p vec0_vtab
+ * @param score scoring arguments, must outlive the scan
+ * @param k number of results
+ * @param par scan state, released with vec0_knn_parallel_free()
+ * @return SQLITE_OK or SQLITE_NOMEM
+ */
+static int vec0_knn_parallel_start(vec0_vtab *p,
+                                   const struct Vec0KnnScoreArgs *score,
+                                   i64 k, struct Vec0KnnParallel *par) {
+  memset(par, 0, sizeof(*par));
+#if SQLITE_VEC_ENABLE_THREADS
+  if (p->threads < 1) {
+    return SQLITE_OK;
   }
-  memset(tmp_topk_distances, 0, k * sizeof(f32));
-
-  i64 k_used = 0;
-  i64 baseVectorsSize = p->chunk_size * vector_column_byte_size(*vector_column);
-  baseVectors = sqlite3_malloc(baseVectorsSize);
-  if (!baseVectors) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+  if (p->threadPool && p->threadPool->nthreads != p->threads) {
+    vec0_thread_pool_destroy(p->threadPool);
+    p->threadPool = NULL;
   }
-
-  chunk_distances = sqlite3_malloc(p->chunk_size * sizeof(f32));
-  if (!chunk_distances) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+  if (!p->threadPool) {
+    int rc = vec0_thread_pool_create(p->threads, &p->threadPool);
+    if (rc == SQLITE_ERROR) {
+      // couldn't start the threads, scan serially
+      return SQLITE_OK;
+    }
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
   }
 
-  b = bitmap_new(p->chunk_size);
-  if (!b) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+  par->score = score;
+  par->pool = p->threadPool;
+  par->nworkers = par->pool->nthreads;
+  par->nslots = 2 * par->nworkers;
+  par->slots = sqlite3_malloc(par->nslots * sizeof(struct Vec0KnnSlot));
+  par->workers = sqlite3_malloc(par->nworkers * sizeof(struct Vec0KnnWorker));
+  if (!par->slots || !par->workers) {
+    vec0_knn_parallel_free(par);
+    return SQLITE_NOMEM;
+  }
+  memset(par->slots, 0, par->nslots * sizeof(struct Vec0KnnSlot));
+  memset(par->workers, 0, par->nworkers * sizeof(struct Vec0KnnWorker));
+
+  size_t chunk_size = (size_t)score->chunk_size;
+  for (int i = 0; i < par->nslots; i++) {
+    struct Vec0KnnSlot *slot = &par->slots[i];
+    slot->vectors = sqlite3_malloc64(chunk_size * score->vectorSize);
+    slot->rowids = sqlite3_malloc64(chunk_size * sizeof(i64));
+    slot->candidates = sqlite3_malloc64(chunk_size / CHAR_BIT);
+    if (!slot->vectors || !slot->rowids || !slot->candidates) {
+      vec0_knn_parallel_free(par);
+      return SQLITE_NOMEM;
+    }
+  }
+  for (int i = 0; i < par->nworkers; i++) {
+    struct Vec0KnnWorker *worker = &par->workers[i];
+    worker->distances = sqlite3_malloc64(chunk_size * sizeof(f32));
+    if (!worker->distances ||
+        vec0_topk_init(&worker->topk, k) != SQLITE_OK) {
+      vec0_knn_parallel_free(par);
+      return SQLITE_NOMEM;
+    }
   }
 
-  bTaken = bitmap_new(p->chunk_size);
-  if (!bTaken) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+  pthread_mutex_init(&par->mutex, NULL);
+  pthread_cond_init(&par->ready, NULL);
+  pthread_cond_init(&par->freed, NULL);
+  par->running = 1;
+  vec0_thread_pool_post(par->pool, vec0_knn_parallel_worker, par);
+#else
+  UNUSED_PARAMETER(p);
+  UNUSED_PARAMETER(score);
+  UNUSED_PARAMETER(k);
+#endif
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Hand a chunk to the workers, waiting for a free slot if they are
+ * behind. The chunk is copied, so its buffers can be reused right away.
+ */
+static void vec0_knn_parallel_submit(struct Vec0KnnParallel *par,
+                                     const void *baseVectors,
+                                     const i64 *rowids,
+                                     const u8 *candidates) {
+#if SQLITE_VEC_ENABLE_THREADS
+  const struct Vec0KnnScoreArgs *score = par->score;
+  struct Vec0KnnSlot *slot = &par->slots[par->filled % par->nslots];
+  pthread_mutex_lock(&par->mutex);
+  while (slot->busy) {
+    pthread_cond_wait(&par->freed, &par->mutex);
+  }
+  pthread_mutex_unlock(&par->mutex);
+
+  memcpy(slot->vectors, baseVectors,
+         (size_t)score->chunk_size * score->vectorSize);
+  memcpy(slot->rowids, rowids, (size_t)score->chunk_size * sizeof(i64));
+  memcpy(slot->candidates, candidates, score->chunk_size / CHAR_BIT);
+  slot->seq = par->next_seq;
+  par->next_seq += score->chunk_size;
+
+  pthread_mutex_lock(&par->mutex);
+  slot->busy = 1;
+  par->filled++;
+  pthread_cond_signal(&par->ready);
+  pthread_mutex_unlock(&par->mutex);
+#else
+  UNUSED_PARAMETER(par);
+  UNUSED_PARAMETER(baseVectors);
+  UNUSED_PARAMETER(rowids);
+  UNUSED_PARAMETER(candidates);
+#endif
+}
+
+#if SQLITE_VEC_ENABLE_THREADS
+/**
+ * @brief Let the workers drain the remaining slots and wait for them.
+ */
+static void vec0_knn_parallel_stop(struct Vec0KnnParallel *par) {
+  if (!par->running) {
+    return;
   }
+  pthread_mutex_lock(&par->mutex);
+  par->done = 1;
+  pthread_cond_broadcast(&par->ready);
+  pthread_mutex_unlock(&par->mutex);
+  vec0_thread_pool_wait(par->pool);
+  pthread_cond_destroy(&par->freed);
+  pthread_cond_destroy(&par->ready);
+  pthread_mutex_destroy(&par->mutex);
+  par->running = 0;
+}
+#endif
 
-  chunk_topk_idxs = sqlite3_malloc(k * sizeof(i32));
-  if (!chunk_topk_idxs) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+/**
+ * @brief Finish the scan and merge every worker's heap into topk.
+ */
+static void vec0_knn_parallel_merge(struct Vec0KnnParallel *par,
+                                    struct Vec0TopK *topk) {
+#if SQLITE_VEC_ENABLE_THREADS
+  vec0_knn_parallel_stop(par);
+  for (int i = 0; i < par->nworkers; i++) {
+    struct Vec0TopK *local = &par->workers[i].topk;
+    for (i32 j = 0; j < local->used; j++) {
+      vec0_topk_insert(topk, local->distances[j], local->rowids[j],
+                       local->seqs[j]);
+    }
   }
+#else
+  UNUSED_PARAMETER(par);
+  UNUSED_PARAMETER(topk);
+#endif
+}
 
-  bmRowids = arrayRowidsIn ? bitmap_new(p->chunk_size) : NULL;
-  if (arrayRowidsIn && !bmRowids) {
-    rc = SQLITE_NOMEM;
-    goto cleanup;
+static void vec0_knn_parallel_free(struct Vec0KnnParallel *par) {
+#if SQLITE_VEC_ENABLE_THREADS
+  vec0_knn_parallel_stop(par);
+  if (par->slots) {
+    for (int i = 0; i < par->nslots; i++) {
+      sqlite3_free(par->slots[i].vectors);
+      sqlite3_free(par->slots[i].rowids);
+      sqlite3_free(par->slots[i].candidates);
+    }
+  }
+  if (par->workers) {
+    for (int i = 0; i < par->nworkers; i++) {
+      vec0_topk_free(&par->workers[i].topk);
+      sqlite3_free(par->workers[i].distances);
+    }
   }
+  sqlite3_free(par->slots);
+  sqlite3_free(par->workers);
+  memset(par, 0, sizeof(*par));
+#else
+  UNUSED_PARAMETER(par);
+#endif
+}
+
+int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
+                               struct VectorColumnDefinition *vector_column,
+                               int vectorColumnIdx, struct Array *arrayRowidsIn,
+                               struct Array * aMetadataIn,
+                               const char * idxStr, int argc, sqlite3_value ** argv,
+                               void *queryVector, i64 nQueries, i64 k,
+                               i64 **out_topk_rowids, f32 **out_topk_distances,
+                               i32 **out_topk_query_idxs, i64 *out_used) {
+  // score every chunk against the query vector, and offer each candidate row
+  // to a single top-k heap that lives for the whole scan (or, with
+  // 'threads=N', to per-worker heaps that are merged into it at the end).
+  // Batched queries get one heap per query vector, and the results of all of
+  // them are concatenated, in query order.
+  // output only rowids + distances (+ query_idxs when batched) for now
 
+  int rc = SQLITE_OK;
   sqlite3_blob * metadataBlobs[VEC0_MAX_METADATA_COLUMNS];
   memset(metadataBlobs, 0, sizeof(sqlite3_blob*) * VEC0_MAX_METADATA_COLUMNS);
 
-  bmMetadata = bitmap_new(p->chunk_size);
-  if(!bmMetadata) {
-    rc = SQLITE_NOMEM;
+  // every buffer below lives in the table's scratch arena
+  struct Vec0ScratchFrame scratch;
+  memset(&scratch, 0, sizeof(scratch));
+  // rowids + distances OWNED BY CALLER ON SUCCESS
+  struct Vec0TopK *topks = NULL;  // memory: nQueries * k * 20
+  f32 *chunk_distances = NULL;    // memory: batch * chunk_size * 4
+  u8 *b = NULL;                   // memory: chunk_size / 8
+  u8 *bmMetadata = NULL;            // memory: chunk_size / 8
+  u8 *bmQuery = NULL;             // memory: chunk_size / 8
+  void *metadataValues = NULL;    // memory: chunk_size * 16
+  struct Vec0DistanceConstraint *constraints = NULL; // memory: argc * 8
+  // the candidate rows of sparse chunks, read through blobVectors
+  u8 *sparseVectors = NULL;       // memory: chunk_size * vectorSize
+  sqlite3_blob *blobVectors = NULL;
+  struct Vec0KnnScoreArgs score;
+  struct Vec0KnnParallel parallel;
+  memset(&parallel, 0, sizeof(parallel));
+  struct Vec0Prefetch prefetch;
+  memset(&prefetch, 0, sizeof(prefetch));
+  struct Vec0ScanTimer timer;
+  memset(&timer, 0, sizeof(timer));
+
+  size_t vectorSize = vector_column_byte_size(*vector_column);
+  int distancesSquared = vec0_distance_is_squared(
+      vector_column->element_type, vector_column->distance_metric);
+  size_t bitmapSize = p->chunk_size / CHAR_BIT;
+  size_t metadataValuesSize =
+      p->chunk_size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+  // distances of one block of queries at a time when batched
+  size_t distancesSize =
+      min(nQueries, SQLITE_VEC_KNN_BATCH_BLOCK) * p->chunk_size * sizeof(f32);
+  rc = vec0_scratch_acquire(
+      &p->scratch,
+      vec0_scratch_size(nQueries * sizeof(struct Vec0TopK)) +
+          vec0_scratch_size(distancesSize) +
+          3 * vec0_scratch_size(bitmapSize) +
+          vec0_scratch_size(metadataValuesSize) +
+          vec0_scratch_size(argc * sizeof(struct Vec0DistanceConstraint)),
+      &scratch);
+  if (rc != SQLITE_OK) {
     goto cleanup;
   }
+  topks = vec0_scratch_alloc(&scratch, nQueries * sizeof(struct Vec0TopK));
+  memset(topks, 0, nQueries * sizeof(struct Vec0TopK));
+  chunk_distances = vec0_scratch_alloc(&scratch, distancesSize);
+  b = vec0_scratch_alloc(&scratch, bitmapSize);
+  bmMetadata = vec0_scratch_alloc(&scratch, bitmapSize);
+  bmQuery = nQueries > 1 ? vec0_scratch_alloc(&scratch, bitmapSize) : NULL;
+  metadataValues = vec0_scratch_alloc(&scratch, metadataValuesSize);
+  constraints = vec0_scratch_alloc(
+      &scratch, argc * sizeof(struct Vec0DistanceConstraint));
+
+  for (i64 q = 0; q < nQueries; q++) {
+    rc = vec0_topk_init(&topks[q], k);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
 
   int idxStrLength = strlen(idxStr);
   int numValueEntries = (idxStrLength-1) / 4;
   assert(numValueEntries == argc);
   int hasMetadataFilters = 0;
-  int hasDistanceConstraints = 0;
+  int hasPartitionFilters = 0;
   for(int i = 0; i < argc; i++) {
     int idx = 1 + (i * 4);
     char kind = idxStr[idx + 0];
     if(kind == VEC0_IDXSTR_KIND_METADATA_CONSTRAINT) {
       hasMetadataFilters = 1;
     }
-    else if(kind == VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT) {
-      hasDistanceConstraints = 1;
+    if(kind == VEC0_IDXSTR_KIND_KNN_PARTITON_CONSTRAINT) {
+      hasPartitionFilters = 1;
+    }
+  }
+
+  score.vector_column = vector_column;
+  score.queryVector = queryVector;
+  score.vectorSize = vectorSize;
+  score.chunk_size = p->chunk_size;
+  score.constraints = constraints;
+  score.nConstraints =
+      vec0_distance_constraints_init(idxStr, argc, argv, distancesSquared,
+                                     constraints);
+  score.distancesSquared = distancesSquared;
+
+  // batched queries are already compute-heavy per chunk read, and stay on
+  // the calling thread.
+  if (nQueries == 1) {
+    rc = vec0_knn_parallel_start(p, &score, k, &parallel);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
     }
   }
+  // the read-ahead thread guesses the next chunk by rowid, which is only the
+  // scan's order when stmtChunks isn't filtered on partition keys.
+  if (!hasPartitionFilters) {
+    vec0_prefetch_start(p, p->shadowVectorChunksNames[vectorColumnIdx],
+                        &prefetch);
+  }
+  vec0_scan_timer_start(&timer);
 
   while (true) {
     rc = sqlite3_step(stmtChunks);
@@ -7367,11 +12747,12 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
       rc = SQLITE_ERROR;
       goto cleanup;
     }
-    memset(chunk_distances, 0, p->chunk_size * sizeof(f32));
-    memset(chunk_topk_idxs, 0, k * sizeof(i32));
+    memset(chunk_distances, 0, distancesSize);
     bitmap_clear(b, p->chunk_size);
 
     i64 chunk_id = sqlite3_column_int64(stmtChunks, 0);
+    vec0_prefetch_advance(&prefetch, chunk_id);
+    timer.stats.chunks++;
     unsigned char *chunkValidity =
         (unsigned char *)sqlite3_column_blob(stmtChunks, 1);
     i64 validitySize = sqlite3_column_bytes(stmtChunks, 1);
@@ -7398,53 +12779,63 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
       goto cleanup;
     }
 
-    // open the vector chunk blob for the current chunk
-    rc = sqlite3_blob_open(p->db, p->schemaName,
-                           p->shadowVectorChunksNames[vectorColumnIdx],
-                           "vectors", chunk_id, 0, &blobVectors);
-    if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, "could not open vectors blob for chunk %lld",
-                     chunk_id);
-      rc = SQLITE_ERROR;
-      goto cleanup;
-    }
-
-    i64 currentBaseVectorsSize = sqlite3_blob_bytes(blobVectors);
-    i64 expectedBaseVectorsSize =
-        p->chunk_size * vector_column_byte_size(*vector_column);
-    if (currentBaseVectorsSize != expectedBaseVectorsSize) {
-      // IMP: V16465_00535
-      vtab_set_error(
-          &p->base,
-          "vectors blob size doesn't match - expected %lld, found %lld",
-          expectedBaseVectorsSize, currentBaseVectorsSize);
-      rc = SQLITE_ERROR;
-      goto cleanup;
+    // a chunk whose value range rules out a metadata constraint has no
+    // candidates, and none of its blobs are opened
+    if (hasMetadataFilters) {
+      int excluded = 0;
+      for (int i = 0; i < argc && !excluded; i++) {
+        int idx = 1 + (i * 4);
+        if (idxStr[idx + 0] != VEC0_IDXSTR_KIND_METADATA_CONSTRAINT) {
+          continue;
+        }
+        int metadata_idx = idxStr[idx + 1] - 'A';
+        if (!p->shadowMetadataBoundsNames[metadata_idx]) {
+          continue;
+        }
+        rc = vec0_metadata_bounds_exclude(p, metadata_idx, idxStr[idx + 2],
+                                          argv[i], chunk_id, &excluded);
+        if (rc != SQLITE_OK) {
+          vtab_set_error(&p->base,
+                         "could not read metadata bounds for chunk %lld",
+                         chunk_id);
+          goto cleanup;
+        }
+      }
+      if (excluded) {
+        timer.stats.filtered++;
+        vec0_scan_timer_lap(&timer, &timer.stats.read_ns);
+        continue;
+      }
     }
-    rc = sqlite3_blob_read(blobVectors, baseVectors, currentBaseVectorsSize, 0);
 
-    if (rc != SQLITE_OK) {
-      vtab_set_error(&p->base, "vectors blob read error for %lld", chunk_id);
-      rc = SQLITE_ERROR;
-      goto cleanup;
+    // a chunk whose bounding box is out of reach isn't worth reading. With
+    // 'threads=N' the heaps live on the workers, so only distance
+    // constraints can rule chunks out here.
+    if (p->shadowVectorBoundsNames[vectorColumnIdx]) {
+      const f32 *bounds = NULL;
+      rc = vec0_vector_bounds_read(p, vectorColumnIdx, chunk_id, &bounds);
+      if (rc != SQLITE_OK) {
+        vtab_set_error(&p->base, "could not read bounds for chunk %lld",
+                       chunk_id);
+        goto cleanup;
+      }
+      int skip = bounds && vec0_knn_chunk_out_of_reach(&score, topks,
+                                                       nQueries, bounds);
+      vec0_vector_bounds_release(p, vectorColumnIdx);
+      if (skip) {
+        timer.stats.skipped++;
+        vec0_scan_timer_lap(&timer, &timer.stats.read_ns);
+        continue;
+      }
     }
 
     bitmap_copy(b, chunkValidity, p->chunk_size);
     if (arrayRowidsIn) {
-      bitmap_clear(bmRowids, p->chunk_size);
-
-      for (int i = 0; i < p->chunk_size; i++) {
-        if (!bitmap_get(chunkValidity, i)) {
-          continue;
-        }
-        i64 rowid = chunkRowids[i];
-        void *in = bsearch(&rowid, arrayRowidsIn->z, arrayRowidsIn->length,
-                           sizeof(i64), _cmp);
-        bitmap_set(bmRowids, i, in ? 1 : 0);
-      }
-      bitmap_and_inplace(b, bmRowids, p->chunk_size);
+      bitmap_filter_rowids_in(b, chunkRowids, p->chunk_size, arrayRowidsIn);
     }
 
+    vec0_scan_timer_lap(&timer, &timer.stats.compute_ns);
+
     if(hasMetadataFilters) {
       for(int i = 0; i < argc; i++) {
         int idx = 1 + (i * 4);
@@ -7452,6 +12843,10 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
         if(kind != VEC0_IDXSTR_KIND_METADATA_CONSTRAINT) {
           continue;
         }
+        // no candidates left in the chunk, the other constraints can't add any
+        if(bitmap_is_clear(b, p->chunk_size)) {
+          break;
+        }
         int metadata_idx = idxStr[idx + 1] - 'A';
         int operator = idxStr[idx + 2];
 
@@ -7463,178 +12858,129 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
           }
         }
 
-        bitmap_clear(bmMetadata, p->chunk_size);
-        rc = vec0_set_metadata_filter_bitmap(p, metadata_idx, operator, argv[i], metadataBlobs[metadata_idx], chunk_id, bmMetadata, p->chunk_size, aMetadataIn, i);
+        rc = vec0_set_metadata_filter_bitmap(p, metadata_idx, operator, argv[i], metadataBlobs[metadata_idx], chunk_id, b, bmMetadata, p->chunk_size, metadataValues, aMetadataIn, i);
         if(rc != SQLITE_OK) {
           vtab_set_error(&p->base, "Could not filter metadata fields");
           if(rc != SQLITE_OK) {
             goto cleanup;
           }
         }
-        bitmap_and_inplace(b, bmMetadata, p->chunk_size);
       }
+      // metadata chunks are read and filtered in one go, count it all as I/O
+      vec0_scan_timer_lap(&timer, &timer.stats.read_ns);
     }
 
+    // the vectors are read last, and only as much of them as the filters let
+    // through: none at all when no row is left, only the candidate rows when
+    // few are.
+    if (bitmap_is_clear(b, p->chunk_size)) {
+      timer.stats.filtered++;
+      vec0_scan_timer_lap(&timer, &timer.stats.compute_ns);
+      continue;
+    }
 
-    for (int i = 0; i < p->chunk_size; i++) {
-      if (!bitmap_get(b, i)) {
-        continue;
-      };
-
-      f32 result;
-      switch (vector_column->element_type) {
-      case SQLITE_VEC_ELEMENT_TYPE_FLOAT32: {
-        const f32 *base_i =
-            ((f32 *)baseVectors) + (i * vector_column->dimensions);
-        switch (vector_column->distance_metric) {
-        case VEC0_DISTANCE_METRIC_L2: {
-          result = distance_l2_sqr_float(base_i, (f32 *)queryVector,
-                                         &vector_column->dimensions);
-          break;
-        }
-        case VEC0_DISTANCE_METRIC_L1: {
-          result = distance_l1_f32(base_i, (f32 *)queryVector,
-                                   &vector_column->dimensions);
-          break;
-        }
-        case VEC0_DISTANCE_METRIC_COSINE: {
-          result = distance_cosine_float(base_i, (f32 *)queryVector,
-                                         &vector_column->dimensions);
-          break;
-        }
-        }
-        break;
-      }
-      case SQLITE_VEC_ELEMENT_TYPE_INT8: {
-        const i8 *base_i =
-            ((i8 *)baseVectors) + (i * vector_column->dimensions);
-        switch (vector_column->distance_metric) {
-        case VEC0_DISTANCE_METRIC_L2: {
-          result = distance_l2_sqr_int8(base_i, (i8 *)queryVector,
-                                        &vector_column->dimensions);
-          break;
-        }
-        case VEC0_DISTANCE_METRIC_L1: {
-          result = distance_l1_int8(base_i, (i8 *)queryVector,
-                                    &vector_column->dimensions);
-          break;
-        }
-        case VEC0_DISTANCE_METRIC_COSINE: {
-          result = distance_cosine_int8(base_i, (i8 *)queryVector,
-                                        &vector_column->dimensions);
-          break;
-        }
+    i64 expectedBaseVectorsSize =
+        p->chunk_size * vector_column_byte_size(*vector_column);
+    const void *baseVectors = NULL;
+    i64 currentBaseVectorsSize = 0;
+    if (vec0_chunk_is_sparse(b, p->chunk_size)) {
+      if (!sparseVectors) {
+        sparseVectors = sqlite3_malloc64(expectedBaseVectorsSize);
+        if (!sparseVectors) {
+          rc = SQLITE_NOMEM;
+          goto cleanup;
         }
-
-        break;
-      }
-      case SQLITE_VEC_ELEMENT_TYPE_BIT: {
-        const u8 *base_i =
-            ((u8 *)baseVectors) + (i * (vector_column->dimensions / CHAR_BIT));
-        result = distance_hamming(base_i, (u8 *)queryVector,
-                                  &vector_column->dimensions);
-        break;
+        // rows that aren't read stay zeroed rather than uninitialized
+        memset(sparseVectors, 0, expectedBaseVectorsSize);
       }
+      if (!blobVectors) {
+        rc = sqlite3_blob_open(p->db, p->schemaName,
+                               p->shadowVectorChunksNames[vectorColumnIdx],
+                               "vectors", chunk_id, 0, &blobVectors);
+      } else {
+        rc = sqlite3_blob_reopen(blobVectors, chunk_id);
       }
-
-      chunk_distances[i] = result;
-    }
-
-    if(hasDistanceConstraints) {
-      for(int i = 0; i < argc; i++) {
-        int idx = 1 + (i * 4);
-        char kind = idxStr[idx + 0];
-        // TODO casts f64 to f32, is that a problem?
-        f32 target = (f32) sqlite3_value_double(argv[i]);
-
-        if(kind != VEC0_IDXSTR_KIND_KNN_DISTANCE_CONSTRAINT)  {
-          continue;
-        }
-        vec0_distance_constraint_operator op = idxStr[idx + 1];
-
-        switch(op) {
-          case VEC0_DISTANCE_CONSTRAINT_GE: {
-            for(int i = 0; i < p->chunk_size;i++) {
-              if(bitmap_get(b, i) && !(chunk_distances[i] >= target)) {
-                bitmap_set(b, i, 0);
-              }
-            }
-            break;
-          }
-          case VEC0_DISTANCE_CONSTRAINT_GT: {
-            for(int i = 0; i < p->chunk_size;i++) {
-              if(bitmap_get(b, i) && !(chunk_distances[i] > target)) {
-                bitmap_set(b, i, 0);
-              }
-            }
-            break;
-          }
-          case VEC0_DISTANCE_CONSTRAINT_LE: {
-            for(int i = 0; i < p->chunk_size;i++) {
-              if(bitmap_get(b, i) && !(chunk_distances[i] <= target)) {
-                bitmap_set(b, i, 0);
-              }
-            }
-            break;
-          }
-          case VEC0_DISTANCE_CONSTRAINT_LT: {
-            for(int i = 0; i < p->chunk_size;i++) {
-              if(bitmap_get(b, i) && !(chunk_distances[i] < target)) {
-                bitmap_set(b, i, 0);
-              }
-            }
-            break;
-          }
+      if (rc == SQLITE_OK) {
+        currentBaseVectorsSize = sqlite3_blob_bytes(blobVectors);
+        if (currentBaseVectorsSize == expectedBaseVectorsSize) {
+          rc = vec0_blob_read_rows(blobVectors, b, p->chunk_size, vectorSize,
+                                   sparseVectors);
         }
       }
+      baseVectors = sparseVectors;
+      timer.stats.sparse++;
+    } else {
+      // position the vector chunk statement on the current chunk. baseVectors
+      // points into SQLite's row buffer until the chunk is released below.
+      rc = vec0_vector_chunk_read(p, vectorColumnIdx, chunk_id, &baseVectors,
+                                  &currentBaseVectorsSize);
+    }
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, "could not read vectors for chunk %lld",
+                     chunk_id);
+      rc = SQLITE_ERROR;
+      goto cleanup;
     }
 
-    int used1;
-    min_idx(chunk_distances, p->chunk_size, b, chunk_topk_idxs,
-            min(k, p->chunk_size), bTaken, &used1);
-
-    i64 used;
-    merge_sorted_lists(topk_distances, topk_rowids, k_used, chunk_distances,
-                       chunkRowids, chunk_topk_idxs,
-                       min(min(k, p->chunk_size), used1), tmp_topk_distances,
-                       tmp_topk_rowids, k, &used);
+    if (currentBaseVectorsSize != expectedBaseVectorsSize) {
+      // IMP: V16465_00535
+      vtab_set_error(
+          &p->base,
+          "vectors blob size doesn't match - expected %lld, found %lld",
+          expectedBaseVectorsSize, currentBaseVectorsSize);
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+    vec0_scan_timer_lap(&timer, &timer.stats.read_ns);
 
-    for (int i = 0; i < used; i++) {
-      topk_rowids[i] = tmp_topk_rowids[i];
-      topk_distances[i] = tmp_topk_distances[i];
+    if (parallel.running) {
+      vec0_knn_parallel_submit(&parallel, baseVectors, chunkRowids, b);
+    } else if (nQueries > 1) {
+      vec0_knn_score_chunk_batch(&score, topks, nQueries, baseVectors,
+                                 chunkRowids, b, bmQuery, chunk_distances);
+    } else {
+      vec0_knn_score_chunk(&score, &topks[0], baseVectors, chunkRowids, b,
+                           chunk_distances);
+    }
+    vec0_vector_chunk_release(p, vectorColumnIdx);
+    vec0_scan_timer_lap(&timer, &timer.stats.compute_ns);
+  }
+
+  vec0_prefetch_stop(&prefetch, &timer.stats);
+  vec0_knn_parallel_merge(&parallel, &topks[0]);
+  vec0_scan_stats_record(p, &timer.stats);
+  for (i64 q = 0; q < nQueries; q++) {
+    vec0_topk_finish(&topks[q]);
+  }
+  if (nQueries == 1) {
+    *out_topk_rowids = topks[0].rowids;
+    *out_topk_distances = topks[0].distances;
+    *out_topk_query_idxs = NULL;
+    *out_used = topks[0].used;
+    // handed over to the caller
+    memset(&topks[0], 0, sizeof(topks[0]));
+  } else {
+    rc = vec0_topk_concat(topks, nQueries, out_topk_rowids,
+                          out_topk_distances, out_topk_query_idxs, out_used);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
     }
-    k_used = used;
-    // blobVectors is always opened with read-only permissions, so this never
-    // fails.
-    sqlite3_blob_close(blobVectors);
-    blobVectors = NULL;
   }
-
-  *out_topk_rowids = topk_rowids;
-  *out_topk_distances = topk_distances;
-  *out_used = k_used;
   rc = SQLITE_OK;
 
 cleanup:
-  if (rc != SQLITE_OK) {
-    sqlite3_free(topk_rowids);
-    sqlite3_free(topk_distances);
-  }
-  sqlite3_free(chunk_topk_idxs);
-  sqlite3_free(tmp_topk_rowids);
-  sqlite3_free(tmp_topk_distances);
-  sqlite3_free(b);
-  sqlite3_free(bTaken);
-  sqlite3_free(bmRowids);
-  sqlite3_free(baseVectors);
-  sqlite3_free(chunk_distances);
-  sqlite3_free(bmMetadata);
+  for (i64 q = 0; topks && q < nQueries; q++) {
+    vec0_topk_free(&topks[q]);
+  }
+  vec0_knn_parallel_free(&parallel);
+  vec0_prefetch_stop(&prefetch, &timer.stats);
+  vec0_scratch_release(&scratch);
   for(int i = 0; i < VEC0_MAX_METADATA_COLUMNS; i++) {
     sqlite3_blob_close(metadataBlobs[i]);
   }
-  // blobVectors is always opened with read-only permissions, so this never
-  // fails.
   sqlite3_blob_close(blobVectors);
+  sqlite3_free(sparseVectors);
+  vec0_vector_chunk_release(p, vectorColumnIdx);
   return rc;
 }
 
@@ -7878,7 +13224,18 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
     rc = SQLITE_ERROR;
     goto cleanup;
   }
-  if (dimensions != vector_column->dimensions) {
+  // When the statement reads query_idx, a query "vector" holding a whole
+  // number of vectors of the column's size is a matrix of query vectors,
+  // packed back to back, all answered in one pass over the chunks. Each row is
+  // tagged with its query in query_idx.
+  i64 nQueries = 1;
+  if (dimensions != vector_column->dimensions &&
+      idxStr[1 + (query_idx * 4) + 1] == VEC0_IDXSTR_KNN_MATCH_BATCH &&
+      dimensions > vector_column->dimensions &&
+      dimensions % vector_column->dimensions == 0) {
+    nQueries = dimensions / vector_column->dimensions;
+  }
+  if (dimensions != nQueries * vector_column->dimensions) {
     vtab_set_error(
         &p->base,
         "Dimension mismatch for query vector for the \"%.*s\" column. "
@@ -7888,6 +13245,30 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
     rc = SQLITE_ERROR;
     goto cleanup;
   }
+  if (nQueries > 1) {
+    if (vector_column->index_type != VEC0_INDEX_TYPE_FLAT) {
+      vtab_set_error(&p->base,
+                     "Batched KNN queries are only supported on vector "
+                     "columns without an index, but \"%.*s\" has one.",
+                     vector_column->name_length, vector_column->name);
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+    if (idxStr[1 + (k_idx * 4) + 1] == VEC0_IDXSTR_KNN_K_FROM_LIMIT) {
+      vtab_set_error(&p->base,
+                     "Batched KNN queries require a 'k = ?' constraint, "
+                     "LIMIT would apply to the rows of all queries combined.");
+      rc = SQLITE_ERROR;
+      goto cleanup;
+    }
+  }
+  if (vector_column->normalize) {
+    rc = vector_normalize_f32_rows(&queryVector, vector_column->dimensions,
+                                   nQueries, &queryVectorCleanup);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
 
   i64 k = sqlite3_value_int64(argv[k_idx]);
   if (k < 0) {
@@ -7957,12 +13338,18 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
   }
 #endif
 
-  #if COMPILER_SUPPORTS_VTAB_IN
+  // `xxx in (...)` lists, and every constraint on a dictionary-encoded TEXT
+  // column, which becomes the set of dictionary codes that satisfy it
   for(int i = 0; i < argc; i++) {
-    if(!(idxStr[1 + (i*4)] == VEC0_IDXSTR_KIND_METADATA_CONSTRAINT && idxStr[1 + (i*4) + 2] == VEC0_METADATA_OPERATOR_IN)) {
+    if(idxStr[1 + (i*4)] != VEC0_IDXSTR_KIND_METADATA_CONSTRAINT) {
       continue;
     }
     int metadata_idx = idxStr[1 + (i*4) + 1]  - 'A';
+    vec0_metadata_operator op = idxStr[1 + (i*4) + 2];
+    int dictionary = p->metadata_columns[metadata_idx].dictionary;
+    if(op != VEC0_METADATA_OPERATOR_IN && !dictionary) {
+      continue;
+    }
     if(!aMetadataIn) {
       aMetadataIn = sqlite3_malloc(sizeof(*aMetadataIn));
       if(!aMetadataIn) {
@@ -7981,6 +13368,19 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
     item.metadata_idx=metadata_idx;
     item.argv_idx = i;
 
+    if(dictionary) {
+      rc = array_init(&item.array, sizeof(i64), 16);
+      if(rc != SQLITE_OK) {
+        goto cleanup;
+      }
+      rc = vec0_metadata_dict_codes(p, metadata_idx, op, argv[i], &item.array);
+      if(rc != SQLITE_OK) {
+        array_cleanup(&item.array);
+        vtab_set_error(&p->base, "Error looking up dictionary codes for a metadata constraint");
+        goto cleanup;
+      }
+    }else
+    #if COMPILER_SUPPORTS_VTAB_IN
     switch(p->metadata_columns[metadata_idx].kind) {
       case VEC0_METADATA_COLUMN_KIND_INTEGER: {
         rc = array_init(&item.array, sizeof(i64), 16);
@@ -8038,13 +13438,24 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
         goto cleanup;
       }
     }
+    #else
+    {
+      vtab_set_error(&p->base, "Internal sqlite-vec error");
+      goto cleanup;
+    }
+    #endif
 
     rc = array_append(aMetadataIn, &item);
     if(rc != SQLITE_OK) {
       goto cleanup;
     }
+    rc = vec0_metadata_in_index(
+      &((struct Vec0MetadataIn *) aMetadataIn->z)[aMetadataIn->length - 1],
+      vec0_metadata_storage_kind(&p->metadata_columns[metadata_idx]));
+    if(rc != SQLITE_OK) {
+      goto cleanup;
+    }
   }
-  #endif
 
 #if SQLITE_VEC_ENABLE_RESCORE
   // Dispatch to rescore KNN path if this vector column has rescore enabled
@@ -8086,10 +13497,11 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
 
   i64 *topk_rowids = NULL;
   f32 *topk_distances = NULL;
+  i32 *topk_query_idxs = NULL;
   i64 k_used = 0;
   rc = vec0Filter_knn_chunks_iter(p, stmtChunks, vector_column, vectorColumnIdx,
-                                  arrayRowidsIn, aMetadataIn, idxStr, argc, argv, queryVector, k, &topk_rowids,
-                                  &topk_distances, &k_used);
+                                  arrayRowidsIn, aMetadataIn, idxStr, argc, argv, queryVector, nQueries, k, &topk_rowids,
+                                  &topk_distances, &topk_query_idxs, &k_used);
   if (rc != SQLITE_OK) {
     goto cleanup;
   }
@@ -8098,6 +13510,9 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
   knn_data->k = k;
   knn_data->rowids = topk_rowids;
   knn_data->distances = topk_distances;
+  knn_data->query_idxs = topk_query_idxs;
+  knn_data->distances_squared = vec0_distance_is_squared(
+      vector_column->element_type, vector_column->distance_metric);
   knn_data->k_used = k_used;
 
   pCur->knn_data = knn_data;
@@ -8113,12 +13528,13 @@ cleanup:
     for(size_t i = 0; i < aMetadataIn->length; i++) {
       struct Vec0MetadataIn* item = &((struct Vec0MetadataIn *) aMetadataIn->z)[i];
       for(size_t j = 0; j < item->array.length; j++) {
-        if(p->metadata_columns[item->metadata_idx].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
+        if(vec0_metadata_storage_kind(&p->metadata_columns[item->metadata_idx]) == VEC0_METADATA_COLUMN_KIND_TEXT) {
           struct Vec0MetadataInTextEntry entry = ((struct Vec0MetadataInTextEntry*)item->array.z)[j];
           sqlite3_free(entry.zString);
         }
       }
       array_cleanup(&item->array);
+      sqlite3_free(item->hashSlots);
     }
     array_cleanup(aMetadataIn);
   }
@@ -8239,6 +13655,12 @@ static int vec0Filter(sqlite3_vtab_cursor *pVtabCursor, int idxNum,
   vec0_cursor *pCur = (vec0_cursor *)pVtabCursor;
   vec0_cursor_clear(pCur);
 
+  // rows staged in this transaction are visible to its queries
+  int rc = vec0_write_behind_flush(p);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
   int idxStrLength = strlen(idxStr);
   if(idxStrLength <= 0) {
     return SQLITE_ERROR;
@@ -8521,8 +13943,17 @@ static int vec0Column_knn(vec0_vtab *pVtab, vec0_cursor *pCur,
     return vec0_result_id(pVtab, context, rowid);
   }
   else if (i == vec0_column_distance_idx(pVtab)) {
-    sqlite3_result_double(
-        context, pCur->knn_data->distances[pCur->knn_data->current_idx]);
+    f32 distance = pCur->knn_data->distances[pCur->knn_data->current_idx];
+    if (pCur->knn_data->distances_squared) {
+      distance = sqrtf(distance);
+    }
+    sqlite3_result_double(context, distance);
+    return SQLITE_OK;
+  }
+  else if (i == vec0_column_query_idx_idx(pVtab)) {
+    i32 *query_idxs = pCur->knn_data->query_idxs;
+    sqlite3_result_int(
+        context, query_idxs ? query_idxs[pCur->knn_data->current_idx] : 0);
     return SQLITE_OK;
   }
   else if (vec0_column_idx_is_vector(pVtab, i)) {
@@ -8667,6 +14098,199 @@ int vec0Update_InsertRowidStep(vec0_vtab *p, sqlite3_value *idValue,
   return vec0_rowids_insert_id(p, NULL, rowid);
 }
 
+// Beyond this many partitions the cursors are dropped and start over, to
+// bound their memory.
+#ifndef VEC0_INSERT_CURSORS_MAX
+#define VEC0_INSERT_CURSORS_MAX 65536
+#endif
+
+/**
+ * @brief The chunk the last insert into a partition went to, and the slot
+ * after it. Slots before next_offset were taken then, and stay taken until a
+ * delete or rollback, which drop every cursor.
+ */
+struct Vec0InsertCursor {
+  struct Vec0InsertCursor *next;
+  u64 hash;
+  // the partition key values, see vec0_insert_cursor_get()
+  char *key;
+  int nKey;
+  // 0 until an insert into the partition found a chunk
+  i64 chunk_id;
+  i64 next_offset;
+};
+
+static void vec0_insert_cursors_clear(vec0_vtab *p) {
+  for (int i = 0; i < p->insertCursorsCapacity; i++) {
+    struct Vec0InsertCursor *cursor = p->insertCursors[i];
+    while (cursor) {
+      struct Vec0InsertCursor *next = cursor->next;
+      sqlite3_free(cursor->key);
+      sqlite3_free(cursor);
+      cursor = next;
+    }
+    p->insertCursors[i] = NULL;
+  }
+  p->numInsertCursors = 0;
+}
+
+/**
+ * @brief Drop the insert cursors if another connection committed since they
+ * were filled, going by PRAGMA data_version. Checked once per transaction:
+ * once this one has read the database, no other can commit under it.
+ */
+static int vec0_insert_cursors_check(vec0_vtab *p) {
+  int rc;
+  if (p->insertCursorsChecked) {
+    return SQLITE_OK;
+  }
+  if (!p->stmtDataVersion) {
+    char *zSql = sqlite3_mprintf("PRAGMA \"%w\".data_version", p->schemaName);
+    if (!zSql) {
+      return SQLITE_NOMEM;
+    }
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &p->stmtDataVersion, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  rc = sqlite3_step(p->stmtDataVersion);
+  if (rc != SQLITE_ROW) {
+    sqlite3_reset(p->stmtDataVersion);
+    return SQLITE_ERROR;
+  }
+  i64 version = sqlite3_column_int64(p->stmtDataVersion, 0);
+  sqlite3_reset(p->stmtDataVersion);
+  if (version != p->insertCursorsDataVersion) {
+    vec0_insert_cursors_clear(p);
+    p->insertCursorsDataVersion = version;
+  }
+  p->insertCursorsChecked = 1;
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Serialize partition key values into a key that is equal for equal
+ * values: a type byte then the value of each partition key column.
+ *
+ * @param pKey output key, to be freed with sqlite3_free(). NULL when the table
+ * has no partition key columns.
+ * @param pnKey output length of the key
+ * @return SQLITE_OK, SQLITE_EMPTY if any value is NULL, or SQLITE_NOMEM
+ */
+static int vec0_partition_key(vec0_vtab *p, sqlite3_value **partitionKeyValues,
+                              char **pKey, int *pnKey) {
+  *pKey = NULL;
+  *pnKey = 0;
+  sqlite3_str *s = sqlite3_str_new(NULL);
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    sqlite3_value *value = partitionKeyValues[i];
+    if (sqlite3_value_type(value) == SQLITE_INTEGER) {
+      i64 x = sqlite3_value_int64(value);
+      sqlite3_str_appendchar(s, 1, 'i');
+      sqlite3_str_append(s, (const char *)&x, sizeof(x));
+    } else if (sqlite3_value_type(value) == SQLITE_TEXT) {
+      const char *text = (const char *)sqlite3_value_text(value);
+      int n = sqlite3_value_bytes(value);
+      sqlite3_str_appendchar(s, 1, 't');
+      sqlite3_str_append(s, (const char *)&n, sizeof(n));
+      sqlite3_str_append(s, text, n);
+    } else {
+      sqlite3_free(sqlite3_str_finish(s));
+      return SQLITE_EMPTY;
+    }
+  }
+  if (sqlite3_str_errcode(s) != SQLITE_OK) {
+    sqlite3_free(sqlite3_str_finish(s));
+    return SQLITE_NOMEM;
+  }
+  *pnKey = sqlite3_str_length(s);
+  *pKey = sqlite3_str_finish(s);
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Find or add the insert cursor of a partition. Sets *out to NULL for
+ * NULL partition key values, which never match an existing chunk.
+ */
+static int vec0_insert_cursor_get(vec0_vtab *p,
+                                  sqlite3_value **partitionKeyValues,
+                                  struct Vec0InsertCursor **out) {
+  int rc;
+  char *key;
+  int nKey;
+  *out = NULL;
+
+  rc = vec0_partition_key(p, partitionKeyValues, &key, &nKey);
+  if (rc == SQLITE_EMPTY) {
+    return SQLITE_OK;
+  }
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  // FNV-1a
+  u64 hash = 14695981039346656037ULL;
+  for (int i = 0; i < nKey; i++) {
+    hash = (hash ^ (u8)key[i]) * 1099511628211ULL;
+  }
+
+  if (p->insertCursorsCapacity) {
+    struct Vec0InsertCursor *cursor =
+        p->insertCursors[hash % p->insertCursorsCapacity];
+    for (; cursor; cursor = cursor->next) {
+      if (cursor->hash == hash && cursor->nKey == nKey &&
+          (nKey == 0 || memcmp(cursor->key, key, nKey) == 0)) {
+        sqlite3_free(key);
+        *out = cursor;
+        return SQLITE_OK;
+      }
+    }
+  }
+
+  if (p->numInsertCursors >= VEC0_INSERT_CURSORS_MAX) {
+    vec0_insert_cursors_clear(p);
+  }
+  if (p->numInsertCursors >= p->insertCursorsCapacity) {
+    int capacity = p->insertCursorsCapacity ? p->insertCursorsCapacity * 2 : 16;
+    struct Vec0InsertCursor **buckets =
+        sqlite3_malloc64(capacity * sizeof(*buckets));
+    if (!buckets) {
+      sqlite3_free(key);
+      return SQLITE_NOMEM;
+    }
+    memset(buckets, 0, capacity * sizeof(*buckets));
+    for (int i = 0; i < p->insertCursorsCapacity; i++) {
+      struct Vec0InsertCursor *cursor = p->insertCursors[i];
+      while (cursor) {
+        struct Vec0InsertCursor *next = cursor->next;
+        cursor->next = buckets[cursor->hash % capacity];
+        buckets[cursor->hash % capacity] = cursor;
+        cursor = next;
+      }
+    }
+    sqlite3_free(p->insertCursors);
+    p->insertCursors = buckets;
+    p->insertCursorsCapacity = capacity;
+  }
+
+  struct Vec0InsertCursor *cursor = sqlite3_malloc(sizeof(*cursor));
+  if (!cursor) {
+    sqlite3_free(key);
+    return SQLITE_NOMEM;
+  }
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->hash = hash;
+  cursor->key = key;
+  cursor->nKey = nKey;
+  cursor->next = p->insertCursors[hash % p->insertCursorsCapacity];
+  p->insertCursors[hash % p->insertCursorsCapacity] = cursor;
+  p->numInsertCursors++;
+  *out = cursor;
+  return SQLITE_OK;
+}
+
 /**
  * @brief Determines the "next available" chunk position for a newly inserted
  * vec0 row.
@@ -8696,9 +14320,27 @@ int vec0Update_InsertNextAvailableStep(
 
   int rc;
   i64 validitySize;
+  i64 startOffset = 0;
+  struct Vec0InsertCursor *cursor = NULL;
   *chunk_offset = -1;
 
-  rc = vec0_get_latest_chunk_rowid(p, chunk_rowid, partitionKeyValues);
+  rc = vec0_insert_cursors_check(p);
+  if (rc == SQLITE_OK) {
+    rc = vec0_insert_cursor_get(p, partitionKeyValues, &cursor);
+  }
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  if (cursor && cursor->chunk_id) {
+    // the partition's last insert went here, try the slots after it
+    *chunk_rowid = cursor->chunk_id;
+    startOffset = cursor->next_offset;
+  } else if (p->shadowFreeSlotsName) {
+    rc = vec0_free_slots_next_chunk(p, partitionKeyValues, chunk_rowid);
+  } else {
+    rc = vec0_get_latest_chunk_rowid(p, chunk_rowid, partitionKeyValues);
+  }
   if(rc == SQLITE_EMPTY) {
     goto done;
   }
@@ -8750,10 +14392,13 @@ int vec0Update_InsertNextAvailableStep(
   }
 
   // find the next available offset, ie first `0` in the bitmap.
-  for (int i = 0; i < validitySize; i++) {
+  for (int i = startOffset / CHAR_BIT; i < validitySize; i++) {
     if ((*bufferChunksValidity)[i] == 0b11111111)
       continue;
     for (int j = 0; j < CHAR_BIT; j++) {
+      if ((i * CHAR_BIT) + j < startOffset) {
+        continue;
+      }
       if (((((*bufferChunksValidity)[i] >> j) & 1) == 0)) {
         *chunk_offset = (i * CHAR_BIT) + j;
         goto done;
@@ -8761,9 +14406,32 @@ int vec0Update_InsertNextAvailableStep(
     }
   }
 
+  if (cursor && cursor->chunk_id) {
+    // the cursor's chunk filled up, look the next one up
+    rc = sqlite3_blob_close(*blobChunksValidity);
+    sqlite3_free((void *)*bufferChunksValidity);
+    *blobChunksValidity = NULL;
+    *bufferChunksValidity = NULL;
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+    cursor->chunk_id = 0;
+    return vec0Update_InsertNextAvailableStep(p, partitionKeyValues,
+                                              chunk_rowid, chunk_offset,
+                                              blobChunksValidity,
+                                              bufferChunksValidity);
+  }
+
 done:
   // latest chunk was full, so need to create a new one
   if (*chunk_offset == -1) {
+    if (rc == SQLITE_OK) {
+      // a chunk listed with free slots that has none: stop offering it
+      rc = vec0_free_slots_clear(p, *chunk_rowid);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
     rc = vec0_new_chunk(p, partitionKeyValues, chunk_rowid);
     if (rc != SQLITE_OK) {
       // IMP: V08441_25279
@@ -8822,7 +14490,11 @@ done:
     }
   }
 
-  rc = SQLITE_OK;
+  if (cursor) {
+    cursor->chunk_id = *chunk_rowid;
+    cursor->next_offset = *chunk_offset + 1;
+  }
+  rc = vec0_free_slots_update(p, *chunk_rowid, -1);
 
 cleanup:
   return rc;
@@ -8953,6 +14625,13 @@ int vec0Update_InsertWriteFinalStep(vec0_vtab *p, i64 chunk_rowid,
       rc = SQLITE_ERROR;
       goto cleanup;
     }
+
+    if (p->shadowVectorBoundsNames[i]) {
+      rc = vec0_vector_bounds_add(p, i, chunk_rowid, vectorDatas[i], 1);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
   }
 
   // write the new rowid to the rowids column of the _chunks table
@@ -9002,46 +14681,54 @@ cleanup:
   return rc;
 }
 
-int vec0_write_metadata_value(vec0_vtab *p, int metadata_column_idx, i64 rowid, i64 chunk_id, i64 chunk_offset, sqlite3_value * v, int isupdate) {
-  int rc;
+/**
+ * @brief Verify a value written to a metadata column matches the column type.
+ */
+static int vec0_metadata_value_check(vec0_vtab *p, int metadata_column_idx, sqlite3_value * v) {
   struct Vec0MetadataColumnDefinition * metadata_column = &p->metadata_columns[metadata_column_idx];
-  vec0_metadata_column_kind kind = metadata_column->kind;
-
-  // verify input value matches column type
-  switch(kind) {
+  switch(metadata_column->kind) {
     case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
       if(sqlite3_value_type(v) != SQLITE_INTEGER || ((sqlite3_value_int(v) != 0) && (sqlite3_value_int(v) != 1))) {
-        rc = SQLITE_ERROR;
         vtab_set_error(&p->base, "Expected 0 or 1 for BOOLEAN metadata column %.*s", metadata_column->name_length, metadata_column->name);
-        goto done;
+        return SQLITE_ERROR;
       }
       break;
     }
     case VEC0_METADATA_COLUMN_KIND_INTEGER: {
       if(sqlite3_value_type(v) != SQLITE_INTEGER) {
-        rc = SQLITE_ERROR;
         vtab_set_error(&p->base, "Expected integer for INTEGER metadata column %.*s, received %s", metadata_column->name_length, metadata_column->name, type_name(sqlite3_value_type(v)));
-        goto done;
+        return SQLITE_ERROR;
       }
       break;
     }
     case VEC0_METADATA_COLUMN_KIND_FLOAT: {
       if(sqlite3_value_type(v) != SQLITE_FLOAT) {
-        rc = SQLITE_ERROR;
         vtab_set_error(&p->base, "Expected float for FLOAT metadata column %.*s, received %s", metadata_column->name_length, metadata_column->name, type_name(sqlite3_value_type(v)));
-        goto done;
+        return SQLITE_ERROR;
       }
       break;
     }
     case VEC0_METADATA_COLUMN_KIND_TEXT: {
       if(sqlite3_value_type(v) != SQLITE_TEXT) {
-        rc = SQLITE_ERROR;
         vtab_set_error(&p->base, "Expected text for TEXT metadata column %.*s, received %s", metadata_column->name_length, metadata_column->name, type_name(sqlite3_value_type(v)));
-        goto done;
+        return SQLITE_ERROR;
       }
       break;
     }
   }
+  return SQLITE_OK;
+}
+
+int vec0_write_metadata_value(vec0_vtab *p, int metadata_column_idx, i64 rowid, i64 chunk_id, i64 chunk_offset, sqlite3_value * v, int isupdate) {
+  int rc;
+  struct Vec0MetadataColumnDefinition * metadata_column = &p->metadata_columns[metadata_column_idx];
+  vec0_metadata_column_kind kind = metadata_column->kind;
+
+  // verify input value matches column type
+  rc = vec0_metadata_value_check(p, metadata_column_idx, v);
+  if(rc != SQLITE_OK) {
+    goto done;
+  }
 
   sqlite3_blob * blobValue = NULL;
   rc = sqlite3_blob_open(p->db, p->schemaName, p->shadowMetadataChunksNames[metadata_column_idx], "data", chunk_id, 1, &blobValue);
@@ -9078,6 +14765,15 @@ int vec0_write_metadata_value(vec0_vtab *p, int metadata_column_idx, i64 rowid,
       break;
     }
     case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      if(metadata_column->dictionary) {
+        i64 code;
+        rc = vec0_metadata_dict_code(p, metadata_column_idx, v, 1, &code);
+        if(rc != SQLITE_OK) {
+          goto done;
+        }
+        rc = sqlite3_blob_write(blobValue, &code, sizeof(code), chunk_offset * sizeof(i64));
+        break;
+      }
       int prev_n;
       rc = sqlite3_blob_read(blobValue, &prev_n, sizeof(int), chunk_offset * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH);
       if(rc != SQLITE_OK) {
@@ -9139,20 +14835,534 @@ int vec0_write_metadata_value(vec0_vtab *p, int metadata_column_idx, i64 rowid,
           goto done;
         }
       }
-      break;
+      break;
+    }
+  }
+
+  if(rc != SQLITE_OK) {
+
+  }
+  rc = sqlite3_blob_close(blobValue);
+  if(rc != SQLITE_OK) {
+    goto done;
+  }
+
+  if(p->shadowMetadataBoundsNames[metadata_column_idx]) {
+    union Vec0MetadataBound bound;
+    if(kind == VEC0_METADATA_COLUMN_KIND_FLOAT) {
+      bound.f = sqlite3_value_double(v);
+    }else if(kind == VEC0_METADATA_COLUMN_KIND_BOOLEAN) {
+      bound.i = sqlite3_value_int(v) != 0;
+    }else {
+      bound.i = sqlite3_value_int64(v);
+    }
+    rc = vec0_metadata_bounds_add(p, metadata_column_idx, chunk_id, bound, bound);
+    if(rc != SQLITE_OK) {
+      goto done;
+    }
+    if(isupdate) {
+      // the overwritten value may have been one end of the range
+      rc = vec0_metadata_bounds_remove(p, metadata_column_idx, chunk_id);
+    }
+  }
+
+  done:
+    return rc;
+}
+
+
+// Most rows the 'write_behind=N' command accepts.
+#ifndef VEC0_WRITE_BEHIND_MAX
+#define VEC0_WRITE_BEHIND_MAX 1048576
+#endif
+
+/**
+ * @brief An inserted row waiting in the write-behind buffer. Its _rowids and
+ * _auxiliary rows are already written, only its chunk slot is not.
+ */
+struct Vec0StagedRow {
+  i64 rowid;
+  // the partition key values, see vec0_partition_key()
+  char *key;
+  int nKey;
+  sqlite3_value *partitionKeyValues[VEC0_MAX_PARTITION_COLUMNS];
+  sqlite3_value *metadataValues[VEC0_MAX_METADATA_COLUMNS];
+  // the vector of every vector column, back to back
+  u8 *vectors;
+};
+
+static void vec0_staged_rows_free(struct Vec0StagedRow *rows, int n) {
+  for (int i = 0; i < n; i++) {
+    sqlite3_free(rows[i].key);
+    sqlite3_free(rows[i].vectors);
+    for (int j = 0; j < VEC0_MAX_PARTITION_COLUMNS; j++) {
+      sqlite3_value_free(rows[i].partitionKeyValues[j]);
+    }
+    for (int j = 0; j < VEC0_MAX_METADATA_COLUMNS; j++) {
+      sqlite3_value_free(rows[i].metadataValues[j]);
+    }
+  }
+}
+
+/**
+ * @brief Drop every staged row, when the transaction or savepoint that
+ * inserted them rolls back.
+ */
+static void vec0_write_behind_discard(vec0_vtab *p) {
+  vec0_staged_rows_free(p->stagedRows, p->numStagedRows);
+  p->numStagedRows = 0;
+}
+
+/**
+ * @brief Stage an inserted row instead of writing it to a chunk.
+ *
+ * @return SQLITE_OK when staged, SQLITE_EMPTY if the row has a NULL partition
+ * key value and must be written right away, error code otherwise
+ */
+static int vec0_write_behind_stage(vec0_vtab *p, i64 rowid,
+                                   sqlite3_value **partitionKeyValues,
+                                   void **vectorDatas,
+                                   sqlite3_value **metadataValues) {
+  int rc;
+  char *key;
+  int nKey;
+  size_t vectorsSize = 0;
+
+  // checked here, as the row is only written to the metadata chunks later
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    rc = vec0_metadata_value_check(p, i, metadataValues[i]);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+
+  rc = vec0_partition_key(p, partitionKeyValues, &key, &nKey);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  if (p->numStagedRows >= p->stagedRowsCapacity) {
+    int capacity = p->stagedRowsCapacity ? p->stagedRowsCapacity * 2 : 64;
+    struct Vec0StagedRow *rows =
+        sqlite3_realloc64(p->stagedRows, capacity * sizeof(*rows));
+    if (!rows) {
+      sqlite3_free(key);
+      return SQLITE_NOMEM;
+    }
+    p->stagedRows = rows;
+    p->stagedRowsCapacity = capacity;
+  }
+
+  struct Vec0StagedRow *row = &p->stagedRows[p->numStagedRows];
+  memset(row, 0, sizeof(*row));
+  row->rowid = rowid;
+  row->key = key;
+  row->nKey = nKey;
+
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    vectorsSize += vector_column_byte_size(p->vector_columns[i]);
+  }
+  row->vectors = sqlite3_malloc64(vectorsSize);
+  if (!row->vectors) {
+    rc = SQLITE_NOMEM;
+    goto error;
+  }
+  vectorsSize = 0;
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    size_t size = vector_column_byte_size(p->vector_columns[i]);
+    memcpy(row->vectors + vectorsSize, vectorDatas[i], size);
+    vectorsSize += size;
+  }
+
+  for (int i = 0; i < p->numPartitionColumns; i++) {
+    row->partitionKeyValues[i] = sqlite3_value_dup(partitionKeyValues[i]);
+    if (!row->partitionKeyValues[i]) {
+      rc = SQLITE_NOMEM;
+      goto error;
+    }
+  }
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    row->metadataValues[i] = sqlite3_value_dup(metadataValues[i]);
+    if (!row->metadataValues[i]) {
+      rc = SQLITE_NOMEM;
+      goto error;
+    }
+  }
+
+  p->numStagedRows++;
+  return SQLITE_OK;
+
+error:
+  vec0_staged_rows_free(row, 1);
+  return rc;
+}
+
+static int vec0_staged_row_same_partition(const struct Vec0StagedRow *a,
+                                          const struct Vec0StagedRow *b) {
+  return a->nKey == b->nKey &&
+         (a->nKey == 0 || memcmp(a->key, b->key, a->nKey) == 0);
+}
+
+// qsort() comparator: by partition, then in insertion order
+static int vec0_staged_row_cmp(const void *pa, const void *pb) {
+  const struct Vec0StagedRow *a = *(const struct Vec0StagedRow **)pa;
+  const struct Vec0StagedRow *b = *(const struct Vec0StagedRow **)pb;
+  if (a->nKey != b->nKey) {
+    return a->nKey < b->nKey ? -1 : 1;
+  }
+  int c = a->nKey ? memcmp(a->key, b->key, a->nKey) : 0;
+  if (c != 0) {
+    return c;
+  }
+  return (a > b) - (a < b);
+}
+
+/**
+ * @brief Open a blob of a chunk for writing and read all of it into *pBuffer,
+ * which the caller writes back, closing *pBlob and freeing *pBuffer.
+ */
+static int vec0_chunk_blob_read(vec0_vtab *p, const char *zTable,
+                                const char *zColumn, i64 chunk_id, i64 size,
+                                sqlite3_blob **pBlob, u8 **pBuffer) {
+  int rc;
+  *pBuffer = NULL;
+  rc = sqlite3_blob_open(p->db, p->schemaName, zTable, zColumn, chunk_id, 1,
+                         pBlob);
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base,
+                   VEC_INTERAL_ERROR "could not open %s blob on %s.%s.%lld",
+                   zColumn, p->schemaName, zTable, chunk_id);
+    return rc;
+  }
+  if (sqlite3_blob_bytes(*pBlob) != size) {
+    vtab_set_error(&p->base,
+                   VEC_INTERAL_ERROR
+                   "%s blob size mismatch on %s.%s.%lld. Expected %lld, "
+                   "actual %d",
+                   zColumn, p->schemaName, zTable, chunk_id, size,
+                   sqlite3_blob_bytes(*pBlob));
+    return SQLITE_ERROR;
+  }
+  *pBuffer = sqlite3_malloc64(size);
+  if (!*pBuffer) {
+    return SQLITE_NOMEM;
+  }
+  return sqlite3_blob_read(*pBlob, *pBuffer, size, 0);
+}
+
+/**
+ * @brief Write staged rows of one partition into the next chunk of it with
+ * free slots, as many as fit. Each shadow table blob of the chunk is read and
+ * written back once.
+ *
+ * @param rows staged rows of the same partition, in insertion order
+ * @param n number of rows
+ * @param written output, how many of rows went into the chunk
+ */
+static int vec0_write_behind_flush_chunk(vec0_vtab *p,
+                                         struct Vec0StagedRow **rows, int n,
+                                         int *written) {
+  int rc, brc;
+  i64 chunk_id;
+  i64 chunk_offset;
+  sqlite3_blob *blobChunksValidity = NULL;
+  unsigned char *bufferChunksValidity = NULL;
+  sqlite3_blob *blob = NULL;
+  u8 *buffer = NULL;
+  i64 *offsets = NULL;
+  i64 *rowids = NULL;
+  f32 *gathered = NULL;
+  sqlite3_stmt *stmtText = NULL;
+  int count = 0;
+  size_t vectorOffset = 0;
+
+  // takes the first free slot of the chunk
+  rc = vec0Update_InsertNextAvailableStep(
+      p, rows[0]->partitionKeyValues, &chunk_id, &chunk_offset,
+      &blobChunksValidity, (const unsigned char **)&bufferChunksValidity);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  offsets = sqlite3_malloc64(min(n, p->chunk_size) * sizeof(i64));
+  rowids = sqlite3_malloc64(min(n, p->chunk_size) * sizeof(i64));
+  if (!offsets || !rowids) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  offsets[count++] = chunk_offset;
+  for (i64 o = chunk_offset + 1; o < p->chunk_size && count < n; o++) {
+    if (!((bufferChunksValidity[o / CHAR_BIT] >> (o % CHAR_BIT)) & 1)) {
+      offsets[count++] = o;
+    }
+  }
+  for (int j = 0; j < count; j++) {
+    bufferChunksValidity[offsets[j] / CHAR_BIT] |= 1 << (offsets[j] % CHAR_BIT);
+  }
+  rc = sqlite3_blob_write(blobChunksValidity, bufferChunksValidity,
+                          p->chunk_size / CHAR_BIT, 0);
+  if (rc != SQLITE_OK) {
+    vtab_set_error(&p->base, VEC_INTERAL_ERROR "could not mark validity bits");
+    goto cleanup;
+  }
+  // the first slot was already counted by vec0Update_InsertNextAvailableStep()
+  rc = vec0_free_slots_update(p, chunk_id, -(count - 1));
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  rc = vec0_chunk_blob_read(p, p->shadowChunksName, "rowids", chunk_id,
+                            p->chunk_size * sizeof(i64), &blob, &buffer);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  for (int j = 0; j < count; j++) {
+    memcpy(buffer + offsets[j] * sizeof(i64), &rows[j]->rowid, sizeof(i64));
+  }
+  rc = sqlite3_blob_write(blob, buffer, p->chunk_size * sizeof(i64), 0);
+  brc = sqlite3_blob_close(blob);
+  blob = NULL;
+  sqlite3_free(buffer);
+  buffer = NULL;
+  if (rc == SQLITE_OK) {
+    rc = brc;
+  }
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    size_t size = vector_column_byte_size(p->vector_columns[i]);
+    enum Vec0IndexType index_type = p->vector_columns[i].index_type;
+    // where the column's vector starts in each staged row
+    size_t columnOffset = vectorOffset;
+    vectorOffset += size;
+    if (index_type == VEC0_INDEX_TYPE_FLAT) {
+      rc = vec0_chunk_blob_read(p, p->shadowVectorChunksNames[i], "vectors",
+                                chunk_id, p->chunk_size * size, &blob, &buffer);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+      for (int j = 0; j < count; j++) {
+        memcpy(buffer + offsets[j] * size, rows[j]->vectors + columnOffset,
+               size);
+      }
+      rc = sqlite3_blob_write(blob, buffer, p->chunk_size * size, 0);
+      brc = sqlite3_blob_close(blob);
+      blob = NULL;
+      sqlite3_free(buffer);
+      buffer = NULL;
+      if (rc == SQLITE_OK) {
+        rc = brc;
+      }
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+
+    // bounds and rescore take the column's vectors back to back
+    if (!p->shadowVectorBoundsNames[i] &&
+        index_type != VEC0_INDEX_TYPE_RESCORE) {
+      continue;
+    }
+    gathered = sqlite3_malloc64(count * size);
+    if (!gathered) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+    for (int j = 0; j < count; j++) {
+      memcpy((u8 *)gathered + j * size, rows[j]->vectors + columnOffset, size);
+    }
+    if (p->shadowVectorBoundsNames[i]) {
+      rc = vec0_vector_bounds_add(p, i, chunk_id, gathered, count);
+    }
+#if SQLITE_VEC_ENABLE_RESCORE
+    if (rc == SQLITE_OK && index_type == VEC0_INDEX_TYPE_RESCORE) {
+      for (int j = 0; j < count; j++) {
+        rowids[j] = rows[j]->rowid;
+      }
+      rc = rescore_on_insert_rows(p, i, chunk_id, offsets, rowids, gathered,
+                                  count);
+    }
+#endif
+    sqlite3_free(gathered);
+    gathered = NULL;
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
+
+  // same encoding as vec0_write_metadata_value()
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    vec0_metadata_column_kind kind = p->metadata_columns[i].kind;
+    i64 size = vec0_metadata_chunk_size(
+        vec0_metadata_storage_kind(&p->metadata_columns[i]), p->chunk_size);
+    rc = vec0_chunk_blob_read(p, p->shadowMetadataChunksNames[i], "data",
+                              chunk_id, size, &blob, &buffer);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+    for (int j = 0; j < count && rc == SQLITE_OK; j++) {
+      sqlite3_value *v = rows[j]->metadataValues[i];
+      i64 o = offsets[j];
+      switch (kind) {
+      case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+        if (sqlite3_value_int(v)) {
+          buffer[o / CHAR_BIT] |= 1 << (o % CHAR_BIT);
+        } else {
+          buffer[o / CHAR_BIT] &= ~(1 << (o % CHAR_BIT));
+        }
+        break;
+      }
+      case VEC0_METADATA_COLUMN_KIND_INTEGER: {
+        i64 value = sqlite3_value_int64(v);
+        memcpy(buffer + o * sizeof(i64), &value, sizeof(value));
+        break;
+      }
+      case VEC0_METADATA_COLUMN_KIND_FLOAT: {
+        double value = sqlite3_value_double(v);
+        memcpy(buffer + o * sizeof(double), &value, sizeof(value));
+        break;
+      }
+      case VEC0_METADATA_COLUMN_KIND_TEXT: {
+        if (p->metadata_columns[i].dictionary) {
+          i64 code;
+          rc = vec0_metadata_dict_code(p, i, v, 1, &code);
+          memcpy(buffer + o * sizeof(i64), &code, sizeof(code));
+          break;
+        }
+        const char *s = (const char *)sqlite3_value_text(v);
+        int nText = sqlite3_value_bytes(v);
+        u8 *view = buffer + o * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+        memset(view, 0, VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH);
+        memcpy(view, &nText, sizeof(int));
+        memcpy(view + 4, s, min(nText, VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH - 4));
+        if (nText <= VEC0_METADATA_TEXT_VIEW_DATA_LENGTH) {
+          break;
+        }
+        if (!stmtText) {
+          char *zSql = sqlite3_mprintf(
+              "INSERT INTO " VEC0_SHADOW_METADATA_TEXT_DATA_NAME
+              " (rowid, data) VALUES (?1, ?2)",
+              p->schemaName, p->tableName, i);
+          if (!zSql) {
+            rc = SQLITE_NOMEM;
+            break;
+          }
+          rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmtText, NULL);
+          sqlite3_free(zSql);
+          if (rc != SQLITE_OK) {
+            break;
+          }
+        }
+        sqlite3_bind_int64(stmtText, 1, rows[j]->rowid);
+        sqlite3_bind_text(stmtText, 2, s, nText, SQLITE_STATIC);
+        rc = sqlite3_step(stmtText);
+        sqlite3_reset(stmtText);
+        rc = rc == SQLITE_DONE ? SQLITE_OK : SQLITE_ERROR;
+        break;
+      }
+      }
+    }
+    union Vec0MetadataBound lo = {0}, hi = {0};
+    if (p->shadowMetadataBoundsNames[i]) {
+      lo = hi = vec0_metadata_bound_at(kind, buffer, offsets[0]);
+      for (int j = 1; j < count; j++) {
+        vec0_metadata_bound_widen(kind, &lo, &hi,
+                                  vec0_metadata_bound_at(kind, buffer, offsets[j]));
+      }
+    }
+    sqlite3_finalize(stmtText);
+    stmtText = NULL;
+    if (rc == SQLITE_OK) {
+      rc = sqlite3_blob_write(blob, buffer, size, 0);
+    }
+    brc = sqlite3_blob_close(blob);
+    blob = NULL;
+    sqlite3_free(buffer);
+    buffer = NULL;
+    if (rc == SQLITE_OK) {
+      rc = brc;
+    }
+    if (rc == SQLITE_OK && p->shadowMetadataBoundsNames[i]) {
+      rc = vec0_metadata_bounds_add(p, i, chunk_id, lo, hi);
+    }
+    if (rc != SQLITE_OK) {
+      goto cleanup;
     }
   }
 
-  if(rc != SQLITE_OK) {
+  for (int j = 0; j < count; j++) {
+    rc = vec0_rowids_update_position(p, rows[j]->rowid, chunk_id, offsets[j]);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
+  *written = count;
+
+cleanup:
+  sqlite3_free(offsets);
+  sqlite3_free(rowids);
+  sqlite3_free(buffer);
+  sqlite3_blob_close(blob);
+  sqlite3_free(bufferChunksValidity);
+  brc = sqlite3_blob_close(blobChunksValidity);
+  if (rc == SQLITE_OK) {
+    rc = brc;
+  }
+  return rc;
+}
 
+/**
+ * @brief Write every staged row to a chunk of its partition. Rows are grouped
+ * by partition, so a chunk takes all the rows it has room for in one write per
+ * shadow table, instead of one small write per row and table.
+ *
+ * Called before anything reads or changes the chunks: queries, deletes,
+ * updates, commands, savepoints and the commit (from xSync).
+ */
+static int vec0_write_behind_flush(vec0_vtab *p) {
+  int rc = SQLITE_OK;
+  struct Vec0StagedRow *staged = p->stagedRows;
+  struct Vec0StagedRow **rows = NULL;
+  int n = p->numStagedRows;
+  if (n == 0) {
+    return SQLITE_OK;
   }
-  rc = sqlite3_blob_close(blobValue);
-  if(rc != SQLITE_OK) {
-    goto done;
+  // the writes below can start a statement savepoint, which flushes again
+  p->stagedRows = NULL;
+  p->numStagedRows = 0;
+  p->stagedRowsCapacity = 0;
+
+  rows = sqlite3_malloc64(n * sizeof(*rows));
+  if (!rows) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
   }
+  for (int i = 0; i < n; i++) {
+    rows[i] = &staged[i];
+  }
+  qsort(rows, n, sizeof(*rows), vec0_staged_row_cmp);
 
-  done:
-    return rc;
+  for (int i = 0; i < n && rc == SQLITE_OK;) {
+    int end = i + 1;
+    while (end < n && vec0_staged_row_same_partition(rows[i], rows[end])) {
+      end++;
+    }
+    while (i < end && rc == SQLITE_OK) {
+      int written = 0;
+      rc = vec0_write_behind_flush_chunk(p, rows + i, end - i, &written);
+      i += written;
+    }
+  }
+
+cleanup:
+  // dropped on errors too, the statement fails and retrying could write rows
+  // twice
+  sqlite3_free(rows);
+  vec0_staged_rows_free(staged, n);
+  sqlite3_free(staged);
+  return rc;
 }
 
 
@@ -9180,6 +15390,9 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
   vector_cleanup cleanups[VEC0_MAX_VECTOR_COLUMNS];
 
   sqlite3_value * partitionKeyValues[VEC0_MAX_PARTITION_COLUMNS];
+  sqlite3_value * metadataValues[VEC0_MAX_METADATA_COLUMNS];
+  // whether the row went to the write-behind buffer, see 'write_behind=N'
+  int staged = 0;
 
   // Rowid of the chunk in the _chunks shadow table that the row will be a part
   // of.
@@ -9265,6 +15478,13 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
       rc = SQLITE_ERROR;
       goto cleanup;
     }
+    if (p->vector_columns[vector_column_idx].normalize) {
+      rc = vector_normalize_f32(&vectorDatas[vector_column_idx], dimensions,
+                                &cleanups[vector_column_idx]);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
   }
 
   // Cannot insert a value in the hidden "distance" column
@@ -9283,6 +15503,15 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
     rc = SQLITE_ERROR;
     goto cleanup;
   }
+  // Cannot insert a value in the hidden "query_idx" column
+  if (p->hasQueryIdxColumn &&
+      sqlite3_value_type(argv[2 + vec0_column_query_idx_idx(p)]) !=
+          SQLITE_NULL) {
+    vtab_set_error(pVTab,
+                   "A value was provided for the hidden \"query_idx\" column.");
+    rc = SQLITE_ERROR;
+    goto cleanup;
+  }
 
   // Handle INSERT OR REPLACE: if the conflict resolution is REPLACE and the
   // row already exists, delete the existing row first before inserting.
@@ -9291,6 +15520,12 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
     int idType = sqlite3_value_type(idValue);
     int existingRowExists = 0;
 
+    // the existing row may still be staged
+    rc = vec0_write_behind_flush(p);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+
     if (p->pkIsText && idType == SQLITE_TEXT) {
       i64 existingRowid;
       rc = vec0_rowid_from_id(p, idValue, &existingRowid);
@@ -9328,7 +15563,25 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
     goto cleanup;
   }
 
-  if (!vec0_all_columns_diskann(p)) {
+  if (p->writeBehind) {
+    // Steps #2 and #3, and the metadata values, are left to
+    // vec0_write_behind_flush()
+    for (int i = 0; i < vec0_num_defined_user_columns(p); i++) {
+      if (p->user_column_kinds[i] == SQLITE_VEC0_USER_COLUMN_KIND_METADATA) {
+        metadataValues[p->user_column_idxs[i]] =
+            argv[2 + VEC0_COLUMN_USERN_START + i];
+      }
+    }
+    rc = vec0_write_behind_stage(p, rowid, partitionKeyValues, vectorDatas,
+                                 metadataValues);
+    if (rc == SQLITE_OK) {
+      staged = 1;
+    } else if (rc != SQLITE_EMPTY) {
+      goto cleanup;
+    }
+  }
+
+  if (!staged && !vec0_all_columns_diskann(p)) {
     // Step #2: Find the next "available" position in the _chunks table for this
     // row.
     rc = vec0Update_InsertNextAvailableStep(p, partitionKeyValues,
@@ -9437,7 +15690,7 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
   }
 
 
-  for(int i = 0; i < vec0_num_defined_user_columns(p); i++) {
+  for(int i = 0; !staged && i < vec0_num_defined_user_columns(p); i++) {
     if(p->user_column_kinds[i] != SQLITE_VEC0_USER_COLUMN_KIND_METADATA) {
       continue;
     }
@@ -9449,6 +15702,13 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
     }
   }
 
+  if (staged && p->numStagedRows >= p->writeBehind) {
+    rc = vec0_write_behind_flush(p);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
+
   *pRowid = rowid;
   rc = SQLITE_OK;
 
@@ -9702,6 +15962,30 @@ int vec0Update_Delete_DeleteChunkIfEmpty(vec0_vtab *p, i64 chunk_id,
       return SQLITE_ERROR;
   }
 
+  // Delete from each _vector_boundsNN
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (!p->shadowVectorBoundsNames[i])
+      continue;
+    zSql = sqlite3_mprintf(
+        "DELETE FROM " VEC0_SHADOW_VECTOR_BOUNDS_N_NAME " WHERE rowid = ?",
+        p->schemaName, p->tableName, i);
+    if (!zSql)
+      return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK)
+      return rc;
+    sqlite3_bind_int64(stmt, 1, chunk_id);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE)
+      return SQLITE_ERROR;
+  }
+
+  rc = vec0_free_slots_clear(p, chunk_id);
+  if (rc != SQLITE_OK)
+    return rc;
+
 #if SQLITE_VEC_ENABLE_RESCORE
   rc = rescore_delete_chunk(p, chunk_id);
   if (rc != SQLITE_OK)
@@ -9726,6 +16010,26 @@ int vec0Update_Delete_DeleteChunkIfEmpty(vec0_vtab *p, i64 chunk_id,
       return SQLITE_ERROR;
   }
 
+  // Delete from each _metadataboundsNN
+  for (int i = 0; i < p->numMetadataColumns; i++) {
+    if (!p->shadowMetadataBoundsNames[i])
+      continue;
+    zSql = sqlite3_mprintf(
+        "DELETE FROM " VEC0_SHADOW_METADATA_BOUNDS_N_NAME " WHERE rowid = ?",
+        p->schemaName, p->tableName, i);
+    if (!zSql)
+      return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+    sqlite3_free(zSql);
+    if (rc != SQLITE_OK)
+      return rc;
+    sqlite3_bind_int64(stmt, 1, chunk_id);
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE)
+      return SQLITE_ERROR;
+  }
+
   // Invalidate cached stmtLatestChunk so it gets re-prepared on next insert
   if (p->stmtLatestChunk) {
     sqlite3_finalize(p->stmtLatestChunk);
@@ -9825,6 +16129,11 @@ int vec0Update_Delete_ClearMetadata(vec0_vtab *p, int metadata_idx, i64 rowid, i
       break;
     }
     case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      if(p->metadata_columns[metadata_idx].dictionary) {
+        i64 v = 0;
+        rc = sqlite3_blob_write(blobValue, &v, sizeof(v), chunk_offset * sizeof(i64));
+        break;
+      }
       int n;
       rc = sqlite3_blob_read(blobValue, &n, sizeof(int), chunk_offset * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH);
       if(rc != SQLITE_OK) {
@@ -9891,6 +16200,9 @@ int vec0Update_Delete(sqlite3_vtab *pVTab, sqlite3_value *idValue) {
     rowid = sqlite3_value_int64(idValue);
   }
 
+  // the freed slot goes before the insert cursors' next ones
+  vec0_insert_cursors_clear(p);
+
   // 1. Find chunk position for given rowid
   // 2. Ensure that validity bit for position is 1, then set to 0
   // 3. Zero out rowid in chunks.rowid
@@ -9972,6 +16284,33 @@ int vec0Update_Delete(sqlite3_vtab *pVTab, sqlite3_value *idValue) {
       if (rc != SQLITE_OK) {
         return rc;
       }
+
+      // 9. otherwise the freed slot can be reused, and the chunk's boxes
+      // and value ranges may have lost a row on their edge
+      if (!chunkDeleted) {
+        rc = vec0_free_slots_update(p, chunk_id, 1);
+        if (rc != SQLITE_OK) {
+          return rc;
+        }
+      }
+      for (int i = 0; !chunkDeleted && i < p->numVectorColumns; i++) {
+        if (!p->shadowVectorBoundsNames[i]) {
+          continue;
+        }
+        rc = vec0_vector_bounds_remove(p, i, chunk_id);
+        if (rc != SQLITE_OK) {
+          return rc;
+        }
+      }
+      for (int i = 0; !chunkDeleted && i < p->numMetadataColumns; i++) {
+        if (!p->shadowMetadataBoundsNames[i]) {
+          continue;
+        }
+        rc = vec0_metadata_bounds_remove(p, i, chunk_id);
+        if (rc != SQLITE_OK) {
+          return rc;
+        }
+      }
     }
   }
 
@@ -10057,6 +16396,12 @@ int vec0Update_UpdateVectorColumn(vec0_vtab *p, i64 chunk_id, i64 chunk_offset,
     rc = SQLITE_ERROR;
     goto cleanup;
   }
+  if (p->vector_columns[i].normalize) {
+    rc = vector_normalize_f32(&vector, dimensions, &cleanup);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
 
 #if SQLITE_VEC_ENABLE_RESCORE
   if (p->vector_columns[i].index_type == VEC0_INDEX_TYPE_RESCORE) {
@@ -10127,6 +16472,19 @@ int vec0Update_UpdateVectorColumn(vec0_vtab *p, i64 chunk_id, i64 chunk_offset,
     goto cleanup;
   }
 
+  if (p->shadowVectorBoundsNames[i]) {
+    // the old vector may have been on the edge of the box, so an overwrite
+    // counts as a removal as well as a widening
+    rc = vec0_vector_bounds_add(p, i, chunk_id, vector, 1);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+    rc = vec0_vector_bounds_remove(p, i, chunk_id);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
+
 cleanup:
   cleanup(vector);
   int brc = sqlite3_blob_close(blobVectors);
@@ -10271,23 +16629,96 @@ int vec0Update_Update(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv) {
   return SQLITE_OK;
 }
 
+// Chunk reorganization, built on the vec0Update_Delete_* helpers above
+#include "sqlite-vec-reorganize.c"
+
+// Bulk loading from .npy/.fvecs/.bvecs files, through the write-behind buffer
+#include "sqlite-vec-import.c"
+
 static int vec0Update(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
                       sqlite_int64 *pRowid) {
+  vec0_vtab *p = (vec0_vtab *)pVTab;
+  int isInsert = argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL;
+  // deletes, updates and commands work on rows in their chunks
+  if (!isInsert || (p->hasCommandColumn &&
+                    sqlite3_value_type(argv[2 + vec0_column_command_idx(p)]) ==
+                        SQLITE_TEXT)) {
+    int rc = vec0_write_behind_flush(p);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+
   // DELETE operation
   if (argc == 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
     return vec0Update_Delete(pVTab, argv[0]);
   }
   // INSERT operation
-  else if (argc > 1 && sqlite3_value_type(argv[0]) == SQLITE_NULL) {
-    vec0_vtab *p = (vec0_vtab *)pVTab;
+  else if (isInsert) {
     // FTS5-style command dispatch via hidden column named after table
     if (p->hasCommandColumn) {
       sqlite3_value *cmdVal = argv[2 + vec0_column_command_idx(p)];
       if (sqlite3_value_type(cmdVal) == SQLITE_TEXT) {
         const char *cmd = (const char *)sqlite3_value_text(cmdVal);
-        int cmdRc = SQLITE_EMPTY;
+        int cmdRc;
+        if (strcmp(cmd, "release-scratch") == 0) {
+          vec0_scratch_free(&p->scratch);
+          return SQLITE_OK;
+        }
+        cmdRc = vec0_reorganize_handle_command(p, cmd);
+        if (cmdRc != SQLITE_EMPTY) {
+          return cmdRc;
+        }
+        cmdRc = vec0_import_handle_command(p, cmd);
+        if (cmdRc != SQLITE_EMPTY) {
+          return cmdRc;
+        }
+        if (strncmp(cmd, "write_behind=", 13) == 0) {
+          char *end = NULL;
+          long val = strtol(cmd + 13, &end, 10);
+          if (end == cmd + 13 || *end != '\0' || val < 0 ||
+              val > VEC0_WRITE_BEHIND_MAX) {
+            vtab_set_error(pVTab, "write_behind must be between 0 and %d",
+                           VEC0_WRITE_BEHIND_MAX);
+            return SQLITE_ERROR;
+          }
+          for (int i = 0; val && i < p->numVectorColumns; i++) {
+            if (p->vector_columns[i].index_type != VEC0_INDEX_TYPE_FLAT) {
+              vtab_set_error(pVTab, "write_behind is not supported on indexed "
+                                    "vector columns");
+              return SQLITE_ERROR;
+            }
+          }
+          p->writeBehind = (int)val;
+          return SQLITE_OK;
+        }
+#if SQLITE_VEC_ENABLE_PREFETCH
+        if (strncmp(cmd, "prefetch=", 9) == 0) {
+          if (strcmp(cmd + 9, "0") != 0 && strcmp(cmd + 9, "1") != 0) {
+            vtab_set_error(pVTab, "prefetch must be 0 or 1");
+            return SQLITE_ERROR;
+          }
+          p->prefetch = cmd[9] == '1';
+          return SQLITE_OK;
+        }
+#endif
+#if SQLITE_VEC_ENABLE_THREADS
+        if (strncmp(cmd, "threads=", 8) == 0) {
+          char *end = NULL;
+          long val = strtol(cmd + 8, &end, 10);
+          if (end == cmd + 8 || *end != '\0' || val < 0 ||
+              val > SQLITE_VEC_MAX_THREADS) {
+            vtab_set_error(pVTab, "threads must be between 0 and %d",
+                           SQLITE_VEC_MAX_THREADS);
+            return SQLITE_ERROR;
+          }
+          p->threads = (int)val;
+          return SQLITE_OK;
+        }
+#endif
 #if SQLITE_VEC_ENABLE_RESCORE
-        cmdRc = rescore_handle_command(p, cmd);
+        if (cmdRc == SQLITE_EMPTY)
+          cmdRc = rescore_handle_command(p, cmd);
 #endif
 #if SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
         if (cmdRc == SQLITE_EMPTY)
@@ -10355,6 +16786,23 @@ static int vec0ShadowName(const char *zName) {
   "metadatatext13",
   "metadatatext14",
   "metadatatext15",
+
+  "metadatadict00",
+  "metadatadict01",
+  "metadatadict02",
+  "metadatadict03",
+  "metadatadict04",
+  "metadatadict05",
+  "metadatadict06",
+  "metadatadict07",
+  "metadatadict08",
+  "metadatadict09",
+  "metadatadict10",
+  "metadatadict11",
+  "metadatadict12",
+  "metadatadict13",
+  "metadatadict14",
+  "metadatadict15",
   };
 
   for (size_t i = 0; i < sizeof(azName) / sizeof(azName[0]); i++) {
@@ -10366,16 +16814,33 @@ static int vec0ShadowName(const char *zName) {
 }
 
 static int vec0Begin(sqlite3_vtab *pVTab) {
-  UNUSED_PARAMETER(pVTab);
+  vec0_vtab *p = (vec0_vtab *)pVTab;
+  // other connections may have committed since the last transaction
+  p->insertCursorsChecked = 0;
   return SQLITE_OK;
 }
 static int vec0Sync(sqlite3_vtab *pVTab) {
-  UNUSED_PARAMETER(pVTab);
   vec0_vtab *p = (vec0_vtab *)pVTab;
+  int rc = vec0_write_behind_flush(p);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
   if (p->stmtLatestChunk) {
     sqlite3_finalize(p->stmtLatestChunk);
     p->stmtLatestChunk = NULL;
   }
+  if (p->stmtFreeSlotsNextChunk) {
+    sqlite3_finalize(p->stmtFreeSlotsNextChunk);
+    p->stmtFreeSlotsNextChunk = NULL;
+  }
+  if (p->stmtFreeSlotsUpdate) {
+    sqlite3_finalize(p->stmtFreeSlotsUpdate);
+    p->stmtFreeSlotsUpdate = NULL;
+  }
+  if (p->stmtFreeSlotsDeleteFull) {
+    sqlite3_finalize(p->stmtFreeSlotsDeleteFull);
+    p->stmtFreeSlotsDeleteFull = NULL;
+  }
   if (p->stmtRowidsInsertRowid) {
     sqlite3_finalize(p->stmtRowidsInsertRowid);
     p->stmtRowidsInsertRowid = NULL;
@@ -10399,7 +16864,24 @@ static int vec0Commit(sqlite3_vtab *pVTab) {
   return SQLITE_OK;
 }
 static int vec0Rollback(sqlite3_vtab *pVTab) {
-  UNUSED_PARAMETER(pVTab);
+  vec0_vtab *p = (vec0_vtab *)pVTab;
+  // cursors may point at chunks and slots that were rolled back
+  vec0_insert_cursors_clear(p);
+  p->insertCursorsChecked = 0;
+  vec0_write_behind_discard(p);
+  return SQLITE_OK;
+}
+// Statement and savepoint rollbacks: same as vec0Rollback(). Staged rows are
+// written when a savepoint starts, so the ones a rollback drops are exactly
+// those inserted after it.
+static int vec0Savepoint(sqlite3_vtab *pVTab, int iSavepoint) {
+  UNUSED_PARAMETER(iSavepoint);
+  return vec0_write_behind_flush((vec0_vtab *)pVTab);
+}
+static int vec0RollbackTo(sqlite3_vtab *pVTab, int iSavepoint) {
+  UNUSED_PARAMETER(iSavepoint);
+  vec0_insert_cursors_clear((vec0_vtab *)pVTab);
+  vec0_write_behind_discard((vec0_vtab *)pVTab);
   return SQLITE_OK;
 }
 
@@ -10410,7 +16892,10 @@ static int vec0Rollback(sqlite3_vtab *pVTab) {
  */
 static int vec0Rename(sqlite3_vtab *pVtab, const char *zNew) {
   vec0_vtab *p = (vec0_vtab *)pVtab;
-  int rc = SQLITE_OK;
+  int rc = vec0_write_behind_flush(p);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
 
   // Build a single SQL string with ALTER TABLE RENAME for every shadow table.
   sqlite3_str *s = sqlite3_str_new(p->db);
@@ -10426,6 +16911,12 @@ static int vec0Rename(sqlite3_vtab *pVtab, const char *zNew) {
     "ALTER TABLE \"%w\".\"%w_chunks\" RENAME TO \"%w_chunks\";",
     p->schemaName, p->tableName, zNew);
 
+  if (p->shadowFreeSlotsName) {
+    sqlite3_str_appendf(s,
+      "ALTER TABLE \"%w\".\"%w_free_slots\" RENAME TO \"%w_free_slots\";",
+      p->schemaName, p->tableName, zNew);
+  }
+
   // Auxiliary shadow table (only if auxiliary columns exist)
   if (p->numAuxiliaryColumns > 0) {
     sqlite3_str_appendf(s,
@@ -10438,6 +16929,11 @@ static int vec0Rename(sqlite3_vtab *pVtab, const char *zNew) {
     sqlite3_str_appendf(s,
       "ALTER TABLE \"%w\".\"%w_vector_chunks%02d\" RENAME TO \"%w_vector_chunks%02d\";",
       p->schemaName, p->tableName, i, zNew, i);
+    if (p->shadowVectorBoundsNames[i]) {
+      sqlite3_str_appendf(s,
+        "ALTER TABLE \"%w\".\"%w_vector_bounds%02d\" RENAME TO \"%w_vector_bounds%02d\";",
+        p->schemaName, p->tableName, i, zNew, i);
+    }
 
 #if SQLITE_VEC_ENABLE_RESCORE
     if (p->shadowRescoreChunksNames[i]) {
@@ -10475,16 +16971,41 @@ static int vec0Rename(sqlite3_vtab *pVtab, const char *zNew) {
   }
 #endif
 
+  // Reorganization plan (only once 'reorganize' has run)
+  i64 reorganizing = 0;
+  rc = vec0_reorganize_exec(p, &reorganizing,
+                            "SELECT EXISTS (SELECT 1 FROM \"%w\".sqlite_master"
+                            " WHERE type = 'table' AND name = '%q_reorganize')",
+                            p->schemaName, p->tableName);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(sqlite3_str_finish(s));
+    return rc;
+  }
+  if (reorganizing) {
+    sqlite3_str_appendf(s,
+      "ALTER TABLE \"%w\".\"%w_reorganize\" RENAME TO \"%w_reorganize\";",
+      p->schemaName, p->tableName, zNew);
+  }
+
   // Per-metadata-column shadow tables
   for (int i = 0; i < p->numMetadataColumns; i++) {
     sqlite3_str_appendf(s,
       "ALTER TABLE \"%w\".\"%w_metadatachunks%02d\" RENAME TO \"%w_metadatachunks%02d\";",
       p->schemaName, p->tableName, i, zNew, i);
-    if (p->metadata_columns[i].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
+    if (p->metadata_columns[i].dictionary) {
+      sqlite3_str_appendf(s,
+        "ALTER TABLE \"%w\".\"%w_metadatadict%02d\" RENAME TO \"%w_metadatadict%02d\";",
+        p->schemaName, p->tableName, i, zNew, i);
+    } else if (p->metadata_columns[i].kind == VEC0_METADATA_COLUMN_KIND_TEXT) {
       sqlite3_str_appendf(s,
         "ALTER TABLE \"%w\".\"%w_metadatatext%02d\" RENAME TO \"%w_metadatatext%02d\";",
         p->schemaName, p->tableName, i, zNew, i);
     }
+    if (p->shadowMetadataBoundsNames[i]) {
+      sqlite3_str_appendf(s,
+        "ALTER TABLE \"%w\".\"%w_metadatabounds%02d\" RENAME TO \"%w_metadatabounds%02d\";",
+        p->schemaName, p->tableName, i, zNew, i);
+    }
   }
 
   char *zSql = sqlite3_str_finish(s);
@@ -10513,10 +17034,20 @@ static int vec0Rename(sqlite3_vtab *pVtab, const char *zNew) {
   sqlite3_free(p->shadowChunksName);
   p->shadowChunksName = sqlite3_mprintf("%s_chunks", zNew);
 
+  if (p->shadowFreeSlotsName) {
+    sqlite3_free(p->shadowFreeSlotsName);
+    p->shadowFreeSlotsName = sqlite3_mprintf("%s_free_slots", zNew);
+  }
+
   for (int i = 0; i < p->numVectorColumns; i++) {
     sqlite3_free(p->shadowVectorChunksNames[i]);
     p->shadowVectorChunksNames[i] =
         sqlite3_mprintf("%s_vector_chunks%02d", zNew, i);
+    if (p->shadowVectorBoundsNames[i]) {
+      sqlite3_free(p->shadowVectorBoundsNames[i]);
+      p->shadowVectorBoundsNames[i] =
+          sqlite3_mprintf("%s_vector_bounds%02d", zNew, i);
+    }
 
 #if SQLITE_VEC_ENABLE_RESCORE
     if (p->shadowRescoreChunksNames[i]) {
@@ -10555,6 +17086,11 @@ static int vec0Rename(sqlite3_vtab *pVtab, const char *zNew) {
     sqlite3_free(p->shadowMetadataChunksNames[i]);
     p->shadowMetadataChunksNames[i] =
         sqlite3_mprintf("%s_metadatachunks%02d", zNew, i);
+    if (p->shadowMetadataBoundsNames[i]) {
+      sqlite3_free(p->shadowMetadataBoundsNames[i]);
+      p->shadowMetadataBoundsNames[i] =
+          sqlite3_mprintf("%s_metadatabounds%02d", zNew, i);
+    }
   }
 
   return SQLITE_OK;
@@ -10581,9 +17117,9 @@ static sqlite3_module vec0Module = {
     /* xRollback     */ vec0Rollback,
     /* xFindFunction */ 0,
     /* xRename       */ vec0Rename,
-    /* xSavepoint    */ 0,
+    /* xSavepoint    */ vec0Savepoint,
     /* xRelease      */ 0,
-    /* xRollbackTo   */ 0,
+    /* xRollbackTo   */ vec0RollbackTo,
     /* xShadowName   */ vec0ShadowName,
 #if SQLITE_VERSION_NUMBER >= 3044000
     /* xIntegrity    */ 0, // https://github.com/asg017/sqlite-vec/issues/44
@@ -10620,10 +17156,23 @@ static sqlite3_module vec0Module = {
 #define SQLITE_VEC_DEBUG_BUILD_DISKANN ""
 #endif
 
+#if SQLITE_VEC_ENABLE_PREFETCH
+#define SQLITE_VEC_DEBUG_BUILD_PREFETCH "prefetch"
+#else
+#define SQLITE_VEC_DEBUG_BUILD_PREFETCH ""
+#endif
+
+#if SQLITE_VEC_ENABLE_THREADS
+#define SQLITE_VEC_DEBUG_BUILD_THREADS "threads"
+#else
+#define SQLITE_VEC_DEBUG_BUILD_THREADS ""
+#endif
+
 #define SQLITE_VEC_DEBUG_BUILD                                                 \
   SQLITE_VEC_DEBUG_BUILD_AVX " " SQLITE_VEC_DEBUG_BUILD_NEON " "              \
   SQLITE_VEC_DEBUG_BUILD_RESCORE " " SQLITE_VEC_DEBUG_BUILD_IVF " "           \
-  SQLITE_VEC_DEBUG_BUILD_DISKANN
+  SQLITE_VEC_DEBUG_BUILD_DISKANN " " SQLITE_VEC_DEBUG_BUILD_PREFETCH " "      \
+  SQLITE_VEC_DEBUG_BUILD_THREADS
 
 #define SQLITE_VEC_DEBUG_STRING                                                \
   "Version: " SQLITE_VEC_VERSION "\n"                                          \
@@ -10631,6 +17180,57 @@ static sqlite3_module vec0Module = {
   "Commit: " SQLITE_VEC_SOURCE "\n"                                            \
   "Build flags: " SQLITE_VEC_DEBUG_BUILD
 
+static void vec_debug(sqlite3_context *context, int argc,
+                      sqlite3_value **argv) {
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+  const struct Vec0DistanceKernels *k = &vec0_kernels;
+#ifdef SQLITE_VEC_ENABLE_NEON
+  const char *zCpu = "neon";
+#else
+  const char *zCpu = vec0_simd_level_names[k->level];
+#endif
+  char *zDebug = sqlite3_mprintf(
+      "%s\nSIMD: cpu=%s l2_f32=%s cosine_f32=%s cosine_unit_f32=%s l1_f32=%s "
+      "l2_i8=%s cosine_i8=%s l1_i8=%s hamming=%s",
+      SQLITE_VEC_DEBUG_STRING, zCpu, k->l2_sqr_float_isa, k->cosine_float_isa,
+      k->cosine_unit_float_isa, k->l1_f32_isa, k->l2_sqr_int8_isa, k->cosine_int8_isa, k->l1_int8_isa,
+      k->hamming_isa);
+  if (!zDebug) {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  sqlite3_result_text(context, zDebug, -1, sqlite3_free);
+}
+
+#if SQLITE_VEC_ENABLE_PREFETCH
+/**
+ * vec0_scan_stats(): JSON description of where the last KNN scan on this
+ * connection spent its time, split between reading chunks and scoring them.
+ */
+static void vec0_scan_stats(sqlite3_context *context, int argc,
+                            sqlite3_value **argv) {
+  UNUSED_PARAMETER(argc);
+  UNUSED_PARAMETER(argv);
+  const struct Vec0ScanStats *stats =
+      (const struct Vec0ScanStats *)sqlite3_user_data(context);
+  char *zJson = sqlite3_mprintf(
+      "{\"chunks\":%lld,\"skipped_chunks\":%lld,\"filtered_chunks\":%lld,"
+      "\"sparse_chunks\":%lld,\"read_ms\":%.3f,\"compute_ms\":%.3f,"
+      "\"prefetch\":%d,\"prefetched_chunks\":%lld,\"prefetch_ms\":%.3f}",
+      stats->chunks, stats->skipped, stats->filtered, stats->sparse,
+      stats->read_ns / 1e6,
+      stats->compute_ns / 1e6,
+      stats->prefetch, stats->prefetched, stats->prefetch_ns / 1e6);
+  if (!zJson) {
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  sqlite3_result_text(context, zJson, -1, sqlite3_free);
+  sqlite3_result_subtype(context, JSON_SUBTYPE);
+}
+#endif
+
 SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
                                     const sqlite3_api_routines *pApi) {
 #ifndef SQLITE_CORE
@@ -10638,6 +17238,16 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
 #endif
   int rc = SQLITE_OK;
 
+  // NULL when SQLite was built without threads, which enter/leave allow
+  static int distance_kernels_ready = 0;
+  sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_MAIN);
+  sqlite3_mutex_enter(mutex);
+  if (!distance_kernels_ready) {
+    vec0_distance_kernels_init(VEC0_SIMD_AVX512);
+    distance_kernels_ready = 1;
+  }
+  sqlite3_mutex_leave(mutex);
+
 #define DEFAULT_FLAGS (SQLITE_UTF8 | SQLITE_INNOCUOUS | SQLITE_DETERMINISTIC)
 
   rc = sqlite3_create_function_v2(db, "vec_version", 0, DEFAULT_FLAGS,
@@ -10646,9 +17256,8 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
   if (rc != SQLITE_OK) {
     return rc;
   }
-  rc = sqlite3_create_function_v2(db, "vec_debug", 0, DEFAULT_FLAGS,
-                                  SQLITE_VEC_DEBUG_STRING, _static_text_func,
-                                  NULL, NULL, NULL);
+  rc = sqlite3_create_function_v2(db, "vec_debug", 0, DEFAULT_FLAGS, NULL,
+                                  vec_debug, NULL, NULL, NULL);
   if (rc != SQLITE_OK) {
     return rc;
   }
@@ -10660,7 +17269,6 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
   } aFunc[] = {
       // clang-format off
     //{"vec_version",         _static_text_func,    0, DEFAULT_FLAGS,                                          (void *) SQLITE_VEC_VERSION },
-    //{"vec_debug",           _static_text_func,    0, DEFAULT_FLAGS,                                          (void *) SQLITE_VEC_DEBUG_STRING },
     {"vec_distance_l2",     vec_distance_l2,      2, DEFAULT_FLAGS | SQLITE_SUBTYPE,                         },
     {"vec_distance_l1",     vec_distance_l1,      2, DEFAULT_FLAGS | SQLITE_SUBTYPE,                         },
     {"vec_distance_hamming",vec_distance_hamming, 2, DEFAULT_FLAGS | SQLITE_SUBTYPE,                         },
@@ -10703,8 +17311,20 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
     }
   }
 
+  // per-connection stats of the last KNN scan, shared by every vec0 table
+  struct Vec0ScanStats *scanStats = NULL;
+#if SQLITE_VEC_ENABLE_PREFETCH
+  scanStats = sqlite3_malloc(sizeof(*scanStats));
+  if (!scanStats) {
+    return SQLITE_NOMEM;
+  }
+  memset(scanStats, 0, sizeof(*scanStats));
+#endif
+
   for (unsigned long i = 0; i < countof(aMod) && rc == SQLITE_OK; i++) {
-    rc = sqlite3_create_module_v2(db, aMod[i].name, aMod[i].module, NULL, NULL);
+    void *pAux = aMod[i].module == &vec0Module ? (void *)scanStats : aMod[i].p;
+    rc = sqlite3_create_module_v2(db, aMod[i].name, aMod[i].module, pAux,
+                                  pAux ? sqlite3_free : aMod[i].xDestroy);
     if (rc != SQLITE_OK) {
       *pzErrMsg = sqlite3_mprintf("Error creating module %s: %s", aMod[i].name,
                                   sqlite3_errmsg(db));
@@ -10712,6 +17332,19 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
     }
   }
 
+#if SQLITE_VEC_ENABLE_PREFETCH
+  // scanStats is owned by the vec0 module registered above, which outlives
+  // any call to this function on the same connection.
+  rc = sqlite3_create_function_v2(db, "vec0_scan_stats", 0,
+                                  SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE,
+                                  scanStats, vec0_scan_stats, NULL, NULL, NULL);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Error creating function vec0_scan_stats: %s",
+                                sqlite3_errmsg(db));
+    return rc;
+  }
+#endif
+
   return SQLITE_OK;
 }
 
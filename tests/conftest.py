@@ -12,7 +12,7 @@ def _vec_debug():
 
 
 def _has_build_flag(flag):
-    return flag in _vec_debug().split("Build flags:")[-1]
+    return flag in _vec_debug().split("Build flags:")[-1].split("\n")[0]
 
 
 def pytest_collection_modifyitems(config, items):
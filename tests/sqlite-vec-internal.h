@@ -6,18 +6,12 @@
 #include <stdint.h>
 
 #ifndef SQLITE_VEC_ENABLE_IVF
-#define SQLITE_VEC_ENABLE_IVF 1
+#ifdef SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+#define SQLITE_VEC_ENABLE_IVF SQLITE_VEC_EXPERIMENTAL_IVF_ENABLE
+#else
+#define SQLITE_VEC_ENABLE_IVF 0
+#endif
 #endif
-
-int min_idx(
-  const float *distances,
-  int32_t n,
-  uint8_t *candidates,
-  int32_t *out,
-  int32_t k,
-  uint8_t *bTaken,
-  int32_t *k_used
-);
 
 // Scanner / tokenizer types and functions
 
@@ -76,16 +70,6 @@ enum Vec0IndexType {
   VEC0_INDEX_TYPE_DISKANN = 4,
 };
 
-enum Vec0RescoreQuantizerType {
-  VEC0_RESCORE_QUANTIZER_BIT = 1,
-  VEC0_RESCORE_QUANTIZER_INT8 = 2,
-};
-
-struct Vec0RescoreConfig {
-  enum Vec0RescoreQuantizerType quantizer_type;
-  int oversample;
-};
-
 #if SQLITE_VEC_ENABLE_IVF
 enum Vec0IvfQuantizer {
   VEC0_IVF_QUANTIZER_NONE = 0,
@@ -112,6 +96,7 @@ enum Vec0RescoreQuantizerType {
 struct Vec0RescoreConfig {
   enum Vec0RescoreQuantizerType quantizer_type;
   int oversample;
+  int oversample_search;
 };
 #endif
 
@@ -142,6 +127,11 @@ struct VectorColumnDefinition {
 #endif
   struct Vec0IvfConfig ivf;
   struct Vec0DiskannConfig diskann;
+  int normalize;
+  int chunk_bounds;
+  float (*distance_fn)(const void *a, const void *b, const void *d);
+  float (*distance_bounded_fn)(const void *a, const void *b, const void *d,
+                               float bound);
 };
 
 int vec0_parse_vector_column(const char *source, int source_length,
@@ -195,9 +185,39 @@ int diskann_prune_select(
     int *outSelected, int *outCount);
 
 #ifdef SQLITE_VEC_TEST
+// Re-selects the distance kernels, capped at max_level
+// (0=scalar, 1=sse4, 2=avx2, 3=avx512). Returns the level actually selected.
+int _test_distance_kernels_init(int max_level);
 float _test_distance_l2_sqr_float(const float *a, const float *b, size_t dims);
+float _test_distance_l2_squared_float(const float *a, const float *b, size_t dims);
 float _test_distance_cosine_float(const float *a, const float *b, size_t dims);
+float _test_distance_cosine_unit_float(const float *a, const float *b, size_t dims);
+double _test_distance_l1_f32(const float *a, const float *b, size_t dims);
+float _test_distance_l2_sqr_int8(const int8_t *a, const int8_t *b, size_t dims);
+float _test_distance_cosine_int8(const int8_t *a, const int8_t *b, size_t dims);
+int32_t _test_distance_l1_int8(const int8_t *a, const int8_t *b, size_t dims);
 float _test_distance_hamming(const unsigned char *a, const unsigned char *b, size_t dims);
+// Pushes n (distance, rowid) pairs through the KNN top-k heap and writes the k
+// smallest out in ascending order. Returns how many were kept.
+int _test_topk(const float *distances, const int64_t *rowids, int32_t n,
+               int32_t k, float *out_distances, int64_t *out_rowids);
+// Smallest s where sqrtf(s) >= target (> target when strict).
+float _test_squared_distance_bound(float target, int strict);
+// Lower bound on the L2 (squared when set) or L1 distance from query to any
+// point of the box bounds, dims minimums then dims maximums.
+float _test_vector_bounds_distance(int l1, int squared, const float *bounds,
+                                   const float *query, size_t dims);
+// Distances from query to every row of base whose bit is set in validity.
+void _test_distances_for_chunk_l2_float(const float *query, const float *base,
+                                        size_t dims, int32_t n,
+                                        const unsigned char *validity,
+                                        float *out);
+// Clears the bits of b whose value fails `value op target`, op being a metadata
+// operator ('a' = EQ through 'f' = NE). values are int64s, or doubles when
+// isFloat is set, compared with targetInt or targetFloat.
+void _test_metadata_filter_numeric(unsigned char *b, int32_t size, int isFloat,
+                                   const void *values, char op,
+                                   int64_t targetInt, double targetFloat);
 
 #ifdef SQLITE_VEC_ENABLE_RESCORE
 void _test_rescore_quantize_float_to_bit(const float *src, uint8_t *dst, size_t dim);
@@ -0,0 +1,232 @@
+"""Tests for free slot reuse after deletes, and the 'optimize' command."""
+import sqlite3
+import struct
+import pytest
+
+
+def connect(path=":memory:"):
+    db = sqlite3.connect(path)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+@pytest.fixture()
+def db():
+    return connect()
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def contents(db, table="v"):
+    return db.execute(f"select * from {table} order by rowid").fetchall()
+
+
+def chunk_of(db, rowid, table="v"):
+    return db.execute(
+        f"select chunk_id from {table}_rowids where rowid = ?", [rowid]
+    ).fetchone()[0]
+
+
+def free_slots(db, table="v"):
+    return db.execute(f"select rowid, free from {table}_free_slots").fetchall()
+
+
+def fill(db, n, table="v"):
+    db.executemany(
+        f"insert into {table}(rowid, embedding, n) values (?, ?, ?)",
+        [(i, float_vec([i, -i]), i * 10) for i in range(1, n + 1)],
+    )
+
+
+def test_free_slots_counts(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)"
+    )
+    fill(db, 20)
+    # two full chunks are not listed, the third has 4 never-used slots
+    assert free_slots(db) == [(3, 4)]
+
+    db.execute("delete from v where rowid in (2, 3, 10)")
+    assert free_slots(db) == [(1, 2), (2, 1), (3, 4)]
+
+    # emptied chunks are deleted, not listed
+    db.execute("delete from v where rowid between 9 and 16")
+    assert free_slots(db) == [(1, 2), (3, 4)]
+    assert db.execute("select rowid from v_chunks").fetchall() == [(1,), (3,)]
+
+
+def test_free_slots_reused_oldest_first(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)"
+    )
+    fill(db, 24)
+    db.execute("delete from v where rowid in (3, 12, 20)")
+
+    db.execute("insert into v(rowid, embedding, n) values (100, '[0, 0]', 1)")
+    assert chunk_of(db, 100) == 1
+    db.execute("insert into v(rowid, embedding, n) values (101, '[0, 0]', 1)")
+    db.execute("insert into v(rowid, embedding, n) values (102, '[0, 0]', 1)")
+    assert [chunk_of(db, r) for r in (101, 102)] == [2, 3]
+
+    # every chunk is full again, the next row starts a new one
+    assert free_slots(db) == []
+    db.execute("insert into v(rowid, embedding, n) values (103, '[0, 0]', 1)")
+    assert chunk_of(db, 103) == 4
+    assert free_slots(db) == [(4, 7)]
+
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 4
+    assert db.execute(
+        "select rowid from v where embedding match '[0, 0]' and k = 3 and n = 1"
+    ).fetchall() == [(100,), (101,), (102,)]
+
+
+def test_free_slots_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "embedding float[2], chunk_size=8)"
+    )
+    db.executemany(
+        "insert into v(rowid, user_id, embedding) values (?, ?, ?)",
+        [(i, i % 2, float_vec([i, i])) for i in range(1, 33)],
+    )
+    db.execute("delete from v where rowid = 2")
+
+    # user 1's rows never land in user 0's chunks
+    db.execute("insert into v(rowid, user_id, embedding) values (100, 1, '[0, 0]')")
+    assert chunk_of(db, 100) != chunk_of(db, 4)
+    assert db.execute(
+        "select partition00 from v_chunks where rowid = ?", [chunk_of(db, 100)]
+    ).fetchone()[0] == 1
+
+    db.execute("insert into v(rowid, user_id, embedding) values (101, 0, '[0, 0]')")
+    assert chunk_of(db, 101) == chunk_of(db, 4)
+
+
+def test_optimize(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[2], n integer, "
+        "name text, +note text, chunk_size=8)"
+    )
+    # nothing to move in a table without chunks
+    db.execute("insert into v(v) values ('optimize')")
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 0
+
+    db.executemany(
+        "insert into v(rowid, embedding, n, name, note) values (?, ?, ?, ?, ?)",
+        [
+            (i, float_vec([i, -i]), i * 10, f"a long name for row number {i}", f"n{i}")
+            for i in range(1, 65)
+        ],
+    )
+    db.execute("delete from v where rowid % 3 != 0")
+    before = contents(db)
+    expected = db.execute(
+        "select rowid, distance from v where embedding match '[30, -30]' and k = 5"
+    ).fetchall()
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 8
+
+    db.execute("insert into v(v) values ('optimize')")
+    # 21 rows need ceil(21 / 8) = 3 chunks, only the last partially full
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 3
+    assert [f for _, f in free_slots(db)] == [3]
+    assert contents(db) == before
+    assert db.execute(
+        "select rowid, distance from v where embedding match '[30, -30]' and k = 5"
+    ).fetchall() == expected
+    assert db.execute(
+        "select rowid from v where name = 'a long name for row number 33'"
+    ).fetchall() == [(33,)]
+    assert db.execute("select count(*) from v where n > 300").fetchone()[0] == 11
+
+    # _rowids points at the new positions
+    for rowid, chunk_id, offset in db.execute(
+        "select rowid, chunk_id, chunk_offset from v_rowids"
+    ):
+        rowids = db.execute(
+            "select rowids from v_chunks where rowid = ?", [chunk_id]
+        ).fetchone()[0]
+        assert struct.unpack_from("q", rowids, offset * 8)[0] == rowid
+
+    # a second optimize has nothing to move
+    db.execute("insert into v(v) values ('optimize')")
+    assert contents(db) == before
+
+
+def test_optimize_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "embedding float[2], chunk_size=8)"
+    )
+    db.executemany(
+        "insert into v(rowid, user_id, embedding) values (?, ?, ?)",
+        [(i, i % 3, float_vec([i, i])) for i in range(1, 97)],
+    )
+    db.execute("delete from v where rowid % 4 != 0")
+    before = contents(db)
+    db.execute("insert into v(v) values ('optimize')")
+    assert contents(db) == before
+    # 8 rows per user, one full chunk each
+    assert db.execute(
+        "select partition00, count(*) from v_chunks group by 1"
+    ).fetchall() == [(0, 1), (1, 1), (2, 1)]
+
+
+def test_optimize_legacy_table(tmp_path):
+    path = str(tmp_path / "legacy.db")
+    db = connect(path)
+    db.execute(
+        "create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)"
+    )
+    fill(db, 24)
+    # a table from before free slots were tracked
+    db.execute("drop table v_free_slots")
+    db.execute("delete from v_info where key = 'free_slots'")
+    db.commit()
+    db.close()
+
+    db = connect(path)
+    db.execute("delete from v where rowid = 2")
+    db.execute("insert into v(rowid, embedding, n) values (100, '[0, 0]', 1)")
+    # without _free_slots, new rows go to the latest chunk
+    assert chunk_of(db, 100) == 4
+
+    db.execute("insert into v(v) values ('optimize')")
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 3
+    assert free_slots(db) == []
+    db.commit()
+    db.close()
+
+    db = connect(path)
+    db.execute("delete from v where rowid = 5")
+    db.execute("insert into v(rowid, embedding, n) values (101, '[0, 0]', 1)")
+    assert chunk_of(db, 101) == chunk_of(db, 6)
+    assert db.execute("select count(*) from v").fetchone()[0] == 24
+
+
+def test_optimize_during_reorganize(db):
+    db.execute("create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)")
+    fill(db, 40)
+    db.execute("insert into v(v) values ('reorganize')")
+    with pytest.raises(sqlite3.OperationalError, match="reorganize is under way"):
+        db.execute("insert into v(v) values ('optimize')")
+
+
+def test_free_slots_rename_and_drop(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)"
+    )
+    fill(db, 12)
+    db.execute("alter table v rename to w")
+    assert free_slots(db, "w") == [(2, 4)]
+    db.execute("delete from w where rowid = 1")
+    db.execute("insert into w(rowid, embedding, n) values (100, '[0, 0]', 1)")
+    assert chunk_of(db, 100, "w") == 1
+    db.execute("drop table w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w%'"
+    ).fetchone()[0] == 0
@@ -1,5 +1,6 @@
 import sqlite3
 import pytest
+from conftest import _has_build_flag
 from helpers import exec
 
 
@@ -39,3 +40,135 @@ def test_command_column_name_conflict(db):
     db.execute("create virtual table t using vec0(embeddings float[4])")
 
 
+
+
+def test_command_release_scratch(db):
+    db.execute("create virtual table t using vec0(a float[4], chunk_size=8)")
+    for i in range(20):
+        db.execute("insert into t(rowid, a) values (?, ?)", [i + 1, f"[{i}, 0, 0, 0]"])
+    q = "select rowid from t where a match '[0, 0, 0, 0]' and k = 3"
+    assert [r[0] for r in db.execute(q).fetchall()] == [1, 2, 3]
+
+    # queries keep working after the scratch buffers are dropped
+    db.execute("insert into t(t) values ('release-scratch')")
+    assert [r[0] for r in db.execute(q).fetchall()] == [1, 2, 3]
+    db.execute("insert into t(t) values ('release-scratch')")
+
+
+@pytest.mark.skipif(
+    not _has_build_flag("prefetch"),
+    reason="prefetch not enabled (compile with -DSQLITE_VEC_ENABLE_PREFETCH=1)",
+)
+def test_command_prefetch(tmp_path):
+    import json
+
+    db = sqlite3.connect(str(tmp_path / "prefetch.db"))
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    db.execute("create virtual table t using vec0(a float[4], chunk_size=8)")
+    for i in range(50):
+        db.execute("insert into t(rowid, a) values (?, ?)", [i + 1, f"[{i}, 0, 0, 0]"])
+    db.commit()
+    q = "select rowid from t where a match '[0, 0, 0, 0]' and k = 3"
+    assert [r[0] for r in db.execute(q).fetchall()] == [1, 2, 3]
+    stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["chunks"] == 7
+    assert stats["prefetch"] == 0
+
+    db.execute("insert into t(t) values ('prefetch=1')")
+    assert [r[0] for r in db.execute(q).fetchall()] == [1, 2, 3]
+    stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["chunks"] == 7
+    assert stats["prefetch"] == 1
+    assert 0 <= stats["prefetched_chunks"] <= 6
+    assert stats["read_ms"] >= 0 and stats["compute_ms"] >= 0
+
+    # in-memory databases have nothing to read ahead from
+    mem = sqlite3.connect(":memory:")
+    mem.enable_load_extension(True)
+    mem.load_extension("dist/vec0")
+    mem.execute("create virtual table t using vec0(a float[4], chunk_size=8)")
+    mem.execute("insert into t(rowid, a) values (1, '[1, 0, 0, 0]')")
+    mem.execute("insert into t(t) values ('prefetch=1')")
+    assert [r[0] for r in mem.execute(q).fetchall()] == [1]
+    stats = json.loads(mem.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["prefetch"] == 0
+
+    # partition-filtered scans don't visit chunks in rowid order
+    db.execute(
+        "create virtual table p using vec0(g integer partition key, a float[4], chunk_size=8)"
+    )
+    for i in range(50):
+        db.execute(
+            "insert into p(rowid, g, a) values (?, ?, ?)", [i + 1, i % 2, f"[{i}, 0, 0, 0]"]
+        )
+    db.commit()
+    db.execute("insert into p(p) values ('prefetch=1')")
+    assert [
+        r[0]
+        for r in db.execute(
+            "select rowid from p where a match '[0, 0, 0, 0]' and k = 3 and g = 1"
+        ).fetchall()
+    ] == [2, 4, 6]
+    stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["prefetch"] == 0
+    assert [
+        r[0]
+        for r in db.execute(
+            "select rowid from p where a match '[0, 0, 0, 0]' and k = 3"
+        ).fetchall()
+    ] == [1, 2, 3]
+    stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["prefetch"] == 1
+
+    with pytest.raises(sqlite3.OperationalError, match="prefetch must be 0 or 1"):
+        db.execute("insert into t(t) values ('prefetch=2')")
+    db.execute("insert into t(t) values ('prefetch=0')")
+    db.close()
+
+
+@pytest.mark.skipif(
+    not _has_build_flag("threads"),
+    reason="threads not enabled (compile with -DSQLITE_VEC_ENABLE_THREADS=1)",
+)
+def test_command_threads(db):
+    import random
+    import struct
+
+    random.seed(13)
+    db.execute(
+        "create virtual table t using vec0(a float[96], b int8[8], c float[4] distance_metric=cosine, m integer, chunk_size=8)"
+    )
+    for i in range(1, 301):
+        a = [random.choice([0.0, 0.5, 1.0]) for _ in range(96)]
+        b = [random.randint(-2, 2) for _ in range(8)]
+        c = [random.choice([0.0, 1.0]) for _ in range(4)]
+        db.execute(
+            "insert into t(rowid, a, b, c, m) values (?, ?, vec_int8(?), ?, ?)",
+            [i, struct.pack("96f", *a), struct.pack("8b", *b), struct.pack("4f", *c), i % 5],
+        )
+    q = struct.pack("96f", *[0.5] * 96)
+    queries = [
+        ("select rowid, distance from t where a match ? and k = 25", [q]),
+        ("select rowid, distance from t where a match ? and k = 300", [q]),
+        ("select rowid, distance from t where a match ? and k = 20 and m = 3", [q]),
+        ("select rowid, distance from t where a match ? and k = 20 and distance > 3", [q]),
+        ("select rowid, distance from t where a match ? and k = 10 and rowid in (1, 5, 9, 200, 201, 299)", [q]),
+        ("select rowid, distance from t where b match vec_int8('[0,0,0,0,0,0,0,0]') and k = 40", []),
+        ("select rowid, distance from t where c match '[1, 0, 0, 0]' and k = 50", []),
+    ]
+    serial = [db.execute(sql, args).fetchall() for sql, args in queries]
+
+    for n in (1, 2, 7):
+        db.execute(f"insert into t(t) values ('threads={n}')")
+        for (sql, args), expected in zip(queries, serial):
+            assert db.execute(sql, args).fetchall() == expected
+
+    db.execute("insert into t(t) values ('threads=0')")
+    for (sql, args), expected in zip(queries, serial):
+        assert db.execute(sql, args).fetchall() == expected
+    with pytest.raises(sqlite3.OperationalError, match="threads must be between 0 and"):
+        db.execute("insert into t(t) values ('threads=-1')")
+    with pytest.raises(sqlite3.OperationalError, match="threads must be between 0 and"):
+        db.execute("insert into t(t) values ('threads=x')")
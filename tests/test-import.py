@@ -0,0 +1,276 @@
+"""Tests for the 'import=PATH' command, which bulk-loads vectors from .npy,
+.fvecs and .bvecs files."""
+import sqlite3
+import struct
+import pytest
+from conftest import _has_build_flag
+
+
+def connect(path=":memory:"):
+    db = sqlite3.connect(path, isolation_level=None)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+@pytest.fixture()
+def db():
+    return connect()
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def vectors(n, dims):
+    return [[float((i * 7 + j * 3) % 23) for j in range(dims)] for i in range(n)]
+
+
+def write_npy(path, descr, shape, data, fortran_order=False, version=1):
+    """Write a .npy file by hand, numpy isn't needed for the tests."""
+    header = (
+        f"{{'descr': '{descr}', 'fortran_order': {fortran_order}, "
+        f"'shape': {shape}, }}"
+    ).encode()
+    prefix = 10 if version == 1 else 12
+    header += b" " * (-(prefix + len(header) + 1) % 64) + b"\n"
+    with open(path, "wb") as f:
+        f.write(b"\x93NUMPY" + bytes([version, 0]))
+        f.write(struct.pack("<H" if version == 1 else "<I", len(header)))
+        f.write(header)
+        f.write(data)
+    return str(path)
+
+
+def write_vecs(path, fmt, rows):
+    with open(path, "wb") as f:
+        for row in rows:
+            f.write(struct.pack("<i", len(row)))
+            f.write(struct.pack(f"<{len(row)}{fmt}", *row))
+    return str(path)
+
+
+def import_file(db, path, table="v"):
+    db.execute(f"insert into {table}({table}) values (?)", [f"import={path}"])
+
+
+def contents(db, table="v"):
+    return db.execute(f"select * from {table} order by rowid").fetchall()
+
+
+def test_import_npy(db, tmp_path):
+    rows = vectors(300, 8)
+    db.execute("create virtual table v using vec0(a float[8], chunk_size=64)")
+    db.execute("create virtual table w using vec0(a float[8], chunk_size=64)")
+    db.execute("insert into v(rowid, a) values (1000, ?)", [float_vec([1] * 8)])
+    path = write_npy(
+        tmp_path / "a.npy",
+        "<f4",
+        (300, 8),
+        b"".join(float_vec(row) for row in rows),
+    )
+    import_file(db, path)
+
+    db.execute("insert into w(rowid, a) values (1000, ?)", [float_vec([1] * 8)])
+    for row in rows:
+        db.execute("insert into w(a) values (?)", [float_vec(row)])
+    assert contents(db, "v") == contents(db, "w")
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 5
+
+    query = float_vec(rows[42])
+    knn = "select rowid, distance from {} where a match ? and k = 5"
+    assert (
+        db.execute(knn.format("v"), [query]).fetchall()
+        == db.execute(knn.format("w"), [query]).fetchall()
+    )
+
+
+def test_import_npy_versions_and_types(db, tmp_path):
+    rows = vectors(10, 4)
+    db.execute("create virtual table v using vec0(a float[4])")
+    import_file(
+        db,
+        write_npy(
+            tmp_path / "f8.npy",
+            "<f8",
+            (10, 4),
+            b"".join(struct.pack("<4d", *row) for row in rows),
+            version=2,
+        ),
+    )
+    import_file(
+        db,
+        write_npy(
+            tmp_path / "u1.npy",
+            "|u1",
+            (10, 4),
+            b"".join(bytes(int(x) for x in row) for row in rows),
+        ),
+    )
+    # float64 and uint8 arrays load into float columns
+    assert [row[1] for row in contents(db)] == [float_vec(row) for row in rows] * 2
+
+    db.execute("create virtual table i using vec0(a int8[4])")
+    import_file(
+        db,
+        write_npy(
+            tmp_path / "i1.npy", "|i1", (2, 4), struct.pack("<8b", 1, -2, 3, -4, 5, -6, 7, -8)
+        ),
+        "i",
+    )
+    assert [row[1] for row in contents(db, "i")] == [
+        struct.pack("<4b", 1, -2, 3, -4),
+        struct.pack("<4b", 5, -6, 7, -8),
+    ]
+
+    # bit columns take np.packbits() bytes
+    db.execute("create virtual table b using vec0(a bit[16])")
+    import_file(
+        db, write_npy(tmp_path / "bits.npy", "|u1", (2, 2), b"\x01\x80\xff\x00"), "b"
+    )
+    assert [row[1] for row in contents(db, "b")] == [b"\x01\x80", b"\xff\x00"]
+
+
+def test_import_vecs(db, tmp_path):
+    rows = vectors(100, 6)
+    db.execute("create virtual table v using vec0(a float[6], chunk_size=32)")
+    import_file(db, write_vecs(tmp_path / "a.fvecs", "f", rows))
+    import_file(
+        db, write_vecs(tmp_path / "a.bvecs", "B", [[int(x) for x in row] for row in rows])
+    )
+    assert contents(db) == [
+        (i + 1, float_vec(row)) for i, row in enumerate(rows + rows)
+    ]
+
+    # empty files add no rows
+    import_file(db, write_vecs(tmp_path / "empty.fvecs", "f", []))
+    assert db.execute("select count(*) from v").fetchone()[0] == 200
+
+
+def test_import_normalize(db, tmp_path):
+    db.execute(
+        "create virtual table v using vec0(a float[2] distance_metric=cosine normalize=1)"
+    )
+    import_file(db, write_vecs(tmp_path / "a.fvecs", "f", [[3.0, 4.0]]))
+    assert contents(db) == [(1, float_vec([0.6, 0.8]))]
+
+
+def test_import_auxiliary(db, tmp_path):
+    db.execute("create virtual table v using vec0(a float[2], +label text)")
+    import_file(db, write_vecs(tmp_path / "a.fvecs", "f", [[1, 2], [3, 4]]))
+    assert contents(db) == [(1, float_vec([1, 2]), None), (2, float_vec([3, 4]), None)]
+    db.execute("update v set label = 'x' where rowid = 2")
+    assert db.execute("select label from v where rowid = 2").fetchone()[0] == "x"
+
+
+def test_import_rollback(db, tmp_path):
+    db.execute("create virtual table v using vec0(a float[2], chunk_size=8)")
+    db.execute("insert into v(a) values (?)", [float_vec([0, 0])])
+    path = write_vecs(tmp_path / "a.fvecs", "f", [[1, 2]] * 20)
+
+    db.execute("begin")
+    import_file(db, path)
+    assert db.execute("select count(*) from v").fetchone()[0] == 21
+    db.execute("rollback")
+    assert contents(db) == [(1, float_vec([0, 0]))]
+
+    # a truncated file adds no rows
+    with open(path, "ab") as f:
+        f.write(struct.pack("<if", 2, 1.0))
+    with pytest.raises(sqlite3.OperationalError, match="is truncated"):
+        import_file(db, path)
+    assert contents(db) == [(1, float_vec([0, 0]))]
+    assert db.execute("select count(*) from v_rowids").fetchone()[0] == 1
+
+
+def test_import_errors(db, tmp_path):
+    db.execute("create virtual table v using vec0(a float[4])")
+    db.execute("create virtual table i using vec0(a int8[4])")
+    fvecs = write_vecs(tmp_path / "a.fvecs", "f", [[1, 2, 3, 4]])
+
+    with pytest.raises(sqlite3.OperationalError, match="unknown file type"):
+        import_file(db, tmp_path / "a.csv")
+    with pytest.raises(sqlite3.OperationalError, match="could not open"):
+        import_file(db, tmp_path / "missing.npy")
+    with pytest.raises(sqlite3.OperationalError, match="not a .npy file"):
+        import_file(db, write_vecs(tmp_path / "c.npy", "f", [[1, 2, 3, 4]]))
+    with pytest.raises(sqlite3.OperationalError, match="C order"):
+        import_file(
+            db, write_npy(tmp_path / "f.npy", "<f4", (1, 4), b"\0" * 16, fortran_order=True)
+        )
+    with pytest.raises(sqlite3.OperationalError, match="2-dimensional"):
+        import_file(db, write_npy(tmp_path / "d.npy", "<f4", (16,), b"\0" * 16))
+    with pytest.raises(sqlite3.OperationalError, match="little-endian"):
+        import_file(db, write_npy(tmp_path / "e.npy", ">f4", (1, 4), b"\0" * 16))
+    with pytest.raises(sqlite3.OperationalError, match="don't fit"):
+        import_file(db, write_npy(tmp_path / "g.npy", "<f4", (1, 3), b"\0" * 12))
+    with pytest.raises(sqlite3.OperationalError, match="don't fit"):
+        import_file(db, write_npy(tmp_path / "h.npy", "<f4", (1, 4), b"\0" * 16), "i")
+    with pytest.raises(sqlite3.OperationalError, match="have 3 dimensions"):
+        import_file(db, write_vecs(tmp_path / "i.fvecs", "f", [[1, 2, 3, 4], [1, 2, 3]]))
+    with pytest.raises(sqlite3.OperationalError, match="is truncated"):
+        import_file(db, write_npy(tmp_path / "j.npy", "<f4", (2, 4), b"\0" * 20))
+    assert db.execute("select count(*) from v").fetchone()[0] == 0
+
+    db.execute("create virtual table m using vec0(a float[4], b float[4])")
+    with pytest.raises(sqlite3.OperationalError, match="one vector column"):
+        import_file(db, fvecs, "m")
+    db.execute("create virtual table p using vec0(user_id int partition key, a float[4])")
+    with pytest.raises(sqlite3.OperationalError, match="no partition key or metadata"):
+        import_file(db, fvecs, "p")
+    db.execute("create virtual table t using vec0(id text primary key, a float[4])")
+    with pytest.raises(sqlite3.OperationalError, match="integer primary key"):
+        import_file(db, fvecs, "t")
+
+
+@pytest.mark.skipif(not _has_build_flag("rescore"), reason="rescore not enabled")
+def test_import_rescore(db, tmp_path):
+    rows = vectors(150, 16)
+    for name in ("v", "w"):
+        db.execute(
+            f"create virtual table {name} using vec0("
+            "a float[16] indexed by rescore(quantizer=int8), chunk_size=64)"
+        )
+    import_file(db, write_vecs(tmp_path / "a.fvecs", "f", rows))
+    for row in rows:
+        db.execute("insert into w(a) values (?)", [float_vec(row)])
+    for shadow in ("rescore_chunks00", "rescore_vectors00"):
+        assert (
+            db.execute(f"select * from v_{shadow} order by rowid").fetchall()
+            == db.execute(f"select * from w_{shadow} order by rowid").fetchall()
+        )
+    query = float_vec(rows[7])
+    knn = "select rowid, distance from {} where a match ? and k = 5"
+    assert (
+        db.execute(knn.format("v"), [query]).fetchall()
+        == db.execute(knn.format("w"), [query]).fetchall()
+    )
+
+
+@pytest.mark.skipif(not _has_build_flag("diskann"), reason="diskann not enabled")
+def test_import_diskann(db, tmp_path):
+    rows = vectors(50, 8)
+    db.execute(
+        "create virtual table v using vec0("
+        "a float[8] indexed by diskann(neighbor_quantizer=binary))"
+    )
+    import_file(db, write_vecs(tmp_path / "a.fvecs", "f", rows))
+    assert db.execute("select count(*) from v").fetchone()[0] == 50
+    assert db.execute(
+        "select rowid from v where a match ? and k = 1", [float_vec(rows[9])]
+    ).fetchone()[0] in {i + 1 for i, row in enumerate(rows) if row == rows[9]}
+
+
+@pytest.mark.skipif(not _has_build_flag("ivf"), reason="IVF not enabled")
+def test_import_ivf(db, tmp_path):
+    rows = vectors(50, 4)
+    db.execute(
+        "create virtual table v using vec0(a float[4] indexed by ivf(nlist=2, nprobe=2))"
+    )
+    import_file(db, write_vecs(tmp_path / "a.fvecs", "f", rows))
+    assert db.execute("select count(*) from v").fetchone()[0] == 50
+    assert db.execute(
+        "select rowid from v where a match ? and k = 1", [float_vec(rows[9])]
+    ).fetchone()[0] in {i + 1 for i, row in enumerate(rows) if row == rows[9]}
@@ -0,0 +1,210 @@
+"""Tests for the per-partition insert cursors, which remember where the last
+insert into each partition went."""
+import sqlite3
+import struct
+import pytest
+
+
+def connect(path=":memory:"):
+    db = sqlite3.connect(path, isolation_level=None)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+@pytest.fixture()
+def db():
+    return connect()
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def check_layout(db, table="v", partition=None):
+    """Every row sits in exactly one valid slot of a chunk of its partition,
+    and every valid slot holds a row."""
+    if partition:
+        assert db.execute(
+            f"select count(*) from {table} v join {table}_rowids r using (rowid) "
+            f"join {table}_chunks c on c.rowid = r.chunk_id "
+            f"where c.partition00 is not v.{partition}"
+        ).fetchone()[0] == 0
+    slots = {}
+    for chunk_id, validity, rowids in db.execute(
+        f"select rowid, validity, rowids from {table}_chunks"
+    ):
+        for offset in range(len(validity) * 8):
+            if validity[offset // 8] >> (offset % 8) & 1:
+                slots[(chunk_id, offset)] = struct.unpack_from("q", rowids, offset * 8)[0]
+    positions = {
+        rowid: (chunk_id, offset)
+        for rowid, chunk_id, offset in db.execute(
+            f"select rowid, chunk_id, chunk_offset from {table}_rowids"
+        )
+    }
+    assert {v: k for k, v in slots.items()} == positions
+    assert len(slots) == len(positions)
+
+
+def test_insert_cursor_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "embedding float[2], chunk_size=8)"
+    )
+    # interleaved inserts into many partitions
+    for i in range(1, 2001):
+        db.execute(
+            "insert into v(rowid, user_id, embedding) values (?, ?, ?)",
+            [i, i % 100, float_vec([i, i])],
+        )
+    check_layout(db, partition="user_id")
+    # 20 rows per user: 3 chunks each, none wasted
+    assert db.execute(
+        "select count(*), count(distinct partition00) from v_chunks"
+    ).fetchone() == (300, 100)
+    assert db.execute(
+        "select rowid from v where user_id = 7 and embedding match '[0, 0]' and k = 2"
+    ).fetchall() == [(7,), (107,)]
+
+
+def test_insert_cursor_text_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(name text partition key, "
+        "embedding float[2], chunk_size=8)"
+    )
+    names = ["a", "b", "a\x00b", "", "ab"]
+    for i in range(50):
+        db.execute(
+            "insert into v(rowid, name, embedding) values (?, ?, ?)",
+            [i + 1, names[i % len(names)], float_vec([i, i])],
+        )
+    check_layout(db, partition="name")
+    for chunk_id, name in db.execute("select rowid, partition00 from v_chunks"):
+        assert {
+            r[0]
+            for r in db.execute(
+                "select name from v where rowid in "
+                "(select rowid from v_rowids where chunk_id = ?)",
+                [chunk_id],
+            )
+        } == {name}
+
+
+def test_insert_cursor_rollback(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    for i in range(1, 9):
+        db.execute("insert into v(rowid, embedding) values (?, '[1, 1]')", [i])
+
+    # the rolled back chunk must not be reused
+    db.execute("begin")
+    db.execute("insert into v(rowid, embedding) values (9, '[1, 1]')")
+    db.execute("rollback")
+    db.execute("insert into v(rowid, embedding) values (10, '[1, 1]')")
+    check_layout(db)
+    assert db.execute("select rowid from v_chunks").fetchall() == [(1,), (2,)]
+
+    # neither are slots of a rolled back statement or savepoint
+    db.execute("begin")
+    with pytest.raises(sqlite3.OperationalError, match="UNIQUE"):
+        db.execute(
+            "insert into v(rowid, embedding) select value, '[2, 2]' "
+            "from json_each('[11, 12, 13, 1]')"
+        )
+    db.execute("savepoint s")
+    db.execute("insert into v(rowid, embedding) values (14, '[1, 1]')")
+    db.execute("rollback to s")
+    db.execute("release s")
+    db.execute("insert into v(rowid, embedding) values (15, '[1, 1]')")
+    db.execute("commit")
+    check_layout(db)
+    assert [r[0] for r in db.execute("select rowid from v")] == list(range(1, 9)) + [10, 15]
+    assert db.execute(
+        "select chunk_id, chunk_offset from v_rowids where rowid = 15"
+    ).fetchone() == (2, 1)
+
+
+def test_insert_cursor_statement_rollback_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "embedding float[2], chunk_size=8)"
+    )
+    for i in range(1, 17):
+        db.execute(
+            "insert into v(rowid, user_id, embedding) values (?, ?, '[1, 1]')",
+            [i, i % 2],
+        )
+    db.execute("begin")
+    # starts a chunk for user 0, then fails and takes it back
+    with pytest.raises(sqlite3.OperationalError, match="UNIQUE"):
+        db.execute(
+            "insert into v(rowid, user_id, embedding) select value, 0, '[2, 2]' "
+            "from json_each('[20, 1]')"
+        )
+    # so user 1's new chunk gets the same chunk_id
+    db.execute("insert into v(rowid, user_id, embedding) values (21, 1, '[1, 1]')")
+    db.execute("insert into v(rowid, user_id, embedding) values (22, 0, '[1, 1]')")
+    db.execute("commit")
+    check_layout(db, partition="user_id")
+
+
+def test_insert_cursor_deletes(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    for i in range(1, 21):
+        db.execute("insert into v(rowid, embedding) values (?, '[1, 1]')", [i])
+    db.execute("delete from v where rowid = 3")
+    # the freed slot is reused before the cursor's next one
+    db.execute("insert into v(rowid, embedding) values (100, '[1, 1]')")
+    assert db.execute(
+        "select chunk_id, chunk_offset from v_rowids where rowid = 100"
+    ).fetchone() == (1, 2)
+    check_layout(db)
+
+
+def test_insert_cursor_other_connections(tmp_path):
+    path = str(tmp_path / "cursors.db")
+    a = connect(path)
+    a.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "embedding float[2], chunk_size=8)"
+    )
+    a.execute("insert into v(rowid, user_id, embedding) values (1, 1, '[1, 1]')")
+
+    b = connect(path)
+    for i in range(2, 12):
+        b.execute(
+            "insert into v(rowid, user_id, embedding) values (?, 1, '[1, 1]')", [i]
+        )
+    b.execute("delete from v where rowid = 1")
+
+    # a's cursor is stale: the slots after it were taken, and slot 0 was freed
+    a.execute("insert into v(rowid, user_id, embedding) values (12, 1, '[1, 1]')")
+    assert a.execute(
+        "select chunk_id, chunk_offset from v_rowids where rowid = 12"
+    ).fetchone() == (1, 0)
+    a.execute("insert into v(rowid, user_id, embedding) values (13, 1, '[1, 1]')")
+    check_layout(a, partition="user_id")
+    assert a.execute("select count(*) from v").fetchone()[0] == 12
+
+    # a's cursor points at a chunk b deleted
+    a.execute("insert into v(rowid, user_id, embedding) values (100, 2, '[1, 1]')")
+    b.execute("delete from v where rowid = 100")
+    a.execute("insert into v(rowid, user_id, embedding) values (101, 2, '[1, 1]')")
+    check_layout(a, partition="user_id")
+
+
+def test_insert_cursor_commands(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    for i in range(1, 21):
+        db.execute("insert into v(rowid, embedding) values (?, ?)", [i, float_vec([i % 5, i])])
+    db.execute("delete from v where rowid <= 10")
+    db.execute("insert into v(v) values ('optimize')")
+    db.execute("insert into v(rowid, embedding) values (100, '[1, 1]')")
+    check_layout(db)
+    for _ in range(10):
+        db.execute("insert into v(v) values ('reorganize')")
+    db.execute("insert into v(rowid, embedding) values (101, '[1, 1]')")
+    check_layout(db)
+    assert db.execute("select count(*) from v").fetchone()[0] == 12
@@ -0,0 +1,145 @@
+"""Tests for batched KNN queries, a MATCH on a packed matrix of query vectors."""
+import struct
+import sqlite3
+import random
+import pytest
+
+SUPPORTS_VTAB_LIMIT = sqlite3.sqlite_version_info[1] >= 41
+
+
+@pytest.fixture()
+def db():
+    db = sqlite3.connect(":memory:")
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def fill(db, metric="l2", dims=4, n=150):
+    db.execute(
+        f"create virtual table v using vec0(embedding float[{dims}] "
+        f"distance_metric={metric}, label integer, chunk_size=8)"
+    )
+    rng = random.Random(7)
+    db.executemany(
+        "insert into v(rowid, embedding, label) values (?, ?, ?)",
+        [
+            (i, float_vec([rng.uniform(-1, 1) for _ in range(dims)]), i % 3)
+            for i in range(1, n + 1)
+        ],
+    )
+    return [[rng.uniform(-1, 1) for _ in range(dims)] for _ in range(13)]
+
+
+def one_by_one(db, queries, extra=""):
+    rows = []
+    for i, q in enumerate(queries):
+        rows += [
+            (i, rowid, distance)
+            for rowid, distance in db.execute(
+                "select rowid, distance from v where embedding match ? and k = 5"
+                + extra,
+                [float_vec(q)],
+            )
+        ]
+    return rows
+
+
+@pytest.mark.parametrize("metric", ["l2", "cosine", "l1"])
+@pytest.mark.parametrize(
+    "extra", ["", " and label = 1", " and distance < 1.2", " and rowid in (1, 5, 9, 40, 77, 120)"]
+)
+def test_batch_matches_single_queries(db, metric, extra):
+    queries = fill(db, metric)
+    matrix = b"".join(float_vec(q) for q in queries)
+    rows = db.execute(
+        "select query_idx, rowid, distance from v where embedding match ? and k = 5"
+        + extra,
+        [matrix],
+    ).fetchall()
+    assert rows == one_by_one(db, queries, extra)
+
+
+def test_batch_json_and_order(db):
+    fill(db)
+    rows = db.execute(
+        "select query_idx, rowid from v "
+        "where embedding match '[1, 1, 1, 1, -1, -1, -1, -1]' and k = 2 "
+        "order by query_idx, distance"
+    ).fetchall()
+    assert [r[0] for r in rows] == [0, 0, 1, 1]
+    assert len(set(r[1] for r in rows)) == 4
+
+
+def test_single_query_idx(db):
+    fill(db)
+    assert db.execute(
+        "select query_idx from v where embedding match '[1, 1, 1, 1]' and k = 3"
+    ).fetchall() == [(0,), (0,), (0,)]
+    assert db.execute("select query_idx from v where rowid = 1").fetchall() == [
+        (None,)
+    ]
+
+
+def test_batch_errors(db):
+    fill(db)
+    if SUPPORTS_VTAB_LIMIT:
+        with pytest.raises(sqlite3.OperationalError, match="require a 'k = \\?' constraint"):
+            db.execute(
+                "select query_idx, rowid from v "
+                "where embedding match '[1,1,1,1,2,2,2,2]' limit 3"
+            ).fetchall()
+    with pytest.raises(sqlite3.OperationalError, match="Dimension mismatch"):
+        db.execute(
+            "select query_idx, rowid from v where embedding match '[1,1,1,1,2,2]' and k = 3"
+        ).fetchall()
+    with pytest.raises(sqlite3.OperationalError, match='hidden "query_idx" column'):
+        db.execute(
+            "insert into v(rowid, embedding, query_idx) values (1000, '[1,1,1,1]', 1)"
+        )
+
+    # a statement that doesn't read query_idx never asks for a batch, so a
+    # vector of the wrong size stays an error rather than several queries
+    for sql in [
+        "select rowid from v where embedding match ? and k = 3",
+        "select * from v where embedding match ? and k = 3",
+    ]:
+        with pytest.raises(sqlite3.OperationalError, match="Dimension mismatch"):
+            db.execute(sql, [float_vec([1] * 8)]).fetchall()
+    assert len(
+        db.execute(
+            "select rowid from v where embedding match ? and k = 3 and query_idx = 1",
+            [float_vec([1] * 8)],
+        ).fetchall()
+    ) == 3
+
+    db.execute(
+        "create virtual table r using vec0(embedding float[8] indexed by rescore(quantizer=bit))"
+    )
+    db.execute("insert into r(rowid, embedding) values (1, ?)", [float_vec([1] * 8)])
+    with pytest.raises(sqlite3.OperationalError, match="only supported on vector columns without an index"):
+        db.execute(
+            "select query_idx, rowid from r where embedding match ? and k = 1",
+            [float_vec([1] * 16)],
+        ).fetchall()
+
+
+def test_user_column_named_query_idx(db):
+    db.execute(
+        "create virtual table u using vec0(query_idx integer, embedding float[2])"
+    )
+    db.execute("insert into u(rowid, query_idx, embedding) values (1, 9, '[1, 2]')")
+    assert db.execute(
+        "select query_idx from u where embedding match '[1, 2]' and k = 1"
+    ).fetchall() == [(9,)]
+    # without the hidden column there is nothing to tag batched rows with
+    with pytest.raises(sqlite3.OperationalError, match="Dimension mismatch"):
+        db.execute(
+            "select query_idx, rowid from u where embedding match '[1, 2, 1, 2]' and k = 1"
+        ).fetchall()
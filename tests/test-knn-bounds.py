@@ -0,0 +1,245 @@
+"""Tests for per-chunk bounding boxes, used to skip chunks in KNN scans."""
+import json
+import random
+import sqlite3
+import struct
+import pytest
+from conftest import _has_build_flag
+
+
+def connect(path=":memory:"):
+    db = sqlite3.connect(path)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+@pytest.fixture()
+def db():
+    return connect()
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def bounds(db, table="v", chunk_id=None):
+    """(lo, hi, deletes) of every chunk's box, by chunk rowid."""
+    out = {}
+    for rowid, blob, deletes in db.execute(
+        f"select rowid, bounds, deletes from {table}_vector_bounds00"
+    ):
+        values = struct.unpack(f"{len(blob) // 4}f", blob)
+        half = len(values) // 2
+        out[rowid] = (list(values[:half]), list(values[half:]), deletes)
+    return out if chunk_id is None else out[chunk_id]
+
+
+def clustered(dims=4, n=200, seed=3):
+    """Rows inserted cluster by cluster, so every chunk covers a small region."""
+    rng = random.Random(seed)
+    rows = []
+    for i in range(n):
+        center = (i // 16) * 10.0
+        rows.append(
+            (i + 1, [center + rng.uniform(-1, 1) for _ in range(dims)], i % 3)
+        )
+    return rows
+
+
+def fill(db, metric="l2", rows=None, dims=4):
+    db.execute(
+        f"create virtual table v using vec0(embedding float[{dims}] "
+        f"distance_metric={metric} chunk_bounds=1, label integer, chunk_size=8)"
+    )
+    db.executemany(
+        "insert into v(rowid, embedding, label) values (?, ?, ?)",
+        [(r, float_vec(e), l) for r, e, l in rows or clustered(dims)],
+    )
+
+
+def knn(db, query, k, extra=""):
+    return db.execute(
+        f"select rowid, distance from v where embedding match ? and k = ? {extra}",
+        [float_vec(query), k],
+    ).fetchall()
+
+
+def unbounded(db, query, k, extra="", keep=lambda distance: True):
+    """KNN with k past the table's size: the heap never fills, so only
+    distance constraints could skip a chunk, and here they're checked after."""
+    rows = knn(db, query, 1000, extra)
+    return [r for r in rows if keep(r[1])][:k]
+
+
+@pytest.mark.parametrize("metric", ["l2", "l1"])
+@pytest.mark.parametrize(
+    "extra, keep",
+    [
+        ("", None),
+        (" and label = 1", None),
+        (" and distance < 15", lambda d: d < 15),
+        (" and distance <= 3", lambda d: d <= 3),
+    ],
+)
+def test_bounds_match_unbounded(db, metric, extra, keep):
+    fill(db, metric)
+    rng = random.Random(11)
+    for _ in range(20):
+        q = [rng.uniform(-5, 130) for _ in range(4)]
+        if keep:
+            expected = unbounded(db, q, 5, keep=keep)
+        else:
+            expected = unbounded(db, q, 5, extra)
+        assert knn(db, q, 5, extra) == expected
+
+
+def test_bounds_batched(db):
+    fill(db)
+    queries = [[0.5] * 4, [60.0] * 4, [200.0] * 4]
+    rows = db.execute(
+        "select query_idx, rowid, distance from v where embedding match ? and k = 4",
+        [b"".join(float_vec(q) for q in queries)],
+    ).fetchall()
+    assert rows == [
+        (i, rowid, distance)
+        for i, q in enumerate(queries)
+        for rowid, distance in unbounded(db, q, 4)
+    ]
+
+
+def test_bounds_maintained(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[2] chunk_bounds=1, chunk_size=16)"
+    )
+    assert bounds(db) == {}
+    db.execute("insert into v(rowid, embedding) values (1, '[1, 5]')")
+    db.execute("insert into v(rowid, embedding) values (2, '[-2, 3]')")
+    assert bounds(db, chunk_id=1) == ([-2, 3], [1, 5], 0)
+
+    # moving a row widens the box and counts as a removal
+    db.execute("update v set embedding = '[4, 4]' where rowid = 2")
+    assert bounds(db, chunk_id=1) == ([-2, 3], [4, 5], 1)
+
+    for i in range(3, 9):
+        db.execute(f"insert into v(rowid, embedding) values ({i}, '[{i}, {i}]')")
+    assert bounds(db, chunk_id=1) == ([-2, 3], [8, 8], 1)
+
+    # the second removal reaches 1/8 of the chunk and rebuilds the box
+    db.execute("delete from v where rowid = 8")
+    assert bounds(db, chunk_id=1) == ([1, 3], [7, 7], 0)
+
+    # reclaimed chunks take their box with them. rowid 8's slot is reused
+    for i in range(9, 19):
+        db.execute(f"insert into v(rowid, embedding) values ({i}, '[0, 0]')")
+    assert sorted(bounds(db)) == [1, 2]
+    db.execute("delete from v where rowid = 18")
+    assert sorted(bounds(db)) == [1]
+
+
+def test_bounds_after_deletes_and_updates(db):
+    rows = clustered()
+    fill(db, rows=rows)
+    rng = random.Random(5)
+    for rowid in rng.sample(range(1, 201), 80):
+        db.execute("delete from v where rowid = ?", [rowid])
+    for rowid in db.execute("select rowid from v").fetchall()[::7]:
+        db.execute(
+            "update v set embedding = ? where rowid = ?",
+            [float_vec([rng.uniform(-20, 150) for _ in range(4)]), rowid[0]],
+        )
+    for _ in range(20):
+        q = [rng.uniform(-5, 130) for _ in range(4)]
+        assert knn(db, q, 6) == unbounded(db, q, 6)
+
+
+def test_bounds_opt_in(db):
+    for column in [
+        "a float[2] distance_metric=cosine chunk_bounds=1",
+        "a int8[2] chunk_bounds=1",
+        "a bit[8] chunk_bounds=1",
+        "a float[2] chunk_bounds=2",
+        "a float[2] chunk_bounds",
+    ]:
+        with pytest.raises(sqlite3.OperationalError, match="could not parse vector column"):
+            db.execute(f"create virtual table v using vec0({column})")
+
+    # only columns declared with chunk_bounds=1 keep boxes
+    db.execute(
+        "create virtual table v using vec0(a float[2] distance_metric=cosine, "
+        "b int8[2], c bit[8], d float[2] chunk_bounds=1, e float[2], "
+        "f float[2] chunk_bounds=0)"
+    )
+    names = [
+        r[0]
+        for r in db.execute(
+            "select name from sqlite_master where name like 'v_vector_bounds%' order by 1"
+        )
+    ]
+    assert names == ["v_vector_bounds03"]
+    db.execute(
+        "insert into v(rowid, a, b, c, d, e, f) values "
+        "(1, '[1, 2]', vec_int8('[1, 2]'), vec_bit(x'ff'), '[1, 2]', '[1, 2]', '[1, 2]')"
+    )
+    assert db.execute(
+        "select rowid from v where a match '[1, 2]' and k = 1"
+    ).fetchall() == [(1,)]
+
+
+def test_bounds_legacy_table(tmp_path):
+    # tables created before boxes existed have no _vector_bounds tables
+    path = str(tmp_path / "legacy.db")
+    db = connect(path)
+    fill(db, rows=clustered()[:40])
+    db.execute("drop table v_vector_bounds00")
+    db.execute("delete from v_info where key = 'vector_bounds_00'")
+    db.commit()
+    db.close()
+
+    db = connect(path)
+    db.execute("insert into v(rowid, embedding, label) values (41, '[1, 1, 1, 1]', 0)")
+    db.execute("update v set embedding = '[2, 2, 2, 2]' where rowid = 2")
+    db.execute("delete from v where rowid = 3")
+    assert knn(db, [1, 1, 1, 1], 5) == unbounded(db, [1, 1, 1, 1], 5)
+    db.execute("alter table v rename to w")
+    db.execute("drop table w")
+
+
+def test_bounds_rename_reconnect(tmp_path):
+    path = str(tmp_path / "rename.db")
+    db = connect(path)
+    fill(db, rows=clustered()[:40])
+    db.execute("alter table v rename to w")
+    db.execute("insert into w(rowid, embedding, label) values (41, '[90, 0, 0, 0]', 0)")
+    assert bounds(db, "w")[6][1][0] == 90
+    db.commit()
+    db.close()
+
+    db = connect(path)
+    db.execute("delete from w where rowid = 40")
+    assert bounds(db, "w")[5][1][0] < 90
+    db.execute("delete from w where rowid = 41")
+    assert 6 not in bounds(db, "w")
+    db.execute("drop table w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w%'"
+    ).fetchone()[0] == 0
+
+
+@pytest.mark.skipif(
+    not _has_build_flag("prefetch"),
+    reason="prefetch not enabled (compile with -DSQLITE_VEC_ENABLE_PREFETCH=1)",
+)
+def test_bounds_skip_chunks(db):
+    fill(db)
+    rows = knn(db, [0.0] * 4, 3)
+    stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["chunks"] == 25
+    assert stats["skipped_chunks"] >= 20
+    assert rows == unbounded(db, [0.0] * 4, 3)
+
+    knn(db, [500.0] * 4, 3, "and distance < 1")
+    stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+    assert stats["skipped_chunks"] == 25
@@ -47,3 +47,32 @@ class Row:
         return repr()
 
 
+
+
+def test_targets_between_f32_distances(db):
+    # distances are f32, but constraints compare against the double the query
+    # passed in. Targets just off a distance round to it as f32, and must not
+    # flip the comparison.
+    db.execute(
+        "create virtual table v using vec0(a float[1] distance_metric=l1, b float[1], chunk_size=8)"
+    )
+    db.executemany(
+        "insert into v(rowid, a, b) values (?1, ?2, ?2)",
+        [[i, f"[{i / 10}]"] for i in range(1, 21)],
+    )
+    for column in ["a", "b"]:
+        knn = f"select rowid, distance from v where {column} match '[0]' and k = 20"
+        rows = [tuple(row) for row in db.execute(knn)]
+        assert len(rows) == 20
+        for _, d in rows[::3]:
+            for target in [d, d * (1 - 1e-9), d * (1 + 1e-9)]:
+                for op, matches in [
+                    ("<", lambda x: x < target),
+                    ("<=", lambda x: x <= target),
+                    (">", lambda x: x > target),
+                    (">=", lambda x: x >= target),
+                ]:
+                    assert [
+                        tuple(row)
+                        for row in db.execute(f"{knn} and distance {op} ?", [target])
+                    ] == [row for row in rows if matches(row[1])], (column, op, target)
@@ -143,7 +143,11 @@ def test_funcs():
             db.execute("select name from loaded_functions").fetchall(),
         )
     )
-    assert funcs == FUNCTIONS
+    build_flags = db.execute("select vec_debug()").fetchone()[0].split("Build flags:")[-1]
+    if "prefetch" in build_flags.split("\n")[0]:
+        assert funcs == sorted(FUNCTIONS + ["vec0_scan_stats"])
+    else:
+        assert funcs == FUNCTIONS
 
 
 def test_modules():
@@ -161,7 +165,8 @@ def test_vec_version():
 def test_vec_debug():
     vec_debug = lambda *args: db.execute("select vec_debug()", args).fetchone()[0]
     d = vec_debug().split("\n")
-    assert len(d) == 4
+    assert len(d) == 5
+    assert d[4].startswith("SIMD: cpu=")
 
 
 def test_vec_bit():
@@ -750,8 +755,15 @@ def test_vec0_inserts():
     db.set_authorizer(None)
 
     # EVIDENCE-OF: V31559_15629 vec0 INSERT error on _chunks shadow insert raises error
+    # (chunks are only looked up once a rollback drops the insert cursor)
+    db.commit()
+    db.execute("insert into t1 values (998, '[2,2,2,2]')")
+    db.rollback()
     db.set_authorizer(authorizer_deny_on(sqlite3.SQLITE_READ, "t1_chunks", "chunk_id"))
-    with _raises("Internal sqlite-vec error: Could not find latest chunk"):
+    with _raises(
+        "Internal sqlite-vec error: could not initialize 'free slots' statement",
+        sqlite3.DatabaseError,
+    ):
         db.execute("insert into t1 values (999, '[2,2,2,2]')")
     db.set_authorizer(None)
 
@@ -914,6 +926,7 @@ def test_vec0_drops():
     ] == [
         "t1",
         "t1_chunks",
+        "t1_free_slots",
         "t1_info",
         "t1_rowids",
         "t1_vector_chunks00",
@@ -1669,7 +1682,7 @@ def test_vec0_create_errors():
     db.execute("BEGIN")
     db.set_authorizer(authorizer_deny_on(sqlite3.SQLITE_READ, "t1_chunks", ""))
     with _raises(
-        "Internal sqlite-vec error: could not initialize 'latest chunk' statement",
+        "Internal sqlite-vec error: could not initialize 'free slots' statement",
         sqlite3.DatabaseError,
     ):
         db.execute("create virtual table t1 using vec0(a float[1])")
@@ -1845,6 +1858,47 @@ def test_vec0_knn():
     db.rollback()
 
 
+def test_vec0_knn_nan_inf_distances():
+    # rows at a NaN or +inf distance still fill the k results, after every
+    # finite distance
+    db = connect(EXT_PATH)
+    db.execute(
+        """
+          create virtual table v using vec0(
+            a float[4] distance_metric=cosine,
+            b float[4],
+            chunk_size=8
+          );
+        """
+    )
+    for i in range(1, 21):
+        db.execute(
+            "insert into v(rowid, a, b) values (?, ?, ?)",
+            # past row 4, squared distances overflow f32
+            [i, json.dumps([i, 1, 0, 0]), json.dumps([i if i <= 4 else i * 1e19, 0, 0, 0])],
+        )
+
+    # cosine against a zero vector is NaN for every row
+    rows = execute_all(
+        db, "select rowid, distance from v where a match '[0,0,0,0]' and k = 5"
+    )
+    assert len({row["rowid"] for row in rows}) == 5
+    assert all(row["distance"] is None for row in rows)
+
+    rows = execute_all(
+        db, "select rowid, distance from v where b match '[0,0,0,0]' and k = 7"
+    )
+    assert [row["rowid"] for row in rows[:4]] == [1, 2, 3, 4]
+    assert [row["distance"] for row in rows] == [1.0, 2.0, 3.0, 4.0] + [
+        float("inf")
+    ] * 3
+
+    rows = execute_all(
+        db, "select rowid from v where b match '[-1e20,0,0,0]' and k = 25"
+    )
+    assert len(rows) == 20
+
+
 import numpy.typing as npt
 
 
@@ -1936,6 +1990,9 @@ def test_smoke():
         {
             "name": "vec_xyz_chunks",
         },
+        {
+            "name": "vec_xyz_free_slots",
+        },
         {
             "name": "vec_xyz_info",
         },
@@ -1964,7 +2021,7 @@ def test_smoke():
     )
     if SUPPORTS_VTAB_LIMIT:
         assert re.match(
-            "SCAN (TABLE )?vec_xyz VIRTUAL TABLE INDEX 0:3{___}___",
+            "SCAN (TABLE )?vec_xyz VIRTUAL TABLE INDEX 0:3{___}L__",
             explain_query_plan(
                 "select * from vec_xyz where a match X'' order by distance limit 10"
             ),
@@ -2183,6 +2240,49 @@ def test_vec0_distance_metric():
     ]
 
 
+def test_vec0_normalize():
+    db = connect(EXT_PATH)
+    db.execute("create virtual table v1 using vec0(a float[3] distance_metric=cosine)")
+    db.execute(
+        "create virtual table v2 using vec0(a float[3] distance_metric=cosine normalize=1)"
+    )
+    base = [[1, 2, 3], [3, 4, 5], [-5, 6, 0.5], [10, -1, 2], [0.1, 0.1, 0.2]]
+    for i, v in enumerate(base):
+        for t in ["v1", "v2"]:
+            db.execute(f"insert into {t}(rowid, a) values (?, ?)", [i + 1, _f32(v)])
+
+    # stored vectors come back at unit length
+    a = np.frombuffer(db.execute("select a from v2 where rowid = 2").fetchone()[0], dtype=np.float32)
+    assert isclose(float(np.linalg.norm(a)), 1.0, rel_tol=1e-6)
+    assert np.allclose(a, np.array([3, 4, 5]) / np.linalg.norm([3, 4, 5]))
+
+    # same ranking and distances as a plain cosine column
+    q = _f32([2, 1, -1])
+    expected = db.execute(
+        "select rowid, distance from v1 where a match ? and k = 5", [q]
+    ).fetchall()
+    actual = db.execute(
+        "select rowid, distance from v2 where a match ? and k = 5", [q]
+    ).fetchall()
+    assert [r[0] for r in actual] == [r[0] for r in expected]
+    for (_, d1), (_, d2) in zip(actual, expected):
+        assert isclose(d1, d2, abs_tol=1e-6)
+
+    # updates are normalized too
+    db.execute("update v2 set a = ? where rowid = 1", [_f32([0, 0, 2])])
+    a = np.frombuffer(db.execute("select a from v2 where rowid = 1").fetchone()[0], dtype=np.float32)
+    assert a.tolist() == [0, 0, 1]
+
+    for column in [
+        "a float[3] normalize=1",
+        "a float[3] distance_metric=l2 normalize=1",
+        "a int8[3] distance_metric=cosine normalize=1",
+        "a float[3] distance_metric=cosine normalize=yes",
+    ]:
+        with pytest.raises(sqlite3.OperationalError):
+            db.execute(f"create virtual table bad using vec0({column})")
+
+
 def test_vec0_vacuum():
     db = connect(EXT_PATH)
     db.execute("create virtual table vec_t using vec0(a float[1]);")
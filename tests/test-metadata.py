@@ -3,6 +3,7 @@ import sqlite3
 from collections import OrderedDict
 import json
 from helpers import exec, vec0_shadow_table_contents
+from conftest import _has_build_flag
 
 
 def test_constructor_limit(db, snapshot):
@@ -399,6 +400,403 @@ def test_vtab_in_long_text(db, snapshot):
     ) == snapshot(name="all")
 
 
+@pytest.mark.skipif(
+    not SUPPORTS_VTAB_IN, reason="requires vtab `x in (...)` support in SQLite >=3.38"
+)
+def test_vtab_in_large_lists(db):
+    # long IN lists, with duplicates, negative numbers, and long strings that
+    # share their length and first 12 bytes
+    db.execute(
+        "create virtual table v using vec0(vector float[1], n int, t text, chunk_size=64)"
+    )
+    rows = [
+        (i, f"[{i}]", (i * 37) % 500 - 250, f"tenant-{i % 300:04}" + ("_x" * (i % 3)))
+        for i in range(1, 1001)
+    ]
+    db.executemany("insert into v(rowid, vector, n, t) values (?, ?, ?, ?)", rows)
+    ints = list(range(-250, 250, 3)) + [-250, 10**12, -(10**12)]
+    texts = (
+        [f"tenant-{i:04}" for i in range(0, 300, 2)]
+        + [f"tenant-{i:04}_x" for i in range(0, 300, 3)]
+        + [f"tenant-{i:04}_x_x" for i in range(0, 300, 5)]
+        + [f"tenant-{i:04}_y_y" for i in range(0, 300, 7)]
+        + ["tenant-0001", ""]
+    )
+
+    def knn(where, values):
+        return [
+            row["rowid"]
+            for row in db.execute(
+                "select rowid from v where vector match '[0]' and k = 1000 and "
+                f"{where} in (select value from json_each(?))",
+                [json.dumps(values)],
+            )
+        ]
+
+    assert knn("n", ints) == [row[0] for row in rows if row[2] in set(ints)]
+    assert knn("t", texts) == [row[0] for row in rows if row[3] in set(texts)]
+    assert knn("n", []) == []
+
+
+def test_knn_filter_before_read(db):
+    # chunks with no row left after the filters aren't read, and chunks with
+    # few rows left only have those rows' vectors read
+    db.execute(
+        "create virtual table v using vec0("
+        "a float[4] distance_metric=l1, b int8[4] distance_metric=l1, "
+        "tenant int, chunk_size=256)"
+    )
+    rows = []
+    for i in range(1, 2001):
+        # the first four chunks hold one tenant each, the rest are mixed
+        tenant = (i - 1) // 256 if i <= 1024 else 10 + (i * 7) % 100
+        a = [(i * 7) % 101, i % 13, (i * 3) % 17, 50]
+        rows.append((i, a, tenant))
+    db.executemany(
+        "insert into v(rowid, a, b, tenant) values (?, ?, vec_int8(?), ?)",
+        [(i, json.dumps(a), json.dumps([x - 50 for x in a]), t) for i, a, t in rows],
+    )
+    query = [40, 6, 8, 50]
+
+    # k is past the number of candidates, so ties can't change the results
+    def expected(where):
+        return [
+            (i, float(d))
+            for d, i in sorted(
+                (sum(abs(x - y) for x, y in zip(a, query)), i)
+                for i, a, t in rows
+                if where(i, t)
+            )
+        ]
+
+    def knn(column, where, q=query):
+        if column == "b":
+            q = [x - 50 for x in q]
+        return sorted(
+            (
+                (row[0], row[1])
+                for row in db.execute(
+                    f"select rowid, distance from v where {column} match "
+                    f"{'vec_int8(?)' if column == 'b' else '?'} and k = 2000 and {where}",
+                    [json.dumps(q)],
+                )
+            ),
+            key=lambda r: (r[1], r[0]),
+        )
+
+    for column in ("a", "b"):
+        # a single chunk has candidates
+        assert knn(column, "tenant = 2") == expected(lambda i, t: t == 2)
+        # a few candidates per mixed chunk
+        assert knn(column, "tenant = 15") == expected(lambda i, t: t == 15)
+        assert knn(column, "tenant in (3, 17)") == expected(
+            lambda i, t: t in (3, 17)
+        )
+        # adjacent candidates are read together
+        assert knn(
+            column, "rowid in (1500, 1501, 1502, 1503, 1504, 1505) and tenant >= 0"
+        ) == expected(lambda i, t: 1500 <= i <= 1505)
+        assert knn(column, "rowid in (1, 256, 257, 1999, 2000)") == expected(
+            lambda i, t: i in (1, 256, 257, 1999, 2000)
+        )
+        assert knn(column, "tenant = 1000") == []
+        assert knn(column, "tenant < 60") == expected(lambda i, t: t < 60)
+
+    if _has_build_flag("prefetch"):
+        knn("a", "tenant = 2")
+        stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+        assert (stats["chunks"], stats["filtered_chunks"]) == (8, 7)
+        assert stats["sparse_chunks"] == 0
+        knn("a", "tenant = 15")
+        stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+        assert stats["filtered_chunks"] == 4
+        assert stats["sparse_chunks"] == 4
+
+    # batched queries score the same sparse chunks
+    assert sorted(
+        (row[0], row[2], row[1])
+        for row in db.execute(
+            "select query_idx, rowid, distance from v where a match ? and k = 2000 "
+            "and tenant = 15",
+            [json.dumps(query + [0, 0, 0, 0])],
+        )
+    ) == [(0, d, i) for i, d in expected(lambda i, t: t == 15)] + [
+        (1, float(d), i) for d, i in sorted((sum(a), i) for i, a, t in rows if t == 15)
+    ]
+
+
+def test_knn_metadata_bounds(db):
+    # each chunk keeps the range of its integer, float and boolean metadata
+    # values, and KNN queries skip chunks whose range rules out a constraint
+    db.execute(
+        "create virtual table v using vec0("
+        "a float[2], n int, x float, flag boolean, label text, chunk_size=16)"
+    )
+    values = {}
+
+    def insert(ids):
+        for i in ids:
+            values[i] = (i, i / 2, ((i - 1) // 16) % 2 == 0)
+        db.executemany(
+            "insert into v(rowid, a, n, x, flag, label) values (?, ?, ?, ?, ?, 'x')",
+            [(i, json.dumps([i % 7, 1]), *values[i]) for i in ids],
+        )
+
+    def bounds(column):
+        return {
+            chunk_id: (lo, hi, deletes)
+            for chunk_id, lo, hi, deletes in db.execute(
+                f"select rowid, lo, hi, deletes from v_metadatabounds{column:02}"
+            )
+        }
+
+    def check_bounds():
+        # every live value lies within its chunk's range
+        for column in range(3):
+            ranges = bounds(column)
+            for rowid, chunk_id in db.execute(
+                "select rowid, chunk_id from v_rowids where chunk_id is not null"
+            ):
+                lo, hi, _ = ranges[chunk_id]
+                assert lo <= values[rowid][column] <= hi, (column, rowid)
+            chunks = [r[0] for r in db.execute("select rowid from v_chunks")]
+            assert sorted(ranges) == sorted(chunks)
+
+    def check_knn():
+        for where, matches in [
+            ("n = 20", lambda n, x, f: n == 20),
+            ("n > 60", lambda n, x, f: n > 60),
+            ("n >= 64", lambda n, x, f: n >= 64),
+            ("n < 17", lambda n, x, f: n < 17),
+            ("n <= 16", lambda n, x, f: n <= 16),
+            ("n != 3", lambda n, x, f: n != 3),
+            ("n > 10 and n < 20", lambda n, x, f: 10 < n < 20),
+            ("n = 1000", lambda n, x, f: n == 1000),
+            ("x < 8.5", lambda n, x, f: x < 8.5),
+            ("x >= 30.0", lambda n, x, f: x >= 30.0),
+            ("x = 10.0", lambda n, x, f: x == 10.0),
+            ("flag = 1", lambda n, x, f: f),
+            ("flag = 0", lambda n, x, f: not f),
+            ("flag != 1", lambda n, x, f: not f),
+            ("flag = 1 and n > 40", lambda n, x, f: f and n > 40),
+        ]:
+            assert sorted(
+                row[0]
+                for row in db.execute(
+                    f"select rowid from v where a match '[0, 1]' and k = 200 and {where}"
+                )
+            ) == sorted(i for i, v in values.items() if matches(*v)), where
+
+    insert(range(1, 81))
+    check_bounds()
+    check_knn()
+    assert bounds(0)[2] == (17, 32, 0)
+    assert bounds(1)[2] == (8.5, 16.0, 0)
+    assert bounds(2)[1] == (1, 1, 0)
+    assert bounds(2)[2] == (0, 0, 0)
+    # TEXT columns keep no range
+    assert db.execute(
+        "select count(*) from sqlite_master where name = 'v_metadatabounds03'"
+    ).fetchone()[0] == 0
+
+    if _has_build_flag("prefetch"):
+        db.execute(
+            "select rowid from v where a match '[0, 1]' and k = 5 and n = 20"
+        ).fetchall()
+        stats = json.loads(db.execute("select vec0_scan_stats()").fetchone()[0])
+        assert (stats["chunks"], stats["filtered_chunks"]) == (5, 4)
+
+    # an update widens the range, and counts as a removal of the old value
+    db.execute("update v set n = 1000 where rowid = 3")
+    values[3] = (1000, *values[3][1:])
+    assert bounds(0)[1] == (1, 1000, 1)
+    check_knn()
+
+    # deletes leave the range loose until an eighth of the chunk is gone
+    db.execute("delete from v where rowid = 17")
+    del values[17]
+    assert bounds(0)[2] == (17, 32, 1)
+    check_knn()
+    db.execute("delete from v where rowid = 32")
+    del values[32]
+    assert bounds(0)[2] == (18, 31, 0)
+    assert bounds(2)[2] == (0, 0, 0)
+    check_bounds()
+    check_knn()
+
+    # emptied chunks take their ranges with them
+    db.execute("delete from v where rowid between 33 and 48")
+    for i in range(33, 49):
+        del values[i]
+    assert 3 not in bounds(0)
+    check_bounds()
+    check_knn()
+
+    # rows written in batches widen the range once per chunk
+    db.commit()
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    insert(range(81, 121))
+    db.commit()
+    check_bounds()
+    check_knn()
+    db.execute("insert into v(v) values ('write_behind=0')")
+
+    # moved rows widen the range of their new chunk
+    db.execute("delete from v where rowid % 3 = 0")
+    for i in [i for i in values if i % 3 == 0]:
+        del values[i]
+    db.execute("insert into v(v) values ('optimize')")
+    check_bounds()
+    check_knn()
+
+    db.execute("alter table v rename to w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w_metadatabounds%'"
+    ).fetchone()[0] == 3
+    db.execute("drop table w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w%'"
+    ).fetchone()[0] == 0
+
+
+def test_knn_metadata_bounds_legacy_table(tmp_path):
+    # tables created before ranges existed have no _metadatabounds tables
+    path = str(tmp_path / "legacy.db")
+    db = sqlite3.connect(path)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.execute(
+        "create virtual table v using vec0(a float[1], n int, chunk_size=8)"
+    )
+    db.executemany(
+        "insert into v(rowid, a, n) values (?, ?, ?)",
+        [(i, json.dumps([i]), i) for i in range(1, 41)],
+    )
+    db.execute("drop table v_metadatabounds00")
+    db.execute("delete from v_info where key = 'metadata_bounds_00'")
+    db.commit()
+    db.close()
+
+    db = sqlite3.connect(path)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.execute("insert into v(rowid, a, n) values (41, '[41]', 41)")
+    db.execute("update v set n = 100 where rowid = 2")
+    db.execute("delete from v where rowid = 3")
+    assert db.execute(
+        "select rowid from v where a match '[0]' and k = 3 and n >= 40"
+    ).fetchall() == [(2,), (40,), (41,)]
+    db.execute("alter table v rename to w")
+    db.execute("drop table w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w%'"
+    ).fetchone()[0] == 0
+
+
+def test_text_dictionary(db):
+    # `text dictionary` columns store each distinct value once, and chunks
+    # hold codes
+    db.execute(
+        "create virtual table v using vec0("
+        "a float[1], genre text DICTIONARY, chunk_size=8)"
+    )
+    genres = [
+        "scifi",
+        "drama",
+        "",
+        "comedy",
+        "a genre name longer than a text view",
+        "a genre name longer than a text view, and then some",
+        "émigré",
+    ]
+    values = {i: genres[(i * 5) % len(genres)] for i in range(1, 61)}
+    db.executemany(
+        "insert into v(rowid, a, genre) values (?, ?, ?)",
+        [(i, json.dumps([i]), g) for i, g in values.items()],
+    )
+
+    assert [r[0] for r in db.execute("select value from v_metadatadict00")] == list(
+        dict.fromkeys(values.values())
+    )
+    assert db.execute(
+        "select count(*) from sqlite_master where name = 'v_metadatatext00'"
+    ).fetchone()[0] == 0
+    assert {
+        len(r[0]) for r in db.execute("select data from v_metadatachunks00")
+    } == {8 * 8}
+
+    def check():
+        assert [
+            tuple(row) for row in db.execute("select rowid, genre from v order by rowid")
+        ] == sorted(values.items())
+        for op, target, matches in [
+            ("=", "'drama'", lambda g: g == "drama"),
+            ("=", "''", lambda g: g == ""),
+            ("=", "'western'", lambda g: g == "western"),
+            ("!=", "'drama'", lambda g: g != "drama"),
+            ("!=", "'western'", lambda g: g != "western"),
+            (">", "'comedy'", lambda g: g > "comedy"),
+            (">=", "'comedy'", lambda g: g >= "comedy"),
+            ("<", "'drama'", lambda g: g < "drama"),
+            ("<=", "'drama'", lambda g: g <= "drama"),
+            (">", "'a genre name longer than a text view'",
+             lambda g: g > "a genre name longer than a text view"),
+            ("in", "('scifi', 'western', 'émigré')",
+             lambda g: g in ("scifi", "western", "émigré")),
+            ("in", "('western')", lambda g: g == "western"),
+        ]:
+            assert sorted(
+                row[0]
+                for row in db.execute(
+                    f"select rowid from v where a match '[0]' and k = 100 "
+                    f"and genre {op} {target}"
+                )
+            ) == sorted(i for i, g in values.items() if matches(g)), (op, target)
+
+    check()
+
+    db.execute("update v set genre = 'western' where rowid = 1")
+    values[1] = "western"
+    db.execute("delete from v where rowid in (2, 3)")
+    del values[2], values[3]
+    check()
+
+    db.commit()
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.executemany(
+        "insert into v(rowid, a, genre) values (?, ?, ?)",
+        [(i, json.dumps([i]), genres[i % 3]) for i in range(61, 81)],
+    )
+    values.update({i: genres[i % 3] for i in range(61, 81)})
+    db.commit()
+    db.execute("insert into v(v) values ('write_behind=0')")
+    check()
+
+    db.execute("delete from v where rowid % 3 = 0")
+    for i in [i for i in values if i % 3 == 0]:
+        del values[i]
+    db.execute("insert into v(v) values ('optimize')")
+    check()
+
+    # values stay in the dictionary once added
+    assert db.execute("select count(*) from v_metadatadict00").fetchone()[0] == 8
+
+    db.execute("alter table v rename to w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name = 'w_metadatadict00'"
+    ).fetchone()[0] == 1
+    db.execute("drop table w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w%'"
+    ).fetchone()[0] == 0
+
+    with pytest.raises(
+        sqlite3.OperationalError,
+        match="'dictionary' is only available on TEXT metadata columns",
+    ):
+        db.execute("create virtual table x using vec0(a float[1], n int dictionary)")
+
+
 def test_idxstr(db, snapshot):
     db.execute(
         """
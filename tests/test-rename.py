@@ -21,6 +21,7 @@ def test_rename_basic(db):
 
     assert _shadow_tables(db, "v") == [
         "v_chunks",
+        "v_free_slots",
         "v_info",
         "v_rowids",
         "v_vector_chunks00",
@@ -43,6 +44,7 @@ def test_rename_basic(db):
     # Shadow tables should all be renamed
     assert _shadow_tables(db, "v2") == [
         "v2_chunks",
+        "v2_free_slots",
         "v2_info",
         "v2_rowids",
         "v2_vector_chunks00",
@@ -98,6 +100,7 @@ def test_rename_with_auxiliary(db):
     assert _shadow_tables(db, "v") == [
         "v_auxiliary",
         "v_chunks",
+        "v_free_slots",
         "v_info",
         "v_rowids",
         "v_vector_chunks00",
@@ -116,6 +119,7 @@ def test_rename_with_auxiliary(db):
     assert _shadow_tables(db, "v2") == [
         "v2_auxiliary",
         "v2_chunks",
+        "v2_free_slots",
         "v2_info",
         "v2_rowids",
         "v2_vector_chunks00",
@@ -135,6 +139,7 @@ def test_rename_with_metadata(db):
 
     assert _shadow_tables(db, "v") == [
         "v_chunks",
+        "v_free_slots",
         "v_info",
         "v_metadatachunks00",
         "v_metadatatext00",
@@ -153,6 +158,7 @@ def test_rename_with_metadata(db):
 
     assert _shadow_tables(db, "v2") == [
         "v2_chunks",
+        "v2_free_slots",
         "v2_info",
         "v2_metadatachunks00",
         "v2_metadatatext00",
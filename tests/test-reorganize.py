@@ -0,0 +1,276 @@
+"""Tests for the 'reorganize' command, which clusters rows into chunks."""
+import json
+import random
+import sqlite3
+import struct
+import pytest
+from conftest import _has_build_flag
+
+
+def connect(path=":memory:"):
+    db = sqlite3.connect(path)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+@pytest.fixture()
+def db():
+    return connect()
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def scattered(n=300, dims=4, seed=7):
+    """Rows from 10 tight clusters, inserted in random cluster order so every
+    chunk starts out covering most of the space."""
+    rng = random.Random(seed)
+    rows = []
+    for i in range(n):
+        center = rng.randrange(10) * 20.0
+        rows.append((i + 1, [center + rng.uniform(-1, 1) for _ in range(dims)]))
+    return rows
+
+
+def reorganize(db, table="v", max_steps=1000):
+    """Run 'reorganize' steps until done, returning how many it took."""
+    for step in range(1, max_steps + 1):
+        db.execute(f"insert into {table}({table}) values ('reorganize')")
+        if not reorganizing(db, table):
+            return step
+    raise AssertionError("reorganize did not finish")
+
+
+def reorganizing(db, table="v"):
+    return db.execute(
+        f"select count(*) from {table}_info where key = 'reorganize_chunk'"
+    ).fetchone()[0] == 1
+
+
+def contents(db, table="v"):
+    return db.execute(f"select * from {table} order by rowid").fetchall()
+
+
+def knn(db, query, k, extra="", table="v"):
+    return db.execute(
+        f"select rowid, distance from {table} where embedding match ? and k = ? {extra}",
+        [float_vec(query), k],
+    ).fetchall()
+
+
+def chunk_spread(db, table="v"):
+    """Mean per-chunk extent of the first dimension, from the rows themselves."""
+    spreads = []
+    for (chunk_id,) in db.execute(f"select rowid from {table}_chunks"):
+        xs = [
+            struct.unpack("4f", e)[0]
+            for (e,) in db.execute(
+                f"select embedding from {table} where rowid in "
+                f"(select rowid from {table}_rowids where chunk_id = ?)",
+                [chunk_id],
+            )
+        ]
+        spreads.append(max(xs) - min(xs))
+    return sum(spreads) / len(spreads)
+
+
+def test_reorganize_clusters_chunks(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[4], label integer, "
+        "chunk_size=32)"
+    )
+    db.executemany(
+        "insert into v(rowid, embedding, label) values (?, ?, ?)",
+        [(r, float_vec(e), r % 5) for r, e in scattered()],
+    )
+    before = contents(db)
+    queries = [[random.Random(i).uniform(0, 180)] * 4 for i in range(10)]
+    expected = [knn(db, q, 5) for q in queries]
+    spread = chunk_spread(db)
+
+    reorganize(db)
+    assert contents(db) == before
+    assert [knn(db, q, 5) for q in queries] == expected
+    assert [knn(db, q, 5, "and label = 2") for q in queries] == [
+        [r for r in knn(db, q, 1000) if r[0] % 5 == 2][:5] for q in queries
+    ]
+    # chunks may straddle two neighbouring clusters, but no more
+    assert chunk_spread(db) < spread / 3
+
+    # rows are packed densely, and every old chunk is gone
+    assert db.execute("select count(*) from v_chunks").fetchone()[0] == 10
+    assert db.execute("select min(rowid) from v_chunks").fetchone()[0] > 10
+    assert db.execute("select count(*) from v_reorganize").fetchone()[0] == 0
+
+    # the table keeps working: new rows, deletes and updates
+    db.execute("insert into v(rowid, embedding, label) values (1000, '[1, 1, 1, 1]', 1)")
+    db.execute("delete from v where rowid = 5")
+    db.execute("update v set embedding = '[2, 2, 2, 2]' where rowid = 6")
+    assert knn(db, [1, 1, 1, 1], 2)[0][0] == 1000
+    assert db.execute("select count(*) from v").fetchone()[0] == 300
+
+
+def test_reorganize_steps_are_bounded(db):
+    db.execute("create virtual table v using vec0(embedding float[4], chunk_size=8)")
+    db.executemany(
+        "insert into v(rowid, embedding) values (?, ?)",
+        [(r, float_vec(e)) for r, e in scattered(n=400)],
+    )
+    before = contents(db)
+    # one planning step, then 16 chunks worth of rows per step
+    db.execute("insert into v(v) values ('reorganize')")
+    assert db.execute("select count(*) from v_reorganize").fetchone()[0] == 400
+    db.execute("insert into v(v) values ('reorganize')")
+    assert db.execute("select count(*) from v_reorganize").fetchone()[0] == 400 - 128
+
+    # writes between steps: deleted rows are dropped from the plan, and new
+    # rows fill free slots in reorganized chunks, never in the old ones
+    db.execute("delete from v where rowid in (1, 2, 3)")
+    db.execute("insert into v(rowid, embedding) values (401, '[0, 0, 0, 0]')")
+    steps = reorganize(db)
+    assert steps == 3
+    assert contents(db) == [r for r in before if r[0] > 3] + [
+        (401, float_vec([0, 0, 0, 0]))
+    ]
+
+
+def test_reorganize_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "embedding float[4], chunk_size=8)"
+    )
+    rows = scattered(n=120)
+    db.executemany(
+        "insert into v(rowid, user_id, embedding) values (?, ?, ?)",
+        [(r, r % 3, float_vec(e)) for r, e in rows],
+    )
+    before = contents(db)
+    expected = [knn(db, [20.0] * 4, 5, f"and user_id = {u}") for u in range(3)]
+    reorganize(db)
+    assert contents(db) == before
+    assert [knn(db, [20.0] * 4, 5, f"and user_id = {u}") for u in range(3)] == expected
+    for chunk_id, user_id in db.execute("select rowid, partition00 from v_chunks"):
+        users = db.execute(
+            "select distinct user_id from v where rowid in "
+            "(select rowid from v_rowids where chunk_id = ?)",
+            [chunk_id],
+        ).fetchall()
+        assert users == [(user_id,)]
+
+
+def test_reorganize_all_columns(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[4], b bit[8], "
+        "c int8[2], flag boolean, n integer, x float, name text, +note text, "
+        "chunk_size=8)"
+    )
+    rng = random.Random(1)
+    for r, e in scattered(n=60):
+        db.execute(
+            "insert into v(rowid, embedding, b, c, flag, n, x, name, note) "
+            "values (?, ?, vec_bit(?), vec_int8(?), ?, ?, ?, ?, ?)",
+            [
+                r,
+                float_vec(e),
+                bytes([r % 256]),
+                json.dumps([r % 100, -(r % 100)]),
+                r % 2 == 0,
+                r * 1000,
+                r / 7,
+                f"short{r}" if r % 2 else f"a long text value for row {r}",
+                f"note {r}",
+            ],
+        )
+    before = contents(db)
+    reorganize(db)
+    assert contents(db) == before
+    assert db.execute(
+        "select rowid from v where flag = 1 and name = 'a long text value for row 8'"
+    ).fetchall() == [(8,)]
+    assert db.execute("select rowid from v where b match vec_bit(x'07') and k = 1").fetchall() == [(7,)]
+    db.execute("delete from v where rowid = 8")
+    assert db.execute("select count(*) from v_metadatatext03").fetchone()[0] == 29
+
+
+@pytest.mark.skipif(
+    not _has_build_flag("rescore"), reason="rescore not enabled"
+)
+def test_reorganize_rescore(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[4], "
+        "r float[8] indexed by rescore(quantizer=bit), chunk_size=8)"
+    )
+    rng = random.Random(2)
+    for r, e in scattered(n=64):
+        db.execute(
+            "insert into v(rowid, embedding, r) values (?, ?, ?)",
+            [r, float_vec(e), float_vec([rng.uniform(-1, 1) for _ in range(8)])],
+        )
+    q = float_vec([0.5] * 8)
+    expected = db.execute("select rowid, distance from v where r match ? and k = 5", [q]).fetchall()
+    before = contents(db)
+    reorganize(db)
+    assert contents(db) == before
+    assert db.execute("select rowid, distance from v where r match ? and k = 5", [q]).fetchall() == expected
+
+
+def test_reorganize_keeps_bounds(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[4] chunk_bounds=1, chunk_size=8)"
+    )
+    db.executemany(
+        "insert into v(rowid, embedding) values (?, ?)",
+        [(r, float_vec(e)) for r, e in scattered(n=100)],
+    )
+    reorganize(db)
+    chunks = [r[0] for r in db.execute("select rowid from v_chunks")]
+    assert sorted(r[0] for r in db.execute("select rowid from v_vector_bounds00")) == chunks
+    for chunk_id, blob in db.execute("select rowid, bounds from v_vector_bounds00"):
+        lo, hi = struct.unpack("4f", blob[:16]), struct.unpack("4f", blob[16:])
+        for (e,) in db.execute(
+            "select embedding from v where rowid in "
+            "(select rowid from v_rowids where chunk_id = ?)",
+            [chunk_id],
+        ):
+            values = struct.unpack("4f", e)
+            assert all(l <= x <= h for l, x, h in zip(lo, values, hi))
+
+
+def test_reorganize_rename_and_drop(tmp_path):
+    path = str(tmp_path / "reorganize.db")
+    db = connect(path)
+    db.execute("create virtual table v using vec0(embedding float[4], chunk_size=8)")
+    db.executemany(
+        "insert into v(rowid, embedding) values (?, ?)",
+        [(r, float_vec(e)) for r, e in scattered(n=200)],
+    )
+    before = contents(db)
+    db.execute("insert into v(v) values ('reorganize')")
+    db.execute("insert into v(v) values ('reorganize')")
+    db.execute("alter table v rename to w")
+    db.commit()
+    db.close()
+
+    db = connect(path)
+    reorganize(db, "w")
+    assert contents(db, "w") == before
+
+    db.execute("insert into w(w) values ('reorganize')")
+    db.execute("drop table w")
+    assert db.execute(
+        "select count(*) from sqlite_master where name like 'w%'"
+    ).fetchone()[0] == 0
+
+
+def test_reorganize_empty_and_errors(db):
+    db.execute("create virtual table v using vec0(embedding float[4])")
+    db.execute("insert into v(v) values ('reorganize')")
+    assert not reorganizing(db)
+
+    db.execute("create virtual table b using vec0(embedding bit[8])")
+    with pytest.raises(sqlite3.OperationalError, match="reorganize requires"):
+        db.execute("insert into b(b) values ('reorganize')")
@@ -440,6 +440,28 @@ def test_knn_k_larger_than_n(db):
     assert len(rows) == 2
 
 
+def test_knn_zero_query_cosine(db):
+    """A zero query has a NaN cosine distance to every row, which must still
+    fill the k results."""
+    db.execute(
+        "CREATE VIRTUAL TABLE t USING vec0("
+        "  embedding float[8] distance_metric=cosine"
+        "  indexed by rescore(quantizer=int8)"
+        ")"
+    )
+    for i in range(20):
+        db.execute(
+            "INSERT INTO t(rowid, embedding) VALUES (?, ?)",
+            [i + 1, float_vec([i + 1] + [1.0] * 7)],
+        )
+    rows = db.execute(
+        "SELECT rowid, distance FROM t WHERE embedding MATCH ? AND k = 5",
+        [float_vec([0.0] * 8)],
+    ).fetchall()
+    assert len(rows) == 5
+    assert len({r["rowid"] for r in rows}) == 5
+
+
 # ============================================================================
 # Integration / edge case tests
 # ============================================================================
@@ -465,6 +487,42 @@ def test_knn_with_rowid_in(db):
     assert result_ids <= {1, 3, 5}
 
 
+def test_knn_with_rowid_in_across_chunks(db):
+    # chunks without a listed rowid aren't read, the others only in part
+    db.execute(
+        "CREATE VIRTUAL TABLE t USING vec0("
+        "  embedding float[8] indexed by rescore(quantizer=int8, oversample=1),"
+        "  chunk_size=64"
+        ")"
+    )
+    vectors = {i: [(i % 97) / 10] * 8 for i in range(1, 501)}
+    for i, v in vectors.items():
+        db.execute(
+            "INSERT INTO t(rowid, embedding) VALUES (?, ?)", [i, float_vec(v)]
+        )
+    ids = [2, 5, 9, 100, 250, 251, 499]
+
+    def knn(k):
+        return [
+            (r["rowid"], r["distance"])
+            for r in db.execute(
+                "SELECT rowid, distance FROM t WHERE embedding MATCH ? "
+                f"AND k = {k} AND rowid IN ({', '.join(map(str, ids))})",
+                [float_vec([0.0] * 8)],
+            )
+        ]
+
+    expected = sorted(ids, key=lambda i: vectors[i][0])
+    # with oversample=1 the quantized distances alone pick the rows
+    for k in (2, 10):
+        rows = knn(k)
+        assert [rowid for rowid, _ in rows] == expected[:k]
+        for rowid, distance in rows:
+            assert distance == pytest.approx(
+                math.sqrt(8) * vectors[rowid][0], rel=1e-5
+            )
+
+
 def test_knn_after_deletes(db):
     db.execute(
         "CREATE VIRTUAL TABLE t USING vec0("
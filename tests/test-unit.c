@@ -500,6 +500,76 @@ void test_vec0_parse_vector_column() {
     assert(rc == SQLITE_ERROR);
   }
 
+  // normalize=1 on a float cosine column, in either order
+  {
+    const char *input = "emb float[128] distance_metric=cosine normalize=1";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.normalize == 1);
+    assert(col.distance_metric == VEC0_DISTANCE_METRIC_COSINE);
+    sqlite3_free(col.name);
+  }
+  {
+    const char *input = "emb float[128] normalize=1 distance_metric=cosine";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.normalize == 1);
+    sqlite3_free(col.name);
+  }
+  {
+    const char *input = "emb float[128] distance_metric=L2 normalize=0";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.normalize == 0);
+    sqlite3_free(col.name);
+  }
+
+  // Error: normalize=1 needs a float32 cosine column
+  {
+    const char *input = "emb float[128] normalize=1";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+  {
+    const char *input = "emb int8[128] distance_metric=cosine normalize=1";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+  {
+    const char *input = "emb float[128] distance_metric=cosine normalize=2";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+
+  // chunk_bounds=1 on float L2 and L1 columns, off by default
+  {
+    const char *input = "emb float[128]";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.chunk_bounds == 0);
+    sqlite3_free(col.name);
+  }
+  {
+    const char *input = "emb float[128] chunk_bounds=1 distance_metric=L1";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.chunk_bounds == 1);
+    assert(col.distance_metric == VEC0_DISTANCE_METRIC_L1);
+    sqlite3_free(col.name);
+  }
+
+  // Error: chunk_bounds=1 needs a float32 L2 or L1 column without an index
+  {
+    const char *input = "emb float[128] distance_metric=cosine chunk_bounds=1";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+  {
+    const char *input = "emb int8[128] chunk_bounds=1";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+
   // indexed by flat()
   {
     const char *input = "emb float[768] indexed by flat()";
@@ -936,6 +1006,487 @@ void test_distance_hamming() {
   printf("  All distance_hamming tests passed.\n");
 }
 
+static uint32_t test_rng_state = 1;
+static uint32_t test_rng_next(void) {
+  test_rng_state = test_rng_state * 1103515245u + 12345u;
+  return test_rng_state >> 8;
+}
+
+static int test_close(double actual, double expected, double rel) {
+  double tol = rel * (fabs(expected) > 1.0 ? fabs(expected) : 1.0);
+  return fabs(actual - expected) <= tol;
+}
+
+// Every SIMD level the CPU supports must agree with the scalar kernels, for
+// dimension counts that do and don't line up with the vector widths.
+void test_distance_kernels_dispatch() {
+  printf("Starting %s...\n", __func__);
+  // every remainder of the 16/32/64-wide loops, plus common embedding sizes
+  size_t dims[130 + 5];
+  for (size_t i = 0; i < 130; i++) {
+    dims[i] = i + 1;
+  }
+  dims[130] = 300;
+  dims[131] = 384;
+  dims[132] = 768;
+  dims[133] = 999;
+  dims[134] = 1000;
+  size_t max_dims = 1000;
+  float *fa = malloc(max_dims * sizeof(float));
+  float *fb = malloc(max_dims * sizeof(float));
+  int8_t *ia = malloc(max_dims);
+  int8_t *ib = malloc(max_dims);
+  unsigned char *ba = malloc(max_dims);
+  unsigned char *bb = malloc(max_dims);
+  assert(fa && fb && ia && ib && ba && bb);
+
+  for (size_t i = 0; i < max_dims; i++) {
+    fa[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+    fb[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+    ia[i] = (int8_t)(test_rng_next() & 0xFF);
+    ib[i] = (int8_t)(test_rng_next() & 0xFF);
+    ba[i] = (unsigned char)(test_rng_next() & 0xFF);
+    bb[i] = (unsigned char)(test_rng_next() & 0xFF);
+  }
+  // extreme int8 values, diff*diff overflows i16
+  ia[0] = -128;
+  ib[0] = 127;
+
+  int max_level = _test_distance_kernels_init(3);
+  printf("  highest supported level: %d\n", max_level);
+
+  for (size_t t = 0; t < countof(dims); t++) {
+    size_t d = dims[t];
+    assert(_test_distance_kernels_init(0) == 0);
+    float l2_f32 = _test_distance_l2_sqr_float(fa, fb, d);
+    float cos_f32 = _test_distance_cosine_float(fa, fb, d);
+    double l1_f32 = _test_distance_l1_f32(fa, fb, d);
+    float l2_i8 = _test_distance_l2_sqr_int8(ia, ib, d);
+    float cos_i8 = _test_distance_cosine_int8(ia, ib, d);
+    int32_t l1_i8 = _test_distance_l1_int8(ia, ib, d);
+    float ham = _test_distance_hamming(ba, bb, d * 8);
+
+    for (int level = 1; level <= max_level; level++) {
+      assert(_test_distance_kernels_init(level) == level);
+      assert(test_close(_test_distance_l2_sqr_float(fa, fb, d), l2_f32, 1e-5));
+      assert(test_close(_test_distance_cosine_float(fa, fb, d), cos_f32, 1e-5));
+      assert(test_close(_test_distance_l1_f32(fa, fb, d), l1_f32, 1e-9));
+      assert(test_close(_test_distance_l2_sqr_int8(ia, ib, d), l2_i8, 1e-5));
+      assert(test_close(_test_distance_cosine_int8(ia, ib, d), cos_i8, 1e-5));
+      assert(_test_distance_l1_int8(ia, ib, d) == l1_i8);
+      assert(_test_distance_hamming(ba, bb, d * 8) == ham);
+    }
+  }
+
+  _test_distance_kernels_init(3);
+  free(fa);
+  free(fb);
+  free(ia);
+  free(ib);
+  free(ba);
+  free(bb);
+  printf("  All distance_kernels_dispatch tests passed.\n");
+}
+
+// vec0_parse_vector_column() picks a distance function per column, with
+// fixed-width kernels for common embedding sizes. Whichever one it picks must
+// agree with the generic kernels, and so must the early-abandoning ones.
+void test_vec0_column_distance_fn() {
+  printf("Starting %s...\n", __func__);
+  const char *metrics[] = {"l2", "cosine", "l1"};
+  size_t dims[] = {3, 383, 384, 768, 1000, 1024, 1536};
+  size_t max_dims = 1536;
+  float *fa = malloc(max_dims * sizeof(float));
+  float *fb = malloc(max_dims * sizeof(float));
+  assert(fa && fb);
+  for (size_t i = 0; i < max_dims; i++) {
+    fa[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+    fb[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+  }
+
+  int max_level = _test_distance_kernels_init(3);
+  for (int level = 0; level <= max_level; level++) {
+    assert(_test_distance_kernels_init(level) == level);
+    for (size_t t = 0; t < countof(dims); t++) {
+      size_t d = dims[t];
+      for (size_t m = 0; m < countof(metrics); m++) {
+        char input[64];
+        snprintf(input, sizeof(input), "v float[%zu] distance_metric=%s", d,
+                 metrics[m]);
+        struct VectorColumnDefinition col;
+        int rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+        assert(rc == SQLITE_OK);
+        assert(col.distance_fn != NULL);
+
+        double expected;
+        if (m == 0) {
+          expected = _test_distance_l2_sqr_float(fa, fb, d);
+        } else if (m == 1) {
+          expected = _test_distance_cosine_float(fa, fb, d);
+        } else {
+          expected = _test_distance_l1_f32(fa, fb, d);
+        }
+        double actual = col.distance_fn(fa, fb, &d);
+        if (m == 0) {
+          // L2 columns rank by squared distance
+          actual = sqrtf((float)actual);
+        }
+        assert(test_close(actual, expected, 1e-5));
+
+        // cosine has no early-abandoning kernel, short vectors don't need one
+        assert((col.distance_bounded_fn != NULL) == (m != 1 && d > 64));
+        if (col.distance_bounded_fn) {
+          float full = col.distance_bounded_fn(fa, fb, &d, INFINITY);
+          assert(test_close(full, col.distance_fn(fa, fb, &d), 1e-5));
+          // exact whenever it's within the bound
+          assert(col.distance_bounded_fn(fa, fb, &d, full) == full);
+          assert(col.distance_bounded_fn(fa, fb, &d, full * 0.25f) >
+                 full * 0.25f);
+          // fixed-width L2 kernels have a bounded twin with the same sums
+          if (m == 0 && level >= 2 && d % 128 == 0) {
+            assert(full == col.distance_fn(fa, fb, &d));
+            assert(col.distance_bounded_fn(fa, fb, &d, full * 2) == full);
+          }
+        }
+        sqlite3_free(col.name);
+      }
+    }
+  }
+
+  _test_distance_kernels_init(3);
+  free(fa);
+  free(fb);
+  printf("  All vec0_column_distance_fn tests passed.\n");
+}
+
+// normalize=1 columns score with 1 - dot, which must match the full cosine
+// kernel once both vectors are unit length.
+void test_distance_cosine_unit_float() {
+  printf("Starting %s...\n", __func__);
+  size_t dims[] = {1, 3, 7, 8, 15, 16, 17, 31, 33, 63, 65, 384, 1000};
+  size_t max_dims = 1000;
+  float *fa = malloc(max_dims * sizeof(float));
+  float *fb = malloc(max_dims * sizeof(float));
+  assert(fa && fb);
+
+  int max_level = _test_distance_kernels_init(3);
+  for (size_t t = 0; t < countof(dims); t++) {
+    size_t d = dims[t];
+    double na = 0, nb = 0;
+    for (size_t i = 0; i < d; i++) {
+      fa[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+      fb[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+      na += fa[i] * fa[i];
+      nb += fb[i] * fb[i];
+    }
+    for (size_t i = 0; i < d; i++) {
+      fa[i] = (float)(fa[i] / sqrt(na));
+      fb[i] = (float)(fb[i] / sqrt(nb));
+    }
+    for (int level = 0; level <= max_level; level++) {
+      assert(_test_distance_kernels_init(level) == level);
+      float expected = _test_distance_cosine_float(fa, fb, d);
+      assert(test_close(_test_distance_cosine_unit_float(fa, fb, d), expected,
+                        1e-5));
+    }
+  }
+
+  _test_distance_kernels_init(3);
+  free(fa);
+  free(fb);
+  printf("  All distance_cosine_unit_float tests passed.\n");
+}
+
+// The KNN top-k heap must keep exactly the k smallest entries, ascending, with
+// ties kept in push order.
+void test_topk() {
+  printf("Starting %s...\n", __func__);
+  enum { N = 2000 };
+  float distances[N];
+  int64_t rowids[N];
+  float out_distances[N];
+  int64_t out_rowids[N];
+  for (int i = 0; i < N; i++) {
+    // coarse values, so plenty of ties
+    distances[i] = (float)(test_rng_next() % 97);
+    rowids[i] = i;
+  }
+
+  int32_t ks[] = {1, 2, 10, 100, 1999, 2000};
+  for (size_t t = 0; t < countof(ks); t++) {
+    int32_t k = ks[t];
+    int used = _test_topk(distances, rowids, N, k, out_distances, out_rowids);
+    assert(used == k);
+    for (int i = 0; i < used; i++) {
+      // the rank of entry i: entries that sort strictly before it
+      int before = 0;
+      int64_t r = out_rowids[i];
+      for (int j = 0; j < N; j++) {
+        if (distances[j] < distances[r] ||
+            (distances[j] == distances[r] && rowids[j] < r)) {
+          before++;
+        }
+      }
+      assert(before == i);
+      assert(out_distances[i] == distances[r]);
+    }
+  }
+
+  // fewer entries than k
+  {
+    int used = _test_topk(distances, rowids, 5, 10, out_distances, out_rowids);
+    assert(used == 5);
+    for (int i = 1; i < used; i++) {
+      assert(out_distances[i - 1] <= out_distances[i]);
+    }
+  }
+
+  // NaN ranks after +inf, and both still fill a heap that isn't full
+  {
+    float d[] = {NAN, INFINITY, 2.0f, NAN, 1.0f, INFINITY};
+    int64_t r[] = {0, 1, 2, 3, 4, 5};
+    int used = _test_topk(d, r, 6, 6, out_distances, out_rowids);
+    assert(used == 6);
+    int64_t expected[] = {4, 2, 1, 5, 0, 3};
+    for (int i = 0; i < used; i++) {
+      assert(out_rowids[i] == expected[i]);
+    }
+    used = _test_topk(d, r, 6, 4, out_distances, out_rowids);
+    assert(used == 4);
+    assert(out_rowids[3] == 5);
+    used = _test_topk(d, r, 1, 1, out_distances, out_rowids);
+    assert(used == 1 && isnan(out_distances[0]));
+  }
+  printf("  All topk tests passed.\n");
+}
+
+// distances_for_chunk() must score exactly the rows set in the validity
+// bitmap, including empty 64-row words and a final partial word.
+void test_distances_for_chunk() {
+  printf("Starting %s...\n", __func__);
+  size_t dims = 5;
+  int32_t n = 200;
+  float *base = malloc(n * dims * sizeof(float));
+  float query[5] = {0.5f, -1.0f, 2.0f, 0.0f, 3.25f};
+  float out[200];
+  unsigned char validity[25];
+  assert(base);
+  for (size_t i = 0; i < n * dims; i++) {
+    base[i] = ((float)(test_rng_next() % 2001) - 1000.0f) / 100.0f;
+  }
+
+  unsigned char patterns[][25] = {
+      {0},
+      {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+       0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+       0xFF},
+      // rows 0, 9, 63, 64, then nothing until the last partial word
+      {0x01, 0x02, 0, 0, 0, 0, 0, 0x80, 0x01, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+       0, 0, 0, 0, 0x90},
+  };
+  for (size_t t = 0; t < countof(patterns) + 1; t++) {
+    if (t < countof(patterns)) {
+      memcpy(validity, patterns[t], sizeof(validity));
+    } else {
+      for (size_t i = 0; i < sizeof(validity); i++) {
+        validity[i] = (unsigned char)(test_rng_next() & 0xFF);
+      }
+    }
+    for (int32_t i = 0; i < n; i++) {
+      out[i] = -1.0f;
+    }
+    _test_distances_for_chunk_l2_float(query, base, dims, n, validity, out);
+    for (int32_t i = 0; i < n; i++) {
+      if (validity[i / 8] & (1 << (i % 8))) {
+        assert(out[i] ==
+               _test_distance_l2_sqr_float(base + i * dims, query, dims));
+      } else {
+        assert(out[i] == -1.0f);
+      }
+    }
+  }
+
+  free(base);
+  printf("  All distances_for_chunk tests passed.\n");
+}
+
+// Integer and float metadata filters, at every kernel level, against a
+// per-row comparison. Rows not set in the candidate bitmap must stay unset.
+void test_metadata_filter_numeric() {
+  printf("Starting %s...\n", __func__);
+  const char ops[] = {'a', 'b', 'c', 'd', 'e', 'f'};
+  int32_t n = 200;
+  int64_t ints[200];
+  double floats[200];
+  unsigned char candidates[25];
+  unsigned char b[25];
+  for (int32_t i = 0; i < n; i++) {
+    ints[i] = (int64_t)(test_rng_next() % 9) - 4;
+    // past 2^53 only the integer compare tells these apart
+    if (i % 17 == 0) {
+      ints[i] = INT64_MAX - (int64_t)(test_rng_next() % 3);
+    }
+    floats[i] = (double)ints[i] / 2.0;
+  }
+  for (size_t i = 0; i < sizeof(candidates); i++) {
+    candidates[i] = (unsigned char)(test_rng_next() & 0xFF);
+  }
+  candidates[2] = 0;
+
+  int max_level = _test_distance_kernels_init(3);
+  for (int level = 0; level <= max_level; level++) {
+    assert(_test_distance_kernels_init(level) == level);
+    for (size_t o = 0; o < countof(ops); o++) {
+      int64_t targets[] = {-4, 0, 2, 7, INT64_MAX - 1};
+      for (size_t t = 0; t < countof(targets); t++) {
+        for (int isFloat = 0; isFloat <= 1; isFloat++) {
+          int64_t ti = targets[t];
+          double tf = (double)targets[t] / 2.0;
+          memcpy(b, candidates, sizeof(b));
+          _test_metadata_filter_numeric(b, n, isFloat,
+                                        isFloat ? (void *)floats : (void *)ints,
+                                        ops[o], ti, tf);
+          for (int32_t i = 0; i < n; i++) {
+            int cmp = isFloat ? (floats[i] > tf) - (floats[i] < tf)
+                              : (ints[i] > ti) - (ints[i] < ti);
+            int pass = 0;
+            switch (ops[o]) {
+            case 'a': pass = cmp == 0; break;
+            case 'b': pass = cmp > 0; break;
+            case 'c': pass = cmp <= 0; break;
+            case 'd': pass = cmp < 0; break;
+            case 'e': pass = cmp >= 0; break;
+            case 'f': pass = cmp != 0; break;
+            }
+            int candidate = (candidates[i / 8] >> (i % 8)) & 1;
+            assert(((b[i / 8] >> (i % 8)) & 1) == (candidate && pass));
+          }
+        }
+      }
+    }
+  }
+  _test_distance_kernels_init(3);
+  printf("  All metadata_filter_numeric tests passed.\n");
+}
+
+// Distance constraints on L2 columns are checked against squared distances,
+// and must agree exactly with comparing the reported sqrtf() distance.
+void test_squared_distance_bound() {
+  printf("Starting %s...\n", __func__);
+  float targets[] = {-1.0f, 0.0f, 1e-20f, 0.5f, 1.0f, 2.0f, 3.0f, 1234.567f};
+  for (size_t t = 0; t < countof(targets) + 200; t++) {
+    float target = t < countof(targets)
+                       ? targets[t]
+                       : (float)(test_rng_next() % 100000) / 997.0f;
+    float lo = _test_squared_distance_bound(target, 0);
+    float hi = _test_squared_distance_bound(target, 1);
+    assert(sqrtf(lo) >= target);
+    assert(lo == 0.0f || !(sqrtf(nextafterf(lo, 0.0f)) >= target));
+    assert(sqrtf(hi) > target);
+    assert(hi == 0.0f || !(sqrtf(nextafterf(hi, 0.0f)) > target));
+    // every squared distance near the boundary lands on the same side
+    float s = target > 0 ? target * target : 0.0f;
+    for (int i = 0; i < 8; i++) {
+      s = nextafterf(s, 0.0f);
+    }
+    for (int i = 0; i < 16; i++) {
+      assert((sqrtf(s) < target) == (s < lo));
+      assert((sqrtf(s) <= target) == (s < hi));
+      s = nextafterf(s, INFINITY);
+    }
+  }
+  printf("  All squared_distance_bound tests passed.\n");
+}
+
+// The box bound must never exceed a kernel's distance to a point inside the
+// box, whichever SIMD level scores it, or KNN scans would skip real results.
+void test_vector_bounds_distance() {
+  printf("Starting %s...\n", __func__);
+  size_t dimss[] = {1, 7, 64, 1536};
+  static float points[8][1536];
+  static float bounds[2 * 1536];
+  static float query[1536];
+  static float corner[1536];
+
+  for (size_t t = 0; t < countof(dimss); t++) {
+    size_t dims = dimss[t];
+    for (size_t d = 0; d < dims; d++) {
+      bounds[d] = INFINITY;
+      bounds[dims + d] = -INFINITY;
+    }
+    assert(isinf(_test_vector_bounds_distance(0, 1, bounds, query, dims)));
+    assert(isinf(_test_vector_bounds_distance(1, 0, bounds, query, dims)));
+
+    for (int i = 0; i < 8; i++) {
+      for (size_t d = 0; d < dims; d++) {
+        points[i][d] = (float)(test_rng_next() % 2000) / 1000.0f - 1.0f;
+        bounds[d] = points[i][d] < bounds[d] ? points[i][d] : bounds[d];
+        bounds[dims + d] =
+            points[i][d] > bounds[dims + d] ? points[i][d] : bounds[dims + d];
+      }
+    }
+    // inside the box
+    for (size_t d = 0; d < dims; d++) {
+      query[d] = (bounds[d] + bounds[dims + d]) / 2;
+    }
+    assert(_test_vector_bounds_distance(0, 1, bounds, query, dims) == 0.0f);
+    assert(_test_vector_bounds_distance(1, 0, bounds, query, dims) == 0.0f);
+
+    // outside: at or below every point, and close to the nearest corner
+    for (size_t d = 0; d < dims; d++) {
+      query[d] = (float)(test_rng_next() % 6000) / 1000.0f - 3.0f;
+      corner[d] = query[d] < bounds[d]          ? bounds[d]
+                  : query[d] > bounds[dims + d] ? bounds[dims + d]
+                                                : query[d];
+    }
+    float l2 = _test_vector_bounds_distance(0, 1, bounds, query, dims);
+    float l2root = _test_vector_bounds_distance(0, 0, bounds, query, dims);
+    float l1 = _test_vector_bounds_distance(1, 0, bounds, query, dims);
+
+    int max_level = _test_distance_kernels_init(3);
+    for (int level = 0; level <= max_level; level++) {
+      assert(_test_distance_kernels_init(level) == level);
+      for (int i = 0; i < 8; i++) {
+        assert(l2 <= _test_distance_l2_squared_float(points[i], query, dims));
+        assert(l2root <= _test_distance_l2_sqr_float(points[i], query, dims));
+        assert(l1 <= _test_distance_l1_f32(points[i], query, dims));
+      }
+      assert(l2 <= _test_distance_l2_squared_float(corner, query, dims));
+      assert(l2 >= _test_distance_l2_squared_float(corner, query, dims) * 0.99f);
+      assert(l2root <= _test_distance_l2_sqr_float(corner, query, dims));
+      assert(l1 <= _test_distance_l1_f32(corner, query, dims));
+      assert(l1 >= _test_distance_l1_f32(corner, query, dims) * 0.99f);
+    }
+    _test_distance_kernels_init(3);
+  }
+  printf("  All vector_bounds_distance tests passed.\n");
+}
+
+// int8 kernels widen before multiplying: -128 vs 127 gives a per-dimension
+// difference of 255 and squares that don't fit in i16.
+void test_distance_int8_extremes() {
+  printf("Starting %s...\n", __func__);
+  int8_t a[1024];
+  int8_t b[1024];
+  memset(a, -128, sizeof(a));
+  memset(b, 127, sizeof(b));
+
+  int max_level = _test_distance_kernels_init(3);
+  for (int level = 0; level <= max_level; level++) {
+    assert(_test_distance_kernels_init(level) == level);
+    assert(_test_distance_l1_int8(a, b, 1024) == 255 * 1024);
+    assert(_test_distance_l1_int8(a, b, 1000) == 255 * 1000);
+    // the scalar kernel accumulates in f32, which is inexact past 2^24
+    assert(test_close(_test_distance_l2_sqr_int8(a, b, 1024), 255.0 * 32.0,
+                      1e-5));
+    assert(fabsf(_test_distance_cosine_int8(a, b, 1024) - 2.0f) < 1e-6f);
+    assert(fabsf(_test_distance_cosine_int8(a, a, 1000) - 0.0f) < 1e-6f);
+  }
+
+  _test_distance_kernels_init(3);
+  printf("  All distance_int8_extremes tests passed.\n");
+}
+
 #ifdef SQLITE_VEC_ENABLE_RESCORE
 
 void test_rescore_quantize_float_to_bit() {
@@ -992,11 +1543,134 @@ void test_rescore_quantize_float_to_int8() {
   printf("Starting %s...\n", __func__);
   int8_t dst[256];
 
-  // Uniform vector -> all zeros (range=0)
+  // Fixed [-1, 1] range: endpoints map to [-128, 127] (max may lose 1 to
+  // float rounding)
   {
-    float src[8] = {5.0f, 5.0f, 5.0f, 5.0f, 5.0f, 5.0f, 5.0f, 5.0f};
-    _test_rescore_quantize_float_to_int8(src, dst, 8);
-    for (int i = 0; i < 8; i++) {
+    float src[2] = {-1.0f, 1.0f};
+    _test_rescore_quantize_float_to_int8(src, dst, 2);
+    assert(dst[0] == -128);
+    assert(dst[1] >= 126 && dst[1] <= 127);
+  }
+
+  // Zero maps to the middle of the range
+  {
+    float src[1] = {0.0f};
+    _test_rescore_quantize_float_to_int8(src, dst, 1);
+    assert(dst[0] == 0);
+  }
+
+  // Out-of-range values are clamped
+  {
+    float src[4] = {5.0f, -5.0f, 100.0f, -100.0f};
+    _test_rescore_quantize_float_to_int8(src, dst, 4);
+    assert(dst[0] == 127);
+    assert(dst[1] == -128);
+    assert(dst[2] == 127);
+    assert(dst[3] == -128);
+  }
+
+  // Monotonic within range
+  {
+    float src[5] = {-0.9f, -0.5f, 0.1f, 0.5f, 0.9f};
+    _test_rescore_quantize_float_to_int8(src, dst, 5);
+    for (int i = 1; i < 5; i++) {
+      assert(dst[i] > dst[i - 1]);
+    }
+  }
+
+  printf("  All rescore_quantize_float_to_int8 tests passed.\n");
+}
+
+void test_rescore_quantized_byte_size() {
+  printf("Starting %s...\n", __func__);
+
+  // Bit quantizer: dims/8
+  assert(_test_rescore_quantized_byte_size_bit(128) == 16);
+  assert(_test_rescore_quantized_byte_size_bit(8) == 1);
+  assert(_test_rescore_quantized_byte_size_bit(1024) == 128);
+
+  // Int8 quantizer: dims
+  assert(_test_rescore_quantized_byte_size_int8(128) == 128);
+  assert(_test_rescore_quantized_byte_size_int8(8) == 8);
+  assert(_test_rescore_quantized_byte_size_int8(1024) == 1024);
+
+  printf("  All rescore_quantized_byte_size tests passed.\n");
+}
+
+void test_vec0_parse_vector_column_rescore() {
+  printf("Starting %s...\n", __func__);
+  struct VectorColumnDefinition col;
+  int rc;
+
+  // Basic bit quantizer
+  {
+    const char *input = "emb float[128] indexed by rescore(quantizer=bit)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
+    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT);
+    assert(col.rescore.oversample == 8); // default
+    sqlite3_free(col.name);
+  }
+
+  // Int8 quantizer
+  {
+    const char *input = "emb float[128] indexed by rescore(quantizer=int8)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
+    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_INT8);
+    sqlite3_free(col.name);
+  }
+
+  // Bit quantizer with oversample
+  {
+    const char *input = "emb float[128] indexed by rescore(quantizer=bit, oversample=16)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
+    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT);
+    assert(col.rescore.oversample == 16);
+    sqlite3_free(col.name);
+  }
+
+  // Error: non-float element type
+  {
+    const char *input = "emb int8[128] indexed by rescore(quantizer=bit)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+
+  // Error: dims not divisible by 8 for bit quantizer
+  {
+    const char *input = "emb float[100] indexed by rescore(quantizer=bit)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+
+  // Error: missing quantizer
+  {
+    const char *input = "emb float[128] indexed by rescore(oversample=8)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_ERROR);
+  }
+
+  // With distance_metric=cosine
+  {
+    const char *input = "emb float[128] distance_metric=cosine indexed by rescore(quantizer=int8)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
+    assert(col.distance_metric == VEC0_DISTANCE_METRIC_COSINE);
+    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_INT8);
+    sqlite3_free(col.name);
+  }
+
+  printf("  All vec0_parse_vector_column_rescore tests passed.\n");
+}
+
+#endif /* SQLITE_VEC_ENABLE_RESCORE */
+
 #if SQLITE_VEC_ENABLE_IVF
 void test_ivf_quantize_int8() {
   printf("Starting %s...\n", __func__);
@@ -1033,63 +1707,6 @@ void test_ivf_quantize_int8() {
     }
   }
 
-  // [0.0, 1.0] -> should map to [-128, 127]
-  {
-    float src[2] = {0.0f, 1.0f};
-    _test_rescore_quantize_float_to_int8(src, dst, 2);
-    assert(dst[0] == -128);
-    assert(dst[1] == 127);
-  }
-
-  // [-1.0, 0.0] -> should map to [-128, 127]
-  {
-    float src[2] = {-1.0f, 0.0f};
-    _test_rescore_quantize_float_to_int8(src, dst, 2);
-    assert(dst[0] == -128);
-    assert(dst[1] == 127);
-  }
-
-  // Single-element: range=0 -> 0
-  {
-    float src[1] = {42.0f};
-    _test_rescore_quantize_float_to_int8(src, dst, 1);
-    assert(dst[0] == 0);
-  }
-
-  // Verify range: all outputs in [-128, 127], min near -128, max near 127
-  {
-    float src[4] = {-100.0f, 0.0f, 100.0f, 50.0f};
-    _test_rescore_quantize_float_to_int8(src, dst, 4);
-    for (int i = 0; i < 4; i++) {
-      assert(dst[i] >= -128 && dst[i] <= 127);
-    }
-    // Min maps to -128 (exact), max maps to ~127 (may lose 1 to float rounding)
-    assert(dst[0] == -128);
-    assert(dst[2] >= 126 && dst[2] <= 127);
-    // Middle value (50) should be positive
-    assert(dst[3] > 0);
-  }
-
-  printf("  All rescore_quantize_float_to_int8 tests passed.\n");
-}
-
-void test_rescore_quantized_byte_size() {
-  printf("Starting %s...\n", __func__);
-
-  // Bit quantizer: dims/8
-  assert(_test_rescore_quantized_byte_size_bit(128) == 16);
-  assert(_test_rescore_quantized_byte_size_bit(8) == 1);
-  assert(_test_rescore_quantized_byte_size_bit(1024) == 128);
-
-  // Int8 quantizer: dims
-  assert(_test_rescore_quantized_byte_size_int8(128) == 128);
-  assert(_test_rescore_quantized_byte_size_int8(8) == 8);
-  assert(_test_rescore_quantized_byte_size_int8(1024) == 1024);
-
-  printf("  All rescore_quantized_byte_size tests passed.\n");
-}
-
-void test_vec0_parse_vector_column_rescore() {
   // Negative zero
   {
     float src[] = {-0.0f};
@@ -1187,108 +1804,10 @@ void test_ivf_quantize_binary() {
 }
 
 void test_ivf_config_parsing() {
-void test_vec0_parse_vector_column_diskann() {
   printf("Starting %s...\n", __func__);
   struct VectorColumnDefinition col;
   int rc;
 
-  // Basic bit quantizer
-  {
-    const char *input = "emb float[128] indexed by rescore(quantizer=bit)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
-    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT);
-    assert(col.rescore.oversample == 8); // default
-  // Existing syntax (no INDEXED BY) should have diskann.enabled == 0
-  {
-    const char *input = "emb float[128]";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type != VEC0_INDEX_TYPE_DISKANN);
-    sqlite3_free(col.name);
-  }
-
-  // With distance_metric but no INDEXED BY
-  {
-    const char *input = "emb float[128] distance_metric=cosine";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type != VEC0_INDEX_TYPE_DISKANN);
-    assert(col.distance_metric == VEC0_DISTANCE_METRIC_COSINE);
-    sqlite3_free(col.name);
-  }
-
-  // Basic binary quantizer
-  {
-    const char *input = "emb float[128] INDEXED BY diskann(neighbor_quantizer=binary)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type == VEC0_INDEX_TYPE_DISKANN);
-    assert(col.diskann.quantizer_type == VEC0_DISKANN_QUANTIZER_BINARY);
-    assert(col.diskann.n_neighbors == 72);  // default
-    assert(col.diskann.search_list_size == 128);  // default
-    assert(col.dimensions == 128);
-    sqlite3_free(col.name);
-  }
-
-  // Int8 quantizer
-  {
-    const char *input = "emb float[128] indexed by rescore(quantizer=int8)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
-    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_INT8);
-    sqlite3_free(col.name);
-  }
-
-  // Bit quantizer with oversample
-  {
-    const char *input = "emb float[128] indexed by rescore(quantizer=bit, oversample=16)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
-    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_BIT);
-    assert(col.rescore.oversample == 16);
-    sqlite3_free(col.name);
-  }
-
-  // Error: non-float element type
-  {
-    const char *input = "emb int8[128] indexed by rescore(quantizer=bit)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_ERROR);
-  }
-
-  // Error: dims not divisible by 8 for bit quantizer
-  {
-    const char *input = "emb float[100] indexed by rescore(quantizer=bit)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_ERROR);
-  }
-
-  // Error: missing quantizer
-  {
-    const char *input = "emb float[128] indexed by rescore(oversample=8)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_ERROR);
-  }
-
-  // With distance_metric=cosine
-  {
-    const char *input = "emb float[128] distance_metric=cosine indexed by rescore(quantizer=int8)";
-    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
-    assert(rc == SQLITE_OK);
-    assert(col.index_type == VEC0_INDEX_TYPE_RESCORE);
-    assert(col.distance_metric == VEC0_DISTANCE_METRIC_COSINE);
-    assert(col.rescore.quantizer_type == VEC0_RESCORE_QUANTIZER_INT8);
-    sqlite3_free(col.name);
-  }
-
-  printf("  All vec0_parse_vector_column_rescore tests passed.\n");
-}
-
-#endif /* SQLITE_VEC_ENABLE_RESCORE */
   // Default IVF config
   {
     const char *s = "v float[4] indexed by ivf()";
@@ -1399,6 +1918,44 @@ void test_vec0_parse_vector_column_diskann() {
   printf("  All ivf_config_parsing tests passed.\n");
 }
 #endif /* SQLITE_VEC_ENABLE_IVF */
+
+void test_vec0_parse_vector_column_diskann() {
+  printf("Starting %s...\n", __func__);
+  struct VectorColumnDefinition col;
+  int rc;
+
+  // Existing syntax (no INDEXED BY) should have diskann.enabled == 0
+  {
+    const char *input = "emb float[128]";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type != VEC0_INDEX_TYPE_DISKANN);
+    sqlite3_free(col.name);
+  }
+
+  // With distance_metric but no INDEXED BY
+  {
+    const char *input = "emb float[128] distance_metric=cosine";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type != VEC0_INDEX_TYPE_DISKANN);
+    assert(col.distance_metric == VEC0_DISTANCE_METRIC_COSINE);
+    sqlite3_free(col.name);
+  }
+
+  // Basic binary quantizer
+  {
+    const char *input = "emb float[128] INDEXED BY diskann(neighbor_quantizer=binary)";
+    rc = vec0_parse_vector_column(input, (int)strlen(input), &col);
+    assert(rc == SQLITE_OK);
+    assert(col.index_type == VEC0_INDEX_TYPE_DISKANN);
+    assert(col.diskann.quantizer_type == VEC0_DISKANN_QUANTIZER_BINARY);
+    assert(col.diskann.n_neighbors == 72);  // default
+    assert(col.diskann.search_list_size == 128);  // default
+    assert(col.dimensions == 128);
+    sqlite3_free(col.name);
+  }
+
   // INT8 quantizer
   {
     const char *input = "v float[64] INDEXED BY diskann(neighbor_quantizer=int8)";
@@ -2096,11 +2653,21 @@ int main() {
   test_distance_l2_sqr_float();
   test_distance_cosine_float();
   test_distance_hamming();
+  test_distance_kernels_dispatch();
+  test_vec0_column_distance_fn();
+  test_distance_cosine_unit_float();
+  test_topk();
+  test_distances_for_chunk();
+  test_metadata_filter_numeric();
+  test_squared_distance_bound();
+  test_vector_bounds_distance();
+  test_distance_int8_extremes();
 #ifdef SQLITE_VEC_ENABLE_RESCORE
   test_rescore_quantize_float_to_bit();
   test_rescore_quantize_float_to_int8();
   test_rescore_quantized_byte_size();
   test_vec0_parse_vector_column_rescore();
+#endif
 #if SQLITE_VEC_ENABLE_IVF
   test_ivf_quantize_int8();
   test_ivf_quantize_binary();
@@ -0,0 +1,311 @@
+"""Tests for the 'write_behind=N' command, which stages inserted rows and
+writes them to their chunks in batches."""
+import sqlite3
+import struct
+import pytest
+from conftest import _has_build_flag
+
+
+def connect(path=":memory:"):
+    db = sqlite3.connect(path, isolation_level=None)
+    db.enable_load_extension(True)
+    db.load_extension("dist/vec0")
+    db.enable_load_extension(False)
+    return db
+
+
+@pytest.fixture()
+def db():
+    return connect()
+
+
+def float_vec(values):
+    """Pack a list of floats into a blob for sqlite-vec."""
+    return struct.pack(f"{len(values)}f", *values)
+
+
+def contents(db, table="v"):
+    return db.execute(f"select * from {table} order by rowid").fetchall()
+
+
+def staged(db, table="v"):
+    """Rows with no chunk position yet, read without going through vec0."""
+    return db.execute(
+        f"select count(*) from {table}_rowids where chunk_id is null"
+    ).fetchone()[0]
+
+
+def check_layout(db, table="v", partitions=()):
+    """Every row sits in exactly one valid slot of a chunk of its partition,
+    and every valid slot holds a row."""
+    for i, partition in enumerate(partitions):
+        assert db.execute(
+            f"select count(*) from {table} v join {table}_rowids r using (rowid) "
+            f"join {table}_chunks c on c.rowid = r.chunk_id "
+            f"where c.partition{i:02} is not v.{partition}"
+        ).fetchone()[0] == 0
+    slots = {}
+    for chunk_id, validity, rowids in db.execute(
+        f"select rowid, validity, rowids from {table}_chunks"
+    ):
+        for offset in range(len(validity) * 8):
+            if validity[offset // 8] >> (offset % 8) & 1:
+                slots[(chunk_id, offset)] = struct.unpack_from("q", rowids, offset * 8)[0]
+    positions = {
+        rowid: (chunk_id, offset)
+        for rowid, chunk_id, offset in db.execute(
+            f"select rowid, chunk_id, chunk_offset from {table}_rowids"
+        )
+    }
+    assert {v: k for k, v in slots.items()} == positions
+    assert len(slots) == len(positions)
+
+
+ALL_COLUMNS = (
+    "create virtual table v using vec0(user_id integer partition key, "
+    "embedding float[2] chunk_bounds=1, b bit[8], flag boolean, n integer, x float, name text, "
+    "+note text, chunk_size=8)"
+)
+
+
+def insert_all_columns(db, rowids):
+    for i in rowids:
+        db.execute(
+            "insert into v(rowid, user_id, embedding, b, flag, n, x, name, note) "
+            "values (?, ?, ?, vec_bit(?), ?, ?, ?, ?, ?)",
+            [
+                i,
+                i % 3,
+                float_vec([i, -i]),
+                bytes([i % 256]),
+                i % 2 == 0,
+                i * 1000,
+                i / 7,
+                f"short{i}" if i % 2 else f"a long text value for row {i}",
+                f"note {i}",
+            ],
+        )
+
+
+def test_write_behind_same_rows(db):
+    expected = connect()
+    expected.execute(ALL_COLUMNS)
+    insert_all_columns(expected, range(1, 61))
+
+    db.execute(ALL_COLUMNS)
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    insert_all_columns(db, range(1, 61))
+    assert staged(db) == 60
+    db.execute("commit")
+    assert staged(db) == 0
+
+    check_layout(db, partitions=["user_id"])
+    assert contents(db) == contents(expected)
+    # partitions take chunks in a different order, but as many
+    for sql in [
+        "select partition00, count(*) from v_chunks group by 1",
+        "select * from v_metadatatext03 order by rowid",
+        "select sum(free) from v_free_slots",
+    ]:
+        assert db.execute(sql).fetchall() == expected.execute(sql).fetchall(), sql
+    for chunk_id, blob in db.execute("select rowid, bounds from v_vector_bounds00"):
+        lo, hi = struct.unpack("2f", blob[:8]), struct.unpack("2f", blob[8:])
+        for (e,) in db.execute(
+            "select embedding from v where rowid in "
+            "(select rowid from v_rowids where chunk_id = ?)",
+            [chunk_id],
+        ):
+            values = struct.unpack("2f", e)
+            assert all(l <= x <= h for l, x, h in zip(lo, values, hi))
+    assert db.execute(
+        "select rowid, distance from v where embedding match '[20, -20]' "
+        "and k = 3 and user_id = 2 and flag = 1"
+    ).fetchall() == expected.execute(
+        "select rowid, distance from v where embedding match '[20, -20]' "
+        "and k = 3 and user_id = 2 and flag = 1"
+    ).fetchall()
+
+
+def test_write_behind_reads_see_staged_rows(db):
+    db.execute("create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)")
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    db.execute("insert into v(rowid, embedding, n) values (1, '[1, 1]', 10)")
+    db.execute("insert into v(rowid, embedding, n) values (2, '[2, 2]', 20)")
+    assert staged(db) == 2
+    assert db.execute("select rowid, n from v where rowid = 2").fetchall() == [(2, 20)]
+    assert staged(db) == 0
+
+    db.execute("insert into v(rowid, embedding, n) values (3, '[3, 3]', 30)")
+    assert db.execute(
+        "select rowid from v where embedding match '[3, 3]' and k = 1"
+    ).fetchall() == [(3,)]
+    db.execute("insert into v(rowid, embedding, n) values (4, '[4, 4]', 40)")
+    assert db.execute("select rowid from v where n > 30").fetchall() == [(4,)]
+
+    # deletes, updates and replaces of staged rows
+    db.execute("insert into v(rowid, embedding, n) values (5, '[5, 5]', 50)")
+    db.execute("insert into v(rowid, embedding, n) values (6, '[6, 6]', 60)")
+    db.execute("insert into v(rowid, embedding, n) values (7, '[7, 7]', 70)")
+    db.execute("delete from v where rowid = 5")
+    db.execute("insert into v(rowid, embedding, n) values (8, '[8, 8]', 80)")
+    db.execute("update v set n = 61 where rowid = 6")
+    db.execute("insert into v(rowid, embedding, n) values (9, '[9, 9]', 90)")
+    db.execute("insert or replace into v(rowid, embedding, n) values (9, '[9, 9]', 91)")
+    with pytest.raises(sqlite3.OperationalError, match="UNIQUE"):
+        db.execute("insert into v(rowid, embedding, n) values (8, '[8, 8]', 80)")
+    db.execute("commit")
+    check_layout(db)
+    assert db.execute("select rowid, n from v order by rowid").fetchall() == [
+        (1, 10), (2, 20), (3, 30), (4, 40), (6, 61), (7, 70), (8, 80), (9, 91)
+    ]
+
+
+def test_write_behind_threshold(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    db.execute("insert into v(v) values ('write_behind=4')")
+    db.execute("begin")
+    for i in range(1, 11):
+        db.execute("insert into v(rowid, embedding) values (?, '[1, 1]')", [i])
+    # written 4 rows at a time
+    assert staged(db) == 2
+    db.execute("commit")
+    check_layout(db)
+
+    # 0 goes back to writing every row right away
+    db.execute("insert into v(v) values ('write_behind=0')")
+    db.execute("begin")
+    db.execute("insert into v(rowid, embedding) values (11, '[1, 1]')")
+    assert staged(db) == 0
+    db.execute("commit")
+
+
+def test_write_behind_rollback(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    for i in range(1, 6):
+        db.execute("insert into v(rowid, embedding) values (?, '[1, 1]')", [i])
+    db.execute("rollback")
+    assert contents(db) == []
+    db.execute("insert into v(rowid, embedding) values (6, '[1, 1]')")
+    check_layout(db)
+
+    db.execute("begin")
+    db.execute("insert into v(rowid, embedding) values (7, '[1, 1]')")
+    # rows of a failed statement are dropped, those before it are kept
+    with pytest.raises(sqlite3.OperationalError, match="UNIQUE"):
+        db.execute(
+            "insert into v(rowid, embedding) select value, '[2, 2]' "
+            "from json_each('[8, 9, 10, 6]')"
+        )
+    db.execute("insert into v(rowid, embedding) values (11, '[1, 1]')")
+    db.execute("savepoint s")
+    db.execute("insert into v(rowid, embedding) values (12, '[1, 1]')")
+    db.execute("savepoint t")
+    db.execute("insert into v(rowid, embedding) values (13, '[1, 1]')")
+    db.execute("release t")
+    db.execute("insert into v(rowid, embedding) values (14, '[1, 1]')")
+    db.execute("rollback to s")
+    db.execute("insert into v(rowid, embedding) values (15, '[1, 1]')")
+    db.execute("release s")
+    db.execute("commit")
+    check_layout(db)
+    assert [r[0] for r in db.execute("select rowid from v")] == [6, 7, 11, 15]
+
+
+def test_write_behind_partitions(db):
+    db.execute(
+        "create virtual table v using vec0(user_id integer partition key, "
+        "name text partition key, embedding float[2], chunk_size=8)"
+    )
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    for i in range(1, 101):
+        db.execute(
+            "insert into v(rowid, user_id, name, embedding) values (?, ?, ?, ?)",
+            [i, i % 4, ["a", "b"][i % 3 == 0], float_vec([i, i])],
+        )
+    # NULL partition values are written right away, each to its own chunk
+    db.execute("insert into v(rowid, user_id, name, embedding) values (101, null, 'a', '[1, 1]')")
+    db.execute("insert into v(rowid, user_id, name, embedding) values (102, null, 'a', '[1, 1]')")
+    assert staged(db) == 100
+    db.execute("commit")
+    check_layout(db, partitions=["user_id", "name"])
+    assert db.execute(
+        "select count(*) from v_chunks where partition00 is null"
+    ).fetchone()[0] == 2
+    # rows fill whole chunks: at most one partly full chunk per partition
+    assert db.execute(
+        "select partition00, partition01 from v_free_slots f "
+        "join v_chunks c on c.rowid = f.rowid "
+        "where partition00 is not null group by 1, 2 having count(*) > 1"
+    ).fetchall() == []
+    assert db.execute(
+        "select rowid from v where user_id = 1 and name = 'b' "
+        "and embedding match '[0, 0]' and k = 2"
+    ).fetchall() == [(9,), (21,)]
+
+
+def test_write_behind_free_slots(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    for i in range(1, 21):
+        db.execute("insert into v(rowid, embedding) values (?, '[1, 1]')", [i])
+    db.execute("delete from v where rowid in (2, 3, 12)")
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    for i in range(100, 110):
+        db.execute("insert into v(rowid, embedding) values (?, '[2, 2]')", [i])
+    db.execute("commit")
+    check_layout(db)
+    assert db.execute(
+        "select rowid, chunk_id, chunk_offset from v_rowids where rowid >= 100"
+    ).fetchall() == [
+        (100, 1, 1), (101, 1, 2), (102, 2, 3), (103, 3, 4), (104, 3, 5),
+        (105, 3, 6), (106, 3, 7), (107, 4, 0), (108, 4, 1), (109, 4, 2),
+    ]
+    assert db.execute("select rowid, free from v_free_slots").fetchall() == [(4, 5)]
+
+
+def test_write_behind_rename(db):
+    db.execute("create virtual table v using vec0(embedding float[2], chunk_size=8)")
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    db.execute("insert into v(rowid, embedding) values (1, '[1, 1]')")
+    db.execute("alter table v rename to w")
+    db.execute("insert into w(rowid, embedding) values (2, '[2, 2]')")
+    db.execute("commit")
+    check_layout(db, "w")
+    assert [r[0] for r in db.execute("select rowid from w")] == [1, 2]
+
+
+def test_write_behind_errors(db):
+    db.execute("create virtual table v using vec0(embedding float[2], n integer, chunk_size=8)")
+    for bad in ["-1", "x", "", "2000000"]:
+        with pytest.raises(sqlite3.OperationalError, match="write_behind must be"):
+            db.execute(f"insert into v(v) values ('write_behind={bad}')")
+
+    # metadata values are checked when staged, not when written
+    db.execute("insert into v(v) values ('write_behind=1000')")
+    db.execute("begin")
+    with pytest.raises(sqlite3.OperationalError, match="Expected integer"):
+        db.execute(
+            "insert into v(rowid, embedding, n) select value, '[1, 1]', "
+            "iif(value = 3, 'x', value) from json_each('[1, 2, 3]')"
+        )
+    db.execute("insert into v(rowid, embedding, n) values (4, '[1, 1]', 4)")
+    db.execute("commit")
+    assert db.execute("select rowid, n from v").fetchall() == [(4, 4)]
+    check_layout(db)
+
+
+@pytest.mark.skipif(not _has_build_flag("rescore"), reason="rescore not enabled")
+def test_write_behind_indexed_columns(db):
+    db.execute(
+        "create virtual table v using vec0(embedding float[8] "
+        "indexed by rescore(quantizer=bit))"
+    )
+    with pytest.raises(sqlite3.OperationalError, match="not supported on indexed"):
+        db.execute("insert into v(v) values ('write_behind=100')")
+    db.execute("insert into v(v) values ('write_behind=0')")